@@ -0,0 +1,351 @@
+#include "fastcgi++/log.hpp"
+#include "fastcgi++/manager.hpp"
+#include "fastcgi++/request.hpp"
+#include "fastcgi++/metrics.hpp"
+#include "fastcgi++/poll.hpp"
+
+#include "report.hpp"
+
+#include <atomic>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+// In-process load generator for the full FastCGI stack.
+//
+// A Manager is started in this process and listens on both a Unix socket and
+// a TCP port. Client threads then hammer it through each transport in turn,
+// one connection per thread with a single request in flight at a time.
+//
+// Usage: load_benchmark [--transport unix|tcp|both] [--concurrency N]
+//                       [--duration seconds] [--threads N] [--size bytes]
+//                       [--phases] [--io-uring] [--early] [--json]
+//
+// With --phases the library times request phases as well and the 99th
+// percentile of each is reported. Those accumulate over the whole process so
+// pick a single transport when using it. With --io-uring the event loops
+// poll with io_uring if it is available. With --early requests are
+// dispatched as soon as their parameters arrive instead of waiting on the
+// empty IN record.
+
+namespace
+{
+    size_t responseSize = 64;
+    bool early = false;
+
+    class Hello: public Fastcgipp::Request<char>
+    {
+        bool earlyDispatch()
+        {
+            return early;
+        }
+
+        bool response()
+        {
+            static const std::string body(responseSize, 'x');
+            out << "Content-Type: text/plain\r\n\r\n" << body;
+            return true;
+        }
+    };
+
+    //! Append a FastCGI record to a buffer
+    void record(
+            std::vector<char>& buffer,
+            Fastcgipp::Protocol::RecordType type,
+            const char* content,
+            size_t size)
+    {
+        const size_t padding = (8-size%8)%8;
+        Fastcgipp::Protocol::Header header;
+        header.version = Fastcgipp::Protocol::version;
+        header.type = type;
+        header.fcgiId = 1;
+        header.contentLength = size;
+        header.paddingLength = padding;
+        header.reserved = 0;
+        const char* const raw = reinterpret_cast<const char*>(&header);
+        buffer.insert(buffer.end(), raw, raw+sizeof(header));
+        buffer.insert(buffer.end(), content, content+size);
+        buffer.insert(buffer.end(), padding, 0);
+    }
+
+    //! Build a complete keep-alive GET request
+    std::vector<char> request()
+    {
+        std::vector<char> buffer;
+
+        Fastcgipp::Protocol::BeginRequest begin;
+        std::memset(&begin, 0, sizeof(begin));
+        begin.role = Fastcgipp::Protocol::Role::RESPONDER;
+        begin.flags = Fastcgipp::Protocol::BeginRequest::keepConnBit;
+        record(
+                buffer,
+                Fastcgipp::Protocol::RecordType::BEGIN_REQUEST,
+                reinterpret_cast<const char*>(&begin),
+                sizeof(begin));
+
+        static const char* const parameters[][2] = {
+            {"REQUEST_METHOD", "GET"},
+            {"REQUEST_URI", "/benchmark?name=value&other=thing"},
+            {"QUERY_STRING", "name=value&other=thing"},
+            {"SCRIPT_NAME", "/benchmark"},
+            {"HTTP_HOST", "localhost"},
+            {"HTTP_USER_AGENT", "fastcgi++ load benchmark"},
+            {"HTTP_ACCEPT", "text/html,application/xhtml+xml"},
+            {"HTTP_ACCEPT_LANGUAGE", "en-CA,en;q=0.8"},
+            {"HTTP_COOKIE", "session=0123456789abcdef; theme=dark"},
+            {"REMOTE_ADDR", "127.0.0.1"},
+            {"REMOTE_PORT", "49003"},
+            {"SERVER_ADDR", "127.0.0.1"},
+            {"SERVER_PORT", "80"}};
+        std::string params;
+        for(const auto& parameter: parameters)
+        {
+            params += char(std::strlen(parameter[0]));
+            params += char(std::strlen(parameter[1]));
+            params += parameter[0];
+            params += parameter[1];
+        }
+        record(
+                buffer,
+                Fastcgipp::Protocol::RecordType::PARAMS,
+                params.data(),
+                params.size());
+        record(buffer, Fastcgipp::Protocol::RecordType::PARAMS, nullptr, 0);
+        record(buffer, Fastcgipp::Protocol::RecordType::IN, nullptr, 0);
+
+        return buffer;
+    }
+
+    int connectUnix(const std::string& path)
+    {
+        const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        sockaddr_un address;
+        std::memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        std::strncpy(
+                address.sun_path,
+                path.c_str(),
+                sizeof(address.sun_path)-1);
+        if(::connect(
+                    fd,
+                    reinterpret_cast<sockaddr*>(&address),
+                    sizeof(address)) != 0)
+        {
+            ::close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    int connectTcp(unsigned short port)
+    {
+        const int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in address;
+        std::memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if(::connect(
+                    fd,
+                    reinterpret_cast<sockaddr*>(&address),
+                    sizeof(address)) != 0)
+        {
+            ::close(fd);
+            return -1;
+        }
+        const int one = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        return fd;
+    }
+
+    //! Read until the END_REQUEST record of the request arrives
+    bool response(int fd, std::vector<char>& buffer)
+    {
+        size_t filled = 0;
+        size_t position = 0;
+        while(true)
+        {
+            while(filled-position >= sizeof(Fastcgipp::Protocol::Header))
+            {
+                const Fastcgipp::Protocol::Header& header =
+                    *reinterpret_cast<const Fastcgipp::Protocol::Header*>(
+                            buffer.data()+position);
+                const size_t size = sizeof(header)
+                    + header.contentLength
+                    + header.paddingLength;
+                if(filled-position < size)
+                    break;
+                if(header.type == Fastcgipp::Protocol::RecordType::END_REQUEST)
+                    return true;
+                position += size;
+            }
+            if(position == filled)
+                filled = position = 0;
+            if(buffer.size()-filled < 0x10000)
+                buffer.resize(filled+0x10000);
+            const ssize_t received = ::read(
+                    fd,
+                    buffer.data()+filled,
+                    buffer.size()-filled);
+            if(received <= 0)
+                return false;
+            filled += received;
+        }
+    }
+
+    struct Totals
+    {
+        std::atomic_ullong requests;
+        std::atomic_ullong errors;
+
+        Totals():
+            requests(0),
+            errors(0)
+        {}
+    };
+
+    void client(
+            const std::function<int()>& connect,
+            Benchmark::Clock::time_point deadline,
+            Fastcgipp::Metrics::Histogram& latency,
+            Totals& totals)
+    {
+        const std::vector<char> data(request());
+        std::vector<char> buffer;
+        int fd = connect();
+
+        while(Benchmark::Clock::now() < deadline)
+        {
+            if(fd < 0)
+            {
+                ++totals.errors;
+                fd = connect();
+                continue;
+            }
+            const auto start = Benchmark::Clock::now();
+            if(::send(fd, data.data(), data.size(), MSG_NOSIGNAL)
+                    != ssize_t(data.size()) || !response(fd, buffer))
+            {
+                ++totals.errors;
+                ::close(fd);
+                fd = connect();
+                continue;
+            }
+            latency.since(start);
+            ++totals.requests;
+        }
+        if(fd >= 0)
+            ::close(fd);
+    }
+
+    void run(
+            Benchmark::Report& report,
+            const std::string& transport,
+            const std::function<int()>& connect,
+            unsigned concurrency,
+            double duration)
+    {
+        Fastcgipp::Metrics::Histogram latency(
+                "load_latency_seconds",
+                "Client side request latency",
+                nullptr);
+        Totals totals;
+
+        const auto start = Benchmark::Clock::now();
+        const auto deadline = start
+            + std::chrono::microseconds(
+                    static_cast<long long>(duration*1e6));
+        std::vector<std::thread> threads;
+        for(unsigned i=0; i<concurrency; ++i)
+            threads.emplace_back(
+                    client,
+                    std::cref(connect),
+                    deadline,
+                    std::ref(latency),
+                    std::ref(totals));
+        for(auto& thread: threads)
+            thread.join();
+        const double elapsed = Benchmark::since(start);
+
+        report.add("load_"+transport);
+        report.value("concurrency", concurrency);
+        report.value("requests", totals.requests);
+        report.value("errors", totals.errors);
+        report.value("rps", totals.requests/elapsed);
+        report.value("p50_us", latency.quantile(0.5));
+        report.value("p90_us", latency.quantile(0.9));
+        report.value("p99_us", latency.quantile(0.99));
+        report.value("p999_us", latency.quantile(0.999));
+        if(Fastcgipp::Metrics::timing)
+        {
+            const std::pair<const char*, Fastcgipp::Metrics::Histogram*>
+                phases[] = {
+                    {"params", &Fastcgipp::Metrics::paramsTime},
+                    {"in", &Fastcgipp::Metrics::inTime},
+                    {"queue", &Fastcgipp::Metrics::queueTime},
+                    {"response", &Fastcgipp::Metrics::responseTime},
+                    {"total", &Fastcgipp::Metrics::requestTime},
+                    {"send", &Fastcgipp::Metrics::sendTime}};
+            for(const auto& phase: phases)
+                report.value(
+                        std::string(phase.first)+"_p99_us",
+                        phase.second->quantile(0.99));
+        }
+        report.done();
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Fastcgipp::Logging::suppress = true;
+
+    const std::string transport(
+            Benchmark::option(argc, argv, "--transport", "both"));
+    const unsigned concurrency = std::stoul(
+            Benchmark::option(argc, argv, "--concurrency", "16"));
+    const double duration = std::stod(
+            Benchmark::option(argc, argv, "--duration", "5"));
+    const unsigned threads = std::stoul(Benchmark::option(
+                argc,
+                argv,
+                "--threads",
+                std::to_string(std::thread::hardware_concurrency())));
+    responseSize = std::stoul(
+            Benchmark::option(argc, argv, "--size", "64"));
+    Fastcgipp::Metrics::timing = Benchmark::flag(argc, argv, "--phases");
+    Fastcgipp::Poll::ioUring = Benchmark::flag(argc, argv, "--io-uring");
+    early = Benchmark::flag(argc, argv, "--early");
+    Benchmark::Report report(Benchmark::flag(argc, argv, "--json"));
+
+    const std::string path(
+            "/tmp/fastcgipp-load-"+std::to_string(::getpid()));
+    unsigned short port = 0;
+
+    Fastcgipp::Manager<Hello> manager(threads);
+    if(!manager.listen(path.c_str()))
+        FAIL_LOG("Unable to listen on " << path.c_str())
+    for(unsigned candidate=20000+::getpid()%20000; !port; ++candidate)
+        if(manager.listen("127.0.0.1", std::to_string(candidate).c_str()))
+            port = candidate;
+    manager.start();
+
+    if(transport == "unix" || transport == "both")
+        run(report, "unix", [&path] () { return connectUnix(path); },
+                concurrency, duration);
+    if(transport == "tcp" || transport == "both")
+        run(report, "tcp", [port] () { return connectTcp(port); },
+                concurrency, duration);
+
+    manager.terminate();
+    manager.join();
+    return 0;
+}
@@ -0,0 +1,312 @@
+#include "fastcgi++/log.hpp"
+#include "fastcgi++/http.hpp"
+#include "fastcgi++/fcgistreambuf.hpp"
+#include "fastcgi++/block.hpp"
+#include "fastcgi++/json.hpp"
+
+#include "report.hpp"
+
+#include <map>
+#include <string>
+#include <cstdlib>
+
+// Microbenchmarks for the hot paths of request parsing and output.
+//
+// Usage: parsing_benchmark [--time seconds] [--json]
+
+namespace
+{
+    double minimumTime = 0.5;
+
+    //! Run a function enough times to get a stable measurement
+    template<class Function> void measure(
+            Benchmark::Report& report,
+            const char* name,
+            size_t bytes,
+            Function&& function)
+    {
+        function();
+
+        unsigned long long iterations = 1;
+        double elapsed;
+        while(true)
+        {
+            const auto start = Benchmark::Clock::now();
+            for(unsigned long long i=0; i<iterations; ++i)
+                function();
+            elapsed = Benchmark::since(start);
+            if(elapsed >= minimumTime)
+                break;
+            iterations *= 2;
+        }
+
+        report.add(name);
+        report.value("iterations", iterations);
+        report.value("ns_per_op", elapsed*1e9/iterations);
+        if(bytes)
+            report.value("mb_per_s", bytes*iterations/elapsed/1e6);
+        report.done();
+    }
+
+    const unsigned char parameters[] =
+#include "multipartParam.hpp"
+
+    const unsigned char post[] =
+#include "multipartPost.hpp"
+
+    const char* const parametersEnd = reinterpret_cast<const char*>(
+            parameters+sizeof(parameters)-1);
+
+    const std::string query(
+            "getVar=testing&secondGetVar=tested&utf8GetVarTest=%D0%BF%D1%80%D0"
+            "%BE%D0%B2%D0%B5%D1%80%D0%BA%D0%B0&enctype=multipart&name=John+Q."
+            "+Public&address=123+Main+St%2C+Anytown&email=john%40example.com&"
+            "comment=This+is+a+rather+long+comment+with+some+%22quoted%22+text"
+            "+and+%3Chtml%3E+in+it&page=12&sort=date&order=desc&filter=active");
+
+    const std::wstring text(
+            L"In botany, a tree is a perennial plant with an elongated stem, or "
+            L"trunk, supporting branches and leaves in most species. Де́рево — "
+            L"жизненная форма деревянистых растений. 나무는 나무질로 된 줄기를 "
+            L"가지고 있는 여러해살이 식물이다.\n");
+}
+
+int main(int argc, char** argv)
+{
+    Fastcgipp::Logging::suppress = true;
+    minimumTime = std::atof(
+            Benchmark::option(argc, argv, "--time", "0.5").c_str());
+    Benchmark::Report report(Benchmark::flag(argc, argv, "--json"));
+
+    {
+        Fastcgipp::Http::Environment<wchar_t> environment;
+        measure(report, "environment_fill", parametersEnd-
+                reinterpret_cast<const char*>(parameters),
+                [&environment] ()
+                {
+                    environment.clear();
+                    environment.fill(
+                            reinterpret_cast<const char*>(parameters),
+                            parametersEnd);
+                });
+    }
+
+    {
+        Fastcgipp::Http::Environment<
+            wchar_t,
+            Fastcgipp::Http::FlatContainers> environment;
+        measure(report, "environment_fill_flat", parametersEnd-
+                reinterpret_cast<const char*>(parameters),
+                [&environment] ()
+                {
+                    environment.clear();
+                    environment.fill(
+                            reinterpret_cast<const char*>(parameters),
+                            parametersEnd);
+                });
+    }
+
+    {
+        Fastcgipp::Http::Environment<wchar_t> environment;
+        environment.parseLazily();
+        measure(report, "environment_fill_lazy", parametersEnd-
+                reinterpret_cast<const char*>(parameters),
+                [&environment] ()
+                {
+                    environment.clear();
+                    environment.fill(
+                            reinterpret_cast<const char*>(parameters),
+                            parametersEnd);
+                });
+    }
+
+    {
+        std::multimap<std::wstring, std::wstring> output;
+        measure(report, "decode_url_encoded", query.size(), [&output] ()
+                {
+                    output.clear();
+                    Fastcgipp::Http::decodeUrlEncoded(
+                            query.data(),
+                            query.data()+query.size(),
+                            output);
+                });
+    }
+
+    {
+        Fastcgipp::FlatMultimap<std::wstring, std::wstring> output;
+        measure(report, "decode_url_encoded_flat", query.size(), [&output] ()
+                {
+                    output.clear();
+                    Fastcgipp::Http::decodeUrlEncoded(
+                            query.data(),
+                            query.data()+query.size(),
+                            output);
+                });
+    }
+
+    {
+        Fastcgipp::Http::Environment<wchar_t> environment;
+        const char* const start = reinterpret_cast<const char*>(post);
+        const char* const end = start+sizeof(post);
+        measure(report, "multipart", sizeof(post),
+                [&environment, start, end] ()
+                {
+                    environment.clear();
+                    environment.fill(
+                            reinterpret_cast<const char*>(parameters),
+                            parametersEnd);
+                    environment.fillPostBuffer(start, end);
+                    environment.parsePostBuffer();
+                });
+    }
+
+    {
+        Fastcgipp::Http::Environment<wchar_t> environment;
+        environment.streamPosts();
+        const char* const start = reinterpret_cast<const char*>(post);
+        const char* const end = start+sizeof(post);
+        measure(report, "multipart_streamed", sizeof(post),
+                [&environment, start, end] ()
+                {
+                    environment.clear();
+                    environment.fill(
+                            reinterpret_cast<const char*>(parameters),
+                            parametersEnd);
+                    for(const char* chunk=start; chunk<end; chunk+=8192)
+                        environment.fillPostBuffer(
+                                chunk,
+                                std::min(chunk+8192, end));
+                    environment.parsePostBuffer();
+                });
+    }
+
+    {
+        size_t sent = 0;
+        Fastcgipp::FcgiStreambuf<wchar_t> streambuf;
+        streambuf.configure(
+                Fastcgipp::Protocol::RequestId(1, Fastcgipp::Socket()),
+                Fastcgipp::Protocol::RecordType::OUT,
+                [&sent] (const Fastcgipp::Socket&, Fastcgipp::Block&& record)
+                {
+                    sent += record.size();
+                });
+        std::basic_ostream<wchar_t> out(&streambuf);
+        measure(report, "fcgistreambuf_wide", 0, [&out] ()
+                {
+                    for(unsigned i=0; i<32; ++i)
+                        out << text;
+                    out.flush();
+                });
+    }
+
+    {
+        const std::string narrow(256, 'x');
+        Fastcgipp::FcgiStreambuf<char> streambuf;
+        streambuf.configure(
+                Fastcgipp::Protocol::RequestId(1, Fastcgipp::Socket()),
+                Fastcgipp::Protocol::RecordType::OUT,
+                [] (const Fastcgipp::Socket&, Fastcgipp::Block&&) {});
+        std::ostream out(&streambuf);
+        measure(report, "fcgistreambuf_narrow", 32*narrow.size(),
+                [&out, &narrow] ()
+                {
+                    for(unsigned i=0; i<32; ++i)
+                        out << narrow;
+                    out.flush();
+                });
+    }
+
+    {
+        const std::wstring html(L"<a href=\"x\">Él & 'ella'</a>");
+        Fastcgipp::FcgiStreambuf<wchar_t> streambuf;
+        streambuf.configure(
+                Fastcgipp::Protocol::RequestId(1, Fastcgipp::Socket()),
+                Fastcgipp::Protocol::RecordType::OUT,
+                [] (const Fastcgipp::Socket&, Fastcgipp::Block&&) {});
+        std::basic_ostream<wchar_t> out(&streambuf);
+        out << Fastcgipp::Encoding::HTML;
+        measure(report, "fcgistreambuf_html", 0, [&out, &html] ()
+                {
+                    for(unsigned i=0; i<32; ++i)
+                        out << html;
+                    out.flush();
+                });
+    }
+
+    {
+        const std::string ipv4("179.124.131.145");
+        const std::string ipv6("2001:db8:85a3::8a2e:370:7334");
+        Fastcgipp::Address address;
+        measure(report, "address_parse_ipv4", 0, [&address, &ipv4] ()
+                {
+                    address.assign(ipv4.data(), ipv4.data()+ipv4.size());
+                });
+        measure(report, "address_parse_ipv6", 0, [&address, &ipv6] ()
+                {
+                    address.assign(ipv6.data(), ipv6.data()+ipv6.size());
+                });
+
+        char buffer[Fastcgipp::Address::textSize];
+        char* volatile written;
+        measure(report, "address_format", 0, [&address, &buffer, &written] ()
+                {
+                    written = address.format(buffer);
+                });
+    }
+
+    {
+        Fastcgipp::FcgiStreambuf<char> streambuf;
+        streambuf.configure(
+                Fastcgipp::Protocol::RequestId(1, Fastcgipp::Socket()),
+                Fastcgipp::Protocol::RecordType::OUT,
+                [] (const Fastcgipp::Socket&, Fastcgipp::Block&&) {});
+        std::ostream out(&streambuf);
+        const std::string name("John \"Q.\" Public, 123 Main St, Anytown");
+        measure(report, "json_writer", 0, [&out, &name] ()
+                {
+                    {
+                        Fastcgipp::Json<char> json(out);
+                        json.beginArray();
+                        for(int i=0; i<64; ++i)
+                            json.beginObject()
+                                .field("id", i*7919)
+                                .field("name", name)
+                                .field("score", i*0.37)
+                                .endObject();
+                        json.endArray();
+                    }
+                    out.flush();
+                });
+        measure(report, "json_ostream", 0, [&out, &name] ()
+                {
+                    out << '[';
+                    for(int i=0; i<64; ++i)
+                    {
+                        if(i)
+                            out << ',';
+                        out << "{\"id\":" << i*7919 << ",\"name\":\"";
+                        for(const char character: name)
+                        {
+                            if(character == '"' || character == '\\')
+                                out << '\\';
+                            out << character;
+                        }
+                        out << "\",\"score\":" << i*0.37 << '}';
+                    }
+                    out << ']';
+                    out.flush();
+                });
+    }
+
+    for(const size_t size: {64, 8192, 65536})
+    {
+        const std::string name("block_allocate_"+std::to_string(size));
+        measure(report, name.c_str(), 0, [size] ()
+                {
+                    Fastcgipp::Block block(size);
+                    block.begin()[0] = 0;
+                });
+    }
+
+    return 0;
+}
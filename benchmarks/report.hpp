@@ -0,0 +1,113 @@
+#ifndef FASTCGIPP_BENCHMARKS_REPORT_HPP
+#define FASTCGIPP_BENCHMARKS_REPORT_HPP
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Benchmark
+{
+    typedef std::chrono::steady_clock Clock;
+
+    //! Seconds passed since a point in time
+    inline double since(Clock::time_point start)
+    {
+        return std::chrono::duration<double>(Clock::now()-start).count();
+    }
+
+    //! Collects results and prints them as text or JSON
+    /*!
+     * The JSON output is a single object with a "benchmarks" array so that
+     * results can be archived and compared between runs.
+     */
+    class Report
+    {
+    private:
+        struct Result
+        {
+            std::string name;
+            std::vector<std::pair<std::string, double>> values;
+        };
+
+        std::vector<Result> m_results;
+
+        bool m_json;
+
+    public:
+        Report(bool json):
+            m_json(json)
+        {}
+
+        //! Start a new result
+        void add(const std::string& name)
+        {
+            m_results.emplace_back();
+            m_results.back().name = name;
+            if(!m_json)
+                std::cout << std::left << std::setw(32) << name << std::flush;
+        }
+
+        //! Add a value to the last result
+        void value(const std::string& name, double value)
+        {
+            m_results.back().values.emplace_back(name, value);
+            if(!m_json)
+                std::cout << ' ' << name << '='
+                    << std::setprecision(9) << value << std::flush;
+        }
+
+        //! Finish the last result
+        void done()
+        {
+            if(!m_json)
+                std::cout << std::endl;
+        }
+
+        ~Report()
+        {
+            if(!m_json)
+                return;
+            std::cout << "{\"benchmarks\":[";
+            for(auto result=m_results.cbegin();
+                    result!=m_results.cend();
+                    ++result)
+            {
+                if(result != m_results.cbegin())
+                    std::cout << ',';
+                std::cout << "\n  {\"name\":\"" << result->name << '"';
+                for(const auto& value: result->values)
+                    std::cout << ",\"" << value.first << "\":"
+                        << std::setprecision(9) << value.second;
+                std::cout << '}';
+            }
+            std::cout << "\n]}" << std::endl;
+        }
+    };
+
+    //! Does the argument list contain a flag?
+    inline bool flag(int argc, char** argv, const std::string& name)
+    {
+        for(int i=1; i<argc; ++i)
+            if(argv[i] == name)
+                return true;
+        return false;
+    }
+
+    //! Value of an option in the argument list
+    inline std::string option(
+            int argc,
+            char** argv,
+            const std::string& name,
+            const std::string& fallback)
+    {
+        for(int i=1; i+1<argc; ++i)
+            if(argv[i] == name)
+                return argv[i+1];
+        return fallback;
+    }
+}
+
+#endif
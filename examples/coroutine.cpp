@@ -0,0 +1,56 @@
+//! The timer example written as a coroutine. Requires C++20.
+#include <thread>
+#include <chrono>
+#include <fastcgi++/coroutine.hpp>
+
+class Countdown: public Fastcgipp::AsyncRequest<char>
+{
+    Fastcgipp::Coroutine respond()
+    {
+        const auto start = std::chrono::steady_clock::now();
+
+        out <<
+"Content-Type: text/html; charset=iso-8859-1\r\n\r\n"
+"<!DOCTYPE html>\n"
+"<html lang='en'>"
+    "<head>"
+        "<meta charset='iso-8859-1' />"
+        "<title>fastcgi++: Coroutine</title>"
+    "</head>"
+    "<body>"
+        "<p>";
+
+        for(unsigned second=0; second<5; ++second)
+        {
+            out << second << "...";
+            out.flush();
+
+            co_await async([&] (
+                        const std::function<void(Fastcgipp::Message)>&)
+                    {
+                        delay(
+                                start+std::chrono::seconds(second+1)
+                                    -std::chrono::steady_clock::now(),
+                                Fastcgipp::Message(1));
+                    });
+        }
+
+        out << "5</p>"
+    "</body>"
+"</html>";
+    }
+};
+
+#include <fastcgi++/manager.hpp>
+
+int main()
+{
+    Fastcgipp::Manager<Countdown> manager(
+            std::max(1u, unsigned(std::thread::hardware_concurrency()/2)));
+    manager.setupSignals();
+    manager.listen();
+    manager.start();
+    manager.join();
+
+    return 0;
+}
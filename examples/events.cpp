@@ -0,0 +1,46 @@
+//! Streams a tick every second to every client as server-sent events
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include <fastcgi++/request.hpp>
+#include <fastcgi++/manager.hpp>
+
+Fastcgipp::Topic ticks;
+
+class Ticker: public Fastcgipp::Request<char>
+{
+    bool response()
+    {
+        out << "Content-Type: text/event-stream\r\n"
+            "Cache-Control: no-cache\r\n\r\n";
+        subscribe(ticks);
+        return true;
+    }
+};
+
+int main()
+{
+    Fastcgipp::Manager<Ticker> manager;
+    manager.setupSignals();
+    manager.listen();
+    manager.start();
+
+    std::atomic_bool running(true);
+    std::thread publisher([&running] ()
+            {
+                for(unsigned tick=1; running; ++tick)
+                {
+                    std::this_thread::sleep_for(std::chrono::seconds(1));
+                    const std::string id(std::to_string(tick));
+                    ticks.event("tick number "+id, "tick", id);
+                }
+            });
+
+    manager.join();
+    running = false;
+    publisher.join();
+
+    return 0;
+}
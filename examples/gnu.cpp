@@ -64,7 +64,7 @@ class Gnu: public Fastcgipp::Request<wchar_t>
         {
             out << "Last-Modified: "
                 << std::put_time(&startTime, L"%a, %d %b %Y %H:%M:%S GMT\n");
-            out << L"Etag: " << locale << '\n';
+            out << L"ETag: \"" << locale << L"\"\n";
             out << L"Content-Type: text/html; charset=utf-8\n";
             out << L"Content-Language: " << language << L"\r\n\r\n";
             //! [Uncached HTML]
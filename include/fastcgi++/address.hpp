@@ -31,6 +31,10 @@
 #include <array>
 #include <algorithm>
 #include <cstring>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <istream>
 
 //! Topmost namespace for the fastcgi++ library
 namespace Fastcgipp
@@ -52,6 +56,9 @@ namespace Fastcgipp
         //! This is the data length of the IPv6 address
         static constexpr size_t size=16;
 
+        //! Longest textual representation format() can produce
+        static constexpr size_t textSize=39;
+
         //! Data representation of the IPv6 address
         std::array<unsigned char, size> m_data;
 
@@ -101,7 +108,9 @@ namespace Fastcgipp
         /*!
          * In order for this to work the string must represent either an IPv4
          * address in standard textual decimal form (127.0.0.1) or an IPv6 in
-         * standard form.
+         * standard form. IPv4 addresses are stored mapped into IPv6
+         * (::ffff:127.0.0.1). Nothing is allocated and plain IPv4 addresses
+         * are tried first. If the string is malformed the address is zeroed.
          *
          * @param[in] start First character of the string
          * @param[in] end Last character of the string + 1
@@ -116,6 +125,28 @@ namespace Fastcgipp
             assign(string, string+std::strlen(string));
         }
 
+        //! Write the address out in text form
+        /*!
+         * IPv6 addresses are written in their canonical (RFC 5952) form and
+         * IPv4 ones as ::ffff:127.0.0.1. Nothing is allocated and no locale
+         * is consulted.
+         *
+         * @param[out] destination Where to write the text. Must have room for
+         *                         at least textSize characters. It is not null
+         *                         terminated.
+         * @return One past the last character written.
+         * @tparam charT Character type.
+         */
+        template<class charT> charT* format(charT* destination) const;
+
+        //! True if this is an IPv4 address mapped into IPv6
+        bool ipv4() const
+        {
+            static const unsigned char prefix[12] =
+                {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff};
+            return std::memcmp(m_data.data(), prefix, sizeof(prefix)) == 0;
+        }
+
         bool operator==(const Address& x) const
         {
             return std::equal(
@@ -151,8 +182,8 @@ namespace Fastcgipp
 
     //! Address stream insertion operation
     /*!
-     * This stream inserter obeys all stream manipulators regarding alignment,
-     * field width and numerical base.
+     * This writes the same text as Address::format() and obeys the stream
+     * manipulators regarding alignment and field width.
      */
     template<class charT, class Traits>
     std::basic_ostream<charT, Traits>& operator<<(
@@ -171,4 +202,27 @@ namespace Fastcgipp
             Address& address);
 }
 
+namespace std
+{
+    //! Lets addresses key unordered containers
+    template<> struct hash<Fastcgipp::Address>
+    {
+        size_t operator()(const Fastcgipp::Address& address) const noexcept
+        {
+            std::uint64_t high;
+            std::uint64_t low;
+            std::memcpy(&high, address.m_data.data(), sizeof(high));
+            std::memcpy(&low, address.m_data.data()+8, sizeof(low));
+
+            // IPv4 addresses only differ in the low half so it gets mixed
+            // through the whole word before the halves are combined.
+            std::uint64_t x = high ^ low*0x9e3779b97f4a7c15ULL;
+            x ^= x >> 32;
+            x *= 0xd6e8feb86659fd93ULL;
+            x ^= x >> 32;
+            return static_cast<size_t>(x);
+        }
+    };
+}
+
 #endif
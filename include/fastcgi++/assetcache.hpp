@@ -0,0 +1,173 @@
+/*!
+ * @file       assetcache.hpp
+ * @brief      Declares the AssetCache class
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 15, 2026
+ * @copyright  Copyright &copy; 2026 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2026 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#ifndef FASTCGIPP_ASSETCACHE_HPP
+#define FASTCGIPP_ASSETCACHE_HPP
+
+#include "fastcgi++/responsecache.hpp"
+#include "fastcgi++/compressor.hpp"
+
+#include <ctime>
+#include <map>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+
+//! Topmost namespace for the fastcgi++ library
+namespace Fastcgipp
+{
+    //! Static assets kept as ready to send FastCGI records
+    /*!
+     * Assets are added once, typically at startup, either from memory like
+     * an image compiled into the program or from a file which is mapped into
+     * memory just long enough to be read. Every asset is then compressed in
+     * each content coding we support that makes it smaller. Each of these
+     * is turned into the complete response with headers, ETag,
+     * Last-Modified and all, encoded as STDOUT records followed by an
+     * END_REQUEST record in an immutable shared buffer. The ETag is a hash
+     * of the asset in quotes, with the name of the content coding appended
+     * after a dash for compressed responses so every coding has it's own.
+     *
+     * A hit is then just a matter of picking the response in the right
+     * content coding and sending a slice of that buffer as is. Nothing is
+     * formatted, copied or allocated. The only exception is when the
+     * request ID isn't the one the records were built with. A copy is made
+     * with the IDs patched in that case, just like with ResponseCache.
+     *
+     * Assets are looked up by the path part of the request URI exactly as
+     * it is sent, query string aside. Requests use this by way of
+     * Request::asset(). Everything is thread safe so assets can be added or
+     * replaced while being served.
+     *
+     * @date    October 15, 2026
+     * @author  Eddie Carle &lt;eddie@isatec.ca&gt;
+     */
+    class AssetCache
+    {
+    public:
+        //! A single asset in every content coding it is available in
+        struct Asset
+        {
+            //! Complete responses indexed by the Compression they are in
+            /*!
+             * The response for Compression::NONE is always there. The rest
+             * have a size of zero unless they were worth compressing.
+             */
+            ResponseCache::Entry responses[4];
+
+            //! The response to send for a content coding
+            const ResponseCache::Entry& response(Compression compression) const
+            {
+                const ResponseCache::Entry& response
+                    = responses[static_cast<unsigned>(compression)];
+                return response.size ? response : responses[0];
+            }
+        };
+
+        AssetCache():
+            m_bytes(0)
+        {}
+
+        //! Add an asset from memory
+        /*!
+         * Any existing asset at the same path is replaced.
+         *
+         * @param[in] path Path part of the request URI
+         * @param[in] data Start of the asset
+         * @param[in] size Size of the asset
+         * @param[in] contentType Value of the Content-Type header
+         * @param[in] lastModified When the asset was last modified. Zero if
+         *                         unknown.
+         * @param[in] headers Any other headers to send with the asset. Each
+         *                    must end in a line break.
+         */
+        void insert(
+                const std::string& path,
+                const char* data,
+                size_t size,
+                const std::string& contentType,
+                std::time_t lastModified=0,
+                const std::string& headers=std::string());
+
+        //! Add an asset from a file
+        /*!
+         * The last modification time comes from the file.
+         *
+         * @param[in] path Path part of the request URI
+         * @param[in] filename File to read the asset from
+         * @param[in] contentType Value of the Content-Type header. Empty to
+         *                        guess it from the file's extension.
+         * @param[in] headers Any other headers to send with the asset. Each
+         *                    must end in a line break.
+         * @return False if the file couldn't be read.
+         */
+        bool load(
+                const std::string& path,
+                const std::string& filename,
+                const std::string& contentType=std::string(),
+                const std::string& headers=std::string());
+
+        //! Look up an asset
+        /*!
+         * @param[in] path Path part of the request URI
+         * @return The asset or null if there is none.
+         */
+        std::shared_ptr<const Asset> find(const std::string& path) const;
+
+        //! Remove an asset
+        void erase(const std::string& path);
+
+        //! Remove every asset
+        void clear();
+
+        //! Amount of assets in the cache
+        size_t size() const;
+
+        //! Bytes taken up by the records of every asset
+        size_t bytes() const;
+
+        //! Guess the content type of a file from it's extension
+        /*!
+         * @return The content type or application/octet-stream if the
+         *         extension isn't known.
+         */
+        static const char* contentType(const std::string& filename);
+
+    private:
+        //! Assets by path
+        std::map<std::string, std::shared_ptr<const Asset>> m_assets;
+
+        //! Bytes taken up by the records of every asset
+        size_t m_bytes;
+
+        //! Thread safe all of the above
+        mutable std::shared_timed_mutex m_mutex;
+    };
+}
+
+#endif
@@ -0,0 +1,175 @@
+/*!
+ * @file       authorizationcache.hpp
+ * @brief      Declares the AuthorizationCache class
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 15, 2026
+ * @copyright  Copyright &copy; 2026 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2026 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#ifndef FASTCGIPP_AUTHORIZATIONCACHE_HPP
+#define FASTCGIPP_AUTHORIZATIONCACHE_HPP
+
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "fastcgi++/responsecache.hpp"
+
+//! Topmost namespace for the fastcgi++ library
+namespace Fastcgipp
+{
+    //! In-process cache of authorizer decisions
+    /*!
+     * A web server asks it's authorizer about every request, so the same
+     * credentials get checked over and over again. Requests in the
+     * AUTHORIZER role that return this from Request::authorizationCache()
+     * are looked up here by their Authorization header, along with whatever
+     * Request::authorizationVariant() adds, before response() is ever
+     * called. A hit is sent back right away as the exact records the
+     * original decision was, Variable-* headers and all. A miss runs
+     * response() as usual and stores what it sends.
+     *
+     * Only decisions are stored, meaning responses with a 200, 401 or 403
+     * status. A response without a Status header counts as a 200. Anything
+     * else, like a 500 from a backend that is down, is more likely a passing
+     * problem than a decision so it's never cached.
+     *
+     * Decisions expire after a fixed time to live. Entries are spread over a
+     * number of independently locked shards by Authorization header so
+     * concurrent lookups rarely contend. Once a shard is full the least
+     * recently used decision in it makes room.
+     *
+     * @date    October 15, 2026
+     * @author  Eddie Carle &lt;eddie@isatec.ca&gt;
+     */
+    class AuthorizationCache
+    {
+    public:
+        typedef ResponseCache::Clock Clock;
+
+        //! A single cached decision
+        typedef ResponseCache::Entry Entry;
+
+        //! Sole constructor
+        /*!
+         * @param[in] ttl How long decisions stay in the cache
+         * @param[in] maxEntries Most decisions kept in the cache
+         * @param[in] shards Amount of independently locked shards
+         */
+        AuthorizationCache(
+                Clock::duration ttl,
+                size_t maxEntries=65536,
+                unsigned shards=16);
+
+        //! How long decisions stay in the cache
+        Clock::duration ttl() const
+        {
+            return m_ttl;
+        }
+
+        //! Look up a decision
+        /*!
+         * Expired entries are removed as they are found.
+         *
+         * @param[in] authorization Authorization header of the request
+         * @param[in] variant Anything else the decision depends on
+         * @return The entry or null if there is none.
+         */
+        std::shared_ptr<const Entry> find(
+                const std::string& authorization,
+                const std::string& variant=std::string());
+
+        //! Add a decision to the cache
+        /*!
+         * Any existing entry for the same authorization and variant is
+         * replaced.
+         *
+         * @param[in] authorization Authorization header of the request
+         * @param[in] variant Anything else the decision depends on
+         * @param[in] entry The decision itself
+         */
+        void insert(
+                const std::string& authorization,
+                const std::string& variant,
+                std::shared_ptr<const Entry>&& entry);
+
+        //! Revoke every decision made for an Authorization header
+        void erase(const std::string& authorization);
+
+        //! Revoke every decision
+        void clear();
+
+        //! Amount of decisions in the cache
+        size_t size() const;
+
+    private:
+        //! A cache entry along with it's key
+        struct Item
+        {
+            std::string key;
+            std::shared_ptr<const Entry> entry;
+        };
+
+        typedef std::map<std::string, std::list<Item>::iterator> Index;
+
+        //! An independently locked part of the cache
+        struct Shard
+        {
+            //! Items in order of use. Most recently used first.
+            std::list<Item> items;
+
+            //! Index of items by authorization and variant
+            Index index;
+
+            //! Thread safe the items
+            mutable std::mutex mutex;
+        };
+
+        //! How long decisions stay in the cache
+        const Clock::duration m_ttl;
+
+        //! Most decisions kept in a single shard
+        const size_t m_maxShardEntries;
+
+        //! Amount of shards
+        const unsigned m_shardCount;
+
+        //! The shards themselves
+        std::unique_ptr<Shard[]> m_shards;
+
+        //! Shard an Authorization header belongs in
+        Shard& shard(const std::string& authorization) const;
+
+        //! Remove an item. The shard's mutex must be locked.
+        static void remove(Shard& shard, Index::iterator index);
+
+        //! Build a key from an authorization and a variant
+        static std::string key(
+                const std::string& authorization,
+                const std::string& variant);
+    };
+}
+
+#endif
@@ -30,9 +30,90 @@
 #define BLOCK_HPP
 
 #include <memory>
+#include <cstddef>
 
 namespace Fastcgipp
 {
+    //! Size classed pool of raw memory for Block objects
+    /*!
+     * All memory allocated for Block objects comes from here. Requests are
+     * rounded up to one of a few size classes tailored to FastCGI records and
+     * released memory is cached for reuse. Each thread keeps a small cache of
+     * it's own so that most allocations and releases don't need any locking.
+     * Only once a thread cache is empty or full is a global cache consulted
+     * under a mutex. There is one global cache per NUMA node so memory stays
+     * close to the threads using it.
+     *
+     * Requests larger than the largest size class bypass the pool entirely.
+     *
+     * @date    October 14, 2026
+     * @author  Eddie Carle &lt;eddie@isatec.ca&gt;
+     */
+    class BlockPool
+    {
+    public:
+        //! Number of size classes
+        static const unsigned classes = 5;
+
+        //! The size classes themselves in bytes
+        /*!
+         * In order these are sized to fit small management records, small
+         * records, a full FcgiStreambuf record, the largest possible FastCGI
+         * record and a Transceiver receive buffer.
+         */
+        static const size_t sizes[classes];
+
+        //! Deleter that returns memory to the pool
+        struct Deleter
+        {
+            //! Actual size of the allocation
+            size_t capacity;
+
+            void operator()(char* data) const
+            {
+                release(data, capacity);
+            }
+
+            Deleter():
+                capacity(0)
+            {}
+
+            Deleter(size_t capacity_):
+                capacity(capacity_)
+            {}
+        };
+
+        //! Allocate at least the requested amount of memory
+        static std::unique_ptr<char[], Deleter> allocate(size_t size);
+
+        //! Allocate at least the requested amount of shared memory
+        static std::shared_ptr<char> share(size_t size);
+
+        //! Pool usage statistics
+        struct Stats
+        {
+            //! Total allocations requested
+            unsigned long long allocations;
+
+            //! Allocations satisfied from cached memory
+            unsigned long long hits;
+
+            //! Bytes currently allocated out of the pool
+            unsigned long long bytes;
+
+            //! Most bytes ever allocated out of the pool at once
+            unsigned long long peakBytes;
+        };
+
+        //! Retrieve current pool usage statistics
+        static Stats stats();
+
+    private:
+        //! Return memory to the pool
+        static void release(char* data, size_t capacity);
+    };
+
+
     //! Data structure to hold a block of raw data
     /*!
      * This is basically a stripped down std::vector. It contains a contiguous
@@ -40,6 +121,10 @@ namespace Fastcgipp
      * how much data is actually allocated while the size tells us how much of
      * the data is relevant. The motivation for this as opposed to a vector is
      * that this lacks element initialization.
+     *
+     * A block can also be a slice of a larger reference counted allocation. In
+     * this case the block shares ownership of the allocation and nothing is
+     * copied until the reserve is changed.
      */
     class Block
     {
@@ -51,7 +136,13 @@ namespace Fastcgipp
         size_t m_size;
 
         //! Point to allocated data
-        std::unique_ptr<char[]> m_data;
+        std::unique_ptr<char[], BlockPool::Deleter> m_data;
+
+        //! Shared allocation if we are a slice
+        std::shared_ptr<char> m_shared;
+
+        //! Pointer to the first element of either allocation
+        char* m_begin;
 
     public:
         //! Initialize an empty block
@@ -63,6 +154,21 @@ namespace Fastcgipp
         //! Initialize a block with equal size and reserve from source data
         Block(const char* const data, const size_t size_);
 
+        //! Initialize a block as a slice of a shared allocation
+        /*!
+         * No data is copied. The block simply shares ownership of the
+         * allocation.
+         *
+         * @param [in] shared Shared allocation the slice comes from.
+         * @param [in] begin Pointer to the first element of the slice. This
+         *                   must lie within the shared allocation.
+         * @param [in] size_ Size of the slice.
+         */
+        Block(
+                const std::shared_ptr<char>& shared,
+                char* const begin,
+                const size_t size_);
+
         //! Assign a sequence a data to the block
         /*!
          * If the reserve if smaller the requested size then reallocation
@@ -85,8 +191,8 @@ namespace Fastcgipp
         //! Set the reserve size
         /*!
          * Unlike std::vector this always obeys your command even if you are
-         * decreasing the reserve size. All data is copied over when a reserve
-         * is changed.
+         * decreasing the reserve size. All data is copied over when the
+         * reserve no longer fits in the underlying allocation.
          */
         void reserve(size_t x);
 
@@ -102,25 +208,25 @@ namespace Fastcgipp
         //! Pointer to the first element
         char* begin()
         {
-            return m_data.get();
+            return m_begin;
         }
 
         //! Constant pointer to the first element
         const char* begin() const
         {
-            return m_data.get();
+            return m_begin;
         }
 
         //! Pointer to 1+ the last element
         char* end()
         {
-            return m_data.get()+m_size;
+            return m_begin+m_size;
         }
 
         //! Constant pointer to 1+ the last element
         const char* end() const
         {
-            return m_data.get()+m_size;
+            return m_begin+m_size;
         }
 
         //! Deallocate memory and set size and reserve to zero
@@ -29,17 +29,23 @@
 #define FASTCGIPP_CHUNKSTREAMBUF_HPP
 
 #include <memory>
-#include <list>
+#include <vector>
 #include <ostream>
 
 #include "fastcgi++/webstreambuf.hpp"
+#include "fastcgi++/block.hpp"
 
 //! Topmost namespace for the fastcgi++ library
 namespace Fastcgipp
 {
     //! De-templated base class for ChunkStreamBuf
     /*!
-     * @date    May 6, 2020
+     * Chunk memory comes out of the BlockPool. The first chunk is small so
+     * short bodies stay cheap and each chunk after that is twice the size of
+     * the last up to the largest pool size class. Large bodies end up in a
+     * handful of chunks that can be handed to a socket or libcurl as is.
+     *
+     * @date    October 15, 2026
      * @author  Eddie Carle &lt;eddie@isatec.ca&gt;
      */
     class ChunkStreamBuf_base
@@ -48,23 +54,44 @@ namespace Fastcgipp
         //! A chunk of body data
         struct Chunk
         {
-            //! Total capacity of a chunk
-            static constexpr unsigned capacity = 4096;
+            //! Capacity of the first chunk
+            static constexpr size_t initial = 0x2040;
+
+            //! Capacity chunks won't grow beyond
+            static constexpr size_t maximum = 0x20000;
 
             //! Pointer to chunk data
-            std::unique_ptr<char[]> data;
+            std::unique_ptr<char[], BlockPool::Deleter> data;
 
             //! Size of chunk data
             unsigned size;
 
-            Chunk():
-                data(new char[capacity]),
+            //! Total capacity of the chunk
+            size_t capacity() const
+            {
+                return data.get_deleter().capacity;
+            }
+
+            Chunk(size_t capacity):
+                data(BlockPool::allocate(capacity)),
                 size(0)
             {}
         };
 
+        //! Chunks of body data in order
+        typedef std::vector<Chunk> Chunks;
+
         //! Chunks of body data
-        std::list<Chunk> m_body;
+        Chunks m_body;
+
+    protected:
+        //! Add an empty chunk to the end of the body
+        void grow()
+        {
+            m_body.emplace_back(m_body.empty()?Chunk::initial:std::min(
+                        2*m_body.back().capacity(),
+                        Chunk::maximum));
+        }
     };
 
     template<class charT> class ChunkStreamBuf;
@@ -99,7 +126,7 @@ namespace Fastcgipp
     {
     private:
         //! Buffer for wide character stuff
-        wchar_t m_buffer[Chunk::capacity];
+        wchar_t m_buffer[0x1000];
 
     public:
         ChunkStreamBuf();
@@ -0,0 +1,170 @@
+/*!
+ * @file       compressor.hpp
+ * @brief      Declares the Compressor class
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 15, 2026
+ * @copyright  Copyright &copy; 2026 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2026 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#ifndef FASTCGIPP_COMPRESSOR_HPP
+#define FASTCGIPP_COMPRESSOR_HPP
+
+#include "fastcgi++/config.hpp"
+
+#include <memory>
+#include <string>
+#include <initializer_list>
+
+//! Topmost namespace for the fastcgi++ library
+namespace Fastcgipp
+{
+    //! HTTP content codings we can compress responses with
+    enum class Compression
+    {
+        NONE,
+        GZIP,
+        BROTLI,
+        ZSTD
+    };
+
+    //! Streaming compression of response bodies
+    /*!
+     * Each coding is only available if fastcgi++ was built against it's
+     * library (zlib, brotli or zstd). Compressor objects hold on to a fair
+     * amount of memory so they are never allocated per request. Instead
+     * acquire() takes one from a pool kept by the calling thread and it goes
+     * back to the pool of whatever thread releases it.
+     *
+     * @date    October 15, 2026
+     * @author  Eddie Carle &lt;eddie@isatec.ca&gt;
+     */
+    class Compressor
+    {
+    public:
+        //! What process() should do once it has taken in all the input
+        enum class Flush
+        {
+            //! Nothing. Output may be held back for better compression.
+            NONE,
+            //! Output everything so far so the client can decode it
+            SYNC,
+            //! Output everything and end the compressed stream
+            FINISH
+        };
+
+        //! Returns a Compressor to the pool when it is done with
+        struct Releaser
+        {
+            void operator()(Compressor* compressor) const;
+        };
+
+        typedef std::unique_ptr<Compressor, Releaser> Pointer;
+
+        //! Get a compressor ready for a new stream
+        /*!
+         * @param[in] compression Content coding to compress with
+         * @return The compressor or nullptr if the coding is NONE or
+         *         unavailable.
+         */
+        static Pointer acquire(Compression compression);
+
+        //! True if we can compress with this content coding
+        static bool supported(Compression compression);
+
+        //! Name of the content coding as used in HTTP headers
+        static const char* name(Compression compression);
+
+        //! Pick a content coding from an Accept-Encoding header
+        /*!
+         * The coding with the highest quality value that we support wins.
+         * Ties go to brotli, then zstd, then gzip. An asterisk stands for
+         * anything not mentioned otherwise.
+         *
+         * @param[in] acceptEncodings Value of the Accept-Encoding header
+         * @return The chosen content coding. NONE if nothing suits.
+         */
+        template<class charT>
+        static Compression negotiate(
+                const std::basic_string<charT>& acceptEncodings);
+
+        //! Pick a content coding from an Accept-Encoding header
+        /*!
+         * This is like negotiate(const std::basic_string<charT>&) except the
+         * candidates needn't be supported by us. Use it for content that has
+         * already been compressed.
+         *
+         * @param[in] acceptEncodings Value of the Accept-Encoding header
+         * @param[in] available Content codings to choose from. Ties go to
+         *                      whichever comes first.
+         * @return The chosen content coding. NONE if nothing suits.
+         */
+        template<class charT>
+        static Compression negotiate(
+                const std::basic_string<charT>& acceptEncodings,
+                std::initializer_list<Compression> available);
+
+        //! Compress data
+        /*!
+         * Input is consumed and output produced until either the input is
+         * used up or the output is full. Call it again with more room if it
+         * returns false.
+         *
+         * @param[in,out] input Start of the input. This is advanced past
+         *                      whatever was consumed.
+         * @param[in] inputEnd 1+ the last byte of input
+         * @param[in,out] output Where to put the output. This is advanced
+         *                       past whatever was produced.
+         * @param[in] outputEnd 1+ the last byte of room for output
+         * @param[in] flush What to do once all input is taken in
+         * @return True if all input was consumed and the flush is complete.
+         */
+        virtual bool process(
+                const char*& input,
+                const char* inputEnd,
+                char*& output,
+                char* outputEnd,
+                Flush flush) =0;
+
+        //! The content coding we compress with
+        Compression compression() const
+        {
+            return m_compression;
+        }
+
+        virtual ~Compressor() {}
+
+    protected:
+        Compressor(Compression compression):
+            m_compression(compression)
+        {}
+
+        //! Get ready for a new stream
+        virtual void reset() =0;
+
+    private:
+        //! The content coding we compress with
+        const Compression m_compression;
+    };
+}
+
+#endif
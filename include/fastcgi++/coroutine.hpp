@@ -0,0 +1,315 @@
+/*!
+ * @file       coroutine.hpp
+ * @brief      Declares coroutine support for requests
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 14, 2026
+ * @copyright  Copyright &copy; 2026 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2026 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#ifndef FASTCGIPP_COROUTINE_HPP
+#define FASTCGIPP_COROUTINE_HPP
+
+#include "fastcgi++/request.hpp"
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#include <coroutine>
+#include <exception>
+#include <utility>
+#include <type_traits>
+
+//! Topmost namespace for the fastcgi++ library
+namespace Fastcgipp
+{
+    //! Return type of a request coroutine
+    /*!
+     * Nothing much to see here. Declare AsyncRequest::respond() as returning
+     * this and write it with co_await and co_return. The coroutine starts
+     * suspended and stays around after finishing so that AsyncRequest can
+     * tell when it is done.
+     *
+     * @date    October 14, 2026
+     * @author  Eddie Carle &lt;eddie@isatec.ca&gt;
+     */
+    class Coroutine
+    {
+    public:
+        struct promise_type
+        {
+            //! Exception thrown out of the coroutine body
+            std::exception_ptr exception;
+
+            Coroutine get_return_object()
+            {
+                return Coroutine(
+                        std::coroutine_handle<promise_type>::from_promise(
+                            *this));
+            }
+
+            std::suspend_always initial_suspend() noexcept
+            {
+                return {};
+            }
+
+            std::suspend_always final_suspend() noexcept
+            {
+                return {};
+            }
+
+            void return_void() {}
+
+            void unhandled_exception()
+            {
+                exception = std::current_exception();
+            }
+        };
+
+        Coroutine():
+            m_handle(nullptr)
+        {}
+
+        Coroutine(Coroutine&& x):
+            m_handle(std::exchange(x.m_handle, nullptr))
+        {}
+
+        Coroutine& operator=(Coroutine&& x)
+        {
+            if(this != &x)
+            {
+                reset();
+                m_handle = std::exchange(x.m_handle, nullptr);
+            }
+            return *this;
+        }
+
+        Coroutine(const Coroutine&) =delete;
+        Coroutine& operator=(const Coroutine&) =delete;
+
+        ~Coroutine()
+        {
+            reset();
+        }
+
+        //! Is there a coroutine here at all?
+        explicit operator bool() const
+        {
+            return bool(m_handle);
+        }
+
+        //! Run the coroutine until it next suspends
+        /*!
+         * @return True if the coroutine has finished
+         */
+        bool resume()
+        {
+            m_handle.resume();
+            if(!m_handle.done())
+                return false;
+            const std::exception_ptr exception(m_handle.promise().exception);
+            reset();
+            if(exception)
+                std::rethrow_exception(exception);
+            return true;
+        }
+
+        //! Destroy the coroutine frame wherever it is suspended
+        void reset()
+        {
+            if(m_handle)
+                m_handle.destroy();
+            m_handle = nullptr;
+        }
+
+    private:
+        explicit Coroutine(std::coroutine_handle<promise_type> handle):
+            m_handle(handle)
+        {}
+
+        std::coroutine_handle<promise_type> m_handle;
+    };
+
+    //! Request that generates it's response with a coroutine
+    /*!
+     * Instead of defining response() and keeping track of where it left off
+     * between calls by decoding Message::type, define respond() as a
+     * coroutine and co_await the asynchronous operations.
+     *
+     * @code
+     * Fastcgipp::Coroutine respond()
+     * {
+     *     co_await query(m_connection, m_query);
+     *     out << "Content-Type: text/html\r\n\r\n" << ...;
+     * }
+     * @endcode
+     *
+     * The coroutine is run on whatever worker thread the Manager hands the
+     * request to, always with the request locked, so it can touch the request
+     * as freely as response() could. An awaited operation is set up to send
+     * it's completion Message through callback() and coroutine is resumed
+     * with that Message as the result of co_await. The Message never gets
+     * decoded by type so any value works. The one hop through the Manager
+     * stays as that is what serializes the request and lets it be completed
+     * and freed when the coroutine finishes.
+     *
+     * Only one operation can be awaited at a time and any Message that
+     * arrives while it is outstanding resumes the coroutine. The awaiting
+     * also has to happen in respond() itself; there is no chaining of nested
+     * coroutines.
+     *
+     * This is only available if the code including it is compiled as C++20
+     * or newer. The library itself need not be.
+     *
+     * @tparam charT Character type for internal processing (wchar_t or char)
+     * @tparam Containers Container policy for the environment data.
+     *
+     * @date    October 14, 2026
+     * @author  Eddie Carle &lt;eddie@isatec.ca&gt;
+     */
+    template<class charT, class Containers=Http::TreeContainers>
+    class AsyncRequest: public Request<charT, Containers>
+    {
+    public:
+        using Request<charT, Containers>::Request;
+
+        void reset()
+        {
+            m_coroutine.reset();
+            m_result = nullptr;
+            Request<charT, Containers>::reset();
+        }
+
+    protected:
+        //! Awaitable asynchronous operation
+        /*!
+         * The start function is called with callback() once the coroutine
+         * has suspended and should set off the operation so that it calls
+         * the callback when done. It may return false to indicate that the
+         * operation could not be started at all in which case the coroutine
+         * carries on right away with a Message of type -1.
+         *
+         * @tparam Start Callable taking a const std::function<void(Message)>&
+         *               and returning bool or void.
+         */
+        template<class Start> class Awaitable
+        {
+        public:
+            Awaitable(AsyncRequest& request, Start&& start):
+                m_request(request),
+                m_start(std::forward<Start>(start)),
+                m_message(-1)
+            {}
+
+            bool await_ready() const
+            {
+                return false;
+            }
+
+            bool await_suspend(std::coroutine_handle<>)
+            {
+                m_request.m_result = &m_message;
+                bool started = true;
+                if constexpr(std::is_void_v<
+                        decltype(m_start(m_request.callback()))>)
+                    m_start(m_request.callback());
+                else
+                    started = m_start(m_request.callback());
+                if(!started)
+                    m_request.m_result = nullptr;
+                return started;
+            }
+
+            Message await_resume()
+            {
+                return std::move(m_message);
+            }
+
+        private:
+            AsyncRequest& m_request;
+            std::decay_t<Start> m_start;
+            Message m_message;
+        };
+
+        //! Await any operation that completes through callback()
+        template<class Start> Awaitable<Start> async(Start&& start)
+        {
+            return Awaitable<Start>(*this, std::forward<Start>(start));
+        }
+
+        //! Await an SQL::Query queued into an SQL::Connection
+        /*!
+         * The query callback is overwritten. The results are in the query
+         * once co_await returns. A Message of type -1 means the query could
+         * not be queued.
+         */
+        template<class Connection, class Query>
+        auto query(Connection& connection, Query& query)
+        {
+            return async(
+                    [&connection, &query] (
+                        const std::function<void(Message)>& callback) -> bool
+                    {
+                        query.callback = callback;
+                        return connection.queue(query);
+                    });
+        }
+
+        //! Await a Curl request performed by a Curler
+        template<class Curler, class Curl>
+        auto perform(Curler& curler, Curl& curl)
+        {
+            return async(
+                    [&curler, &curl] (
+                        const std::function<void(Message)>& callback)
+                    {
+                        curl.setCallback(callback);
+                        curler.queue(curl);
+                    });
+        }
+
+        //! The coroutine generating the response
+        virtual Coroutine respond() =0;
+
+    private:
+        //! Our coroutine should it be suspended
+        Coroutine m_coroutine;
+
+        //! Where the awaiting operation wants it's Message
+        Message* m_result = nullptr;
+
+        bool response()
+        {
+            if(!m_coroutine)
+                m_coroutine = respond();
+            else if(m_result)
+            {
+                *m_result = std::move(this->m_message);
+                m_result = nullptr;
+            }
+            else
+                return false;
+            return m_coroutine.resume();
+        }
+    };
+}
+
+#endif
+#endif
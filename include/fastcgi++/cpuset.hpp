@@ -0,0 +1,129 @@
+/*!
+ * @file       cpuset.hpp
+ * @brief      Declares the CpuSet class
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 15, 2026
+ * @copyright  Copyright &copy; 2026 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2026 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#ifndef FASTCGIPP_CPUSET_HPP
+#define FASTCGIPP_CPUSET_HPP
+
+#include "fastcgi++/config.hpp"
+
+#include <vector>
+#include <string>
+#include <initializer_list>
+
+//! Topmost namespace for the fastcgi++ library
+namespace Fastcgipp
+{
+    //! A set of CPUs that threads can be pinned to
+    /*!
+     * Threads are normally free to run on any CPU. On machines with more
+     * than one NUMA node the scheduler will happily move them between
+     * nodes, and their memory ends up on the wrong side of the machine.
+     * Handing one of these to the various thread owning classes keeps
+     * their threads on the chosen CPUs.
+     *
+     * An empty set pins nothing. Pinning is only supported on Linux.
+     * Elsewhere it quietly does nothing.
+     *
+     * @date    October 15, 2026
+     * @author  Eddie Carle &lt;eddie@isatec.ca&gt;
+     */
+    class CpuSet
+    {
+    public:
+        //! An empty set that pins nothing
+        CpuSet():
+            m_spread(false)
+        {}
+
+        //! A set of specific CPUs
+        CpuSet(std::initializer_list<unsigned> cpus);
+
+        //! A set from a list like "0-3,8,10-11"
+        /*!
+         * This is the format Linux uses in sysfs and that taskset takes.
+         * Anything that doesn't parse is skipped and ranges are cut short
+         * at the most CPUs a thread can be pinned to.
+         */
+        static CpuSet parse(const std::string& list);
+
+        //! All the CPUs on a NUMA node
+        /*!
+         * On systems without NUMA information node zero holds every CPU.
+         */
+        static CpuSet node(unsigned node);
+
+        //! Number of NUMA nodes in the system
+        static unsigned nodes();
+
+        //! NUMA node a CPU belongs to
+        static unsigned nodeOf(unsigned cpu);
+
+        //! NUMA node the calling thread is currently running on
+        static unsigned currentNode();
+
+        //! A copy that pins each thread to a single CPU of the set
+        /*!
+         * Threads are handed out the CPUs in order according to their
+         * index. This is what you want for one event loop per core.
+         */
+        CpuSet spread() const
+        {
+            CpuSet set(*this);
+            set.m_spread = true;
+            return set;
+        }
+
+        //! The CPUs themselves in ascending order
+        const std::vector<unsigned>& cpus() const
+        {
+            return m_cpus;
+        }
+
+        bool empty() const
+        {
+            return m_cpus.empty();
+        }
+
+        //! Pin the calling thread to the set
+        /*!
+         * @param[in] index Index of the thread amongst it's siblings. This
+         *                  only matters if the set is spread.
+         * @return False if the thread couldn't be pinned.
+         */
+        bool pin(unsigned index=0) const;
+
+    private:
+        //! The CPUs in ascending order
+        std::vector<unsigned> m_cpus;
+
+        //! True if each thread gets a single CPU
+        bool m_spread;
+    };
+}
+
+#endif
@@ -30,7 +30,7 @@
 
 #include <memory>
 #include <ostream>
-#include <list>
+#include <map>
 #include <functional>
 
 #include "fastcgi++/chunkstreambuf.hpp"
@@ -102,10 +102,13 @@ namespace Fastcgipp
             //! The libcurl headers list
             void* m_headers;
 
-            //! A reference to the child class's POST data linked chunk list
-            std::list<ChunkStreamBuf_base::Chunk>& m_data;
+            //! A reference to the child class's POST data chunks
+            ChunkStreamBuf_base::Chunks& m_data;
 
-            //! An internal read counter for pulling data out of m_data
+            //! The chunk in m_data we are currently pulling data out of
+            unsigned m_readChunk;
+
+            //! An internal read counter for pulling data out of m_readChunk
             unsigned m_readCounter;
 
             //! Call function for when the request is complete
@@ -129,7 +132,7 @@ namespace Fastcgipp
                     const char* dataEnd) =0;
         protected:
             //! Only to be called by the child class
-            StreamBuf_base(std::list<ChunkStreamBuf_base::Chunk>& data);
+            StreamBuf_base(ChunkStreamBuf_base::Chunks& data);
         };
 
         //! Shared pointer to stream buffer base object. It is managed here.
@@ -25,6 +25,7 @@
 * along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
 *******************************************************************************/
 
+
 #ifndef FASTCGIPP_CURLER_HPP
 #define FASTCGIPP_CURLER_HPP
 
@@ -33,9 +34,12 @@
 #include <mutex>
 #include <thread>
 #include <map>
+#include <vector>
+#include <memory>
 
 #include "fastcgi++/poll.hpp"
 #include "fastcgi++/curl.hpp"
+#include "fastcgi++/cpuset.hpp"
 
 //! Topmost namespace for the fastcgi++ library
 namespace Fastcgipp
@@ -44,40 +48,52 @@ namespace Fastcgipp
     /*!
      * This class handles outgoing HTTP requests via curl.  It can safely be
      * constructed in the global space. Once constructed call start() to start
-     * the handling thread. Once you're done, call stop() or terminate() to
-     * finish things and then call join() to wait for the thread to complete.
+     * the handling threads. Once you're done, call stop() or terminate() to
+     * finish things and then call join() to wait for the threads to complete.
      *
      * Queue up requests for sending with queue().
      *
+     * Requests are handled by one or more event loops, each running in it's
+     * own thread with it's own curl multi handle. A queued request goes to
+     * whichever loop has the fewest outstanding transfers so outbound
+     * concurrency can scale with cores when a single thread isn't enough.
+     *
+     * All requests going through a Curler share one DNS cache and TLS session
+     * cache. Each event loop keeps it's own connection cache so repeated calls
+     * to the same host skip the TCP and TLS handshakes. HTTP/2 is negotiated
+     * whenever the server supports it and concurrent requests to the same host
+     * are then multiplexed over a single connection rather than opening new
+     * ones.
+     *
      * @date    May 7, 2020
      * @author  Eddie Carle &lt;eddie@isatec.ca&gt;
      */
     class Curler
     {
     public:
-        //! Call from any thread to stop the handler() thread
+        //! Call from any thread to stop the handler() threads
         /*!
-         * Calling this thread will signal the handler() thread to
-         * gracefully stop itself. This means it waits until all
+         * Calling this thread will signal the handler() threads to
+         * gracefully stop themselves. This means they wait until all
          * queued queries are finished
          *
          * @sa join()
          */
         void stop();
 
-        //! Call from any thread to terminate the handler() thread
+        //! Call from any thread to terminate the handler() threads
         /*!
-         * Calling this thread will signal the handler() thread to
-         * immediately terminate itself. This means it doesn't wait until
-         * the currently queued queries are finished.
+         * Calling this thread will signal the handler() threads to
+         * immediately terminate themselves. This means they don't wait
+         * until the currently queued queries are finished.
          *
          * @sa join()
          */
         void terminate();
 
-        //! Call from any thread to start the handler() thread
+        //! Call from any thread to start the handler() threads
         /*!
-         * If the thread is already running this will do nothing.
+         * If the threads are already running this will do nothing.
          */
         void start();
 
@@ -87,61 +103,127 @@ namespace Fastcgipp
         //! Queue up an curl
         void queue(Curl_base& curl);
 
+        //! Call before start to pin the event loop threads to CPUs
+        /*!
+         * @param[in] cpus CPUs to run the event loops on. Empty for anywhere
+         *                 (default).
+         */
+        void cpus(const CpuSet& cpus)
+        {
+            m_cpus = cpus;
+        }
+
         ~Curler();
 
         //! Construct a Curler object
         /*!
          * @param concurrency Maximum amount of current requests to be handled
+         *                    by each event loop
+         * @param hostConnections Maximum amount of connections any one event
+         *                        loop keeps open to a single host. Requests
+         *                        beyond this wait for a connection to free up
+         *                        or to be multiplexed onto. Zero means no
+         *                        limit.
+         * @param threads Amount of event loops to run
          */
-        Curler(unsigned concurrency=1);
+        Curler(
+                unsigned concurrency=1,
+                unsigned hostConnections=0,
+                unsigned threads=1);
 
     private:
-        //! General curler handler
-        void handler();
+        //! A single curl event loop
+        class Loop
+        {
+        public:
+            //! General curler handler
+            /*!
+             * @param[in] index Index of the loop amongst it's siblings
+             */
+            void handler(unsigned index);
 
-        //! How many concurrent can we do?
-        const unsigned m_concurrency;
+            //! Queue up an already prepared curl
+            void queue(const Curl_base& curl);
 
-        //! %Buffer for transmitting data
-        std::queue<Curl_base> m_queue;
+            //! Call to wake up. Lock m_mutex first.
+            void wake();
 
-        //! True when handler() should be terminating
-        std::atomic_bool m_terminate;
+            //! Always practice safe threading
+            std::mutex m_mutex;
 
-        //! True when handler() should be stopping
-        std::atomic_bool m_stop;
+            //! Transfers queued or in progress
+            std::atomic_uint m_outstanding;
 
-        //! Thread our handler is running in
-        std::thread m_thread;
+            //! Thread our handler is running in
+            std::thread m_thread;
 
-        //! Always practice safe threading
-        std::mutex m_mutex;
+            Loop(Curler& curler, unsigned hostConnections);
+            ~Loop();
 
-        //! A pair of sockets for wakeup purposes
-        socket_t m_wakeSockets[2];
+        private:
+            //! The Curler we belong to
+            Curler& m_curler;
 
-        //! Set to true while there is a pending wake
-        bool m_waking;
+            //! %Buffer for transmitting data
+            std::queue<Curl_base> m_queue;
 
-        //! The polling object
-        Poll m_poll;
+            //! A pair of sockets for wakeup purposes
+            socket_t m_wakeSockets[2];
 
-        //! Call to wake up
-        void wake();
+            //! Set to true while there is a pending wake
+            bool m_waking;
 
-        //! Associative array linked sockets to handles
-        std::map<void*, Curl_base> m_handles;
+            //! The polling object
+            Poll m_poll;
 
-        //! Curl multi handle
-        void* const m_multiHandle;
+            //! Associative array linked sockets to handles
+            std::map<void*, Curl_base> m_handles;
 
-        //! Curl socket action callback function
-        static int socketCallback(
+            //! Curl multi handle
+            void* const m_multiHandle;
+
+            //! Curl socket action callback function
+            static int socketCallback(
+                    void* handle,
+                    int socket,
+                    int action,
+                    void *userp,
+                    void *socketp);
+        };
+
+        //! How many concurrent can we do per event loop?
+        const unsigned m_concurrency;
+
+        //! True when handler() should be terminating
+        std::atomic_bool m_terminate;
+
+        //! True when handler() should be stopping
+        std::atomic_bool m_stop;
+
+        //! Curl share handle for the DNS and TLS session caches
+        void* const m_shareHandle;
+
+        //! One lock for each kind of data in the share handle
+        std::mutex m_shareMutexes[8];
+
+        //! Curl share lock callback function
+        static void lockCallback(
+                void* handle,
+                int data,
+                int access,
+                void* userp);
+
+        //! Curl share unlock callback function
+        static void unlockCallback(
                 void* handle,
-                int socket,
-                int action,
-                void *userp,
-                void *socketp);
+                int data,
+                void* userp);
+
+        //! Our event loops
+        std::vector<std::unique_ptr<Loop>> m_loops;
+
+        //! CPUs to pin the event loop threads to
+        CpuSet m_cpus;
     };
 }
 
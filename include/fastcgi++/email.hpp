@@ -29,7 +29,6 @@
 #define FASTCGIPP_EMAIL_HPP
 
 #include <memory>
-#include <list>
 #include <ostream>
 
 #include "fastcgi++/chunkstreambuf.hpp"
@@ -52,8 +51,8 @@ namespace Fastcgipp
             //! %Email message data
             struct DataRef
             {
-                //! Linked list of body chunks
-                std::list<ChunkStreamBuf_base::Chunk>& body;
+                //! Body chunks
+                ChunkStreamBuf_base::Chunks& body;
 
                 //! Recipient email address
                 std::string to;
@@ -61,7 +60,7 @@ namespace Fastcgipp
                 //! From email address
                 std::string from;
 
-                DataRef(std::list<ChunkStreamBuf_base::Chunk>& _body):
+                DataRef(ChunkStreamBuf_base::Chunks& _body):
                     body(_body)
                 {}
             };
@@ -69,8 +68,8 @@ namespace Fastcgipp
             //! %Email message data
             struct Data
             {
-                //! Linked list of body chunks
-                std::list<ChunkStreamBuf_base::Chunk> body;
+                //! Body chunks
+                ChunkStreamBuf_base::Chunks body;
 
                 //! Recipient email address
                 std::string to;
@@ -102,7 +101,7 @@ namespace Fastcgipp
             //! Flush the buffer and set the stream to EOF.
             virtual void close() =0;
 
-            Email_base(std::list<ChunkStreamBuf_base::Chunk>& body):
+            Email_base(ChunkStreamBuf_base::Chunks& body):
                 m_data(body)
             {}
         };
@@ -28,6 +28,7 @@
 #ifndef FASTCGIPP_ENDIAN_HPP
 #define FASTCGIPP_ENDIAN_HPP
 
+#include <cstddef>
 #include <cstdint>
 #include <type_traits>
 
@@ -203,6 +204,19 @@ namespace Fastcgipp
             return s_size;
         }
     };
+
+    //! Convert a run of words between big endian and host order in place
+    /*!
+     * Converting is the same in both directions so this serves for reading
+     * and writing alike. On little endian hosts the bytes of every word are
+     * reversed with the widest shuffle the processor supports, as chosen at
+     * runtime. On big endian hosts it does nothing.
+     *
+     * @param [in,out] data Start of the words. No alignment is needed.
+     * @param [in] count Number of words.
+     * @param [in] width Size in bytes of each word. Must be 2, 4 or 8.
+     */
+    void convertBigEndian(char* data, size_t count, unsigned width) noexcept;
 }
 
 #endif
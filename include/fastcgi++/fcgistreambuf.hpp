@@ -32,9 +32,14 @@
 #include "fastcgi++/protocol.hpp"
 #include "fastcgi++/webstreambuf.hpp"
 #include "fastcgi++/block.hpp"
+#include "fastcgi++/compressor.hpp"
 
 #include <istream>
 #include <functional>
+#include <memory>
+#include <utility>
+
+#include <sys/types.h>
 
 //! Topmost namespace for the fastcgi++ library
 namespace Fastcgipp
@@ -45,6 +50,22 @@ namespace Fastcgipp
      * just the same with the added feature of the dump() function but properly
      * flushes into FastCGI records.
      *
+     * The buffer itself is a Block from the BlockPool that is only allocated
+     * once something is actually written. With narrow characters the buffer
+     * is the content section of a record. Flushing it just means filling in
+     * the header and handing the whole Block off to be sent.
+     *
+     * In cork mode finished records are not sent but accumulated back to
+     * back in a single Block. Records are made as large as possible and
+     * nothing goes out until an explicit flush or takeCorked(). This way an
+     * entire response can go out in one piece along with the END_REQUEST
+     * record.
+     *
+     * Once compress() is called everything written to the stream, dumped or
+     * not, goes through a Compressor before being packaged into records. The
+     * stream buffer is then a plain Block that gets reused after every
+     * compression pass. Wide characters are UTF-8 encoded first.
+     *
      * @tparam charT Character type (char or wchar_t)
      * @tparam traits Character traits
      *
@@ -55,14 +76,15 @@ namespace Fastcgipp
     class FcgiStreambuf: public WebStreambuf<charT, traits>
     {
     public:
-        FcgiStreambuf()
-        {
-            this->setp(m_buffer, m_buffer+s_buffSize);
-        }
+        FcgiStreambuf():
+            m_bufferSize(s_buffSize),
+            m_corked(false),
+            m_sent(false)
+        {}
 
         ~FcgiStreambuf()
         {
-            emptyBuffer();
+            sync();
         }
 
         //! Configure the stream buffer
@@ -73,16 +95,46 @@ namespace Fastcgipp
          * @param[in] id Complete ID associated with the request
          * @param[in] type Type of output stream (ERR or OUT)
          * @param[in] send_ Function to send record with
+         * @param[in] sendFile_ Function to send a record header followed by
+         *                      a segment of a file and the padding with. If this isn't
+         *                      provided dumpFile() reads the file into
+         *                      records itself.
          */
         void configure(
                 const Protocol::RequestId& id,
                 const Protocol::RecordType& type,
                 const std::function<void(const Socket&, Block&&)>
-                    send_)
+                    send_,
+                const std::function<void(
+                    const Socket&,
+                    Block&&,
+                    const std::shared_ptr<const int>&,
+                    off_t,
+                    size_t)> sendFile_ = nullptr)
         {
             m_id = id;
             m_type = type;
             send = send_;
+            sendFile = sendFile_;
+            m_sent = false;
+        }
+
+        //! Reconfigure the stream buffer for a different request
+        /*!
+         * The record type and send function stay as they are. Any stream
+         * still being compressed is abandoned.
+         *
+         * @param[in] id Complete ID associated with the new request
+         */
+        void configure(const Protocol::RequestId& id)
+        {
+            m_id = id;
+            m_sent = false;
+            if(m_compressor)
+            {
+                this->setp(nullptr, nullptr);
+                m_compressor.reset();
+            }
         }
 
         //! Dumps raw data directly into the FastCGI protocol
@@ -90,6 +142,8 @@ namespace Fastcgipp
          * This function exists as a mechanism to dump raw data out the stream
          * bypassing the stream buffer or any code conversion mechanisms. If the
          * user has any binary data to send, this is the function to do it with.
+         * The same goes for text that is already UTF-8 encoded. There is no
+         * need to widen it just so it can be encoded again.
          *
          * @param[in] data Pointer to first byte of data to send
          * @param[in] size Size in bytes of data to be sent
@@ -108,15 +162,182 @@ namespace Fastcgipp
          */
         void dump(std::basic_istream<char>& stream);
 
+        //! Dumps part of a file directly into the FastCGI protocol
+        /*!
+         * This is like dump(std::basic_istream<char>&) except the file
+         * contents are handed to the transceiver by descriptor and written
+         * into the socket with sendfile(). Only the record headers and
+         * padding are ever built in userspace.
+         *
+         * The descriptor is duplicated so the caller is free to close it as
+         * soon as this returns. The file should not be truncated until the
+         * response has been sent though. In cork mode, anything held back is
+         * sent first.
+         *
+         * @param[in] file Open file descriptor to read from
+         * @param[in] offset Offset into the file to start at
+         * @param[in] size Amount of data to send
+         * @return True on success. False if the descriptor couldn't be
+         *         duplicated or read from.
+         */
+        bool dumpFile(int file, off_t offset, size_t size);
+
+        //! Room to write into the stream buffer directly
+        /*!
+         * Serializers can use this to skip the std::basic_ostream machinery
+         * along with any encoding set on the stream. If fewer than size
+         * characters of room are left the buffer is emptied first. Whatever
+         * is written has to be committed with commit() before the stream is
+         * used in any other way.
+         *
+         * @param[in] size Room needed in characters
+         * @return Start and end of the room. This can be less than size if
+         *         the buffer itself is smaller.
+         */
+        std::pair<charT*, charT*> room(size_t size)
+        {
+            if(this->pptr() == nullptr
+                    || size_t(this->epptr()-this->pptr()) < size)
+                emptyBuffer();
+            return std::make_pair(this->pptr(), this->epptr());
+        }
+
+        //! Commit what was written into room()
+        /*!
+         * @param[in] end One past the last character written
+         */
+        void commit(charT* end)
+        {
+            this->pbump(int(end-this->pptr()));
+        }
+
+        //! Set the size of the stream buffer
+        /*!
+         * This takes effect the next time the buffer gets emptied. It is
+         * ignored in cork mode where buffers are always as large as they can
+         * be.
+         *
+         * @param[in] size Size of the buffer in characters. This gets clamped
+         *                 to what fits into a single record.
+         */
+        void bufferSize(size_t size);
+
+        //! Enable or disable cork mode
+        /*!
+         * Disabling cork mode transmits everything held back.
+         *
+         * @param[in] corked True to hold back records until flushed
+         */
+        void cork(bool corked);
+
+        //! Are we in cork mode?
+        bool corked() const
+        {
+            return m_corked;
+        }
+
+        //! Package everything held back and hand it over instead of sending it
+        /*!
+         * The contents of the stream buffer are packaged into a record and
+         * returned along with any other records held back in cork mode. This
+         * lets the caller append something of it's own before sending it
+         * all out at once. If we aren't in cork mode, the stream buffer is
+         * simply flushed and an empty Block is returned.
+         *
+         * @return Block of records ready for transmission
+         */
+        Block takeCorked();
+
+        //! Has anything been sent since the stream buffer was configured?
+        /*!
+         * Records held back in cork mode don't count until they are sent.
+         */
+        bool sent() const
+        {
+            return m_sent;
+        }
+
+        //! Compress everything written from here on
+        /*!
+         * Whatever is in the stream buffer goes out uncompressed first. This
+         * way HTTP headers can be written and then the body compressed. If
+         * we are already compressing, that stream is finished first.
+         *
+         * @param[in] compression Content coding to compress with
+         * @return False if the coding is NONE or unavailable. Nothing is
+         *         compressed in that case.
+         */
+        bool compress(Compression compression);
+
+        //! End the compressed stream and stop compressing
+        /*!
+         * This does nothing if we aren't compressing. The compressor is
+         * returned to the pool.
+         */
+        void finish();
+
+        //! Content coding we are currently compressing with
+        Compression compression() const
+        {
+            return m_compressor?m_compressor->compression():Compression::NONE;
+        }
+
     private:
-        //! Code converts, packages and transmits all data in the stream buffer
+        //! Transmits the stream buffer and makes sure there is room for more
         bool emptyBuffer();
 
+        //! Code converts, packages and transmits all data in the stream buffer
+        /*!
+         * Unlike emptyBuffer() this might leave us with no buffer at all.
+         */
+        bool sendBuffer();
+
+        //! Allocate a new buffer and point the put area at it
+        inline void newBuffer();
+
+        //! Flush the stream buffer and whatever cork mode held back
+        int sync();
+
+        //! Send off everything held back by cork mode
+        inline void sendCork();
+
+        //! Get room for a record of the given size
+        /*!
+         * In cork mode the room is at the end of the cork. Otherwise the
+         * record Block is sized to fit.
+         *
+         * @param[in] record Block to put the record in if not in cork mode
+         * @param[in] size Size of the record including it's header
+         * @return Pointer to the first byte of the record
+         */
+        inline char* newRecord(Block& record, size_t size);
+
+        //! Send off a record filled in after newRecord()
+        /*!
+         * @param[in] record Same Block passed to newRecord()
+         * @param[in] size Final size of the record including it's header.
+         *                 This can be smaller than what was passed to
+         *                 newRecord().
+         */
+        inline void sendRecord(Block& record, size_t size);
+
+        //! Compress data and package the output into records
+        /*!
+         * @param[in] data First byte of data to compress
+         * @param[in] end 1+ the last byte of data to compress
+         * @param[in] flush What the compressor should do once it has taken
+         *                  in the data
+         */
+        void compressData(
+                const char* data,
+                const char* end,
+                Compressor::Flush flush);
+
         //! Size of the internal stream buffer
         static const int s_buffSize = 8192;
 
         //! The buffer
-        charT m_buffer[s_buffSize];
+        Block m_buffer;
 
         //! ID associated with the request
         Protocol::RequestId m_id;
@@ -126,6 +347,29 @@ namespace Fastcgipp
 
         //! Function to actually send the record
         std::function<void(const Socket&, Block&&)> send;
+
+        //! Size of the stream buffer in characters outside of cork mode
+        size_t m_bufferSize;
+
+        //! True if we are in cork mode
+        bool m_corked;
+
+        //! Records held back in cork mode
+        Block m_cork;
+
+        //! True if anything has been sent since we were configured
+        bool m_sent;
+
+        //! Function to send a record header followed by file data
+        std::function<void(
+                const Socket&,
+                Block&&,
+                const std::shared_ptr<const int>&,
+                off_t,
+                size_t)> sendFile;
+
+        //! Compressor everything goes through. Null if not compressing.
+        Compressor::Pointer m_compressor;
     };
 }
 
@@ -0,0 +1,260 @@
+/*!
+ * @file       flatmultimap.hpp
+ * @brief      Declares the FlatMultimap container
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 14, 2026
+ * @copyright  Copyright &copy; 2026 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2026 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#ifndef FASTCGIPP_FLATMULTIMAP_HPP
+#define FASTCGIPP_FLATMULTIMAP_HPP
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+//! Topmost namespace for the fastcgi++ library
+namespace Fastcgipp
+{
+    //! A multimap stored as a sorted vector
+    /*!
+     * This provides the commonly used subset of the std::multimap interface
+     * for the handful of entries a typical request carries. All entries live
+     * in one contiguous block so building and searching it is far cheaper
+     * than with a node based tree.
+     *
+     * Entries removed by clear() or erase() are not destroyed but kept aside
+     * to be assigned over by later insertions. This way strings keep their
+     * allocated capacity and a container that gets cleared and refilled
+     * for every request stops allocating memory altogether.
+     *
+     * Unlike std::multimap, the key of a value_type is not const. Modifying
+     * it through an iterator breaks the ordering so don't do that.
+     *
+     * @tparam Key Key type
+     * @tparam Value Mapped type
+     *
+     * @date    October 14, 2026
+     * @author  Eddie Carle &lt;eddie@isatec.ca&gt;
+     */
+    template<class Key, class Value> class FlatMultimap
+    {
+    public:
+        typedef Key key_type;
+        typedef Value mapped_type;
+        typedef std::pair<Key, Value> value_type;
+        typedef typename std::vector<value_type>::iterator iterator;
+        typedef typename std::vector<value_type>::const_iterator const_iterator;
+        typedef typename std::vector<value_type>::size_type size_type;
+
+    private:
+        //! Entries. Those at m_size and above are spares.
+        std::vector<value_type> m_data;
+
+        //! Number of entries actually in the container
+        size_type m_size;
+
+        //! Put a new entry into the first spare and return it
+        value_type& spare()
+        {
+            if(m_size == m_data.size())
+                m_data.emplace_back();
+            return m_data[m_size++];
+        }
+
+        //! Move the last entry into it's sorted position
+        iterator place()
+        {
+            const auto position = std::upper_bound(
+                    begin(),
+                    end()-1,
+                    m_data[m_size-1].first,
+                    [] (const Key& y, const value_type& x)
+                    {
+                        return y < x.first;
+                    });
+            std::rotate(position, end()-1, end());
+            return position;
+        }
+
+    public:
+        FlatMultimap():
+            m_size(0)
+        {}
+
+        iterator begin()
+        {
+            return m_data.begin();
+        }
+
+        iterator end()
+        {
+            return m_data.begin()+m_size;
+        }
+
+        const_iterator begin() const
+        {
+            return m_data.cbegin();
+        }
+
+        const_iterator end() const
+        {
+            return m_data.cbegin()+m_size;
+        }
+
+        const_iterator cbegin() const
+        {
+            return begin();
+        }
+
+        const_iterator cend() const
+        {
+            return end();
+        }
+
+        size_type size() const
+        {
+            return m_size;
+        }
+
+        bool empty() const
+        {
+            return m_size == 0;
+        }
+
+        //! Remove all entries while keeping their storage around
+        void clear()
+        {
+            m_size = 0;
+        }
+
+        //! Reserve room for this many entries
+        void reserve(size_type size)
+        {
+            m_data.reserve(size);
+        }
+
+        //! Insert an entry after any others with the same key
+        iterator insert(const value_type& x)
+        {
+            value_type& slot = spare();
+            slot.first = x.first;
+            slot.second = x.second;
+            return place();
+        }
+
+        //! Insert an entry after any others with the same key
+        /*!
+         * If a spare entry is available, x is copied into it rather than
+         * moved so that the capacity of the spare is reused.
+         */
+        iterator insert(value_type&& x)
+        {
+            if(m_size == m_data.size())
+            {
+                m_data.push_back(std::move(x));
+                ++m_size;
+            }
+            else
+            {
+                value_type& slot = spare();
+                slot.first = x.first;
+                slot.second = x.second;
+            }
+            return place();
+        }
+
+        const_iterator lower_bound(const Key& key) const
+        {
+            return std::lower_bound(
+                    begin(),
+                    end(),
+                    key,
+                    [] (const value_type& x, const Key& y)
+                    {
+                        return x.first < y;
+                    });
+        }
+
+        const_iterator upper_bound(const Key& key) const
+        {
+            return std::upper_bound(
+                    begin(),
+                    end(),
+                    key,
+                    [] (const Key& y, const value_type& x)
+                    {
+                        return y < x.first;
+                    });
+        }
+
+        std::pair<const_iterator, const_iterator> equal_range(
+                const Key& key) const
+        {
+            return std::make_pair(lower_bound(key), upper_bound(key));
+        }
+
+        //! Find the first entry with the key
+        const_iterator find(const Key& key) const
+        {
+            const auto it = lower_bound(key);
+            if(it != end() && !(key < it->first))
+                return it;
+            return end();
+        }
+
+        size_type count(const Key& key) const
+        {
+            const auto range = equal_range(key);
+            return range.second-range.first;
+        }
+
+        //! Remove all entries with the key
+        /*!
+         * @return Number of entries removed
+         */
+        size_type erase(const Key& key)
+        {
+            const auto range = equal_range(key);
+            const size_type count = range.second-range.first;
+            std::rotate(
+                    begin()+(range.first-cbegin()),
+                    begin()+(range.second-cbegin()),
+                    end());
+            m_size -= count;
+            return count;
+        }
+
+        bool operator==(const FlatMultimap& x) const
+        {
+            return size() == x.size() && std::equal(begin(), end(), x.begin());
+        }
+
+        bool operator!=(const FlatMultimap& x) const
+        {
+            return !(*this == x);
+        }
+    };
+}
+
+#endif
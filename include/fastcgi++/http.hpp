@@ -33,13 +33,21 @@
 #include <istream>
 #include <iterator>
 #include <map>
+#include <unordered_map>
+#include <list>
+#include <mutex>
 #include <vector>
 #include <memory>
 #include <ctime>
 #include <atomic>
+#include <cstdio>
+#include <functional>
+#include <cstring>
+#include <algorithm>
 
 #include "fastcgi++/protocol.hpp"
 #include "fastcgi++/address.hpp"
+#include "fastcgi++/flatmultimap.hpp"
 
 //! Topmost namespace for the fastcgi++ library
 namespace Fastcgipp
@@ -72,15 +80,39 @@ namespace Fastcgipp
             //! File data
             mutable std::unique_ptr<char[]> data;
 
+            //! File data that was spilled to disk
+            /*!
+             * If the file was too big to be held in memory (see
+             * Environment::streamPosts()) this is an anonymous temporary file
+             * positioned at the start of the data and data is null. The
+             * temporary file disappears along with the stream.
+             */
+            mutable std::unique_ptr<std::FILE, int(*)(std::FILE*)> stream;
+
             //! Move constructor
             File(File&& x):
                 filename(std::move(x.filename)),
                 contentType(std::move(x.contentType)),
                 size(x.size),
-                data(std::move(x.data))
+                data(std::move(x.data)),
+                stream(std::move(x.stream))
             {}
 
-            File() {}
+            //! Move assignment
+            File& operator=(File&& x)
+            {
+                filename = std::move(x.filename);
+                contentType = std::move(x.contentType);
+                size = x.size;
+                data = std::move(x.data);
+                stream = std::move(x.stream);
+                return *this;
+            }
+
+            File():
+                size(0),
+                stream(nullptr, std::fclose)
+            {}
         };
 
         //! The HTTP request method as an enumeration
@@ -108,6 +140,102 @@ namespace Fastcgipp
             return os << requestMethodLabels[static_cast<int>(requestMethod)];
         }
 
+        //! Non-owning reference to a string of raw characters
+        /*!
+         * This is what Environment::raw() hands out. It does not own the
+         * characters it points to so it is only valid as long as the object
+         * that gave it out is left alone.
+         *
+         * @date    October 14, 2026
+         * @author  Eddie Carle &lt;eddie@isatec.ca&gt;
+         */
+        class RawString
+        {
+        private:
+            const char* m_data;
+            size_t m_size;
+
+        public:
+            RawString():
+                m_data(nullptr),
+                m_size(0)
+            {}
+
+            RawString(const char* data, size_t size):
+                m_data(data),
+                m_size(size)
+            {}
+
+            const char* data() const
+            {
+                return m_data;
+            }
+
+            size_t size() const
+            {
+                return m_size;
+            }
+
+            bool empty() const
+            {
+                return m_size == 0;
+            }
+
+            const char* begin() const
+            {
+                return m_data;
+            }
+
+            const char* end() const
+            {
+                return m_data+m_size;
+            }
+
+            //! True if this actually refers to something
+            explicit operator bool() const
+            {
+                return m_data != nullptr;
+            }
+
+            //! Compare to a null terminated string
+            bool operator==(const char* x) const
+            {
+                const size_t size = std::strlen(x);
+                return size == m_size && std::equal(x, x+size, m_data);
+            }
+
+            bool operator!=(const char* x) const
+            {
+                return !(*this == x);
+            }
+
+            //! Copy into a std::string
+            std::string str() const
+            {
+                return std::string(m_data, m_size);
+            }
+        };
+
+        //! Container policy for Environment using std::multimap
+        struct TreeContainers
+        {
+            template<class Key, class Value>
+            using Multimap = std::multimap<Key, Value>;
+        };
+
+        //! Container policy for Environment using FlatMultimap
+        /*!
+         * With this policy gets, posts and cookies are stored in sorted
+         * vectors rather than trees. Along with Environment::clear() keeping
+         * their storage around, a recycled Environment can take in a typical
+         * request without touching the allocator.
+         */
+        struct FlatContainers
+        {
+            template<class Key, class Value>
+            using Multimap = FlatMultimap<Key, Value>;
+        };
+
         //! Data structure of HTTP environment data
         /*!
          * This structure contains all HTTP environment data for each
@@ -115,12 +243,21 @@ namespace Fastcgipp
          * records.
          *
          * @tparam charT Character type to use for strings
+         * @tparam Containers Policy deciding what type of multimap stores
+         *                    gets, posts and cookies. Either TreeContainers
+         *                    or FlatContainers.
          *
-         * @date    March 24, 2020
+         * @date    October 14, 2026
          * @author  Eddie Carle &lt;eddie@isatec.ca&gt;
          */
-        template<class charT> struct Environment
+        template<class charT, class Containers=TreeContainers>
+        struct Environment
         {
+            //! Container type for gets, posts and cookies
+            typedef typename Containers::template Multimap<
+                std::basic_string<charT>,
+                std::basic_string<charT>> Multimap;
+
             //! Hostname of the server
             std::basic_string<charT> host;
 
@@ -138,6 +275,9 @@ namespace Fastcgipp
 
             //! Character sets the clients accepts
             std::basic_string<charT> acceptCharsets;
+
+            //! Content codings the client accepts
+            std::basic_string<charT> acceptEncodings;
 	  
             //! Http authorization string
             std::basic_string<charT> authorization;
@@ -164,6 +304,10 @@ namespace Fastcgipp
             std::vector<std::basic_string<charT>> pathInfo;
 
             //! The etag the client assumes this document should have
+            /*!
+             * This is the number in the first entity tag of If-None-Match
+             * with any quotes, weak prefix and suffix stripped off.
+             */
             unsigned etag;
 
             //! How many seconds the connection should be kept alive
@@ -187,25 +331,25 @@ namespace Fastcgipp
             //! Timestamp the client has for this document
             std::time_t ifModifiedSince;
 
+            //! Length of the file data to be filtered (FILTER role only)
+            unsigned dataLength;
+
+            //! Timestamp of the file data to be filtered (FILTER role only)
+            std::time_t dataLastModified;
+
             //! Container with all other enironment variables
             std::map<
                 std::basic_string<charT>,
                 std::basic_string<charT>> others;
 
             //! Container with all url-encoded cookie data
-            std::multimap<
-                std::basic_string<charT>,
-                std::basic_string<charT>> cookies;
+            Multimap cookies;
 
             //! Container with all url-encoded GET data
-            std::multimap<
-                std::basic_string<charT>,
-                std::basic_string<charT>> gets;
+            Multimap gets;
 
             //! Container of non-file POST data
-            std::multimap<
-                std::basic_string<charT>,
-                std::basic_string<charT>> posts;
+            Multimap posts;
 
             //! Container of file POST data
             std::multimap<
@@ -226,10 +370,53 @@ namespace Fastcgipp
                     const char* data,
                     const char* dataEnd);
 
+            //! Keep parameters in raw form until they are asked for
+            /*!
+             * By default fill() converts every parameter into it's respective
+             * data member as it comes in. Once this is called, fill() only
+             * keeps the raw parameter data around and indexes it.  Only
+             * REQUEST_METHOD, CONTENT_LENGTH and CONTENT_TYPE, which are needed
+             * to handle the request at all, are still parsed on the spot.
+             * Everything else must then be accessed as raw() data, or be
+             * converted into it's data member with parse(). This setting
+             * survives clear().
+             */
+            void parseLazily()
+            {
+                m_lazy = true;
+            }
+
+            //! Convert stored raw parameters into their data members
+            /*!
+             * This only does anything if parseLazily() is in effect. Each
+             * parameter is only ever converted once so this can be called as
+             * often as is convenient.
+             *
+             * @param[in] name If not null, only the parameter with this name is
+             *                 converted. For example "HTTP_COOKIE" will fill
+             *                 in cookies and nothing else.
+             */
+            void parse(const char* name=nullptr);
+
+            //! Get the raw value of a FastCGI parameter
+            /*!
+             * This only works if parseLazily() is in effect. The returned
+             * value is only valid until the next call to fill() or clear().
+             *
+             * @param[in] name Name of the FastCGI parameter. For example
+             *                 "HTTP_HOST".
+             * @return Raw value of the parameter. This will convert to false if
+             *         the parameter wasn't received.
+             */
+            RawString raw(const char* name) const;
+
             //! Consolidates POST data into a single buffer
             /*!
              * This function will take arbitrarily divided chunks of raw http
-             * post data and consolidate them into m_postBuffer.
+             * post data and consolidate them into m_postBuffer. If
+             * streamPosts() is in effect and the content type is recognized,
+             * the data is parsed on the spot instead and m_postBuffer only
+             * holds onto what it must until more data arrives.
              *
              * @param[in] start Start of post data.
              * @param[in] end 1+ the last byte of post data
@@ -254,6 +441,52 @@ namespace Fastcgipp
                 return m_postBuffer;
             }
 
+            //! How many bytes of POST data have been received in total
+            size_t postSize() const
+            {
+                return m_postSize;
+            }
+
+            //! Receives uploaded file data as it streams in
+            /*!
+             * This is called with consecutive pieces of an uploaded file and
+             * then once more with a size of zero when the file is complete.
+             * The name of the file parameter and the File object, sans data,
+             * are passed along with every piece.
+             */
+            typedef std::function<void(
+                    const std::basic_string<charT>& name,
+                    const File<charT>& file,
+                    const char* data,
+                    size_t size)> FileSink;
+
+            //! Parse POST data incrementally as it arrives
+            /*!
+             * By default the entire POST body is consolidated into
+             * postBuffer() and parsed in one go by parsePostBuffer(). Once
+             * this is called, fillPostBuffer() parses "multipart/form-data"
+             * and "application/x-www-form-urlencoded" data as it comes in so
+             * memory use stays bounded regardless of upload size. Only what
+             * can not yet be parsed stays in postBuffer() which means a
+             * Request::inProcessor() will never see the raw data of those
+             * content types. This setting survives clear().
+             *
+             * @param[in] spill Uploaded files that grow beyond this many bytes
+             *                  are moved out of memory and into File::stream.
+             * @param[in] sink If set, uploaded file data is passed to this as
+             *                 it arrives and never stored at all. The
+             *                 resulting entry in files will only carry the
+             *                 size.
+             */
+            void streamPosts(
+                    size_t spill = 0x10000,
+                    const FileSink& sink = FileSink())
+            {
+                m_streaming = true;
+                m_spill = spill;
+                m_fileSink = sink;
+            }
+
             //! Clear the post buffer
             void clearPostBuffer()
             {
@@ -261,6 +494,14 @@ namespace Fastcgipp
                 m_postBuffer.shrink_to_fit();
             }
 
+            //! Reset everything back to a freshly constructed state
+            /*!
+             * Unlike assigning a new Environment, all strings keep their
+             * allocated capacity so an Environment can be reused without
+             * much allocator traffic.
+             */
+            void clear();
+
             Environment():
                 requestMethod(RequestMethod::ERROR),
                 etag(0),
@@ -268,22 +509,139 @@ namespace Fastcgipp
                 contentLength(0),
                 serverPort(0),
                 remotePort(0),
-                ifModifiedSince(0)
+                ifModifiedSince(0),
+                dataLength(0),
+                dataLastModified(0),
+                m_postSize(0),
+                m_postType(PostType::UNKNOWN),
+                m_inPart(false),
+                m_partNamed(false),
+                m_partIsFile(false),
+                m_streaming(false),
+                m_spill(~size_t(0)),
+                m_lazy(false)
             {}
         private:
+            //! Convert a single parameter into it's data member
+            inline void parameter(
+                    const char* name,
+                    const char* value,
+                    const char* end);
+
             //! Parses "multipart/form-data" http post data
-            inline void parsePostsMultipart();
+            /*!
+             * Everything that can be parsed is consumed from the front of
+             * m_postBuffer. Anything after the last complete part header and
+             * the tail end of a file body, which might yet turn out to be
+             * the boundary, is left there until more data arrives.
+             *
+             * @param[in] last True if there is no more data to come.
+             */
+            inline void parsePostsMultipart(bool last);
 
             //! Parses "application/x-www-form-urlencoded" post data
-            inline void parsePostsUrlEncoded();
+            /*!
+             * Everything up until the last '&' is consumed from the front of
+             * m_postBuffer.
+             *
+             * @param[in] last True if there is no more data to come.
+             */
+            inline void parsePostsUrlEncoded(bool last);
+
+            //! Pull the name, filename and content type from a part header
+            inline void parsePartHeader(const char* start, const char* end);
+
+            //! Store a piece of the body of an uploaded file
+            inline void fileData(const char* start, const char* end);
+
+            //! Finish up a multipart part and insert it
+            inline void finishPart(const char* bodyStart, const char* bodyEnd);
 
             //! Raw string of characters representing the post boundary
             std::vector<char> boundary;
 
             //! Buffer for processing post data
             std::vector<char> m_postBuffer;
+
+            //! Total amount of POST data received
+            size_t m_postSize;
+
+            //! Recognized POST content types
+            enum class PostType
+            {
+                UNKNOWN,
+                NONE,
+                MULTIPART,
+                URLENCODED
+            };
+
+            //! Content type of the POST data. Resolved on the first data.
+            PostType m_postType;
+
+            //! Figure out the content type of the POST data
+            inline PostType postType();
+
+            //! True if the multipart parser is within a part body
+            bool m_inPart;
+
+            //! True if the current part has a name
+            bool m_partNamed;
+
+            //! True if the current part is a file
+            bool m_partIsFile;
+
+            //! Name of the current part
+            std::basic_string<charT> m_partName;
+
+            //! File data of the current part
+            File<charT> m_partFile;
+
+            //! In memory data of the current file part
+            std::vector<char> m_fileBuffer;
+
+            //! True if POST data should be parsed as it arrives
+            bool m_streaming;
+
+            //! Files bigger than this get spilled to disk
+            size_t m_spill;
+
+            //! Where to send uploaded file data if anywhere
+            FileSink m_fileSink;
+
+            //! True if parameters are stored raw and parsed on demand
+            bool m_lazy;
+
+            //! Raw parameter data stored by fill() when parsing lazily
+            std::vector<char> m_parameterData;
+
+            //! Location of a raw parameter within m_parameterData
+            struct RawParameter
+            {
+                size_t name;
+                size_t value;
+                size_t end;
+                bool parsed;
+            };
+
+            //! Index of the raw parameters within m_parameterData
+            std::vector<RawParameter> m_parameters;
         };
 
+        //! Only keep certain unrecognized parameters in Environment::others
+        /*!
+         * By default every FastCGI parameter that Environment doesn't have a
+         * data member for is converted and kept in Environment::others. Once
+         * this is called only the parameters named here are. Everything else
+         * is skipped without being converted or copied anywhere. Pass an
+         * empty list to skip them all.
+         *
+         * This is not thread safe so call it before starting the Manager.
+         *
+         * @param[in] names Names of the parameters to keep. For example
+         *                  "HTTP_X_FORWARDED_FOR".
+         */
+        void keepOthers(const std::vector<std::string>& names);
+
         //! Convert a char array to a std::wstring
         /*!
          * @param[in] start First byte in char array
@@ -354,6 +712,15 @@ namespace Fastcgipp
                     std::basic_string<charT>>& output,
                 const char* const fieldSeparator="&");
 
+        //! Decodes a url-encoded string into a FlatMultimap container
+        template<class charT> void decodeUrlEncoded(
+                const char* data,
+                const char* dataEnd,
+                FlatMultimap<
+                    std::basic_string<charT>,
+                    std::basic_string<charT>>& output,
+                const char* const fieldSeparator="&");
+
         //! Convert a string with percent escaped byte values to their values
         /*!
          * Since converting a percent escaped string to actual values can only
@@ -470,6 +837,12 @@ namespace Fastcgipp
                     std::basic_ostream<charT, Traits>& os,
                     const SessionId& x);
 
+            //! The raw ID data
+            const std::array<unsigned char, size>& data() const
+            {
+                return m_data;
+            }
+
             bool operator<(const SessionId& x) const
             {
                 return std::memcmp(
@@ -493,13 +866,65 @@ namespace Fastcgipp
                 std::basic_ostream<charT, Traits>& os,
                 const SessionId& x)
         {
-            base64Encode(
-                    x.m_data.begin(),
-                    x.m_data.end(),
-                    std::ostream_iterator<charT, charT, Traits>(os));
+            charT string[SessionId::stringLength];
+            base64Encode(x.m_data.begin(), x.m_data.end(), string);
+            os.write(string, SessionId::stringLength);
             return os;
         }
 
+        //! Interface for session storage shared beyond a single process
+        /*!
+         * Sessions keeps everything in process memory by default. When
+         * given a store, session data is additionally kept in it so that
+         * several processes serving the same clients see the same
+         * sessions. Since session data never changes once generated, the
+         * store only ever has to deal with inserting, fetching, refreshing
+         * and erasing serialized data.
+         *
+         * Implementations must be thread safe.
+         *
+         * @date    October 14, 2026
+         * @author  Eddie Carle &lt;eddie@isatec.ca&gt;
+         */
+        class SessionStore
+        {
+        public:
+            //! Store data for a newly generated session
+            /*!
+             * @param[in] id ID of the new session
+             * @param[in] data Serialized session data
+             * @param[in] now Current time to use as the last access time
+             * @return False if the ID is already in use.
+             */
+            virtual bool insert(
+                    const SessionId& id,
+                    const std::string& data,
+                    std::time_t now) =0;
+
+            //! Fetch and refresh a session
+            /*!
+             * Sessions last used before oldest are considered expired and
+             * treated as nonexistent.
+             *
+             * @param[in] id ID of the session we are looking for
+             * @param[in] oldest Sessions last used before this are expired
+             * @param[in] now Current time to use as the last access time
+             * @param[out] data If not null, the serialized session data is
+             *                  stored here.
+             * @return False if the session doesn't exist.
+             */
+            virtual bool fetch(
+                    const SessionId& id,
+                    std::time_t oldest,
+                    std::time_t now,
+                    std::string* data) =0;
+
+            //! Erase a session
+            virtual void erase(const SessionId& id) =0;
+
+            virtual ~SessionStore() {}
+        };
+
         //! Container for HTTP sessions
         /*!
          * In many ways this class behaves like an std::map. Additions include
@@ -507,30 +932,80 @@ namespace Fastcgipp
          * time and a frequency of deletion, and full thread safety. Basically
          * it contains all session data and associates it with ID values.
          *
+         * Sessions are spread over a number of independently locked shards
+         * selected by the ID data so that concurrent requests rarely contend
+         * for the same mutex. Within a shard sessions are kept in order of last
+         * access which means expired sessions are always found at the front.
+         * Clearing them out costs only as much as the amount of sessions that
+         * actually expired and never holds more than one shard's lock.
+         *
          * Session data is only available as constant in order to ensure thread
          * safety when accessing the data. It is not only possible, but very
          * probable, that multiple requests/threads will be accessing the same
          * session data simultaneously.
          *
+         * If constructed with a SessionStore the in process shards act as a
+         * cache in front of it. The store is always consulted to confirm a
+         * session still exists and sessions not found locally are fetched
+         * from it. In this case size() only reflects the sessions cached by
+         * this process.
+         *
          * @tparam T Class containing session data.
          *
-         * @date    May 26, 2016
+         * @date    October 14, 2026
          * @author  Eddie Carle &lt;eddie@isatec.ca&gt;
          */
         template<class T> class Sessions
         {
         private:
+            //! Hashes session IDs by their (random) ID data
+            struct Hash
+            {
+                size_t operator()(const SessionId& id) const
+                {
+                    size_t hash;
+                    std::memcpy(&hash, id.m_data.data(), sizeof(hash));
+                    return hash;
+                }
+            };
+
+            //! Sessions in order of last access with the oldest first
+            typedef std::list<SessionId> Order;
+
+            //! What a session ID maps to
+            struct Session
+            {
+                //! The actual session data
+                std::shared_ptr<const T> data;
+
+                //! Position of the session in the shard's access order
+                typename Order::iterator position;
+            };
+
+            //! An independently locked subset of the sessions
+            struct Shard
+            {
+                //! Actual container of sessions
+                std::unordered_map<SessionId, Session, Hash> sessions;
+
+                //! Session IDs in order of last access
+                Order order;
+
+                //! Thread safe all operations on this shard
+                mutable std::mutex mutex;
+            };
+
             //! Amount of seconds to keep sessions around for.
             const unsigned int m_keepAlive;
 
             //! The time that the next session cleanup should be done.
-            std::time_t m_cleanupTime;
+            std::atomic<std::time_t> m_cleanupTime;
 
-            //! Actual container of sessions
-            std::map<SessionId, std::shared_ptr<const T>> m_sessions;
+            //! How many shards are there? Always a power of two.
+            const unsigned int m_shardCount;
 
-            //! Thread safe all operations
-            mutable std::mutex m_mutex;
+            //! The shards themselves
+            const std::unique_ptr<Shard[]> m_shards;
 
             //! Length of expiration string (with null terminator)
             static const size_t expirationLength = 30;
@@ -544,15 +1019,112 @@ namespace Fastcgipp
             //! Internal helper for building the m_expiration string
             void setExpiration();
 
+            //! Which shard does a session ID belong to?
+            Shard& shard(const SessionId& id) const
+            {
+                // The hash uses the leading bytes so we use the last one here
+                return m_shards[id.m_data[SessionId::size-1]&(m_shardCount-1)];
+            }
+
+            //! Round the requested shard count up to a power of two
+            static unsigned int shardCount(unsigned int shards)
+            {
+                unsigned int count = 1;
+                while(count < shards && count < 256)
+                    count <<= 1;
+                return count;
+            }
+
+            //! Erase sessions in a shard last used before oldest
+            /*!
+             * The shard must be locked before calling this.
+             */
+            static void expire(Shard& shard, std::time_t oldest)
+            {
+                while(!shard.order.empty()
+                        && shard.order.front().m_timestamp < oldest)
+                {
+                    shard.sessions.erase(shard.order.front());
+                    shard.order.pop_front();
+                }
+            }
+
+            //! Erase a session from it's locked shard
+            static void erase(
+                    Shard& shard,
+                    typename std::unordered_map<SessionId, Session, Hash>
+                        ::iterator session)
+            {
+                shard.order.erase(session->second.position);
+                shard.sessions.erase(session);
+            }
+
+            //! Sweep expired sessions out of every shard if it is time to
+            void cleanup(std::time_t now);
+
+            //! Optional storage shared with other processes
+            const std::shared_ptr<SessionStore> m_store;
+
+            //! Convert session data for the store
+            const std::function<std::string(const T&)> m_serialize;
+
+            //! Convert session data from the store
+            const std::function<std::shared_ptr<const T>(const std::string&)>
+                m_deserialize;
+
+            //! Cache a session in it's locked shard
+            void cache(
+                    Shard& shard,
+                    const SessionId& id,
+                    const std::shared_ptr<const T>& data);
+
         public:
             //! Constructor takes session keep alive times
             /*!
              * @param[in] keepAlive Amount of seconds a session will stay alive
              *                      for.
+             * @param[in] shards Amount of independently locked shards to split
+             *                   the sessions over. This is rounded up to a
+             *                   power of two no greater than 256.
              */
-            Sessions(unsigned int keepAlive):
+            Sessions(unsigned int keepAlive, unsigned int shards=16):
                 m_keepAlive(keepAlive),
-                m_cleanupTime(std::time(nullptr)+keepAlive)
+                m_cleanupTime(std::time(nullptr)+keepAlive),
+                m_shardCount(shardCount(shards)),
+                m_shards(new Shard[m_shardCount])
+            {
+                setExpiration();
+            }
+
+            //! Constructor for sessions backed by a store
+            /*!
+             * @param[in] keepAlive Amount of seconds a session will stay alive
+             *                      for.
+             * @param[in] store Storage to share the sessions through.
+             * @param[in] serialize Function to convert session data into a
+             *                      string for the store.
+             * @param[in] deserialize Function to convert a string from the
+             *                        store back into session data. It should
+             *                        return a null pointer if the data is
+             *                        invalid.
+             * @param[in] shards Amount of independently locked shards to split
+             *                   the sessions over. This is rounded up to a
+             *                   power of two no greater than 256.
+             */
+            Sessions(
+                    unsigned int keepAlive,
+                    const std::shared_ptr<SessionStore>& store,
+                    const std::function<std::string(const T&)>& serialize,
+                    const std::function<std::shared_ptr<const T>(
+                        const std::string&)>& deserialize,
+                    unsigned int shards=16):
+                m_keepAlive(keepAlive),
+                m_cleanupTime(std::time(nullptr)+keepAlive),
+                m_shardCount(shardCount(shards)),
+                m_shards(new Shard[m_shardCount]),
+                m_store(store),
+                m_serialize(serialize),
+                m_deserialize(deserialize)
             {
                 setExpiration();
             }
@@ -568,8 +1140,13 @@ namespace Fastcgipp
             //! How many active sessions are there?
             size_t size() const
             {
-                std::lock_guard<std::mutex> lock(m_mutex);
-                return m_sessions.size();
+                size_t count = 0;
+                for(unsigned int i=0; i<m_shardCount; ++i)
+                {
+                    std::lock_guard<std::mutex> lock(m_shards[i].mutex);
+                    count += m_shards[i].sessions.size();
+                }
+                return count;
             }
 
             //! Generates a new session
@@ -587,8 +1164,13 @@ namespace Fastcgipp
              */
             void erase(const SessionId& id)
             {
-                std::lock_guard<std::mutex> lock(m_mutex);
-                m_sessions.erase(id);
+                if(m_store)
+                    m_store->erase(id);
+                Shard& shard = this->shard(id);
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                const auto session = shard.sessions.find(id);
+                if(session != shard.sessions.end())
+                    erase(shard, session);
             }
 
             //! Expiration string for setting cookies
@@ -647,32 +1229,26 @@ Out Fastcgipp::Http::base64Decode(In start, In end, Out destination)
 template<class In, class Out>
 Out Fastcgipp::Http::base64Encode(In start, In end, Out destination)
 {
-    for(int buffer, bitPos=-6, padded; start!=end || bitPos>-6; ++destination)
+    // Whole groups of three bytes go straight into four characters
+    while(start != end)
     {
-        if(bitPos==-6)
+        uint32_t buffer = uint32_t(static_cast<unsigned char>(*start++)) << 16;
+        unsigned bytes = 1;
+        if(start != end)
         {
-            bitPos=16;
-            buffer=0;
-            padded=-6;
-            while(bitPos!=-8)
-            {
-                if(start!=end)
-                    buffer |= static_cast<int>(
-                            *reinterpret_cast<const unsigned char*>(
-                                start++)) << bitPos;
-                else padded+=6;
-                bitPos-=8;
+            buffer |= uint32_t(static_cast<unsigned char>(*start++)) << 8;
+            ++bytes;
+            if(start != end)
+            {
+                buffer |= uint32_t(static_cast<unsigned char>(*start++));
+                ++bytes;
             }
-            bitPos=18;
         }
 
-        if(padded == bitPos)
-        {
-            *destination='=';
-            padded-=6;
-        }
-        else *destination=base64Characters[ (buffer >> bitPos)&0x3f ];
-        bitPos -= 6;
+        *destination++ = base64Characters[(buffer >> 18)&0x3f];
+        *destination++ = base64Characters[(buffer >> 12)&0x3f];
+        *destination++ = bytes>1?base64Characters[(buffer >> 6)&0x3f]:'=';
+        *destination++ = bytes>2?base64Characters[buffer&0x3f]:'=';
     }
 
     return destination;
@@ -681,55 +1257,96 @@ Out Fastcgipp::Http::base64Encode(In start, In end, Out destination)
 template<class T> Fastcgipp::Http::SessionId
 Fastcgipp::Http::Sessions<T>::generate(const std::shared_ptr<const T>& data)
 {
-    std::lock_guard<std::mutex> lock(m_mutex);
-    std::pair<
-            typename std::map<SessionId, std::shared_ptr<const T>>::iterator,
-            bool>
-        retVal;
-    retVal.second=false;
-    while(!retVal.second)
-        retVal=m_sessions.insert(std::pair<SessionId, std::shared_ptr<const T>>(
-                    SessionId(),
-                    data));
-    return retVal.first->first;
+    const std::time_t now = std::time(nullptr);
+    cleanup(now);
+
+    while(true)
+    {
+        const SessionId id;
+        if(m_store && !m_store->insert(id, m_serialize(*data), now))
+            continue;
+        Shard& shard = this->shard(id);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if(shard.sessions.find(id) == shard.sessions.end())
+        {
+            cache(shard, id, data);
+            return id;
+        }
+    }
 }
 
 template<class T> std::shared_ptr<const T>
 Fastcgipp::Http::Sessions<T>::get(const SessionId& id)
 {
-    std::lock_guard<std::mutex> lock(m_mutex);
     const std::time_t now = std::time(nullptr);
     const std::time_t oldest(now-m_keepAlive);
+    cleanup(now);
+
+    Shard& shard = this->shard(id);
+    std::unique_lock<std::mutex> lock(shard.mutex);
+    expire(shard, oldest);
 
-    if(now >= m_cleanupTime)
+    const auto session = shard.sessions.find(id);
+    if(session != shard.sessions.end())
     {
-        auto session = m_sessions.begin();
-        while(session != m_sessions.end())
+        if(m_store && !m_store->fetch(id, oldest, now, nullptr))
         {
-            if(session->first.m_timestamp < oldest)
-                session = m_sessions.erase(session);
-            else
-                ++session;
+            erase(shard, session);
+            return std::shared_ptr<const T>();
         }
-        m_cleanupTime = std::time(nullptr)+m_keepAlive;
-        setExpiration();
+        session->second.position->m_timestamp = now;
+        shard.order.splice(
+                shard.order.end(),
+                shard.order,
+                session->second.position);
+        return session->second.data;
     }
+    lock.unlock();
 
-    const auto session = m_sessions.find(id);
-    if(session != m_sessions.cend())
+    std::string serialized;
+    if(m_store && m_store->fetch(id, oldest, now, &serialized))
     {
-        if(session->first.m_timestamp < oldest)
-            m_sessions.erase(session);
-        else
+        const std::shared_ptr<const T> data(m_deserialize(serialized));
+        if(data)
         {
-            session->first.refresh();
-            return session->second;
+            lock.lock();
+            if(shard.sessions.find(id) == shard.sessions.end())
+                cache(shard, id, data);
         }
+        return data;
     }
 
     return std::shared_ptr<const T>();
 }
 
+template<class T> void Fastcgipp::Http::Sessions<T>::cache(
+        Shard& shard,
+        const SessionId& id,
+        const std::shared_ptr<const T>& data)
+{
+    Session& session = shard.sessions[id];
+    session.data = data;
+    session.position = shard.order.insert(shard.order.end(), id);
+    session.position->refresh();
+}
+
+template<class T> void Fastcgipp::Http::Sessions<T>::cleanup(std::time_t now)
+{
+    std::time_t cleanupTime = m_cleanupTime;
+    if(now < cleanupTime || !m_cleanupTime.compare_exchange_strong(
+                cleanupTime,
+                now+m_keepAlive))
+        return;
+
+    const std::time_t oldest(now-m_keepAlive);
+    for(unsigned int i=0; i<m_shardCount; ++i)
+    {
+        std::lock_guard<std::mutex> lock(m_shards[i].mutex);
+        expire(m_shards[i], oldest);
+    }
+    setExpiration();
+}
+
 template<class T> void Fastcgipp::Http::Sessions<T>::setExpiration()
 {
     char* const newExpiration(
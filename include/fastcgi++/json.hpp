@@ -0,0 +1,435 @@
+/*!
+ * @file       json.hpp
+ * @brief      Declares the Json class
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 15, 2026
+ * @copyright  Copyright &copy; 2026 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2026 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#ifndef FASTCGIPP_JSON_HPP
+#define FASTCGIPP_JSON_HPP
+
+#include "fastcgi++/fcgistreambuf.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <cwchar>
+#include <map>
+#include <ostream>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+//! Topmost namespace for the fastcgi++ library
+namespace Fastcgipp
+{
+    //! A named member of a struct for Json to serialize
+    template<class T, class Member> struct JsonField
+    {
+        //! Key the member is written under
+        const char* name;
+
+        //! The member itself
+        Member T::* member;
+    };
+
+    //! Make a JsonField
+    /*!
+     * This is meant to be used in a jsonFields() function. See Json.
+     */
+    template<class T, class Member>
+    constexpr JsonField<T, Member> jsonField(
+            const char* name,
+            Member T::* member)
+    {
+        return JsonField<T, Member>{name, member};
+    }
+
+    //! Streaming JSON writer
+    /*!
+     * This writes JSON straight into the put area of an FcgiStreambuf,
+     * bypassing std::basic_ostream along with it's sentries, locales and
+     * virtual calls. Full buffers are handed off to be sent as they would be
+     * otherwise. Numbers are formatted by hand and strings are escaped with
+     * the vectorized Scan::findAny(). Commas and colons are taken care of.
+     *
+     * @code
+     * Fastcgipp::Json<char> json(out);
+     * json.beginObject();
+     * json.field("id", 17).field("tags", tags);
+     * json.endObject();
+     * @endcode
+     *
+     * Vectors, maps with string keys and tuples (as arrays) are written as
+     * you would expect. Structs are written as objects once they are given a
+     * jsonFields() function that is found through argument dependent lookup.
+     * It takes a null pointer to the struct and returns a tuple of
+     * jsonField(). All the work is done at compile time.
+     *
+     * @code
+     * struct User
+     * {
+     *     int id;
+     *     std::string name;
+     * };
+     *
+     * inline auto jsonFields(const User*)
+     * {
+     *     return std::make_tuple(
+     *         Fastcgipp::jsonField("id", &User::id),
+     *         Fastcgipp::jsonField("name", &User::name));
+     * }
+     * @endcode
+     *
+     * The rows of an SQL::Results are tuples as well so they can be written
+     * as arrays or with object() and rows() as objects keyed by column name.
+     *
+     * Nothing is committed to the stream buffer until commit() is called or
+     * the writer is destroyed. It has to be done before the stream is used
+     * in any other way. Wide writers take narrow strings as ASCII while
+     * narrow writers encode wide strings in UTF-8. Floating point numbers
+     * that aren't finite are written as null.
+     *
+     * @tparam charT Character type of the stream buffer
+     *
+     * @date    October 15, 2026
+     * @author  Eddie Carle &lt;eddie@isatec.ca&gt;
+     */
+    template<class charT> class Json
+    {
+    public:
+        //! Write into a stream buffer
+        explicit Json(FcgiStreambuf<charT>& streambuf):
+            m_streambuf(streambuf),
+            m_put(nullptr),
+            m_end(nullptr),
+            m_first(true)
+        {}
+
+        //! Write into the stream buffer of a stream
+        /*!
+         * This throws std::bad_cast if the stream buffer isn't an
+         * FcgiStreambuf. The output stream of a Request always is.
+         */
+        explicit Json(std::basic_ostream<charT>& stream):
+            Json(dynamic_cast<FcgiStreambuf<charT>&>(*stream.rdbuf()))
+        {}
+
+        Json(const Json&) = delete;
+        Json& operator=(const Json&) = delete;
+
+        ~Json()
+        {
+            commit();
+        }
+
+        //! Commit everything written to the stream buffer
+        void commit()
+        {
+            if(m_put != nullptr)
+            {
+                m_streambuf.commit(m_put);
+                m_put = nullptr;
+                m_end = nullptr;
+            }
+        }
+
+        Json& beginObject()
+        {
+            separate();
+            put('{');
+            m_first = true;
+            return *this;
+        }
+
+        Json& endObject()
+        {
+            put('}');
+            m_first = false;
+            return *this;
+        }
+
+        Json& beginArray()
+        {
+            separate();
+            put('[');
+            m_first = true;
+            return *this;
+        }
+
+        Json& endArray()
+        {
+            put(']');
+            m_first = false;
+            return *this;
+        }
+
+        //! Write the key of the next member of an object
+        Json& key(const char* name, size_t size)
+        {
+            separate();
+            quoted(name, size);
+            put(':');
+            m_first = true;
+            return *this;
+        }
+
+        Json& key(const char* name)
+        {
+            return key(name, std::strlen(name));
+        }
+
+        Json& key(const std::string& name)
+        {
+            return key(name.data(), name.size());
+        }
+
+        //! Write a member of an object
+        template<class T> Json& field(const char* name, const T& x)
+        {
+            key(name);
+            return value(x);
+        }
+
+        //! Write a string
+        Json& string(const char* data, size_t size)
+        {
+            separate();
+            quoted(data, size);
+            return *this;
+        }
+
+        //! Write a string
+        Json& string(const wchar_t* data, size_t size)
+        {
+            separate();
+            quoted(data, size);
+            return *this;
+        }
+
+        Json& null();
+
+        Json& value(std::nullptr_t)
+        {
+            return null();
+        }
+
+        Json& value(bool x);
+
+        template<class T>
+        typename std::enable_if<
+            std::is_integral<T>::value && !std::is_same<T, bool>::value,
+            Json&>::type
+        value(T x)
+        {
+            return x < 0 ?
+                integer(std::uint64_t(0)-std::uint64_t(x), true)
+                : integer(std::uint64_t(x), false);
+        }
+
+        Json& value(double x);
+        Json& value(float x);
+
+        Json& value(const char* x)
+        {
+            return string(x, std::strlen(x));
+        }
+
+        Json& value(const std::string& x)
+        {
+            return string(x.data(), x.size());
+        }
+
+        Json& value(const wchar_t* x)
+        {
+            return string(x, std::wcslen(x));
+        }
+
+        Json& value(const std::wstring& x)
+        {
+            return string(x.data(), x.size());
+        }
+
+        template<class T> Json& value(const std::vector<T>& x)
+        {
+            beginArray();
+            for(const auto& element: x)
+                value(element);
+            return endArray();
+        }
+
+        template<class T, class Compare>
+        Json& value(const std::map<std::string, T, Compare>& x)
+        {
+            beginObject();
+            for(const auto& member: x)
+                field(member.first.c_str(), member.second);
+            return endObject();
+        }
+
+        //! Write a tuple as an array
+        template<class... Types> Json& value(const std::tuple<Types...>& x)
+        {
+            beginArray();
+            elements(x, std::index_sequence_for<Types...>());
+            return endArray();
+        }
+
+        //! Write a struct that has a jsonFields() function as an object
+        template<class T>
+        auto value(const T& x) -> decltype(
+                jsonFields(static_cast<const T*>(nullptr)),
+                std::declval<Json&>())
+        {
+            const auto fields = jsonFields(static_cast<const T*>(nullptr));
+            beginObject();
+            members(
+                    x,
+                    fields,
+                    std::make_index_sequence<
+                        std::tuple_size<decltype(fields)>::value>());
+            return endObject();
+        }
+
+        //! Write a tuple as an object
+        /*!
+         * @param[in] x Tuple to write
+         * @param[in] names Key for each element of the tuple
+         */
+        template<class... Types> Json& object(
+                const std::tuple<Types...>& x,
+                const char* const (&names)[sizeof...(Types)])
+        {
+            beginObject();
+            named(x, names, std::index_sequence_for<Types...>());
+            return endObject();
+        }
+
+        //! Write every row of a result set as an array
+        /*!
+         * @param[in] results Anything with rows() and row() like
+         *                    SQL::Results
+         */
+        template<class Results> Json& rows(const Results& results)
+        {
+            beginArray();
+            for(unsigned row=0; row<results.rows(); ++row)
+                value(results.row(row));
+            return endArray();
+        }
+
+        //! Write every row of a result set as an object
+        /*!
+         * @param[in] results Anything with rows() and row() like
+         *                    SQL::Results
+         * @param[in] names Key for each column
+         */
+        template<class Results, size_t columns> Json& rows(
+                const Results& results,
+                const char* const (&names)[columns])
+        {
+            beginArray();
+            for(unsigned row=0; row<results.rows(); ++row)
+                object(results.row(row), names);
+            return endArray();
+        }
+
+    private:
+        //! Stream buffer we write into
+        FcgiStreambuf<charT>& m_streambuf;
+
+        //! Where the next character goes
+        charT* m_put;
+
+        //! End of the room we have
+        charT* m_end;
+
+        //! Are we at the first value in an object or array?
+        bool m_first;
+
+        //! Commit and get at least size characters of room if possible
+        void refill(size_t size);
+
+        //! Write a comma unless this is the first value
+        void separate()
+        {
+            if(!m_first)
+                put(',');
+            m_first = false;
+        }
+
+        void put(char character)
+        {
+            if(m_put == m_end)
+                refill(1);
+            *m_put++ = charT(character);
+        }
+
+        //! Write characters that need no escaping
+        void write(const char* data, size_t size);
+
+        //! Write an escaped and quoted string
+        void quoted(const char* data, size_t size);
+
+        //! Write an escaped and quoted string
+        void quoted(const wchar_t* data, size_t size);
+
+        //! Write an integer
+        Json& integer(std::uint64_t magnitude, bool negative);
+
+        template<class Tuple, size_t... index>
+        void elements(const Tuple& x, std::index_sequence<index...>)
+        {
+            const int expand[] = {0, (value(std::get<index>(x)), 0)...};
+            (void)expand;
+        }
+
+        template<class T, class Fields, size_t... index>
+        void members(
+                const T& x,
+                const Fields& fields,
+                std::index_sequence<index...>)
+        {
+            const int expand[] = {0, (field(
+                        std::get<index>(fields).name,
+                        x.*(std::get<index>(fields).member)), 0)...};
+            (void)expand;
+        }
+
+        template<class Tuple, size_t... index>
+        void named(
+                const Tuple& x,
+                const char* const* names,
+                std::index_sequence<index...>)
+        {
+            const int expand[] = {0, (field(
+                        names[index],
+                        std::get<index>(x)), 0)...};
+            (void)expand;
+        }
+    };
+}
+
+#endif
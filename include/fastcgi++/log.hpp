@@ -33,6 +33,7 @@
 
 #include <ostream>
 #include <mutex>
+#include <atomic>
 #include <cstdlib>
 #include <string>
 
@@ -70,16 +71,85 @@ namespace Fastcgipp
 
         //! Send a log header to logstream
         void header(Level level);
+
+        //! Formats of asynchronously written log messages
+        enum Format
+        {
+            //! Human readable lines written to logstream
+            TEXT,
+
+            //! Binary records written to binarystream
+            /*!
+             * Every record is the time in microseconds since the epoch as a
+             * big endian 64 bit integer, the level as a single byte, the size
+             * of the message as a big endian 32 bit integer and finally the
+             * message itself in UTF-8.
+             */
+            BINARY
+        };
+
+        //! The stream binary log records are written to
+        extern std::ostream* binarystream;
+
+        //! True while asynchronous logging is running
+        extern std::atomic_bool async;
+
+        //! Start asynchronous logging
+        /*!
+         * From here on messages are only formatted by the thread logging them.
+         * They are then handed off to a background thread for writing by way of a
+         * lock free per thread buffer. Should a thread's buffer be full the
+         * message is dropped rather than waiting for room. See dropped().
+         *
+         * Note that FAIL_LOG() messages are always written synchronously after
+         * everything before them has been.
+         *
+         * @param [in] format How should messages be written?
+         * @param [in] capacity How many messages can be waiting in each
+         *                      thread's buffer?
+         */
+        void start(Format format=TEXT, unsigned capacity=1024);
+
+        //! Stop asynchronous logging
+        /*!
+         * This writes out every message still waiting and joins the background
+         * thread. Call it once other threads have stopped logging.
+         */
+        void stop();
+
+        //! %Block until every message logged so far has been written
+        void flush();
+
+        //! How many messages have been dropped for want of buffer space?
+        unsigned long long dropped();
+
+        //! The calling thread's stream to format an asynchronous message into
+        std::wostream& buffer();
+
+        //! Hand the message in buffer() off to the background thread
+        void push(Level level);
     }
 }
 
+//! Called by the logging macros to write out a message
+#define FASTCGIPP_LOG_MESSAGE(level, data) \
+    if(::Fastcgipp::Logging::async) \
+    { \
+        ::Fastcgipp::Logging::buffer() << data;\
+        ::Fastcgipp::Logging::push(level);\
+    } \
+    else \
+    { \
+        std::lock_guard<std::mutex> lock(::Fastcgipp::Logging::mutex);\
+        ::Fastcgipp::Logging::header(level);\
+        *::Fastcgipp::Logging::logstream << data << std::endl;\
+    }
+
 //! This is for the user to log whatever they want.
 #define INFO_LOG(data) {\
     if(!::Fastcgipp::Logging::suppress)\
     { \
-        std::lock_guard<std::mutex> lock(::Fastcgipp::Logging::mutex);\
-        ::Fastcgipp::Logging::header(::Fastcgipp::Logging::INFO);\
-        *::Fastcgipp::Logging::logstream << data << std::endl;\
+        FASTCGIPP_LOG_MESSAGE(::Fastcgipp::Logging::INFO, data)\
     }}
 
 //! Log any "errors" that cannot be recovered from and then exit.
@@ -91,6 +161,7 @@ namespace Fastcgipp
 #define FAIL_LOG(data) {\
     if(!::Fastcgipp::Logging::suppress)\
     { \
+        ::Fastcgipp::Logging::flush();\
         std::lock_guard<std::mutex> lock(::Fastcgipp::Logging::mutex);\
         ::Fastcgipp::Logging::header(::Fastcgipp::Logging::FAIL);\
         *::Fastcgipp::Logging::logstream << data << std::endl;\
@@ -106,9 +177,7 @@ namespace Fastcgipp
  */
 #define ERROR_LOG(data) \
     { \
-        std::lock_guard<std::mutex> lock(::Fastcgipp::Logging::mutex);\
-        ::Fastcgipp::Logging::header(::Fastcgipp::Logging::ERROR);\
-        *::Fastcgipp::Logging::logstream << data << std::endl;\
+        FASTCGIPP_LOG_MESSAGE(::Fastcgipp::Logging::ERROR, data)\
     }
 #else
 #define ERROR_LOG(data) {}
@@ -124,9 +193,7 @@ namespace Fastcgipp
 #define WARNING_LOG(data) {\
     if(!::Fastcgipp::Logging::suppress)\
     { \
-        std::lock_guard<std::mutex> lock(::Fastcgipp::Logging::mutex);\
-        ::Fastcgipp::Logging::header(::Fastcgipp::Logging::WARNING);\
-        *::Fastcgipp::Logging::logstream << data << std::endl;\
+        FASTCGIPP_LOG_MESSAGE(::Fastcgipp::Logging::WARNING, data)\
     }}
 #else
 #define WARNING_LOG(data) {}
@@ -137,9 +204,7 @@ namespace Fastcgipp
 #define DEBUG_LOG(data) {\
     if(!::Fastcgipp::Logging::suppress)\
     { \
-        std::lock_guard<std::mutex> lock(::Fastcgipp::Logging::mutex);\
-        ::Fastcgipp::Logging::header(::Fastcgipp::Logging::DEBUG);\
-        *::Fastcgipp::Logging::logstream << data << std::endl;\
+        FASTCGIPP_LOG_MESSAGE(::Fastcgipp::Logging::DEBUG, data)\
     }}
 #else
 #define DEBUG_LOG(data) {}
@@ -150,9 +215,7 @@ namespace Fastcgipp
 #define DIAG_LOG(data) {\
     if(!::Fastcgipp::Logging::suppress)\
     { \
-        std::lock_guard<std::mutex> lock(::Fastcgipp::Logging::mutex);\
-        ::Fastcgipp::Logging::header(::Fastcgipp::Logging::DIAG);\
-        *::Fastcgipp::Logging::logstream << data << std::endl;\
+        FASTCGIPP_LOG_MESSAGE(::Fastcgipp::Logging::DIAG, data)\
     }}
 #else
 #define DIAG_LOG(data) {}
@@ -28,7 +28,9 @@
 #ifndef FASTCGIPP_MAILER_HPP
 #define FASTCGIPP_MAILER_HPP
 
-#include <queue>
+#include <deque>
+#include <vector>
+#include <chrono>
 #include <atomic>
 #include <mutex>
 #include <thread>
@@ -36,6 +38,7 @@
 
 #include "fastcgi++/sockets.hpp"
 #include "fastcgi++/email.hpp"
+#include "fastcgi++/cpuset.hpp"
 
 //! Topmost namespace for the fastcgi++ library
 namespace Fastcgipp
@@ -53,6 +56,13 @@ namespace Fastcgipp
          *
          * Queue up emails for sending with queue().
          *
+         * Connections are opened as needed up to the amount given to init()
+         * and stay open for as long as there are emails in the queue, sending
+         * one after the other. If the server supports PIPELINING (RFC 2920)
+         * the commands for an email are sent as a single group along with the
+         * end of the previous email's data so each email costs a single round
+         * trip.
+         *
          * @date    May 12, 2019
          * @author  Eddie Carle &lt;eddie@isatec.ca&gt;
          */
@@ -100,18 +110,31 @@ namespace Fastcgipp
              * @param [in] port Server port number
              * @param [in] retryInterval How many seconds before retrying a bad
              *                           connection to the SMTP server?
+             * @param [in] connections Maximum amount of connections to open
+             *                         to the SMTP server at once.
              */
             void init(
                     const char* host,
                     const char* origin,
                     const unsigned short port=25,
-                    unsigned retryInterval=30);
+                    unsigned retryInterval=30,
+                    unsigned connections=1);
+
+            //! Call before start to pin the handler() thread to CPUs
+            /*!
+             * @param[in] cpus CPUs to run the handler() thread on. Empty for
+             *                 anywhere (default).
+             */
+            void cpus(const CpuSet& cpus)
+            {
+                m_cpus = cpus;
+            }
 
             ~Mailer();
 
             Mailer():
                 m_initialized(false),
-                m_state(DISCONNECTED)
+                m_inFlight(0)
             {}
 
         private:
@@ -122,7 +145,7 @@ namespace Fastcgipp
             bool m_initialized;
 
             //! %Buffer for transmitting data
-            std::queue<Email_base::Data> m_queue;
+            std::deque<Email_base::Data> m_queue;
 
             //! True when handler() should be terminating
             std::atomic_bool m_terminate;
@@ -133,6 +156,9 @@ namespace Fastcgipp
             //! Thread our handler is running in
             std::thread m_thread;
 
+            //! CPUs to pin the handler() thread to
+            CpuSet m_cpus;
+
             //! Always practice safe threading
             std::mutex m_mutex;
 
@@ -154,46 +180,121 @@ namespace Fastcgipp
             //! The socket group
             SocketGroup m_socketGroup;
 
-            //! The connection socket
-            Socket m_socket;
-
-            //! Current email
-            Email_base::Data m_email;
-
-            //! Are we currently working on an email?
-            bool inEmail() const
+            //! Replies we can be waiting on from the SMTP server
+            enum Reply
             {
-                return !m_email.to.empty();
-            }
-
-            //! Purge current email
-            void purgeEmail()
-            {
-                m_email.body.clear();
-                m_email.to.clear();
-                m_email.from.clear();
-            }
-
-            //! State enumeration
-            enum State
-            {
-                DISCONNECTED,
-                CONNECTED,
+                GREETING,
                 EHLO,
-                EIGHTBIT,
                 MAIL,
                 RCPT,
                 DATA,
                 DUMP,
-                QUIT,
-                ERROR
+                QUIT
+            };
+
+            //! A single connection to the SMTP server
+            struct Connection
+            {
+                //! The connection socket
+                Socket socket;
+
+                //! Replies expected from the server in order
+                std::deque<Reply> replies;
+
+                //! Emails sent off but not yet accepted by the server
+                std::deque<Email_base::Data> emails;
+
+                //! Current line being read from SMTP server
+                std::string line;
+
+                //! Commands waiting to be written to the server
+                std::deque<std::string> commands;
+
+                //! Everything waiting to be written to the server in order
+                /*!
+                 * These point into either commands or the body chunks of
+                 * emails so bodies are written straight out of the chunks
+                 * they were composed in.
+                 */
+                std::vector<iovec> output;
+
+                //! How many buffers in output have been completely written
+                size_t written;
+
+                //! True once the server has accepted EHLO
+                bool ready;
+
+                //! Did the server advertise 8BITMIME?
+                bool eightBit;
+
+                //! Did the server advertise PIPELINING?
+                bool pipelining;
+
+                //! Don't try connecting again before this
+                std::chrono::steady_clock::time_point retry;
+
+                Connection():
+                    written(0),
+                    ready(false),
+                    eightBit(false),
+                    pipelining(false)
+                {}
+
+                Connection(const Connection&) = delete;
+                Connection(Connection&&) = default;
+
+                //! Queue up a command to be written
+                void command(std::string&& text)
+                {
+                    commands.push_back(std::move(text));
+                    output.push_back({
+                            const_cast<char*>(commands.back().data()),
+                            commands.back().size()});
+                }
+
+                //! Queue up the body chunks of an email to be written
+                void body(const ChunkStreamBuf_base::Chunks& chunks)
+                {
+                    for(const auto& chunk: chunks)
+                        if(chunk.size)
+                            output.push_back({chunk.data.get(), chunk.size});
+                }
+
+                //! Forget about everything waiting to be written
+                void clear()
+                {
+                    commands.clear();
+                    output.clear();
+                    written = 0;
+                }
             };
 
-            //! Current state
-            State m_state;
+            //! Our connections to the SMTP server
+            std::vector<Connection> m_connections;
+
+            //! Count of emails sent off on the connections
+            size_t m_inFlight;
+
+            //! Open a connection to the SMTP server
+            void open(Connection& connection);
+
+            //! Move the next email in the queue onto the connection
+            /*!
+             * Lock m_mutex first and ensure the queue isn't empty.
+             */
+            void begin(Connection& connection);
+
+            //! Write as much of the waiting output as possible
+            void flush(Connection& connection);
+
+            //! Handle a complete reply line from the server
+            /*!
+             * @return False if the reply is a failure.
+             */
+            bool reply(Connection& connection);
 
-            //! Current line being read from SMTP server
-            std::string m_line;
+            //! Close a connection and put it's emails back in the queue
+            void fail(Connection& connection);
         };
     }
 }
@@ -30,10 +30,15 @@
 #define FASTCGIPP_MANAGER_HPP
 
 #include <map>
+#include <set>
 #include <list>
+#include <deque>
+#include <vector>
+#include <atomic>
 #include <algorithm>
 #include <thread>
 #include <mutex>
+#include <condition_variable>
 #include <shared_mutex>
 #include <memory>
 #include <functional>
@@ -169,6 +174,58 @@ namespace Fastcgipp
             return m_transceiver.listen(interface, service);
         }
 
+        //! Hand our listeners off to a new process when it asks for them
+        /*!
+         * Use this together with inherit() for hot restarts. Once the new
+         * process calls inherit() with the same name, it takes over our
+         * listeners and starts accepting new connections. We then stop() and
+         * carry on with the requests we already have until they're done, so
+         * nothing is refused and nothing is cut short in between.
+         *
+         * Sessions, caches and anything else held in memory are not carried
+         * over.
+         *
+         * @param [in] name Name of socket (path in Unix world).
+         * @return True on success. False on failure.
+         *
+         * @sa SocketGroup::handOff()
+         */
+        bool handOff(const char* name)
+        {
+            return m_transceiver.handOff(name, [this] () { stop(); });
+        }
+
+        //! Take over the listeners of the process we are replacing
+        /*!
+         * Call this instead of listen() in the new process. If there is no
+         * old process to take over from it returns false and you should
+         * listen() as usual.
+         *
+         * @param [in] name Name of socket (path in Unix world) given to
+         *                  handOff() in the old process.
+         * @return True if any listeners were taken over.
+         *
+         * @sa SocketGroup::inherit()
+         */
+        bool inherit(const char* name)
+        {
+            return m_transceiver.inherit(name);
+        }
+
+        //! Listen on a socket that is already listening
+        /*!
+         * This is how child processes take on the listeners of a Prefork.
+         *
+         * @param [in] listener OS level socket identifier of the listener.
+         * @return True on success. False on failure.
+         *
+         * @sa SocketGroup::inherit()
+         */
+        bool inherit(const socket_t listener)
+        {
+            return m_transceiver.inherit(listener);
+        }
+
         //! Pass a message to a request
         void push(Protocol::RequestId id, Message&& message);
 
@@ -182,9 +239,16 @@ namespace Fastcgipp
             m_transceiver.reuseAddress(value);
         }
 
-        //! Call before start to change the number of threads
+        //! Change the number of threads
         /*!
-         * If the Manager is already running this will do nothing.
+         * Called before start() this sets a fixed number of threads and
+         * turns off any scaling set up with scaleThreads().
+         *
+         * Once the Manager is running this changes the number of threads
+         * within the bounds of scaleThreads() or between one and the number
+         * of threads we started with. New threads are started right away and
+         * surplus ones quit as soon as they run out of work. In affinity
+         * mode nothing can be changed once running.
          *
          * @param[in] threads Number of threads to use for request handling
          *
@@ -193,6 +257,284 @@ namespace Fastcgipp
          */
         void resizeThreads(unsigned threads);
 
+        //! Call before start to scale the number of threads with the load
+        /*!
+         * We start with the minimum number of threads. Whenever a task has
+         * waited longer than the latency given and no thread was sleeping,
+         * another thread is added, at most one per latency period. Threads
+         * that find nothing to do for the idle period quit until we are
+         * down to the minimum again. This does nothing in affinity mode
+         * since requests there can't move between threads. If the Manager is
+         * already running this will do nothing.
+         *
+         * @param[in] minimum Fewest threads to use for request handling
+         * @param[in] maximum Most threads to use for request handling
+         * @param[in] latency How long a task may wait for a thread before we
+         *                    add another one
+         * @param[in] idle How long a surplus thread may sleep before it quits
+         *
+         * @sa Blocking
+         */
+        void scaleThreads(
+                unsigned minimum,
+                unsigned maximum,
+                std::chrono::microseconds latency
+                    = std::chrono::milliseconds(5),
+                std::chrono::milliseconds idle = std::chrono::seconds(30));
+
+        //! Marks a section of a handler thread that blocks
+        /*!
+         * Construct one of these, in Request::response() for example,
+         * before doing anything that could block for a while. File I/O and
+         * calls into synchronous libraries are typical. For as long as it
+         * exists the thread doesn't count towards the number of threads
+         * handling requests, so another is started in it's place if need
+         * be. Up to as many threads again as the maximum can be started
+         * this way. Once the section is done the surplus thread quits when
+         * it runs out of work.
+         *
+         * Sections can be nested. This does nothing outside of handler
+         * threads or in affinity mode.
+         *
+         * @date    October 15, 2026
+         * @author  Eddie Carle &lt;eddie@isatec.ca&gt;
+         */
+        class Blocking
+        {
+        public:
+            Blocking();
+            ~Blocking();
+
+            Blocking(const Blocking&) = delete;
+            Blocking& operator=(const Blocking&) = delete;
+
+        private:
+            //! Manager to tell when we are done. Null for nested sections.
+            Manager_base* const m_manager;
+        };
+
+        //! Call before start to pin requests to a single worker thread
+        /*!
+         * In affinity mode all requests on a connection are created,
+         * handled and destroyed by the single handler() thread the
+         * connection hashes to. Messages are passed to requests directly
+         * through that thread's task queue so neither Request_base::mutex nor
+         * the request's own message queue are ever involved. The trade off
+         * is that an idle thread can not take over work from a busy one. If
+         * the Manager is already running this will do nothing.
+         *
+         * @param[in] status True to enable affinity mode. False for the
+         *                   default where any thread can handle any request.
+         *
+         * @sa start()
+         */
+        void affinity(bool status)
+        {
+            if(m_stop)
+                m_affinity = status;
+        }
+
+        //! Call before start to set the number of connections we advertise
+        /*!
+         * This is the FCGI_MAX_CONNS value reported to the other side with
+         * GET_VALUES. It's up to the other side to respect it. If not set
+         * it is the same as the reported maximum number of concurrent
+         * requests. If the Manager is already running this will do
+         * nothing.
+         *
+         * @param[in] connections Maximum number of connections
+         */
+        void maxConnections(unsigned connections)
+        {
+            if(m_stop)
+                m_maxConnections = connections;
+        }
+
+        //! Call before start to limit the number of concurrent requests
+        /*!
+         * New requests beyond the limit are rejected with an OVERLOADED
+         * status. This is also the FCGI_MAX_REQS value reported to the other
+         * side with GET_VALUES. Without a limit the number of handler
+         * threads is reported. If the Manager is already running this will
+         * do nothing.
+         *
+         * @param[in] requests Maximum number of concurrent requests. Zero
+         *                     for no limit (default).
+         */
+        void maxRequests(unsigned requests)
+        {
+            if(m_stop)
+                m_requestLimit = requests;
+        }
+
+        //! Call before start to limit the number of queued tasks
+        /*!
+         * New requests that arrive while more tasks than this are waiting
+         * for a handler() thread are rejected with an OVERLOADED status.
+         * Handlers falling this far behind means latency has already gone
+         * through the roof so turning away work is the kinder option. If the
+         * Manager is already running this will do nothing.
+         *
+         * @param[in] tasks Maximum number of queued tasks. Zero for no limit
+         *                  (default).
+         */
+        void maxQueuedTasks(unsigned tasks)
+        {
+            if(m_stop)
+                m_taskLimit = tasks;
+        }
+
+        //! Call before start to limit the amount of queued output
+        /*!
+         * New requests that arrive while more output than this is waiting
+         * to be sent in total are rejected with an OVERLOADED status. An
+         * event loop with more than this waiting on it's own connections
+         * also stops reading from the other side until it's backlog is down
+         * to half the limit. If the Manager is already running this will do
+         * nothing.
+         *
+         * @param[in] bytes Maximum amount of queued output in bytes. Zero
+         *                  for no limit (default).
+         *
+         * @sa Transceiver::sendLimit()
+         */
+        void maxSendBytes(size_t bytes)
+        {
+            if(m_stop)
+                m_transceiver.sendLimit(bytes);
+        }
+
+        //! Call before start to reject overloaded requests with an HTTP 503
+        /*!
+         * Many web servers turn an OVERLOADED status into a generic error
+         * of their own. With this set, requests rejected for any of the
+         * limits above instead get a proper "503 Service Unavailable"
+         * response with a Retry-After header so clients know to back off.
+         * If the Manager is already running this will do nothing.
+         *
+         * @param[in] status True to respond with a 503. False to use the
+         *                   OVERLOADED status (default).
+         */
+        void overloadResponse(bool status)
+        {
+            if(m_stop)
+                m_overloadResponse = status;
+        }
+
+        //! Call before start to allow or forbid multiplexing
+        /*!
+         * With multiplexing the other side may run any number of concurrent
+         * requests over a single connection. Their output is interleaved
+         * fairly so a large response doesn't hold up the rest.
+         * Without it, additional requests on a busy connection are rejected
+         * with a CANT_MPX_CONN status. This is also the FCGI_MPXS_CONNS value
+         * reported to the other side with GET_VALUES. If the Manager is
+         * already running this will do nothing.
+         *
+         * @param[in] status True to allow multiplexing (default).
+         */
+        void multiplex(bool status)
+        {
+            if(m_stop)
+                m_multiplex = status;
+        }
+
+        //! Call before start to change the number of socket I/O event loops
+        /*!
+         * Each event loop runs in it's own thread with it's own set of
+         * sockets. New connections are spread evenly across them. If the
+         * Manager is already running this will do nothing.
+         *
+         * With a dedicated acceptor, one more thread does nothing but accept
+         * new connections and hand them off to the event loops. This keeps
+         * the established connections responsive during reconnect storms.
+         *
+         * @param[in] loops Number of event loops to use for socket I/O
+         * @param[in] acceptor Set to true for a dedicated acceptor thread
+         *
+         * @sa start()
+         */
+        void resizeLoops(unsigned loops, bool acceptor=false)
+        {
+            if(m_stop)
+                m_transceiver.resizeLoops(loops, acceptor);
+        }
+
+        //! Call before start to pin the socket I/O event loops to CPUs
+        /*!
+         * If the Manager is already running this will do nothing.
+         *
+         * @param[in] cpus CPUs to run the event loops on. Empty for anywhere
+         *                 (default).
+         *
+         * @sa Transceiver::cpus()
+         */
+        void loopCpus(const CpuSet& cpus)
+        {
+            if(m_stop)
+                m_transceiver.cpus(cpus);
+        }
+
+        //! Call before start to pin the handler() threads to CPUs
+        /*!
+         * Keeping the handler threads on the same NUMA node as the event
+         * loops keeps requests and their memory on one side of the machine.
+         * With a spread set each thread gets the CPU matching it's index.
+         * If the Manager is already running this will do nothing.
+         *
+         * @param[in] cpus CPUs to run the handler() threads on. Empty for
+         *                 anywhere (default).
+         */
+        void handlerCpus(const CpuSet& cpus)
+        {
+            if(m_stop)
+                m_handlerCpus = cpus;
+        }
+
+        //! Timers run by the first socket I/O event loop
+        /*!
+         * Use these for anything that needs doing at a later time. The
+         * timer functions are called from the event loop itself so they
+         * should do little more than pass a Message along.
+         */
+        Timers& timers()
+        {
+            return m_transceiver.timers();
+        }
+
+        //! Call before start to give every request a deadline
+        /*!
+         * Requests that aren't complete by their deadline get
+         * Request::timeoutHandler() called and are completed then and there.
+         * This keeps a request waiting forever on something that never
+         * comes from holding on to it's resources forever. If the Manager is
+         * already running this will do nothing.
+         *
+         * @param[in] timeout Time from BEGIN_REQUEST a request has to
+         *                    complete. Zero for no deadline (default).
+         */
+        void requestTimeout(std::chrono::milliseconds timeout)
+        {
+            if(m_stop)
+                m_requestTimeout = timeout;
+        }
+
+        //! Call before start to close connections that sit idle
+        /*!
+         * If the Manager is already running this will do nothing.
+         *
+         * @param[in] timeout How long a connection may go without receiving
+         *                    anything. Zero to never close idle connections
+         *                    (default).
+         *
+         * @sa Transceiver::idleTimeout()
+         */
+        void idleTimeout(std::chrono::milliseconds timeout)
+        {
+            if(m_stop)
+                m_transceiver.idleTimeout(timeout);
+        }
+
     protected:
         //! Make a request object
         virtual std::unique_ptr<Request_base> makeRequest(
@@ -200,22 +542,294 @@ namespace Fastcgipp
                 const Protocol::Role& role,
                 bool kill) =0;
 
+        //! Dispose of a completed request object
+        /*!
+         * This is called outside of any locks once a completed request has
+         * been taken out of m_requests. It either destroys the object or
+         * keeps it around to be handed out again by makeRequest().
+         */
+        virtual void recycle(std::unique_ptr<Request_base>&& request) =0;
+
         //! Handles low level communication with the other side
         Transceiver m_transceiver;
 
+        //! Time requests have to complete. Zero for no deadline.
+        std::chrono::milliseconds m_requestTimeout;
+
     private:
-        //! Queue for pending tasks
-        std::queue<Protocol::RequestId> m_tasks;
+        //! A pending task
+        struct Task
+        {
+            //! Request the task is for
+            Protocol::RequestId id;
+
+            //! Message to deliver to the request
+            /*!
+             * This is only ever used in affinity mode. Otherwise messages
+             * are queued up in the request itself.
+             */
+            Message message;
+
+            //! When the task was queued if timing or scaling is enabled
+            Metrics::Clock::time_point queued;
+
+            Task() {}
+
+            Task(
+                    const Protocol::RequestId& id_,
+                    Message&& message_,
+                    Metrics::Clock::time_point queued_):
+                id(id_),
+                message(std::move(message_)),
+                queued(queued_)
+            {}
+
+            Task(Task&& x):
+                id(x.id),
+                message(std::move(x.message)),
+                queued(x.queued)
+            {}
+
+            Task& operator=(Task&& x)
+            {
+                id = x.id;
+                message = std::move(x.message);
+                queued = x.queued;
+                return *this;
+            }
+        };
+
+        //! Queue of pending tasks belonging to a single handler() thread
+        struct TaskQueue
+        {
+            //! The tasks themselves
+            std::deque<Task> tasks;
+
+            //! Thread safe the tasks
+            std::mutex mutex;
+
+            //! How many tasks are sitting in this queue
+            std::atomic_uint pending;
+
+            //! Wakes up the owning thread in affinity mode
+            /*!
+             * Since a thread in affinity mode can only ever service it's own
+             * queue, waking up an arbitrary thread would be pointless.
+             */
+            std::condition_variable wake;
+
+            TaskQueue():
+                pending(0)
+            {}
+        };
+
+        //! One task queue for every handler() thread up to the maximum
+        /*!
+         * Tasks are spread across the queues round-robin. A thread services
+         * it's own queue first and steals from the others once it is empty.
+         * Threads started for blocking sections share queues with the
+         * others.
+         */
+        std::vector<std::unique_ptr<TaskQueue>> m_tasks;
+
+        //! Index of the next queue to push a task into
+        std::atomic_uint m_nextQueue;
+
+        //! Total number of tasks waiting in all queues
+        std::atomic_size_t m_pendingTasks;
+
+        //! Number of handler() threads sleeping or about to sleep
+        std::atomic_uint m_sleepers;
+
+        //! Bumped whenever sleeping handler() threads should reevaluate
+        /*!
+         * This happens on stop() and terminate() and when requests are
+         * destroyed while stopping.
+         */
+        std::atomic_uint m_epoch;
+
+        //! Thread safe sleeping and waking of handler() threads
+        std::mutex m_wakeMutex;
+
+        //! True if requests are pinned to a single handler() thread
+        bool m_affinity;
 
-        //! Thread safe our tasks
-        std::mutex m_tasksMutex;
+        //! Queue up a task
+        /*!
+         * In affinity mode request tasks always go to the queue owned by the
+         * thread that a request's connection hashes to.
+         */
+        inline void pushTask(const Protocol::RequestId& id, Message&& message);
+
+        //! Retrieve a task
+        /*!
+         * In affinity mode we never steal tasks from other queues.
+         *
+         * @param[in] index Index of the queue to try first
+         * @param[out] task Task retrieved
+         * @return True if a task was retrieved. False if all queues were empty.
+         */
+        inline bool popTask(unsigned index, Task& task);
+
+        //! Pass a message on to it's request or create a new one
+        /*!
+         * This must be called with m_requestsMutex write locked.
+         *
+         * @return True if the message was queued up in a request and a task
+         *         needs to be pushed for it.
+         */
+        inline bool route(const Protocol::RequestId& id, Message&& message);
+
+        //! Deal with a record for a request that doesn't exist
+        /*!
+         * An ABORT_REQUEST may be for a request that handed itself off to a
+         * Topic and an empty IN record may trail a request that was
+         * dispatched early. Anything else is warned about.
+         *
+         * @param[in] id Request the record is for
+         * @param[in] header Header of the record
+         */
+        inline void orphan(
+                const Protocol::RequestId& id,
+                const Protocol::Header& header);
+
+        //! Take note of a request that was just taken out of m_requests
+        /*!
+         * If it was dispatched early without getting it's empty IN record
+         * the ID goes into m_trailing so the record isn't warned about.
+         */
+        inline void finished(
+                const Protocol::RequestId& id,
+                const Request_base& request);
+
+        //! A new request can't have an IN record trailing the old one
+        inline void begun(const Protocol::RequestId& id);
+
+        //! Nothing trails requests on a dead socket
+        inline void forget(const Socket& socket);
+
+        //! Handle a request task in the default mode
+        /*!
+         * When a request completes, it's END_REQUEST record is out the door
+         * before we get to erase it. If the web server is quick to reuse the
+         * ID some records for the new request will have been queued up in
+         * the old one so they get routed again once it is gone.
+         */
+        inline void requestHandler(const Protocol::RequestId& id);
+
+        //! Handle a request task in affinity mode
+        /*!
+         * Here the handler() thread owns all requests on the connection
+         * outright. It creates them, passes messages directly to them and
+         * destroys them without ever locking the requests themselves.
+         */
+        inline void ownedHandler(Task& task);
+
+        //! Wake up all handler() threads so they reevaluate their situation
+        inline void wakeAll();
+
+        //! Make sure there is one task queue per handler() thread
+        /*!
+         * Tasks in queues that are removed are moved to the first queue.
+         * There is also room for twice the maximum number of threads so
+         * blocking sections can be made up for.
+         */
+        void resizeTasks();
+
+        //! Start handler() threads until enough are outside blocking sections
+        /*!
+         * This must be called with m_startStopMutex locked.
+         */
+        void fill();
+
+        //! Start a handler() thread in the first free slot
+        /*!
+         * This must be called with m_startStopMutex locked.
+         *
+         * @return False if there were no free slots.
+         */
+        bool spawn();
+
+        //! Quit the calling handler() thread if there are too many
+        /*!
+         * @return True if the thread should quit.
+         */
+        inline bool retire();
+
+        //! Add a handler() thread if a task waited too long for one
+        /*!
+         * @param[in] queued When the task that was just retrieved was queued
+         */
+        inline void grow(Metrics::Clock::time_point queued);
+
+        //! Have the task queues looked at once a task could be overdue
+        /*!
+         * Threads only grow() the pool when they retrieve a task. If they are
+         * all stuck outside of blocking sections that never happens so a
+         * timer has to check on the queues for them.
+         */
+        inline void watch();
+
+        //! Grow the pool if the oldest queued task waited too long
+        void oversee();
+
+        //! Remove a handler() thread that has been idle for too long
+        inline void shrink();
+
+        //! Called when a handler() thread enters a blocking section
+        void block();
+
+        //! Called when a handler() thread leaves a blocking section
+        void unblock();
+
+        //! Fewest handler() threads we scale down to
+        unsigned m_minThreads;
+
+        //! Most handler() threads we scale up to
+        /*!
+         * This doesn't include threads started for blocking sections.
+         */
+        unsigned m_maxThreads;
+
+        //! How many handler() threads we want outside of blocking sections
+        std::atomic_uint m_targetThreads;
+
+        //! How many handler() threads are running
+        std::atomic_uint m_liveThreads;
+
+        //! How many handler() threads are in blocking sections
+        std::atomic_uint m_blockedThreads;
+
+        //! How long a task may wait before we add a thread
+        /*!
+         * Zero for a fixed number of threads.
+         */
+        std::chrono::microseconds m_scaleLatency;
+
+        //! How long a surplus thread may sleep before quitting
+        std::chrono::milliseconds m_idleTimeout;
+
+        //! When a thread was last added because of latency
+        std::atomic<Metrics::Clock::rep> m_lastGrowth;
+
+        //! True while a timer is set to oversee() the task queues
+        std::atomic_bool m_watching;
+
+        //! Which slots in m_threads have a running handler() thread
+        std::vector<bool> m_running;
 
         //! An associative container for our requests
-        Protocol::Requests<std::unique_ptr<Request_base>> m_requests;
+        Protocol::RequestTable<std::unique_ptr<Request_base>> m_requests;
 
         //! Thread safe our requests
         std::shared_timed_mutex m_requestsMutex;
 
+        //! Finished requests whose trailing empty IN record is still due
+        std::set<Protocol::RequestId, Protocol::RequestId::Less> m_trailing;
+
+        //! Thread safe m_trailing
+        std::mutex m_trailingMutex;
+
         //! Local messages
         std::queue<std::pair<Message, Socket>> m_messages;
 
@@ -223,7 +837,10 @@ namespace Fastcgipp
         std::mutex m_messagesMutex;
 
         //! General handling function to have it's own thread
-        void handler();
+        /*!
+         * @param[in] index Index of this thread's own task queue
+         */
+        void handler(unsigned index);
 
         //! Handles management messages
         /*!
@@ -233,17 +850,20 @@ namespace Fastcgipp
         inline void localHandler();
 
         //! True when the manager should be terminating
-        bool m_terminate;
+        std::atomic_bool m_terminate;
 
         //! True when the manager should be stopping
-        bool m_stop;
+        std::atomic_bool m_stop;
 
         //! Thread safe starting and stopping
         std::mutex m_startStopMutex;
 
-        //! Threads our manager is running in
+        //! Slots for the threads our manager is running in
         std::vector<std::thread> m_threads;
 
+        //! CPUs to pin the handler() threads to
+        CpuSet m_handlerCpus;
+
         //! Condition variable to wake handler() threads up
         std::condition_variable m_wake;
 
@@ -253,31 +873,43 @@ namespace Fastcgipp
         //! Pointer to the %Manager object
         static Manager_base* instance;
 
-#if FASTCGIPP_LOG_LEVEL > 3
-        //! Debug counter for new requests
-        std::atomic_ullong m_requestCount;
+        //! Maximum number of connections. Zero if not set.
+        unsigned m_maxConnections;
 
-        //! Debug counter for max requests
-        size_t m_maxRequests;
+        //! Maximum number of concurrent requests. Zero if unlimited.
+        unsigned m_requestLimit;
 
-        //! Debug counter for management records
-        std::atomic_ullong m_managementRecordCount;
+        //! True if requests may be multiplexed over a single connection
+        bool m_multiplex;
 
-        //! Debug counter for bad socket messages
-        std::atomic_ullong m_badSocketMessageCount;
+        //! Maximum number of queued tasks. Zero if unlimited.
+        unsigned m_taskLimit;
 
-        //! Debug counter for bad socket kills
-        std::atomic_ullong m_badSocketKillCount;
+        //! True if overloaded requests get an HTTP 503
+        bool m_overloadResponse;
 
-        //! Debug counter for request messages received
-        std::atomic_ullong m_messageCount;
-
-        //! Debug counter currently active handler() threads
-        unsigned m_activeThreads;
+        //! Reject a new request with an END_REQUEST record
+        /*!
+         * @param[in] id Request to reject
+         * @param[in] status Reason for the rejection
+         * @param[in] kill True if the connection should be closed as well
+         */
+        inline void reject(
+                const Protocol::RequestId& id,
+                Protocol::ProtocolStatus status,
+                bool kill);
 
-        //! Debug counter max active handler() threads
-        unsigned m_maxActiveThreads;
-#endif
+        //! Check whether a new request can be accepted
+        /*!
+         * If it can't it is rejected. This must be called with
+         * m_requestsMutex write locked along with adding the request.
+         *
+         * @param[in] id Request to be created
+         * @param[in] kill True if the connection should be closed once
+         *                 the request is done
+         * @return True if the request should be created
+         */
+        inline bool admit(const Protocol::RequestId& id, bool kill);
     };
 
     //! General task and protocol management class
@@ -308,10 +940,42 @@ namespace Fastcgipp
          * @param[in] threads Number of threads to use for request handling
          */
         Manager(unsigned threads = std::thread::hardware_concurrency()):
-            Manager_base(threads)
+            Manager_base(threads),
+            m_poolSize(0)
         {}
 
+        //! Recycle completed request objects instead of destroying them
+        /*!
+         * Constructing a request is not cheap. Between the stream buffers,
+         * streams and the HTTP environment there is a fair bit of allocating
+         * going on. With this enabled, completed requests are reset() and
+         * kept around so the next BEGIN_REQUEST can reuse one along with all
+         * the string capacity it has built up. Make sure RequestT::reset()
+         * clears out any state your derivation has before enabling this.
+         *
+         * @param[in] size Maximum amount of idle request objects to keep
+         *                 around. The default of 0 means request objects are
+         *                 never reused.
+         */
+        void requestPool(size_t size)
+        {
+            std::lock_guard<std::mutex> lock(m_poolMutex);
+            m_poolSize = size;
+            if(m_pool.size() > size)
+                m_pool.resize(size);
+        }
+
     private:
+        //! Idle request objects ready for reuse
+        std::vector<std::unique_ptr<RequestT>> m_pool;
+
+        //! Maximum amount of idle request objects to keep around
+        size_t m_poolSize;
+
+        //! Thread safe the request pool
+        std::mutex m_poolMutex;
+
+
         //! Make a request object
         std::unique_ptr<Request_base> makeRequest(
                 const Protocol::RequestId& id,
@@ -320,16 +984,62 @@ namespace Fastcgipp
         {
             using namespace std::placeholders;
 
-            std::unique_ptr<RequestT> request(new RequestT);
+            std::unique_ptr<RequestT> request;
+            {
+                std::lock_guard<std::mutex> lock(m_poolMutex);
+                if(!m_pool.empty())
+                {
+                    request = std::move(m_pool.back());
+                    m_pool.pop_back();
+                }
+            }
+
+            if(request)
+            {
+                request->configure(
+                        id,
+                        role,
+                        kill,
+                        std::bind(&Manager_base::push, this, id, _1));
+                request->deadline(m_transceiver.timers(), m_requestTimeout);
+                return request;
+            }
+
+            request.reset(new RequestT);
             request->configure(
                     id,
                     role,
                     kill,
                     std::bind(&Transceiver::send, &m_transceiver, _1, _2, _3),
+                    std::bind(
+                        &Transceiver::sendFile,
+                        &m_transceiver,
+                        _1,
+                        _2,
+                        _3,
+                        _4,
+                        _5),
                     std::bind(&Manager_base::push, this, id, _1));
+            request->deadline(m_transceiver.timers(), m_requestTimeout);
             return request;
         }
 
+        //! Reset and pool a completed request object if there's room
+        void recycle(std::unique_ptr<Request_base>&& request)
+        {
+            std::unique_ptr<RequestT> recycled(
+                    static_cast<RequestT*>(request.release()));
+            {
+                std::lock_guard<std::mutex> lock(m_poolMutex);
+                if(m_pool.size() >= m_poolSize)
+                    return;
+            }
+            recycled->reset();
+            std::lock_guard<std::mutex> lock(m_poolMutex);
+            if(m_pool.size() < m_poolSize)
+                m_pool.push_back(std::move(recycled));
+        }
+
     };
 }
 
@@ -29,6 +29,10 @@
 #ifndef MESSAGE_HPP
 #define MESSAGE_HPP
 
+#include <new>
+#include <type_traits>
+#include <utility>
+
 #include "fastcgi++/block.hpp"
 
 namespace Fastcgipp
@@ -42,38 +46,213 @@ namespace Fastcgipp
      * and the message will be passed up to the user code to be processed. The
      * data may contain any data that can be serialized into a raw character
      * array.
+     *
+     * Alternatively a message can carry a single object of any move
+     * constructible type as it's payload with emplace() and payload(). Nothing
+     * is serialized that way. Payloads no larger than inlineSize that can be
+     * moved without throwing are stored inside the message itself so passing
+     * one along never touches the heap.
      */
     struct Message
     {
+        //! Largest payload stored inside the message itself
+        static const size_t inlineSize = 3*sizeof(void*);
+
         Message(const int type_):
-            type(type_)
+            type(type_),
+            m_payload(nullptr)
         {}
 
         Message():
-            type(0)
+            type(0),
+            m_payload(nullptr)
         {}
 
         Message(Message&& x):
             type(x.type),
-            data(std::move(x.data))
-        {}
+            data(std::move(x.data)),
+            m_payload(nullptr)
+        {
+            take(x);
+        }
 
         Message& operator=(Message&& x)
         {
-            type=x.type;
-            data=std::move(x.data);
+            if(this != &x)
+            {
+                type=x.type;
+                data=std::move(x.data);
+                reset();
+                take(x);
+            }
             return *this;
         }
 
         Message(const Message&) =delete;
         Message& operator=(const Message&) =delete;
 
+        ~Message()
+        {
+            reset();
+        }
+
         //! Type of message. A 0 means FastCGI record. Anything else is open.
         int type;
 
         //! The raw data being passed along with the message.
         Block data;
+
+        //! Construct a payload in place replacing any existing one
+        /*!
+         * @tparam T Type of the payload.
+         * @param[in] args Arguments to the constructor of the payload
+         * @return Reference to the payload
+         */
+        template<class T, class... Args>
+        T& emplace(Args&&... args)
+        {
+            reset();
+            T* const payload = Payload<T>::construct(
+                    &m_storage,
+                    std::forward<Args>(args)...);
+            m_payload = &Payload<T>::operations;
+            return *payload;
+        }
+
+        //! Get the payload if it is of a certain type
+        /*!
+         * @tparam T Type the payload is expected to be.
+         * @return Pointer to the payload or null if there is none or it's of
+         *         some other type.
+         */
+        template<class T>
+        T* payload()
+        {
+            if(m_payload != &Payload<T>::operations)
+                return nullptr;
+            return Payload<T>::get(&m_storage);
+        }
+
+        //! Get the payload if it is of a certain type
+        template<class T>
+        const T* payload() const
+        {
+            return const_cast<Message*>(this)->payload<T>();
+        }
+
+        //! Destroy any payload
+        void reset()
+        {
+            if(m_payload)
+            {
+                m_payload->destroy(&m_storage);
+                m_payload = nullptr;
+            }
+        }
+
+    private:
+        //! What can be done with a payload without knowing it's type
+        struct Operations
+        {
+            //! Destroy the payload in some storage
+            void (*destroy)(void* storage);
+
+            //! Move the payload from one storage to another and destroy it
+            void (*move)(void* from, void* to);
+        };
+
+        //! Handles payloads of a certain type
+        /*!
+         * The address of operations identifies the type of the payload.
+         */
+        template<class T, bool =
+            sizeof(T) <= inlineSize
+            && alignof(T) <= alignof(void*)
+            && std::is_nothrow_move_constructible<T>::value>
+        struct Payload
+        {
+            template<class... Args>
+            static T* construct(void* storage, Args&&... args)
+            {
+                return new(storage) T(std::forward<Args>(args)...);
+            }
+
+            static T* get(void* storage)
+            {
+                return static_cast<T*>(storage);
+            }
+
+            static void destroy(void* storage)
+            {
+                get(storage)->~T();
+            }
+
+            static void move(void* from, void* to)
+            {
+                new(to) T(std::move(*get(from)));
+                destroy(from);
+            }
+
+            static const Operations operations;
+        };
+
+        //! Handles payloads too large or unwieldy to store inline
+        template<class T>
+        struct Payload<T, false>
+        {
+            template<class... Args>
+            static T* construct(void* storage, Args&&... args)
+            {
+                T* const payload = new T(std::forward<Args>(args)...);
+                *static_cast<T**>(storage) = payload;
+                return payload;
+            }
+
+            static T* get(void* storage)
+            {
+                return *static_cast<T**>(storage);
+            }
+
+            static void destroy(void* storage)
+            {
+                delete get(storage);
+            }
+
+            static void move(void* from, void* to)
+            {
+                *static_cast<T**>(to) = get(from);
+            }
+
+            static const Operations operations;
+        };
+
+        //! Storage for the payload or a pointer to it
+        std::aligned_storage<inlineSize, alignof(void*)>::type m_storage;
+
+        //! Operations of the payload type. Null if there is no payload.
+        const Operations* m_payload;
+
+        //! Take the payload of another message
+        void take(Message& x)
+        {
+            if(x.m_payload)
+            {
+                x.m_payload->move(&x.m_storage, &m_storage);
+                m_payload = x.m_payload;
+                x.m_payload = nullptr;
+            }
+        }
     };
+
+    template<class T, bool small>
+    const Message::Operations Message::Payload<T, small>::operations = {
+        &Message::Payload<T, small>::destroy,
+        &Message::Payload<T, small>::move};
+
+    template<class T>
+    const Message::Operations Message::Payload<T, false>::operations = {
+        &Message::Payload<T, false>::destroy,
+        &Message::Payload<T, false>::move};
 }
 
 #endif
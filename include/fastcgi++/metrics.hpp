@@ -0,0 +1,531 @@
+/*!
+ * @file       metrics.hpp
+ * @brief      Declares the runtime metrics interface
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 14, 2026
+ * @copyright  Copyright &copy; 2026 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2026 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#ifndef FASTCGIPP_METRICS_HPP
+#define FASTCGIPP_METRICS_HPP
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <ostream>
+
+//! Topmost namespace for the fastcgi++ library
+namespace Fastcgipp
+{
+    //! Always on runtime metrics
+    /*!
+     * Every metric registers itself on construction so that the whole lot
+     * can be read in-process with each() or exported in the Prometheus text
+     * format with write(). Counters and gauges are sharded across cache
+     * lines by thread so that updating them from the hot paths costs no more
+     * than an uncontended relaxed atomic add. Reading one sums the shards.
+     *
+     * The library keeps the metrics declared at the bottom of this file. You
+     * are free to define your own and they'll be exported right along with
+     * them.
+     *
+     * Timing the phases of requests costs a clock read at every phase so it
+     * is off by default. Set #timing to true to turn it on.
+     */
+    namespace Metrics
+    {
+        //! How a metric should be presented
+        enum class Type
+        {
+            COUNTER,
+            GAUGE,
+            HISTOGRAM
+        };
+
+        //! Base class for all metrics
+        class Metric
+        {
+        public:
+            //! Construct and register the metric
+            /*!
+             * None of the strings are copied so they must outlive the
+             * metric. String literals are the idea.
+             *
+             * @param[in] name Prometheus name of the metric. Metrics that
+             *                 share a name must differ in labels.
+             * @param[in] help One line description of the metric
+             * @param[in] labels Labels exactly as they should appear between
+             *                   the braces (name="value",...) or nullptr for
+             *                   none.
+             * @param[in] type How the metric should be presented
+             */
+            Metric(
+                    const char* name,
+                    const char* help,
+                    const char* labels,
+                    Type type);
+
+            Metric(const Metric&) = delete;
+            Metric& operator=(const Metric&) = delete;
+
+            //! Unregister the metric
+            virtual ~Metric();
+
+            //! Current value of the metric
+            virtual long long value() const =0;
+
+            //! Write the samples of the metric in Prometheus text format
+            /*!
+             * By default this is a single sample of value().
+             */
+            virtual void samples(std::ostream& stream) const;
+
+            const char* const name;
+            const char* const help;
+            const char* const labels;
+            const Type type;
+        };
+
+        //! Number of shards counters and gauges are split into
+        const unsigned shards = 16;
+
+        //! Assign a shard to a new thread
+        unsigned nextShard();
+
+        //! Shard the calling thread should update
+        inline unsigned shard()
+        {
+            static thread_local const unsigned index = nextShard();
+            return index;
+        }
+
+        //! A single shard padded out to it's own cache line
+        struct alignas(64) Shard
+        {
+            std::atomic_llong value;
+        };
+
+        //! A value that only ever goes up
+        class Counter: public Metric
+        {
+        private:
+            Shard m_shards[shards];
+
+        public:
+            Counter(
+                    const char* name,
+                    const char* help,
+                    const char* labels = nullptr);
+
+            void add(long long amount=1)
+            {
+                m_shards[shard()].value.fetch_add(
+                        amount,
+                        std::memory_order_relaxed);
+            }
+
+            Counter& operator++()
+            {
+                add();
+                return *this;
+            }
+
+            Counter& operator+=(long long amount)
+            {
+                add(amount);
+                return *this;
+            }
+
+            long long value() const;
+        };
+
+        //! A value that goes up and down
+        class Gauge: public Metric
+        {
+        private:
+            Shard m_shards[shards];
+
+        public:
+            Gauge(
+                    const char* name,
+                    const char* help,
+                    const char* labels = nullptr);
+
+            void add(long long amount=1)
+            {
+                m_shards[shard()].value.fetch_add(
+                        amount,
+                        std::memory_order_relaxed);
+            }
+
+            void sub(long long amount=1)
+            {
+                add(-amount);
+            }
+
+            Gauge& operator++()
+            {
+                add();
+                return *this;
+            }
+
+            Gauge& operator--()
+            {
+                sub();
+                return *this;
+            }
+
+            long long value() const;
+        };
+
+        //! The highest value ever reported to it
+        /*!
+         * This isn't sharded. Once it has settled the only cost of an update
+         * is the load.
+         */
+        class Peak: public Metric
+        {
+        private:
+            std::atomic_llong m_value;
+
+        public:
+            Peak(
+                    const char* name,
+                    const char* help,
+                    const char* labels = nullptr);
+
+            void update(long long candidate)
+            {
+                long long current = m_value.load(std::memory_order_relaxed);
+                while(candidate > current && !m_value.compare_exchange_weak(
+                            current,
+                            candidate,
+                            std::memory_order_relaxed));
+            }
+
+            long long value() const
+            {
+                return m_value.load(std::memory_order_relaxed);
+            }
+        };
+
+        //! Clock used for all timing
+        typedef std::chrono::steady_clock Clock;
+
+        //! Should the phases of requests be timed?
+        extern std::atomic_bool timing;
+
+        //! The current time if #timing is enabled
+        /*!
+         * @return The current time or a default constructed time point if
+         *         timing is disabled.
+         */
+        inline Clock::time_point timestamp()
+        {
+            if(timing.load(std::memory_order_relaxed))
+                return Clock::now();
+            return Clock::time_point();
+        }
+
+        //! A distribution of durations
+        /*!
+         * Durations are recorded in microseconds into log-linear buckets in
+         * the style of an HDR histogram. Every power of two is split into
+         * eight buckets so quantiles are accurate to within 12.5% all the way
+         * from a microsecond up to well over nine hours. Recording is a
+         * couple of relaxed atomic adds so nothing ever waits on a lock.
+         *
+         * For Prometheus the buckets are exported cumulatively at every power
+         * of two from 16&micro;s up to 67s.
+         */
+        class Histogram: public Metric
+        {
+        public:
+            //! Buckets each power of two is split into will be 2^subBits
+            static const unsigned subBits = 3;
+
+            //! Buckets each power of two is split into
+            static const unsigned subBuckets = 1<<subBits;
+
+            //! Durations of 2^maxExponent microseconds and up are clamped
+            static const unsigned maxExponent = 36;
+
+            //! Total number of buckets
+            static const unsigned buckets
+                = (maxExponent-subBits+1)*subBuckets;
+
+        private:
+            std::atomic_ullong m_buckets[buckets];
+            Shard m_sum[shards];
+
+        public:
+            Histogram(
+                    const char* name,
+                    const char* help,
+                    const char* labels = nullptr);
+
+            //! Bucket a duration in microseconds falls into
+            static unsigned bucket(unsigned long long microseconds)
+            {
+                if(microseconds < subBuckets)
+                    return microseconds;
+                const unsigned exponent = 63-__builtin_clzll(microseconds);
+                if(exponent >= maxExponent)
+                    return buckets-1;
+                return (exponent-subBits+1)*subBuckets
+                    + ((microseconds >> (exponent-subBits)) & (subBuckets-1));
+            }
+
+            //! Smallest duration that falls in a bucket
+            static unsigned long long lower(unsigned bucket);
+
+            //! Largest duration that falls in a bucket
+            static unsigned long long upper(unsigned bucket);
+
+            //! Record a duration in microseconds
+            void record(unsigned long long microseconds)
+            {
+                m_buckets[bucket(microseconds)].fetch_add(
+                        1,
+                        std::memory_order_relaxed);
+                m_sum[shard()].value.fetch_add(
+                        microseconds,
+                        std::memory_order_relaxed);
+            }
+
+            //! Record the time passed since a timestamp()
+            /*!
+             * Nothing is recorded if timing was disabled when the timestamp
+             * was taken.
+             */
+            void since(Clock::time_point start)
+            {
+                if(start != Clock::time_point())
+                    record(std::chrono::duration_cast<
+                            std::chrono::microseconds>(
+                                Clock::now()-start).count());
+            }
+
+            //! Number of durations recorded
+            unsigned long long count() const;
+
+            //! Sum of all durations recorded in microseconds
+            unsigned long long sum() const;
+
+            //! Durations recorded into a specific bucket
+            unsigned long long count(unsigned bucket) const
+            {
+                return m_buckets[bucket].load(std::memory_order_relaxed);
+            }
+
+            //! Estimate a quantile
+            /*!
+             * @param[in] quantile Quantile from 0 to 1 (0.99 for p99)
+             * @return Upper bound of the bucket the quantile falls in, in
+             *         microseconds. Zero if nothing has been recorded.
+             */
+            unsigned long long quantile(double quantile) const;
+
+            //! The number of durations recorded
+            long long value() const
+            {
+                return count();
+            }
+
+            void samples(std::ostream& stream) const;
+        };
+
+        //! Visit every registered metric
+        /*!
+         * Metrics are visited in order of registration. Don't construct or
+         * destroy metrics from within the visitor.
+         */
+        void each(const std::function<void(const Metric&)>& visitor);
+
+        //! Write every registered metric in Prometheus text format
+        /*!
+         * Metrics sharing a name are grouped under a single HELP and TYPE
+         * line. The content type for this is "text/plain; version=0.0.4".
+         */
+        void write(std::ostream& stream);
+
+        //! Requests created
+        extern Counter requests;
+
+        //! Requests currently in existence
+        extern Gauge activeRequests;
+
+        //! Most requests ever in existence at once
+        extern Peak maxActiveRequests;
+
+        //! Tasks waiting in the manager's queues
+        extern Gauge queuedTasks;
+
+        //! Handler threads not currently sleeping
+        extern Gauge activeThreads;
+
+        //! Most handler threads ever active at once
+        extern Peak maxActiveThreads;
+
+        //! Handler threads running
+        extern Gauge handlerThreads;
+
+        //! Handler threads inside blocking sections
+        extern Gauge blockedThreads;
+
+        //! Management records received
+        extern Counter managementRecords;
+
+        //! Messages received for requests
+        extern Counter messages;
+
+        //! Dead socket notifications received by the manager
+        extern Counter badSocketMessages;
+
+        //! Requests killed because their socket died
+        extern Counter badSocketKills;
+
+        //! Records received for requests that don't exist
+        extern Counter orphanRecords;
+
+        //! Connections accepted
+        extern Counter incomingConnections;
+
+        //! Connections made
+        extern Counter outgoingConnections;
+
+        //! Sockets closed locally
+        extern Counter socketKills;
+
+        //! Sockets hung up remotely
+        extern Counter socketHangups;
+
+        //! Bytes written to sockets
+        extern Counter bytesSent;
+
+        //! Bytes read from sockets
+        extern Counter bytesReceived;
+
+        //! Connections closed by the transceiver at the end of a request
+        extern Counter connectionKills;
+
+        //! Connections the transceiver found dead when reading
+        extern Counter connectionHangups;
+
+        //! Records queued up for sending
+        extern Counter recordsQueued;
+
+        //! Records completely sent
+        extern Counter recordsSent;
+
+        //! Records waiting in the send queues of every connection
+        extern Gauge sendQueueRecords;
+
+        //! Bytes waiting in the send queues of every connection
+        extern Gauge sendQueueBytes;
+
+        //! Timers pending in all timer wheels
+        extern Gauge pendingTimers;
+
+        //! Connections closed for being idle too long
+        extern Counter idleKills;
+
+        //! Requests that ran past their deadline
+        extern Counter requestTimeouts;
+
+        //! New requests rejected for there being too many active ones
+        extern Counter requestLimitRejections;
+
+        //! New requests rejected for there being too many queued tasks
+        extern Counter taskLimitRejections;
+
+        //! New requests rejected for there being too much queued output
+        extern Counter sendLimitRejections;
+
+        //! Requests rejected for their client making too many of them
+        extern Counter rateLimitRejections;
+
+        //! Times an event loop stopped reading for too much queued output
+        extern Counter readPauses;
+
+        //! Requests handed off to a Topic to stream from
+        extern Gauge subscribers;
+
+        //! Subscribers dropped for not keeping up with their Topic
+        extern Counter subscriberDrops;
+
+        //! Responses served out of a ResponseCache
+        extern Counter responseCacheHits;
+
+        //! Responses answered with 304 Not Modified by a ResponseCache
+        extern Counter responseCacheNotModified;
+
+        //! Lookups that didn't find a response in a ResponseCache
+        extern Counter responseCacheMisses;
+
+        //! Bytes taken up by all ResponseCache objects
+        extern Gauge responseCacheBytes;
+
+        //! Authorizations answered out of an AuthorizationCache
+        extern Counter authorizationCacheHits;
+
+        //! Lookups that didn't find a decision in an AuthorizationCache
+        extern Counter authorizationCacheMisses;
+
+        //! Static assets served out of an AssetCache
+        extern Counter assetHits;
+
+        //! Static assets answered with 304 Not Modified
+        extern Counter assetNotModified;
+
+        //! Lookups that didn't find a static asset in an AssetCache
+        extern Counter assetMisses;
+
+        //! Time from BEGIN_REQUEST until the end of PARAMS
+        extern Histogram paramsTime;
+
+        //! Time from the end of PARAMS until the end of IN
+        extern Histogram inTime;
+
+        //! Time tasks spend in the manager's queues
+        extern Histogram queueTime;
+
+        //! Time spent in each call to Request::response()
+        extern Histogram responseTime;
+
+        //! Time from BEGIN_REQUEST until the request is complete
+        extern Histogram requestTime;
+
+        //! Time from queueing a record until it's last byte is sent
+        extern Histogram sendTime;
+
+        //! Records received of a certain type
+        /*!
+         * @param[in] type Record type as it appears in the header. Anything
+         *                 unknown is lumped together.
+         */
+        Counter& recordsReceived(unsigned type);
+    }
+}
+
+#endif
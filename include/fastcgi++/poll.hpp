@@ -36,8 +36,10 @@
 
 #include "fastcgi++/config.hpp"
 
-#ifdef FASTCGIPP_UNIX
 #include <vector>
+#include <memory>
+#include <cstddef>
+#ifdef FASTCGIPP_UNIX
 #include <poll.h>
 #endif
 
@@ -53,6 +55,18 @@ namespace Fastcgipp
      * used by the SocketGroup class and other facilities of within fastcgi++.
      * Cross-platform development will require modification of this class.
      *
+     * Events are retrieved from the OS in batches of up to batchSize. A call
+     * to poll() for a single result only goes to the OS once every event from
+     * the previous batch has been handed out.
+     *
+     * If built with FASTCGIPP_IO_URING the Linux implementation will use an
+     * io_uring instead of epoll when the kernel allows it. Changes to the poll
+     * list are then queued up in the ring and handed to the kernel along with
+     * the next wait so a full cycle of the event loop costs a single system
+     * call. Sockets are polled with one shot requests that get rearmed once
+     * their event has been handed out which keeps the level triggered
+     * behaviour of epoll.
+     *
      * @date    October 3, 2018
      * @author  Eddie Carle &lt;eddie@isatec.ca&gt;
      */
@@ -67,14 +81,54 @@ namespace Fastcgipp
         typedef std::vector<pollfd> poll_t;
 #endif
 
+#ifdef FASTCGIPP_IO_URING
+        //! io_uring based implementation
+        struct Ring;
+
+        //! Our io_uring if we are using one
+        const std::unique_ptr<Ring> m_ring;
+#endif
+
         //! The OS level polling object
         poll_t m_poll;
 
     public:
+        //! Maximum number of events retrieved from the OS in a single call
+        static const unsigned batchSize = 256;
+
+        //! Set to true to have new Poll objects use io_uring
+        /*!
+         * This has no effect unless fastcgi++ was built with
+         * FASTCGIPP_IO_URING. Even if true, an io_uring will only be used if
+         * the kernel supports all the features we need. Defaults to false
+         * as the io_uring only replaces polling and doesn't save any of the
+         * reads and writes, so epoll remains the proven choice.
+         */
+        static bool ioUring;
+
+        //! Name of the OS level polling mechanism in use
+        const char* backend() const;
+
         //! Add a socket identifier to the poll list
         bool add(const socket_t socket);
 
+        //! Set whether or not we poll the socket for writability
+        /*!
+         * Sockets are only polled for writability on request as they
+         * would otherwise almost always have an event waiting.
+         *
+         * @param [in] socket Socket identifier already in the poll list.
+         * @param [in] out True if we should poll for writability.
+         * @param [in] in False if we should stop polling for readability.
+         *                Errors and hang ups are still reported.
+         */
+        bool mod(const socket_t socket, bool out, bool in=true);
+
         //! Remove a socket identifier to the poll list
+        /*!
+         * Any events still pending for the socket in the current batch are
+         * discarded.
+         */
         bool del(const socket_t socket);
 
         //! Type returned from a poll request
@@ -93,6 +147,9 @@ namespace Fastcgipp
             //! Event: the socket has been "hung up" on the other end
             static const unsigned pollRdHup;
 
+            //! Event: the socket can be written to
+            static const unsigned pollOut;
+
             //! Event register
             unsigned m_events;
 
@@ -153,6 +210,12 @@ namespace Fastcgipp
                 return m_events & pollIn;
             }
 
+            //! True if the socket can be written to
+            bool out() const
+            {
+                return m_events & pollOut;
+            }
+
             //! True if and only if the socket has data to read
             bool onlyIn() const
             {
@@ -162,14 +225,41 @@ namespace Fastcgipp
 
         //! Initiate poll on group
         /*!
+         * If events from a previous batch are still pending, the next one is
+         * returned immediately without going to the OS.
+         *
          * @param [in] timeout 0 means don't block at all. -1 means block
          *                     indefinitely. A positive integer is the number of
          *                     milliseconds before blocking times out.
          */
         Result poll(int timeout);
 
+        //! Initiate poll on group and retrieve an entire batch of events
+        /*!
+         * Any events still pending from a previous batch are returned instead
+         * of going to the OS. The returned container is only valid until the
+         * next call to poll(), batch() or del() and any events from it are
+         * considered handed out.
+         *
+         * @param [in] timeout 0 means don't block at all. -1 means block
+         *                     indefinitely. A positive integer is the number of
+         *                     milliseconds before blocking times out.
+         * @return Ready events. Empty if the poll timed out.
+         */
+        const std::vector<Result>& batch(int timeout);
+
         Poll();
         ~Poll();
+
+    private:
+        //! Most recent batch of events retrieved from the OS
+        std::vector<Result> m_batch;
+
+        //! Index of the next event in m_batch to hand out
+        std::size_t m_next;
+
+        //! Fill m_batch with events from the OS
+        inline void fill(int timeout);
     };
 }
 
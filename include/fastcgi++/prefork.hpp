@@ -0,0 +1,239 @@
+/*!
+ * @file       prefork.hpp
+ * @brief      Declares the Prefork class
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 15, 2026
+ * @copyright  Copyright &copy; 2026 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2026 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#ifndef FASTCGIPP_PREFORK_HPP
+#define FASTCGIPP_PREFORK_HPP
+
+#include <set>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <ostream>
+#include <functional>
+
+#include <sys/types.h>
+#include <signal.h>
+
+#include "fastcgi++/sockets.hpp"
+
+//! Topmost namespace for the fastcgi++ library
+namespace Fastcgipp
+{
+    //! Runs a Manager in each of a number of forked processes
+    /*!
+     * Each process has it's own transceiver and it's own copy of everything
+     * process wide, so nothing is contended between them. They share the
+     * listen sockets, which are set up in the supervising process before
+     * forking with listen(). The kernel hands each new connection to
+     * whichever process accepts it first.
+     *
+     * The supervisor restarts any child that crashes. Sending it SIGUSR1 or
+     * SIGTERM passes the signal on to every child and waits for them all to
+     * finish. SIGINT is passed on as SIGTERM.
+     *
+     * Every child publishes it's metrics into memory shared with the others
+     * once a second. Any process can then write() the sum of them all.
+     *
+     * @code
+     * Fastcgipp::Prefork prefork(4);
+     * prefork.listen("127.0.0.1", "23987");
+     * return prefork.run([&prefork] ()
+     * {
+     *     Fastcgipp::Manager<Echo> manager;
+     *     for(const auto listener: prefork.listeners())
+     *         manager.inherit(listener);
+     *     manager.setupSignals();
+     *     manager.start();
+     *     manager.join();
+     *     return 0;
+     * });
+     * @endcode
+     *
+     * @date    October 15, 2026
+     * @author  Eddie Carle &lt;eddie@isatec.ca&gt;
+     */
+    class Prefork
+    {
+    public:
+        //! Set up the supervisor. Nothing is forked yet.
+        /*!
+         * @param[in] processes Number of child processes to run
+         * @param[in] publishInterval How often children publish their
+         *                            metrics
+         */
+        Prefork(
+                unsigned processes = std::thread::hardware_concurrency(),
+                std::chrono::milliseconds publishInterval
+                    = std::chrono::seconds(1));
+
+        ~Prefork();
+
+        Prefork(const Prefork&) = delete;
+        Prefork& operator=(const Prefork&) = delete;
+
+        //! Listen to the default Fastcgi socket
+        /*!
+         * @return True on success. False on failure.
+         *
+         * @sa SocketGroup::listen()
+         */
+        bool listen()
+        {
+            return m_sockets.listen();
+        }
+
+        //! Listen to a named socket
+        /*!
+         * @param [in] name Name of socket (path in Unix world).
+         * @param [in] permissions Permissions of socket.
+         * @param [in] owner Owner (username) of socket.
+         * @param [in] group Group (group name) of socket.
+         * @return True on success. False on failure.
+         *
+         * @sa SocketGroup::listen()
+         */
+        bool listen(
+                const char* name,
+                uint32_t permissions = 0xffffffffUL,
+                const char* owner = nullptr,
+                const char* group = nullptr)
+        {
+            return m_sockets.listen(name, permissions, owner, group);
+        }
+
+        //! Listen to a TCP port
+        /*!
+         * @param [in] interface Interface to listen on.
+         * @param [in] service Port or service to listen on.
+         * @return True on success. False on failure.
+         *
+         * @sa SocketGroup::listen()
+         */
+        bool listen(
+                const char* interface,
+                const char* service)
+        {
+            return m_sockets.listen(interface, service);
+        }
+
+        //! Should we set socket option to reuse address
+        void reuseAddress(bool value)
+        {
+            m_sockets.reuseAddress(value);
+        }
+
+        //! The listen sockets for children to inherit
+        const std::set<socket_t>& listeners() const
+        {
+            return m_sockets.listeners();
+        }
+
+        //! Fork the children and supervise them until they are all done
+        /*!
+         * Children run the function given and exit with whatever it
+         * returns. One that exits cleanly is done. One that crashes or exits
+         * with anything else is forked again, after a second if it didn't
+         * even last that long.
+         *
+         * This blocks SIGCHLD, SIGINT, SIGTERM and SIGUSR1 in the calling
+         * thread, so call it before starting any other threads.
+         *
+         * @param[in] child Function each child process runs
+         * @return Zero if every child exited cleanly.
+         */
+        int run(const std::function<int()>& child);
+
+        //! Index of the calling child process
+        /*!
+         * Handy for pinning each child to it's own CPUs with a spread
+         * CpuSet.
+         *
+         * @return Index from zero or the number of processes when called
+         *         from the supervisor.
+         */
+        unsigned index() const
+        {
+            return m_index;
+        }
+
+        //! Write the metrics of every child summed in Prometheus text format
+        /*!
+         * The samples of each series are added together across all children,
+         * using whatever each child last published. The calling child's own
+         * metrics are always current.
+         */
+        void write(std::ostream& stream) const;
+
+        //! Publish the calling child's metrics for the others to see
+        /*!
+         * This is done periodically for you while a child is running.
+         */
+        void publish();
+
+    private:
+        //! Listen sockets shared with the children
+        SocketGroup m_sockets;
+
+        //! Number of child processes
+        const unsigned m_processes;
+
+        //! How often children publish their metrics
+        const std::chrono::milliseconds m_publishInterval;
+
+        //! Index of this process. m_processes for the supervisor.
+        unsigned m_index;
+
+        //! Process ID of each child. Zero if not running.
+        std::vector<pid_t> m_children;
+
+        //! Shared memory the children publish their metrics into
+        struct Slot;
+
+        //! One slot for each child
+        Slot* m_slots;
+
+        //! Size of a slot including it's data
+        static const size_t slotSize = 0x40000;
+
+        //! The slot of a child
+        Slot& slot(unsigned index) const;
+
+        //! Signal mask to restore in the children
+        sigset_t m_mask;
+
+        //! Fork a child
+        /*!
+         * The child never returns from this.
+         *
+         * @return False if the fork failed.
+         */
+        bool fork(unsigned index, const std::function<int()>& child);
+    };
+}
+
+#endif
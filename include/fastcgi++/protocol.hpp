@@ -137,6 +137,267 @@ namespace Fastcgipp
         template<class T>
         using Requests = std::map<RequestId, T, RequestId::Less>;
 
+        //! A flat hash table that indexes with RequestId
+        /*!
+         * Requests are grouped by connection. The connections live in an open
+         * addressing hash table keyed on Socket::hash() with linear probing
+         * while the requests of any one connection live in a dense array
+         * indexed directly by their FcgiId. Since web servers hand out FastCGI
+         * request IDs starting from 1 these arrays stay tiny and a lookup
+         * boils down to one short probe sequence and an array index. Killing
+         * every request on a connection is just as cheap.
+         *
+         * Pointers to values are invalidated by any insertion or erasure so
+         * values should be cheap to move and best not hold onto. There is no
+         * locking in here but the const member functions can safely be called
+         * concurrently.
+         *
+         * @tparam T Value type. It must be default constructible.
+         * @date    October 14, 2026
+         * @author  Eddie Carle &lt;eddie@isatec.ca&gt;
+         */
+        template<class T>
+        class RequestTable
+        {
+        private:
+            //! A single request within a connection
+            struct Slot
+            {
+                T value;
+                bool used;
+
+                Slot():
+                    used(false)
+                {}
+            };
+
+            //! All the requests on a single connection
+            /*!
+             * A bucket with a zero count is empty.
+             */
+            struct Connection
+            {
+                Socket socket;
+                std::vector<Slot> slots;
+                size_t count;
+
+                Connection():
+                    count(0)
+                {}
+            };
+
+            //! The hash table itself. It's size is always a power of two.
+            std::vector<Connection> m_connections;
+
+            //! How many buckets are in use
+            size_t m_connectionCount;
+
+            //! How many requests are in the table
+            size_t m_size;
+
+            //! Return value of locate() if the connection isn't there
+            static const size_t npos = ~size_t(0);
+
+            //! Find the bucket index of a connection
+            size_t locate(const Socket& socket) const
+            {
+                if(m_connections.empty())
+                    return npos;
+                const size_t mask = m_connections.size()-1;
+                for(
+                        size_t i = socket.hash() & mask;
+                        m_connections[i].count;
+                        i = (i+1) & mask)
+                    if(m_connections[i].socket == socket)
+                        return i;
+                return npos;
+            }
+
+            //! Find or add the bucket for a connection
+            size_t bucket(const Socket& socket)
+            {
+                size_t i = locate(socket);
+                if(i != npos)
+                    return i;
+
+                if((m_connectionCount+1)*2 > m_connections.size())
+                    rehash(m_connections.empty() ? 16 : m_connections.size()*2);
+
+                const size_t mask = m_connections.size()-1;
+                for(i = socket.hash() & mask;
+                        m_connections[i].count;
+                        i = (i+1) & mask);
+                m_connections[i].socket = socket;
+                ++m_connectionCount;
+                return i;
+            }
+
+            //! Move every connection into a table of the specified size
+            void rehash(size_t size)
+            {
+                std::vector<Connection> connections(size);
+                const size_t mask = size-1;
+                for(auto& connection: m_connections)
+                    if(connection.count)
+                    {
+                        size_t i = connection.socket.hash() & mask;
+                        while(connections[i].count)
+                            i = (i+1) & mask;
+                        connections[i] = std::move(connection);
+                    }
+                m_connections.swap(connections);
+            }
+
+            //! Empty a bucket and close the gap in any probe sequence
+            void remove(size_t hole)
+            {
+                const size_t mask = m_connections.size()-1;
+                m_connections[hole] = Connection();
+                --m_connectionCount;
+                for(
+                        size_t i = (hole+1) & mask;
+                        m_connections[i].count;
+                        i = (i+1) & mask)
+                {
+                    const size_t home = m_connections[i].socket.hash() & mask;
+                    if(((i-home) & mask) >= ((i-hole) & mask))
+                    {
+                        m_connections[hole] = std::move(m_connections[i]);
+                        m_connections[i] = Connection();
+                        hole = i;
+                    }
+                }
+            }
+
+            //! Empty a slot without checking if it's connection is now empty
+            void clear(Connection& connection, Slot& slot)
+            {
+                slot.value = T();
+                slot.used = false;
+                --connection.count;
+                --m_size;
+            }
+
+        public:
+            RequestTable():
+                m_connectionCount(0),
+                m_size(0)
+            {}
+
+            //! Find a request
+            /*!
+             * @param [in] id Request to look for.
+             * @return Pointer to the value or nullptr if it isn't there.
+             */
+            T* find(const RequestId& id)
+            {
+                return const_cast<T*>(
+                        static_cast<const RequestTable&>(*this).find(id));
+            }
+
+            //! Find a request
+            const T* find(const RequestId& id) const
+            {
+                const size_t i = locate(id.m_socket);
+                if(i == npos)
+                    return nullptr;
+                const Connection& connection = m_connections[i];
+                if(id.m_id >= connection.slots.size()
+                        || !connection.slots[id.m_id].used)
+                    return nullptr;
+                return &connection.slots[id.m_id].value;
+            }
+
+            //! Find a request or default construct it if it isn't there
+            T& operator[](const RequestId& id)
+            {
+                Connection& connection = m_connections[bucket(id.m_socket)];
+                if(id.m_id >= connection.slots.size())
+                    connection.slots.resize(id.m_id+1);
+                Slot& slot = connection.slots[id.m_id];
+                if(!slot.used)
+                {
+                    slot.used = true;
+                    ++connection.count;
+                    ++m_size;
+                }
+                return slot.value;
+            }
+
+            //! Erase a single request
+            /*!
+             * @return True if the request was there to be erased.
+             */
+            bool erase(const RequestId& id)
+            {
+                const size_t i = locate(id.m_socket);
+                if(i == npos)
+                    return false;
+                Connection& connection = m_connections[i];
+                if(id.m_id >= connection.slots.size()
+                        || !connection.slots[id.m_id].used)
+                    return false;
+                clear(connection, connection.slots[id.m_id]);
+                if(!connection.count)
+                    remove(i);
+                return true;
+            }
+
+            //! Erase all requests on a connection
+            /*!
+             * @return How many requests were erased.
+             */
+            size_t erase(const Socket& socket)
+            {
+                return erase(socket, [] (T&) { return true; });
+            }
+
+            //! Erase the requests on a connection that satisfy a predicate
+            /*!
+             * @param [in] socket Connection to erase requests from.
+             * @param [in] predicate Called with a reference to each value on the
+             *                       connection. Return true to erase it.
+             * @return How many requests were erased.
+             */
+            template<class Predicate>
+            size_t erase(const Socket& socket, Predicate predicate)
+            {
+                const size_t i = locate(socket);
+                if(i == npos)
+                    return 0;
+                Connection& connection = m_connections[i];
+                size_t erased = 0;
+                for(auto& slot: connection.slots)
+                    if(slot.used && predicate(slot.value))
+                    {
+                        clear(connection, slot);
+                        ++erased;
+                    }
+                if(!connection.count)
+                    remove(i);
+                return erased;
+            }
+
+            //! How many requests are in the table
+            size_t size() const
+            {
+                return m_size;
+            }
+
+            //! How many requests are on a connection
+            size_t count(const Socket& socket) const
+            {
+                const size_t i = locate(socket);
+                return i == npos ? 0 : m_connections[i].count;
+            }
+
+            //! True if there are no requests in the table
+            bool empty() const
+            {
+                return m_size == 0;
+            }
+        };
+
         //! Defines the types of records within the FastCGI protocol
         enum class RecordType: uint8_t
         {
@@ -403,14 +664,29 @@ namespace Fastcgipp
          */
         size_t getRecordSize(size_t contentLength);
 
-        //! The maximum allowed file descriptors open at a time
-        extern const ManagementReply<14, 2> maxConnsReply;
-
-        //! The maximum allowed requests at a time
-        extern const ManagementReply<13, 2> maxReqsReply;
+        //! Determine the size of the records needed to hold some content
+        /*!
+         * @param[in] contentLength Length of the content. This may be
+         *                          larger than fits into a single record.
+         * @return Length of all the records including headers and padding.
+         */
+        size_t getRecordsSize(size_t contentLength);
 
-        //! Where or not requests can be multiplexed over a single connections
-        extern const ManagementReply<15, 1> mpxsConnsReply;
+        //! Encode content into as many aligned records as it takes
+        /*!
+         * @param[in] type Type of the records
+         * @param[in] fcgiId Request ID of the records
+         * @param[in] content Start of the content
+         * @param[in] contentLength Length of the content
+         * @param[out] records Room for getRecordsSize(contentLength) bytes
+         * @return 1+ the last byte of the records
+         */
+        char* encodeRecords(
+                RecordType type,
+                FcgiId fcgiId,
+                const char* content,
+                size_t contentLength,
+                char* records);
     }
 }
 
@@ -0,0 +1,107 @@
+/*!
+ * @file       ratelimiter.hpp
+ * @brief      Declares the RateLimiter class
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 15, 2026
+ * @copyright  Copyright &copy; 2026 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2026 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#ifndef FASTCGIPP_RATELIMITER_HPP
+#define FASTCGIPP_RATELIMITER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+
+//! Topmost namespace for the fastcgi++ library
+namespace Fastcgipp
+{
+    //! Lock free per client rate limiter
+    /*!
+     * This limits every client to a long run rate of requests while letting
+     * them make a burst of requests at once. It implements the generic cell
+     * rate algorithm: all that is kept per client is the theoretical arrival
+     * time of their next request, which makes refilling implicit in the
+     * passing of time. Requests that return this from Request::rateLimiter()
+     * are checked as soon as their parameters arrive and answered with 429
+     * Too Many Requests before any post data is accepted should they not be
+     * admitted.
+     *
+     * Clients are identified by a hash, the remote address by default. No
+     * keys are stored. Instead every client is hashed into two cells of a
+     * fixed table of atomics which are updated with compare and swap. A
+     * client sharing a cell with another only ever sees it's arrival time
+     * pushed later, so the earlier of the two is used. A client is only
+     * limited unfairly if both of it's cells are shared with busier ones.
+     *
+     * @date    October 15, 2026
+     * @author  Eddie Carle &lt;eddie@isatec.ca&gt;
+     */
+    class RateLimiter
+    {
+    public:
+        typedef std::chrono::steady_clock Clock;
+
+        //! Sole constructor
+        /*!
+         * @param[in] rate Requests per second a client can make in the long
+         *                 run
+         * @param[in] burst Requests a client can make at once
+         * @param[in] cells Amount of cells clients are hashed into. This is
+         *                  rounded up to a power of two.
+         */
+        RateLimiter(double rate, unsigned burst, size_t cells=65536);
+
+        //! Try to admit a request from a client
+        /*!
+         * @param[in] key Hash identifying the client
+         * @param[in] now Time the request is made at
+         * @param[out] retryAfter If the request isn't admitted this is set
+         *                        to how long until it would be. Can be null.
+         * @return True if the request is admitted.
+         */
+        bool admit(
+                size_t key,
+                Clock::time_point now=Clock::now(),
+                Clock::duration* retryAfter=nullptr);
+
+        //! Forget about every client
+        void clear();
+
+    private:
+        //! Time between requests in the long run
+        const Clock::duration m_interval;
+
+        //! How far ahead of now a client's arrival time can be
+        const Clock::duration m_tolerance;
+
+        //! One less than the amount of cells
+        const size_t m_mask;
+
+        //! Theoretical arrival times since the clock's epoch
+        std::unique_ptr<std::atomic<Clock::rep>[]> m_cells;
+    };
+}
+
+#endif
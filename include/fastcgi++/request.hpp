@@ -32,11 +32,22 @@
 #include "fastcgi++/protocol.hpp"
 #include "fastcgi++/fcgistreambuf.hpp"
 #include "fastcgi++/http.hpp"
+#include "fastcgi++/metrics.hpp"
+#include "fastcgi++/timers.hpp"
+#include "fastcgi++/responsecache.hpp"
+#include "fastcgi++/assetcache.hpp"
+#include "fastcgi++/authorizationcache.hpp"
+#include "fastcgi++/ratelimiter.hpp"
+#include "fastcgi++/topic.hpp"
 
 #include <ostream>
+#include <sstream>
 #include <functional>
 #include <queue>
 #include <mutex>
+#include <atomic>
+#include <climits>
+#include <memory>
 
 //! Topmost namespace for the fastcgi++ library
 namespace Fastcgipp
@@ -59,11 +70,32 @@ namespace Fastcgipp
          */
         virtual std::unique_lock<std::mutex> handler() =0;
 
+        //! Handle a single message directly
+        /*!
+         * This bypasses the message queue entirely and is intended for the
+         * case where a single thread owns the request outright.
+         *
+         * @param[in] message Message to handle
+         * @return True if the request is complete.
+         */
+        virtual bool handle(Message&& message) =0;
+
+        //! Is the empty IN record of an early dispatched request still due?
+        /*!
+         * A request that completes from earlyDispatch() before the web
+         * server terminates it's input stream leaves that record to arrive
+         * after it's gone.
+         */
+        virtual bool trailing() const =0;
+
         virtual ~Request_base() {}
 
         //! Only one thread is allowed to handle the request at a time
         std::mutex mutex;
 
+        //! Message type reserved for the expiry of a request deadline
+        static const int deadlineType = INT_MIN;
+
         //! Send a message to the request
         inline void push(Message&& message)
         {
@@ -71,12 +103,28 @@ namespace Fastcgipp
             m_messages.push(std::move(message));
         }
 
+        //! Take whatever messages are still queued up for the request
+        /*!
+         * Once a request is complete anything left in the queue belongs to
+         * the next request the web server started with the same ID.
+         */
+        inline std::queue<Message> leftovers()
+        {
+            std::queue<Message> messages;
+            std::lock_guard<std::mutex> lock(m_messagesMutex);
+            messages.swap(m_messages);
+            return messages;
+        }
+
     protected:
         //! A queue of message for the request
         std::queue<Message> m_messages;
 
         //! Thread safe our message queue
         std::mutex m_messagesMutex;
+
+        //! Source of the serial numbers that tell requests apart
+        static std::atomic_ullong s_serials;
     };
 
     //! %Request handling class
@@ -93,11 +141,15 @@ namespace Fastcgipp
      * for everything internally.
      *
      * @tparam charT Character type for internal processing (wchar_t or char)
+     * @tparam Containers Container policy for the environment data. Pass
+     *                    Http::FlatContainers to have gets, posts and cookies
+     *                    stored in flat containers.
      *
-     * @date    October 13, 2018
+     * @date    October 14, 2026
      * @author  Eddie Carle &lt;eddie@isatec.ca&gt;
      */
-    template<class charT> class Request: public Request_base
+    template<class charT, class Containers=Http::TreeContainers>
+    class Request: public Request_base
     {
     public:
         //! Initializes what it can. configure() to finish.
@@ -116,10 +168,18 @@ namespace Fastcgipp
             err(&m_errStreamBuffer),
             m_maxPostSize(maxPostSize),
             m_state(Protocol::RecordType::PARAMS),
-            m_status(Protocol::ProtocolStatus::REQUEST_COMPLETE)
+            m_early(false),
+            m_status(Protocol::ProtocolStatus::REQUEST_COMPLETE),
+            m_timers(nullptr),
+            m_deadline(0),
+            m_serial(0),
+            m_cache(nullptr),
+            m_cacheCorked(false),
+            m_authorizations(nullptr),
+            m_topic(nullptr)
         {
-            out.imbue(std::locale("C"));
-            err.imbue(std::locale("C"));
+            out.imbue(std::locale::classic());
+            err.imbue(std::locale::classic());
         }
 
         //! Configures the request with the data it needs.
@@ -133,6 +193,8 @@ namespace Fastcgipp
          * @param[in] kill Boolean value indicating whether or not the socket
          *                 should be closed upon completion
          * @param[in] send Function for sending data out of the stream buffers
+         * @param[in] sendFile Function for sending file data out of the
+         *                     stream buffers by descriptor
          * @param[in] callback Callback function capable of passing messages to
          *                     the request
          */
@@ -142,21 +204,80 @@ namespace Fastcgipp
                 bool kill,
                 const std::function<void(const Socket&, Block&&, bool)>
                     send,
+                const std::function<void(
+                    const Socket&,
+                    Block&&,
+                    const std::shared_ptr<const int>&,
+                    off_t,
+                    size_t)> sendFile,
                 const std::function<void(Message)> callback);
 
+        //! Configures a recycled request with the data it needs.
+        /*!
+         * This is the same as the full configure() except that the send
+         * function is left as it was the first time around.
+         */
+        void configure(
+                const Protocol::RequestId& id,
+                const Protocol::Role& role,
+                bool kill,
+                const std::function<void(Message)> callback);
+
+        //! Set the timers to use and start the clock on a deadline
+        /*!
+         * This is called by the Manager once the request is configured. If
+         * the request isn't complete once the deadline passes,
+         * timeoutHandler() is called and the request completed.
+         *
+         * @param[in] timers Timers to use for the deadline and delay().
+         * @param[in] timeout Time the request has to complete. Zero for no
+         *                    deadline.
+         */
+        void deadline(Timers& timers, std::chrono::milliseconds timeout);
+
+        //! Reset a completed request so the object can be used again
+        /*!
+         * This is only ever called if request objects are being recycled by
+         * way of Manager::requestPool(). It puts the request back into it's
+         * just constructed state while keeping whatever memory it can.
+         *
+         * If your derivation carries any state of it's own between calls to
+         * response(), override this to reset it and call
+         * Request<charT>::reset() from there.
+         */
+        virtual void reset();
+
         std::unique_lock<std::mutex> handler();
 
+        //! Handle a single message directly
+        bool handle(Message&& message);
+
+        bool trailing() const
+        {
+            return m_early;
+        }
+
         virtual ~Request() {}
 
+        //! Build locales ahead of time
+        /*!
+         * Call this at startup with the same list passed to pickLocale() and
+         * setLocale() won't ever have to build a locale while handling a
+         * request.
+         *
+         * @param[in] locales Names of the locales without the codepage
+         */
+        static void cacheLocales(const std::vector<std::string>& locales);
+
     protected:
         //! Const accessor for the HTTP environment data
-        const Http::Environment<charT>& environment() const
+        const Http::Environment<charT, Containers>& environment() const
         {
             return m_environment;
         }
 
         //! Accessor for the HTTP environment data
-        Http::Environment<charT>& environment()
+        Http::Environment<charT, Containers>& environment()
         {
             return m_environment;
         }
@@ -192,6 +313,23 @@ namespace Fastcgipp
          */
         virtual void unknownContentErrorHandler();
 
+        //! Called when the request runs past it's deadline
+        /*!
+         * By default it will send a standard 504 Gateway Timeout message to
+         * the user. That only makes sense if nothing has been output yet so
+         * override it if the response may already be under way.
+         */
+        virtual void timeoutHandler();
+
+        //! Called when rateLimiter() doesn't admit the request
+        /*!
+         * By default it will send a standard 429 Too Many Requests message
+         * to the user. Override for more specialized purposes.
+         *
+         * @param[in] retryAfter Seconds until the client would be admitted.
+         */
+        virtual void rateLimitErrorHandler(unsigned retryAfter);
+
         //! See the requests role
         Protocol::Role role() const
         {
@@ -267,6 +405,94 @@ namespace Fastcgipp
             return false;
         }
 
+        //! Consume file data to be filtered
+        /*!
+         * In the FILTER role the web server follows the post data with the
+         * contents of the file to be filtered. This function is called with
+         * each DATA record of it as it arrives and response() only once it
+         * has all been passed here. Nothing of it is kept by the library so
+         * memory use is bounded by the record size rather than the file size.
+         * Output written to the stream from here is sent on as the buffers
+         * fill so a filter can respond on the fly. The default does nothing.
+         *
+         * @param[in] data Start of the file data in this record
+         * @param[in] size Amount of file data in this record
+         */
+        virtual void dataHandler(const char* data, size_t size)
+        {}
+
+        //! Cache to answer authorizations from
+        /*!
+         * Override this to return a cache should you wish for requests in
+         * the AUTHORIZER role to have their decisions cached. Before
+         * response() is called the cache is checked for the Authorization
+         * header along with authorizationVariant(). If a decision is found it
+         * is sent as is and response() is never called. Otherwise the output
+         * of response() is corked and stored once it completes, provided it
+         * didn't end through errorHandler() or timeoutHandler(). Any call to
+         * cache() is ignored for such requests.
+         *
+         * @return Cache to use or null for none.
+         */
+        virtual AuthorizationCache* authorizationCache()
+        {
+            return nullptr;
+        }
+
+        //! Anything other than the Authorization header a decision depends on
+        /*!
+         * This is only called if authorizationCache() returns a cache. The
+         * request URI or remote address for example.
+         */
+        virtual std::string authorizationVariant()
+        {
+            return std::string();
+        }
+
+        //! Rate limiter to admit requests through
+        /*!
+         * Override this to return a limiter should you wish for clients to be
+         * limited in how often they make requests. It is consulted with
+         * rateLimitKey() as soon as the parameters arrive, before any post
+         * data is accepted. Requests that aren't admitted are answered by
+         * rateLimitErrorHandler() and response() is never called.
+         *
+         * @return Limiter to use or null for none.
+         */
+        virtual RateLimiter* rateLimiter()
+        {
+            return nullptr;
+        }
+
+        //! Identifies the client to rateLimiter()
+        /*!
+         * By default clients are told apart by their remote address. Override
+         * this to limit them by an API key or session for example.
+         */
+        virtual size_t rateLimitKey()
+        {
+            m_environment.parse("REMOTE_ADDR");
+            return std::hash<Address>()(environment().remoteAddress);
+        }
+
+        //! Should response() be called as soon as the parameters arrive
+        /*!
+         * Override this function to return true should you wish for requests
+         * without any post data to skip the IN phase. When the environment is
+         * complete and it's contentLength is zero, response() is called
+         * immediately instead of waiting on the empty IN record that the web
+         * server sends to terminate the input stream. That record is quietly
+         * discarded when it does arrive. The environment is fully available
+         * when this is called so the decision can be based on it. This is
+         * never called in the FILTER role.
+         *
+         * @return Return true to call response() without waiting on IN.
+         */
+        virtual bool earlyDispatch()
+        {
+            return false;
+        }
+
         //! The message associated with the current handler() call.
         /*!
          * This is only of use to the library user when a non FastCGI (type=0)
@@ -319,6 +545,189 @@ namespace Fastcgipp
             m_outStreamBuffer.dump(stream);
         }
 
+        //! Dumps part of a file directly out the stream
+        /*!
+         * This is the way to send large static files. The data is written
+         * straight from the file into the socket with sendfile() so it
+         * never gets copied through the library. The descriptor is
+         * duplicated so it can be closed as soon as this returns.
+         *
+         * @param[in] file Open file descriptor to read from
+         * @param[in] offset Offset into the file to start at
+         * @param[in] size Amount of data to send
+         * @return True on success. False if the descriptor couldn't be used.
+         */
+        bool dumpFile(int file, off_t offset, size_t size)
+        {
+            return m_outStreamBuffer.dumpFile(file, offset, size);
+        }
+
+        //! Respond with the library metrics
+        /*!
+         * This is the built-in Prometheus endpoint. Call it from response()
+         * for whatever URI the metrics should be scraped from. It outputs
+         * the headers itself so nothing else should have been output.
+         *
+         * @sa Metrics::write()
+         */
+        void metrics()
+        {
+            std::ostringstream text;
+            text << "Content-Type: text/plain; version=0.0.4\r\n\r\n";
+            Metrics::write(text);
+            const std::string data(text.str());
+            dump(data.data(), data.size());
+        }
+
+        //! Pass a message to ourselves after a delay
+        /*!
+         * The message arrives through callback() like any other so this
+         * takes the place of a thread sleeping on our behalf. Return false
+         * from response() and it will be called again with the message once
+         * the delay is up.
+         *
+         * @param[in] delay How long to wait before delivering the message
+         * @param[in] message Message to deliver
+         * @return Identifier of the timer should it need cancelling with
+         *         Timers::cancel(). Zero if there are no timers to use.
+         */
+        Timers::Id delay(Timers::Clock::duration delay, Message&& message);
+
+        //! Set the size of the output stream buffers
+        /*!
+         * Every time the buffer fills up a record is sent. Larger buffers
+         * mean fewer and larger records. Call this from the constructor of
+         * your request class. It stays in effect for recycled requests.
+         *
+         * @param[in] size Size of the buffers in characters. The default is
+         *                 8192 and the maximum is 65528.
+         */
+        void bufferSize(size_t size)
+        {
+            m_outStreamBuffer.bufferSize(size);
+            m_errStreamBuffer.bufferSize(size);
+        }
+
+        //! Enable or disable cork mode on the output stream
+        /*!
+         * In cork mode output goes into records that are as large as
+         * possible and nothing is actually sent until the output stream is
+         * explicitly flushed or the request completes. In the latter case
+         * all output is sent along with the END_REQUEST record in a single
+         * piece. This suits responses that are generated quickly in their
+         * entirety. Keep in mind that std::endl is an explicit flush.
+         *
+         * Call this from the constructor of your request class. It stays in
+         * effect for recycled requests.
+         *
+         * @param[in] corked True to enable cork mode.
+         */
+        void cork(bool corked=true)
+        {
+            m_outStreamBuffer.cork(corked);
+        }
+
+        //! End the headers and compress the rest of the response
+        /*!
+         * Call this in place of outputting the blank line that ends the
+         * headers. A content coding is picked from the Accept-Encoding header
+         * and the Content-Encoding and Vary headers are output along with
+         * the blank line. Everything output after this, dumps included, is
+         * compressed.
+         *
+         * @return The content coding chosen. NONE if the response won't be
+         *         compressed.
+         */
+        Compression compress();
+
+        //! End the headers and compress the rest of the response
+        /*!
+         * This is like compress() except the content coding has already been
+         * chosen.
+         *
+         * @param[in] compression Content coding to compress with. NONE or
+         *                        one that we don't support means the
+         *                        response isn't compressed.
+         * @return The content coding used
+         */
+        Compression compress(Compression compression);
+
+        //! End the headers of a response that is already compressed
+        /*!
+         * Use this for content that was compressed ahead of time. A content
+         * coding is picked from those available according to the
+         * Accept-Encoding header. The Content-Encoding and Vary headers are
+         * output along with the blank line that ends the headers. It is up
+         * to the caller to then dump() or dumpFile() the content in the
+         * chosen coding.
+         *
+         * @param[in] available Content codings the content is available in
+         * @return The content coding chosen. NONE if the content should be
+         *         sent as is.
+         */
+        Compression precompressed(
+                std::initializer_list<Compression> available);
+
+        //! Serve the response out of a cache
+        /*!
+         * Call this first thing in response(). If the cache holds a response
+         * for the request URI it is sent as is, or with 304 Not Modified if
+         * the client's If-None-Match or If-Modified-Since says it already has
+         * it. The 304 repeats the ETag, Vary, Cache-Control, Expires and
+         * Content-Location headers of the cached response. Only GET and HEAD
+         * requests are served from the cache.
+         *
+         * @param[in] cache Cache to look in
+         * @param[in] variant Anything other than the URI that the response
+         *                    depends on. The content coding for example.
+         * @return True if the response was served. Return true from
+         *         response() right away in that case.
+         */
+        bool cached(
+                ResponseCache& cache,
+                const std::string& variant=std::string());
+
+        //! Serve a static asset
+        /*!
+         * Call this first thing in response(). If the cache holds an asset
+         * for the path of the request URI it is sent in the best content
+         * coding the client accepts, or with 304 Not Modified if the
+         * client's If-None-Match or If-Modified-Since says it already has
+         * it. The 304 carries the ETag of that content coding along with the
+         * Vary header. Only GET and HEAD requests are served.
+         *
+         * @param[in] assets Cache to look in
+         * @return True if the asset was served. Return true from response()
+         *         right away in that case.
+         */
+        bool asset(const AssetCache& assets);
+
+        //! Store the response in a cache once it completes
+        /*!
+         * Call this before outputting anything. The output is corked until
+         * the request completes so that it can be captured in full. If the
+         * output gets flushed or a file dumped by descriptor along the way
+         * the response isn't cached. Neither are responses that end
+         * through errorHandler() or timeoutHandler().
+         *
+         * @param[in] cache Cache to store the response in
+         * @param[in] ttl How long the response stays in the cache
+         * @param[in] etag ETag of the response. Zero if it has none. The
+         *                 response's ETag header should hold it in quotes,
+         *                 optionally followed by a dash and a suffix that
+         *                 tells variants apart, as in "1234-gzip".
+         * @param[in] lastModified When the response was last modified. Zero
+         *                         if unknown.
+         * @param[in] variant Anything other than the URI that the response
+         *                    depends on. Same as passed to cached().
+         */
+        void cache(
+                ResponseCache& cache,
+                ResponseCache::Clock::duration ttl,
+                unsigned etag=0,
+                std::time_t lastModified=0,
+                const std::string& variant=std::string());
+
         //! Pick a locale
         /*!
          * Basically this finds the first language in
@@ -329,8 +738,41 @@ namespace Fastcgipp
         unsigned pickLocale(const std::vector<std::string>& locales);
 
         //! Set the output stream's locale
+        /*!
+         * Locales are only built the first time they are asked for and are
+         * shared by all requests after that. Any that can't be built are
+         * replaced with the classic "C" locale.
+         *
+         * @param[in] locale Name of the locale without the codepage. For
+         *                   example "en_US".
+         */
         void setLocale(const std::string& locale);
 
+        //! Hand the request off to a topic to stream it's output from
+        /*!
+         * Call this from response() and return true. Whatever has been
+         * output so far, headers included, is sent and then the request
+         * becomes a Topic::Subscriber instead of completing. From there on
+         * out it gets everything published to the topic until it is dropped
+         * or the topic is closed. The request object itself is done with.
+         *
+         * @code
+         * bool response()
+         * {
+         *     out << "Content-Type: text/event-stream\r\n"
+         *         "Cache-Control: no-cache\r\n\r\n";
+         *     subscribe(events);
+         *     return true;
+         * }
+         * @endcode
+         *
+         * @param[in] topic Topic to subscribe to
+         */
+        void subscribe(Topic& topic)
+        {
+            m_topic = &topic;
+        }
+
     private:
         //! The callback function for dealings outside the fastcgi++ library
         /*!
@@ -348,7 +790,7 @@ namespace Fastcgipp
         std::function<void(Message)> m_callback;
 
         //! The data structure containing all HTTP environment data
-        Http::Environment<charT> m_environment;
+        Http::Environment<charT, Containers> m_environment;
 
         //! The maximum amount of post data, in bytes, that can be recieved
         const size_t m_maxPostSize;
@@ -365,8 +807,21 @@ namespace Fastcgipp
         //! What the request is current doing
         Protocol::RecordType m_state;
 
+        //! True if response() was called before the empty IN record arrived
+        bool m_early;
+
+        //! When the request began if timing is enabled
+        Metrics::Clock::time_point m_began;
+
+        //! When the current phase of the request began
+        Metrics::Clock::time_point m_phase;
+
         //! Generates an END_REQUEST FastCGI record
-        void complete();
+        /*!
+         * @param[in] responded True if response() finished the request. Only
+         *                      then can the response be cached.
+         */
+        void complete(bool responded=false);
 
         //! Function to actually send the record
         std::function<void(const Socket&, Block&&, bool kill)> m_send;
@@ -374,6 +829,66 @@ namespace Fastcgipp
         //! Status to end the request with
         Protocol::ProtocolStatus m_status;
 
+        //! Timers for the deadline and delay()
+        Timers* m_timers;
+
+        //! Timer enforcing the deadline. Zero if there is none.
+        Timers::Id m_deadline;
+
+        //! Identifies this particular request to it's deadline timer
+        unsigned long long m_serial;
+
+        //! Cache to store the response in. Null if it isn't to be cached.
+        ResponseCache* m_cache;
+
+        //! Response details to store in the cache along with it
+        ResponseCache::Entry m_cacheEntry;
+
+        //! URI to store the response in the cache under
+        std::string m_cacheUri;
+
+        //! Variant to store the response in the cache as
+        std::string m_cacheVariant;
+
+        //! Were we in cork mode before caching the response?
+        bool m_cacheCorked;
+
+        //! Cache to store the authorization in. Null if it isn't cached.
+        AuthorizationCache* m_authorizations;
+
+        //! Authorization header to store the authorization under
+        std::string m_authorization;
+
+        //! Variant to store the authorization as
+        std::string m_authorizationVariant;
+
+        //! Check the request against rateLimiter()
+        /*!
+         * @return False if the request was rejected.
+         */
+        bool admitted();
+
+        //! Topic to hand off to instead of completing. Null if there is none.
+        Topic* m_topic;
+
+        //! Hand the request off to m_topic
+        void handOff();
+
+        //! Answer an authorization out of authorizationCache()
+        /*!
+         * @return True if the authorization was answered from the cache.
+         */
+        bool authorized();
+
+        //! Send a cached response with our request ID
+        void serve(const ResponseCache::Entry& entry);
+
+        //! Answer with a 304 Not Modified for a cached response
+        void notModified(const ResponseCache::Entry& entry);
+
+        //! Response served out of a cache
+        Block m_cached;
+
         //! Stream buffer for the out stream
         FcgiStreambuf<charT> m_outStreamBuffer;
 
@@ -381,7 +896,7 @@ namespace Fastcgipp
         FcgiStreambuf<charT> m_errStreamBuffer;
 
         //! Codepage
-        inline const char* codepage() const;
+        static inline const char* codepage();
     };
 }
 
@@ -0,0 +1,184 @@
+/*!
+ * @file       responsecache.hpp
+ * @brief      Declares the ResponseCache class
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 15, 2026
+ * @copyright  Copyright &copy; 2026 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2026 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#ifndef FASTCGIPP_RESPONSECACHE_HPP
+#define FASTCGIPP_RESPONSECACHE_HPP
+
+#include <chrono>
+#include <ctime>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "fastcgi++/protocol.hpp"
+
+//! Topmost namespace for the fastcgi++ library
+namespace Fastcgipp
+{
+    //! In-process cache of complete responses
+    /*!
+     * Responses are kept as the exact FastCGI records that were sent for
+     * them, END_REQUEST included, in an immutable shared buffer. Serving one
+     * again is a single send of those records with no formatting at all. If
+     * the request ID differs from the one the records were built for, a
+     * copy is made with the IDs patched.
+     *
+     * Entries are keyed on the request URI along with an optional variant
+     * for responses that differ by more than that. They expire after their
+     * time to live and the least recently used ones are evicted once the
+     * cache grows beyond it's size limit. Everything is thread safe so a
+     * single cache can be shared by all requests.
+     *
+     * Requests use this by way of Request::cached() and Request::cache().
+     *
+     * @date    October 15, 2026
+     * @author  Eddie Carle &lt;eddie@isatec.ca&gt;
+     */
+    class ResponseCache
+    {
+    public:
+        typedef std::chrono::steady_clock Clock;
+
+        //! A single cached response
+        struct Entry
+        {
+            //! STDOUT records followed by an END_REQUEST record
+            std::shared_ptr<char> records;
+
+            //! Size of the records in bytes
+            size_t size;
+
+            //! Request ID the records were built with
+            Protocol::FcgiId fcgiId;
+
+            //! ETag of the response. Zero if it has none.
+            unsigned etag;
+
+            //! When the response was last modified. Zero if unknown.
+            std::time_t lastModified;
+
+            //! Header lines to repeat in a 304 Not Modified response
+            /*!
+             * These are the response's own ETag, Vary, Cache-Control,
+             * Expires and Content-Location headers, each with it's line
+             * break.
+             */
+            std::string validators;
+
+            //! When the entry expires
+            Clock::time_point expires;
+        };
+
+        //! Sole constructor
+        /*!
+         * @param[in] maxBytes Size limit of the cache in bytes. Responses
+         *                     larger than this are never cached.
+         */
+        ResponseCache(size_t maxBytes=64*1024*1024):
+            m_maxBytes(maxBytes),
+            m_bytes(0)
+        {}
+
+        //! Look up a response
+        /*!
+         * Expired entries are removed as they are found.
+         *
+         * @param[in] uri Request URI of the response
+         * @param[in] variant Variant of the response
+         * @return The entry or null if there is none.
+         */
+        std::shared_ptr<const Entry> find(
+                const std::string& uri,
+                const std::string& variant=std::string());
+
+        //! Add a response to the cache
+        /*!
+         * Any existing entry for the same URI and variant is replaced.
+         *
+         * @param[in] uri Request URI of the response
+         * @param[in] variant Variant of the response
+         * @param[in] entry The response itself
+         */
+        void insert(
+                const std::string& uri,
+                const std::string& variant,
+                std::shared_ptr<const Entry>&& entry);
+
+        //! Invalidate every variant of a response
+        /*!
+         * @param[in] uri Request URI of the response
+         */
+        void erase(const std::string& uri);
+
+        //! Invalidate every response
+        void clear();
+
+        //! Amount of responses in the cache
+        size_t size() const;
+
+        //! Bytes taken up by the responses in the cache
+        size_t bytes() const;
+
+    private:
+        //! A cache entry along with it's key
+        struct Item
+        {
+            std::string key;
+            std::shared_ptr<const Entry> entry;
+        };
+
+        //! Items in order of use. Most recently used first.
+        std::list<Item> m_items;
+
+        typedef std::map<std::string, std::list<Item>::iterator> Index;
+
+        //! Index of items by key
+        Index m_index;
+
+        //! Size limit of the cache in bytes
+        const size_t m_maxBytes;
+
+        //! Bytes taken up by the items
+        size_t m_bytes;
+
+        //! Thread safe all of the above
+        mutable std::mutex m_mutex;
+
+        //! Build a key from a URI and a variant
+        static std::string key(
+                const std::string& uri,
+                const std::string& variant);
+
+        //! Remove an item. The mutex must be locked.
+        void remove(Index::iterator index);
+    };
+}
+
+#endif
@@ -0,0 +1,331 @@
+/*!
+ * @file       router.hpp
+ * @brief      Declares the Router class
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 15, 2026
+ * @copyright  Copyright &copy; 2026 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2026 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#ifndef FASTCGIPP_ROUTER_HPP
+#define FASTCGIPP_ROUTER_HPP
+
+#include <array>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "fastcgi++/manager.hpp"
+
+//! Topmost namespace for the fastcgi++ library
+namespace Fastcgipp
+{
+    //! What a Router matched a request against
+    /*!
+     * This is handed to the constructor of the request type a route was
+     * added with should it have one taking a `const Route&`. The captured
+     * values point into the raw parameter records of the request so they
+     * are only valid during that constructor.
+     *
+     * @date    October 15, 2026
+     * @author  Eddie Carle &lt;eddie@isatec.ca&gt;
+     */
+    class Route
+    {
+    public:
+        //! Most parameters a single route can capture
+        static const size_t maxCaptures = 8;
+
+        //! Request method of the request
+        Http::RequestMethod method() const
+        {
+            return m_method;
+        }
+
+        //! Amount of captured parameters
+        size_t size() const
+        {
+            return m_size;
+        }
+
+        //! Name of a captured parameter
+        const std::string& name(size_t index) const
+        {
+            return *m_captures[index].name;
+        }
+
+        //! Percent decoded value of a captured parameter
+        std::string value(size_t index) const;
+
+        //! Percent decoded value of a captured parameter by name
+        /*!
+         * @return The value or an empty string if nothing was captured under
+         *         that name.
+         */
+        std::string value(const std::string& name) const;
+
+    private:
+        //! A captured parameter
+        struct Capture
+        {
+            //! Name of the parameter as it appears in the route
+            const std::string* name;
+
+            //! First byte of the raw value
+            const char* begin;
+
+            //! 1+ the last byte of the raw value
+            const char* end;
+        };
+
+        //! Captured parameters
+        std::array<Capture, maxCaptures> m_captures;
+
+        //! Amount of captured parameters
+        size_t m_size;
+
+        //! Request method of the request
+        Http::RequestMethod m_method;
+
+        //! Complete ID of the request
+        Protocol::RequestId m_id;
+
+        //! The role that the other side expects the request to play
+        Protocol::Role m_role;
+
+        //! Should the socket be closed upon completion
+        bool m_kill;
+
+        friend class Router;
+    };
+
+    //! Manager that picks the request type by path and method
+    /*!
+     * A Manager binds a single request type so anything serving more than
+     * a page or two ends up switching on the URI inside of response(). This
+     * instead keeps a compressed radix tree of routes and builds the request
+     * type of whatever route the request matches. Each request type thereby
+     * has it's own constructor, maximum post size and everything else.
+     *
+     * Routes are paths where a segment starting with a colon captures that
+     * segment under the name following it and a trailing segment starting
+     * with an asterisk captures the rest of the path. So `/users/:id/files/`
+     * followed by `*path` would match `/users/17/files/a/b.txt` capturing
+     * `id` as "17" and `path` as "a/b.txt". Static segments take precedence
+     * over captures. Matching is done against the path portion of
+     * REQUEST_URI without allocating.
+     *
+     * Since the path isn't known at BEGIN_REQUEST, the object made for a new
+     * request first holds on to the parameter records. Once they are
+     * complete the route is matched, the real request built, and the records
+     * handed over to it. Requests that don't match any route get a 404 Not
+     * Found, or a 405 Method Not Allowed if only the method didn't match,
+     * unless a fallback() is set. Request objects are never recycled.
+     *
+     * Add all routes before calling start(). Otherwise this is used exactly
+     * as a Manager is.
+     *
+     * @date    October 15, 2026
+     * @author  Eddie Carle &lt;eddie@isatec.ca&gt;
+     */
+    class Router: public Manager_base
+    {
+    public:
+        //! Sole constructor
+        /*!
+         * @param[in] threads Number of threads to use for request handling
+         */
+        Router(unsigned threads = std::thread::hardware_concurrency());
+
+        ~Router();
+
+        //! Serve any method on a route with a request type
+        /*!
+         * @param[in] route Path with optional captures as described above.
+         * @return False if the route is malformed or conflicts with one
+         *         already added.
+         * @tparam RequestT A class type derived from Request. If it is
+         *                  constructible from a `const Route&` that is used,
+         *                  otherwise the default constructor.
+         */
+        template<class RequestT>
+        bool route(const std::string& route)
+        {
+            return add(
+                    Http::RequestMethod::ERROR,
+                    route,
+                    &Router::build<RequestT>);
+        }
+
+        //! Serve a single method on a route with a request type
+        /*!
+         * A route for GET also serves HEAD unless HEAD has one of it's own.
+         *
+         * @param[in] method Request method to serve
+         * @param[in] route Path with optional captures as described above.
+         * @return False if the route is malformed or conflicts with one
+         *         already added.
+         * @tparam RequestT A class type derived from Request.
+         */
+        template<class RequestT>
+        bool route(Http::RequestMethod method, const std::string& route)
+        {
+            return add(method, route, &Router::build<RequestT>);
+        }
+
+        //! Serve anything that doesn't match a route with a request type
+        template<class RequestT>
+        void fallback()
+        {
+            m_fallback = &Router::build<RequestT>;
+        }
+
+        //! Match a path against the routes
+        /*!
+         * This is what is used for every request but is exposed mostly for
+         * testing.
+         *
+         * @param[in] method Request method
+         * @param[in] path First byte of the path
+         * @param[in] end 1+ the last byte of the path
+         * @param[out] route Captures of the matching route
+         * @return True if a route matched both the path and method.
+         */
+        bool match(
+                Http::RequestMethod method,
+                const char* path,
+                const char* end,
+                Route& route) const;
+
+    private:
+        //! Builds and configures a request
+        typedef std::unique_ptr<Request_base> (Router::*Factory)(
+                const Route&);
+
+        //! A node in the radix tree
+        struct Node;
+
+        //! Holds onto records until the route of a request is known
+        class Dispatch;
+
+        //! Root of the radix tree
+        std::unique_ptr<Node> m_root;
+
+        //! Factory for requests that don't match a route
+        Factory m_fallback;
+
+        //! Add a route to the tree
+        bool add(
+                Http::RequestMethod method,
+                const std::string& route,
+                Factory factory);
+
+        //! Find the factory for a request
+        /*!
+         * @param[in] node Node the path continues from
+         * @param[out] route Captures of the matching route
+         * @param[in] path First byte of the path
+         * @param[in] end 1+ the last byte of the path
+         * @param[out] allowed If only the method didn't match, a bit is set
+         *                     for each RequestMethod the path can be had with.
+         * @return Factory of the matching route or null.
+         */
+        Factory find(
+                const Node& node,
+                Route& route,
+                const char* path,
+                const char* end,
+                unsigned& allowed) const;
+
+        //! Pick and build the request for a Dispatch
+        std::unique_ptr<Request_base> dispatch(
+                Route& route,
+                const char* uri,
+                const char* uriEnd);
+
+        //! Build a request that just returns an HTTP status
+        std::unique_ptr<Request_base> status(
+                const Route& route,
+                unsigned allowed);
+
+        //! Construct a request from a route
+        template<class RequestT>
+        static RequestT* construct(const Route& route, std::true_type)
+        {
+            return new RequestT(route);
+        }
+
+        //! Construct a request without a route
+        template<class RequestT>
+        static RequestT* construct(const Route& route, std::false_type)
+        {
+            return new RequestT;
+        }
+
+        //! Build and configure a request of a certain type
+        template<class RequestT>
+        std::unique_ptr<Request_base> build(const Route& route)
+        {
+            return configure(std::unique_ptr<RequestT>(construct<RequestT>(
+                            route,
+                            std::is_constructible<RequestT, const Route&>())),
+                    route);
+        }
+
+        //! Configure a newly constructed request
+        template<class RequestT>
+        std::unique_ptr<Request_base> configure(
+                std::unique_ptr<RequestT>&& request,
+                const Route& route)
+        {
+            using namespace std::placeholders;
+
+            request->configure(
+                    route.m_id,
+                    route.m_role,
+                    route.m_kill,
+                    std::bind(&Transceiver::send, &m_transceiver, _1, _2, _3),
+                    std::bind(
+                        &Transceiver::sendFile,
+                        &m_transceiver,
+                        _1,
+                        _2,
+                        _3,
+                        _4,
+                        _5),
+                    std::bind(&Manager_base::push, this, route.m_id, _1));
+            request->deadline(m_transceiver.timers(), m_requestTimeout);
+            return std::move(request);
+        }
+
+        std::unique_ptr<Request_base> makeRequest(
+                const Protocol::RequestId& id,
+                const Protocol::Role& role,
+                bool kill);
+
+        void recycle(std::unique_ptr<Request_base>&& request)
+        {}
+    };
+}
+
+#endif
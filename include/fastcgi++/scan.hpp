@@ -0,0 +1,124 @@
+/*!
+ * @file       scan.hpp
+ * @brief      Declares vectorized byte scanning functions
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 14, 2026
+ * @copyright  Copyright &copy; 2026 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2026 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#ifndef FASTCGIPP_SCAN_HPP
+#define FASTCGIPP_SCAN_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+//! Topmost namespace for the fastcgi++ library
+namespace Fastcgipp
+{
+    //! Vectorized searching of byte ranges
+    /*!
+     * These functions back the hot loops of the HTTP parsing and output
+     * encoding code. The actual implementation is chosen once at runtime
+     * based on what the CPU supports so the library itself can be built for a
+     * generic target. On x86 that means AVX2 when available and SSE2
+     * otherwise (findAny() needs SSSE3), NEON on ARM and plain scalar code
+     * anywhere else.
+     */
+    namespace Scan
+    {
+        //! Find the first occurrence of a byte sequence
+        /*!
+         * @param[in] start First byte to search
+         * @param[in] end +1 the last byte to search
+         * @param[in] needle Sequence to search for
+         * @param[in] size Size of the sequence
+         * @return Pointer to the first byte of the match or end if not found.
+         */
+        const char* find(
+                const char* start,
+                const char* end,
+                const char* needle,
+                size_t size);
+
+        //! Find the first occurrence of either of two bytes
+        /*!
+         * @param[in] start First byte to search
+         * @param[in] end +1 the last byte to search
+         * @param[in] first First byte to look for
+         * @param[in] second Second byte to look for
+         * @return Pointer to the first match or end if not found.
+         */
+        const char* findEither(
+                const char* start,
+                const char* end,
+                char first,
+                char second);
+
+        //! A set of ASCII characters that can be searched for in bulk
+        /*!
+         * Membership is stored as a bitmap indexed by the low nibble of a
+         * character with one bit per high nibble. That is exactly what a
+         * byte shuffle needs to classify a whole register of characters at
+         * once. Bytes outside of ASCII are never members.
+         */
+        struct Set
+        {
+            //! Bit n of bitmap[x] is set if (n<<4)|x is a member
+            uint8_t bitmap[16];
+
+            //! Build a set out of a membership predicate
+            template<class Predicate>
+            constexpr explicit Set(Predicate predicate):
+                bitmap{}
+            {
+                for(unsigned character=0; character<0x80; ++character)
+                    if(predicate(static_cast<unsigned char>(character)))
+                        bitmap[character&0xf] |= 1 << (character>>4);
+            }
+
+            //! True if the character is a member
+            constexpr bool contains(unsigned char character) const
+            {
+                return character<0x80
+                    && (bitmap[character&0xf]>>(character>>4)) & 1;
+            }
+        };
+
+        //! Find the first byte that is a member of a set
+        /*!
+         * @param[in] start First byte to search
+         * @param[in] end +1 the last byte to search
+         * @param[in] set Set of bytes to look for
+         * @return Pointer to the first match or end if not found.
+         */
+        const char* findAny(
+                const char* start,
+                const char* end,
+                const Set& set);
+
+        //! Name of the implementation chosen at runtime
+        const char* implementation();
+    }
+}
+
+#endif
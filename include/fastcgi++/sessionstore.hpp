@@ -0,0 +1,183 @@
+/*!
+ * @file       sessionstore.hpp
+ * @brief      Declares the SharedSessionStore class
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 14, 2026
+ * @copyright  Copyright &copy; 2026 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2026 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#ifndef FASTCGIPP_SESSIONSTORE_HPP
+#define FASTCGIPP_SESSIONSTORE_HPP
+
+#include <string>
+#include <ctime>
+#include <cstdint>
+#include <chrono>
+
+#include "fastcgi++/http.hpp"
+
+//! Topmost namespace for the fastcgi++ library
+namespace Fastcgipp
+{
+    namespace Http
+    {
+        //! Session storage in shared memory for all processes on a host
+        /*!
+         * Every process constructing a SharedSessionStore with the same name
+         * maps the same table of sessions so a session generated by one
+         * process is immediately available to all the others without any
+         * network round trip.
+         *
+         * The table has a fixed amount of fixed size slots. Each session can
+         * live in one of a handful of slots determined by its ID. Reads are
+         * lock free, being validated by a per slot sequence number that
+         * writers increment before and after modifying the slot. Should a
+         * process die in the middle of writing to a slot, the next one to
+         * wait on it notices and empties the slot. Expired
+         * sessions are simply overwritten by new ones and should the table
+         * fill up, the least recently used session among the candidate slots
+         * is evicted.
+         *
+         * All processes sharing a store need to agree on the table geometry.
+         *
+         * @date    October 14, 2026
+         * @author  Eddie Carle &lt;eddie@isatec.ca&gt;
+         */
+        class SharedSessionStore: public SessionStore
+        {
+        public:
+            //! Map the shared memory table
+            /*!
+             * The table is created if it doesn't already exist.
+             *
+             * @param[in] name Name of the shared memory object. It should
+             *                 start with a slash.
+             * @param[in] slots Amount of sessions the table can hold.
+             * @param[in] slotSize Maximum size in bytes of serialized session
+             *                     data.
+             */
+            SharedSessionStore(
+                    const std::string& name,
+                    size_t slots=65536,
+                    size_t slotSize=448);
+
+            ~SharedSessionStore();
+
+            bool insert(
+                    const SessionId& id,
+                    const std::string& data,
+                    std::time_t now);
+
+            bool fetch(
+                    const SessionId& id,
+                    std::time_t oldest,
+                    std::time_t now,
+                    std::string* data);
+
+            void erase(const SessionId& id);
+
+            //! Remove a shared memory table from the system
+            /*!
+             * Processes that already have it mapped keep using it.
+             *
+             * @param[in] name Name of the shared memory object.
+             * @return True on success.
+             */
+            static bool remove(const std::string& name);
+
+        private:
+            struct Header;
+            struct Slot;
+
+            //! How many slots a single session can live in
+            static const size_t probes = 8;
+
+            //! Amount of slots in the table
+            const size_t m_slots;
+
+            //! Maximum size of serialized session data
+            const size_t m_slotSize;
+
+            //! Size in bytes of a slot including it's data
+            const size_t m_stride;
+
+            //! Size in bytes of the entire mapping
+            const size_t m_length;
+
+            //! The mapped memory
+            unsigned char* m_memory;
+
+            //! Get a slot by index
+            inline Slot& slot(size_t index) const;
+
+            //! Index of the first slot a session can live in
+            inline size_t home(const SessionId& id) const;
+
+            //! Read a consistent snapshot of a slot
+            /*!
+             * @param[in] slot Slot to read
+             * @param[in] id Session ID to compare the slot's against
+             * @param[out] match Set to true if the slot holds the session
+             * @param[out] data If not null and the slot holds the session,
+             *                  the session data is stored here.
+             * @return The slot's last access time
+             */
+            inline int64_t read(
+                    const Slot& slot,
+                    const SessionId& id,
+                    bool& match,
+                    std::string* data) const;
+
+            //! Lock a slot for writing
+            inline static void lock(Slot& slot);
+
+            //! Unlock a slot locked for writing
+            inline static void unlock(Slot& slot);
+
+            //! The lock on a slot we are waiting on
+            struct Stuck
+            {
+                //! Value of the lock
+                uint64_t word=0;
+
+                //! When we first saw this value
+                std::chrono::steady_clock::time_point since;
+            };
+
+            //! Wait a moment on a locked slot
+            /*!
+             * If the process holding the lock is gone, or has held it far
+             * longer than any write could take, the lock is taken over and
+             * the slot emptied.
+             *
+             * @param[in] slot Slot to wait on
+             * @param[in] word Value of the lock as seen locked
+             * @param[in,out] stuck What we have been waiting on so far
+             * @return True if we took over the lock.
+             */
+            static bool wait(Slot& slot, uint64_t word, Stuck& stuck);
+        };
+    }
+}
+
+#endif
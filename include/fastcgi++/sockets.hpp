@@ -30,14 +30,20 @@
 #define FASTCGIPP_SOCKETS_HPP
 
 #include <memory>
-#include <map>
 #include <mutex>
 #include <set>
 #include <atomic>
 #include <deque>
+#include <vector>
 #include <string>
+#include <functional>
+#include <cstdint>
+
+#include <sys/uio.h>
+#include <sys/types.h>
 
 #include "fastcgi++/poll.hpp"
+#include "fastcgi++/timers.hpp"
 
 //! Topmost namespace for the fastcgi++ library
 namespace Fastcgipp
@@ -65,6 +71,9 @@ namespace Fastcgipp
         //! Our respective SocketGroup needs private access.
         friend class SocketGroup;
 
+        //! The Transceiver keeps track of what is queued up on us
+        friend class Transceiver;
+
         //! Data structure to hold the shared socket data.
         struct Data
         {
@@ -81,9 +90,19 @@ namespace Fastcgipp
              */
             bool m_closing;
 
+            //! Indicates whether or not the last write was incomplete
+            /*!
+             * While this is true the socket is polled for writability and
+             * further writes are pointless.
+             */
+            bool m_blocked;
+
             //! SocketGroup object this socket is tied to.
             SocketGroup& m_group;
 
+            //! Bytes queued up by the Transceiver for transmission
+            std::atomic_size_t m_queued;
+
             //! Sole constructor
             /*!
              * @param [inout] socket The OS level socket identifier to associate
@@ -101,7 +120,9 @@ namespace Fastcgipp
                 m_socket(socket),
                 m_valid(valid),
                 m_closing(false),
-                m_group(group)
+                m_blocked(false),
+                m_group(group),
+                m_queued(0)
             {}
 
             Data() =delete;
@@ -133,6 +154,16 @@ namespace Fastcgipp
                 SocketGroup& group,
                 bool valid=true);
 
+        //! Account for bytes queued up for transmission on us
+        /*!
+         * Our group keeps count of the bytes queued up on all it's sockets
+         * as well.
+         */
+        void enqueued(size_t bytes) const;
+
+        //! Account for queued bytes that are gone
+        void dequeued(size_t bytes) const;
+
     public:
         //! Try and read a chunk of data out of the socket.
         /*!
@@ -170,6 +201,9 @@ namespace Fastcgipp
          * read(). The socket will not be automatically shut down until said
          * data is read.
          *
+         * If not all the data could be written the socket is marked as
+         * blocked() until SocketGroup::poll() sees it become writable again.
+         *
          * @param [out] buffer Pointer to memory location to which data should
          *                     be written from.
          * @param [in] size Maximum amount of data to write from the buffer.
@@ -178,6 +212,39 @@ namespace Fastcgipp
          */
         ssize_t write(const char* buffer, size_t size) const;
 
+        //! Try and write a set of chunks of data into the socket.
+        /*!
+         * This behaves exactly like write(const char*, size_t) except the
+         * data is gathered from multiple buffers in a single system call.
+         *
+         * @param [in] buffers Array of buffers to write the data from in
+         *                     order.
+         * @param [in] count Number of buffers in the array.
+         * @return Actual number of bytes written from the buffers. A -1 means
+         *         you can't actually write data to the socket anymore.
+         */
+        ssize_t write(const iovec* buffers, size_t count) const;
+
+        //! Try and write a chunk of a file into the socket.
+        /*!
+         * This behaves exactly like write(const char*, size_t) except the
+         * data comes straight out of a file descriptor. On Linux this is by
+         * way of sendfile() so it never passes through userspace. Elsewhere
+         * it is read into a buffer a chunk at a time.
+         *
+         * Should the file end before the requested amount of data has been
+         * written the socket is closed because whatever the other side was
+         * promised can no longer be delivered.
+         *
+         * @param [in] file File descriptor to write the data from.
+         * @param [in,out] offset Offset into the file to start at. This is
+         *                        advanced by the amount of data written.
+         * @param [in] size Maximum amount of data to write from the file.
+         * @return Actual number of bytes written from the file. A -1 means
+         *         you can't actually write data to the socket anymore.
+         */
+        ssize_t write(int file, off_t& offset, size_t size) const;
+
         //! We need this to allow the socket objects to be in sorted containers.
         inline bool operator<(const Socket& x) const noexcept
         {
@@ -217,16 +284,53 @@ namespace Fastcgipp
          * into containers. The source socket has it's originality stripped and
          * moved to the destination.
          */
-        Socket(Socket&& x):
+        Socket(Socket&& x) noexcept:
             m_data(x.m_data),
             m_original(x.m_original)
         {
             x.m_original=false;
         }
 
+        //! Move assignment
+        /*!
+         * Like the move constructor this carries originality over from the
+         * source. If we were an original ourselves the socket we used to
+         * represent is torn down exactly as if we had been destroyed.
+         */
+        Socket& operator=(Socket&& x) noexcept
+        {
+            if(this != &x)
+            {
+                const Socket old(std::move(*this));
+                m_data = x.m_data;
+                m_original = x.m_original;
+                x.m_original = false;
+            }
+            return *this;
+        }
+
         //! Calls close() on the socket if we are destructing the original
         ~Socket();
 
+        //! Returns true if the last write could not be completed
+        /*!
+         * This stays true until the socket becomes writable again. At that
+         * point SocketGroup::poll() clears it and returns early.
+         */
+        bool blocked() const
+        {
+            return m_data && m_data->m_blocked;
+        }
+
+        //! Bytes queued up for transmission that haven't been sent yet
+        /*!
+         * This can be called from any thread.
+         */
+        size_t queued() const
+        {
+            return m_data ? m_data->m_queued.load() : 0;
+        }
+
         //! Returns true if this socket is still open and capable of read/write.
         bool valid() const
         {
@@ -245,6 +349,22 @@ namespace Fastcgipp
          */
         void close() const;
 
+        //! Hash value suitable for spreading sockets over buckets
+        size_t hash() const noexcept
+        {
+            uint64_t x = reinterpret_cast<uintptr_t>(m_data.get());
+            x ^= x >> 33;
+            x *= 0xff51afd7ed558ccdULL;
+            x ^= x >> 33;
+            return x;
+        }
+
+        //! Returns true if this socket was created by the specified group
+        bool member(const SocketGroup& group) const
+        {
+            return m_data && &m_data->m_group == &group;
+        }
+
         //! Creates an invalid socket with no original.
         Socket();
     };
@@ -316,6 +436,61 @@ namespace Fastcgipp
                 const char* interface,
                 const char* service);
 
+        //! Wait for a new process to hand our listeners off to
+        /*!
+         * This is the old process's half of a hot restart. A named socket is
+         * set up and polled alongside the listeners. Once a new process
+         * connects to it with inherit(), every listener is sent over with
+         * SCM_RIGHTS and closed on our end. From then on new connections go
+         * to the new process while we keep serving the ones we already have.
+         *
+         * The named socket is only accessible to our own user and anything
+         * connecting to it as another user is turned away.
+         *
+         * Named sockets we were listening on aren't removed when we are done
+         * with them as they now belong to the new process.
+         *
+         * @param [in] name Name of socket (path in Unix world).
+         * @param [in] callback Called from poll() once the listeners have
+         *                      been handed off. This is typically where
+         *                      stopping gets started.
+         * @return True on success. False on failure.
+         */
+        bool handOff(
+                const char* name,
+                const std::function<void()>& callback = nullptr);
+
+        //! Take over the listeners of an old process
+        /*!
+         * This is the new process's half of a hot restart. It connects to the
+         * named socket given to handOff() in the old process and listens on
+         * everything the old process was listening on. Connections are never
+         * refused in between as the listen sockets themselves never close.
+         *
+         * @param [in] name Name of socket (path in Unix world).
+         * @return True if any listeners were taken over. If not, just
+         *         listen() as usual.
+         */
+        bool inherit(const char* name);
+
+        //! Listen on a socket that is already listening
+        /*!
+         * This is for listen sockets set up by a parent process before
+         * forking, see Prefork. Listen sockets are only ever closed, never
+         * shutdown, so other processes sharing it aren't affected when we
+         * are done with it.
+         *
+         * @param [in] listener OS level socket identifier of the listener.
+         * @return True on success. False on failure.
+         */
+        bool inherit(const socket_t listener);
+
+        //! The sockets we listen for connections on
+        const std::set<socket_t>& listeners() const
+        {
+            return m_listeners;
+        }
+
         //! Connect to a named socket
         /*!
          * Connect to a named socket. In the Unix world this would be a path.
@@ -358,6 +533,10 @@ namespace Fastcgipp
          *    return the socket.
          *  - If the call has been set to non-blocking and no new data awaits, a
          *    generic invalid socket is returned.
+         *  - If a blocked() socket has become writable, it is unblocked and
+         *    the call returns early with a generic invalid socket.
+         *  - If any timers() are due, they are expired and the call returns
+         *    early with a generic invalid socket.
          *
          * This function can be either blocking or non-blocking depending on the
          * boolean value passed to it. If the call is blocking it can be awoken
@@ -381,10 +560,47 @@ namespace Fastcgipp
          */
         void wake();
 
+        //! Timers expired by the poll() thread
+        /*!
+         * Timer functions are called from within poll() so they are free to
+         * touch the sockets of the group.
+         */
+        Timers& timers()
+        {
+            return m_timers;
+        }
+
+        //! Stop or resume reading from all our sockets
+        /*!
+         * While paused, poll() only reports errors and hang ups on our
+         * sockets and whether blocked ones have become writable. Data
+         * simply waits in the OS buffers until we resume. This is how a
+         * loop pushes back on the other side once it has too much to deal
+         * with.
+         *
+         * @param [in] status True to pause. False to resume.
+         */
+        void pause(bool status);
+
+        //! True if reading from our sockets is paused
+        bool paused() const
+        {
+            return m_paused;
+        }
+
+        //! Bytes queued up for transmission on all our sockets
+        /*!
+         * This can be called from any thread.
+         */
+        size_t queued() const
+        {
+            return m_queued;
+        }
+
         //! How many active sockets (not counting listeners) are in the group
         size_t size() const
         {
-            return m_sockets.size();
+            return m_size;
         }
 
         //! Should we accept new connections?
@@ -404,6 +620,42 @@ namespace Fastcgipp
             m_reuse = value;
         }
 
+        //! Share accepted connections with other groups
+        /*!
+         * Once this is called, connections accepted on our listeners will be
+         * handed off round-robin between ourselves and the passed groups. The
+         * passed groups take full ownership over any connection given to them
+         * and will poll for it themselves. Passing an empty container disables
+         * distribution.
+         *
+         * If we're a dedicated acceptor we keep none of the connections for
+         * ourselves and they all go round-robin to the passed groups. This
+         * way a storm of new connections can't hold up the I/O of established
+         * ones.
+         *
+         * This should only be called while no thread is in poll() for any of
+         * the groups involved.
+         *
+         * @param [in] groups Groups to distribute accepted connections to.
+         * @param [in] dedicated True if we should only accept connections
+         *                       and not handle any of them ourselves. This is
+         *                       ignored if groups is empty.
+         */
+        void distribute(
+                const std::vector<SocketGroup*>& groups,
+                bool dedicated=false);
+
+        //! Take ownership of an already accepted connection
+        /*!
+         * The socket is queued up and added to our polling set the next time
+         * poll() is called. This function is thread safe and is intended to
+         * be called from the poll() thread of another group.
+         *
+         * @param [in] socket OS level socket identifier of the connection.
+         *                    It must already be set non-blocking.
+         */
+        void adopt(const socket_t socket);
+
     private:
         //! Our sockets need access to our private data
         friend class Socket;
@@ -414,11 +666,22 @@ namespace Fastcgipp
         //! Our poll object
         Poll m_poll;
 
+        //! Timers expired by poll()
+        Timers m_timers;
+
         //! A pair of sockets for wakeup purposes
+        /*!
+         * On Linux this is a single eventfd so both elements are the same.
+         * Wakes are written into the first and read out of the second.
+         */
         socket_t m_wakeSockets[2];
 
         //! Set to true while there is a pending wake
-        bool m_waking;
+        /*!
+         * This lets any number of wake() calls between two polls get away
+         * with a single write into the wakeup socket.
+         */
+        std::atomic_bool m_waking;
 
         //! Set to true to reuse address
         bool m_reuse;
@@ -429,37 +692,84 @@ namespace Fastcgipp
         //! Set to true if we should refresh the listeners in the poll
         std::atomic_bool m_refreshListeners;
 
-        //! We need this mutex to thread safe the wake() function.
-        std::mutex m_wakingMutex;
+        //! We need this mutex to thread safe the adoptees.
+        std::mutex m_adopteesMutex;
+
+        //! All the sockets indexed by their OS level identifier
+        /*!
+         * The OS hands out the lowest free identifiers first so this stays
+         * dense. Vacant slots hold invalid sockets.
+         */
+        std::vector<Socket> m_sockets;
+
+        //! How many valid sockets there are in m_sockets
+        size_t m_size;
+
+        //! True if we've stopped polling our sockets for readability
+        bool m_paused;
+
+        //! Bytes queued up by the Transceiver for transmission on our sockets
+        std::atomic_size_t m_queued;
+
+        //! Groups we hand off accepted connections to
+        std::vector<SocketGroup*> m_groups;
 
-        //! All the sockets
-        std::map<socket_t, Socket> m_sockets;
+        //! Index of the next group to hand a connection to
+        size_t m_nextGroup;
 
-        //! Accept a new connection and create it's socket
-        inline void createSocket(const socket_t listener);
+        //! True if we hand every accepted connection to another group
+        bool m_dedicated;
+
+        //! True if other groups may hand connections to us
+        bool m_adoptive;
+
+        //! Connections handed to us that are waiting to be polled
+        std::deque<socket_t> m_adoptees;
+
+        //! Mark a socket as blocked and start polling for it's writability
+        inline void block(Socket::Data& data);
+
+        //! Maximum number of connections accepted per listener readiness
+        /*!
+         * Anything left over is picked up on the next poll so a flood of new
+         * connections can't starve the established ones.
+         */
+        static const unsigned acceptBatch = 64;
+
+        //! Accept pending connections and create their sockets
+        inline void createSockets(const socket_t listener);
+
+        //! Create a socket for a connection and add it to m_sockets
+        /*!
+         * @param [in] socket OS level socket identifier of the connection.
+         * @return The new socket. It is invalid if it couldn't be polled.
+         */
+        Socket insert(const socket_t socket);
+
+        //! Remove a socket from m_sockets
+        inline void erase(const socket_t socket);
 
         //! Filenames to cleanup when we're done
         std::deque<std::string> m_filenames;
 
-#if FASTCGIPP_LOG_LEVEL > 3
-        //! Debug counter for incoming connections
-        std::atomic_ullong m_incomingConnectionCount;
-
-        //! Debug counter for outgoing connections
-        std::atomic_ullong m_outgoingConnectionCount;
+        //! Socket a new process connects to for our listeners. -1 if none.
+        socket_t m_handOffListener;
 
-        //! Debug counter for locally killed sockets
-        std::atomic_ullong m_connectionKillCount;
+        //! Name of the hand off socket
+        std::string m_handOffName;
 
-        //! Debug counter for remotely hung up sockets
-        std::atomic_ullong m_connectionRDHupCount;
+        //! Called once the listeners have been handed off
+        std::function<void()> m_handedOff;
 
-        //! Debug counter for bytes sent
-        std::atomic_ullong m_bytesSent;
+        //! Most listeners that can be handed off
+        /*!
+         * This is the limit Linux puts on descriptors passed in a single
+         * message.
+         */
+        static const unsigned maxHandOff = 253;
 
-        //! Debug counter for bytes received
-        std::atomic_ullong m_bytesReceived;
-#endif
+        //! Hand our listeners off to a new process that connected
+        inline void handOff();
     };
 }
 
@@ -31,15 +31,20 @@
 
 #include <deque>
 #include <map>
+#include <unordered_map>
+#include <string>
 #include <functional>
 #include <atomic>
 #include <mutex>
 #include <thread>
+#include <chrono>
 
 #include "fastcgi++/sockets.hpp"
 #include "fastcgi++/message.hpp"
+#include "fastcgi++/cpuset.hpp"
 #include "fastcgi++/sql/parameters.hpp"
 #include "fastcgi++/sql/results.hpp"
+#include "fastcgi++/sql/copy.hpp"
 
 //! Topmost namespace for the fastcgi++ library
 namespace Fastcgipp
@@ -61,6 +66,39 @@ namespace Fastcgipp
 
             //! Callback function to call when query is complete
             std::function<void(Message)> callback;
+
+            //! Rows to send if the statement is a COPY FROM STDIN
+            /*!
+             * Such statements are never prepared. On a connection in
+             * pipeline mode the query waits for the pipeline to drain, as
+             * COPY can't be pipelined.
+             */
+            std::shared_ptr<Copy_base> copy;
+
+            //! Rows per batch to stream the results in
+            /*!
+             * If this isn't zero the results must be a StreamResults and are
+             * delivered in batches of this many rows while the query is still
+             * running. Just like with copies, on a connection in pipeline mode
+             * the query waits for the pipeline to drain.
+             */
+            unsigned batch=0;
+
+            //! Priority of the query with zero being the highest
+            /*!
+             * Queued queries are always sent in order of priority. Anything
+             * beyond Connection::priorities-1 is treated as the lowest
+             * priority.
+             */
+            unsigned priority=0;
+
+            //! Drop the query if it hasn't been sent by this time
+            /*!
+             * A dropped query still has it's callback called but the status
+             * of it's results will be Status::expired. Leave this at its
+             * default to never drop the query.
+             */
+            std::chrono::steady_clock::time_point deadline;
         };
 
         //! Handles low level communication with "the other side"
@@ -73,6 +111,12 @@ namespace Fastcgipp
          *
          * Queue up queries with queue().
          *
+         * Statements are automatically prepared on each backend connection
+         * the first time they are run on it and then executed by name from
+         * there on. Statements are looked up by their address and verified
+         * by their text so string literals work best. A statement should
+         * always be given the same parameter types.
+         *
          * @date    October 7, 2018
          * @author  Eddie Carle &lt;eddie@isatec.ca&gt;
          */
@@ -111,6 +155,42 @@ namespace Fastcgipp
             //! Queue up a query
             bool queue(const Query& query);
 
+            //! Call before start to pin the handler() thread to CPUs
+            /*!
+             * @param[in] cpus CPUs to run the handler() thread on. Empty for
+             *                 anywhere (default).
+             */
+            void cpus(const CpuSet& cpus)
+            {
+                m_cpus = cpus;
+            }
+
+            //! How many priority lanes are there for queries?
+            static const unsigned priorities = 4;
+
+            //! Let the connection pool grow and shrink
+            /*!
+             * By default the pool stays at the concurrency given to init().
+             * Calling this lets the pool grow up to maximum connections
+             * whenever more queries are queued than there are connections or
+             * a queued query has waited too long. Connections beyond the
+             * initial concurrency are closed once they have been idle for
+             * too long.
+             *
+             * This must be called after init() and before start().
+             *
+             * @param [in] maximum Largest the pool can grow to.
+             * @param [in] idleTimeout Seconds before an idle connection
+             *                         beyond the initial concurrency is
+             *                         closed.
+             * @param [in] growDelay Milliseconds a query can wait in the
+             *                       queue before we open another connection.
+             */
+            void pool(
+                    unsigned maximum,
+                    unsigned idleTimeout=60,
+                    unsigned growDelay=10);
+
             //! Initialize the connection
             /*!
              * Note that this function can only be called _once_.
@@ -125,6 +205,12 @@ namespace Fastcgipp
              * @param [in] messageType Type value for Message sent via callback.
              * @param [in] retryInterval How many seconds before retrying a bad
              *                           connection to the SQL server?
+             * @param [in] pipeline How many queries can be in flight on each
+             *                      connection. Anything above one puts the
+             *                      connections in pipeline mode so queued
+             *                      queries are streamed to the server without
+             *                      waiting on the results of earlier ones.
+             *                      This requires libpq 14 or later.
              */
             void init(
                     const char* host,
@@ -134,14 +220,34 @@ namespace Fastcgipp
                     const unsigned concurrency=1,
                     const unsigned short port=5432,
                     int messageType=5432,
-                    unsigned retryInterval=30);
+                    unsigned retryInterval=30,
+                    unsigned pipeline=1);
 
             ~Connection();
 
             Connection():
-                m_initialized(false)
+                m_initialized(false),
+                m_queued(0),
+                m_statementHits(0),
+                m_statementMisses(0)
             {}
 
+            //! How many queries were run with an already prepared statement?
+            unsigned long long statementHits() const
+            {
+                return m_statementHits;
+            }
+
+            //! How many queries needed their statement prepared first?
+            /*!
+             * This includes queries run unprepared because the statement
+             * cache was full or preparing the statement failed.
+             */
+            unsigned long long statementMisses() const
+            {
+                return m_statementMisses;
+            }
+
         private:
             //! General connection handler
             void handler();
@@ -152,33 +258,217 @@ namespace Fastcgipp
             //! Call this to initiate all connections with the server
             void connect();
 
+            //! Open one more connection with the server
+            /*!
+             * @return True on success.
+             */
+            bool open();
+
             //! Are we fully connected?
             bool connected()
             {
-                return m_connections.size() == m_concurrency;
+                return m_connections.size() >= m_concurrency;
             }
 
+            //! Take the highest priority query from the queue
+            /*!
+             * Queries found to be past their deadline are moved into
+             * m_expired along the way.
+             *
+             * @param[out] query Query taken from the queue.
+             * @return False if no query was queued.
+             */
+            bool take(Query& query);
+
+            //! Call the callbacks of the queries in m_expired
+            void expire();
+
+            //! Are queries backing up enough to grow the pool?
+            bool backedUp(std::chrono::steady_clock::time_point now);
+
             //! True if we're initialized
             bool m_initialized;
 
+            //! A command sent to the server awaiting it's results
+            struct Pending
+            {
+                enum Type
+                {
+                    PREPARE,
+                    QUERY,
+                    SYNC
+                };
+
+                //! What kind of command is this?
+                Type type;
+
+                //! The query the command is for
+                Query query;
+
+                //! Name of the statement being prepared or executed
+                std::string name;
+
+                //! True if the statement being prepared was accepted
+                bool prepared;
+
+                //! True if the query never ran due to an earlier failure
+                bool aborted;
+
+                //! True while copy data is being sent for the query
+                bool copying;
+
+                //! How much of the copy data has been sent
+                size_t copied;
+
+                //! Where to deliver batches of streamed rows
+                ResultStream_base* stream;
+
+                //! The batch of streamed rows being filled
+                void* rows;
+
+                //! How many batches were delivered already
+                unsigned batches;
+
+                Pending(Type type_, const Query& query_=Query());
+                Pending(Pending&& x);
+                Pending(const Pending&) =delete;
+                ~Pending();
+            };
+
             struct Conn
             {
-                bool idle;
                 void* connection;
-                Query query;
+
+                //! Commands awaiting results in the order they were sent
+                std::deque<Pending> pending;
+
+                //! How many queries are in flight
+                unsigned queries;
+
+                //! True if the connection is in pipeline mode
+                bool pipelined;
+
+                //! True if we are polling for writability
+                bool writing;
+
+                //! A statement prepared on this connection
+                struct Statement
+                {
+                    //! Statement text it was prepared from
+                    std::string text;
+
+                    //! Name it was prepared under. Empty if preparing it
+                    //! failed so it is sent unprepared.
+                    std::string name;
+                };
+
+                //! Prepared statements keyed by statement pointer
+                std::unordered_map<const char*, Statement> statements;
+
+                //! How many statement names have been used up
+                unsigned names;
+
+                //! Last time a query was sent or completed
+                std::chrono::steady_clock::time_point active;
             };
 
+            //! Most statements we will prepare on a single connection
+            static const size_t maxStatements = 256;
+
+            //! Most copy data we hand libpq at once
+            static const size_t chunkSize = 0x10000;
+
+            //! Flush outgoing data and poll for writability if any is left
+            /*!
+             * @param[in] connection Connection to flush.
+             * @return False on error.
+             */
+            bool flush(std::map<socket_t, Conn>::iterator& connection);
+
+            //! Send whatever copy data the connection's current query has left
+            /*!
+             * @param[in] connection Connection to send copy data on.
+             * @return False on error.
+             */
+            bool copy(std::map<socket_t, Conn>::iterator& connection);
+
+            //! Add a streamed row to the query's current batch
+            /*!
+             * @param[in] pending The query the row is for.
+             * @param[in] result Single row result set. This is freed.
+             */
+            void stream(Pending& pending, void* result);
+
+            //! Deliver the query's current batch of streamed rows
+            void deliver(Pending& pending);
+
+            //! Put a query back at the front of it's lane
+            void requeue(const Query& query);
+
+            //! Send a query to the server
+            /*!
+             * @param[in] connection Connection to send the query down.
+             * @param[in] query Query to send.
+             * @param[in] name Name of the prepared statement to execute or
+             *                 null to send the statement unprepared.
+             * @return True on success.
+             */
+            bool send(Conn& connection, const Query& query, const char* name);
+
+            //! Dispatch a query on a connection
+            /*!
+             * If the statement isn't yet prepared on this connection, this
+             * sends the prepare first. Without pipelining the query itself is
+             * then sent once the prepare completes.
+             *
+             * @param[in] connection Connection to dispatch the query on.
+             * @param[in] query Query to dispatch.
+             * @return True on success.
+             */
+            bool dispatch(Conn& connection, const Query& query);
+
+            //! Process whatever results a connection has ready
+            /*!
+             * @param[in] connection Connection to receive results on.
+             * @return False if a follow up query couldn't be sent.
+             */
+            bool receive(Conn& connection);
+
             //! Container associating sockets with their receive buffers
             std::map<socket_t, Conn> m_connections;
 
             //! Kill and destroy this specific connection
+            /*!
+             * Any queries it had in flight are put back in the queue and
+             * the iterator is moved to the next connection.
+             */
             void kill(std::map<socket_t, Conn>::iterator& conn);
 
             //! Kill and destroy everything!!
             void killAll();
 
-            //! %Buffer for transmitting data
-            std::deque<Query> m_queue;
+            //! A query waiting in the queue
+            struct Queued
+            {
+                Query query;
+
+                //! When the query was queued
+                std::chrono::steady_clock::time_point time;
+
+                Queued(const Query& query_):
+                    query(query_),
+                    time(std::chrono::steady_clock::now())
+                {}
+            };
+
+            //! Queued queries in a lane for each priority
+            std::deque<Queued> m_queue[priorities];
+
+            //! How many queries are queued in all lanes
+            std::atomic_size_t m_queued;
+
+            //! Queries dropped for being past their deadline
+            std::deque<Query> m_expired;
 
             //! True when handler() should be terminating
             std::atomic_bool m_terminate;
@@ -189,6 +479,9 @@ namespace Fastcgipp
             //! Thread our handler is running in
             std::thread m_thread;
 
+            //! CPUs to pin the handler() thread to
+            CpuSet m_cpus;
+
             //! Always practice safe threading
             std::mutex m_mutex;
 
@@ -216,11 +509,29 @@ namespace Fastcgipp
             //! How many concurrent queries shall we allow?
             unsigned m_concurrency;
 
+            //! Largest the connection pool can grow to
+            unsigned m_maxConcurrency;
+
+            //! How long before an extra connection is closed for being idle
+            std::chrono::steady_clock::duration m_idleTimeout;
+
+            //! How long a queued query waits before we grow the pool
+            std::chrono::milliseconds m_growDelay;
+
             //! Callback message type ID
             unsigned m_messageType;
 
+            //! How many queries can be in flight on each connection
+            unsigned m_pipeline;
+
             //! The poll group
             Poll m_poll;
+
+            //! Count of queries run with an already prepared statement
+            std::atomic_ullong m_statementHits;
+
+            //! Count of queries that needed their statement prepared
+            std::atomic_ullong m_statementMisses;
         };
     }
 }
@@ -0,0 +1,156 @@
+/*!
+ * @file       copy.hpp
+ * @brief      Declares %SQL bulk copy types
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 14, 2026
+ * @copyright  Copyright &copy; 2026 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2026 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#ifndef FASTCGIPP_SQL_COPY_HPP
+#define FASTCGIPP_SQL_COPY_HPP
+
+#include "fastcgi++/sql/parameters.hpp"
+
+#include <vector>
+#include <memory>
+
+//! Topmost namespace for the fastcgi++ library
+namespace Fastcgipp
+{
+    //! Contains all fastcgi++ %SQL facilities
+    namespace SQL
+    {
+        class Connection;
+
+        //! De-templated base class for Copy
+        /*!
+         * This holds the rows in the binary format of COPY FROM STDIN.
+         */
+        class Copy_base
+        {
+        protected:
+            //! The binary copy data
+            std::vector<char> m_data;
+
+            //! How many rows are in the data?
+            unsigned m_rows;
+
+            //! True once the trailer is appended
+            bool m_finished;
+
+            //! Start a new row with so many fields
+            void row(int16_t fields);
+
+            //! Append a field to the row
+            void field(const char* data, int32_t size);
+
+        public:
+            Copy_base();
+
+            //! Append the trailer to the data
+            /*!
+             * This is called by Connection::queue() and rows can no longer be
+             * added afterwards.
+             */
+            void finish();
+
+            //! Pointer to the binary copy data
+            const char* data() const
+            {
+                return m_data.data();
+            }
+
+            //! Size of the binary copy data
+            size_t size() const
+            {
+                return m_data.size();
+            }
+
+            //! How many rows are there?
+            unsigned rows() const
+            {
+                return m_rows;
+            }
+
+            virtual ~Copy_base() {}
+        };
+
+        //! Rows to bulk load into a table
+        /*!
+         * This allows inserting any amount of rows with a single query by way
+         * of a binary COPY. The rows are serialized with the same Parameter
+         * types used by Parameters so the same column types are supported.
+         *
+         * Set an instance of this as Query::copy and give the query a
+         * statement of the form
+         * <tt>COPY table (columns...) FROM STDIN (FORMAT binary)</tt>. The
+         * column list must match the types in order.
+         *
+         * @tparam Types Pack of column types.
+         * @date    October 14, 2026
+         * @author  Eddie Carle &lt;eddie@isatec.ca&gt;
+         */
+        template<typename... Types>
+        class Copy: public Copy_base
+        {
+        private:
+            //! Append a serialized parameter to the row
+            template<typename T>
+            inline void field(const Parameter<T>& x)
+            {
+                Copy_base::field(x.data(), x.size());
+            }
+
+            template<size_t... columns>
+            inline void push(
+                    const std::tuple<Types...>& row,
+                    std::index_sequence<columns...>)
+            {
+                push(std::get<columns>(row)...);
+            }
+
+        public:
+            //! Add a row
+            void push(const Types&... values)
+            {
+                row(sizeof...(Types));
+                const int expand[] = {(field(Parameter<Types>(values)), 0)...};
+                static_cast<void>(expand);
+            }
+
+            //! Add a row from a tuple
+            void push(const std::tuple<Types...>& row)
+            {
+                push(row, std::index_sequence_for<Types...>{});
+            }
+        };
+
+        template<typename... Types>
+        std::shared_ptr<Copy<Types...>> make_Copy()
+        {
+            return std::shared_ptr<Copy<Types...>>(new Copy<Types...>);
+        }
+    }
+}
+
+#endif
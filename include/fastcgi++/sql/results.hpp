@@ -33,6 +33,9 @@
 #include <string>
 #include <vector>
 #include <chrono>
+#include <deque>
+#include <mutex>
+#include <algorithm>
 
 #include "fastcgi++/address.hpp"
 
@@ -55,7 +58,8 @@ namespace Fastcgipp
             nonfatalError,
             fatalError,
             copyBoth,
-            singleTuple
+            singleTuple,
+            expired
         };
 
         //! Returns a text description of the specified %SQL query result status
@@ -63,6 +67,87 @@ namespace Fastcgipp
 
         class Connection;
 
+        //! Non-owning reference to the raw bytes of an %SQL field
+        /*!
+         * Retrieving a field as a View rather than an std::string or
+         * std::vector<char> avoids copying it out of the result set. It
+         * points straight into the underlying result data so it is only
+         * valid for as long as the Results object is and, with StreamResults,
+         * until the next call to next(). It can be used as a type in the
+         * Results tuple for text, varchar and bytea columns or retrieved
+         * directly from any column with Results_base::view().
+         *
+         * The bytes are exactly as the server sent them so for text columns
+         * they're UTF-8. Write them to an output stream with Request::dump().
+         *
+         * @date    October 14, 2026
+         * @author  Eddie Carle &lt;eddie@isatec.ca&gt;
+         */
+        class View
+        {
+        private:
+            const char* m_data;
+            size_t m_size;
+
+        public:
+            View():
+                m_data(nullptr),
+                m_size(0)
+            {}
+
+            View(const char* data, size_t size):
+                m_data(data),
+                m_size(size)
+            {}
+
+            const char* data() const
+            {
+                return m_data;
+            }
+
+            size_t size() const
+            {
+                return m_size;
+            }
+
+            bool empty() const
+            {
+                return m_size == 0;
+            }
+
+            const char* begin() const
+            {
+                return m_data;
+            }
+
+            const char* end() const
+            {
+                return m_data+m_size;
+            }
+
+            char operator[](size_t index) const
+            {
+                return m_data[index];
+            }
+
+            //! Copy the bytes into an std::string
+            std::string str() const
+            {
+                return std::string(m_data, m_size);
+            }
+
+            bool operator==(const View& x) const
+            {
+                return m_size == x.m_size
+                    && std::equal(m_data, m_data+m_size, x.m_data);
+            }
+
+            bool operator!=(const View& x) const
+            {
+                return !(*this == x);
+            }
+        };
+
         //! De-templated base class for %SQL query result sets
         class Results_base
         {
@@ -87,6 +172,32 @@ namespace Fastcgipp
             //! Check for nullness of a specific row/column
             bool null(int row, int column) const;
 
+            //! Reference the raw bytes of a specific row/column
+            /*!
+             * No type checking is done so this works for any column.
+             * Null fields come back empty.
+             */
+            View view(int row, int column) const;
+
+            //! Extract an entire column at once
+            /*!
+             * This fills the vector with one value per row. It's far cheaper
+             * than going through row() when rendering a large listing in that
+             * nothing is allocated per field and the byte order conversion of
+             * numeric columns is vectorized across the whole column.
+             *
+             * Numeric, std::chrono::time_point and View columns are
+             * supported. Null fields come back as zero or an empty View.
+             *
+             * @param [in] column Zero indexed column number
+             * @param [out] values Filled with the column data. Previous
+             *              content is discarded but it's capacity is kept.
+             * @return False if the column type doesn't match T. In this case
+             *         the vector is left untouched.
+             */
+            template<typename T>
+            bool column(int column, std::vector<T>& values) const;
+
             virtual ~Results_base();
 
         protected:
@@ -95,8 +206,12 @@ namespace Fastcgipp
             //! Pointer to underlying %SQL results object
             void* m_res;
 
+            //! True if the query was dropped for missing it's deadline
+            bool m_expired;
+
             Results_base():
-                m_res(nullptr)
+                m_res(nullptr),
+                m_expired(false)
             {}
 
             //! How many columns are associated with the underlying results
@@ -252,6 +367,78 @@ namespace Fastcgipp
                     return -1;
             }
         };
+
+        //! De-templated base class for StreamResults
+        class ResultStream_base
+        {
+        protected:
+            friend class Connection;
+
+            //! Batches of rows waiting to be taken
+            std::deque<void*> m_batches;
+
+            //! True once the query is complete
+            bool m_complete;
+
+            //! Always practice safe threading
+            mutable std::mutex m_mutex;
+
+            //! Add a batch for the request to take
+            void push(void* batch);
+
+            //! Mark the query as complete
+            void finish();
+
+            //! Replace the current result set with the next batch
+            bool next(void*& res);
+
+            ResultStream_base():
+                m_complete(false)
+            {}
+
+            ~ResultStream_base();
+
+        public:
+            //! Is the query complete with all batches taken?
+            bool complete() const;
+        };
+
+        //! Holds %SQL query results delivered in batches
+        /*!
+         * For queries producing too many rows to comfortably hold in memory at
+         * once. Set Query::batch to the amount of rows per batch and use an
+         * instance of this as the query results. The query callback is then
+         * called for every batch of rows as they come in from the server and
+         * once more when the query is complete.
+         *
+         * Every time the callback is called:
+         *  1. Call next() to make the next batch the current result set.
+         *  2. Call status(), verify() and row() as you would with Results.
+         *  3. Repeat until next() returns false.
+         *
+         * Batches of rows have a status of Status::rowsOk. The final batch
+         * carries the status of the query as a whole and no rows unless the
+         * server didn't accept single row mode.
+         *
+         * @tparam Types Pack of types to contain in the row tuple.
+         * @date    October 14, 2026
+         * @author  Eddie Carle &lt;eddie@isatec.ca&gt;
+         */
+        template<typename... Types>
+        class StreamResults:
+            public Results<Types...>,
+            public ResultStream_base
+        {
+        public:
+            //! Make the next batch of rows the current result set
+            /*!
+             * @return False if no batch is waiting.
+             */
+            bool next()
+            {
+                return ResultStream_base::next(this->m_res);
+            }
+        };
     }
 }
 
@@ -0,0 +1,220 @@
+/*!
+ * @file       timers.hpp
+ * @brief      Declares the Timers class
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 14, 2026
+ * @copyright  Copyright &copy; 2026 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2026 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#ifndef FASTCGIPP_TIMERS_HPP
+#define FASTCGIPP_TIMERS_HPP
+
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <vector>
+#include <cstdint>
+
+#include "fastcgi++/poll.hpp"
+
+//! Topmost namespace for the fastcgi++ library
+namespace Fastcgipp
+{
+    //! A hierarchical timer wheel
+    /*!
+     * Timers call a function once their time comes. Time is counted in ticks
+     * of one resolution and pending timers are kept in four levels of 256
+     * slots each where every level covers 256 times the span of the one
+     * below it. A timer sits in the lowest level that can tell it apart from
+     * the current tick and falls down a level whenever the ticks come close
+     * enough for that level. Both add() and cancel() are O(1) and the cost of
+     * expiry is shared out over the timers themselves so any amount of them
+     * can be pending.
+     *
+     * On Linux the wheel arms a timerfd for the next time anything has to
+     * happen. Put descriptor() into a poll and call expire() whenever it is
+     * readable. Elsewhere poll with timeout() instead. This is done for you
+     * by SocketGroup so you'll rarely have to deal with this directly. Get at
+     * the timers of the Manager with Manager_base::timers().
+     *
+     * Everything but expire() is thread safe. The timer functions are called
+     * from whatever thread calls expire() with no locks held so they may add
+     * or cancel timers but should otherwise be quick about it.
+     *
+     * @date    October 14, 2026
+     * @author  Eddie Carle &lt;eddie@isatec.ca&gt;
+     */
+    class Timers
+    {
+    public:
+        typedef std::chrono::steady_clock Clock;
+
+        //! Identifies a pending timer. Zero is never a valid one.
+        typedef uint64_t Id;
+
+        //! Length of a single tick
+        static const std::chrono::microseconds resolution;
+
+        //! Sole constructor
+        /*!
+         * @param[in] wake Function to wake up whoever is waiting on
+         *                 timeout() when it gets shorter. Only used where
+         *                 there is no timerfd.
+         */
+        Timers(const std::function<void()>& wake);
+
+        ~Timers();
+
+        //! Call a function at a point in time
+        /*!
+         * A timer is never called early. If time has already come, it is
+         * called on the next expire().
+         *
+         * @param[in] when When to call the function
+         * @param[in] callback Function to call
+         * @return Identifier to cancel the timer with
+         */
+        Id add(Clock::time_point when, std::function<void()> callback);
+
+        //! Call a function after a delay
+        Id add(Clock::duration delay, std::function<void()> callback)
+        {
+            return add(Clock::now()+delay, std::move(callback));
+        }
+
+        //! Cancel a pending timer
+        /*!
+         * @return True if the timer was still pending and has been cancelled.
+         *         False if it has already been called or never existed.
+         */
+        bool cancel(Id id);
+
+        //! Number of pending timers
+        size_t size() const;
+
+        //! Descriptor that becomes readable when expire() needs calling
+        /*!
+         * @return The timerfd or -1 if there is none on this platform.
+         */
+        socket_t descriptor() const
+        {
+            return m_fd;
+        }
+
+        //! Milliseconds until expire() needs calling
+        /*!
+         * @return Milliseconds suitable as a poll timeout. -1 if there are
+         *         no timers.
+         */
+        int timeout() const;
+
+        //! Call every timer whose time has come
+        void expire();
+
+    private:
+        static const unsigned levels = 4;
+        static const unsigned slotBits = 8;
+        static const unsigned slots = 1 << slotBits;
+
+        //! Slot index for timers beyond the last level
+        static const unsigned overflow = levels*slots;
+
+        static const uint32_t npos = ~uint32_t(0);
+        static const uint64_t never = ~uint64_t(0);
+
+        //! A pending or free timer
+        struct Node
+        {
+            std::function<void()> callback;
+
+            //! Tick the timer expires at
+            uint64_t expiry;
+
+            //! Neighbours in the slot list or the next free node
+            uint32_t prev;
+            uint32_t next;
+
+            //! Bumped every time the node is freed to invalidate old Ids
+            uint32_t generation;
+
+            //! Slot index the node is in
+            uint32_t slot;
+
+            //! True if the node holds a pending timer
+            bool active;
+        };
+
+        //! All nodes pending or free
+        std::vector<Node> m_nodes;
+
+        //! First free node
+        uint32_t m_free;
+
+        //! First node in every slot
+        uint32_t m_heads[levels*slots+1];
+
+        //! Bit set for every slot that isn't empty
+        uint64_t m_occupied[levels][slots/64];
+
+        //! The tick that was last expired
+        uint64_t m_now;
+
+        //! Time of tick zero
+        const Clock::time_point m_origin;
+
+        //! Tick the timerfd is armed for
+        uint64_t m_armed;
+
+        //! Number of pending timers
+        size_t m_size;
+
+        //! Thread safe the wheel
+        mutable std::mutex m_mutex;
+
+        //! The timerfd
+        socket_t m_fd;
+
+        //! Wakes up whoever waits on timeout()
+        const std::function<void()> m_wake;
+
+        //! Callbacks of timers taken out of the wheel by expire()
+        std::vector<std::function<void()>> m_expired;
+
+        //! Put a node into the slot that matches it's expiry
+        void link(uint32_t node);
+
+        //! Take a node out of it's slot
+        void unlink(uint32_t node);
+
+        //! Tick at which something next has to happen
+        uint64_t next() const;
+
+        //! Advance through every tick up to and including the passed one
+        void advance(uint64_t target);
+
+        //! Make sure we'll be woken up for the next tick that matters
+        void arm();
+    };
+}
+
+#endif
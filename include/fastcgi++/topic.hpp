@@ -0,0 +1,179 @@
+/*!
+ * @file       topic.hpp
+ * @brief      Declares the Topic class
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 15, 2026
+ * @copyright  Copyright &copy; 2026 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2026 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#ifndef FASTCGIPP_TOPIC_HPP
+#define FASTCGIPP_TOPIC_HPP
+
+#include "fastcgi++/protocol.hpp"
+#include "fastcgi++/block.hpp"
+
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+//! Topmost namespace for the fastcgi++ library
+namespace Fastcgipp
+{
+    //! Broadcasts output to long lived requests such as server-sent events
+    /*!
+     * A request that is meant to stream output for as long as the client is
+     * around can call Request::subscribe() from it's response(). Once it's
+     * headers are sent, the request object is done with and all that is
+     * kept of it is a Subscriber in here. It no longer counts as an active
+     * request.
+     *
+     * Anything published is encoded into FastCGI records just once. Every
+     * subscriber with the same request ID gets a slice of that same shared
+     * allocation queued up straight with the Transceiver. Web servers that
+     * don't multiplex connections all use the same request ID so this is
+     * effectively one copy no matter how many subscribers there are.
+     *
+     * A subscriber that has more than the backlog waiting to be sent on it's
+     * connection when something is published has it's request ended instead.
+     * Clients that can't keep up are dropped rather than buffered for
+     * without limit. Subscribers whose connection is gone are forgotten
+     * about the next time something is published.
+     *
+     * Should the web server abort a subscribed request, the Manager has the
+     * topic holding it end it's request and forget about it.
+     *
+     * Nothing ever comes from the other side after the headers so an idle
+     * timeout would close quiet connections. Call heartbeat() from a timer
+     * to keep them busy. Since the subscribers keep their connections open,
+     * close() must be called before a clean Manager::stop() can complete.
+     *
+     * @date    October 15, 2026
+     * @author  Eddie Carle &lt;eddie@isatec.ca&gt;
+     */
+    class Topic
+    {
+    public:
+        //! All that is kept of a request once it has subscribed
+        struct Subscriber
+        {
+            //! Complete ID of the request
+            Protocol::RequestId id;
+
+            //! Should the connection be closed once the request ends
+            bool kill;
+
+            //! Function to queue up records for transmission with
+            std::function<void(const Socket&, Block&&, bool)> send;
+        };
+
+        //! Constructor
+        /*!
+         * @param[in] backlog Bytes that may be waiting to be sent on a
+         *                    subscriber's connection before it is dropped.
+         */
+        explicit Topic(size_t backlog=0x100000);
+
+        Topic(const Topic&) = delete;
+        Topic& operator=(const Topic&) = delete;
+
+        //! Ends every subscription
+        ~Topic();
+
+        //! Take over a request
+        /*!
+         * This is done for you by Request::subscribe().
+         */
+        void subscribe(Subscriber&& subscriber);
+
+        //! Publish raw output to every subscriber
+        /*!
+         * This can be called from any thread.
+         *
+         * @param[in] data Start of the output
+         * @param[in] size Size of the output
+         */
+        void publish(const char* data, size_t size);
+
+        //! Publish raw output to every subscriber
+        void publish(const std::string& data)
+        {
+            publish(data.data(), data.size());
+        }
+
+        //! Publish a server-sent event to every subscriber
+        /*!
+         * The data is split into a data field per line. The type and ID
+         * must not contain any line breaks.
+         *
+         * @param[in] data Data of the event
+         * @param[in] type Type of the event. Empty for a plain message.
+         * @param[in] id ID of the event. Empty for none.
+         */
+        void event(
+                const std::string& data,
+                const std::string& type=std::string(),
+                const std::string& id=std::string());
+
+        //! Publish a server-sent event comment to keep connections busy
+        void heartbeat()
+        {
+            publish(":\n", 2);
+        }
+
+        //! End every subscription
+        void close();
+
+        //! End the subscription of an aborted request
+        /*!
+         * This is done for you by the Manager when the web server aborts a
+         * request that isn't around anymore. Every topic is searched.
+         *
+         * @param[in] id Request that was aborted
+         * @return True if a topic had the request subscribed.
+         */
+        static bool abort(const Protocol::RequestId& id);
+
+        //! How many subscribers there are
+        size_t size() const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_subscribers.size();
+        }
+
+    private:
+        //! Bytes allowed to be waiting on a subscriber's connection
+        const size_t m_backlog;
+
+        //! Thread safe the subscribers
+        mutable std::mutex m_mutex;
+
+        //! Our subscribers
+        std::vector<Subscriber> m_subscribers;
+
+        //! End the request of a subscriber
+        static void end(const Subscriber& subscriber);
+    };
+}
+
+#endif
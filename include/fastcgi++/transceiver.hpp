@@ -32,6 +32,7 @@
 #include <map>
 #include <list>
 #include <queue>
+#include <vector>
 #include <algorithm>
 #include <map>
 #include <functional>
@@ -42,6 +43,8 @@
 
 #include <fastcgi++/protocol.hpp>
 #include "fastcgi++/block.hpp"
+#include "fastcgi++/cpuset.hpp"
+#include "fastcgi++/metrics.hpp"
 
 //! Topmost namespace for the fastcgi++ library
 namespace Fastcgipp
@@ -52,21 +55,19 @@ namespace Fastcgipp
      * level sockets and also the creation/destruction of the sockets
      * themselves.
      *
+     * By default all of this is done in a single event loop. If that loop
+     * becomes a bottleneck, resizeLoops() can be used to spread connections
+     * over several loops each running in their own thread with their own
+     * SocketGroup. Connections are accepted by the first loop and handed off
+     * round-robin to the rest. The first loop can also be made a dedicated
+     * acceptor that handles none of the connections itself.
+     *
      * @date    May 4, 2017
      * @author  Eddie Carle &lt;eddie@isatec.ca&gt;
      */
     class Transceiver
     {
     public:
-        //! General transceiver handler
-        /*!
-         * This function is called by Manager::handler() to both transmit data
-         * passed to it from requests and relay received data back to them as a
-         * Message. The function will return true if there is nothing at all for
-         * it to do.
-         */
-        void handler();
-
         //! Call from any thread to stop the handler() thread
         /*!
          * Calling this thread will signal the handler() thread to cleanly stop
@@ -105,6 +106,26 @@ namespace Fastcgipp
          */
         void send(const Socket& socket, Block&& data, bool kill);
 
+        //! Queue up a record whose content comes from a file for transmission
+        /*!
+         * The file data is written straight from the descriptor into the
+         * socket with sendfile() so it never gets copied into userspace. It
+         * is followed by whatever padding the header calls for.
+         *
+         * @param[in] socket Socket to write the data out
+         * @param[in] data Block containing only the record header
+         * @param[in] file Open file descriptor to send from. It is kept open
+         *                 for as long as the data is queued.
+         * @param[in] offset Offset into the file to start at
+         * @param[in] size Amount of file data to send
+         */
+        void sendFile(
+                const Socket& socket,
+                Block&& data,
+                const std::shared_ptr<const int>& file,
+                off_t offset,
+                size_t size);
+
         //! Constructor
         /*!
          * Construct a transceiver object based on an initial file descriptor to
@@ -127,7 +148,7 @@ namespace Fastcgipp
          */
         bool listen()
         {
-            return m_sockets.listen();
+            return m_loops.front()->sockets.listen();
         }
 
         //! Listen to a named socket
@@ -151,7 +172,11 @@ namespace Fastcgipp
                 const char* owner = nullptr,
                 const char* group = nullptr)
         {
-            return m_sockets.listen(name, permissions, owner, group);
+            return m_loops.front()->sockets.listen(
+                    name,
+                    permissions,
+                    owner,
+                    group);
         }
 
         //! Listen to a TCP port
@@ -170,7 +195,47 @@ namespace Fastcgipp
                 const char* interface,
                 const char* service)
         {
-            return m_sockets.listen(interface, service);
+            return m_loops.front()->sockets.listen(interface, service);
+        }
+
+        //! Wait for a new process to hand our listeners off to
+        /*!
+         * @param [in] name Name of socket (path in Unix world).
+         * @param [in] callback Called once the listeners have been handed
+         *                      off.
+         * @return True on success. False on failure.
+         *
+         * @sa SocketGroup::handOff()
+         */
+        bool handOff(
+                const char* name,
+                const std::function<void()>& callback = nullptr)
+        {
+            return m_loops.front()->sockets.handOff(name, callback);
+        }
+
+        //! Take over the listeners of an old process
+        /*!
+         * @param [in] name Name of socket (path in Unix world).
+         * @return True if any listeners were taken over.
+         *
+         * @sa SocketGroup::inherit()
+         */
+        bool inherit(const char* name)
+        {
+            return m_loops.front()->sockets.inherit(name);
+        }
+
+        //! Listen on a socket that is already listening
+        /*!
+         * @param [in] listener OS level socket identifier of the listener.
+         * @return True on success. False on failure.
+         *
+         * @sa SocketGroup::inherit()
+         */
+        bool inherit(const socket_t listener)
+        {
+            return m_loops.front()->sockets.inherit(listener);
         }
 
         //! Should we set socket option to reuse address
@@ -180,20 +245,104 @@ namespace Fastcgipp
          */
         void reuseAddress(bool value)
         {
-            m_sockets.reuseAddress(value);
+            m_loops.front()->sockets.reuseAddress(value);
         }
 
-    private:
-        //! Container associating sockets with their receive buffers
-        std::map<Socket, Block> m_receiveBuffers;
+        //! Call before start to change the number of event loops
+        /*!
+         * If the transceiver is already running this will do nothing.
+         *
+         * @param[in] loops Number of event loops (and threads) to handle
+         *                  socket I/O with. Anything less than one is treated
+         *                  as one.
+         * @param[in] acceptor Set to true to dedicate an additional event
+         *                     loop to accepting new connections and handing
+         *                     them off to the others.
+         */
+        void resizeLoops(unsigned loops, bool acceptor=false);
+
+        //! Timers run by the first event loop
+        Timers& timers()
+        {
+            return m_loops.front()->sockets.timers();
+        }
+
+        //! Call before start to close connections that sit idle
+        /*!
+         * A connection is idle if nothing has been sent or received over it
+         * for the timeout and it has nothing waiting to be sent. Any requests
+         * still on it are killed along with it so this should be comfortably
+         * longer than any request is expected to take.
+         *
+         * @param[in] timeout How long a connection may sit idle. Zero to
+         *                    never close idle connections (default).
+         */
+        void idleTimeout(std::chrono::milliseconds timeout)
+        {
+            m_idleTimeout = timeout;
+        }
+
+        //! Call before start to limit the amount of queued output
+        /*!
+         * Once more than this many bytes are waiting to be sent on the
+         * connections of an event loop, that loop stops reading anything
+         * more from the other side until it's backlog is down to half of it.
+         * See congested() as well.
+         *
+         * @param[in] bytes Limit on queued output. Zero for no limit
+         *                  (default).
+         */
+        void sendLimit(size_t bytes)
+        {
+            m_sendLimit = bytes;
+        }
+
+        //! Call before start to pin the event loop threads to CPUs
+        /*!
+         * Each loop is handed it's index amongst the loops so a spread set
+         * puts every loop on a core of it's own.
+         *
+         * @param[in] cpus CPUs to run the loops on. Empty for anywhere
+         *                 (default).
+         */
+        void cpus(const CpuSet& cpus)
+        {
+            m_cpus = cpus;
+        }
 
+        //! True if more output is queued in total than the send limit allows
+        bool congested() const
+        {
+            return m_sendLimit && Metrics::sendQueueBytes.value()
+                > static_cast<long long>(m_sendLimit);
+        }
+
+    private:
         //! Simple FastCGI record to queue up for transmission
+        /*!
+         * If file is set, fileSize bytes from it are sent following the
+         * data and then as much padding as the header in the data calls
+         * for.
+         */
         struct Record
         {
             const Socket socket;
             const Block data;
             const char* read;
             const bool kill;
+            const std::shared_ptr<const int> file;
+            off_t fileOffset;
+            size_t fileSize;
+            size_t padding;
+
+            //! ID of the request the record belongs to
+            const Protocol::FcgiId id;
+
+            //! Bytes this record accounts for in the send queue metrics
+            const size_t queued;
+
+            //! When the record was queued if timing is enabled
+            const Metrics::Clock::time_point created;
 
             Record(
                     const Socket& socket_,
@@ -202,30 +351,193 @@ namespace Fastcgipp
                 socket(socket_),
                 data(std::move(data_)),
                 read(data.begin()),
-                kill(kill_)
+                kill(kill_),
+                fileOffset(0),
+                fileSize(0),
+                padding(0),
+                id(fcgiId(data)),
+                queued(data.size()),
+                created(Metrics::timestamp())
+            {
+                enqueued();
+            }
+
+            Record(
+                    const Socket& socket_,
+                    Block&& data_,
+                    const std::shared_ptr<const int>& file_,
+                    off_t fileOffset_,
+                    size_t fileSize_):
+                socket(socket_),
+                data(std::move(data_)),
+                read(data.begin()),
+                kill(false),
+                file(file_),
+                fileOffset(fileOffset_),
+                fileSize(fileSize_),
+                padding(reinterpret_cast<const Protocol::Header*>(
+                            data.begin())->paddingLength),
+                id(fcgiId(data)),
+                queued(data.size()+fileSize+padding),
+                created(Metrics::timestamp())
+            {
+                enqueued();
+            }
+
+            ~Record()
+            {
+                --Metrics::sendQueueRecords;
+                Metrics::sendQueueBytes.sub(queued);
+                socket.dequeued(queued);
+            }
+
+            //! Is there anything left to send beyond the data?
+            bool trailing() const
+            {
+                return fileSize || padding;
+            }
+
+        private:
+            void enqueued() const
+            {
+                ++Metrics::sendQueueRecords;
+                Metrics::sendQueueBytes.add(queued);
+                socket.enqueued(queued);
+            }
+
+            //! Get the request ID out of the header the data starts with
+            static Protocol::FcgiId fcgiId(const Block& data)
+            {
+                if(data.size() < sizeof(Protocol::Header))
+                    return 0;
+                return reinterpret_cast<const Protocol::Header*>(
+                        data.begin())->fcgiId;
+            }
+        };
+
+        //! Records queued up for a single request on a connection
+        struct RequestQueue
+        {
+            Protocol::FcgiId id;
+            std::deque<std::unique_ptr<Record>> records;
+        };
+
+        //! Queue up a record for transmission by the loop it's socket is in
+        void enqueue(std::unique_ptr<Record>&& record);
+
+        //! Size of the per connection receive buffers
+        /*!
+         * This must be at least twice the size of the largest possible
+         * FastCGI record.
+         */
+        static const size_t s_receiveSize = 0x20000;
+
+        //! Per connection buffer that records are received into
+        /*!
+         * As much data as is available is read into the buffer at once and
+         * every complete record in it is passed on as a slice of the buffer.
+         * The slices share ownership of the buffer so it only gets reused
+         * once they are all gone. Otherwise a new one is allocated once the
+         * current one is full.
+         */
+        struct ReceiveBuffer
+        {
+            //! The buffer itself
+            std::shared_ptr<char> data;
+
+            //! Offset of the first byte not yet passed on in a record
+            size_t begin;
+
+            //! Offset of 1+ the last byte read into the buffer
+            size_t end;
+
+            //! Last time anything was sent or received if idle connections
+            //! are closed
+            Timers::Clock::time_point active;
+
+            //! True if a timer is watching the connection for idleness
+            bool watched;
+
+            ReceiveBuffer():
+                begin(0),
+                end(0),
+                watched(false)
             {}
         };
 
-        //! %Buffer for transmitting data
-        std::deque<std::unique_ptr<Record>> m_sendBuffer;
+        //! Everything needed to run a single event loop
+        struct Loop
+        {
+            //! Sockets polled by this loop
+            SocketGroup sockets;
+
+            //! Container associating sockets with their receive buffers
+            std::map<Socket, ReceiveBuffer> receiveBuffers;
+
+            //! Records queued up by send() for transmission
+            std::deque<std::unique_ptr<Record>> sendBuffer;
+
+            //! Thread safe the send buffer
+            std::mutex sendBufferMutex;
+
+            //! Records pulled out of the send buffer awaiting distribution
+            std::deque<std::unique_ptr<Record>> pending;
+
+            //! Container associating sockets with their transmission queues
+            /*!
+             * Each connection has a queue per request so that output from
+             * requests multiplexed over it can be interleaved fairly. This
+             * is only ever touched by the loop thread.
+             */
+            std::map<Socket, std::deque<RequestQueue>> sendQueues;
+
+            //! Scatter/gather array reused for each write
+            std::vector<iovec> vectors;
+
+            //! Request queue index of every record in vectors
+            std::vector<size_t> gathered;
+
+            //! Thread the loop is running in
+            std::thread thread;
+        };
 
-        //! Thread safe the send buffer
-        std::mutex m_sendBufferMutex;
+        //! Our event loops
+        /*!
+         * The first loop owns all the listeners and hands connections off to
+         * the rest.
+         */
+        std::vector<std::unique_ptr<Loop>> m_loops;
 
         //! Function to call to pass messages to requests
         const std::function<void(Protocol::RequestId, Message&&)> m_sendMessage;
 
-        //! Listen for connections with this
-        SocketGroup m_sockets;
+        //! General transceiver handler
+        /*!
+         * This function runs in it's own thread for every loop to both
+         * transmit data passed to it from requests and relay received data
+         * back to them as a Message.
+         */
+        void handler(Loop& loop);
 
         //! Transmit all buffered data possible
         /*!
-         * @return True if we successfully sent all data that was queued up.
+         * Every record queued up for a socket is written out with a single
+         * gathered write. Sockets that can't take any more data are skipped
+         * until SocketGroup::poll() sees them become writable again so one
+         * slow connection doesn't hold up the rest.
+         *
+         * Requests multiplexed over a connection take turns contributing a
+         * record at a time to the write so one large response doesn't hold
+         * up the rest either. The only exception is a record that has only
+         * been partially written. It has to be finished first.
          */
-        inline bool transmit();
+        inline void transmit(Loop& loop);
 
         //! Receive data on the specified socket.
-        inline void receive(Socket& socket);
+        /*!
+         * Every complete record received is passed on in it's own Message.
+         */
+        inline void receive(Loop& loop, Socket& socket);
 
         //! True when handler() should be terminating
         std::atomic_bool m_terminate;
@@ -233,28 +545,33 @@ namespace Fastcgipp
         //! True when handler() should be stopping
         std::atomic_bool m_stop;
 
-        //! Thread our handler is running in
-        std::thread m_thread;
-
         //! Cleanup a dead socket
-        void cleanupSocket(const Socket& socket);
+        void cleanupSocket(Loop& loop, const Socket& socket);
 
-#if FASTCGIPP_LOG_LEVEL > 3
-        //! Debug counter for locally killed sockets
-        std::atomic_ullong m_connectionKillCount;
+        //! Limit on queued output in bytes. Zero for none.
+        size_t m_sendLimit;
 
-        //! Debug counter for remotely hung up sockets
-        std::atomic_ullong m_connectionRDHupCount;
+        //! Pause or resume reading depending on how much output is queued
+        /*!
+         * Only the loop's own backlog counts so a slow connection holds up
+         * the connections sharing it's loop but not those of other loops.
+         * The backlog only shrinks as the loop itself sends it's output so
+         * this gets another look every time around.
+         */
+        inline void throttle(Loop& loop);
 
-        //! Debug counter for records sent
-        std::atomic_ullong m_recordsSent;
+        //! How long a connection may sit idle. Zero for forever.
+        std::chrono::milliseconds m_idleTimeout;
 
-        //! Debug counter for records queued for sending
-        std::atomic_ullong m_recordsQueued;
+        //! CPUs to pin the event loop threads to
+        CpuSet m_cpus;
 
-        //! Debug counter for bytes received
-        std::atomic_ullong m_recordsReceived;
-#endif
+        //! Check on a connection once it might have become idle
+        /*!
+         * If it has, it gets closed. Otherwise it is checked on again once
+         * it might have.
+         */
+        void idle(Loop& loop, const Socket& socket);
     };
 }
 
@@ -28,7 +28,6 @@
 #ifndef FASTCGIPP_WEBSTREAMBUF_HPP
 #define FASTCGIPP_WEBSTREAMBUF_HPP
 
-#include <map>
 #include <streambuf>
 
 //! Topmost namespace for the fastcgi++ library
@@ -45,7 +44,7 @@ namespace Fastcgipp
      * @endcode
      *
      * When output encoding is set to NONE, no character translation takes place.
-     * HTML and URL encoding is described by the following table.
+     * HTML, URL and JSON encoding is described by the following tables.
      *
      * <b>HTML</b>
      * <table>
@@ -175,6 +174,49 @@ namespace Fastcgipp
      *  </tr>
      * </table>
      *
+     * <b>JSON</b>
+     *
+     * This escapes the contents of a JSON string. The surrounding quotes are
+     * left to you.
+     * <table>
+     *  <tr>
+     *      <td><b>Input</b></td>
+     *      <td><b>Output</b></td>
+     *  </tr>
+     *  <tr>
+     *      <td>&quot;</td>
+     *      <td>\\&quot;</td>
+     *  </tr>
+     *  <tr>
+     *      <td>\\</td>
+     *      <td>\\\\</td>
+     *  </tr>
+     *  <tr>
+     *      <td>*backspace*</td>
+     *      <td>\\b</td>
+     *  </tr>
+     *  <tr>
+     *      <td>*form feed*</td>
+     *      <td>\\f</td>
+     *  </tr>
+     *  <tr>
+     *      <td>*newline*</td>
+     *      <td>\\n</td>
+     *  </tr>
+     *  <tr>
+     *      <td>*carriage return*</td>
+     *      <td>\\r</td>
+     *  </tr>
+     *  <tr>
+     *      <td>*tab*</td>
+     *      <td>\\t</td>
+     *  </tr>
+     *  <tr>
+     *      <td>*other control characters*</td>
+     *      <td>\\u00XX</td>
+     *  </tr>
+     * </table>
+     *
      * @date    May 2, 2016
      * @author  Eddie Carle &lt;eddie@isatec.ca&gt;
      */
@@ -182,7 +224,8 @@ namespace Fastcgipp
     {
         NONE,
         HTML,
-        URL
+        URL,
+        JSON
     };
 
     template<class charT, class traits>
@@ -208,13 +251,12 @@ namespace Fastcgipp
         typedef typename std::basic_streambuf<charT, traits>::traits_type traits_type;
         typedef typename std::basic_streambuf<charT, traits>::char_type char_type;
 
-        //! Needed for html encoding of stream data
-        static const std::map<charT, const std::basic_string<charT>> htmlCharacters;
-
-        //! Needed for url encoding of stream data
-        static const std::map<charT, const std::basic_string<charT>> urlCharacters;
-
         //! Derived from std::basic_streambuf<charT, traits>
+        /*!
+         * When encoding, runs of characters that need no escaping are found
+         * with Scan::findAny() and copied in bulk. Escape sequences come out
+         * of a table indexed by character.
+         */
         std::streamsize xsputn(const char_type *s, std::streamsize n);
 
         //! Output encoding for stream buffer
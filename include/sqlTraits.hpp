@@ -38,6 +38,7 @@
 #undef ERROR
 
 #include "fastcgi++/http.hpp"
+#include "fastcgi++/sql/results.hpp"
 
 //! Topmost namespace for the fastcgi++ library
 namespace Fastcgipp
@@ -164,6 +165,17 @@ namespace Fastcgipp
                 return type == oid;
             }
         };
+        template<> struct Traits<View>
+        {
+            static constexpr unsigned oid = TEXTOID;
+            static bool verifyType(const void* result, int column)
+            {
+                const Oid type = PQftype(
+                        reinterpret_cast<const PGresult*>(result),
+                        column);
+                return type == oid || type == VARCHAROID || type == BYTEAOID;
+            }
+        };
         template<> struct Traits<std::vector<char>>
         {
             static constexpr unsigned oid = BYTEAOID;
@@ -31,7 +31,6 @@
 
 #include "fastcgi++/address.hpp"
 #include "fastcgi++/log.hpp"
-#include "fastcgi++/http.hpp"
 
 Fastcgipp::Address& Fastcgipp::Address::operator&=(
         const Address& x)
@@ -44,127 +43,217 @@ Fastcgipp::Address& Fastcgipp::Address::operator&=(
     return *this;
 }
 
-template void Fastcgipp::Address::assign<char>(
-        const char* start,
-        const char* end);
-template void Fastcgipp::Address::assign<wchar_t>(
-        const wchar_t* start,
-        const wchar_t* end);
-template<class charT> void Fastcgipp::Address::assign(
-        const charT* start,
-        const charT* end)
+namespace
 {
-    const charT* read=start-1;
-    auto write=m_data.begin();
-    auto pad=m_data.end();
-    unsigned char offset;
-    uint16_t chunk=0;
-    bool error=false;
-
-    while(1)
+    //! Value of a hexadecimal digit or 16 if it isn't one
+    template<class charT> inline unsigned hexDigit(const charT character)
     {
-        ++read;
-        if(read >= end || *read == ':')
+        if('0' <= character && character <= '9')
+            return character-'0';
+        const charT lower = character | 0x20;
+        if('a' <= lower && lower <= 'f')
+            return lower-'a'+10;
+        return 16;
+    }
+
+    //! Parse a dotted decimal IPv4 address making up all of [read, end)
+    template<class charT> bool parseIpv4(
+            const charT* read,
+            const charT* const end,
+            unsigned char* write)
+    {
+        for(int octet=0; octet<4; ++octet)
         {
-            if(read == start || *(read-1) == ':')
-            {
-                if(pad!=m_data.end() && pad!=write)
-                {
-                    error=true;
-                    break;
-                }
-                else
-                    pad = write;
-            }
-            else
+            if(octet != 0)
             {
-                *write = (chunk&0xff00)>>8;
-                *(write+1) = chunk&0x00ff;
-                chunk = 0;
-                write += 2;
-                if(write>=m_data.end() || read>=end)
-                {
-                    if(read>=end && write<m_data.end() && pad==m_data.end())
-                        error=true;
-                    break;
-                }
+                if(read == end || *read != '.')
+                    return false;
+                ++read;
             }
-            continue;
+
+            const charT* const digits = read;
+            unsigned value = 0;
+            while(read != end && read-digits < 3
+                    && '0' <= *read && *read <= '9')
+                value = value*10 + unsigned(*read++ - '0');
+            if(read == digits || value > 255)
+                return false;
+            *write++ = static_cast<unsigned char>(value);
+        }
+        return read == end;
+    }
+
+    //! Parse an IPv6 address making up all of [read, end)
+    template<class charT> bool parseIpv6(
+            const charT* read,
+            const charT* const end,
+            unsigned char* const data)
+    {
+        unsigned char* write = data;
+        unsigned char* const last = data+Fastcgipp::Address::size;
+        unsigned char* pad = nullptr;
+
+        if(end-read >= 2 && read[0] == ':' && read[1] == ':')
+        {
+            pad = write;
+            read += 2;
         }
-        else if('0' <= *read && *read <= '9')
-            offset = '0';
-        else if('A' <= *read && *read <= 'F')
-            offset = 'A'-10;
-        else if('a' <= *read && *read <= 'f')
-            offset = 'a'-10;
-        else if(*read == '.')
+
+        while(read != end)
         {
-            if(write == m_data.begin())
+            const charT* const group = read;
+            unsigned chunk = 0;
+            unsigned digit;
+            while(read != end && read-group < 4
+                    && (digit = hexDigit(*read)) < 16)
             {
-                // We must be getting a pure ipv4 formatted address. Not an
-                // ::ffff:xxx.xxx.xxx.xxx style ipv4 address.
-                *reinterpret_cast<uint16_t*>(write) = 0xffff;
-                pad = m_data.begin();
-                write += 2;
+                chunk = chunk<<4 | digit;
+                ++read;
             }
-            else if(write - m_data.begin() > 12)
+            if(read == group)
+                return false;
+
+            if(read != end && *read == '.')
             {
-                // We don't have enought space for an ipv4 address
-                error=true;
+                // A trailing IPv4 address takes up the last two groups
+                if(last-write < 4 || !parseIpv4(group, end, write))
+                    return false;
+                write += 4;
                 break;
             }
 
-            // First convert the value stored in chunk to the first part of the
-            // ipv4 address
-            *write = 0;
-            for(int i=0; i<3; ++i)
-            {
-                *write = *write * 10 + ((chunk&0x0f00)>>8);
-                chunk <<= 4;
-            }
-            ++write;
+            if(write == last)
+                return false;
+            *write++ = static_cast<unsigned char>(chunk >> 8);
+            *write++ = static_cast<unsigned char>(chunk);
 
-            // Now we'll get the remaining pieces
-            for(int i=0; i<3 && read<end; ++i)
+            if(read == end)
+                break;
+            if(*read != ':' || ++read == end)
+                return false;
+            if(*read == ':')
             {
-                const charT* point=std::find(read, end, '.');
-                if(point<end-1)
-                    read=point;
-                else
-                {
-                    error=true;
-                    break;
-                }
-                *write++ = Http::atoi(++read, end);
+                if(pad)
+                    return false;
+                pad = write;
+                ++read;
             }
-            break;
         }
-        else
+
+        if(pad)
         {
-            error=true;
-            break;
+            // The double colon has to stand in for at least one group
+            if(write == last)
+                return false;
+            const size_t padSize = last-write;
+            std::move_backward(pad, write, last);
+            std::fill_n(pad, padSize, 0);
         }
-        chunk <<= 4;
-        chunk |= *read-offset;
+        else if(write != last)
+            return false;
+        return true;
     }
+}
 
-    if(error)
+template void Fastcgipp::Address::assign<char>(
+        const char* start,
+        const char* end);
+template void Fastcgipp::Address::assign<wchar_t>(
+        const wchar_t* start,
+        const wchar_t* end);
+template<class charT> void Fastcgipp::Address::assign(
+        const charT* start,
+        const charT* end)
+{
+    if(parseIpv4(start, end, m_data.data()+12))
+    {
+        std::fill_n(m_data.begin(), 10, 0);
+        m_data[10] = 0xff;
+        m_data[11] = 0xff;
+    }
+    else if(!parseIpv6(start, end, m_data.data()))
     {
         m_data.fill(0);
         WARNING_LOG("Error converting IPv6 address " \
                 << std::wstring(start, end))
     }
-    else if(pad != m_data.end())
+}
+
+template char* Fastcgipp::Address::format<char>(char* destination) const;
+template wchar_t* Fastcgipp::Address::format<wchar_t>(
+        wchar_t* destination) const;
+template<class charT>
+charT* Fastcgipp::Address::format(charT* destination) const
+{
+    static const char digits[] = "0123456789abcdef";
+
+    if(ipv4())
+    {
+        for(const char* prefix="::ffff:"; *prefix; ++prefix)
+            *destination++ = *prefix;
+        for(size_t i=12; i<size; ++i)
+        {
+            if(i != 12)
+                *destination++ = '.';
+            unsigned value = m_data[i];
+            if(value >= 100)
+            {
+                *destination++ = digits[value/100];
+                value %= 100;
+                *destination++ = digits[value/10];
+            }
+            else if(value >= 10)
+                *destination++ = digits[value/10];
+            *destination++ = digits[value%10];
+        }
+        return destination;
+    }
+
+    unsigned groups[8];
+    for(unsigned i=0; i<8; ++i)
+        groups[i] = unsigned(m_data[2*i])<<8 | m_data[2*i+1];
+
+    // Only the first of the longest runs of two or more zero groups is
+    // compressed
+    unsigned runStart = 8;
+    unsigned runSize = 1;
+    for(unsigned i=0; i<8;)
+    {
+        if(groups[i])
+        {
+            ++i;
+            continue;
+        }
+        unsigned j=i;
+        while(j<8 && !groups[j])
+            ++j;
+        if(j-i > runSize)
+        {
+            runStart = i;
+            runSize = j-i;
+        }
+        i = j;
+    }
+
+    for(unsigned i=0; i<8; ++i)
     {
-        if(pad==write)
-            std::fill(write, m_data.end(), 0);
-        else
+        if(i == runStart)
         {
-            auto padEnd=pad+(m_data.end()-write);
-            std::copy(pad, write, padEnd);
-            std::fill(pad, padEnd, 0);
+            *destination++ = ':';
+            *destination++ = ':';
+            i += runSize-1;
+            continue;
         }
+        if(i != 0 && i != runStart+runSize)
+            *destination++ = ':';
+
+        int shift = 12;
+        while(shift > 0 && !(groups[i] >> shift))
+            shift -= 4;
+        for(; shift >= 0; shift -= 4)
+            *destination++ = digits[(groups[i] >> shift) & 0xf];
     }
+    return destination;
 }
 
 template std::basic_ostream<char, std::char_traits<char>>&
@@ -189,128 +278,8 @@ Fastcgipp::operator<<(
         if(opfx)
         {
             streamsize fieldWidth=os.width(0);
-            charT buffer[40];
-            charT* bufPtr=buffer;
-            locale loc(os.getloc(), new num_put<charT, charT*>);
-
-            const uint16_t* subStart=0;
-            const uint16_t* subEnd=0;
-            {
-                const uint16_t* subStartCandidate;
-                const uint16_t* subEndCandidate;
-                bool inZero = false;
-
-                for(
-                        const uint16_t* it = reinterpret_cast<const uint16_t*>(
-                            address.m_data.data());
-                        it < reinterpret_cast<const uint16_t*>(
-                            address.m_data.data()+Address::size);
-                        ++it)
-                {
-                    if(*it == 0)
-                    {
-                        if(!inZero)
-                        {
-                            subStartCandidate = it;
-                            subEndCandidate = it;
-                            inZero=true;
-                        }
-                        ++subEndCandidate;
-                    }
-                    else if(inZero)
-                    {
-                        if(subEndCandidate-subStartCandidate > subEnd-subStart)
-                        {
-                            subStart=subStartCandidate;
-                            subEnd=subEndCandidate-1;
-                        }
-                        inZero=false;
-                    }
-                }
-                if(inZero)
-                {
-                    if(subEndCandidate-subStartCandidate > subEnd-subStart)
-                    {
-                        subStart=subStartCandidate;
-                        subEnd=subEndCandidate-1;
-                    }
-                    inZero=false;
-                }
-            }
-
-            ios_base::fmtflags oldFlags = os.flags();
-            os.setf(ios::hex, ios::basefield);
-
-            if(
-                    subStart==reinterpret_cast<const uint16_t*>(
-                        address.m_data.data())
-                    && subEnd==reinterpret_cast<const uint16_t*>(
-                        address.m_data.data())+4
-                    && *(reinterpret_cast<const uint16_t*>(
-                            address.m_data.data())+5) == 0xffff)
-            {
-                // It is an ipv4 address
-                *bufPtr++=os.widen(':');
-                *bufPtr++=os.widen(':');
-                bufPtr=use_facet<num_put<charT, charT*> >(loc).put(
-                        bufPtr,
-                        os,
-                        os.fill(),
-                        static_cast<unsigned long int>(0xffff));
-                *bufPtr++=os.widen(':');
-                os.setf(ios::dec, ios::basefield);
-
-                for(
-                        const unsigned char* it = address.m_data.data()+12;
-                        it < address.m_data.data()+Address::size;
-                        ++it)
-                {
-                    bufPtr=use_facet<num_put<charT, charT*> >(loc).put(
-                            bufPtr,
-                            os,
-                            os.fill(),
-                            static_cast<unsigned long int>(*it));
-                    *bufPtr++=os.widen('.');
-                }
-                --bufPtr;
-            }
-            else
-            {
-                // It is an ipv6 address
-                for(const uint16_t* it= reinterpret_cast<const uint16_t*>(
-                            address.m_data.data());
-                        it < reinterpret_cast<const uint16_t*>(
-                            address.m_data.data()+Address::size);
-                        ++it)
-                {
-                    if(subStart <= it && it <= subEnd)
-                    {
-                        if(
-                                it == subStart
-                                && it == reinterpret_cast<const uint16_t*>(
-                                    address.m_data.data()))
-                            *bufPtr++=os.widen(':');
-                        if(it == subEnd)
-                            *bufPtr++=os.widen(':');
-                    }
-                    else
-                    {
-                        bufPtr=use_facet<num_put<charT, charT*> >(loc).put(
-                                bufPtr,
-                                os,
-                                os.fill(),
-                                static_cast<unsigned long int>(
-                                    *reinterpret_cast<
-                                    const BigEndian<uint16_t>*>(it)));
-
-                        if(it < reinterpret_cast<const uint16_t*>(
-                                    address.m_data.data()+Address::size)-1)
-                            *bufPtr++=os.widen(':');
-                    }
-                }
-            }
-
-            os.flags(oldFlags);
+            charT buffer[Address::textSize];
+            charT* const bufPtr=address.format(buffer);
 
             charT* ptr=buffer;
             ostreambuf_iterator<charT,Traits> sink(os);
@@ -0,0 +1,358 @@
+/*!
+ * @file       assetcache.cpp
+ * @brief      Defines the AssetCache class
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 15, 2026
+ * @copyright  Copyright &copy; 2026 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2026 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#include "fastcgi++/assetcache.hpp"
+#include "fastcgi++/log.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+    //! Content codings assets are compressed with
+    const Fastcgipp::Compression codings[] = {
+        Fastcgipp::Compression::GZIP,
+        Fastcgipp::Compression::BROTLI,
+        Fastcgipp::Compression::ZSTD};
+
+    //! Compress all of some data at once
+    /*!
+     * @return The compressed data or an empty string if the coding isn't
+     *         supported.
+     */
+    std::string compress(
+            Fastcgipp::Compression compression,
+            const char* data,
+            size_t size)
+    {
+        std::string output;
+        const auto compressor = Fastcgipp::Compressor::acquire(compression);
+        if(!compressor)
+            return output;
+
+        output.resize(size/2+0x400);
+        const char* input = data;
+        size_t produced = 0;
+        while(true)
+        {
+            char* position = &output[0]+produced;
+            const bool finished = compressor->process(
+                    input,
+                    data+size,
+                    position,
+                    &output[0]+output.size(),
+                    Fastcgipp::Compressor::Flush::FINISH);
+            produced = position-&output[0];
+            if(finished)
+                break;
+            output.resize(output.size()*2);
+        }
+        output.resize(produced);
+        return output;
+    }
+
+    //! Build the complete response for an asset
+    Fastcgipp::ResponseCache::Entry response(
+            const std::string& headers,
+            const char* body,
+            size_t size,
+            unsigned etag,
+            std::time_t lastModified,
+            const std::string& validators)
+    {
+        using namespace Fastcgipp::Protocol;
+
+        Fastcgipp::ResponseCache::Entry entry;
+        entry.size = getRecordsSize(headers.size())+getRecordsSize(size)
+            +sizeof(Header)+sizeof(EndRequest);
+        entry.records = Fastcgipp::BlockPool::share(entry.size);
+        entry.fcgiId = 1;
+        entry.etag = etag;
+        entry.lastModified = lastModified;
+        entry.validators = validators;
+        entry.expires = Fastcgipp::ResponseCache::Clock::time_point::max();
+
+        char* record = encodeRecords(
+                RecordType::OUT,
+                entry.fcgiId,
+                headers.data(),
+                headers.size(),
+                entry.records.get());
+        record = encodeRecords(
+                RecordType::OUT,
+                entry.fcgiId,
+                body,
+                size,
+                record);
+
+        Header& header = *reinterpret_cast<Header*>(record);
+        header.version = version;
+        header.type = RecordType::END_REQUEST;
+        header.fcgiId = entry.fcgiId;
+        header.contentLength = sizeof(EndRequest);
+        header.paddingLength = 0;
+        header.reserved = 0;
+        EndRequest& end = *reinterpret_cast<EndRequest*>(
+                record+sizeof(header));
+        end.appStatus = 0;
+        end.protocolStatus = ProtocolStatus::REQUEST_COMPLETE;
+        std::fill(std::begin(end.reserved), std::end(end.reserved), 0);
+
+        return entry;
+    }
+}
+
+void Fastcgipp::AssetCache::insert(
+        const std::string& path,
+        const char* data,
+        size_t size,
+        const std::string& contentType,
+        std::time_t lastModified,
+        const std::string& headers)
+{
+    // FNV-1a
+    unsigned etag = 0x811c9dc5;
+    for(const char* byte=data; byte != data+size; ++byte)
+        etag = (etag ^ static_cast<unsigned char>(*byte)) * 0x01000193;
+    etag = std::max(etag, 1U);
+    const std::string tag = "ETag: \"" + std::to_string(etag);
+
+    std::string common("Content-Type: ");
+    common += contentType;
+    common += "\r\n";
+    if(lastModified != 0)
+    {
+        std::tm time;
+        char text[64];
+        const size_t length = std::strftime(
+                text,
+                sizeof(text),
+                "Last-Modified: %a, %d %b %Y %H:%M:%S GMT\r\n",
+                gmtime_r(&lastModified, &time));
+        common.append(text, length);
+    }
+    common += headers;
+
+    auto asset = std::make_shared<Asset>();
+    size_t bytes = 0;
+    bool compressed = false;
+    for(const Compression coding: codings)
+    {
+        const std::string body = compress(coding, data, size);
+        if(body.empty() || body.size() >= size-size/16)
+            continue;
+
+        std::string validators(tag);
+        validators += '-';
+        validators += Compressor::name(coding);
+        validators += "\"\r\nVary: Accept-Encoding\r\n";
+
+        std::string header(common);
+        header += validators;
+        header += "Content-Length: ";
+        header += std::to_string(body.size());
+        header += "\r\nContent-Encoding: ";
+        header += Compressor::name(coding);
+        header += "\r\n\r\n";
+
+        ResponseCache::Entry& entry
+            = asset->responses[static_cast<unsigned>(coding)];
+        entry = response(
+                header,
+                body.data(),
+                body.size(),
+                etag,
+                lastModified,
+                validators);
+        bytes += entry.size;
+        compressed = true;
+    }
+
+    std::string validators(tag);
+    validators += "\"\r\n";
+    if(compressed)
+        validators += "Vary: Accept-Encoding\r\n";
+
+    std::string header(common);
+    header += validators;
+    header += "Content-Length: ";
+    header += std::to_string(size);
+    header += "\r\n\r\n";
+    asset->responses[0] = response(
+            header,
+            data,
+            size,
+            etag,
+            lastModified,
+            validators);
+    bytes += asset->responses[0].size;
+
+    std::lock_guard<std::shared_timed_mutex> lock(m_mutex);
+    auto& existing = m_assets[path];
+    if(existing)
+        for(const auto& entry: existing->responses)
+            m_bytes -= entry.size;
+    existing = std::move(asset);
+    m_bytes += bytes;
+}
+
+bool Fastcgipp::AssetCache::load(
+        const std::string& path,
+        const std::string& filename,
+        const std::string& contentType,
+        const std::string& headers)
+{
+    const int file = ::open(filename.c_str(), O_RDONLY);
+    if(file == -1)
+    {
+        ERROR_LOG("Unable to open asset " << filename.c_str() << ": " \
+                << std::strerror(errno))
+        return false;
+    }
+
+    struct stat status;
+    if(::fstat(file, &status) != 0 || !S_ISREG(status.st_mode))
+    {
+        ERROR_LOG("Asset " << filename.c_str() << " isn't a regular file")
+        ::close(file);
+        return false;
+    }
+
+    const size_t size = status.st_size;
+    void* data = nullptr;
+    if(size != 0)
+    {
+        data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+        if(data == MAP_FAILED)
+        {
+            ERROR_LOG("Unable to map asset " << filename.c_str() << ": " \
+                    << std::strerror(errno))
+            ::close(file);
+            return false;
+        }
+    }
+    ::close(file);
+
+    insert(
+            path,
+            static_cast<const char*>(data),
+            size,
+            contentType.empty() ? std::string(this->contentType(filename))
+                : contentType,
+            status.st_mtime,
+            headers);
+
+    if(data != nullptr)
+        ::munmap(data, size);
+    return true;
+}
+
+std::shared_ptr<const Fastcgipp::AssetCache::Asset>
+Fastcgipp::AssetCache::find(const std::string& path) const
+{
+    std::shared_lock<std::shared_timed_mutex> lock(m_mutex);
+    const auto asset = m_assets.find(path);
+    if(asset == m_assets.end())
+        return nullptr;
+    return asset->second;
+}
+
+void Fastcgipp::AssetCache::erase(const std::string& path)
+{
+    std::lock_guard<std::shared_timed_mutex> lock(m_mutex);
+    const auto asset = m_assets.find(path);
+    if(asset == m_assets.end())
+        return;
+    for(const auto& entry: asset->second->responses)
+        m_bytes -= entry.size;
+    m_assets.erase(asset);
+}
+
+void Fastcgipp::AssetCache::clear()
+{
+    std::lock_guard<std::shared_timed_mutex> lock(m_mutex);
+    m_assets.clear();
+    m_bytes = 0;
+}
+
+size_t Fastcgipp::AssetCache::size() const
+{
+    std::shared_lock<std::shared_timed_mutex> lock(m_mutex);
+    return m_assets.size();
+}
+
+size_t Fastcgipp::AssetCache::bytes() const
+{
+    std::shared_lock<std::shared_timed_mutex> lock(m_mutex);
+    return m_bytes;
+}
+
+const char* Fastcgipp::AssetCache::contentType(const std::string& filename)
+{
+    static const std::pair<const char*, const char*> types[] = {
+        {"css", "text/css; charset=utf-8"},
+        {"gif", "image/gif"},
+        {"htm", "text/html; charset=utf-8"},
+        {"html", "text/html; charset=utf-8"},
+        {"ico", "image/x-icon"},
+        {"jpeg", "image/jpeg"},
+        {"jpg", "image/jpeg"},
+        {"js", "text/javascript; charset=utf-8"},
+        {"json", "application/json"},
+        {"pdf", "application/pdf"},
+        {"png", "image/png"},
+        {"svg", "image/svg+xml"},
+        {"txt", "text/plain; charset=utf-8"},
+        {"wasm", "application/wasm"},
+        {"webp", "image/webp"},
+        {"woff", "font/woff"},
+        {"woff2", "font/woff2"},
+        {"xml", "application/xml"}};
+
+    const size_t dot = filename.rfind('.');
+    const size_t slash = filename.rfind('/');
+    if(dot != std::string::npos && (slash == std::string::npos || dot > slash))
+    {
+        std::string extension(filename, dot+1);
+        std::transform(
+                extension.begin(),
+                extension.end(),
+                extension.begin(),
+                ::tolower);
+        for(const auto& type: types)
+            if(extension == type.first)
+                return type.second;
+    }
+    return "application/octet-stream";
+}
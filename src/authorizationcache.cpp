@@ -0,0 +1,140 @@
+/*!
+ * @file       authorizationcache.cpp
+ * @brief      Defines the AuthorizationCache class
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 15, 2026
+ * @copyright  Copyright &copy; 2026 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2026 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#include "fastcgi++/authorizationcache.hpp"
+
+#include <algorithm>
+#include <functional>
+
+Fastcgipp::AuthorizationCache::AuthorizationCache(
+        Clock::duration ttl,
+        size_t maxEntries,
+        unsigned shards):
+    m_ttl(ttl),
+    m_maxShardEntries(std::max(maxEntries/std::max(shards, 1u), size_t(1))),
+    m_shardCount(std::max(shards, 1u)),
+    m_shards(new Shard[m_shardCount])
+{}
+
+std::string Fastcgipp::AuthorizationCache::key(
+        const std::string& authorization,
+        const std::string& variant)
+{
+    std::string key;
+    key.reserve(authorization.size()+1+variant.size());
+    key += authorization;
+    key += '\0';
+    key += variant;
+    return key;
+}
+
+Fastcgipp::AuthorizationCache::Shard& Fastcgipp::AuthorizationCache::shard(
+        const std::string& authorization) const
+{
+    return m_shards[std::hash<std::string>()(authorization)%m_shardCount];
+}
+
+void Fastcgipp::AuthorizationCache::remove(Shard& shard, Index::iterator index)
+{
+    shard.items.erase(index->second);
+    shard.index.erase(index);
+}
+
+std::shared_ptr<const Fastcgipp::AuthorizationCache::Entry>
+Fastcgipp::AuthorizationCache::find(
+        const std::string& authorization,
+        const std::string& variant)
+{
+    const auto now = Clock::now();
+    Shard& shard = this->shard(authorization);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    const auto index = shard.index.find(key(authorization, variant));
+    if(index == shard.index.end())
+        return nullptr;
+    if(index->second->entry->expires <= now)
+    {
+        remove(shard, index);
+        return nullptr;
+    }
+
+    shard.items.splice(shard.items.begin(), shard.items, index->second);
+    return index->second->entry;
+}
+
+void Fastcgipp::AuthorizationCache::insert(
+        const std::string& authorization,
+        const std::string& variant,
+        std::shared_ptr<const Entry>&& entry)
+{
+    std::string key(this->key(authorization, variant));
+    Shard& shard = this->shard(authorization);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    const auto existing = shard.index.find(key);
+    if(existing != shard.index.end())
+        remove(shard, existing);
+    while(shard.index.size() >= m_maxShardEntries)
+        remove(shard, shard.index.find(shard.items.back().key));
+
+    shard.items.push_front(Item{std::move(key), std::move(entry)});
+    shard.index.emplace(shard.items.front().key, shard.items.begin());
+}
+
+void Fastcgipp::AuthorizationCache::erase(const std::string& authorization)
+{
+    const std::string prefix(key(authorization, std::string()));
+    Shard& shard = this->shard(authorization);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto index = shard.index.lower_bound(prefix);
+    while(index != shard.index.end()
+            && index->first.compare(0, prefix.size(), prefix) == 0)
+        remove(shard, index++);
+}
+
+void Fastcgipp::AuthorizationCache::clear()
+{
+    for(unsigned i=0; i<m_shardCount; ++i)
+    {
+        std::lock_guard<std::mutex> lock(m_shards[i].mutex);
+        m_shards[i].index.clear();
+        m_shards[i].items.clear();
+    }
+}
+
+size_t Fastcgipp::AuthorizationCache::size() const
+{
+    size_t size = 0;
+    for(unsigned i=0; i<m_shardCount; ++i)
+    {
+        std::lock_guard<std::mutex> lock(m_shards[i].mutex);
+        size += m_shards[i].index.size();
+    }
+    return size;
+}
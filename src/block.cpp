@@ -27,52 +27,288 @@
 *******************************************************************************/
 
 #include "fastcgi++/block.hpp"
+#include "fastcgi++/cpuset.hpp"
 #include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+const size_t Fastcgipp::BlockPool::sizes[Fastcgipp::BlockPool::classes] =
+{
+    0x40,
+    0x400,
+    0x2040,
+    0x10108,
+    0x20000
+};
+
+namespace
+{
+    //! How many allocations of each size class a thread keeps cached
+    const size_t threadLimits[Fastcgipp::BlockPool::classes] =
+    {
+        256,
+        64,
+        32,
+        8,
+        4
+    };
+
+    //! How many allocations of each size class are kept cached globally
+    const size_t globalLimits[Fastcgipp::BlockPool::classes] =
+    {
+        4096,
+        1024,
+        256,
+        64,
+        32
+    };
+
+    //! Find the size class for a requested size
+    inline unsigned sizeClass(size_t size)
+    {
+        unsigned i=0;
+        while(i<Fastcgipp::BlockPool::classes
+                && size > Fastcgipp::BlockPool::sizes[i])
+            ++i;
+        return i;
+    }
+
+    //! Memory cached across all threads on a single NUMA node
+    /*!
+     * Memory ends up on the node of the thread that first touches it so
+     * keeping a cache per node stops it wandering over to the others.
+     */
+    struct Global
+    {
+        std::vector<char*> free[Fastcgipp::BlockPool::classes];
+        std::mutex mutex;
+    };
+
+    //! Usage statistics across all nodes
+    struct Totals
+    {
+        std::atomic_ullong allocations;
+        std::atomic_ullong hits;
+        std::atomic_ullong bytes;
+        std::atomic_ullong peakBytes;
+
+        Totals():
+            allocations(0),
+            hits(0),
+            bytes(0),
+            peakBytes(0)
+        {}
+    };
+
+    //! The global caches are never destroyed
+    /*!
+     * Blocks are free to outlive pretty much anything during static
+     * destruction so the global caches must always be there for them.
+     */
+    Global& global(unsigned node)
+    {
+        static const unsigned nodes = Fastcgipp::CpuSet::nodes();
+        static Global* const global = new Global[nodes];
+        return global[node<nodes?node:0];
+    }
+
+    Totals& totals()
+    {
+        static Totals* const totals = new Totals;
+        return *totals;
+    }
+
+    //! Memory cached for a single thread
+    struct Cache
+    {
+        std::vector<char*> free[Fastcgipp::BlockPool::classes];
+
+        //! NUMA node the thread was on when the cache was made
+        const unsigned node;
+
+        Cache():
+            node(Fastcgipp::CpuSet::currentNode())
+        {}
+
+        ~Cache();
+    };
+
+    //! Set once the calling thread's cache has been destroyed
+    thread_local bool cacheDestroyed = false;
+
+    thread_local Cache cache;
+
+    Cache::~Cache()
+    {
+        cacheDestroyed = true;
+        Global& pool = global(node);
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        for(unsigned i=0; i<Fastcgipp::BlockPool::classes; ++i)
+            for(const auto data: free[i])
+            {
+                if(pool.free[i].size() < globalLimits[i])
+                    pool.free[i].push_back(data);
+                else
+                    delete [] data;
+            }
+    }
+}
+
+std::unique_ptr<char[], Fastcgipp::BlockPool::Deleter>
+Fastcgipp::BlockPool::allocate(size_t size)
+{
+    Totals& stats = totals();
+    const unsigned i = sizeClass(size);
+    const size_t capacity = i<classes?sizes[i]:size;
+    char* data = nullptr;
+
+    if(i<classes)
+    {
+        if(!cacheDestroyed && !cache.free[i].empty())
+        {
+            data = cache.free[i].back();
+            cache.free[i].pop_back();
+        }
+        else
+        {
+            Global& pool = global(
+                    cacheDestroyed?CpuSet::currentNode():cache.node);
+            std::lock_guard<std::mutex> lock(pool.mutex);
+            if(!pool.free[i].empty())
+            {
+                data = pool.free[i].back();
+                pool.free[i].pop_back();
+            }
+        }
+    }
+
+    ++stats.allocations;
+    if(data)
+        ++stats.hits;
+    else
+        data = new char[capacity];
+
+    const unsigned long long bytes = stats.bytes += capacity;
+    unsigned long long peak = stats.peakBytes;
+    while(bytes > peak && !stats.peakBytes.compare_exchange_weak(peak, bytes));
+
+    return std::unique_ptr<char[], Deleter>(data, Deleter(capacity));
+}
+
+std::shared_ptr<char> Fastcgipp::BlockPool::share(size_t size)
+{
+    auto data = allocate(size);
+    std::shared_ptr<char> shared(data.get(), data.get_deleter());
+    data.release();
+    return shared;
+}
+
+void Fastcgipp::BlockPool::release(char* data, size_t capacity)
+{
+    totals().bytes -= capacity;
+
+    const unsigned i = sizeClass(capacity);
+    if(i<classes && sizes[i] == capacity)
+    {
+        if(!cacheDestroyed && cache.free[i].size() < threadLimits[i])
+        {
+            cache.free[i].push_back(data);
+            return;
+        }
+
+        Global& pool = global(
+                cacheDestroyed?CpuSet::currentNode():cache.node);
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        if(pool.free[i].size() < globalLimits[i])
+        {
+            pool.free[i].push_back(data);
+            return;
+        }
+    }
+
+    delete [] data;
+}
+
+Fastcgipp::BlockPool::Stats Fastcgipp::BlockPool::stats()
+{
+    const Totals& totals = ::totals();
+    Stats stats;
+    stats.allocations = totals.allocations;
+    stats.hits = totals.hits;
+    stats.bytes = totals.bytes;
+    stats.peakBytes = totals.peakBytes;
+    return stats;
+}
 
 void Fastcgipp::Block::reserve(size_t x)
 {
     if(x != m_reserve)
     {
-        std::unique_ptr<char[]> data(new char[x]);
+        if(!m_shared && m_data && x <= m_data.get_deleter().capacity)
+        {
+            m_reserve = x;
+            m_size = std::min(m_size, x);
+            return;
+        }
+
+        auto data(BlockPool::allocate(x));
         size_t newSize = std::min(m_size, x);
         std::copy(
-                m_data.get(),
-                m_data.get()+newSize,
+                m_begin,
+                m_begin+newSize,
                 data.get());
 
         m_reserve = x;
         m_size = newSize;
         m_data = std::move(data);
-
+        m_shared.reset();
+        m_begin = m_data.get();
     }
 }
 
 Fastcgipp::Block::Block():
     m_reserve(0),
-    m_size(0)
+    m_size(0),
+    m_begin(nullptr)
 {}
 
 Fastcgipp::Block::Block(const size_t size_):
     m_reserve(size_),
     m_size(size_),
-    m_data(new char[size_])
+    m_data(BlockPool::allocate(size_)),
+    m_begin(m_data.get())
 {}
 
 Fastcgipp::Block::Block(const char* const data, const size_t size_):
     m_reserve(size_),
     m_size(size_),
-    m_data(new char[size_])
+    m_data(BlockPool::allocate(size_)),
+    m_begin(m_data.get())
 {
     std::copy(data, data+size_, m_data.get());
 }
 
+Fastcgipp::Block::Block(
+        const std::shared_ptr<char>& shared,
+        char* const begin,
+        const size_t size_):
+    m_reserve(size_),
+    m_size(size_),
+    m_shared(shared),
+    m_begin(begin)
+{}
+
 Fastcgipp::Block::Block(Block&& x):
     m_reserve(x.m_reserve),
     m_size(x.m_size),
-    m_data(std::move(x.m_data))
+    m_data(std::move(x.m_data)),
+    m_shared(std::move(x.m_shared)),
+    m_begin(x.m_begin)
 {
     x.m_reserve = 0;
     x.m_size = 0;
+    x.m_begin = nullptr;
 }
 
 Fastcgipp::Block& Fastcgipp::Block::operator=(Block&& x)
@@ -82,6 +318,9 @@ Fastcgipp::Block& Fastcgipp::Block::operator=(Block&& x)
     m_size = x.m_size;
     x.m_size = 0;
     m_data = std::move(x.m_data);
+    m_shared = std::move(x.m_shared);
+    m_begin = x.m_begin;
+    x.m_begin = nullptr;
     return *this;
 }
 
@@ -100,15 +339,19 @@ void Fastcgipp::Block::clear()
     m_reserve = 0;
     m_size = 0;
     m_data.reset();
+    m_shared.reset();
+    m_begin = nullptr;
 }
 
 void Fastcgipp::Block::assign(const char* const data, const size_t size_)
 {
-    if(size_ > m_reserve)
+    if(size_ > m_reserve || m_shared)
     {
-        m_data.reset(new char[size_]);
+        m_data = BlockPool::allocate(size_);
+        m_shared.reset();
+        m_begin = m_data.get();
         m_reserve = size_;
     }
     m_size = size_;
-    std::copy(data, data+size_, m_data.get());
+    std::copy(data, data+size_, m_begin);
 }
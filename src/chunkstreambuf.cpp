@@ -31,6 +31,7 @@
 #include <codecvt>
 #include <locale>
 #include <algorithm>
+#include <iterator>
 
 Fastcgipp::ChunkStreamBuf<char>::ChunkStreamBuf()
 {
@@ -45,29 +46,36 @@ void Fastcgipp::ChunkStreamBuf<char>::clear()
 
 void Fastcgipp::ChunkStreamBuf<char>::setBufferPtr()
 {
-    m_body.emplace_back();
+    grow();
     this->setp(
-            m_body.back().data.get(), 
-            m_body.back().data.get()+Chunk::capacity);
+            m_body.back().data.get(),
+            m_body.back().data.get()+m_body.back().capacity());
 }
 
 bool Fastcgipp::ChunkStreamBuf<char>::emptyBuffer()
 {
+    // Our body might have been moved out from under us
+    if(m_body.empty())
+    {
+        this->setp(nullptr, nullptr);
+        return false;
+    }
+
     m_body.back().size = this->pptr() - this->pbase();
-    if(m_body.back().size == Chunk::capacity)
+    if(m_body.back().size == m_body.back().capacity())
         setBufferPtr();
     return true;
 }
 
 Fastcgipp::ChunkStreamBuf<wchar_t>::ChunkStreamBuf()
 {
-    this->setp(m_buffer, m_buffer+Chunk::capacity);
+    this->setp(m_buffer, std::end(m_buffer));
 }
 
 void Fastcgipp::ChunkStreamBuf<wchar_t>::clear()
 {
     m_body.clear();
-    this->setp(m_buffer, m_buffer+Chunk::capacity);
+    this->setp(m_buffer, std::end(m_buffer));
 }
 
 bool Fastcgipp::ChunkStreamBuf<wchar_t>::emptyBuffer()
@@ -83,8 +91,8 @@ bool Fastcgipp::ChunkStreamBuf<wchar_t>::emptyBuffer()
     const wchar_t* from=this->pbase();
     const wchar_t* const fromEnd = this->pptr();
 
-    if(m_body.empty() || m_body.back().size == Chunk::capacity)
-        m_body.emplace_back();
+    if(m_body.empty() || m_body.back().size == m_body.back().capacity())
+        grow();
 
     while(true)
     {
@@ -94,7 +102,7 @@ bool Fastcgipp::ChunkStreamBuf<wchar_t>::emptyBuffer()
                 fromEnd,
                 from,
                 m_body.back().data.get()+m_body.back().size,
-                m_body.back().data.get()+Chunk::capacity,
+                m_body.back().data.get()+m_body.back().capacity(),
                 toNext);
 
         if(result == std::codecvt_base::error
@@ -111,9 +119,9 @@ bool Fastcgipp::ChunkStreamBuf<wchar_t>::emptyBuffer()
         if(count == 0)
             break;
         else
-            m_body.emplace_back();
+            grow();
     }
 
-    this->setp(m_buffer, m_buffer+Chunk::capacity);
+    this->setp(m_buffer, std::end(m_buffer));
     return true;
 }
@@ -0,0 +1,481 @@
+/*!
+ * @file       compressor.cpp
+ * @brief      Defines the Compressor class
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 15, 2026
+ * @copyright  Copyright &copy; 2026 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2026 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#include "fastcgi++/compressor.hpp"
+#include "fastcgi++/log.hpp"
+
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+
+#ifdef FASTCGIPP_ZLIB
+#include <zlib.h>
+#endif
+#ifdef FASTCGIPP_BROTLI
+#include <brotli/encode.h>
+#endif
+#ifdef FASTCGIPP_ZSTD
+#include <zstd.h>
+#endif
+
+namespace
+{
+    using Fastcgipp::Compression;
+
+    // Response bodies are compressed on the fly so the levels favour speed
+
+#ifdef FASTCGIPP_ZLIB
+    class Gzip: public Fastcgipp::Compressor
+    {
+    public:
+        Gzip():
+            Compressor(Compression::GZIP)
+        {
+            std::memset(&m_stream, 0, sizeof(m_stream));
+            if(deflateInit2(
+                        &m_stream,
+                        level,
+                        Z_DEFLATED,
+                        15+16,
+                        8,
+                        Z_DEFAULT_STRATEGY) != Z_OK)
+                FAIL_LOG("Unable to initialize zlib")
+        }
+
+        ~Gzip()
+        {
+            deflateEnd(&m_stream);
+        }
+
+        bool process(
+                const char*& input,
+                const char* inputEnd,
+                char*& output,
+                char* outputEnd,
+                Flush flush)
+        {
+            m_stream.next_in = reinterpret_cast<Bytef*>(
+                    const_cast<char*>(input));
+            m_stream.avail_in = inputEnd-input;
+            m_stream.next_out = reinterpret_cast<Bytef*>(output);
+            m_stream.avail_out = outputEnd-output;
+
+            const int result = deflate(
+                    &m_stream,
+                    flush==Flush::NONE?Z_NO_FLUSH:
+                        flush==Flush::SYNC?Z_SYNC_FLUSH:Z_FINISH);
+            input = reinterpret_cast<const char*>(m_stream.next_in);
+            output = reinterpret_cast<char*>(m_stream.next_out);
+
+            if(result == Z_STREAM_ERROR)
+            {
+                ERROR_LOG("zlib compression failed")
+                return true;
+            }
+            switch(flush)
+            {
+                case Flush::NONE:
+                    return m_stream.avail_in == 0;
+                case Flush::SYNC:
+                    return m_stream.avail_in == 0 && m_stream.avail_out != 0;
+                default:
+                    return result == Z_STREAM_END;
+            }
+        }
+
+    private:
+        static const int level = 5;
+
+        z_stream m_stream;
+
+        void reset()
+        {
+            deflateReset(&m_stream);
+        }
+    };
+#endif
+
+#ifdef FASTCGIPP_BROTLI
+    class Brotli: public Fastcgipp::Compressor
+    {
+    public:
+        Brotli():
+            Compressor(Compression::BROTLI),
+            m_state(nullptr)
+        {
+            reset();
+        }
+
+        ~Brotli()
+        {
+            BrotliEncoderDestroyInstance(m_state);
+        }
+
+        bool process(
+                const char*& input,
+                const char* inputEnd,
+                char*& output,
+                char* outputEnd,
+                Flush flush)
+        {
+            size_t availableIn = inputEnd-input;
+            const uint8_t* nextIn = reinterpret_cast<const uint8_t*>(input);
+            size_t availableOut = outputEnd-output;
+            uint8_t* nextOut = reinterpret_cast<uint8_t*>(output);
+
+            const bool success = BrotliEncoderCompressStream(
+                    m_state,
+                    flush==Flush::NONE?BROTLI_OPERATION_PROCESS:
+                        flush==Flush::SYNC?BROTLI_OPERATION_FLUSH:
+                        BROTLI_OPERATION_FINISH,
+                    &availableIn,
+                    &nextIn,
+                    &availableOut,
+                    &nextOut,
+                    nullptr);
+            input = reinterpret_cast<const char*>(nextIn);
+            output = reinterpret_cast<char*>(nextOut);
+
+            if(!success)
+            {
+                ERROR_LOG("Brotli compression failed")
+                return true;
+            }
+            switch(flush)
+            {
+                case Flush::NONE:
+                    return availableIn == 0;
+                case Flush::SYNC:
+                    return availableIn == 0
+                        && !BrotliEncoderHasMoreOutput(m_state);
+                default:
+                    return BrotliEncoderIsFinished(m_state);
+            }
+        }
+
+    private:
+        static const int quality = 4;
+
+        BrotliEncoderState* m_state;
+
+        //! Brotli can't reset a stream so we start over with a new one
+        void reset()
+        {
+            if(m_state)
+                BrotliEncoderDestroyInstance(m_state);
+            m_state = BrotliEncoderCreateInstance(nullptr, nullptr, nullptr);
+            if(m_state == nullptr)
+                FAIL_LOG("Unable to initialize brotli")
+            BrotliEncoderSetParameter(m_state, BROTLI_PARAM_QUALITY, quality);
+        }
+    };
+#endif
+
+#ifdef FASTCGIPP_ZSTD
+    class Zstd: public Fastcgipp::Compressor
+    {
+    public:
+        Zstd():
+            Compressor(Compression::ZSTD),
+            m_context(ZSTD_createCCtx())
+        {
+            if(m_context == nullptr)
+                FAIL_LOG("Unable to initialize zstd")
+            ZSTD_CCtx_setParameter(
+                    m_context,
+                    ZSTD_c_compressionLevel,
+                    level);
+        }
+
+        ~Zstd()
+        {
+            ZSTD_freeCCtx(m_context);
+        }
+
+        bool process(
+                const char*& input,
+                const char* inputEnd,
+                char*& output,
+                char* outputEnd,
+                Flush flush)
+        {
+            ZSTD_inBuffer in = {input, size_t(inputEnd-input), 0};
+            ZSTD_outBuffer out = {output, size_t(outputEnd-output), 0};
+
+            const size_t remaining = ZSTD_compressStream2(
+                    m_context,
+                    &out,
+                    &in,
+                    flush==Flush::NONE?ZSTD_e_continue:
+                        flush==Flush::SYNC?ZSTD_e_flush:ZSTD_e_end);
+            input += in.pos;
+            output += out.pos;
+
+            if(ZSTD_isError(remaining))
+            {
+                ERROR_LOG("zstd compression failed: " \
+                        << ZSTD_getErrorName(remaining))
+                return true;
+            }
+            if(flush == Flush::NONE)
+                return in.pos == in.size;
+            return remaining == 0;
+        }
+
+    private:
+        static const int level = 3;
+
+        ZSTD_CCtx* m_context;
+
+        void reset()
+        {
+            ZSTD_CCtx_reset(m_context, ZSTD_reset_session_only);
+        }
+    };
+#endif
+
+    //! How many idle compressors of each coding a thread holds on to
+    const size_t poolLimit = 8;
+
+    //! Idle compressors kept by a single thread
+    struct Pool
+    {
+        std::vector<Fastcgipp::Compressor*> free[4];
+
+        ~Pool();
+    };
+
+    //! Set once the calling thread's pool has been destroyed
+    thread_local bool poolDestroyed = false;
+
+    thread_local Pool pool;
+
+    Pool::~Pool()
+    {
+        poolDestroyed = true;
+        for(auto& compressors: free)
+            for(const auto compressor: compressors)
+                delete compressor;
+    }
+
+    //! Lower case ASCII
+    inline char lower(char x)
+    {
+        return x>='A' && x<='Z' ? x-'A'+'a' : x;
+    }
+
+    //! Pick the best content coding out of those available
+    template<class charT>
+    Compression choose(
+            const std::basic_string<charT>& acceptEncodings,
+            const Compression* const available,
+            const Compression* const availableEnd)
+    {
+        // Quality values indexed by compression with the asterisk last. A
+        // negative value means it wasn't mentioned.
+        double qualities[5] = {-1, -1, -1, -1, -1};
+
+        auto group = acceptEncodings.cbegin();
+        while(group != acceptEncodings.cend())
+        {
+            const auto groupEnd = std::find(
+                    group,
+                    acceptEncodings.cend(),
+                    charT(','));
+            const auto parameters = std::find(group, groupEnd, charT(';'));
+
+            std::string coding;
+            for(auto i=group; i!=parameters; ++i)
+                if(*i != ' ' && *i != '\t')
+                    coding.push_back(lower(char(*i)));
+
+            double quality = 1;
+            std::string parameter;
+            for(auto i=parameters; i!=groupEnd; ++i)
+                if(*i != ' ' && *i != '\t')
+                    parameter.push_back(lower(char(*i)));
+            if(parameter.compare(0, 3, ";q=") == 0)
+                quality = std::strtod(parameter.c_str()+3, nullptr);
+
+            if(coding == "gzip" || coding == "x-gzip")
+                qualities[static_cast<unsigned>(Compression::GZIP)] = quality;
+            else if(coding == "br")
+                qualities[static_cast<unsigned>(Compression::BROTLI)] = quality;
+            else if(coding == "zstd")
+                qualities[static_cast<unsigned>(Compression::ZSTD)] = quality;
+            else if(coding == "*")
+                qualities[4] = quality;
+
+            group = groupEnd;
+            if(group != acceptEncodings.cend())
+                ++group;
+        }
+
+        Compression chosen = Compression::NONE;
+        double best = 0;
+        for(
+                auto compression=available;
+                compression!=availableEnd;
+                ++compression)
+        {
+            if(*compression == Compression::NONE)
+                continue;
+            double quality = qualities[static_cast<unsigned>(*compression)];
+            if(quality < 0)
+                quality = qualities[4];
+            if(quality > best)
+            {
+                best = quality;
+                chosen = *compression;
+            }
+        }
+        return chosen;
+    }
+}
+
+void Fastcgipp::Compressor::Releaser::operator()(Compressor* compressor) const
+{
+    auto& free = pool.free[static_cast<unsigned>(compressor->compression())];
+    if(poolDestroyed || free.size() >= poolLimit)
+    {
+        delete compressor;
+        return;
+    }
+    compressor->reset();
+    free.push_back(compressor);
+}
+
+Fastcgipp::Compressor::Pointer Fastcgipp::Compressor::acquire(
+        Compression compression)
+{
+    if(!supported(compression))
+        return nullptr;
+
+    if(!poolDestroyed)
+    {
+        auto& free = pool.free[static_cast<unsigned>(compression)];
+        if(!free.empty())
+        {
+            Compressor* const compressor = free.back();
+            free.pop_back();
+            return Pointer(compressor);
+        }
+    }
+
+    switch(compression)
+    {
+#ifdef FASTCGIPP_ZLIB
+        case Compression::GZIP:
+            return Pointer(new Gzip);
+#endif
+#ifdef FASTCGIPP_BROTLI
+        case Compression::BROTLI:
+            return Pointer(new Brotli);
+#endif
+#ifdef FASTCGIPP_ZSTD
+        case Compression::ZSTD:
+            return Pointer(new Zstd);
+#endif
+        default:
+            return nullptr;
+    }
+}
+
+bool Fastcgipp::Compressor::supported(Compression compression)
+{
+    switch(compression)
+    {
+#ifdef FASTCGIPP_ZLIB
+        case Compression::GZIP:
+            return true;
+#endif
+#ifdef FASTCGIPP_BROTLI
+        case Compression::BROTLI:
+            return true;
+#endif
+#ifdef FASTCGIPP_ZSTD
+        case Compression::ZSTD:
+            return true;
+#endif
+        default:
+            return false;
+    }
+}
+
+const char* Fastcgipp::Compressor::name(Compression compression)
+{
+    switch(compression)
+    {
+        case Compression::GZIP:
+            return "gzip";
+        case Compression::BROTLI:
+            return "br";
+        case Compression::ZSTD:
+            return "zstd";
+        default:
+            return "identity";
+    }
+}
+
+template Fastcgipp::Compression Fastcgipp::Compressor::negotiate<char>(
+        const std::basic_string<char>& acceptEncodings);
+template Fastcgipp::Compression Fastcgipp::Compressor::negotiate<wchar_t>(
+        const std::basic_string<wchar_t>& acceptEncodings);
+template<class charT>
+Fastcgipp::Compression Fastcgipp::Compressor::negotiate(
+        const std::basic_string<charT>& acceptEncodings)
+{
+    static const Compression preference[] = {
+        Compression::BROTLI,
+        Compression::ZSTD,
+        Compression::GZIP};
+
+    Compression available[3];
+    const auto availableEnd = std::copy_if(
+            std::begin(preference),
+            std::end(preference),
+            available,
+            supported);
+    return choose(acceptEncodings, available, availableEnd);
+}
+
+template Fastcgipp::Compression Fastcgipp::Compressor::negotiate<char>(
+        const std::basic_string<char>& acceptEncodings,
+        std::initializer_list<Compression> available);
+template Fastcgipp::Compression Fastcgipp::Compressor::negotiate<wchar_t>(
+        const std::basic_string<wchar_t>& acceptEncodings,
+        std::initializer_list<Compression> available);
+template<class charT>
+Fastcgipp::Compression Fastcgipp::Compressor::negotiate(
+        const std::basic_string<charT>& acceptEncodings,
+        std::initializer_list<Compression> available)
+{
+    return choose(acceptEncodings, available.begin(), available.end());
+}
@@ -37,76 +37,152 @@
 #include "fastcgi++/log.hpp"
 
 #include <unistd.h>
+#include <sys/socket.h>
 #include <cstring>
+#include <algorithm>
+#include <vector>
+
+namespace
+{
+    //! Did a query never actually run because of an earlier failure?
+    /*!
+     * In pipeline mode that is either an earlier error in it's sync segment
+     * or the prepare of the statement it executes by name failing.
+     *
+     * @param[in] name Name of the statement the query executed. Empty if it
+     *                 was sent unprepared.
+     * @param[in] result Result received for the query.
+     */
+    bool aborted(const std::string& name, const PGresult* result)
+    {
+#ifdef LIBPQ_HAS_PIPELINING
+        if(PQresultStatus(result) == PGRES_PIPELINE_ABORTED)
+            return true;
+#endif
+        if(name.empty() || PQresultStatus(result) != PGRES_FATAL_ERROR)
+            return false;
+        const char* const state = PQresultErrorField(
+                result,
+                PG_DIAG_SQLSTATE);
+        return state != nullptr && std::strcmp(state, "26000") == 0;
+    }
+}
 
 void Fastcgipp::SQL::Connection::handler()
 {
+    if(!m_cpus.empty())
+        m_cpus.pin();
+
     killAll();
-    while(!m_terminate && !(m_stop && m_queue.empty()))
+    while(!m_terminate && !(m_stop && m_queued == 0))
     {
         // Get connected
         if(!connected()) connect();
+        const auto now = std::chrono::steady_clock::now();
 
         // Do we have a free connection?
-        for(
-                auto connection=m_connections.begin();
-                connection != m_connections.end();
-                ++connection)
+        for(auto connection=m_connections.begin();
+                connection != m_connections.end();)
         {
-            auto& idle = connection->second.idle;
-            if(idle)
+            Conn& conn = connection->second;
+            PGconn* const pgConn = reinterpret_cast<PGconn*>(conn.connection);
+            bool sent = false;
+            bool failed = false;
+
+            while(conn.queries < (conn.pipelined?m_pipeline:1))
             {
-                auto& conn = reinterpret_cast<PGconn*&>(
-                        connection->second.connection);
-                auto& query = connection->second.query;
+                Query query;
+                if(!take(query))
+                    break;
 
+#ifdef LIBPQ_HAS_PIPELINING
+                if((query.copy || query.batch) && conn.pipelined)
                 {
-                    std::lock_guard<std::mutex> lock(m_mutex);
-                    if(m_queue.empty())
+                    // COPY and streams have to wait for the pipeline to drain
+                    if(!conn.pending.empty())
+                    {
+                        requeue(query);
+                        break;
+                    }
+                    if(PQexitPipelineMode(pgConn) != 1)
+                    {
+                        requeue(query);
+                        failed = true;
                         break;
-                    query = m_queue.front();
-                    m_queue.pop_front();
+                    }
+                    conn.pipelined = false;
                 }
+#endif
 
-                int result;
-                if(query.parameters)
-                    result = PQsendQueryParams(
-                            conn,
-                            query.statement,
-                            query.parameters->size(),
-                            query.parameters->oids(),
-                            query.parameters->raws(),
-                            query.parameters->sizes(),
-                            query.parameters->formats(),
-                            1);
-                else
-                    result = PQsendQueryParams(
-                            conn,
-                            query.statement,
-                            0,
-                            nullptr,
-                            nullptr,
-                            nullptr,
-                            nullptr,
-                            1);
-
-                if(result != 1)
+                if(!dispatch(conn, query))
                 {
-                    ERROR_LOG("Unable to dispatch SQL query: " \
-                            << PQerrorMessage(conn))
-                    kill(connection);
+                    failed = true;
+                    break;
                 }
-                else
+                sent = true;
+
+#ifdef LIBPQ_HAS_PIPELINING
+                // An error aborts everything up to the next sync point so
+                // every query gets it's own to keep it from taking out others
+                if(conn.pipelined)
                 {
-                    PQflush(conn);
-                    idle = false;
+                    conn.pending.push_back(Pending(Pending::SYNC));
+                    if(PQpipelineSync(pgConn) != 1)
+                    {
+                        failed = true;
+                        break;
+                    }
                 }
+#endif
+            }
+
+            if(failed)
+            {
+                ERROR_LOG("Unable to dispatch SQL query: " \
+                        << PQerrorMessage(pgConn))
+                kill(connection);
+                continue;
+            }
+            if(sent && !flush(connection))
+            {
+                ERROR_LOG("Unable to flush SQL query: " \
+                        << PQerrorMessage(pgConn))
+                kill(connection);
+                continue;
             }
+
+            if(sent)
+                conn.active = now;
+            else if(conn.queries == 0
+                    && m_connections.size() > m_concurrency
+                    && now-conn.active >= m_idleTimeout)
+            {
+                // Shrink the pool back down
+                kill(connection);
+                continue;
+            }
+            ++connection;
         }
+        expire();
+
+        // Grow the pool if queries are backing up
+        if(connected()
+                && m_connections.size() < m_maxConcurrency
+                && backedUp(now))
+            open();
+
+        int timeout = -1;
+        if(!connected())
+            timeout = m_retry;
+        else if(m_queued && m_connections.size() < m_maxConcurrency)
+            timeout = m_growDelay.count();
+        else if(m_connections.size() > m_concurrency)
+            timeout = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    m_idleTimeout).count();
 
 
         // Let's see if any data is waiting for us from the connections
-        const auto pollResult = m_poll.poll(connected()?-1:m_retry);
+        const auto pollResult = m_poll.poll(timeout);
         if(pollResult)
         {
             if(pollResult.socket() == m_wakeSockets[1])
@@ -137,44 +213,37 @@ void Fastcgipp::SQL::Connection::handler()
                     continue;
                 }
 
+                if(pollResult.out())
+                {
+                    if(!copy(connection) || !flush(connection))
+                        ERROR_LOG("Unable to flush SQL query: " \
+                                << PQerrorMessage(reinterpret_cast<PGconn*>(
+                                        connection->second.connection)))
+                    else if(!pollResult.in() && !pollResult.hup()
+                            && !pollResult.rdHup() && !pollResult.err())
+                        continue;
+                }
+
                 if(pollResult.in())
                 {
-                    auto& conn = reinterpret_cast<PGconn*&>(
-                            connection->second.connection);
-                    auto& query = connection->second.query;
-                    auto& idle = connection->second.idle;
-                    if(idle)
+                    Conn& conn = connection->second;
+                    PGconn* const pgConn = reinterpret_cast<PGconn*>(
+                            conn.connection);
+                    if(conn.pending.empty())
                         ERROR_LOG("Recieved input data on SQL connection for "\
                                 "which there is no active query")
-                    else if(PQconsumeInput(conn) != 1)
+                    else if(PQconsumeInput(pgConn) != 1)
                         ERROR_LOG("Error consuming SQL input: " \
-                                << PQerrorMessage(conn))
+                                << PQerrorMessage(pgConn))
                     else
                     {
-                        PQflush(conn);
-                        while(PQisBusy(conn) == 0)
+                        if(!receive(conn)
+                                || !copy(connection)
+                                || !flush(connection))
                         {
-                            PGresult* result = PQgetResult(conn);
-                            if(result == nullptr)
-                            {
-                                // Query is complete
-                                idle = true;
-                                query.statement = nullptr;
-                                query.parameters.reset();
-                                query.results.reset();
-                                if(query.callback)
-                                    query.callback(m_messageType);
-                                break;
-                            }
-
-                            if(query.results->m_res == nullptr)
-                                query.results->m_res = result;
-                            else
-                            {
-                                WARNING_LOG("Multiple result sets received on"\
-                                        " query. Discarding extras.")
-                                PQclear(result);
-                            }
+                            ERROR_LOG("Unable to dispatch SQL query: " \
+                                    << PQerrorMessage(pgConn))
+                            kill(connection);
                         }
                         continue;
                     }
@@ -201,6 +270,451 @@ void Fastcgipp::SQL::Connection::handler()
     killAll();
 }
 
+bool Fastcgipp::SQL::Connection::flush(
+        std::map<socket_t, Conn>::iterator& connection)
+{
+    const int result = PQflush(
+            reinterpret_cast<PGconn*>(connection->second.connection));
+    if(result == -1)
+        return false;
+
+    // Only poll for writability while there is data stuck in libpq
+    const bool writing = result == 1;
+    if(writing != connection->second.writing)
+    {
+        m_poll.mod(connection->first, writing);
+        connection->second.writing = writing;
+    }
+    return true;
+}
+
+bool Fastcgipp::SQL::Connection::copy(
+        std::map<socket_t, Conn>::iterator& connection)
+{
+    if(connection->second.pending.empty())
+        return true;
+    Pending& pending = connection->second.pending.front();
+    if(!pending.copying)
+        return true;
+
+    PGconn* const conn = reinterpret_cast<PGconn*>(
+            connection->second.connection);
+    const Copy_base& copy = *pending.query.copy;
+    while(pending.copied < copy.size())
+    {
+        const size_t size = std::min(copy.size()-pending.copied, chunkSize);
+        const int result = PQputCopyData(
+                conn,
+                copy.data()+pending.copied,
+                size);
+        if(result == -1)
+            return false;
+        if(result == 0)
+        {
+            // Buffers are full so wait for writability
+            m_poll.mod(connection->first, true);
+            connection->second.writing = true;
+            return true;
+        }
+        pending.copied += size;
+    }
+
+    const int result = PQputCopyEnd(conn, nullptr);
+    if(result == -1)
+        return false;
+    if(result == 0)
+    {
+        m_poll.mod(connection->first, true);
+        connection->second.writing = true;
+        return true;
+    }
+    pending.copying = false;
+    return true;
+}
+
+void Fastcgipp::SQL::Connection::requeue(const Query& query)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_queue[std::min(query.priority, priorities-1)].push_front(Queued(query));
+    ++m_queued;
+}
+
+bool Fastcgipp::SQL::Connection::send(
+        Conn& connection,
+        const Query& query,
+        const char* name)
+{
+    PGconn* const conn = reinterpret_cast<PGconn*>(connection.connection);
+    const int size = query.parameters?query.parameters->size():0;
+    const char* const* const raws
+        = query.parameters?query.parameters->raws():nullptr;
+    const int* const sizes
+        = query.parameters?query.parameters->sizes():nullptr;
+    const int* const formats
+        = query.parameters?query.parameters->formats():nullptr;
+
+    const bool sent = name?
+        PQsendQueryPrepared(
+                conn,
+                name,
+                size,
+                raws,
+                sizes,
+                formats,
+                1) == 1:
+        PQsendQueryParams(
+                conn,
+                query.statement,
+                size,
+                query.parameters?query.parameters->oids():nullptr,
+                raws,
+                sizes,
+                formats,
+                1) == 1;
+
+    // Without single row mode the results simply come in one batch
+    if(sent && query.batch && PQsetSingleRowMode(conn) != 1)
+        WARNING_LOG("Unable to stream SQL results in single row mode")
+    return sent;
+}
+
+Fastcgipp::SQL::Connection::Pending::Pending(
+        Type type_,
+        const Query& query_):
+    type(type_),
+    query(query_),
+    prepared(false),
+    aborted(false),
+    copying(false),
+    copied(0),
+    stream(query.batch?
+            dynamic_cast<ResultStream_base*>(query.results.get()):nullptr),
+    rows(nullptr),
+    batches(0)
+{
+    if(type == QUERY && query.batch && stream == nullptr)
+        ERROR_LOG("SQL query results with a batch size aren't "\
+                "StreamResults")
+}
+
+Fastcgipp::SQL::Connection::Pending::Pending(Pending&& x):
+    type(x.type),
+    query(std::move(x.query)),
+    name(std::move(x.name)),
+    prepared(x.prepared),
+    aborted(x.aborted),
+    copying(x.copying),
+    copied(x.copied),
+    stream(x.stream),
+    rows(x.rows),
+    batches(x.batches)
+{
+    x.rows = nullptr;
+}
+
+Fastcgipp::SQL::Connection::Pending::~Pending()
+{
+    if(rows != nullptr)
+        PQclear(reinterpret_cast<PGresult*>(rows));
+}
+
+void Fastcgipp::SQL::Connection::stream(Pending& pending, void* result)
+{
+    PGresult* const row = reinterpret_cast<PGresult*>(result);
+    PGresult*& rows = reinterpret_cast<PGresult*&>(pending.rows);
+    if(rows == nullptr)
+        rows = PQcopyResult(row, PG_COPYRES_ATTRS);
+
+    if(rows != nullptr)
+    {
+        const int index = PQntuples(rows);
+        for(int column=0; column<PQnfields(row); ++column)
+            PQsetvalue(
+                    rows,
+                    index,
+                    column,
+                    PQgetvalue(row, 0, column),
+                    PQgetisnull(row, 0, column)?
+                        -1:PQgetlength(row, 0, column));
+    }
+    else
+        ERROR_LOG("Unable to allocate batch for streamed SQL rows")
+    PQclear(row);
+
+    if(rows != nullptr
+            && PQntuples(rows) >= static_cast<int>(pending.query.batch))
+    {
+        deliver(pending);
+        if(pending.query.callback)
+            pending.query.callback(m_messageType);
+    }
+}
+
+void Fastcgipp::SQL::Connection::deliver(Pending& pending)
+{
+    if(pending.rows != nullptr)
+    {
+        pending.stream->push(pending.rows);
+        pending.rows = nullptr;
+        ++pending.batches;
+    }
+}
+
+bool Fastcgipp::SQL::Connection::dispatch(Conn& connection, const Query& query)
+{
+    ++connection.queries;
+
+    if(query.copy)
+    {
+        connection.pending.push_back(Pending(Pending::QUERY, query));
+        return send(connection, query, nullptr);
+    }
+
+    const auto statement = connection.statements.find(query.statement);
+    if(statement != connection.statements.end()
+            && statement->second.text == query.statement)
+    {
+        if(statement->second.name.empty())
+        {
+            // Preparing it failed before so don't bother again
+            ++m_statementMisses;
+            connection.pending.push_back(Pending(Pending::QUERY, query));
+            return send(connection, query, nullptr);
+        }
+        ++m_statementHits;
+        connection.pending.push_back(Pending(Pending::QUERY, query));
+        connection.pending.back().name = statement->second.name;
+        return send(connection, query, statement->second.name.c_str());
+    }
+
+    ++m_statementMisses;
+    if(statement == connection.statements.end()
+            && connection.statements.size() >= maxStatements)
+    {
+        connection.pending.push_back(Pending(Pending::QUERY, query));
+        return send(connection, query, nullptr);
+    }
+
+    connection.pending.push_back(Pending(Pending::PREPARE, query));
+    Pending& prepare = connection.pending.back();
+    prepare.name = "fastcgipp" + std::to_string(connection.names++);
+    if(PQsendPrepare(
+                reinterpret_cast<PGconn*>(connection.connection),
+                prepare.name.c_str(),
+                query.statement,
+                query.parameters?query.parameters->size():0,
+                query.parameters?query.parameters->oids():nullptr) != 1)
+    {
+        // Make sure kill() puts the query back in the queue
+        prepare.type = Pending::QUERY;
+        return false;
+    }
+
+    // Without pipelining the query has to wait for the prepare to complete
+    if(!connection.pipelined)
+        return true;
+
+    auto& cached = connection.statements[query.statement];
+    cached.text = query.statement;
+    cached.name = prepare.name;
+    connection.pending.push_back(Pending(Pending::QUERY, query));
+    connection.pending.back().name = cached.name;
+    return send(connection, query, cached.name.c_str());
+}
+
+bool Fastcgipp::SQL::Connection::receive(Conn& connection)
+{
+    PGconn* const conn = reinterpret_cast<PGconn*>(connection.connection);
+
+    while(!connection.pending.empty() && PQisBusy(conn) == 0)
+    {
+        Pending& pending = connection.pending.front();
+
+        // No results come until all the copy data is sent
+        if(pending.copying)
+            break;
+
+        PGresult* const result = PQgetResult(conn);
+
+        if(pending.type == Pending::SYNC)
+        {
+            // A sync point isn't followed by a null result
+            if(result == nullptr)
+                break;
+            PQclear(result);
+            connection.pending.pop_front();
+            continue;
+        }
+
+        if(result != nullptr)
+        {
+            if(pending.type == Pending::PREPARE)
+            {
+                pending.prepared = PQresultStatus(result) == PGRES_COMMAND_OK;
+                if(!pending.prepared)
+                    WARNING_LOG("Unable to prepare SQL statement: " \
+                            << PQresultErrorMessage(result))
+                PQclear(result);
+            }
+            else if(aborted(pending.name, result))
+            {
+                pending.aborted = true;
+                PQclear(result);
+            }
+            else if(PQresultStatus(result) == PGRES_COPY_IN)
+            {
+                pending.copying = true;
+                PQclear(result);
+                break;
+            }
+            else if(pending.stream
+                    && PQresultStatus(result) == PGRES_SINGLE_TUPLE)
+                stream(pending, result);
+            else if(pending.stream)
+            {
+                // The final result goes in it's own batch
+                deliver(pending);
+                pending.stream->push(result);
+            }
+            else if(pending.query.results->m_res == nullptr)
+                pending.query.results->m_res = result;
+            else
+            {
+                WARNING_LOG("Multiple result sets received on query. "\
+                        "Discarding extras.")
+                PQclear(result);
+            }
+            continue;
+        }
+
+        if(pending.type == Pending::PREPARE)
+        {
+            // Prepare is complete
+            if(connection.pipelined)
+            {
+                // The query behind it gets aborted and retried unprepared
+                if(!pending.prepared)
+                    connection.statements[pending.query.statement].name.clear();
+                connection.pending.pop_front();
+                continue;
+            }
+
+            if(pending.prepared)
+            {
+                auto& cached = connection.statements[pending.query.statement];
+                cached.text = pending.query.statement;
+                cached.name = pending.name;
+            }
+            pending.type = Pending::QUERY;
+            if(!pending.prepared)
+                pending.name.clear();
+            if(!send(
+                        connection,
+                        pending.query,
+                        pending.prepared?pending.name.c_str():nullptr))
+                return false;
+            continue;
+        }
+
+        if(pending.aborted)
+        {
+            // It never ran so put it back to be sent again
+            requeue(pending.query);
+            connection.pending.pop_front();
+            --connection.queries;
+            continue;
+        }
+
+        // Query is complete
+        if(pending.stream)
+        {
+            deliver(pending);
+            pending.stream->finish();
+        }
+        const auto callback = std::move(pending.query.callback);
+        connection.pending.pop_front();
+        --connection.queries;
+        connection.active = std::chrono::steady_clock::now();
+#ifdef LIBPQ_HAS_PIPELINING
+        if(!connection.pipelined
+                && m_pipeline > 1
+                && connection.pending.empty())
+        {
+            // Back to pipelining after a COPY
+            if(PQenterPipelineMode(conn) != 1)
+                return false;
+            connection.pipelined = true;
+        }
+#endif
+        if(callback)
+            callback(m_messageType);
+    }
+
+    return true;
+}
+
+bool Fastcgipp::SQL::Connection::take(Query& query)
+{
+    const auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for(auto& lane: m_queue)
+        while(!lane.empty())
+        {
+            Query& front = lane.front().query;
+            const bool expired
+                = front.deadline != std::chrono::steady_clock::time_point()
+                && front.deadline < now;
+            if(expired)
+                m_expired.push_back(std::move(front));
+            else
+                query = std::move(front);
+            lane.pop_front();
+            --m_queued;
+            if(!expired)
+                return true;
+        }
+    return false;
+}
+
+void Fastcgipp::SQL::Connection::expire()
+{
+    while(!m_expired.empty())
+    {
+        Query& query = m_expired.front();
+        if(query.results)
+            query.results->m_expired = true;
+        const auto callback = std::move(query.callback);
+        m_expired.pop_front();
+        if(callback)
+            callback(m_messageType);
+    }
+}
+
+bool Fastcgipp::SQL::Connection::backedUp(
+        std::chrono::steady_clock::time_point now)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(m_queued > m_connections.size())
+        return true;
+    for(const auto& lane: m_queue)
+        if(!lane.empty() && now-lane.front().time >= m_growDelay)
+            return true;
+    return false;
+}
+
+void Fastcgipp::SQL::Connection::pool(
+        unsigned maximum,
+        unsigned idleTimeout,
+        unsigned growDelay)
+{
+    if(!m_thread.joinable())
+    {
+        m_maxConcurrency = std::max(maximum, m_concurrency);
+        m_idleTimeout = std::chrono::seconds(idleTimeout);
+        m_growDelay = std::chrono::milliseconds(growDelay);
+    }
+}
+
 void Fastcgipp::SQL::Connection::stop()
 {
     m_stop=true;
@@ -251,7 +765,8 @@ void Fastcgipp::SQL::Connection::init(
         const unsigned concurrency,
         const unsigned short port,
         int messageType,
-        unsigned retryInterval)
+        unsigned retryInterval,
+        unsigned pipeline)
 {
     if(!m_initialized)
     {
@@ -262,9 +777,20 @@ void Fastcgipp::SQL::Connection::init(
         m_username = username;
         m_password = password;
         m_concurrency = concurrency;
+        m_maxConcurrency = concurrency;
+        m_idleTimeout = std::chrono::seconds(60);
+        m_growDelay = std::chrono::milliseconds(10);
         m_port = std::to_string(port);
         m_messageType = messageType;
         m_retry = retryInterval*1000;
+#ifdef LIBPQ_HAS_PIPELINING
+        m_pipeline = pipeline?pipeline:1;
+#else
+        if(pipeline > 1)
+            WARNING_LOG("This libpq doesn't support pipeline mode. Running "\
+                    "one query per SQL connection.")
+        m_pipeline = 1;
+#endif
         m_initialized = true;
     }
 }
@@ -275,9 +801,13 @@ bool Fastcgipp::SQL::Connection::queue(const Query& query)
     {
         if(query.parameters)
             query.parameters->build();
+        if(query.copy)
+            query.copy->finish();
 
         std::lock_guard<std::mutex> lock(m_mutex);
-        m_queue.push_back(query);
+        m_queue[std::min(query.priority, priorities-1)].push_back(
+                Queued(query));
+        ++m_queued;
         wake();
         return true;
     }
@@ -286,56 +816,97 @@ bool Fastcgipp::SQL::Connection::queue(const Query& query)
 
 void Fastcgipp::SQL::Connection::connect()
 {
-    while(!connected())
+    while(!connected() && open());
+}
+
+bool Fastcgipp::SQL::Connection::open()
+{
+    Conn conn;
+    conn.connection = PQsetdbLogin(
+            m_host.c_str(),
+            m_port.c_str(),
+            nullptr,
+            nullptr,
+            m_db.c_str(),
+            m_username.c_str(),
+            m_password.c_str());
+    auto& connection = reinterpret_cast<PGconn*&>(conn.connection);
+    if(connection == nullptr)
     {
-        Conn conn;
-        conn.connection = PQsetdbLogin(
-                m_host.c_str(),
-                m_port.c_str(),
-                nullptr,
-                nullptr,
-                m_db.c_str(),
-                m_username.c_str(),
-                m_password.c_str());
-        auto& connection = reinterpret_cast<PGconn*&>(conn.connection);
-        if(connection == nullptr)
-        {
-            ERROR_LOG("Error initiating connection to postgresql server: " \
-                    << PQerrorMessage(connection))
-            break;
-        }
-        if(PQstatus(connection) != CONNECTION_OK)
-        {
-            ERROR_LOG("Error connecting to postgresql server: " \
-                    << PQerrorMessage(connection))
-            PQfinish(connection);
-            break;
-        }
-        if(PQsetnonblocking(connection, 1) != 0)
+        ERROR_LOG("Error initiating connection to postgresql server: " \
+                << PQerrorMessage(connection))
+        return false;
+    }
+    if(PQstatus(connection) != CONNECTION_OK)
+    {
+        ERROR_LOG("Error connecting to postgresql server: " \
+                << PQerrorMessage(connection))
+        PQfinish(connection);
+        return false;
+    }
+    if(PQsetnonblocking(connection, 1) != 0)
+    {
+        ERROR_LOG("Error setting nonblock on postgresql connection: " \
+                << PQerrorMessage(connection))
+        PQfinish(connection);
+        return false;
+    }
+
+    conn.queries = 0;
+    conn.names = 0;
+    conn.pipelined = false;
+    conn.writing = false;
+    conn.active = std::chrono::steady_clock::now();
+#ifdef LIBPQ_HAS_PIPELINING
+    if(m_pipeline > 1)
+    {
+        if(PQenterPipelineMode(connection) != 1)
         {
-            ERROR_LOG("Error setting nonblock on postgresql connection: " \
-                    << PQerrorMessage(connection))
+            ERROR_LOG("Error entering pipeline mode on postgresql "\
+                    "connection: " << PQerrorMessage(connection))
             PQfinish(connection);
-            break;
+            return false;
         }
-
-        conn.idle = true;
-        const auto socket = PQsocket(connection);
-        m_poll.add(socket);
-        m_connections[socket] = conn;
+        conn.pipelined = true;
     }
+#endif
+    const auto socket = PQsocket(connection);
+    m_poll.add(socket);
+    m_connections[socket] = std::move(conn);
+    return true;
 }
 
 void Fastcgipp::SQL::Connection::kill(std::map<socket_t, Conn>::iterator& conn)
 {
     PQfinish(reinterpret_cast<PGconn*>(conn->second.connection));
     m_poll.del(conn->first);
-    if(!conn->second.idle)
+    std::vector<std::function<void(Message)>> callbacks;
     {
+        // Without pipelining a pending prepare holds the only copy of it's
+        // query. With it the query has it's own entry.
         std::lock_guard<std::mutex> lock(m_mutex);
-        m_queue.push_front(conn->second.query);
+        auto& pending = conn->second.pending;
+        for(auto it = pending.rbegin(); it != pending.rend(); ++it)
+            if(it->stream && it->batches)
+            {
+                // Rows were already delivered so we can't start over
+                deliver(*it);
+                it->stream->finish();
+                if(it->query.callback)
+                    callbacks.push_back(std::move(it->query.callback));
+            }
+            else if(it->type == Pending::QUERY
+                    || (it->type == Pending::PREPARE
+                        && !conn->second.pipelined))
+            {
+                m_queue[std::min(it->query.priority, priorities-1)]
+                    .push_front(Queued(it->query));
+                ++m_queued;
+            }
     }
-    m_connections.erase(conn);
+    conn = m_connections.erase(conn);
+    for(const auto& callback: callbacks)
+        callback(m_messageType);
 }
 
 void Fastcgipp::SQL::Connection::killAll()
@@ -347,5 +918,9 @@ void Fastcgipp::SQL::Connection::killAll()
     }
     m_connections.clear();
     std::lock_guard<std::mutex> lock(m_mutex);
-    m_queue.clear();
+    for(auto& lane: m_queue)
+        lane.clear();
+    m_queued = 0;
 }
+
+const size_t Fastcgipp::SQL::Connection::chunkSize;
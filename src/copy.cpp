@@ -0,0 +1,73 @@
+/*!
+ * @file       copy.cpp
+ * @brief      Defines %SQL bulk copy types
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 14, 2026
+ * @copyright  Copyright &copy; 2026 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2026 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#include "fastcgi++/sql/copy.hpp"
+#include "fastcgi++/endian.hpp"
+
+#include <algorithm>
+
+namespace
+{
+    //! Signature starting the binary COPY format
+    const char signature[] = "PGCOPY\n\377\r\n";
+}
+
+Fastcgipp::SQL::Copy_base::Copy_base():
+    m_rows(0),
+    m_finished(false)
+{
+    // The signature includes it's null terminator
+    m_data.insert(m_data.end(), signature, signature+sizeof(signature));
+
+    // Flags and header extension length
+    m_data.resize(m_data.size()+2*sizeof(int32_t), 0);
+}
+
+void Fastcgipp::SQL::Copy_base::row(int16_t fields)
+{
+    const BigEndian<int16_t> count(fields);
+    m_data.insert(m_data.end(), count.data(), count.data()+count.size());
+    ++m_rows;
+}
+
+void Fastcgipp::SQL::Copy_base::field(const char* data, int32_t size)
+{
+    const BigEndian<int32_t> length(size);
+    m_data.insert(m_data.end(), length.data(), length.data()+length.size());
+    m_data.insert(m_data.end(), data, data+size);
+}
+
+void Fastcgipp::SQL::Copy_base::finish()
+{
+    if(!m_finished)
+    {
+        row(-1);
+        --m_rows;
+        m_finished = true;
+    }
+}
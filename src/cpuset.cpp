@@ -0,0 +1,196 @@
+/*!
+ * @file       cpuset.cpp
+ * @brief      Defines the CpuSet class
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 15, 2026
+ * @copyright  Copyright &copy; 2026 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2026 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#include "fastcgi++/cpuset.hpp"
+#include "fastcgi++/log.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <thread>
+
+#ifdef FASTCGIPP_LINUX
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace
+{
+    //! One past the highest CPU a thread could ever be pinned to
+#ifdef FASTCGIPP_LINUX
+    const unsigned maxCpus = CPU_SETSIZE;
+#else
+    const unsigned maxCpus = 1024;
+#endif
+
+    //! What NUMA node each CPU belongs to
+    struct Topology
+    {
+        //! Node of each CPU indexed by CPU
+        std::vector<unsigned> nodes;
+
+        //! Number of NUMA nodes
+        unsigned count;
+
+        Topology():
+            count(1)
+        {
+            for(unsigned node=0; true; ++node)
+            {
+                std::ifstream file("/sys/devices/system/node/node"
+                        +std::to_string(node)+"/cpulist");
+                std::string list;
+                if(!std::getline(file, list))
+                    break;
+                const Fastcgipp::CpuSet set(Fastcgipp::CpuSet::parse(list));
+                for(const unsigned cpu: set.cpus())
+                {
+                    if(cpu >= nodes.size())
+                        nodes.resize(cpu+1, 0);
+                    nodes[cpu] = node;
+                }
+                count = node+1;
+            }
+        }
+    };
+
+    //! The topology is never destroyed
+    /*!
+     * Blocks released during static destruction look up the current node
+     * so it must always be there for them.
+     */
+    const Topology& topology()
+    {
+        static const Topology& topology = *new Topology;
+        return topology;
+    }
+}
+
+Fastcgipp::CpuSet::CpuSet(std::initializer_list<unsigned> cpus):
+    m_cpus(cpus),
+    m_spread(false)
+{
+    std::sort(m_cpus.begin(), m_cpus.end());
+    m_cpus.erase(std::unique(m_cpus.begin(), m_cpus.end()), m_cpus.end());
+}
+
+Fastcgipp::CpuSet Fastcgipp::CpuSet::parse(const std::string& list)
+{
+    CpuSet set;
+    std::istringstream stream(list);
+    std::string range;
+    while(std::getline(stream, range, ','))
+    {
+        unsigned first;
+        unsigned last;
+        char dash;
+        std::istringstream parser(range);
+        if(!(parser >> first) || first >= maxCpus)
+            continue;
+        if(!(parser >> dash >> last) || dash != '-' || last < first)
+            last = first;
+        last = std::min(last, maxCpus-1);
+        for(unsigned cpu=first; cpu<=last; ++cpu)
+            set.m_cpus.push_back(cpu);
+    }
+    std::sort(set.m_cpus.begin(), set.m_cpus.end());
+    set.m_cpus.erase(
+            std::unique(set.m_cpus.begin(), set.m_cpus.end()),
+            set.m_cpus.end());
+    return set;
+}
+
+Fastcgipp::CpuSet Fastcgipp::CpuSet::node(unsigned node)
+{
+    CpuSet set;
+    const Topology& system = topology();
+    if(system.nodes.empty())
+    {
+        if(node == 0)
+        {
+            const unsigned cpus = std::thread::hardware_concurrency();
+            for(unsigned cpu=0; cpu<cpus; ++cpu)
+                set.m_cpus.push_back(cpu);
+        }
+        return set;
+    }
+
+    for(unsigned cpu=0; cpu<system.nodes.size(); ++cpu)
+        if(system.nodes[cpu] == node)
+            set.m_cpus.push_back(cpu);
+    return set;
+}
+
+unsigned Fastcgipp::CpuSet::nodes()
+{
+    return topology().count;
+}
+
+unsigned Fastcgipp::CpuSet::nodeOf(unsigned cpu)
+{
+    const Topology& system = topology();
+    return cpu < system.nodes.size() ? system.nodes[cpu] : 0;
+}
+
+unsigned Fastcgipp::CpuSet::currentNode()
+{
+#ifdef FASTCGIPP_LINUX
+    const int cpu = sched_getcpu();
+    if(cpu >= 0)
+        return nodeOf(cpu);
+#endif
+    return 0;
+}
+
+bool Fastcgipp::CpuSet::pin(unsigned index) const
+{
+    if(m_cpus.empty())
+        return true;
+#ifdef FASTCGIPP_LINUX
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for(const unsigned cpu: m_cpus)
+        if(cpu < CPU_SETSIZE
+                && (!m_spread || cpu == m_cpus[index%m_cpus.size()]))
+            CPU_SET(cpu, &set);
+
+    const int error = pthread_setaffinity_np(
+            pthread_self(),
+            sizeof(set),
+            &set);
+    if(error)
+    {
+        WARNING_LOG("Unable to pin thread to CPUs: " << std::strerror(error))
+        return false;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
@@ -33,6 +33,61 @@
 #include <locale>
 #include <algorithm>
 #include <iostream>
+#include <vector>
+#include <mutex>
+
+namespace
+{
+    // Easy handles hold on to their buffers and other resources so rather
+    // than creating one for every request we recycle them. Whatever options
+    // the previous request set are wiped by curl_easy_reset() beforehand.
+
+    const size_t maxPooledHandles = 64;
+
+    struct HandlePool
+    {
+        std::vector<CURL*> handles;
+        std::mutex mutex;
+    };
+
+    // Never destroyed so handles can still be returned by static Curl objects
+    // at exit
+    HandlePool& handlePool()
+    {
+        static HandlePool* const pool = new HandlePool;
+        return *pool;
+    }
+
+    CURL* takeHandle()
+    {
+        HandlePool& pool(handlePool());
+        {
+            std::lock_guard<std::mutex> lock(pool.mutex);
+            if(!pool.handles.empty())
+            {
+                CURL* const handle = pool.handles.back();
+                pool.handles.pop_back();
+                return handle;
+            }
+        }
+        return curl_easy_init();
+    }
+
+    void returnHandle(CURL* handle)
+    {
+        HandlePool& pool(handlePool());
+        curl_easy_reset(handle);
+        {
+            std::lock_guard<std::mutex> lock(pool.mutex);
+            if(pool.handles.size() < maxPooledHandles)
+            {
+                pool.handles.push_back(handle);
+                return;
+            }
+        }
+        curl_easy_cleanup(handle);
+    }
+}
 
 template<class charT>
 Fastcgipp::Curl<charT>::Curl():
@@ -161,17 +216,32 @@ void Fastcgipp::Curl_base::prepare()
     CURL* const& handle(reinterpret_cast<CURL* const&>(m_streamBuf->m_handle));
 
     long size=0;
+    unsigned filled=0;
+    const char* data=nullptr;
     close();
     for(const auto& chunk: m_streamBuf->m_data)
-        size += chunk.size;
+        if(chunk.size)
+        {
+            size += chunk.size;
+            data = chunk.data.get();
+            ++filled;
+        }
 
     if(size > 0)
     {
-        m_streamBuf->m_readCounter = 0;
         curl_easy_setopt(handle, CURLOPT_POST, 1L);
         curl_easy_setopt(handle, CURLOPT_POSTFIELDSIZE, size);
-        curl_easy_setopt(handle, CURLOPT_READFUNCTION, readCallback);
-        curl_easy_setopt(handle, CURLOPT_READDATA, m_streamBuf.get());
+        if(filled == 1)
+            // A single chunk is handed to libcurl as is with no copying
+            curl_easy_setopt(handle, CURLOPT_POSTFIELDS, data);
+        else
+        {
+            m_streamBuf->m_readChunk = 0;
+            m_streamBuf->m_readCounter = 0;
+            curl_easy_setopt(handle, CURLOPT_POSTFIELDS, nullptr);
+            curl_easy_setopt(handle, CURLOPT_READFUNCTION, readCallback);
+            curl_easy_setopt(handle, CURLOPT_READDATA, m_streamBuf.get());
+        }
     }
     else
         curl_easy_setopt(handle, CURLOPT_HTTPGET, 1L);
@@ -196,8 +266,8 @@ void Fastcgipp::Curl_base::reset()
 }
 
 Fastcgipp::Curl_base::StreamBuf_base::StreamBuf_base(
-        std::list<Fastcgipp::ChunkStreamBuf_base::Chunk>& data):
-    m_handle(curl_easy_init()),
+        Fastcgipp::ChunkStreamBuf_base::Chunks& data):
+    m_handle(takeHandle()),
     m_headers(nullptr),
     m_data(data)
 {
@@ -210,7 +280,7 @@ Fastcgipp::Curl_base::StreamBuf_base::~StreamBuf_base()
     curl_slist* const& headers(reinterpret_cast<curl_slist* const&>(m_headers));
     if(headers)
         curl_slist_free_all(headers);
-    curl_easy_cleanup(handle);
+    returnHandle(handle);
 }
 
 size_t Fastcgipp::Curl_base::readCallback(
@@ -223,9 +293,10 @@ size_t Fastcgipp::Curl_base::readCallback(
     unsigned writeSpace = size*items;
     size_t written = 0;
 
-    while(writeSpace > 0 && !streamBuf.m_data.empty())
+    while(writeSpace > 0 && streamBuf.m_readChunk < streamBuf.m_data.size())
     {
-        const ChunkStreamBuf_base::Chunk& chunk(streamBuf.m_data.front());
+        const ChunkStreamBuf_base::Chunk& chunk(
+                streamBuf.m_data[streamBuf.m_readChunk]);
         const char* const start = chunk.data.get()+streamBuf.m_readCounter;
         const size_t actualSize = std::min(
                 writeSpace,
@@ -236,7 +307,7 @@ size_t Fastcgipp::Curl_base::readCallback(
         streamBuf.m_readCounter += actualSize;
         if(streamBuf.m_readCounter >= chunk.size)
         {
-            streamBuf.m_data.pop_front();
+            ++streamBuf.m_readChunk;
             streamBuf.m_readCounter = 0;
         }
 
@@ -25,30 +25,46 @@
 * along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
 *******************************************************************************/
 
+
 #include "fastcgi++/curler.hpp"
 #include "fastcgi++/log.hpp"
 
 #include <curl/curl.h>
 #include <unistd.h>
 #include <cstring>
+#include <algorithm>
 
-void Fastcgipp::Curler::handler()
+void Fastcgipp::Curler::Loop::handler(unsigned index)
 {
     CURLM* const& multiHandle(reinterpret_cast<CURL* const&>(m_multiHandle));
     std::unique_lock<std::mutex> lock(m_mutex);
     int handles = 0;
     long timeout = -1;
 
-    while(!m_terminate && !(m_stop && m_queue.empty() && m_handles.empty()))
+    if(!m_curler.m_cpus.empty())
+        m_curler.m_cpus.pin(index);
+
+    while(!m_curler.m_terminate && !(
+                m_curler.m_stop && m_queue.empty() && m_handles.empty()))
     {
-        if(!m_queue.empty() && m_handles.size() < m_concurrency)
+        if(!m_queue.empty() && m_handles.size() < m_curler.m_concurrency)
         {
-            while(!m_queue.empty() && m_handles.size() < m_concurrency)
+            while(!m_queue.empty()
+                    && m_handles.size() < m_curler.m_concurrency)
             {
                 CURL* const& handle(reinterpret_cast<CURL* const&>(
                             m_queue.front().handle()));
                 m_handles.emplace(handle, m_queue.front());
                 m_queue.pop();
+                curl_easy_setopt(
+                        handle,
+                        CURLOPT_SHARE,
+                        m_curler.m_shareHandle);
+                curl_easy_setopt(
+                        handle,
+                        CURLOPT_HTTP_VERSION,
+                        CURL_HTTP_VERSION_2TLS);
+                curl_easy_setopt(handle, CURLOPT_PIPEWAIT, 1L);
                 if(curl_multi_add_handle(multiHandle, handle))
                     FAIL_LOG("Unable to add curl handle to multi");
             }
@@ -100,6 +116,8 @@ void Fastcgipp::Curler::handler()
                 Curl_base curl = curlIt->second;
                 m_handles.erase(curlIt);
                 curl_multi_remove_handle(multiHandle, curl.handle());
+                curl_easy_setopt(curl.handle(), CURLOPT_SHARE, nullptr);
+                --m_outstanding;
                 curl.callback();
             }
         }
@@ -107,23 +125,33 @@ void Fastcgipp::Curler::handler()
         lock.lock();
     }
 }
-int Fastcgipp::Curler::socketCallback(
+
+int Fastcgipp::Curler::Loop::socketCallback(
         void* handle,
         int socket,
         int action,
         void *userp,
         void *socketp)
 {
-    Curler& curler(*reinterpret_cast<Curler*>(userp));
+    Loop& loop(*reinterpret_cast<Loop*>(userp));
     if(action == CURL_POLL_REMOVE)
-        curler.m_poll.del(socket);
+        loop.m_poll.del(socket);
     else
-        curler.m_poll.add(socket);
+    {
+        // Large uploads stall unless we poll for writability when asked
+        loop.m_poll.add(socket);
+        loop.m_poll.mod(
+                socket,
+                action & CURL_POLL_OUT,
+                action & CURL_POLL_IN);
+    }
     return 0;
 }
 
-Fastcgipp::Curler::Curler(unsigned concurrency):
-    m_concurrency(concurrency),
+Fastcgipp::Curler::Loop::Loop(Curler& curler, unsigned hostConnections):
+    m_outstanding(0),
+    m_curler(curler),
+    m_waking(false),
     m_multiHandle(curl_multi_init())
 {
     socketpair(AF_UNIX, SOCK_STREAM, 0, m_wakeSockets);
@@ -133,14 +161,22 @@ Fastcgipp::Curler::Curler(unsigned concurrency):
     curl_multi_setopt(
             multiHandle,
             CURLMOPT_SOCKETFUNCTION,
-            Fastcgipp::Curler::socketCallback);
+            Fastcgipp::Curler::Loop::socketCallback);
     curl_multi_setopt(
             multiHandle,
             CURLMOPT_SOCKETDATA,
             this);
+    curl_multi_setopt(
+            multiHandle,
+            CURLMOPT_PIPELINING,
+            CURLPIPE_MULTIPLEX);
+    curl_multi_setopt(
+            multiHandle,
+            CURLMOPT_MAX_HOST_CONNECTIONS,
+            static_cast<long>(hostConnections));
 }
 
-Fastcgipp::Curler::~Curler()
+Fastcgipp::Curler::Loop::~Loop()
 {
     close(m_wakeSockets[0]);
     close(m_wakeSockets[1]);
@@ -149,52 +185,143 @@ Fastcgipp::Curler::~Curler()
     curl_multi_cleanup(multiHandle);
 }
 
+void Fastcgipp::Curler::Loop::queue(const Curl_base& curl)
+{
+    ++m_outstanding;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_queue.push(curl);
+    wake();
+}
+
+void Fastcgipp::Curler::Loop::wake()
+{
+    if(!m_waking)
+    {
+        m_waking=true;
+        static const char x=0;
+        if(write(m_wakeSockets[0], &x, 1) != 1)
+            FAIL_LOG("Unable to write to wakeup socket in Curler: " \
+                    << std::strerror(errno))
+    }
+}
+
+void Fastcgipp::Curler::lockCallback(
+        void* handle,
+        int data,
+        int access,
+        void* userp)
+{
+    Curler& curler(*reinterpret_cast<Curler*>(userp));
+    curler.m_shareMutexes[data].lock();
+}
+
+void Fastcgipp::Curler::unlockCallback(
+        void* handle,
+        int data,
+        void* userp)
+{
+    Curler& curler(*reinterpret_cast<Curler*>(userp));
+    curler.m_shareMutexes[data].unlock();
+}
+
+Fastcgipp::Curler::Curler(
+        unsigned concurrency,
+        unsigned hostConnections,
+        unsigned threads):
+    m_concurrency(concurrency),
+    m_shareHandle(curl_share_init())
+{
+    static_assert(
+            CURL_LOCK_DATA_LAST <= sizeof(m_shareMutexes)/sizeof(std::mutex),
+            "Not enough share mutexes for libcurl");
+
+    // The connection cache can't be shared between threads so that stays
+    // with the multi handle of each event loop.
+    CURLSH* const& shareHandle(
+            reinterpret_cast<CURLSH* const&>(m_shareHandle));
+    curl_share_setopt(
+            shareHandle,
+            CURLSHOPT_LOCKFUNC,
+            Fastcgipp::Curler::lockCallback);
+    curl_share_setopt(
+            shareHandle,
+            CURLSHOPT_UNLOCKFUNC,
+            Fastcgipp::Curler::unlockCallback);
+    curl_share_setopt(shareHandle, CURLSHOPT_USERDATA, this);
+    curl_share_setopt(shareHandle, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(
+            shareHandle,
+            CURLSHOPT_SHARE,
+            CURL_LOCK_DATA_SSL_SESSION);
+
+    m_loops.reserve(std::max(threads, 1u));
+    do
+        m_loops.emplace_back(new Loop(*this, hostConnections));
+    while(m_loops.size() < threads);
+}
+
+Fastcgipp::Curler::~Curler()
+{
+    m_loops.clear();
+
+    CURLSH* const& shareHandle(
+            reinterpret_cast<CURLSH* const&>(m_shareHandle));
+    curl_share_cleanup(shareHandle);
+}
+
 void Fastcgipp::Curler::stop()
 {
     m_stop=true;
-    wake();
+    for(auto& loop: m_loops)
+    {
+        std::lock_guard<std::mutex> lock(loop->m_mutex);
+        loop->wake();
+    }
 }
 
 void Fastcgipp::Curler::terminate()
 {
     m_terminate=true;
-    wake();
+    for(auto& loop: m_loops)
+    {
+        std::lock_guard<std::mutex> lock(loop->m_mutex);
+        loop->wake();
+    }
 }
 
 void Fastcgipp::Curler::start()
 {
-    if(!m_thread.joinable())
+    if(!m_loops.front()->m_thread.joinable())
     {
         m_stop=false;
         m_terminate=false;
-        m_waking=false;
-        std::thread thread(&Fastcgipp::Curler::handler, this);
-        m_thread.swap(thread);
+        for(unsigned i=0; i<m_loops.size(); ++i)
+        {
+            std::thread thread(
+                    &Fastcgipp::Curler::Loop::handler,
+                    m_loops[i].get(),
+                    i);
+            m_loops[i]->m_thread.swap(thread);
+        }
     }
 }
 
 void Fastcgipp::Curler::join()
 {
-    if(m_thread.joinable())
-        m_thread.join();
+    for(auto& loop: m_loops)
+        if(loop->m_thread.joinable())
+            loop->m_thread.join();
 }
 
 void Fastcgipp::Curler::queue(Curl_base& curl)
 {
     curl.prepare();
-    std::lock_guard<std::mutex> lock(m_mutex);
-    m_queue.push(curl);
-    wake();
-}
-
-void Fastcgipp::Curler::wake()
-{
-    if(!m_waking)
-    {
-        m_waking=true;
-        static const char x=0;
-        if(write(m_wakeSockets[0], &x, 1) != 1)
-            FAIL_LOG("Unable to write to wakeup socket in Curler: " \
-                    << std::strerror(errno))
-    }
+    const auto loop = std::min_element(
+            m_loops.begin(),
+            m_loops.end(),
+            [] (const std::unique_ptr<Loop>& x, const std::unique_ptr<Loop>& y)
+            {
+                return x->m_outstanding < y->m_outstanding;
+            });
+    (*loop)->queue(curl);
 }
@@ -0,0 +1,193 @@
+/*!
+ * @file       endian.cpp
+ * @brief      Defines the bulk big endian conversion
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 15, 2026
+ * @copyright  Copyright &copy; 2026 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2026 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#include "fastcgi++/endian.hpp"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define FASTCGIPP_SWAP_X86
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define FASTCGIPP_SWAP_NEON
+#include <arm_neon.h>
+#endif
+
+namespace
+{
+    // Whole runs of big endian numbers are converted in place with these.
+    // The vector kernels reverse the bytes of every word in a register with a
+    // single shuffle and leave whatever doesn't fill one to the scalar code.
+
+    void swapScalar(char* data, size_t count, unsigned width)
+    {
+        switch(width)
+        {
+            case 2:
+            {
+                for(size_t i=0; i<count; ++i, data+=2)
+                {
+                    uint16_t word;
+                    std::memcpy(&word, data, 2);
+                    word = __builtin_bswap16(word);
+                    std::memcpy(data, &word, 2);
+                }
+                break;
+            }
+            case 4:
+            {
+                for(size_t i=0; i<count; ++i, data+=4)
+                {
+                    uint32_t word;
+                    std::memcpy(&word, data, 4);
+                    word = __builtin_bswap32(word);
+                    std::memcpy(data, &word, 4);
+                }
+                break;
+            }
+            case 8:
+            {
+                for(size_t i=0; i<count; ++i, data+=8)
+                {
+                    uint64_t word;
+                    std::memcpy(&word, data, 8);
+                    word = __builtin_bswap64(word);
+                    std::memcpy(data, &word, 8);
+                }
+                break;
+            }
+        }
+    }
+
+#ifdef FASTCGIPP_SWAP_X86
+    // Shuffle masks for 2, 4 and 8 byte words
+    const unsigned char swapMasks[3][16] =
+    {
+        {1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14},
+        {3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12},
+        {7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8}
+    };
+
+    __attribute__((target("ssse3")))
+    void swapSsse3(char* data, size_t count, unsigned width)
+    {
+        const __m128i mask = _mm_loadu_si128(
+                reinterpret_cast<const __m128i*>(swapMasks[width>>2]));
+        char* const end = data+count*width;
+
+        while(end-data >= 16)
+        {
+            const __m128i words = _mm_loadu_si128(
+                    reinterpret_cast<const __m128i*>(data));
+            _mm_storeu_si128(
+                    reinterpret_cast<__m128i*>(data),
+                    _mm_shuffle_epi8(words, mask));
+            data += 16;
+        }
+
+        swapScalar(data, (end-data)/width, width);
+    }
+
+    __attribute__((target("avx2")))
+    void swapAvx2(char* data, size_t count, unsigned width)
+    {
+        // The 256 bit shuffle works within each 128 bit lane so the same mask
+        // goes in both.
+        const __m256i mask = _mm256_broadcastsi128_si256(_mm_loadu_si128(
+                reinterpret_cast<const __m128i*>(swapMasks[width>>2])));
+        char* const end = data+count*width;
+
+        while(end-data >= 32)
+        {
+            const __m256i words = _mm256_loadu_si256(
+                    reinterpret_cast<const __m256i*>(data));
+            _mm256_storeu_si256(
+                    reinterpret_cast<__m256i*>(data),
+                    _mm256_shuffle_epi8(words, mask));
+            data += 32;
+        }
+
+        swapSsse3(data, (end-data)/width, width);
+    }
+#endif
+
+#ifdef FASTCGIPP_SWAP_NEON
+    void swapNeon(char* data, size_t count, unsigned width)
+    {
+        char* const end = data+count*width;
+
+        while(end-data >= 16)
+        {
+            uint8x16_t words = vld1q_u8(reinterpret_cast<uint8_t*>(data));
+            switch(width)
+            {
+                case 2:
+                    words = vrev16q_u8(words);
+                    break;
+                case 4:
+                    words = vrev32q_u8(words);
+                    break;
+                case 8:
+                    words = vrev64q_u8(words);
+                    break;
+            }
+            vst1q_u8(reinterpret_cast<uint8_t*>(data), words);
+            data += 16;
+        }
+
+        swapScalar(data, (end-data)/width, width);
+    }
+#endif
+
+    typedef void (*Swap)(char*, size_t, unsigned);
+
+    Swap resolveSwap()
+    {
+#if defined(FASTCGIPP_SWAP_X86)
+        __builtin_cpu_init();
+        if(__builtin_cpu_supports("avx2"))
+            return swapAvx2;
+        if(__builtin_cpu_supports("ssse3"))
+            return swapSsse3;
+#elif defined(FASTCGIPP_SWAP_NEON)
+        return swapNeon;
+#endif
+        return swapScalar;
+    }
+}
+
+void Fastcgipp::convertBigEndian(
+        char* data,
+        size_t count,
+        unsigned width) noexcept
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    static const Swap swap = resolveSwap();
+    swap(data, count, width);
+#endif
+}
@@ -28,103 +28,439 @@
 #include "fastcgi++/fcgistreambuf.hpp"
 #include "fastcgi++/log.hpp"
 
-#include <codecvt>
 #include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+
+#include <unistd.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+    //! Largest content length a record can carry
+    const size_t maxContentLength = 0xffffU;
+
+    //! Largest content length a record can carry without padding
+    const size_t maxAlignedContentLength = 0xfff8U;
+
+    //! How many bytes a code point takes in UTF-8. Zero if it's invalid.
+    inline unsigned utf8Size(const wchar_t character)
+    {
+        const uint32_t code = static_cast<uint32_t>(character);
+        if(code < 0x80)
+            return 1;
+        else if(code < 0x800)
+            return 2;
+        else if(code < 0x10000)
+            return (code >= 0xd800 && code < 0xe000)?0:3;
+        else if(code < 0x110000)
+            return 4;
+        return 0;
+    }
+
+    //! Length of the ASCII only run at the start of the characters
+    inline size_t asciiRun(const wchar_t* const start, const wchar_t* const end)
+    {
+        const wchar_t* position = start;
+#ifdef __SSE2__
+        if(sizeof(wchar_t) == 4)
+        {
+            const __m128i high = _mm_set1_epi32(~0x7f);
+            while(end-position >= 8)
+            {
+                const __m128i bits = _mm_or_si128(
+                        _mm_loadu_si128(
+                            reinterpret_cast<const __m128i*>(position)),
+                        _mm_loadu_si128(
+                            reinterpret_cast<const __m128i*>(position+4)));
+                if(_mm_movemask_epi8(_mm_cmpeq_epi32(
+                                _mm_and_si128(bits, high),
+                                _mm_setzero_si128())) != 0xffff)
+                    break;
+                position += 8;
+            }
+        }
+#endif
+        while(position != end && static_cast<uint32_t>(*position) < 0x80)
+            ++position;
+        return position-start;
+    }
+
+    //! Narrow ASCII characters into bytes
+    inline char* narrow(
+            const wchar_t* from,
+            const wchar_t* const fromEnd,
+            char* to)
+    {
+#ifdef __SSE2__
+        if(sizeof(wchar_t) == 4)
+            while(fromEnd-from >= 16)
+            {
+                const __m128i* const source =
+                    reinterpret_cast<const __m128i*>(from);
+                const __m128i low = _mm_packs_epi32(
+                        _mm_loadu_si128(source),
+                        _mm_loadu_si128(source+1));
+                const __m128i high = _mm_packs_epi32(
+                        _mm_loadu_si128(source+2),
+                        _mm_loadu_si128(source+3));
+                _mm_storeu_si128(
+                        reinterpret_cast<__m128i*>(to),
+                        _mm_packus_epi16(low, high));
+                from += 16;
+                to += 16;
+            }
+#endif
+        while(from != fromEnd)
+            *to++ = static_cast<char>(*from++);
+        return to;
+    }
+
+    //! Figure out how many characters will fit in a record
+    /*!
+     * @param[in] from First character to encode
+     * @param[in] fromEnd 1+ the last character to encode
+     * @param[out] stop 1+ the last character that fits. This is also where
+     *                  we stop if we hit an invalid code point.
+     * @return Size of the encoded characters in bytes
+     */
+    inline size_t utf8Measure(
+            const wchar_t* from,
+            const wchar_t* const fromEnd,
+            const wchar_t*& stop)
+    {
+        size_t size = 0;
+        while(from != fromEnd)
+        {
+            const size_t run = std::min(
+                    asciiRun(from, fromEnd),
+                    maxContentLength-size);
+            from += run;
+            size += run;
+            if(from == fromEnd || size == maxContentLength)
+                break;
+
+            const unsigned characterSize = utf8Size(*from);
+            if(characterSize == 0 || size+characterSize > maxContentLength)
+                break;
+            size += characterSize;
+            ++from;
+        }
+        stop = from;
+        return size;
+    }
+
+    //! Encode characters that are known to be valid into UTF-8
+    inline char* utf8Encode(
+            const wchar_t* from,
+            const wchar_t* const fromEnd,
+            char* to)
+    {
+        while(from != fromEnd)
+        {
+            const size_t run = asciiRun(from, fromEnd);
+            to = narrow(from, from+run, to);
+            from += run;
+            if(from == fromEnd)
+                break;
+
+            const uint32_t code = static_cast<uint32_t>(*from++);
+            if(code < 0x800)
+            {
+                *to++ = static_cast<char>(0xc0 | (code >> 6));
+                *to++ = static_cast<char>(0x80 | (code & 0x3f));
+            }
+            else if(code < 0x10000)
+            {
+                *to++ = static_cast<char>(0xe0 | (code >> 12));
+                *to++ = static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+                *to++ = static_cast<char>(0x80 | (code & 0x3f));
+            }
+            else
+            {
+                *to++ = static_cast<char>(0xf0 | (code >> 18));
+                *to++ = static_cast<char>(0x80 | ((code >> 12) & 0x3f));
+                *to++ = static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+                *to++ = static_cast<char>(0x80 | (code & 0x3f));
+            }
+        }
+        return to;
+    }
+}
+
+template <class charT, class traits>
+char* Fastcgipp::FcgiStreambuf<charT, traits>::newRecord(
+        Block& record,
+        size_t size)
+{
+    if(m_corked)
+    {
+        const size_t needed = m_cork.size()+size;
+        if(m_cork.reserve() < needed)
+            m_cork.reserve(std::max(needed, 2*m_cork.reserve()));
+        return m_cork.end();
+    }
+
+    record.reserve(size);
+    return record.begin();
+}
+
+template <class charT, class traits>
+void Fastcgipp::FcgiStreambuf<charT, traits>::sendRecord(
+        Block& record,
+        size_t size)
+{
+    if(m_corked)
+        m_cork.size(m_cork.size()+size);
+    else
+    {
+        record.size(size);
+        send(m_id.m_socket, std::move(record));
+        m_sent = true;
+    }
+}
+
+template <class charT, class traits>
+void Fastcgipp::FcgiStreambuf<charT, traits>::compressData(
+        const char* data,
+        const char* const end,
+        Compressor::Flush flush)
+{
+    Block record;
+    bool done = false;
+
+    while(!done)
+    {
+        char* const begin = newRecord(
+                record,
+                Protocol::getRecordSize(maxAlignedContentLength));
+        char* const content = begin+sizeof(Protocol::Header);
+        char* output = content;
+
+        done = m_compressor->process(
+                data,
+                end,
+                output,
+                content+maxAlignedContentLength,
+                flush);
+        if(output == content)
+            continue;
+
+        const size_t recordSize = Protocol::getRecordSize(output-content);
+        Protocol::Header& header = *reinterpret_cast<Protocol::Header*>(begin);
+        header.contentLength = output-content;
+        header.version = Protocol::version;
+        header.type = m_type;
+        header.fcgiId = m_id.m_id;
+        header.paddingLength =
+            recordSize-header.contentLength-sizeof(Protocol::Header);
+
+        sendRecord(record, recordSize);
+    }
+}
+
+template <class charT, class traits>
+void Fastcgipp::FcgiStreambuf<charT, traits>::sendCork()
+{
+    if(m_cork.size() != 0)
+    {
+        send(m_id.m_socket, std::move(m_cork));
+        m_cork.size(0);
+        m_sent = true;
+    }
+}
 
 namespace Fastcgipp
 {
     template <> bool
-    Fastcgipp::FcgiStreambuf<wchar_t, std::char_traits<wchar_t>>::emptyBuffer()
+    Fastcgipp::FcgiStreambuf<wchar_t, std::char_traits<wchar_t>>::sendBuffer()
     {
-        const std::codecvt_utf8<wchar_t> converter;
-        std::codecvt_base::result result;
-        Block record;
-        size_t count;
-        mbstate_t state = mbstate_t();
-        char* toNext;
         const wchar_t* from = this->pbase();
         const wchar_t* const fromEnd = this->pptr();
+        const wchar_t* stop;
+        Block record;
 
-        while((count = fromEnd - from) != 0)
+        if(m_compressor && from != fromEnd)
         {
-            record.reserve(
-                    Protocol::getRecordSize(count*converter.max_length()));
+            record.reserve(maxContentLength);
+            while(from != fromEnd)
+            {
+                const size_t size = utf8Measure(from, fromEnd, stop);
+                if(stop == from)
+                {
+                    ERROR_LOG("FcgiStreambuf code conversion failed")
+                    pbump(-(fromEnd-from));
+                    return false;
+                }
+                utf8Encode(from, stop, record.begin());
+                from = stop;
+                compressData(
+                        record.begin(),
+                        record.begin()+size,
+                        Compressor::Flush::NONE);
+            }
+        }
 
-            Protocol::Header& header
-                = *reinterpret_cast<Protocol::Header*>(record.begin());
-
-            result = converter.out(
-                    state,
-                    from,
-                    fromEnd,
-                    from,
-                    record.begin()+sizeof(Protocol::Header),
-                    &*record.end(),
-                    toNext);
-
-            if(result == std::codecvt_base::error
-                    || result == std::codecvt_base::noconv)
+        while(from != fromEnd)
+        {
+            const size_t size = utf8Measure(from, fromEnd, stop);
+            if(stop == from)
             {
                 ERROR_LOG("FcgiStreambuf code conversion failed")
-                pbump(-count);
+                pbump(-(fromEnd-from));
                 return false;
             }
-            header.contentLength = std::distance(
-                    record.begin()+sizeof(Protocol::Header),
-                    toNext);
-            record.size(Protocol::getRecordSize(header.contentLength));
 
+            const size_t recordSize = Protocol::getRecordSize(size);
+            char* const begin = newRecord(record, recordSize);
+            Protocol::Header& header
+                = *reinterpret_cast<Protocol::Header*>(begin);
+            utf8Encode(from, stop, begin+sizeof(Protocol::Header));
+            from = stop;
+
+            header.contentLength = size;
             header.version = Protocol::version;
             header.type = m_type;
             header.fcgiId = m_id.m_id;
             header.paddingLength =
-                record.size()-header.contentLength-sizeof(Protocol::Header);
+                recordSize-header.contentLength-sizeof(Protocol::Header);
 
-            send(m_id.m_socket, std::move(record));
+            sendRecord(record, recordSize);
         }
 
-        this->setp(m_buffer, m_buffer+s_buffSize);
+        this->setp(this->pbase(), this->epptr());
         return true;
     }
 
+    template <> void
+    Fastcgipp::FcgiStreambuf<wchar_t, std::char_traits<wchar_t>>::newBuffer()
+    {
+        const size_t size = m_corked?maxAlignedContentLength:m_bufferSize;
+        m_buffer.reserve(size*sizeof(wchar_t));
+        wchar_t* const buffer = reinterpret_cast<wchar_t*>(m_buffer.begin());
+        this->setp(buffer, buffer+size);
+    }
+
     template <>
-    bool Fastcgipp::FcgiStreambuf<char, std::char_traits<char>>::emptyBuffer()
+    bool Fastcgipp::FcgiStreambuf<char, std::char_traits<char>>::sendBuffer()
     {
-        Block record;
-        size_t count;
+        const size_t count = this->pptr()-this->pbase();
+        if(count == 0)
+            return true;
+
+        if(m_compressor)
+        {
+            compressData(
+                    this->pbase(),
+                    this->pptr(),
+                    Compressor::Flush::NONE);
+            this->setp(this->pbase(), this->epptr());
+            return true;
+        }
+
+        const size_t recordSize = Protocol::getRecordSize(count);
+        Protocol::Header& header = *reinterpret_cast<Protocol::Header*>(
+                this->pbase()-sizeof(Protocol::Header));
+        header.contentLength = count;
+        header.version = Protocol::version;
+        header.type = m_type;
+        header.fcgiId = m_id.m_id;
+        header.paddingLength =
+            recordSize-header.contentLength-sizeof(Protocol::Header);
 
-        const char* from = this->pbase();
-        const char* const fromEnd = this->pptr();
+        this->setp(nullptr, nullptr);
+        sendRecord(m_buffer, recordSize);
+        return true;
+    }
 
-        while((count = fromEnd - from) != 0)
+    template <> void
+    Fastcgipp::FcgiStreambuf<char, std::char_traits<char>>::newBuffer()
+    {
+        const size_t size = m_corked?maxAlignedContentLength:m_bufferSize;
+        if(m_compressor)
         {
-            record.size(Protocol::getRecordSize(count));
+            // Compressed output is packaged separately so the buffer
+            // needn't be part of a record
+            m_buffer.reserve(size);
+            this->setp(m_buffer.begin(), m_buffer.begin()+size);
+            return;
+        }
+        char* const buffer = newRecord(m_buffer, Protocol::getRecordSize(size))
+            +sizeof(Protocol::Header);
+        this->setp(buffer, buffer+size);
+    }
+}
 
-            Protocol::Header& header
-                = *reinterpret_cast<Protocol::Header*>(record.begin());
-            header.contentLength = std::min(
-                    count,
-                    static_cast<size_t>(0xffffU));
+template <class charT, class traits>
+bool Fastcgipp::FcgiStreambuf<charT, traits>::emptyBuffer()
+{
+    if(!sendBuffer())
+        return false;
+    if(this->pbase() == nullptr)
+        newBuffer();
+    return true;
+}
 
-            std::copy(
-                    from,
-                    from+header.contentLength,
-                    record.begin()+sizeof(Protocol::Header));
+template <class charT, class traits>
+int Fastcgipp::FcgiStreambuf<charT, traits>::sync()
+{
+    const bool success = sendBuffer();
+    if(m_compressor)
+        compressData(nullptr, nullptr, Compressor::Flush::SYNC);
+    this->setp(nullptr, nullptr);
+    sendCork();
+    return success?0:-1;
+}
 
-            from += header.contentLength;
+template <class charT, class traits>
+bool Fastcgipp::FcgiStreambuf<charT, traits>::compress(
+        Compression compression)
+{
+    finish();
+    sendBuffer();
+    this->setp(nullptr, nullptr);
+    m_compressor = Compressor::acquire(compression);
+    return bool(m_compressor);
+}
 
-            header.version = Protocol::version;
-            header.type = m_type;
-            header.fcgiId = m_id.m_id;
-            header.paddingLength =
-                record.size()-header.contentLength-sizeof(Protocol::Header);
+template <class charT, class traits>
+void Fastcgipp::FcgiStreambuf<charT, traits>::finish()
+{
+    if(!m_compressor)
+        return;
+    sendBuffer();
+    compressData(nullptr, nullptr, Compressor::Flush::FINISH);
+    this->setp(nullptr, nullptr);
+    m_compressor.reset();
+}
 
-            send(m_id.m_socket, std::move(record));
-        }
+template <class charT, class traits>
+void Fastcgipp::FcgiStreambuf<charT, traits>::bufferSize(size_t size)
+{
+    m_bufferSize = std::max(
+            size_t(1),
+            std::min(size, maxAlignedContentLength));
+}
 
-        this->setp(m_buffer, m_buffer+s_buffSize);
-        return true;
-    }
+template <class charT, class traits>
+void Fastcgipp::FcgiStreambuf<charT, traits>::cork(bool corked)
+{
+    if(corked == m_corked)
+        return;
+    sync();
+    m_corked = corked;
+}
+
+template <class charT, class traits>
+Fastcgipp::Block Fastcgipp::FcgiStreambuf<charT, traits>::takeCorked()
+{
+    sendBuffer();
+    this->setp(nullptr, nullptr);
+    return std::move(m_cork);
 }
 
 template <class charT, class traits>
@@ -132,32 +468,39 @@ void Fastcgipp::FcgiStreambuf<charT, traits>::dump(
         const char* data,
         size_t size)
 {
-    emptyBuffer();
+    sendBuffer();
+    this->setp(nullptr, nullptr);
+    if(m_compressor)
+    {
+        compressData(data, data+size, Compressor::Flush::NONE);
+        return;
+    }
     Block record;
 
     while(size != 0)
     {
-        record.size(Protocol::getRecordSize(size));
+        const size_t contentLength = std::min(size, maxContentLength);
+        const size_t recordSize = Protocol::getRecordSize(contentLength);
+        char* const begin = newRecord(record, recordSize);
 
-        Protocol::Header& header
-            = *reinterpret_cast<Protocol::Header*>(record.begin());
-        header.contentLength = std::min(size, static_cast<size_t>(0xffffU));
+        Protocol::Header& header = *reinterpret_cast<Protocol::Header*>(begin);
+        header.contentLength = contentLength;
 
         std::copy(
                 data,
-                data+header.contentLength,
-                record.begin()+sizeof(Protocol::Header));
+                data+contentLength,
+                begin+sizeof(Protocol::Header));
 
-        size -= header.contentLength;
-        data += header.contentLength;
+        size -= contentLength;
+        data += contentLength;
 
         header.version = Protocol::version;
         header.type = m_type;
         header.fcgiId = m_id.m_id;
         header.paddingLength =
-            record.size()-header.contentLength-sizeof(Protocol::Header);
+            recordSize-contentLength-sizeof(Protocol::Header);
 
-        send(m_id.m_socket, std::move(record));
+        sendRecord(record, recordSize);
     }
 }
 
@@ -165,32 +508,173 @@ template <class charT, class traits>
 void Fastcgipp::FcgiStreambuf<charT, traits>::dump(
         std::basic_istream<char>& stream)
 {
-    const size_t maxContentLength = 0xffffU;
-    emptyBuffer();
+    sendBuffer();
+    this->setp(nullptr, nullptr);
     Block record;
 
+    if(m_compressor)
+    {
+        record.reserve(maxContentLength);
+        do
+        {
+            stream.read(record.begin(), maxContentLength);
+            compressData(
+                    record.begin(),
+                    record.begin()+stream.gcount(),
+                    Compressor::Flush::NONE);
+        } while(stream.gcount() != 0);
+        return;
+    }
+
     while(true)
     {
-        record.reserve(Protocol::getRecordSize(maxContentLength));
+        char* const begin = newRecord(
+                record,
+                Protocol::getRecordSize(maxContentLength));
 
-        Protocol::Header& header
-            = *reinterpret_cast<Protocol::Header*>(record.begin());
+        Protocol::Header& header = *reinterpret_cast<Protocol::Header*>(begin);
 
-        stream.read(record.begin()+sizeof(Protocol::Header), maxContentLength);
+        stream.read(begin+sizeof(Protocol::Header), maxContentLength);
         header.contentLength = stream.gcount();
         if(header.contentLength == 0)
             break;
 
-        record.size(Protocol::getRecordSize(header.contentLength));
+        const size_t recordSize
+            = Protocol::getRecordSize(header.contentLength);
 
         header.version = Protocol::version;
         header.type = m_type;
         header.fcgiId = m_id.m_id;
         header.paddingLength =
-            record.size()-header.contentLength-sizeof(Protocol::Header);
+            recordSize-header.contentLength-sizeof(Protocol::Header);
 
-        send(m_id.m_socket, std::move(record));
+        sendRecord(record, recordSize);
+    }
+}
+
+template <class charT, class traits>
+bool Fastcgipp::FcgiStreambuf<charT, traits>::dumpFile(
+        int file,
+        off_t offset,
+        size_t size)
+{
+    sendBuffer();
+    this->setp(nullptr, nullptr);
+
+    if(m_compressor)
+    {
+        // There is no way around reading the file to compress it
+        Block chunk(maxContentLength);
+        while(size != 0)
+        {
+            const ssize_t count = ::pread(
+                    file,
+                    chunk.begin(),
+                    std::min(size, maxContentLength),
+                    offset);
+            if(count <= 0)
+            {
+                ERROR_LOG("Unable to read file descriptor " << file \
+                        << " for dumping: " \
+                        << (count<0?std::strerror(errno):"end of file"))
+                return false;
+            }
+            compressData(
+                    chunk.begin(),
+                    chunk.begin()+count,
+                    Compressor::Flush::NONE);
+            size -= count;
+            offset += count;
+        }
+        return true;
+    }
+
+    if(!sendFile)
+    {
+        Block record;
+        while(size != 0)
+        {
+            char* const begin = newRecord(
+                    record,
+                    Protocol::getRecordSize(maxContentLength));
+
+            Protocol::Header& header
+                = *reinterpret_cast<Protocol::Header*>(begin);
+
+            const ssize_t count = ::pread(
+                    file,
+                    begin+sizeof(Protocol::Header),
+                    std::min(size, maxContentLength),
+                    offset);
+            if(count <= 0)
+            {
+                ERROR_LOG("Unable to read file descriptor " << file \
+                        << " for dumping: " \
+                        << (count<0?std::strerror(errno):"end of file"))
+                return false;
+            }
+            header.contentLength = count;
+            size -= count;
+            offset += count;
+
+            const size_t recordSize
+                = Protocol::getRecordSize(header.contentLength);
+
+            header.version = Protocol::version;
+            header.type = m_type;
+            header.fcgiId = m_id.m_id;
+            header.paddingLength =
+                recordSize-header.contentLength-sizeof(Protocol::Header);
+
+            sendRecord(record, recordSize);
+        }
+        return true;
+    }
+
+    sendCork();
+
+    const int duplicate = ::dup(file);
+    if(duplicate < 0)
+    {
+        ERROR_LOG("Unable to duplicate file descriptor " << file \
+                << " for dumping: " << std::strerror(errno))
+        return false;
+    }
+    const std::shared_ptr<const int> shared(
+            new int(duplicate),
+            [] (const int* x)
+            {
+                ::close(*x);
+                delete x;
+            });
+
+    while(size != 0)
+    {
+        Block record(sizeof(Protocol::Header));
+
+        Protocol::Header& header
+            = *reinterpret_cast<Protocol::Header*>(record.begin());
+        header.version = Protocol::version;
+        header.type = m_type;
+        header.fcgiId = m_id.m_id;
+        header.contentLength = std::min(size, maxAlignedContentLength);
+        header.paddingLength =
+            Protocol::getRecordSize(header.contentLength)
+            -header.contentLength-sizeof(Protocol::Header);
+        header.reserved = 0;
+
+        const size_t contentLength = header.contentLength;
+        m_sent = true;
+        sendFile(
+                m_id.m_socket,
+                std::move(record),
+                shared,
+                offset,
+                contentLength);
+        size -= contentLength;
+        offset += contentLength;
     }
+    return true;
 }
 
 template class Fastcgipp::FcgiStreambuf<wchar_t, std::char_traits<wchar_t>>;
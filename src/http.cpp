@@ -31,17 +31,254 @@
 #include <sstream>
 #include <iomanip>
 #include <random>
+#include <cstring>
+#include <cerrno>
+#include <cstdint>
+#include <atomic>
+
+#include <pthread.h>
 
 #include "fastcgi++/log.hpp"
 #include "fastcgi++/http.hpp"
+#include "fastcgi++/scan.hpp"
+
+#ifdef FASTCGIPP_LINUX
+#include <sys/random.h>
+#endif
+
+
+namespace
+{
+    //! FastCGI parameters Environment knows what to do with
+    enum class Parameter: unsigned char
+    {
+        NONE,
+        HTTP_HOST,
+        PATH_INFO,
+        HTTP_ACCEPT,
+        HTTP_COOKIE,
+        SERVER_ADDR,
+        REMOTE_ADDR,
+        SERVER_PORT,
+        REMOTE_PORT,
+        SCRIPT_NAME,
+        REQUEST_URI,
+        HTTP_ORIGIN,
+        HTTP_REFERER,
+        CONTENT_TYPE,
+        QUERY_STRING,
+        DOCUMENT_ROOT,
+        REQUEST_METHOD,
+        CONTENT_LENGTH,
+        HTTP_USER_AGENT,
+        HTTP_KEEP_ALIVE,
+        FCGI_DATA_LENGTH,
+        HTTP_IF_NONE_MATCH,
+        FCGI_DATA_LAST_MOD,
+        HTTP_AUTHORIZATION,
+        HTTP_ACCEPT_CHARSET,
+        HTTP_ACCEPT_LANGUAGE,
+        HTTP_ACCEPT_ENCODING,
+        HTTP_IF_MODIFIED_SINCE,
+        COUNT
+    };
+
+    //! Names of the parameters indexed by Parameter
+    constexpr const char* parameterNames[] =
+    {
+        "",
+        "HTTP_HOST",
+        "PATH_INFO",
+        "HTTP_ACCEPT",
+        "HTTP_COOKIE",
+        "SERVER_ADDR",
+        "REMOTE_ADDR",
+        "SERVER_PORT",
+        "REMOTE_PORT",
+        "SCRIPT_NAME",
+        "REQUEST_URI",
+        "HTTP_ORIGIN",
+        "HTTP_REFERER",
+        "CONTENT_TYPE",
+        "QUERY_STRING",
+        "DOCUMENT_ROOT",
+        "REQUEST_METHOD",
+        "CONTENT_LENGTH",
+        "HTTP_USER_AGENT",
+        "HTTP_KEEP_ALIVE",
+        "FCGI_DATA_LENGTH",
+        "HTTP_IF_NONE_MATCH",
+        "FCGI_DATA_LAST_MOD",
+        "HTTP_AUTHORIZATION",
+        "HTTP_ACCEPT_CHARSET",
+        "HTTP_ACCEPT_LANGUAGE",
+        "HTTP_ACCEPT_ENCODING",
+        "HTTP_IF_MODIFIED_SINCE"
+    };
+
+    static_assert(
+            sizeof(parameterNames)/sizeof(const char*)
+                == static_cast<size_t>(Parameter::COUNT),
+            "Every parameter needs a name");
+
+    constexpr size_t length(const char* string)
+    {
+        size_t size = 0;
+        while(string[size])
+            ++size;
+        return size;
+    }
+
+    //! Shortest parameter name we know
+    const size_t minimumParameter = 9;
+
+    //! Longest parameter name we know
+    const size_t maximumParameter = 22;
+
+    //! Slots in the parameter hash table
+    const unsigned parameterSlots = 64;
+
+    //! Hash a parameter name with a given multiplier
+    /*!
+     * Only the length and a few characters that tell our names apart are
+     * looked at. The name must be at least minimumParameter long.
+     */
+    constexpr unsigned hashParameter(
+            const char* name,
+            size_t size,
+            unsigned multiplier)
+    {
+        return ((((unsigned(size)*multiplier
+                            + (unsigned char)name[5])*multiplier
+                        + (unsigned char)name[size-1])*multiplier
+                    + (unsigned char)name[size-3])*multiplier >> 8)
+            % parameterSlots;
+    }
+
+    //! True if a multiplier hashes every parameter name to it's own slot
+    constexpr bool perfect(unsigned multiplier)
+    {
+        bool used[parameterSlots] = {};
+        for(unsigned i=1; i<static_cast<unsigned>(Parameter::COUNT); ++i)
+        {
+            const size_t size = length(parameterNames[i]);
+            if(size < minimumParameter || size > maximumParameter)
+                return false;
+            const unsigned slot = hashParameter(
+                    parameterNames[i],
+                    size,
+                    multiplier);
+            if(used[slot])
+                return false;
+            used[slot] = true;
+        }
+        return true;
+    }
+
+    //! Smallest multiplier that makes hashParameter() perfect
+    constexpr unsigned findMultiplier()
+    {
+        unsigned multiplier = 1;
+        while(multiplier < 0x10000 && !perfect(multiplier))
+            ++multiplier;
+        return multiplier;
+    }
+
+    constexpr unsigned parameterMultiplier = findMultiplier();
+
+    static_assert(
+            parameterMultiplier < 0x10000,
+            "No perfect hash for the parameter names");
+
+    //! Perfect hash table of the parameters we know
+    struct ParameterTable
+    {
+        Parameter slots[parameterSlots];
+        unsigned char sizes[parameterSlots];
+
+        constexpr ParameterTable():
+            slots(),
+            sizes()
+        {
+            for(unsigned i=1; i<static_cast<unsigned>(Parameter::COUNT); ++i)
+            {
+                const size_t size = length(parameterNames[i]);
+                const unsigned slot = hashParameter(
+                        parameterNames[i],
+                        size,
+                        parameterMultiplier);
+                slots[slot] = static_cast<Parameter>(i);
+                sizes[slot] = size;
+            }
+        }
+    };
+
+    constexpr ParameterTable parameterTable;
+
+    //! Identify a parameter by it's name
+    /*!
+     * A single hash and a single comparison is all it takes.
+     */
+    inline Parameter identifyParameter(const char* name, const char* end)
+    {
+        const size_t size = end-name;
+        if(size < minimumParameter || size > maximumParameter)
+            return Parameter::NONE;
+        const unsigned slot = hashParameter(name, size, parameterMultiplier);
+        const Parameter parameter = parameterTable.slots[slot];
+        if(parameterTable.sizes[slot] != size || !std::equal(
+                    name,
+                    end,
+                    parameterNames[static_cast<unsigned>(parameter)]))
+            return Parameter::NONE;
+        return parameter;
+    }
+
+    //! Sorted names of the unrecognized parameters to keep
+    std::vector<std::string> keptOthers;
+
+    //! True if only the parameters in keptOthers should be kept
+    bool keepingOthers = false;
+
+    //! Should we keep an unrecognized parameter?
+    inline bool keepOther(const char* name, const char* end)
+    {
+        if(!keepingOthers)
+            return true;
+        const auto kept = std::lower_bound(
+                keptOthers.cbegin(),
+                keptOthers.cend(),
+                std::make_pair(name, end),
+                [] (
+                    const std::string& x,
+                    const std::pair<const char*, const char*>& y)
+                {
+                    return std::lexicographical_compare(
+                            x.cbegin(),
+                            x.cend(),
+                            y.first,
+                            y.second);
+                });
+        return kept != keptOthers.cend()
+            && kept->size() == size_t(end-name)
+            && std::equal(name, end, kept->cbegin());
+    }
+}
 
+void Fastcgipp::Http::keepOthers(const std::vector<std::string>& names)
+{
+    keptOthers = names;
+    std::sort(keptOthers.begin(), keptOthers.end());
+    keepingOthers = true;
+}
 
 void Fastcgipp::Http::vecToString(
         const char* start,
         const char* end,
         std::wstring& string)
 {
-    std::wstring_convert<std::codecvt_utf8<wchar_t>, wchar_t> converter;
+    thread_local std::wstring_convert<std::codecvt_utf8<wchar_t>, wchar_t>
+        converter;
     try
     {
         string = converter.from_bytes(&*start, &*end);
@@ -112,57 +349,50 @@ float Fastcgipp::Http::atof(const charT* start, const charT* end)
     return neg?-result:result;
 }
 
+namespace
+{
+    inline char hexValue(const char digit)
+    {
+        if((digit|0x20) >= 'a' && (digit|0x20) <= 'f')
+            return (digit|0x20)-0x57;
+        else if(digit >= '0' && digit <= '9')
+            return digit&0x0f;
+        return 0;
+    }
+}
+
 char* Fastcgipp::Http::percentEscapedToRealBytes(
         const char* start,
         const char* end,
         char* destination)
 {
-    enum State
-    {
-        NORMAL,
-        DECODINGFIRST,
-        DECODINGSECOND,
-    } state = NORMAL;
-
     while(start != end)
     {
-        if(state == NORMAL)
-        {
-            if(*start=='%')
-            {
-                *destination=0;
-                state = DECODINGFIRST;
-            }
-            else if(*start=='+')
-                *destination++=' ';
-            else
-                *destination++=*start;
-        }
-        else if(state == DECODINGFIRST)
-        {
-            if((*start|0x20) >= 'a' && (*start|0x20) <= 'f')
-                *destination = ((*start|0x20)-0x57)<<4;
-            else if(*start >= '0' && *start <= '9')
-                *destination = (*start&0x0f)<<4;
+        const char* const special = Scan::findEither(start, end, '%', '+');
+        destination = std::copy(start, special, destination);
+        start = special;
 
-            state = DECODINGSECOND;
+        if(start == end)
+            break;
+        else if(*start == '+')
+        {
+            *destination++ = ' ';
+            ++start;
         }
-        else if(state == DECODINGSECOND)
+        else
         {
-            if((*start|0x20) >= 'a' && (*start|0x20) <= 'f')
-                *destination |= (*start|0x20)-0x57;
-            else if(*start >= '0' && *start <= '9')
-                *destination |= *start&0x0f;
-
-            ++destination;
-            state = NORMAL;
+            // A truncated escape sequence is dropped
+            if(end-start < 3)
+                break;
+            *destination++ = (hexValue(start[1])<<4) | hexValue(start[2]);
+            start += 3;
         }
-        ++start;
     }
     return destination;
 }
 
-template<class charT> void Fastcgipp::Http::Environment<charT>::fill(
+template<class charT, class Containers>
+void Fastcgipp::Http::Environment<charT, Containers>::fill(
         const char* data,
         const char* const dataEnd)
 {
@@ -170,6 +400,38 @@ template<class charT> void Fastcgipp::Http::Environment<charT>::fill(
     const char* value;
     const char* end;
 
+    if(m_lazy)
+    {
+        const size_t offset = m_parameterData.size();
+        m_parameterData.insert(m_parameterData.end(), data, dataEnd);
+        const char* const base = m_parameterData.data();
+        data = base+offset;
+
+        while(Protocol::processParamHeader(
+                data,
+                base+m_parameterData.size(),
+                name,
+                value,
+                end))
+        {
+            // Without these we can't even take in the request body
+            const Parameter known = identifyParameter(name, value);
+            const bool essential = known == Parameter::REQUEST_METHOD
+                || known == Parameter::CONTENT_LENGTH
+                || known == Parameter::CONTENT_TYPE;
+            if(essential)
+                parameter(name, value, end);
+
+            m_parameters.push_back({
+                    size_t(name-base),
+                    size_t(value-base),
+                    size_t(end-base),
+                    essential});
+            data = end;
+        }
+        return;
+    }
+
     while(Protocol::processParamHeader(
             data,
             dataEnd,
@@ -177,243 +439,301 @@ template<class charT> void Fastcgipp::Http::Environment<charT>::fill(
             value,
             end))
     {
-        bool processed=true;
+        parameter(name, value, end);
+        data = end;
+    }
+}
+
+template<class charT, class Containers>
+void Fastcgipp::Http::Environment<charT, Containers>::parse(
+        const char* const name)
+{
+    const size_t nameSize = name?std::strlen(name):0;
+    const char* const base = m_parameterData.data();
+
+    for(auto& stored: m_parameters)
+    {
+        if(stored.parsed)
+            continue;
+        if(name && (
+                    stored.value-stored.name != nameSize
+                    || !std::equal(name, name+nameSize, base+stored.name)))
+            continue;
+
+        parameter(
+                base+stored.name,
+                base+stored.value,
+                base+stored.end);
+        stored.parsed = true;
+    }
+}
+
+template<class charT, class Containers>
+Fastcgipp::Http::RawString Fastcgipp::Http::Environment<charT, Containers>::raw(
+        const char* const name) const
+{
+    const size_t nameSize = std::strlen(name);
+    const char* const base = m_parameterData.data();
+
+    for(const auto& stored: m_parameters)
+        if(
+                stored.value-stored.name == nameSize
+                && std::equal(name, name+nameSize, base+stored.name))
+            return RawString(
+                    base+stored.value,
+                    stored.end-stored.value);
+
+    return RawString();
+}
 
-        switch(value-name)
+template<class charT, class Containers>
+void Fastcgipp::Http::Environment<charT, Containers>::parameter(
+        const char* const name,
+        const char* const value,
+        const char* const end)
+{
+    switch(identifyParameter(name, value))
+    {
+    case Parameter::HTTP_HOST:
+        vecToString(value, end, host);
+        break;
+    case Parameter::PATH_INFO:
+    {
+        const size_t bufferSize = end-value;
+        std::unique_ptr<char[]> buffer(new char[bufferSize]);
+        int size=-1;
+        for(
+                auto source=value;
+                source<=end;
+                ++source, ++size)
         {
-        case 9:
-            if(std::equal(name, value, "HTTP_HOST"))
-                vecToString(value, end, host);
-            else if(std::equal(name, value, "PATH_INFO"))
+            if(*source == '/' || source == end)
             {
-                const size_t bufferSize = end-value;
-                std::unique_ptr<char[]> buffer(new char[bufferSize]);
-                int size=-1;
-                for(
-                        auto source=value;
-                        source<=end;
-                        ++source, ++size)
+                if(size > 0)
                 {
-                    if(*source == '/' || source == end)
-                    {
-                        if(size > 0)
-                        {
-                            const auto bufferEnd = percentEscapedToRealBytes(
-                                    source-size,
-                                    source,
-                                    buffer.get());
-                            pathInfo.push_back(std::basic_string<charT>());
-                            vecToString(
-                                    buffer.get(),
-                                    bufferEnd,
-                                    pathInfo.back());
-                        }
-                        size=-1;
-                    }
+                    const auto bufferEnd = percentEscapedToRealBytes(
+                            source-size,
+                            source,
+                            buffer.get());
+                    pathInfo.push_back(std::basic_string<charT>());
+                    vecToString(
+                            buffer.get(),
+                            bufferEnd,
+                            pathInfo.back());
                 }
+                size=-1;
             }
-            else
-                processed=false;
-            break;
-        case 11:
-            if(std::equal(name, value, "HTTP_ACCEPT"))
-                vecToString(value, end, acceptContentTypes);
-            else if(std::equal(name, value, "HTTP_COOKIE"))
-                decodeUrlEncoded(value, end, cookies, "; ");
-            else if(std::equal(name, value, "SERVER_ADDR"))
-                serverAddress.assign(&*value, &*end);
-            else if(std::equal(name, value, "REMOTE_ADDR"))
-                remoteAddress.assign(&*value, &*end);
-            else if(std::equal(name, value, "SERVER_PORT"))
-                serverPort=atoi(&*value, &*end);
-            else if(std::equal(name, value, "REMOTE_PORT"))
-                remotePort=atoi(&*value, &*end);
-            else if(std::equal(name, value, "SCRIPT_NAME"))
-                vecToString(value, end, scriptName);
-            else if(std::equal(name, value, "REQUEST_URI"))
-                vecToString(value, end, requestUri);
-            else if(std::equal(name, value, "HTTP_ORIGIN"))
-                vecToString(value, end, origin);
-            else
-                processed=false;
-            break;
-        case 12:
-            if(std::equal(name, value, "HTTP_REFERER"))
-                vecToString(value, end, referer);
-            else if(std::equal(name, value, "CONTENT_TYPE"))
-            {
-                const auto semicolon = std::find(value, end, ';');
-                vecToString(
+        }
+        break;
+    }
+    case Parameter::HTTP_ACCEPT:
+        vecToString(value, end, acceptContentTypes);
+        break;
+    case Parameter::HTTP_COOKIE:
+        decodeUrlEncoded(value, end, cookies, "; ");
+        break;
+    case Parameter::SERVER_ADDR:
+        serverAddress.assign(&*value, &*end);
+        break;
+    case Parameter::REMOTE_ADDR:
+        remoteAddress.assign(&*value, &*end);
+        break;
+    case Parameter::SERVER_PORT:
+        serverPort=atoi(&*value, &*end);
+        break;
+    case Parameter::REMOTE_PORT:
+        remotePort=atoi(&*value, &*end);
+        break;
+    case Parameter::SCRIPT_NAME:
+        vecToString(value, end, scriptName);
+        break;
+    case Parameter::REQUEST_URI:
+        vecToString(value, end, requestUri);
+        break;
+    case Parameter::HTTP_ORIGIN:
+        vecToString(value, end, origin);
+        break;
+    case Parameter::HTTP_REFERER:
+        vecToString(value, end, referer);
+        break;
+    case Parameter::CONTENT_TYPE:
+    {
+        const auto semicolon = std::find(value, end, ';');
+        vecToString(
+                value,
+                semicolon,
+                contentType);
+        if(semicolon != end)
+        {
+            const auto equals = std::find(semicolon, end, '=');
+            if(equals != end)
+                boundary.assign(
+                        equals+1,
+                        end);
+        }
+        break;
+    }
+    case Parameter::QUERY_STRING:
+        decodeUrlEncoded(value, end, gets);
+        break;
+    case Parameter::DOCUMENT_ROOT:
+        vecToString(value, end, root);
+        break;
+    case Parameter::REQUEST_METHOD:
+    {
+        requestMethod = RequestMethod::ERROR;
+        switch(end-value)
+        {
+        case 3:
+            if(std::equal(
                         value,
-                        semicolon,
-                        contentType);
-                if(semicolon != end)
-                {
-                    const auto equals = std::find(semicolon, end, '=');
-                    if(equals != end)
-                        boundary.assign(
-                                equals+1,
-                                end);
-                }
-            }
-            else if(std::equal(name, value, "QUERY_STRING"))
-                decodeUrlEncoded(value, end, gets);
-            else
-                processed=false;
-            break;
-        case 13:
-            if(std::equal(name, value, "DOCUMENT_ROOT"))
-                vecToString(value, end, root);
-            else
-                processed=false;
+                        end,
+                        requestMethodLabels[static_cast<int>(
+                            RequestMethod::GET)]))
+                requestMethod = RequestMethod::GET;
+            else if(std::equal(
+                        value,
+                        end,
+                        requestMethodLabels[static_cast<int>(
+                            RequestMethod::PUT)]))
+                requestMethod = RequestMethod::PUT;
             break;
-        case 14:
-            if(std::equal(name, value, "REQUEST_METHOD"))
-            {
-                requestMethod = RequestMethod::ERROR;
-                switch(end-value)
-                {
-                case 3:
-                    if(std::equal(
-                                value,
-                                end,
-                                requestMethodLabels[static_cast<int>(
-                                    RequestMethod::GET)]))
-                        requestMethod = RequestMethod::GET;
-                    else if(std::equal(
-                                value,
-                                end,
-                                requestMethodLabels[static_cast<int>(
-                                    RequestMethod::PUT)]))
-                        requestMethod = RequestMethod::PUT;
-                    break;
-                case 4:
-                    if(std::equal(
-                                value,
-                                end,
-                                requestMethodLabels[static_cast<int>(
-                                    RequestMethod::HEAD)]))
-                        requestMethod = RequestMethod::HEAD;
-                    else if(std::equal(
-                                value,
-                                end,
-                                requestMethodLabels[static_cast<int>(
-                                    RequestMethod::POST)]))
-                        requestMethod = RequestMethod::POST;
-                    break;
-                case 5:
-                    if(std::equal(
-                                value,
-                                end,
-                                requestMethodLabels[static_cast<int>(
-                                    RequestMethod::TRACE)]))
-                        requestMethod = RequestMethod::TRACE;
-                    break;
-                case 6:
-                    if(std::equal(
-                                value,
-                                end,
-                                requestMethodLabels[static_cast<int>(
-                                    RequestMethod::DELETE)]))
-                        requestMethod = RequestMethod::DELETE;
-                    break;
-                case 7:
-                    if(std::equal(
-                                value,
-                                end,
-                                requestMethodLabels[static_cast<int>(
-                                    RequestMethod::OPTIONS)]))
-                        requestMethod = RequestMethod::OPTIONS;
-                    else if(std::equal(
-                                value,
-                                end,
-                                requestMethodLabels[static_cast<int>(
-                                    RequestMethod::OPTIONS)]))
-                        requestMethod = RequestMethod::CONNECT;
-                    break;
-                }
-            }
-            else if(std::equal(name, value, "CONTENT_LENGTH"))
-                contentLength=atoi(&*value, &*end);
-            else
-                processed=false;
+        case 4:
+            if(std::equal(
+                        value,
+                        end,
+                        requestMethodLabels[static_cast<int>(
+                            RequestMethod::HEAD)]))
+                requestMethod = RequestMethod::HEAD;
+            else if(std::equal(
+                        value,
+                        end,
+                        requestMethodLabels[static_cast<int>(
+                            RequestMethod::POST)]))
+                requestMethod = RequestMethod::POST;
             break;
-        case 15:
-            if(std::equal(name, value, "HTTP_USER_AGENT"))
-                vecToString(value, end, userAgent);
-            else if(std::equal(name, value, "HTTP_KEEP_ALIVE"))
-                keepAlive=atoi(&*value, &*end);
-            else
-                processed=false;
+        case 5:
+            if(std::equal(
+                        value,
+                        end,
+                        requestMethodLabels[static_cast<int>(
+                            RequestMethod::TRACE)]))
+                requestMethod = RequestMethod::TRACE;
             break;
-        case 18:
-            if(std::equal(name, value, "HTTP_IF_NONE_MATCH"))
-                etag=atoi(&*value, &*end);
-            else if(std::equal(name, value, "HTTP_AUTHORIZATION"))
-                vecToString(value, end, authorization);
-            else
-                processed=false;
+        case 6:
+            if(std::equal(
+                        value,
+                        end,
+                        requestMethodLabels[static_cast<int>(
+                            RequestMethod::DELETE)]))
+                requestMethod = RequestMethod::DELETE;
             break;
-        case 19:
-            if(std::equal(name, value, "HTTP_ACCEPT_CHARSET"))
-                vecToString(value, end, acceptCharsets);
-            else
-                processed=false;
+        case 7:
+            if(std::equal(
+                        value,
+                        end,
+                        requestMethodLabels[static_cast<int>(
+                            RequestMethod::OPTIONS)]))
+                requestMethod = RequestMethod::OPTIONS;
+            else if(std::equal(
+                        value,
+                        end,
+                        requestMethodLabels[static_cast<int>(
+                            RequestMethod::OPTIONS)]))
+                requestMethod = RequestMethod::CONNECT;
             break;
-        case 20:
-            if(std::equal(name, value, "HTTP_ACCEPT_LANGUAGE"))
-            {
-                const char* groupStart = value;
-                const char* groupEnd;
-                const char* subStart;
-                const char* subEnd;
-                size_t dash;
-                while(groupStart < end)
-                {
-                    acceptLanguages.push_back(std::string());
-                    std::string& language = acceptLanguages.back();
+        }
+        break;
+    }
+    case Parameter::CONTENT_LENGTH:
+        contentLength=atoi(&*value, &*end);
+        break;
+    case Parameter::HTTP_USER_AGENT:
+        vecToString(value, end, userAgent);
+        break;
+    case Parameter::HTTP_KEEP_ALIVE:
+        keepAlive=atoi(&*value, &*end);
+        break;
+    case Parameter::FCGI_DATA_LENGTH:
+        dataLength=atoi(&*value, &*end);
+        break;
+    case Parameter::FCGI_DATA_LAST_MOD:
+        dataLastModified=atoi(&*value, &*end);
+        break;
+    case Parameter::HTTP_IF_NONE_MATCH:
+    {
+        // Only the number in the first entity tag counts. The weak prefix,
+        // quotes and anything after the number like a coding suffix are
+        // skipped over.
+        const char* tag = value;
+        while(tag < end && *tag == ' ')
+            ++tag;
+        if(end-tag >= 2 && tag[0] == 'W' && tag[1] == '/')
+            tag += 2;
+        if(tag < end && *tag == '"')
+            ++tag;
+        etag = 0;
+        for(; tag < end && '0' <= *tag && *tag <= '9'; ++tag)
+            etag = etag*10 + (*tag-'0');
+        break;
+    }
+    case Parameter::HTTP_AUTHORIZATION:
+        vecToString(value, end, authorization);
+        break;
+    case Parameter::HTTP_ACCEPT_CHARSET:
+        vecToString(value, end, acceptCharsets);
+        break;
+    case Parameter::HTTP_ACCEPT_LANGUAGE:
+    {
+        const char* groupStart = value;
+        const char* groupEnd;
+        const char* subStart;
+        const char* subEnd;
+        size_t dash;
+        while(groupStart < end)
+        {
+            acceptLanguages.push_back(std::string());
+            std::string& language = acceptLanguages.back();
 
-                    groupEnd = std::find(groupStart, end, ',');
+            groupEnd = std::find(groupStart, end, ',');
 
-                    // Setup the locality
-                    subEnd = std::find(groupStart, groupEnd, ';');
-                    subStart = groupStart;
-                    while(subStart != subEnd && *subStart == ' ')
-                        ++subStart;
-                    while(subEnd != subStart && *(subEnd-1) == ' ')
-                        --subEnd;
-                    vecToString(subStart, subEnd, language);
+            // Setup the locality
+            subEnd = std::find(groupStart, groupEnd, ';');
+            subStart = groupStart;
+            while(subStart != subEnd && *subStart == ' ')
+                ++subStart;
+            while(subEnd != subStart && *(subEnd-1) == ' ')
+                --subEnd;
+            vecToString(subStart, subEnd, language);
 
-                    dash = language.find('-');
-                    if(dash != std::string::npos)
-                        language[dash] = '_';
+            dash = language.find('-');
+            if(dash != std::string::npos)
+                language[dash] = '_';
 
-                    groupStart = groupEnd+1;
-                }
-            }
-            else
-                processed=false;
-            break;
-        case 22:
-            if(std::equal(name, value, "HTTP_IF_MODIFIED_SINCE"))
-            {
-                std::tm time;
-                std::fill(
-                        reinterpret_cast<char*>(&time),
-                        reinterpret_cast<char*>(&time)+sizeof(time),
-                        0);
-                std::stringstream dateStream;
-                dateStream.write(&*value, end-value);
-                dateStream >> std::get_time(
-                        &time,
-                        "%a, %d %b %Y %H:%M:%S GMT");
-                ifModifiedSince = std::mktime(&time) - timezone;
-            }
-            else
-                processed=false;
-            break;
+            groupStart = groupEnd+1;
         }
-        if(!processed)
+        break;
+    }
+    case Parameter::HTTP_ACCEPT_ENCODING:
+        vecToString(value, end, acceptEncodings);
+        break;
+    case Parameter::HTTP_IF_MODIFIED_SINCE:
+    {
+        std::tm time;
+        std::fill(
+                reinterpret_cast<char*>(&time),
+                reinterpret_cast<char*>(&time)+sizeof(time),
+                0);
+        std::stringstream dateStream;
+        dateStream.write(&*value, end-value);
+        dateStream >> std::get_time(
+                &time,
+                "%a, %d %b %Y %H:%M:%S GMT");
+        ifModifiedSince = std::mktime(&time) - timezone;
+        break;
+    }
+    default:
+        if(keepOther(name, value))
         {
             std::basic_string<charT> nameString;
             std::basic_string<charT> valueString;
@@ -421,249 +741,600 @@ template<class charT> void Fastcgipp::Http::Environment<charT>::fill(
             vecToString(value, end, valueString);
             others[nameString] = valueString;
         }
-        data = end;
+        break;
     }
 }
 
-template<class charT>
-void Fastcgipp::Http::Environment<charT>::fillPostBuffer(
+template<class charT, class Containers>
+void Fastcgipp::Http::Environment<charT, Containers>::fillPostBuffer(
         const char* const start,
         const char* const end)
 {
-    if(m_postBuffer.empty())
+    if(m_postBuffer.empty() && !m_streaming)
         m_postBuffer.reserve(contentLength);
     m_postBuffer.insert(m_postBuffer.end(), start, end);
+    m_postSize += end-start;
+
+    if(m_streaming)
+        switch(postType())
+        {
+            case PostType::MULTIPART:
+                parsePostsMultipart(false);
+                break;
+            case PostType::URLENCODED:
+                parsePostsUrlEncoded(false);
+                break;
+            default:
+                break;
+        }
 }
 
-template<class charT>
-bool Fastcgipp::Http::Environment<charT>::parsePostBuffer()
+template<class charT, class Containers>
+void Fastcgipp::Http::Environment<charT, Containers>::clear()
+{
+    host.clear();
+    origin.clear();
+    userAgent.clear();
+    acceptContentTypes.clear();
+    acceptLanguages.clear();
+    acceptCharsets.clear();
+    acceptEncodings.clear();
+    authorization.clear();
+    referer.clear();
+    contentType.clear();
+    root.clear();
+    scriptName.clear();
+    requestMethod = RequestMethod::ERROR;
+    requestUri.clear();
+    pathInfo.clear();
+    etag = 0;
+    keepAlive = 0;
+    contentLength = 0;
+    serverAddress.zero();
+    remoteAddress.zero();
+    serverPort = 0;
+    remotePort = 0;
+    ifModifiedSince = 0;
+    dataLength = 0;
+    dataLastModified = 0;
+    others.clear();
+    cookies.clear();
+    gets.clear();
+    posts.clear();
+    files.clear();
+    boundary.clear();
+    clearPostBuffer();
+    m_postSize = 0;
+    m_postType = PostType::UNKNOWN;
+    m_inPart = false;
+    m_partNamed = false;
+    m_partIsFile = false;
+    m_partName.clear();
+    m_partFile = File<charT>();
+    m_fileBuffer.clear();
+    m_parameterData.clear();
+    m_parameters.clear();
+}
+
+template<class charT, class Containers>
+typename Fastcgipp::Http::Environment<charT, Containers>::PostType
+Fastcgipp::Http::Environment<charT, Containers>::postType()
 {
     static const std::string multipartStr("multipart/form-data");
     static const std::string urlEncodedStr("application/x-www-form-urlencoded");
 
-    if(!m_postBuffer.size())
-        return true;
-
-    bool parsed = false;
-
-    if(std::equal(
-                multipartStr.cbegin(),
-                multipartStr.cend(),
-                contentType.cbegin(),
-                contentType.cend()))
+    if(m_postType == PostType::UNKNOWN)
     {
-        parsePostsMultipart();
-        parsed = true;
-    }
-    else if(std::equal(
-                urlEncodedStr.cbegin(),
-                urlEncodedStr.cend(),
-                contentType.cbegin(),
-                contentType.cend()))
-    {
-        parsePostsUrlEncoded();
-        parsed = true;
+        if(std::equal(
+                    multipartStr.cbegin(),
+                    multipartStr.cend(),
+                    contentType.cbegin(),
+                    contentType.cend()))
+            m_postType = PostType::MULTIPART;
+        else if(std::equal(
+                    urlEncodedStr.cbegin(),
+                    urlEncodedStr.cend(),
+                    contentType.cbegin(),
+                    contentType.cend()))
+            m_postType = PostType::URLENCODED;
+        else
+            m_postType = PostType::NONE;
     }
 
-    return parsed;
+    return m_postType;
 }
 
-template<class charT>
-void Fastcgipp::Http::Environment<charT>::parsePostsMultipart()
+template<class charT, class Containers>
+bool Fastcgipp::Http::Environment<charT, Containers>::parsePostBuffer()
 {
-    static const std::string cName("name=\"");
-    static const std::string cFilename("filename=\"");
-    static const std::string cContentType("Content-Type: ");
-    static const std::string cBody("\r\n\r\n");
+    if(!m_postSize)
+        return true;
 
-    const char* const postBufferStart = m_postBuffer.data();
-    const char* const postBufferEnd = m_postBuffer.data() + m_postBuffer.size();
+    switch(postType())
+    {
+        case PostType::MULTIPART:
+            parsePostsMultipart(true);
+            return true;
+        case PostType::URLENCODED:
+            parsePostsUrlEncoded(true);
+            return true;
+        default:
+            return false;
+    }
+}
 
-    auto nameStart(postBufferEnd);
-    auto nameEnd(postBufferEnd);
-    auto filenameStart(postBufferEnd);
-    auto filenameEnd(postBufferEnd);
-    auto contentTypeStart(postBufferEnd);
-    auto contentTypeEnd(postBufferEnd);
-    auto bodyStart(postBufferEnd);
-    auto bodyEnd(postBufferEnd);
+template<class charT, class Containers>
+void Fastcgipp::Http::Environment<charT, Containers>::parsePostsMultipart(
+        bool last)
+{
+    static const std::string cBody("\r\n\r\n");
 
-    enum State
-    {
-        HEADER,
-        NAME,
-        FILENAME,
-        CONTENT_TYPE,
-        BODY
-    } state=HEADER;
+    const char* const start = m_postBuffer.data();
+    const char* const end = m_postBuffer.data() + m_postBuffer.size();
+    const char* position = start;
 
-    for(auto byte = postBufferStart; byte < postBufferEnd; ++byte)
+    while(position < end)
     {
-        switch(state)
+        if(!m_inPart)
         {
-            case HEADER:
+            const auto headerEnd = Scan::find(
+                    position,
+                    end,
+                    cBody.data(),
+                    cBody.size());
+            if(headerEnd == end)
             {
-                const size_t bytesLeft = size_t(postBufferEnd-byte);
-
-                if(
-                        nameEnd == postBufferEnd &&
-                        bytesLeft >= cName.size() &&
-                        std::equal(cName.begin(), cName.end(), byte))
-                {
-                    byte += cName.size()-1;
-                    nameStart = byte+1;
-                    state = NAME;
-                }
-                else if(
-                        filenameEnd == postBufferEnd &&
-                        bytesLeft >= cFilename.size() &&
-                        std::equal(cFilename.begin(), cFilename.end(), byte))
-                {
-                    byte += cFilename.size()-1;
-                    filenameStart = byte+1;
-                    state = FILENAME;
-                }
-                else if(
-                        contentTypeEnd == postBufferEnd &&
-                        bytesLeft >= cContentType.size() &&
-                        std::equal(cContentType.begin(), cContentType.end(), byte))
-                {
-                    byte += cContentType.size()-1;
-                    contentTypeStart = byte+1;
-                    state = CONTENT_TYPE;
-                }
-                else if(
-                        bodyEnd == postBufferEnd &&
-                        bytesLeft >= cBody.size() &&
-                        std::equal(cBody.begin(), cBody.end(), byte))
-                {
-                    byte += cBody.size()-1;
-                    bodyStart = byte+1;
-                    state = BODY;
-                }
-
+                if(last)
+                    position = end;
                 break;
             }
 
-            case NAME:
+            parsePartHeader(position, headerEnd);
+            position = headerEnd+cBody.size();
+            m_inPart = true;
+        }
+        else
+        {
+            const auto delimiter = Scan::find(
+                    position,
+                    end,
+                    boundary.data(),
+                    boundary.size());
+            if(delimiter == end)
             {
-                if(*byte == '"')
+                // The tail could be the start of "\r\n--boundary"
+                const size_t hold = boundary.size()+4;
+                if(size_t(end-position) > hold
+                        && (m_partIsFile || !m_partNamed))
                 {
-                    nameEnd=byte;
-                    state=HEADER;
+                    if(m_partNamed)
+                        fileData(position, end-hold);
+                    position = end-hold;
                 }
-                break;
-            }
 
-            case FILENAME:
-            {
-                if(*byte == '"')
+                if(last)
                 {
-                    filenameEnd=byte;
-                    state=HEADER;
+                    position = end;
+                    m_inPart = false;
+                    m_partFile = File<charT>();
+                    m_fileBuffer.clear();
                 }
                 break;
             }
 
-            case CONTENT_TYPE:
-            {
-                if(*byte == '\r' || *byte == '\n')
-                {
-                    contentTypeEnd = byte--;
-                    state=HEADER;
-                }
-                break;
-            }
+            auto bodyEnd = delimiter-2;
+            if(bodyEnd<position)
+                bodyEnd = position;
+            else if(
+                    bodyEnd-position>=2
+                    && *(bodyEnd-1)=='\n'
+                    && *(bodyEnd-2)=='\r')
+                bodyEnd -= 2;
 
-            case BODY:
-            {
-                const size_t bytesLeft = size_t(postBufferEnd-byte);
+            finishPart(position, bodyEnd);
+            position = delimiter+boundary.size();
+            m_inPart = false;
+        }
+    }
 
-                if(
-                        bytesLeft >= boundary.size() &&
-                        std::equal(boundary.begin(), boundary.end(), byte))
-                {
-                    bodyEnd = byte-2;
-                    if(bodyEnd<bodyStart)
-                        bodyEnd = bodyStart;
-                    else if(
-                            bodyEnd-bodyStart>=2
-                            && *(bodyEnd-1)=='\n'
-                            && *(bodyEnd-2)=='\r')
-                        bodyEnd -= 2;
-
-                    if(nameEnd != postBufferEnd)
-                    {
-                        std::basic_string<charT> name;
-                        vecToString(nameStart, nameEnd, name);
-
-                        if(contentTypeEnd != postBufferEnd)
-                        {
-                            File<charT> file;
-                            vecToString(
-                                    contentTypeStart,
-                                    contentTypeEnd,
-                                    file.contentType);
-                            if(filenameEnd != postBufferEnd)
-                                vecToString(
-                                        filenameStart,
-                                        filenameEnd,
-                                        file.filename);
-
-                            file.size = bodyEnd-bodyStart;
-                            file.data.reset(new char[file.size]);
-                            std::copy(bodyStart, bodyEnd, file.data.get());
-
-                            files.insert(std::make_pair(
-                                        std::move(name),
-                                        std::move(file)));
-                        }
-                        else
-                        {
-                            std::basic_string<charT> value;
-                            vecToString(bodyStart, bodyEnd, value);
-                            posts.insert(std::make_pair(
-                                        std::move(name),
-                                        std::move(value)));
-                        }
-                    }
-
-                    state=HEADER;
-                    nameStart = postBufferEnd;
-                    nameEnd = postBufferEnd;
-                    filenameStart = postBufferEnd;
-                    filenameEnd = postBufferEnd;
-                    contentTypeStart = postBufferEnd;
-                    contentTypeEnd = postBufferEnd;
-                    bodyStart = postBufferEnd;
-                    bodyEnd = postBufferEnd;
-                }
+    m_postBuffer.erase(
+            m_postBuffer.begin(),
+            m_postBuffer.begin()+(position-start));
+}
+
+template<class charT, class Containers>
+void Fastcgipp::Http::Environment<charT, Containers>::parsePartHeader(
+        const char* const start,
+        const char* const end)
+{
+    static const std::string cName("name=\"");
+    static const std::string cFilename("filename=\"");
+    static const std::string cContentType("Content-Type: ");
+
+    m_partNamed = false;
+    m_partIsFile = false;
+    m_partName.clear();
+    m_partFile = File<charT>();
+    bool filenamed = false;
 
+    for(auto byte = start; byte < end; ++byte)
+    {
+        const size_t bytesLeft = size_t(end-byte);
+
+        if(
+                !m_partNamed &&
+                bytesLeft >= cName.size() &&
+                std::equal(cName.begin(), cName.end(), byte))
+        {
+            const auto nameStart = byte+cName.size();
+            const auto nameEnd = std::find(nameStart, end, '"');
+            if(nameEnd == end)
                 break;
+            vecToString(nameStart, nameEnd, m_partName);
+            m_partNamed = true;
+            byte = nameEnd;
+        }
+        else if(
+                !filenamed &&
+                bytesLeft >= cFilename.size() &&
+                std::equal(cFilename.begin(), cFilename.end(), byte))
+        {
+            const auto filenameStart = byte+cFilename.size();
+            const auto filenameEnd = std::find(filenameStart, end, '"');
+            if(filenameEnd == end)
+                break;
+            vecToString(filenameStart, filenameEnd, m_partFile.filename);
+            filenamed = true;
+            byte = filenameEnd;
+        }
+        else if(
+                !m_partIsFile &&
+                bytesLeft >= cContentType.size() &&
+                std::equal(cContentType.begin(), cContentType.end(), byte))
+        {
+            const auto contentTypeStart = byte+cContentType.size();
+            auto contentTypeEnd = contentTypeStart;
+            while(contentTypeEnd < end
+                    && *contentTypeEnd != '\r'
+                    && *contentTypeEnd != '\n')
+                ++contentTypeEnd;
+            vecToString(
+                    contentTypeStart,
+                    contentTypeEnd,
+                    m_partFile.contentType);
+            m_partIsFile = true;
+            byte = contentTypeEnd-1;
+        }
+    }
+
+    if(!m_partNamed)
+        m_partIsFile = false;
+}
+
+template<class charT, class Containers>
+void Fastcgipp::Http::Environment<charT, Containers>::fileData(
+        const char* const start,
+        const char* const end)
+{
+    const size_t size = end-start;
+    if(!size)
+        return;
+    m_partFile.size += size;
+
+    if(m_fileSink)
+    {
+        m_fileSink(m_partName, m_partFile, start, size);
+        return;
+    }
+
+    if(!m_partFile.stream && m_fileBuffer.size()+size > m_spill)
+    {
+        m_partFile.stream.reset(std::tmpfile());
+        if(m_partFile.stream)
+        {
+            std::fwrite(
+                    m_fileBuffer.data(),
+                    1,
+                    m_fileBuffer.size(),
+                    m_partFile.stream.get());
+            m_fileBuffer.clear();
+        }
+        else
+            ERROR_LOG("Unable to create temporary file for upload: " \
+                    << std::strerror(errno))
+    }
+
+    if(m_partFile.stream)
+        std::fwrite(start, 1, size, m_partFile.stream.get());
+    else
+        m_fileBuffer.insert(m_fileBuffer.end(), start, end);
+}
+
+template<class charT, class Containers>
+void Fastcgipp::Http::Environment<charT, Containers>::finishPart(
+        const char* const bodyStart,
+        const char* const bodyEnd)
+{
+    if(m_partNamed)
+    {
+        if(m_partIsFile)
+        {
+            fileData(bodyStart, bodyEnd);
+
+            if(m_fileSink)
+                m_fileSink(m_partName, m_partFile, bodyEnd, 0);
+            else if(m_partFile.stream)
+                std::rewind(m_partFile.stream.get());
+            else
+            {
+                m_partFile.data.reset(new char[m_fileBuffer.size()]);
+                std::copy(
+                        m_fileBuffer.cbegin(),
+                        m_fileBuffer.cend(),
+                        m_partFile.data.get());
             }
+
+            files.insert(std::make_pair(
+                        std::move(m_partName),
+                        std::move(m_partFile)));
+        }
+        else
+        {
+            std::basic_string<charT> value;
+            vecToString(bodyStart, bodyEnd, value);
+            posts.insert(std::make_pair(
+                        std::move(m_partName),
+                        std::move(value)));
         }
     }
+
+    m_partName.clear();
+    m_partFile = File<charT>();
+    m_fileBuffer.clear();
 }
 
-template<class charT>
-void Fastcgipp::Http::Environment<charT>::parsePostsUrlEncoded()
+template<class charT, class Containers>
+void Fastcgipp::Http::Environment<charT, Containers>::parsePostsUrlEncoded(
+        bool last)
 {
-    decodeUrlEncoded(
-            m_postBuffer.data(),
-            m_postBuffer.data()+m_postBuffer.size(),
-            posts);
+    const char* const start = m_postBuffer.data();
+    const char* const end = m_postBuffer.data() + m_postBuffer.size();
+    const char* parseEnd = end;
+    const char* consumed = end;
+
+    if(!last)
+    {
+        const auto separator = std::find(
+                std::reverse_iterator<const char*>(end),
+                std::reverse_iterator<const char*>(start),
+                '&').base();
+        if(separator == start)
+            return;
+        parseEnd = separator-1;
+        consumed = separator;
+    }
+
+    decodeUrlEncoded(start, parseEnd, posts);
+    m_postBuffer.erase(
+            m_postBuffer.begin(),
+            m_postBuffer.begin()+(consumed-start));
 }
 
 template struct Fastcgipp::Http::Environment<char>;
 template struct Fastcgipp::Http::Environment<wchar_t>;
+template struct Fastcgipp::Http::Environment<
+    char,
+    Fastcgipp::Http::FlatContainers>;
+template struct Fastcgipp::Http::Environment<
+    wchar_t,
+    Fastcgipp::Http::FlatContainers>;
 
-Fastcgipp::Http::SessionId::SessionId()
+namespace
 {
-    std::random_device device;
-    std::uniform_int_distribution<unsigned short> distribution(0, 255);
+    //! Bumped in the child process after every fork
+    std::atomic<unsigned> forks(0);
+
+    //! Fill memory with randomness from the operating system
+    void osRandom(unsigned char* data, size_t size)
+    {
+#ifdef FASTCGIPP_LINUX
+        while(size != 0)
+        {
+            const ssize_t count = ::getrandom(data, size, 0);
+            if(count < 0)
+            {
+                if(errno == EINTR)
+                    continue;
+                FAIL_LOG("Unable to get random data from the system: " \
+                        << std::strerror(errno))
+            }
+            data += count;
+            size -= count;
+        }
+#else
+        std::random_device device;
+        while(size != 0)
+        {
+            const unsigned value = device();
+            const size_t count = std::min(size, sizeof(value));
+            std::memcpy(data, &value, count);
+            data += count;
+            size -= count;
+        }
+#endif
+    }
+
+    //! Cryptographically secure random number generator for one thread
+    /*!
+     * This is ChaCha20 keyed from the operating system. Each refill
+     * generates a handful of blocks at once and the first 32 bytes of them
+     * replace the key. Output that was already handed out therefore can't be
+     * reconstructed from the state. Fresh operating system randomness is
+     * mixed in every so often and after a fork so that parent and child
+     * don't hand out the same IDs.
+     */
+    class Random
+    {
+    public:
+        Random():
+            m_key{},
+            m_position(sizeof(m_buffer))
+        {
+            static const int handler = ::pthread_atfork(
+                    nullptr,
+                    nullptr,
+                    [] () { ++forks; });
+            static_cast<void>(handler);
+            reseed();
+        }
+
+        ~Random()
+        {
+            volatile unsigned char* data
+                = reinterpret_cast<volatile unsigned char*>(this);
+            for(size_t i=0; i<sizeof(*this); ++i)
+                data[i] = 0;
+        }
+
+        //! Fill memory with random data
+        void fill(unsigned char* data, size_t size)
+        {
+            if(m_forks != forks.load(std::memory_order_relaxed)
+                    || m_generated >= reseedInterval)
+                reseed();
+            m_generated += size;
+
+            while(size != 0)
+            {
+                if(m_position == sizeof(m_buffer))
+                    refill();
+                const size_t count = std::min(
+                        size,
+                        sizeof(m_buffer)-m_position);
+                std::memcpy(data, m_buffer+m_position, count);
+                std::memset(m_buffer+m_position, 0, count);
+                m_position += count;
+                data += count;
+                size -= count;
+            }
+        }
+
+    private:
+        //! ChaCha20 blocks generated per refill
+        static const size_t blocks = 8;
+
+        //! Bytes handed out before reseeding from the operating system
+        static const size_t reseedInterval = 1<<20;
+
+        //! ChaCha20 key
+        uint32_t m_key[8];
+
+        //! ChaCha20 block counter
+        uint64_t m_counter;
+
+        //! Random data not yet handed out
+        unsigned char m_buffer[blocks*64-sizeof(m_key)];
+
+        //! Position of the first byte in the buffer not yet handed out
+        size_t m_position;
+
+        //! Bytes handed out since the last reseed
+        size_t m_generated;
+
+        //! Value of forks at the last reseed
+        unsigned m_forks;
+
+        //! Take a new key from the operating system
+        void reseed()
+        {
+            unsigned char seed[sizeof(m_key)];
+            osRandom(seed, sizeof(seed));
+            for(unsigned i=0; i<8; ++i)
+                m_key[i] ^= load(seed+4*i);
+            std::memset(seed, 0, sizeof(seed));
+            std::memset(m_buffer, 0, sizeof(m_buffer));
+            m_position = sizeof(m_buffer);
+            m_counter = 0;
+            m_generated = 0;
+            m_forks = forks.load(std::memory_order_relaxed);
+        }
+
+        //! Generate more random data and replace the key
+        void refill()
+        {
+            unsigned char output[blocks*64];
+            for(unsigned i=0; i<blocks; ++i)
+                block(output+64*i);
+            for(unsigned i=0; i<8; ++i)
+                m_key[i] = load(output+4*i);
+            std::memcpy(m_buffer, output+sizeof(m_key), sizeof(m_buffer));
+            std::memset(output, 0, sizeof(output));
+            m_position = 0;
+        }
+
+        static uint32_t load(const unsigned char* x)
+        {
+            return uint32_t(x[0]) | uint32_t(x[1])<<8 | uint32_t(x[2])<<16
+                | uint32_t(x[3])<<24;
+        }
+
+        static uint32_t rotate(uint32_t x, unsigned bits)
+        {
+            return x<<bits | x>>(32-bits);
+        }
+
+        static void quarterRound(
+                uint32_t& a,
+                uint32_t& b,
+                uint32_t& c,
+                uint32_t& d)
+        {
+            a += b; d = rotate(d^a, 16);
+            c += d; b = rotate(b^c, 12);
+            a += b; d = rotate(d^a, 8);
+            c += d; b = rotate(b^c, 7);
+        }
+
+        //! Generate a single 64 byte ChaCha20 block
+        void block(unsigned char* output)
+        {
+            const uint32_t input[16] = {
+                0x61707865, 0x3320646e, 0x79622d32, 0x6b206574,
+                m_key[0], m_key[1], m_key[2], m_key[3],
+                m_key[4], m_key[5], m_key[6], m_key[7],
+                uint32_t(m_counter), uint32_t(m_counter>>32), 0, 0};
+            ++m_counter;
 
-    for(unsigned char& byte: m_data)
-        byte = static_cast<unsigned char>(distribution(device));
+            uint32_t x[16];
+            std::copy(input, input+16, x);
+            for(unsigned round=0; round<10; ++round)
+            {
+                quarterRound(x[0], x[4], x[8], x[12]);
+                quarterRound(x[1], x[5], x[9], x[13]);
+                quarterRound(x[2], x[6], x[10], x[14]);
+                quarterRound(x[3], x[7], x[11], x[15]);
+                quarterRound(x[0], x[5], x[10], x[15]);
+                quarterRound(x[1], x[6], x[11], x[12]);
+                quarterRound(x[2], x[7], x[8], x[13]);
+                quarterRound(x[3], x[4], x[9], x[14]);
+            }
+
+            for(unsigned i=0; i<16; ++i)
+            {
+                const uint32_t word = x[i]+input[i];
+                output[4*i] = static_cast<unsigned char>(word);
+                output[4*i+1] = static_cast<unsigned char>(word>>8);
+                output[4*i+2] = static_cast<unsigned char>(word>>16);
+                output[4*i+3] = static_cast<unsigned char>(word>>24);
+            }
+        }
+    };
+}
+
+Fastcgipp::Http::SessionId::SessionId()
+{
+    thread_local Random random;
+    random.fill(m_data.data(), size);
     m_timestamp = std::time(nullptr);
 }
 
@@ -684,6 +1355,58 @@ template<class charT> Fastcgipp::Http::SessionId::SessionId(
 const size_t Fastcgipp::Http::SessionId::stringLength;
 const size_t Fastcgipp::Http::SessionId::size;
 
+namespace
+{
+    template<class Output> void decodeUrlEncodedInto(
+            const char* data,
+            const char* const dataEnd,
+            Output& output,
+            const char* const fieldSeparator)
+    {
+        typedef typename Output::key_type String;
+        std::unique_ptr<char[]> buffer(new char[dataEnd-data]);
+        String name;
+        String value;
+
+        const size_t fieldSeparatorSize = std::strlen(fieldSeparator);
+
+        const char* nameStart = data;
+        while(true)
+        {
+            const char* const equals = static_cast<const char*>(
+                    std::memchr(nameStart, '=', dataEnd-nameStart));
+            if(equals == nullptr)
+                break;
+
+            const char* decodedEnd =
+                Fastcgipp::Http::percentEscapedToRealBytes(
+                        nameStart,
+                        equals,
+                        buffer.get());
+            Fastcgipp::Http::vecToString(buffer.get(), decodedEnd, name);
+
+            const char* const valueStart = equals+1;
+            const char* const valueEnd = Fastcgipp::Scan::find(
+                    valueStart,
+                    dataEnd,
+                    fieldSeparator,
+                    fieldSeparatorSize);
+            decodedEnd = Fastcgipp::Http::percentEscapedToRealBytes(
+                    valueStart,
+                    valueEnd,
+                    buffer.get());
+            Fastcgipp::Http::vecToString(buffer.get(), decodedEnd, value);
+            output.insert(std::make_pair(
+                        std::move(name),
+                        std::move(value)));
+
+            if(valueEnd == dataEnd)
+                break;
+            nameStart = valueEnd+fieldSeparatorSize;
+        }
+    }
+}
+
 template void Fastcgipp::Http::decodeUrlEncoded<char>(
         const char* data,
         const char* const dataEnd,
@@ -691,6 +1414,13 @@ template void Fastcgipp::Http::decodeUrlEncoded<char>(
             std::basic_string<char>,
             std::basic_string<char>>& output,
         const char* const fieldSeparator);
+template void Fastcgipp::Http::decodeUrlEncoded<char>(
+        const char* data,
+        const char* const dataEnd,
+        Fastcgipp::FlatMultimap<
+            std::basic_string<char>,
+            std::basic_string<char>>& output,
+        const char* const fieldSeparator);
 template void Fastcgipp::Http::decodeUrlEncoded<wchar_t>(
         const char* data,
         const char* const dataEnd,
@@ -698,6 +1428,13 @@ template void Fastcgipp::Http::decodeUrlEncoded<wchar_t>(
             std::basic_string<wchar_t>,
             std::basic_string<wchar_t>>& output,
         const char* const fieldSeparator);
+template void Fastcgipp::Http::decodeUrlEncoded<wchar_t>(
+        const char* data,
+        const char* const dataEnd,
+        Fastcgipp::FlatMultimap<
+            std::basic_string<wchar_t>,
+            std::basic_string<wchar_t>>& output,
+        const char* const fieldSeparator);
 template<class charT> void Fastcgipp::Http::decodeUrlEncoded(
         const char* data,
         const char* const dataEnd,
@@ -706,51 +1443,18 @@ template<class charT> void Fastcgipp::Http::decodeUrlEncoded(
             std::basic_string<charT>>& output,
         const char* const fieldSeparator)
 {
-    std::unique_ptr<char[]> buffer(new char[dataEnd-data]);
-    std::basic_string<charT> name;
-    std::basic_string<charT> value;
-
-    const size_t fieldSeparatorSize = std::strlen(fieldSeparator);
-    const char* const fieldSeparatorEnd = fieldSeparator+fieldSeparatorSize;
-
-    const char* nameStart = data;
-    const char* nameEnd = dataEnd;
-    const char* valueStart = nullptr;
-    const char* valueEnd;
+    decodeUrlEncodedInto(data, dataEnd, output, fieldSeparator);
+}
 
-    while(data <= dataEnd)
-    {
-        if(nameEnd != dataEnd)
-        {
-            if(data == dataEnd || (data+fieldSeparatorSize<=dataEnd
-                        && std::equal(fieldSeparator, fieldSeparatorEnd, data)))
-            {
-                valueEnd=percentEscapedToRealBytes(
-                        valueStart,
-                        data,
-                        buffer.get());
-                vecToString(buffer.get(), valueEnd, value);
-                output.insert(std::make_pair(
-                            std::move(name),
-                            std::move(value)));
-
-                nameStart = data+fieldSeparatorSize;
-                data += fieldSeparatorSize;
-                nameEnd = dataEnd;
-                continue;
-            }
-        }
-        else if(data!=dataEnd && *data=='=')
-        {
-            nameEnd = percentEscapedToRealBytes(
-                    nameStart,
-                    data,
-                    buffer.get());
-            vecToString(buffer.get(), nameEnd, name);
-            valueStart=data+1;
-        }
-        ++data;
-    }
+template<class charT> void Fastcgipp::Http::decodeUrlEncoded(
+        const char* data,
+        const char* const dataEnd,
+        Fastcgipp::FlatMultimap<
+            std::basic_string<charT>,
+            std::basic_string<charT>>& output,
+        const char* const fieldSeparator)
+{
+    decodeUrlEncodedInto(data, dataEnd, output, fieldSeparator);
 }
 
 extern const std::array<const char, 64> Fastcgipp::Http::base64Characters =
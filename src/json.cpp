@@ -0,0 +1,394 @@
+/*!
+ * @file       json.cpp
+ * @brief      Defines the Json class
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 15, 2026
+ * @copyright  Copyright &copy; 2026 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2026 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#include "fastcgi++/json.hpp"
+#include "fastcgi++/scan.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+    //! Characters that need escaping in JSON strings
+    struct Escaped
+    {
+        constexpr bool operator()(unsigned char character) const
+        {
+            return character < 0x20 || character == '"' || character == '\\';
+        }
+    };
+
+    constexpr Fastcgipp::Scan::Set escaped((Escaped()));
+
+    //! Every number from 00 to 99
+    const char digitPairs[] =
+        "0001020304050607080910111213141516171819"
+        "2021222324252627282930313233343536373839"
+        "4041424344454647484950515253545556575859"
+        "6061626364656667686970717273747576777879"
+        "8081828384858687888990919293949596979899";
+
+    //! Build the escape sequence for a character
+    /*!
+     * @param[in] character Character to escape
+     * @param[out] sequence Room for at least 6 characters
+     * @return Size of the sequence
+     */
+    inline size_t escape(unsigned char character, char* sequence)
+    {
+        static const char hex[] = "0123456789abcdef";
+        sequence[0] = '\\';
+        switch(character)
+        {
+            case '"':
+                sequence[1] = '"';
+                return 2;
+            case '\\':
+                sequence[1] = '\\';
+                return 2;
+            case '\b':
+                sequence[1] = 'b';
+                return 2;
+            case '\f':
+                sequence[1] = 'f';
+                return 2;
+            case '\n':
+                sequence[1] = 'n';
+                return 2;
+            case '\r':
+                sequence[1] = 'r';
+                return 2;
+            case '\t':
+                sequence[1] = 't';
+                return 2;
+            default:
+                sequence[1] = 'u';
+                sequence[2] = '0';
+                sequence[3] = '0';
+                sequence[4] = hex[character >> 4];
+                sequence[5] = hex[character & 0xf];
+                return 6;
+        }
+    }
+
+    //! Does a wide character need escaping?
+    inline bool escapedWide(wchar_t character)
+    {
+        return static_cast<unsigned long>(character) < 0x80
+            && escaped.contains(static_cast<unsigned char>(character));
+    }
+
+    inline char* copy(const char* start, const char* end, char* destination)
+    {
+        std::memcpy(destination, start, end-start);
+        return destination+(end-start);
+    }
+
+    inline wchar_t* copy(
+            const char* start,
+            const char* end,
+            wchar_t* destination)
+    {
+        while(start != end)
+            *destination++ = static_cast<unsigned char>(*start++);
+        return destination;
+    }
+
+    //! Format a floating point number as a short decimal fraction
+    /*!
+     * Most numbers seen in practice have few decimal places. We look for the
+     * fewest places that give back exactly the same number. Dividing an
+     * integer below 2^53 by an exact power of ten is correctly rounded so
+     * this is exactly what a parser will see.
+     *
+     * @param[out] buffer Room for at least 32 characters
+     * @param[in] x Finite number to format
+     * @return Size of the text or zero if the number has no such form
+     */
+    template<class Float> size_t fixed(char* buffer, Float x)
+    {
+        static const double powers[] = {
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+            1e12, 1e13, 1e14, 1e15, 1e16, 1e17};
+        const double magnitude = std::fabs(double(x));
+        if(!(magnitude < 1e15))
+            return 0;
+
+        for(unsigned places=0; places<sizeof(powers)/sizeof(double); ++places)
+        {
+            const double scaled = std::round(magnitude*powers[places]);
+            if(scaled >= 9007199254740992.0)
+                return 0;
+            if(Float(scaled/powers[places]) != Float(magnitude))
+                continue;
+
+            char digits[16];
+            char* const digitsEnd = digits+sizeof(digits);
+            char* start = digitsEnd;
+            std::uint64_t integer = std::uint64_t(scaled);
+            do
+            {
+                *--start = char('0'+integer%10);
+                integer /= 10;
+            } while(integer);
+            const size_t size = digitsEnd-start;
+
+            char* position = buffer;
+            if(x < 0)
+                *position++ = '-';
+            if(size <= places)
+            {
+                *position++ = '0';
+                *position++ = '.';
+                position = std::fill_n(position, places-size, '0');
+                position = std::copy(start, digitsEnd, position);
+            }
+            else
+            {
+                position = std::copy(start, digitsEnd-places, position);
+                if(places)
+                {
+                    *position++ = '.';
+                    position = std::copy(digitsEnd-places, digitsEnd, position);
+                }
+            }
+            return position-buffer;
+        }
+        return 0;
+    }
+
+    //! Format a floating point number with as few digits as round trip
+    /*!
+     * @param[out] buffer Room for at least 32 characters
+     * @param[in] x Number to format
+     * @param[in] digits Significant digits that usually suffice
+     * @param[in] exact Significant digits that always suffice
+     * @return Size of the text
+     */
+    template<class Float>
+    size_t shortest(char* buffer, Float x, int digits, int exact)
+    {
+        int size = std::snprintf(buffer, 32, "%.*g", digits, double(x));
+        if(Float(std::strtod(buffer, nullptr)) != x)
+            size = std::snprintf(buffer, 32, "%.*g", exact, double(x));
+
+        // The C locale could have been changed from underneath us
+        std::replace(buffer, buffer+size, ',', '.');
+        return size;
+    }
+}
+
+template<class charT>
+void Fastcgipp::Json<charT>::refill(size_t size)
+{
+    commit();
+    const auto room = m_streambuf.room(size);
+    m_put = room.first;
+    m_end = room.second;
+}
+
+template<class charT>
+void Fastcgipp::Json<charT>::write(const char* data, size_t size)
+{
+    while(size != 0)
+    {
+        if(m_put == m_end)
+            refill(1);
+        const size_t count = std::min(size, size_t(m_end-m_put));
+        m_put = copy(data, data+count, m_put);
+        data += count;
+        size -= count;
+    }
+}
+
+template<class charT>
+void Fastcgipp::Json<charT>::quoted(const char* data, size_t size)
+{
+    put('"');
+    const char* const end = data+size;
+    while(true)
+    {
+        const char* const run = Scan::findAny(data, end, escaped);
+        write(data, run-data);
+        if(run == end)
+            break;
+        char sequence[6];
+        write(sequence, escape(*run, sequence));
+        data = run+1;
+    }
+    put('"');
+}
+
+namespace Fastcgipp
+{
+    template<> void Json<wchar_t>::quoted(const wchar_t* data, size_t size)
+    {
+        put('"');
+        const wchar_t* const end = data+size;
+        while(data != end)
+        {
+            if(escapedWide(*data))
+            {
+                char sequence[6];
+                write(sequence, escape(*data++, sequence));
+                continue;
+            }
+
+            if(m_put == m_end)
+                refill(1);
+            const wchar_t* const limit = data+std::min(
+                    end-data,
+                    m_end-m_put);
+            while(data != limit && !escapedWide(*data))
+                *m_put++ = *data++;
+        }
+        put('"');
+    }
+
+    template<> void Json<char>::quoted(const wchar_t* data, size_t size)
+    {
+        put('"');
+        for(const wchar_t* const end = data+size; data != end; ++data)
+        {
+            const unsigned long character = static_cast<unsigned long>(*data);
+            char sequence[6];
+            if(character < 0x80)
+            {
+                if(escaped.contains(static_cast<unsigned char>(character)))
+                    write(sequence, escape(character, sequence));
+                else
+                    put(char(character));
+            }
+            else if(character < 0x800)
+            {
+                sequence[0] = char(0xc0 | character>>6);
+                sequence[1] = char(0x80 | (character & 0x3f));
+                write(sequence, 2);
+            }
+            else if(character < 0x10000)
+            {
+                sequence[0] = char(0xe0 | character>>12);
+                sequence[1] = char(0x80 | (character>>6 & 0x3f));
+                sequence[2] = char(0x80 | (character & 0x3f));
+                write(sequence, 3);
+            }
+            else
+            {
+                sequence[0] = char(0xf0 | (character>>18 & 0x07));
+                sequence[1] = char(0x80 | (character>>12 & 0x3f));
+                sequence[2] = char(0x80 | (character>>6 & 0x3f));
+                sequence[3] = char(0x80 | (character & 0x3f));
+                write(sequence, 4);
+            }
+        }
+        put('"');
+    }
+}
+
+template<class charT>
+Fastcgipp::Json<charT>& Fastcgipp::Json<charT>::integer(
+        std::uint64_t magnitude,
+        bool negative)
+{
+    char buffer[21];
+    char* const end = buffer+sizeof(buffer);
+    char* start = end;
+    while(magnitude >= 100)
+    {
+        const unsigned pair = unsigned(magnitude%100)*2;
+        magnitude /= 100;
+        *--start = digitPairs[pair+1];
+        *--start = digitPairs[pair];
+    }
+    if(magnitude >= 10)
+    {
+        *--start = digitPairs[magnitude*2+1];
+        *--start = digitPairs[magnitude*2];
+    }
+    else
+        *--start = char('0'+magnitude);
+    if(negative)
+        *--start = '-';
+
+    separate();
+    write(start, end-start);
+    return *this;
+}
+
+template<class charT>
+Fastcgipp::Json<charT>& Fastcgipp::Json<charT>::null()
+{
+    separate();
+    write("null", 4);
+    return *this;
+}
+
+template<class charT>
+Fastcgipp::Json<charT>& Fastcgipp::Json<charT>::value(bool x)
+{
+    separate();
+    if(x)
+        write("true", 4);
+    else
+        write("false", 5);
+    return *this;
+}
+
+template<class charT>
+Fastcgipp::Json<charT>& Fastcgipp::Json<charT>::value(double x)
+{
+    if(!std::isfinite(x))
+        return null();
+    char buffer[32];
+    size_t size = fixed(buffer, x);
+    if(size == 0)
+        size = shortest(buffer, x, 15, 17);
+    separate();
+    write(buffer, size);
+    return *this;
+}
+
+template<class charT>
+Fastcgipp::Json<charT>& Fastcgipp::Json<charT>::value(float x)
+{
+    if(!std::isfinite(x))
+        return null();
+    char buffer[32];
+    size_t size = fixed(buffer, x);
+    if(size == 0)
+        size = shortest(buffer, x, 6, 9);
+    separate();
+    write(buffer, size);
+    return *this;
+}
+
+template class Fastcgipp::Json<char>;
+template class Fastcgipp::Json<wchar_t>;
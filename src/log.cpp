@@ -27,6 +27,7 @@
 *******************************************************************************/
 
 #include "fastcgi++/log.hpp"
+#include "fastcgi++/endian.hpp"
 
 #include <iomanip>
 #include <iostream>
@@ -35,6 +36,11 @@
 #include <cstring>
 #include <array>
 #include <sstream>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <algorithm>
 
 #include <unistd.h>
 #include <limits.h>
@@ -95,6 +101,226 @@ namespace Fastcgipp
             L"[debug]: ",
             L"[diagnostic]: "
         }};
+
+        //! Cached "%b %d %H:%M:%S " timestamp. Lock mutex first.
+        const std::wstring& timestamp(const std::time_t now)
+        {
+            static std::time_t cached = -1;
+            static std::wstring text;
+            if(now != cached)
+            {
+                std::tm local;
+                localtime_r(&now, &local);
+                wchar_t buffer[64];
+                text.assign(
+                        buffer,
+                        std::wcsftime(buffer, 64, L"%b %d %H:%M:%S ", &local));
+                cached = now;
+            }
+            return text;
+        }
+
+        //! Stream buffer that appends to a string we can swap out
+        class StringBuf: public std::wstreambuf
+        {
+        public:
+            std::wstring m_string;
+
+        protected:
+            int_type overflow(int_type c)
+            {
+                if(!traits_type::eq_int_type(c, traits_type::eof()))
+                    m_string.push_back(traits_type::to_char_type(c));
+                return traits_type::not_eof(c);
+            }
+
+            std::streamsize xsputn(const wchar_t* s, std::streamsize n)
+            {
+                m_string.append(s, n);
+                return n;
+            }
+        };
+
+        //! A single asynchronous log message
+        struct Record
+        {
+            Level level;
+            std::chrono::system_clock::time_point time;
+            std::wstring message;
+        };
+
+        //! Single producer single consumer ring of messages
+        struct Ring
+        {
+            const std::unique_ptr<Record[]> records;
+            const unsigned capacity;
+
+            //! Next record for the background thread to write
+            std::atomic_ullong head;
+
+            //! Next record for the logging thread to fill
+            std::atomic_ullong tail;
+
+            Ring(unsigned size):
+                records(new Record[size]),
+                capacity(size),
+                head(0),
+                tail(0)
+            {}
+        };
+
+        //! Everything a logging thread keeps to itself
+        struct Local
+        {
+            StringBuf buffer;
+            std::wostream stream;
+            std::shared_ptr<Ring> ring;
+
+            Local():
+                stream(&buffer)
+            {}
+        };
+
+        Local& local()
+        {
+            thread_local Local local;
+            return local;
+        }
+
+        //! Rings of every thread that has logged asynchronously
+        std::vector<std::shared_ptr<Ring>> rings;
+        std::mutex ringsMutex;
+
+        std::atomic_ullong droppedCount(0);
+        unsigned ringCapacity = 1024;
+        Format format = TEXT;
+        std::thread writer;
+        std::atomic_bool writing(false);
+
+        //! Write a single record. Lock mutex first.
+        void write(const Record& record)
+        {
+            const auto time = record.time.time_since_epoch();
+            if(format == BINARY && binarystream != nullptr)
+            {
+                static std::wstring_convert<std::codecvt_utf8<wchar_t>, wchar_t>
+                    converter;
+                std::string message;
+                try
+                {
+                    message = converter.to_bytes(record.message);
+                }
+                catch(const std::range_error& e)
+                {
+                    message = "Error in log message code conversion to utf8";
+                }
+
+                const BigEndian<int64_t> microseconds(
+                        std::chrono::duration_cast<std::chrono::microseconds>(
+                            time).count());
+                const char level = static_cast<char>(record.level);
+                const BigEndian<int32_t> size(message.size());
+
+                binarystream->write(microseconds.data(), microseconds.size());
+                binarystream->write(&level, 1);
+                binarystream->write(size.data(), size.size());
+                binarystream->write(message.data(), message.size());
+            }
+            else
+            {
+                const std::time_t now = std::chrono::duration_cast<
+                    std::chrono::seconds>(time).count();
+                *logstream
+                    << timestamp(now) << hostname << ' ' << program << ' '
+                    << levels[record.level] << record.message << L'\n';
+            }
+        }
+
+        //! Write out everything waiting in the rings
+        /*!
+         * @return True if anything was written.
+         */
+        bool drain(std::vector<std::shared_ptr<Ring>>& snapshot)
+        {
+            {
+                std::lock_guard<std::mutex> lock(ringsMutex);
+                snapshot = rings;
+            }
+
+            bool wrote = false;
+            std::lock_guard<std::mutex> lock(mutex);
+            for(const auto& ring: snapshot)
+            {
+                const unsigned long long tail = ring->tail.load(
+                        std::memory_order_acquire);
+                unsigned long long head = ring->head.load(
+                        std::memory_order_relaxed);
+                while(head != tail)
+                {
+                    Record& record = ring->records[head % ring->capacity];
+                    write(record);
+                    record.message.clear();
+                    ring->head.store(++head, std::memory_order_release);
+                    wrote = true;
+                }
+            }
+
+            static unsigned long long reported = 0;
+            const unsigned long long dropped = droppedCount.load(
+                    std::memory_order_relaxed);
+            if(dropped != reported)
+            {
+                std::wostringstream message;
+                message << dropped-reported << L" log messages dropped";
+                write({
+                        WARNING,
+                        std::chrono::system_clock::now(),
+                        message.str()});
+                reported = dropped;
+                wrote = true;
+            }
+
+            if(wrote)
+            {
+                logstream->flush();
+                if(format == BINARY && binarystream != nullptr)
+                    binarystream->flush();
+            }
+            return wrote;
+        }
+
+        //! Body of the background writing thread
+        void writerHandler()
+        {
+            std::vector<std::shared_ptr<Ring>> snapshot;
+            unsigned idle = 0;
+            while(writing)
+            {
+                if(drain(snapshot))
+                    idle = 0;
+                else
+                {
+                    // Back off to a handful of wakeups per second when quiet
+                    idle = std::min(idle+1, 50u);
+                    std::this_thread::sleep_for(std::chrono::milliseconds(idle));
+                }
+
+                // Forget the rings of threads that have finished
+                std::lock_guard<std::mutex> lock(ringsMutex);
+                rings.erase(
+                        std::remove_if(
+                            rings.begin(),
+                            rings.end(),
+                            [] (const std::shared_ptr<Ring>& ring)
+                            {
+                                return ring.use_count() == 1
+                                    && ring->head == ring->tail;
+                            }),
+                        rings.end());
+            }
+            drain(snapshot);
+        }
+
     }
 }
 
@@ -103,11 +329,99 @@ std::mutex Fastcgipp::Logging::mutex;
 bool Fastcgipp::Logging::suppress(false);
 std::wstring Fastcgipp::Logging::hostname(Fastcgipp::Logging::getHostname());
 std::wstring Fastcgipp::Logging::program(Fastcgipp::Logging::getProgram());
+std::ostream* Fastcgipp::Logging::binarystream(nullptr);
+std::atomic_bool Fastcgipp::Logging::async(false);
 
 void Fastcgipp::Logging::header(Level level)
 {
-    const std::time_t now = std::time(nullptr);
     *logstream
-        << std::put_time(std::localtime(&now), L"%b %d %H:%M:%S ")
+        << timestamp(std::time(nullptr))
         << hostname << ' ' << program << ' ' << levels[level];
 }
+
+void Fastcgipp::Logging::start(Format format_, unsigned capacity)
+{
+    if(async || writer.joinable())
+        return;
+    format = format_;
+    ringCapacity = std::max(capacity, 1u);
+    writing = true;
+    std::thread thread(writerHandler);
+    writer.swap(thread);
+    async = true;
+}
+
+void Fastcgipp::Logging::stop()
+{
+    if(!writer.joinable())
+        return;
+    async = false;
+    writing = false;
+    writer.join();
+    std::vector<std::shared_ptr<Ring>> snapshot;
+    drain(snapshot);
+}
+
+void Fastcgipp::Logging::flush()
+{
+    if(!async || std::this_thread::get_id() == writer.get_id())
+        return;
+
+    std::vector<std::pair<std::shared_ptr<Ring>, unsigned long long>> marks;
+    {
+        std::lock_guard<std::mutex> lock(ringsMutex);
+        for(const auto& ring: rings)
+            marks.emplace_back(ring, ring->tail.load());
+    }
+    for(const auto& mark: marks)
+        while(async && mark.first->head < mark.second)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
+unsigned long long Fastcgipp::Logging::dropped()
+{
+    return droppedCount;
+}
+
+std::wostream& Fastcgipp::Logging::buffer()
+{
+    return local().stream;
+}
+
+void Fastcgipp::Logging::push(Level level)
+{
+    Local& local(Logging::local());
+    if(!local.ring)
+    {
+        local.ring = std::make_shared<Ring>(ringCapacity);
+        std::lock_guard<std::mutex> lock(ringsMutex);
+        rings.push_back(local.ring);
+    }
+
+    Ring& ring(*local.ring);
+    const unsigned long long tail = ring.tail.load(std::memory_order_relaxed);
+    if(tail-ring.head.load(std::memory_order_acquire) >= ring.capacity)
+    {
+        droppedCount.fetch_add(1, std::memory_order_relaxed);
+        local.buffer.m_string.clear();
+        return;
+    }
+
+    Record& record = ring.records[tail % ring.capacity];
+    record.level = level;
+    record.time = std::chrono::system_clock::now();
+    record.message.swap(local.buffer.m_string);
+    ring.tail.store(tail+1, std::memory_order_release);
+}
+
+namespace
+{
+    // Defined last so that it's destroyed before everything it depends on
+    struct Stopper
+    {
+        ~Stopper()
+        {
+            Fastcgipp::Logging::stop();
+        }
+    } stopper;
+}
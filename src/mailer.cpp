@@ -25,299 +25,348 @@
 * along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
 *******************************************************************************/
 
+
 #include "fastcgi++/mailer.hpp"
 #include "fastcgi++/log.hpp"
 
-#include <chrono>
+#include <algorithm>
+#include <climits>
 
 void Fastcgipp::Mail::Mailer::handler()
 {
+    std::vector<Connection*> opening;
+    opening.reserve(m_connections.size());
+
+    if(!m_cpus.empty())
+        m_cpus.pin();
+
     std::unique_lock<std::mutex> lock(m_mutex);
-    while(!m_terminate && !(m_stop && m_queue.empty() && !inEmail()))
+    while(!m_terminate && !(m_stop && m_queue.empty() && m_inFlight == 0))
     {
-        if(m_state == ERROR)
-        {
-            using namespace std::chrono_literals;
-            m_wake.wait_for(lock, m_retry*1s);
-            m_state = DISCONNECTED;
+        const auto now = std::chrono::steady_clock::now();
+        auto retry = std::chrono::steady_clock::time_point::max();
 
-            if(m_terminate || (m_stop && m_queue.empty() && !inEmail()))
-                break;
+        size_t connected = 0;
+        for(const auto& connection: m_connections)
+            if(connection.socket.valid())
+                ++connected;
+
+        // Only open as many new connections as there are emails for
+        size_t wanted = m_queue.size()>connected ? m_queue.size()-connected:0;
+        for(auto& connection: m_connections)
+        {
+            if(connection.socket.valid())
+            {
+                if(connection.ready && connection.replies.empty())
+                {
+                    if(!m_queue.empty())
+                        begin(connection);
+                    else
+                    {
+                        connection.command("QUIT\r\n");
+                        connection.replies.push_back(QUIT);
+                        connection.ready = false;
+                    }
+                }
+            }
+            else if(wanted)
+            {
+                if(connection.retry <= now)
+                {
+                    opening.push_back(&connection);
+                    --wanted;
+                }
+                else
+                    retry = std::min(retry, connection.retry);
+            }
         }
 
-        if(!inEmail() && !m_queue.empty())
+        if(connected == 0 && opening.empty())
         {
-            m_email = std::move(m_queue.front());
-            m_queue.pop();
+            if(retry != std::chrono::steady_clock::time_point::max())
+                m_wake.wait_until(lock, retry);
+            else
+                m_wake.wait(lock);
+            continue;
         }
 
         lock.unlock();
 
-        if(inEmail() && !m_socket.valid())
+        for(Connection* connection: opening)
+            open(*connection);
+        opening.clear();
+
+        connected = 0;
+        for(auto& connection: m_connections)
         {
-            m_line.clear();
-            m_socket = m_socketGroup.connect(m_host.c_str(), m_port.c_str());
-            if(!m_socket.valid())
-            {
-                ERROR_LOG("Error connecting to SMTP server.")
-                m_state = ERROR;
-                m_socket.close();
-                lock.lock();
-                continue;
-            }
-            else
-                m_state = CONNECTED;
+            if(connection.socket.valid() && !connection.output.empty())
+                flush(connection);
+            if(connection.socket.valid())
+                ++connected;
         }
 
-        if(m_socketGroup.poll(true) == m_socket)
+        if(connected)
         {
-            char buffer;
-            while(m_socket.read(&buffer, 1) == 1)
-            {
-                if(buffer == '\n')
-                    break;
-                m_line.push_back(buffer);
-            }
+            const Socket socket = m_socketGroup.poll(true);
+            const auto connection = std::find_if(
+                    m_connections.begin(),
+                    m_connections.end(),
+                    [&socket] (const Connection& x)
+                    {
+                        return socket.valid() && x.socket == socket;
+                    });
 
-            if(buffer == '\n')
+            if(connection != m_connections.end())
             {
-                if(m_line.back() == '\r')
-                    m_line.pop_back();
-
-                switch(m_state)
+                // Outgoing sockets block so read only what poll() saw
+                char buffer[4096];
+                const ssize_t count = connection->socket.read(
+                        buffer,
+                        sizeof(buffer));
+                bool failed = false;
+                for(const char* c = buffer; c < buffer+count; ++c)
                 {
-                    case CONNECTED:
+                    if(*c != '\n')
                     {
-                        if(m_line.size() >= 4 && m_line.substr(0,4) == "220 ")
-                        {
-                            m_line = "EHLO ";
-                            m_line += m_origin + '\n';
-                            if(m_socket.write(m_line.data(), m_line.size())
-                                    != static_cast<ssize_t>(m_line.size()))
-                            {
-                                ERROR_LOG("Error sending EHLO command to SMTP "\
-                                        "server.")
-                            }
-                            else
-                            {
-                                m_state = EHLO;
-                                break;
-                            }
-                        }
-                        else
-                        {
-                            ERROR_LOG("Bad reply from SMTP server after "\
-                                    "connecting: " << m_line.c_str())
-                        }
-                        m_socket.close();
-                        m_state = ERROR;
-                        break;
+                        connection->line.push_back(*c);
+                        continue;
                     }
 
-                    case EHLO:
+                    if(!connection->line.empty()
+                            && connection->line.back() == '\r')
+                        connection->line.pop_back();
+                    if(!reply(*connection))
                     {
-                        if(m_line == "250-8BITMIME")
-                        {
-                            m_state = EIGHTBIT;
-                            break;
-                        }
-                        else if(m_line.size()>=4 && m_line.substr(0,3)=="250")
-                        {
-                            if(m_line[3] == ' ')
-                            {
-                                ERROR_LOG("SMTP server does not support 8BITMIME.")
-                            }
-                            else if(m_line[3] == '-')
-                                break;
-                            else
-                                ERROR_LOG("Bad reply from SMTP server after "\
-                                        "EHLO: " << m_line.c_str())
-                        }
-                        else
-                        {
-                            ERROR_LOG("Bad reply from SMTP server after EHLO: "\
-                                    << m_line.c_str())
-                        }
-                        m_socket.close();
-                        m_state = ERROR;
+                        fail(*connection);
+                        failed = true;
                         break;
                     }
+                    connection->line.clear();
+                }
 
-                    case EIGHTBIT:
-                    {
-                        if(m_line.size()>=4 && m_line.substr(0,3)=="250")
-                        {
-                            if(m_line[3] == ' ')
-                            {
-                                m_line = "MAIL FROM: <";
-                                m_line += m_email.from + ">\n";
-                                if(m_socket.write(m_line.data(), m_line.size())
-                                        != static_cast<ssize_t>(m_line.size()))
-                                {
-                                    ERROR_LOG("Error sending MAIL command to "\
-                                            "SMTP server.")
-                                }
-                                else
-                                {
-                                    m_state = MAIL;
-                                    break;
-                                }
-                            }
-                            else if(m_line[3] == '-')
-                                break;
-                        }
-                        else
-                        {
-                            ERROR_LOG("Bad reply from SMTP server after EHLO: "\
-                                    << m_line.c_str())
-                        }
-                        m_socket.close();
-                        m_state = ERROR;
-                        break;
-                    }
+                if(!failed && !connection->socket.valid()
+                        && !connection->replies.empty())
+                {
+                    ERROR_LOG("SMTP server closed the connection.")
+                    fail(*connection);
+                }
+            }
+        }
 
-                    case MAIL:
-                    {
-                        if(m_line.size() >= 4 && m_line.substr(0,4) == "250 ")
-                        {
-                            m_line = "RCPT TO: <";
-                            m_line += m_email.to + ">\n";
-                            if(m_socket.write(m_line.data(), m_line.size())
-                                    != static_cast<ssize_t>(m_line.size()))
-                            {
-                                ERROR_LOG("Error sending RCPT command to SMTP "\
-                                        "server.")
-                            }
-                            else
-                            {
-                                m_state = RCPT;
-                                break;
-                            }
-                        }
-                        else
-                        {
-                            ERROR_LOG("Bad reply from SMTP server after MAIL: "\
-                                    << m_line.c_str())
-                        }
-                        m_socket.close();
-                        m_state = ERROR;
-                        break;
-                    }
+        lock.lock();
+    }
+    lock.unlock();
 
-                    case RCPT:
-                    {
-                        if(m_line.size() >= 4 && m_line.substr(0,4) == "250 ")
-                        {
-                            if(m_socket.write("DATA\n", 5) != 5)
-                            {
-                                ERROR_LOG("Error sending DATA command to SMTP "\
-                                        "server.")
-                            }
-                            else
-                            {
-                                m_state = DATA;
-                                break;
-                            }
-                        }
-                        else
-                        {
-                            ERROR_LOG("Bad reply from SMTP server after RCPT: "\
-                                    << m_line.c_str())
-                        }
-                        m_socket.close();
-                        m_state = ERROR;
-                        break;
-                    }
+    for(auto& connection: m_connections)
+    {
+        if(connection.socket.valid() || !connection.emails.empty())
+            fail(connection);
+        connection.retry = std::chrono::steady_clock::time_point();
+    }
+}
 
-                    case DATA:
-                    {
-                        if(m_line.size() >= 4 && m_line.substr(0,4) == "354 ")
-                        {
-                            bool success=true;
-                            for(const auto& chunk: m_email.body)
-                                if(m_socket.write(
-                                            chunk.data.get(),
-                                            chunk.size) != static_cast<ssize_t>(
-                                                chunk.size))
-                                {
-                                    ERROR_LOG("Error sending data chunk "\
-                                            "to SMTP server.")
-                                    success=false;
-                                    break;
-                                }
-                            if(success)
-                            {
-                                if(m_socket.write("\r\n.\r\n", 5) != 5)
-                                {
-                                    ERROR_LOG("Error sending CRLF.CRLF to "\
-                                            "SMTP server.")
-                                }
-                                else
-                                {
-                                    m_state = DUMP;
-                                    break;
-                                }
-                            }
-                        }
-                        else
-                        {
-                            ERROR_LOG("Bad reply from SMTP server after RCPT: "\
-                                    << m_line.c_str())
-                        }
-                        m_socket.close();
-                        m_state = ERROR;
-                        break;
-                    }
+void Fastcgipp::Mail::Mailer::open(Connection& connection)
+{
+    connection.replies.clear();
+    connection.line.clear();
+    connection.clear();
+    connection.ready = false;
+    connection.eightBit = false;
+    connection.pipelining = false;
 
-                    case DUMP:
-                    {
-                        if(m_line.size() >= 4 && m_line.substr(0,4) == "250 ")
-                        {
-                            purgeEmail();
-                            if(m_socket.write("QUIT\n", 5) != 5)
-                            {
-                                ERROR_LOG("Error sending QUIT command to SMTP "\
-                                        "server.")
-                            }
-                            else
-                            {
-                                m_state = QUIT;
-                                break;
-                            }
-                        }
-                        else
-                        {
-                            ERROR_LOG("Bad reply from SMTP server after data "\
-                                    "insertion: " << m_line.c_str())
-                        }
-                        m_socket.close();
-                        m_state = ERROR;
-                        break;
-                    }
+    connection.socket = m_socketGroup.connect(m_host.c_str(), m_port.c_str());
+    if(!connection.socket.valid())
+    {
+        ERROR_LOG("Error connecting to SMTP server.")
+        connection.socket.close();
+        connection.retry = std::chrono::steady_clock::now()
+            + std::chrono::seconds(m_retry);
+        return;
+    }
+    connection.replies.push_back(GREETING);
+}
 
-                    case QUIT:
-                    {
-                        if(!(m_line.size() >= 4 && m_line.substr(0,4) == "221 "))
-                        {
-                            ERROR_LOG("Bad reply from SMTP server after QUIT: "\
-                                    << m_line.c_str())
-                            m_state = ERROR;
-                        }
-                        else
-                            m_state = DISCONNECTED;
-                        m_socket.close();
-                        break;
-                    }
+void Fastcgipp::Mail::Mailer::begin(Connection& connection)
+{
+    connection.emails.push_back(std::move(m_queue.front()));
+    m_queue.pop_front();
+    ++m_inFlight;
 
-                    case ERROR:
-                    case DISCONNECTED:
-                        ;// DO NOTHING
-                }
-                m_line.clear();
+    const Email_base::Data& email(connection.emails.back());
+    connection.command("MAIL FROM:<" + email.from + ">\r\n");
+    connection.replies.push_back(MAIL);
+    if(connection.pipelining)
+    {
+        connection.command("RCPT TO:<" + email.to + ">\r\nDATA\r\n");
+        connection.replies.push_back(RCPT);
+        connection.replies.push_back(DATA);
+    }
+}
+
+void Fastcgipp::Mail::Mailer::flush(Connection& connection)
+{
+    std::vector<iovec>& output(connection.output);
+    while(connection.written < output.size()
+            && !connection.socket.blocked())
+    {
+        const ssize_t count = connection.socket.write(
+                output.data()+connection.written,
+                std::min(output.size()-connection.written, size_t(IOV_MAX)));
+        if(count < 0)
+        {
+            ERROR_LOG("Error sending data to SMTP server.")
+            fail(connection);
+            return;
+        }
+
+        size_t remaining = count;
+        while(remaining)
+        {
+            iovec& buffer(output[connection.written]);
+            if(remaining < buffer.iov_len)
+            {
+                buffer.iov_base = static_cast<char*>(buffer.iov_base)
+                    + remaining;
+                buffer.iov_len -= remaining;
+                break;
             }
+            remaining -= buffer.iov_len;
+            ++connection.written;
         }
+    }
 
-        lock.lock();
+    if(connection.written == output.size())
+        connection.clear();
+}
+
+bool Fastcgipp::Mail::Mailer::reply(Connection& connection)
+{
+    static const char* const codes[] = {
+        "220", "250", "250", "250", "354", "250", "221"};
+    static const char* const after[] = {
+        "connecting", "EHLO", "MAIL", "RCPT", "DATA", "data insertion",
+        "QUIT"};
+
+    const std::string& line(connection.line);
+    if(connection.replies.empty())
+    {
+        ERROR_LOG("Unexpected reply from SMTP server: " << line.c_str())
+        return false;
+    }
+    const Reply expected = connection.replies.front();
+
+    if(line.size() < 4
+            || (line[3] != ' ' && line[3] != '-')
+            || line.compare(0, 3, codes[expected]) != 0)
+    {
+        ERROR_LOG("Bad reply from SMTP server after " << after[expected] \
+                << ": " << line.c_str())
+        return false;
+    }
+
+    if(expected == EHLO)
+    {
+        if(line.compare(4, std::string::npos, "8BITMIME") == 0)
+            connection.eightBit = true;
+        else if(line.compare(4, std::string::npos, "PIPELINING") == 0)
+            connection.pipelining = true;
+    }
+
+    // Wait for the last line of a multiline reply
+    if(line[3] == '-')
+        return true;
+    connection.replies.pop_front();
+
+    switch(expected)
+    {
+        case GREETING:
+        {
+            connection.command("EHLO " + m_origin + "\r\n");
+            connection.replies.push_back(EHLO);
+            break;
+        }
+
+        case EHLO:
+        {
+            if(!connection.eightBit)
+            {
+                ERROR_LOG("SMTP server does not support 8BITMIME.")
+                return false;
+            }
+            connection.ready = true;
+            break;
+        }
+
+        case MAIL:
+        {
+            if(!connection.pipelining)
+            {
+                connection.command(
+                        "RCPT TO:<" + connection.emails.back().to + ">\r\n");
+                connection.replies.push_back(RCPT);
+            }
+            break;
+        }
+
+        case RCPT:
+        {
+            if(!connection.pipelining)
+            {
+                connection.command("DATA\r\n");
+                connection.replies.push_back(DATA);
+            }
+            break;
+        }
+
+        case DATA:
+        {
+            connection.body(connection.emails.front().body);
+            connection.command("\r\n.\r\n");
+            connection.replies.push_back(DUMP);
+
+            // The next email's commands can ride along with the end of data
+            if(connection.pipelining)
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if(!m_queue.empty())
+                    begin(connection);
+            }
+            break;
+        }
+
+        case DUMP:
+        {
+            connection.emails.pop_front();
+            --m_inFlight;
+            break;
+        }
+
+        case QUIT:
+        {
+            connection.socket.close();
+            break;
+        }
+    }
+
+    return true;
+}
+
+void Fastcgipp::Mail::Mailer::fail(Connection& connection)
+{
+    connection.socket.close();
+    connection.replies.clear();
+    connection.line.clear();
+    connection.clear();
+    connection.ready = false;
+    connection.retry = std::chrono::steady_clock::now()
+        + std::chrono::seconds(m_retry);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_inFlight -= connection.emails.size();
+    while(!connection.emails.empty())
+    {
+        m_queue.push_front(std::move(connection.emails.back()));
+        connection.emails.pop_back();
     }
 }
 
@@ -362,7 +411,8 @@ void Fastcgipp::Mail::Mailer::init(
         const char* host,
         const char* origin,
         const unsigned short port,
-        unsigned retryInterval)
+        unsigned retryInterval,
+        unsigned connections)
 {
     if(!m_initialized)
     {
@@ -370,6 +420,7 @@ void Fastcgipp::Mail::Mailer::init(
         m_origin = origin;
         m_port = std::to_string(port);
         m_retry = retryInterval;
+        m_connections.resize(std::max(connections, 1u));
         m_initialized = true;
     }
 }
@@ -377,6 +428,7 @@ void Fastcgipp::Mail::Mailer::init(
 void Fastcgipp::Mail::Mailer::queue(Email_base& email)
 {
     std::lock_guard<std::mutex> lock(m_mutex);
-    m_queue.push(email.data());
+    m_queue.push_back(email.data());
     m_socketGroup.wake();
+    m_wake.notify_all();
 }
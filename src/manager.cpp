@@ -31,71 +31,236 @@
 
 Fastcgipp::Manager_base* Fastcgipp::Manager_base::instance=nullptr;
 
+namespace
+{
+    //! The manager the calling thread handles requests for if any
+    thread_local Fastcgipp::Manager_base* handlerManager = nullptr;
+
+    //! How deep in blocking sections the calling handler thread is
+    thread_local unsigned blockingDepth = 0;
+}
+
 Fastcgipp::Manager_base::Manager_base(unsigned threads):
     m_transceiver(std::bind(
                 &Fastcgipp::Manager_base::push,
                 this,
                 std::placeholders::_1,
                 std::placeholders::_2)),
+    m_requestTimeout(0),
+    m_nextQueue(0),
+    m_pendingTasks(0),
+    m_sleepers(0),
+    m_epoch(0),
+    m_affinity(false),
+    m_minThreads(1),
+    m_maxThreads(std::max(threads, 1u)),
+    m_targetThreads(0),
+    m_liveThreads(0),
+    m_blockedThreads(0),
+    m_scaleLatency(0),
+    m_idleTimeout(0),
+    m_lastGrowth(0),
+    m_watching(false),
     m_terminate(true),
     m_stop(true),
-    m_threads(threads)
-#if FASTCGIPP_LOG_LEVEL > 3
-    ,m_requestCount(0),
-    m_maxRequests(0),
-    m_managementRecordCount(0),
-    m_badSocketMessageCount(0),
-    m_badSocketKillCount(0),
-    m_messageCount(0),
-    m_activeThreads(threads),
-    m_maxActiveThreads(0)
-#endif
+    m_maxConnections(0),
+    m_requestLimit(0),
+    m_multiplex(true),
+    m_taskLimit(0),
+    m_overloadResponse(false)
 {
     if(instance != nullptr)
         FAIL_LOG("You're not allowed to have multiple manager instances")
     instance = this;
+    resizeTasks();
     DIAG_LOG("Manager_base::Manager_base(): Initialized")
 }
 
 void Fastcgipp::Manager_base::terminate()
 {
-    std::lock_guard<std::mutex> lock(m_tasksMutex);
+    std::lock_guard<std::mutex> lock(m_startStopMutex);
     m_terminate=true;
     m_transceiver.terminate();
-    m_wake.notify_all();
+    wakeAll();
 }
 
 void Fastcgipp::Manager_base::stop()
 {
-    std::lock_guard<std::mutex> lock(m_tasksMutex);
+    std::lock_guard<std::mutex> lock(m_startStopMutex);
     m_stop=true;
     m_transceiver.stop();
-    m_wake.notify_all();
+    wakeAll();
 }
 
 void Fastcgipp::Manager_base::start()
 {
-    std::lock_guard<std::mutex> lock(m_tasksMutex);
+    std::lock_guard<std::mutex> lock(m_startStopMutex);
     DIAG_LOG("Starting fastcgi++ manager")
     m_stop=false;
     m_terminate=false;
     m_transceiver.start();
-    for(auto& thread: m_threads)
-        if(!thread.joinable())
-        {
-            std::thread newThread(&Fastcgipp::Manager_base::handler, this);
-            thread.swap(newThread);
-        }
+    m_watching = false;
+    m_targetThreads = m_scaleLatency.count() && !m_affinity
+        ? m_minThreads
+        : m_maxThreads;
+    fill();
 }
 
 void Fastcgipp::Manager_base::join()
 {
-    for(auto& thread: m_threads)
-        if(thread.joinable())
-            thread.join();
+    // Threads come and go while running so we take them one at a time
+    while(true)
+    {
+        std::thread thread;
+        {
+            std::lock_guard<std::mutex> lock(m_startStopMutex);
+            const auto found = std::find_if(
+                    m_threads.begin(),
+                    m_threads.end(),
+                    [] (const std::thread& x)
+                    {
+                        return x.joinable();
+                    });
+            if(found == m_threads.end())
+                break;
+            thread.swap(*found);
+        }
+        thread.join();
+    }
     m_transceiver.join();
 }
 
+void Fastcgipp::Manager_base::fill()
+{
+    if(m_stop)
+        return;
+    while(m_liveThreads-m_blockedThreads < m_targetThreads && spawn());
+}
+
+bool Fastcgipp::Manager_base::spawn()
+{
+    const auto slot = std::find(m_running.begin(), m_running.end(), false);
+    if(slot == m_running.end())
+        return false;
+    const unsigned index = slot-m_running.begin();
+
+    // Anything left in the slot has already quit
+    if(m_threads[index].joinable())
+        m_threads[index].join();
+
+    *slot = true;
+    ++m_liveThreads;
+    ++Metrics::handlerThreads;
+    std::thread thread(&Fastcgipp::Manager_base::handler, this, index);
+    m_threads[index].swap(thread);
+    return true;
+}
+
+bool Fastcgipp::Manager_base::retire()
+{
+    if(m_affinity)
+        return false;
+    unsigned live = m_liveThreads;
+    while(live-m_blockedThreads > m_targetThreads)
+        if(m_liveThreads.compare_exchange_weak(live, live-1))
+            return true;
+    return false;
+}
+
+void Fastcgipp::Manager_base::grow(Metrics::Clock::time_point queued)
+{
+    if(m_sleepers || m_targetThreads >= m_maxThreads)
+        return;
+
+    const auto now = Metrics::Clock::now();
+    if(now-queued < m_scaleLatency)
+        return;
+
+    auto last = m_lastGrowth.load();
+    if(now.time_since_epoch().count()-last
+            < Metrics::Clock::duration(m_scaleLatency).count()
+            || !m_lastGrowth.compare_exchange_strong(
+                last,
+                now.time_since_epoch().count()))
+        return;
+
+    unsigned target = m_targetThreads;
+    do
+        if(target >= m_maxThreads)
+            return;
+    while(!m_targetThreads.compare_exchange_weak(target, target+1));
+
+    std::lock_guard<std::mutex> lock(m_startStopMutex);
+    fill();
+}
+
+void Fastcgipp::Manager_base::watch()
+{
+    bool watching = false;
+    if(m_watching.compare_exchange_strong(watching, true))
+        m_transceiver.timers().add(m_scaleLatency, [this] () { oversee(); });
+}
+
+void Fastcgipp::Manager_base::oversee()
+{
+    m_watching = false;
+    if(m_stop || !m_pendingTasks || m_sleepers)
+        return;
+
+    auto oldest = Metrics::Clock::time_point::max();
+    for(auto& queue: m_tasks)
+    {
+        std::lock_guard<std::mutex> lock(queue->mutex);
+        if(!queue->tasks.empty())
+            oldest = std::min(oldest, queue->tasks.front().queued);
+    }
+    if(oldest == Metrics::Clock::time_point::max())
+        return;
+
+    grow(oldest);
+    if(m_targetThreads < m_maxThreads)
+        watch();
+}
+
+void Fastcgipp::Manager_base::shrink()
+{
+    unsigned target = m_targetThreads;
+    do
+        if(target <= m_minThreads)
+            return;
+    while(!m_targetThreads.compare_exchange_weak(target, target-1));
+}
+
+void Fastcgipp::Manager_base::block()
+{
+    ++m_blockedThreads;
+    ++Metrics::blockedThreads;
+    std::lock_guard<std::mutex> lock(m_startStopMutex);
+    fill();
+}
+
+void Fastcgipp::Manager_base::unblock()
+{
+    --m_blockedThreads;
+    --Metrics::blockedThreads;
+}
+
+Fastcgipp::Manager_base::Blocking::Blocking():
+    m_manager(handlerManager && !handlerManager->m_affinity
+            && blockingDepth++ == 0 ? handlerManager : nullptr)
+{
+    if(m_manager)
+        m_manager->block();
+}
+
+Fastcgipp::Manager_base::Blocking::~Blocking()
+{
+    if(m_manager)
+        m_manager->unblock();
+    if(handlerManager && !handlerManager->m_affinity)
+        --blockingDepth;
+}
+
 #include <signal.h>
 void Fastcgipp::Manager_base::setupSignals()
 {
@@ -159,66 +324,66 @@ void Fastcgipp::Manager_base::localHandler()
         {
             case Protocol::RecordType::GET_VALUES:
             {
+                const unsigned maxRequests = m_requestLimit
+                    ? m_requestLimit
+                    : m_maxThreads;
+                const std::string maxConnections = std::to_string(
+                        m_maxConnections ? m_maxConnections : maxRequests);
+                const std::string maxRequestsValue
+                    = std::to_string(maxRequests);
+                const std::string multiplex(m_multiplex ? "1" : "0");
+
+                std::vector<char> content;
+                const auto reply = [&content] (
+                        const std::string& name,
+                        const std::string& value)
+                {
+                    content.push_back(name.size());
+                    content.push_back(value.size());
+                    content.insert(content.end(), name.begin(), name.end());
+                    content.insert(content.end(), value.begin(), value.end());
+                };
+
                 const char* name;
                 const char* value;
-                const char* end;
+                const char* end = message.data.begin()+sizeof(header);
+                const char* const contentEnd = end+header.contentLength;
 
                 while(Protocol::processParamHeader(
-                        message.data.begin()+sizeof(header),
-                        message.data.end(),
+                        end,
+                        contentEnd,
                         name,
                         value,
                         end))
                 {
-                    switch(value-name)
-                    {
-                        case 14:
-                        {
-                            if(std::equal(name, value, "FCGI_MAX_CONNS"))
-                            {
-                                Block record(
-                                        reinterpret_cast<const char*>(
-                                            &Protocol::maxConnsReply),
-                                        sizeof(Protocol::maxConnsReply));
-                                m_transceiver.send(
-                                        socket,
-                                        std::move(record),
-                                        false);
-                            }
-                            break;
-                        }
-                        case 13:
-                        {
-                            if(std::equal(name, value, "FCGI_MAX_REQS"))
-                            {
-                                Block record(
-                                        reinterpret_cast<const char*>(
-                                            &Protocol::maxReqsReply),
-                                        sizeof(Protocol::maxReqsReply));
-                                m_transceiver.send(
-                                        socket,
-                                        std::move(record),
-                                        false);
-                            }
-                            break;
-                        }
-                        case 15:
-                        {
-                            if(std::equal(name, value, "FCGI_MPXS_CONNS"))
-                            {
-                                Block record(
-                                        reinterpret_cast<const char*>(
-                                            &Protocol::mpxsConnsReply),
-                                        sizeof(Protocol::mpxsConnsReply));
-                                m_transceiver.send(
-                                        socket,
-                                        std::move(record),
-                                        false);
-                            }
-                            break;
-                        }
-                    }
+                    const std::string requested(name, value);
+                    if(requested == "FCGI_MAX_CONNS")
+                        reply(requested, maxConnections);
+                    else if(requested == "FCGI_MAX_REQS")
+                        reply(requested, maxRequestsValue);
+                    else if(requested == "FCGI_MPXS_CONNS")
+                        reply(requested, multiplex);
                 }
+
+                Block record(Protocol::getRecordSize(content.size()));
+                Protocol::Header& sendHeader
+                    = *reinterpret_cast<Protocol::Header*>(record.begin());
+                sendHeader.version = Protocol::version;
+                sendHeader.type = Protocol::RecordType::GET_VALUES_RESULT;
+                sendHeader.fcgiId = 0;
+                sendHeader.contentLength = content.size();
+                sendHeader.paddingLength =
+                    record.size()-content.size()-sizeof(Protocol::Header);
+                sendHeader.reserved = 0;
+                std::fill(
+                        std::copy(
+                            content.cbegin(),
+                            content.cend(),
+                            record.begin()+sizeof(Protocol::Header)),
+                        record.end(),
+                        0);
+
+                m_transceiver.send(socket, std::move(record), false);
                 break;
             }
 
@@ -251,177 +416,551 @@ void Fastcgipp::Manager_base::localHandler()
         ERROR_LOG("Got a non-FastCGI record destined for the manager")
 }
 
-void Fastcgipp::Manager_base::handler()
+void Fastcgipp::Manager_base::pushTask(
+        const Protocol::RequestId& id,
+        Message&& message)
+{
+    TaskQueue& queue = *m_tasks[m_affinity && id.m_id != 0 ?
+        id.m_socket.hash() % m_tasks.size():
+        m_nextQueue++ % m_tasks.size()];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.emplace_back(
+                id,
+                std::move(message),
+                m_scaleLatency.count() && !m_affinity
+                    ? Metrics::Clock::now()
+                    : Metrics::timestamp());
+    }
+    ++queue.pending;
+    ++m_pendingTasks;
+    ++Metrics::queuedTasks;
+    if(!m_sleepers && m_scaleLatency.count() && !m_affinity)
+        watch();
+    if(m_sleepers)
+    {
+        std::lock_guard<std::mutex> lock(m_wakeMutex);
+        if(m_affinity)
+            queue.wake.notify_one();
+        else
+            m_wake.notify_one();
+    }
+}
+
+bool Fastcgipp::Manager_base::popTask(unsigned index, Task& task)
+{
+    const unsigned size = m_affinity ? 1 : m_tasks.size();
+    for(unsigned i=0; i<size && m_pendingTasks; ++i)
+    {
+        TaskQueue& queue = *m_tasks[(index+i)%m_tasks.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if(!queue.tasks.empty())
+        {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+            --queue.pending;
+            --m_pendingTasks;
+            --Metrics::queuedTasks;
+            if(Metrics::timing.load(std::memory_order_relaxed))
+                Metrics::queueTime.since(task.queued);
+            return true;
+        }
+    }
+    return false;
+}
+
+void Fastcgipp::Manager_base::wakeAll()
+{
+    ++m_epoch;
+    std::lock_guard<std::mutex> lock(m_wakeMutex);
+    m_wake.notify_all();
+    for(auto& queue: m_tasks)
+        queue->wake.notify_all();
+}
+
+void Fastcgipp::Manager_base::resizeTasks()
+{
+    const unsigned size = m_maxThreads;
+    if(m_tasks.size() > size)
+    {
+        TaskQueue& first = *m_tasks.front();
+        for(auto queue = m_tasks.begin()+size; queue != m_tasks.end(); ++queue)
+        {
+            for(auto& task: (*queue)->tasks)
+                first.tasks.push_back(std::move(task));
+            first.pending += (*queue)->pending;
+        }
+    }
+    m_tasks.resize(size);
+    for(auto& queue: m_tasks)
+        if(!queue)
+            queue.reset(new TaskQueue);
+    m_threads.resize(2*size);
+    m_running.resize(2*size, false);
+}
+
+void Fastcgipp::Manager_base::requestHandler(const Protocol::RequestId& id)
 {
-    std::unique_lock<std::shared_timed_mutex> requestsWriteLock(
-            m_requestsMutex,
-            std::defer_lock);
-    std::unique_lock<std::mutex> tasksLock(m_tasksMutex);
     std::shared_lock<std::shared_timed_mutex> requestsReadLock(m_requestsMutex);
+    const auto found = m_requests.find(id);
+    if(found == nullptr)
+        return;
+    Request_base& request = **found;
+
+    std::unique_lock<std::mutex> requestLock(
+            request.mutex,
+            std::try_to_lock);
+    requestsReadLock.unlock();
 
-    while(!m_terminate && !(m_stop && m_requests.empty()))
+    if(requestLock)
     {
-        requestsReadLock.unlock();
-        while(!m_tasks.empty())
+        auto lock = request.handler();
+        const bool complete = !lock;
+        if(complete || !id.m_socket.valid())
         {
-            auto id = m_tasks.front();
-            m_tasks.pop();
-            tasksLock.unlock();
+            if(!id.m_socket.valid())
+                ++Metrics::badSocketKills;
+            if(lock)
+                lock.unlock();
+            std::unique_lock<std::shared_timed_mutex> requestsWriteLock(
+                    m_requestsMutex);
+            requestLock.unlock();
+            auto leftovers = request.leftovers();
+            std::unique_ptr<Request_base> finished(
+                    std::move(*m_requests.find(id)));
+            m_requests.erase(id);
+            --Metrics::activeRequests;
+            this->finished(id, *finished);
+            bool queued = false;
+            while(!leftovers.empty())
+            {
+                queued = route(id, std::move(leftovers.front())) || queued;
+                leftovers.pop();
+            }
+            const bool last = m_requests.empty();
+            requestsWriteLock.unlock();
+            if(complete)
+                recycle(std::move(finished));
+            if(queued)
+                pushTask(id, Message());
+            if(m_stop && last)
+                wakeAll();
+        }
+        else
+        {
+            requestLock.unlock();
+            lock.unlock();
+        }
+    }
+}
 
-            if(id.m_id == 0)
-                localHandler();
-            else
+void Fastcgipp::Manager_base::ownedHandler(Task& task)
+{
+    if(task.id.m_id == Protocol::badFcgiId)
+    {
+        std::lock_guard<std::shared_timed_mutex> lock(m_requestsMutex);
+        const size_t killed = m_requests.erase(task.id.m_socket);
+        forget(task.id.m_socket);
+        Metrics::badSocketKills += killed;
+        Metrics::activeRequests.sub(killed);
+        if(m_stop && m_requests.empty())
+            wakeAll();
+        return;
+    }
+
+    std::shared_lock<std::shared_timed_mutex> requestsReadLock(m_requestsMutex);
+    const auto found = m_requests.find(task.id);
+    Request_base* const request = found ? found->get() : nullptr;
+    requestsReadLock.unlock();
+
+    if(request == nullptr)
+    {
+        if(task.message.type == 0)
+        {
+            const Protocol::Header& header=*reinterpret_cast<Protocol::Header*>(
+                    task.message.data.begin());
+            if(header.type == Protocol::RecordType::BEGIN_REQUEST)
             {
-                requestsReadLock.lock();
-                auto request = m_requests.find(id);
-                if(request != m_requests.end())
-                {
-                    std::unique_lock<std::mutex> requestLock(
-                            request->second->mutex,
-                            std::try_to_lock);
-                    requestsReadLock.unlock();
+                const Protocol::BeginRequest& body
+                    = *reinterpret_cast<Protocol::BeginRequest*>(
+                            task.message.data.begin()
+                            +sizeof(header));
 
-                    if(requestLock)
-                    {
-                        auto lock = request->second->handler();
-                        if(!lock || !id.m_socket.valid())
-                        {
-#if FASTCGIPP_LOG_LEVEL > 3
-                            if(!id.m_socket.valid())
-                                ++m_badSocketKillCount;
-#endif
-                            if(lock)
-                                lock.unlock();
-                            requestsWriteLock.lock();
-                            requestLock.unlock();
-                            m_requests.erase(request);
-                            requestsWriteLock.unlock();
-                        }
-                        else
-                        {
-                            requestLock.unlock();
-                            lock.unlock();
-                        }
-                    }
-                }
-                else
-                    requestsReadLock.unlock();
+                // Admitting and adding has to be atomic to keep to the limits
+                std::lock_guard<std::shared_timed_mutex> lock(m_requestsMutex);
+                if(!admit(task.id, body.kill()))
+                    return;
+                begun(task.id);
+                m_requests[task.id] = makeRequest(
+                        task.id,
+                        body.role,
+                        body.kill());
+                ++Metrics::requests;
+                ++Metrics::activeRequests;
+                Metrics::maxActiveRequests.update(m_requests.size());
             }
-            tasksLock.lock();
+            else
+                orphan(task.id, header);
+        }
+        return;
+    }
+
+    const bool complete = request->handle(std::move(task.message));
+    if(complete || !task.id.m_socket.valid())
+    {
+        if(!task.id.m_socket.valid())
+            ++Metrics::badSocketKills;
+        std::unique_lock<std::shared_timed_mutex> lock(m_requestsMutex);
+        std::unique_ptr<Request_base> finished(
+                std::move(*m_requests.find(task.id)));
+        m_requests.erase(task.id);
+        --Metrics::activeRequests;
+        this->finished(task.id, *finished);
+        const bool last = m_requests.empty();
+        lock.unlock();
+        if(complete)
+            recycle(std::move(finished));
+        if(m_stop && last)
+            wakeAll();
+    }
+}
+
+void Fastcgipp::Manager_base::handler(unsigned index)
+{
+    std::shared_lock<std::shared_timed_mutex> requestsReadLock(
+            m_requestsMutex,
+            std::defer_lock);
+    Task task;
+    bool retired = false;
+    const bool scaling = m_scaleLatency.count() && !m_affinity;
+    handlerManager = this;
+    if(!m_handlerCpus.empty())
+        m_handlerCpus.pin(index);
+    ++Metrics::activeThreads;
+
+    while(true)
+    {
+        const unsigned epoch = m_epoch;
+
+        while(popTask(index, task))
+        {
+            if(scaling)
+                grow(task.queued);
+            if(task.id.m_id == 0)
+                localHandler();
+            else if(m_affinity)
+                ownedHandler(task);
+            else
+                requestHandler(task.id);
         }
 
         requestsReadLock.lock();
         if(m_terminate || (m_stop && m_requests.empty()))
+        {
+            --Metrics::activeThreads;
             break;
+        }
         requestsReadLock.unlock();
-#if FASTCGIPP_LOG_LEVEL > 3
-        --m_activeThreads;
-#endif
-        m_wake.wait(tasksLock);
-#if FASTCGIPP_LOG_LEVEL > 3
-        if(!m_stop && !m_terminate)
+
+        if(retire())
         {
-            ++m_activeThreads;
-            m_maxActiveThreads = std::max(m_activeThreads, m_maxActiveThreads);
+            --Metrics::activeThreads;
+            retired = true;
+            break;
         }
-#endif
-        requestsReadLock.lock();
+
+        std::unique_lock<std::mutex> wakeLock(m_wakeMutex);
+        ++m_sleepers;
+        --Metrics::activeThreads;
+        if(m_affinity)
+        {
+            TaskQueue& queue = *m_tasks[index];
+            queue.wake.wait(wakeLock, [this, &queue, epoch] {
+                    return queue.pending || m_epoch != epoch;
+                });
+        }
+        else if(scaling)
+        {
+            if(!m_wake.wait_for(wakeLock, m_idleTimeout, [this, epoch] {
+                        return m_pendingTasks || m_epoch != epoch;
+                    }))
+                shrink();
+        }
+        else
+            m_wake.wait(wakeLock, [this, epoch] {
+                    return m_pendingTasks || m_epoch != epoch;
+                });
+        --m_sleepers;
+        ++Metrics::activeThreads;
+        Metrics::maxActiveThreads.update(Metrics::activeThreads.value());
+    }
+
+    if(requestsReadLock)
+        requestsReadLock.unlock();
+    if(!retired)
+        --m_liveThreads;
+    --Metrics::handlerThreads;
+    handlerManager = nullptr;
+    std::lock_guard<std::mutex> lock(m_startStopMutex);
+    m_running[index] = false;
+}
+
+void Fastcgipp::Manager_base::reject(
+        const Protocol::RequestId& id,
+        Protocol::ProtocolStatus status,
+        bool kill)
+{
+    static const char unavailable[] =
+        "Status: 503 Service Unavailable\r\n"
+        "Retry-After: 1\r\n"
+        "Content-Type: text/plain; charset=utf-8\r\n\r\n"
+        "503 Service Unavailable";
+    const bool respond = m_overloadResponse
+        && status == Protocol::ProtocolStatus::OVERLOADED;
+
+    // The response goes in an OUT record padded to eight bytes, then an
+    // empty OUT record to end the stream.
+    const size_t content = respond?sizeof(unavailable)-1:0;
+    const size_t padding = (8-content%8)%8;
+    const size_t offset = respond?
+        2*sizeof(Protocol::Header)+content+padding:0;
+    Block record(
+            offset+sizeof(Protocol::Header)+sizeof(Protocol::EndRequest));
+
+    if(respond)
+    {
+        char* position = record.begin();
+        for(const size_t length: {content, size_t(0)})
+        {
+            Protocol::Header& out
+                = *reinterpret_cast<Protocol::Header*>(position);
+            out.version = Protocol::version;
+            out.type = Protocol::RecordType::OUT;
+            out.fcgiId = id.m_id;
+            out.contentLength = length;
+            out.paddingLength = length?padding:0;
+            out.reserved = 0;
+            position += sizeof(Protocol::Header);
+            std::copy(unavailable, unavailable+length, position);
+            std::fill(position+length, position+length+out.paddingLength, 0);
+            position += length+out.paddingLength;
+        }
+        status = Protocol::ProtocolStatus::REQUEST_COMPLETE;
+    }
+
+    Protocol::Header& header
+        = *reinterpret_cast<Protocol::Header*>(record.begin()+offset);
+    header.version = Protocol::version;
+    header.type = Protocol::RecordType::END_REQUEST;
+    header.fcgiId = id.m_id;
+    header.contentLength = sizeof(Protocol::EndRequest);
+    header.paddingLength = 0;
+
+    Protocol::EndRequest& body =
+        *reinterpret_cast<Protocol::EndRequest*>(
+                record.begin()+offset+sizeof(header));
+    body.appStatus = 0;
+    body.protocolStatus = status;
+
+    m_transceiver.send(id.m_socket, std::move(record), kill);
+}
+
+bool Fastcgipp::Manager_base::admit(const Protocol::RequestId& id, bool kill)
+{
+    if(!m_multiplex && m_requests.count(id.m_socket) != 0)
+    {
+        WARNING_LOG("Rejecting a multiplexed request")
+        reject(id, Protocol::ProtocolStatus::CANT_MPX_CONN, kill);
+        return false;
+    }
+    if(m_requestLimit != 0 && m_requests.size() >= m_requestLimit)
+    {
+        WARNING_LOG("Rejecting a request as we are overloaded")
+        ++Metrics::requestLimitRejections;
+        reject(id, Protocol::ProtocolStatus::OVERLOADED, kill);
+        return false;
+    }
+    if(m_taskLimit != 0 && m_pendingTasks >= m_taskLimit)
+    {
+        WARNING_LOG("Rejecting a request as too many tasks are queued")
+        ++Metrics::taskLimitRejections;
+        reject(id, Protocol::ProtocolStatus::OVERLOADED, kill);
+        return false;
+    }
+    if(m_transceiver.congested())
+    {
+        WARNING_LOG("Rejecting a request as too much output is queued")
+        ++Metrics::sendLimitRejections;
+        reject(id, Protocol::ProtocolStatus::OVERLOADED, kill);
+        return false;
     }
+    return true;
+}
+
+bool Fastcgipp::Manager_base::route(
+        const Protocol::RequestId& id,
+        Message&& message)
+{
+    const auto request = m_requests.find(id);
+    if(request != nullptr)
+    {
+        (*request)->push(std::move(message));
+        return true;
+    }
+
+    if(message.type == 0)
+    {
+        const Protocol::Header& header=
+            *reinterpret_cast<Protocol::Header*>(message.data.begin());
+        if(header.type == Protocol::RecordType::BEGIN_REQUEST)
+        {
+            const Protocol::BeginRequest& body
+                = *reinterpret_cast<Protocol::BeginRequest*>(
+                        message.data.begin()
+                        +sizeof(header));
+
+            if(!admit(id, body.kill()))
+                return false;
+            begun(id);
+            m_requests[id] = makeRequest(
+                    id,
+                    body.role,
+                    body.kill());
+            ++Metrics::requests;
+            ++Metrics::activeRequests;
+            Metrics::maxActiveRequests.update(m_requests.size());
+        }
+        else
+            orphan(id, header);
+    }
+    return false;
+}
+
+void Fastcgipp::Manager_base::orphan(
+        const Protocol::RequestId& id,
+        const Protocol::Header& header)
+{
+    // A subscribed request is in a topic instead
+    if(header.type == Protocol::RecordType::ABORT_REQUEST
+            && Topic::abort(id))
+        return;
+
+    // An empty IN record can trail an early dispatched request
+    if(header.type == Protocol::RecordType::IN && header.contentLength == 0)
+    {
+        std::lock_guard<std::mutex> lock(m_trailingMutex);
+        if(m_trailing.erase(id))
+            return;
+    }
+
+    ++Metrics::orphanRecords;
+    WARNING_LOG("Got a non BEGIN_REQUEST record for a request"\
+            " that doesn't exist")
+}
+
+void Fastcgipp::Manager_base::finished(
+        const Protocol::RequestId& id,
+        const Request_base& request)
+{
+    if(request.trailing() && id.m_socket.valid())
+    {
+        std::lock_guard<std::mutex> lock(m_trailingMutex);
+        m_trailing.insert(id);
+    }
+}
+
+void Fastcgipp::Manager_base::begun(const Protocol::RequestId& id)
+{
+    std::lock_guard<std::mutex> lock(m_trailingMutex);
+    m_trailing.erase(id);
+}
+
+void Fastcgipp::Manager_base::forget(const Socket& socket)
+{
+    std::lock_guard<std::mutex> lock(m_trailingMutex);
+    const auto range = m_trailing.equal_range(socket);
+    m_trailing.erase(range.first, range.second);
 }
 
 void Fastcgipp::Manager_base::push(Protocol::RequestId id, Message&& message)
 {
     if(id.m_id == 0)
     {
-#if FASTCGIPP_LOG_LEVEL > 3
-        ++m_managementRecordCount;
-#endif
+        ++Metrics::managementRecords;
         std::lock_guard<std::mutex> lock(m_messagesMutex);
         m_messages.push(std::make_pair(std::move(message), id.m_socket));
     }
+    else if(m_affinity)
+    {
+        if(id.m_id == Protocol::badFcgiId)
+            ++Metrics::badSocketMessages;
+        else
+            ++Metrics::messages;
+        pushTask(id, std::move(message));
+        return;
+    }
     else if(id.m_id == Protocol::badFcgiId)
     {
-#if FASTCGIPP_LOG_LEVEL > 3
-        ++m_badSocketMessageCount;
-#endif
+        ++Metrics::badSocketMessages;
         std::lock_guard<std::shared_timed_mutex> lock(m_requestsMutex);
-        const auto range = m_requests.equal_range(id.m_socket);
-        auto request = range.first;
-        while(request != range.second)
-        {
-            std::unique_lock<std::mutex> lock(
-                    request->second->mutex,
-                    std::try_to_lock);
-            if(lock)
-            {
-                lock.unlock();
-                request = m_requests.erase(request);
-#if FASTCGIPP_LOG_LEVEL > 3
-                ++m_badSocketKillCount;
-#endif
-            }
-            else
-                ++request;
-        }
+        const size_t killed = m_requests.erase(
+                id.m_socket,
+                [] (std::unique_ptr<Request_base>& request)
+                {
+                    std::unique_lock<std::mutex> lock(
+                            request->mutex,
+                            std::try_to_lock);
+                    return bool(lock);
+                });
+        forget(id.m_socket);
+        Metrics::badSocketKills += killed;
+        Metrics::activeRequests.sub(killed);
         return;
     }
     else
     {
-#if FASTCGIPP_LOG_LEVEL > 3
-        ++m_messageCount;
-#endif
-        std::unique_lock<std::shared_timed_mutex> lock(m_requestsMutex);
-        auto request = m_requests.find(id);
-        if(request == m_requests.end())
-        {
-            if(message.type == 0)
-            {
-                const Protocol::Header& header=
-                    *reinterpret_cast<Protocol::Header*>(message.data.begin());
-                if(header.type == Protocol::RecordType::BEGIN_REQUEST)
-                {
-                    const Protocol::BeginRequest& body
-                        = *reinterpret_cast<Protocol::BeginRequest*>(
-                                message.data.begin()
-                                +sizeof(header));
-
-                    request = m_requests.emplace(
-                            std::piecewise_construct,
-                            std::forward_as_tuple(id),
-                            std::forward_as_tuple()).first;
-
-                    request->second = makeRequest(
-                            id,
-                            body.role,
-                            body.kill());
-                    lock.unlock();
-#if FASTCGIPP_LOG_LEVEL > 3
-                    ++m_requestCount;
-                    m_maxRequests = std::max(m_maxRequests, m_requests.size());
-#endif
-                }
-                else
-                    WARNING_LOG("Got a non BEGIN_REQUEST record for a request"\
-                            " that doesn't exist")
-            }
+        ++Metrics::messages;
+        std::lock_guard<std::shared_timed_mutex> lock(m_requestsMutex);
+        if(!route(id, std::move(message)))
             return;
-        }
-        else
-            request->second->push(std::move(message));
     }
-    std::lock_guard<std::mutex> lock(m_tasksMutex);
-    m_tasks.push(id);
-    m_wake.notify_one();
+    pushTask(id, Message());
 }
 
 void Fastcgipp::Manager_base::resizeThreads(unsigned threads)
 {
+    std::lock_guard<std::mutex> lock(m_startStopMutex);
+    if(m_stop)
+    {
+        m_minThreads = 1;
+        m_maxThreads = std::max(threads, 1u);
+        m_scaleLatency = std::chrono::microseconds(0);
+        resizeTasks();
+    }
+    else if(!m_affinity)
+    {
+        m_targetThreads = std::min(
+                std::max(threads, m_minThreads),
+                m_maxThreads);
+        fill();
+        wakeAll();
+    }
+}
+
+void Fastcgipp::Manager_base::scaleThreads(
+        unsigned minimum,
+        unsigned maximum,
+        std::chrono::microseconds latency,
+        std::chrono::milliseconds idle)
+{
+    std::lock_guard<std::mutex> lock(m_startStopMutex);
     if(m_stop)
     {
-        m_threads.resize(threads);
-#if FASTCGIPP_LOG_LEVEL > 3
-        m_activeThreads = threads;
-#endif
+        m_maxThreads = std::max(maximum, 1u);
+        m_minThreads = std::min(std::max(minimum, 1u), m_maxThreads);
+        m_scaleLatency = latency;
+        m_idleTimeout = idle;
+        resizeTasks();
     }
 }
 
@@ -430,23 +969,32 @@ Fastcgipp::Manager_base::~Manager_base()
     instance=nullptr;
     terminate();
     DIAG_LOG("Manager_base::~Manager_base(): New requests ============== " \
-            << m_requestCount)
+            << Metrics::requests.value())
     DIAG_LOG("Manager_base::~Manager_base(): Max concurrent requests === " \
-            << m_maxRequests)
+            << Metrics::maxActiveRequests.value())
     DIAG_LOG("Manager_base::~Manager_base(): Management records ======== " \
-            << m_managementRecordCount)
+            << Metrics::managementRecords.value())
     DIAG_LOG("Manager_base::~Manager_base(): Bad socket messages ======= " \
-            << m_badSocketMessageCount)
+            << Metrics::badSocketMessages.value())
     DIAG_LOG("Manager_base::~Manager_base(): Bad socket request kills == " \
-            << m_badSocketKillCount)
+            << Metrics::badSocketKills.value())
+    DIAG_LOG("Manager_base::~Manager_base(): Orphan records ============ " \
+            << Metrics::orphanRecords.value())
     DIAG_LOG("Manager_base::~Manager_base(): Request messages received = " \
-            << m_messageCount)
+            << Metrics::messages.value())
     DIAG_LOG("Manager_base::~Manager_base(): Maximum active threads ==== " \
-            << m_maxActiveThreads)
+            << Metrics::maxActiveThreads.value())
     DIAG_LOG("Manager_base::~Manager_base(): Remaining requests ======== " \
             << m_requests.size())
     DIAG_LOG("Manager_base::~Manager_base(): Remaining tasks =========== " \
-            << m_tasks.size())
+            << m_pendingTasks)
     DIAG_LOG("Manager_base::~Manager_base(): Remaining local messages == " \
             << m_messages.size())
+    DIAG_LOG("Manager_base::~Manager_base(): Block pool hits =========== " \
+            << BlockPool::stats().hits << '/' \
+            << BlockPool::stats().allocations)
+    DIAG_LOG("Manager_base::~Manager_base(): Block pool peak bytes ===== " \
+            << BlockPool::stats().peakBytes)
+    Metrics::activeRequests.sub(m_requests.size());
+    Metrics::queuedTasks.sub(m_pendingTasks);
 }
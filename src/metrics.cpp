@@ -0,0 +1,518 @@
+/*!
+ * @file       metrics.cpp
+ * @brief      Defines the runtime metrics
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 14, 2026
+ * @copyright  Copyright &copy; 2026 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2026 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#include "fastcgi++/metrics.hpp"
+
+#include <mutex>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+
+namespace
+{
+    struct Registry
+    {
+        std::mutex mutex;
+        std::vector<const Fastcgipp::Metrics::Metric*> metrics;
+    };
+
+    // The registry must be constructed before, and so destroyed after, any
+    // metric with static storage duration
+    Registry& registry()
+    {
+        static Registry registry;
+        return registry;
+    }
+
+    template<class T> long long sum(const T& shards)
+    {
+        long long total = 0;
+        for(const auto& shard: shards)
+            total += shard.value.load(std::memory_order_relaxed);
+        return total;
+    }
+
+    template<class T> void zero(T& shards)
+    {
+        for(auto& shard: shards)
+            shard.value.store(0, std::memory_order_relaxed);
+    }
+
+    std::atomic_uint nextShardIndex(0);
+
+    // Microseconds written out as seconds without any loss of precision
+    void seconds(std::ostream& stream, unsigned long long microseconds)
+    {
+        stream << microseconds/1000000;
+        unsigned fraction = microseconds%1000000;
+        if(fraction)
+        {
+            char digits[8] = ".000000";
+            for(int i=6; i>0; --i, fraction/=10)
+                digits[i] = '0'+fraction%10;
+            int end = 7;
+            while(digits[end-1] == '0')
+                --end;
+            digits[end] = 0;
+            stream << digits;
+        }
+    }
+
+    const char* typeName(Fastcgipp::Metrics::Type type)
+    {
+        switch(type)
+        {
+            case Fastcgipp::Metrics::Type::COUNTER:
+                return "counter";
+            case Fastcgipp::Metrics::Type::GAUGE:
+                return "gauge";
+            default:
+                return "histogram";
+        }
+    }
+}
+
+Fastcgipp::Metrics::Metric::Metric(
+        const char* name_,
+        const char* help_,
+        const char* labels_,
+        Type type_):
+    name(name_),
+    help(help_),
+    labels(labels_),
+    type(type_)
+{
+    Registry& metrics = registry();
+    std::lock_guard<std::mutex> lock(metrics.mutex);
+    metrics.metrics.push_back(this);
+}
+
+Fastcgipp::Metrics::Metric::~Metric()
+{
+    Registry& metrics = registry();
+    std::lock_guard<std::mutex> lock(metrics.mutex);
+    metrics.metrics.erase(std::remove(
+                metrics.metrics.begin(),
+                metrics.metrics.end(),
+                this),
+            metrics.metrics.end());
+}
+
+void Fastcgipp::Metrics::Metric::samples(std::ostream& stream) const
+{
+    stream << name;
+    if(labels != nullptr)
+        stream << '{' << labels << '}';
+    stream << ' ' << value() << '\n';
+}
+
+unsigned Fastcgipp::Metrics::nextShard()
+{
+    return nextShardIndex++ % shards;
+}
+
+Fastcgipp::Metrics::Counter::Counter(
+        const char* name,
+        const char* help,
+        const char* labels):
+    Metric(name, help, labels, Type::COUNTER)
+{
+    zero(m_shards);
+}
+
+long long Fastcgipp::Metrics::Counter::value() const
+{
+    return sum(m_shards);
+}
+
+Fastcgipp::Metrics::Gauge::Gauge(
+        const char* name,
+        const char* help,
+        const char* labels):
+    Metric(name, help, labels, Type::GAUGE)
+{
+    zero(m_shards);
+}
+
+long long Fastcgipp::Metrics::Gauge::value() const
+{
+    return sum(m_shards);
+}
+
+Fastcgipp::Metrics::Peak::Peak(
+        const char* name,
+        const char* help,
+        const char* labels):
+    Metric(name, help, labels, Type::GAUGE),
+    m_value(0)
+{}
+
+const unsigned Fastcgipp::Metrics::Histogram::subBits;
+const unsigned Fastcgipp::Metrics::Histogram::subBuckets;
+const unsigned Fastcgipp::Metrics::Histogram::maxExponent;
+const unsigned Fastcgipp::Metrics::Histogram::buckets;
+
+Fastcgipp::Metrics::Histogram::Histogram(
+        const char* name,
+        const char* help,
+        const char* labels):
+    Metric(name, help, labels, Type::HISTOGRAM)
+{
+    for(auto& bucket: m_buckets)
+        bucket.store(0, std::memory_order_relaxed);
+    zero(m_sum);
+}
+
+unsigned long long Fastcgipp::Metrics::Histogram::lower(unsigned bucket)
+{
+    const unsigned group = bucket/subBuckets;
+    if(group == 0)
+        return bucket;
+    return (unsigned long long)(subBuckets+bucket%subBuckets) << (group-1);
+}
+
+unsigned long long Fastcgipp::Metrics::Histogram::upper(unsigned bucket)
+{
+    if(bucket+1 >= buckets)
+        return ~0ULL;
+    return lower(bucket+1)-1;
+}
+
+unsigned long long Fastcgipp::Metrics::Histogram::count() const
+{
+    unsigned long long total = 0;
+    for(const auto& bucket: m_buckets)
+        total += bucket.load(std::memory_order_relaxed);
+    return total;
+}
+
+unsigned long long Fastcgipp::Metrics::Histogram::sum() const
+{
+    return ::sum(m_sum);
+}
+
+unsigned long long Fastcgipp::Metrics::Histogram::quantile(
+        double quantile) const
+{
+    unsigned long long counts[buckets];
+    unsigned long long total = 0;
+    for(unsigned i=0; i<buckets; ++i)
+        total += counts[i] = count(i);
+    if(total == 0)
+        return 0;
+
+    unsigned long long rank = std::ceil(quantile*total);
+    rank = std::min(std::max(rank, 1ULL), total);
+    unsigned long long seen = 0;
+    for(unsigned i=0; i<buckets; ++i)
+    {
+        seen += counts[i];
+        if(seen >= rank)
+            return upper(i);
+    }
+    return upper(buckets-1);
+}
+
+void Fastcgipp::Metrics::Histogram::samples(std::ostream& stream) const
+{
+    const char* const separator = labels == nullptr ? "":",";
+    const char* const tags = labels == nullptr ? "":labels;
+
+    unsigned long long cumulative = 0;
+    unsigned index = 0;
+    for(unsigned exponent=4; exponent<=26; ++exponent)
+    {
+        const unsigned long long limit = 1ULL << exponent;
+        for(; index < bucket(limit); ++index)
+            cumulative += count(index);
+        stream << name << "_bucket{" << tags << separator << "le=\"";
+        seconds(stream, limit);
+        stream << "\"} " << cumulative << '\n';
+    }
+    for(; index<buckets; ++index)
+        cumulative += count(index);
+    stream << name << "_bucket{" << tags << separator << "le=\"+Inf\"} "
+        << cumulative << '\n';
+
+    stream << name << "_sum";
+    if(labels != nullptr)
+        stream << '{' << labels << '}';
+    stream << ' ';
+    seconds(stream, sum());
+    stream << '\n' << name << "_count";
+    if(labels != nullptr)
+        stream << '{' << labels << '}';
+    stream << ' ' << cumulative << '\n';
+}
+
+void Fastcgipp::Metrics::each(
+        const std::function<void(const Metric&)>& visitor)
+{
+    Registry& metrics = registry();
+    std::lock_guard<std::mutex> lock(metrics.mutex);
+    for(const Metric* metric: metrics.metrics)
+        visitor(*metric);
+}
+
+void Fastcgipp::Metrics::write(std::ostream& stream)
+{
+    std::vector<const Metric*> sorted;
+    {
+        Registry& metrics = registry();
+        std::lock_guard<std::mutex> lock(metrics.mutex);
+        sorted = metrics.metrics;
+    }
+    std::stable_sort(
+            sorted.begin(),
+            sorted.end(),
+            [] (const Metric* x, const Metric* y)
+            {
+                return std::strcmp(x->name, y->name) < 0;
+            });
+
+    const char* previous = nullptr;
+    for(const Metric* metric: sorted)
+    {
+        if(previous == nullptr || std::strcmp(previous, metric->name) != 0)
+        {
+            stream << "# HELP " << metric->name << ' ' << metric->help
+                << "\n# TYPE " << metric->name << ' '
+                << typeName(metric->type) << '\n';
+            previous = metric->name;
+        }
+        metric->samples(stream);
+    }
+}
+
+namespace Fastcgipp
+{
+    namespace Metrics
+    {
+        std::atomic_bool timing(false);
+
+        Counter requests(
+                "fastcgipp_requests_total",
+                "Requests created");
+        Gauge activeRequests(
+                "fastcgipp_active_requests",
+                "Requests currently in existence");
+        Peak maxActiveRequests(
+                "fastcgipp_max_active_requests",
+                "Most requests ever in existence at once");
+        Gauge queuedTasks(
+                "fastcgipp_queued_tasks",
+                "Tasks waiting in the manager queues");
+        Gauge activeThreads(
+                "fastcgipp_active_threads",
+                "Handler threads not currently sleeping");
+        Peak maxActiveThreads(
+                "fastcgipp_max_active_threads",
+                "Most handler threads ever active at once");
+        Gauge handlerThreads(
+                "fastcgipp_handler_threads",
+                "Handler threads running");
+        Gauge blockedThreads(
+                "fastcgipp_blocked_threads",
+                "Handler threads inside blocking sections");
+        Counter managementRecords(
+                "fastcgipp_management_records_total",
+                "Management records received");
+        Counter messages(
+                "fastcgipp_messages_total",
+                "Messages received for requests");
+        Counter badSocketMessages(
+                "fastcgipp_bad_socket_messages_total",
+                "Dead socket notifications received by the manager");
+        Counter badSocketKills(
+                "fastcgipp_bad_socket_kills_total",
+                "Requests killed because their socket died");
+        Counter orphanRecords(
+                "fastcgipp_orphan_records_total",
+                "Records received for requests that don't exist");
+        Counter incomingConnections(
+                "fastcgipp_incoming_connections_total",
+                "Connections accepted");
+        Counter outgoingConnections(
+                "fastcgipp_outgoing_connections_total",
+                "Connections made");
+        Counter socketKills(
+                "fastcgipp_socket_kills_total",
+                "Sockets closed locally");
+        Counter socketHangups(
+                "fastcgipp_socket_hangups_total",
+                "Sockets hung up remotely");
+        Counter bytesSent(
+                "fastcgipp_bytes_sent_total",
+                "Bytes written to sockets");
+        Counter bytesReceived(
+                "fastcgipp_bytes_received_total",
+                "Bytes read from sockets");
+        Counter connectionKills(
+                "fastcgipp_connection_kills_total",
+                "Connections closed at the end of a request");
+        Counter connectionHangups(
+                "fastcgipp_connection_hangups_total",
+                "Connections found dead when reading");
+        Counter recordsQueued(
+                "fastcgipp_records_queued_total",
+                "Records queued up for sending");
+        Counter recordsSent(
+                "fastcgipp_records_sent_total",
+                "Records completely sent");
+        Gauge sendQueueRecords(
+                "fastcgipp_send_queue_records",
+                "Records waiting in connection send queues");
+        Gauge sendQueueBytes(
+                "fastcgipp_send_queue_bytes",
+                "Bytes waiting in connection send queues");
+        Gauge pendingTimers(
+                "fastcgipp_pending_timers",
+                "Timers pending in all timer wheels");
+        Counter idleKills(
+                "fastcgipp_idle_connection_kills_total",
+                "Connections closed for being idle too long");
+        Counter requestTimeouts(
+                "fastcgipp_request_timeouts_total",
+                "Requests that ran past their deadline");
+        Counter requestLimitRejections(
+                "fastcgipp_overload_rejections_total",
+                "New requests rejected due to overload",
+                "reason=\"requests\"");
+        Counter taskLimitRejections(
+                "fastcgipp_overload_rejections_total",
+                "New requests rejected due to overload",
+                "reason=\"tasks\"");
+        Counter sendLimitRejections(
+                "fastcgipp_overload_rejections_total",
+                "New requests rejected due to overload",
+                "reason=\"send\"");
+        Counter rateLimitRejections(
+                "fastcgipp_overload_rejections_total",
+                "New requests rejected due to overload",
+                "reason=\"rate\"");
+        Counter readPauses(
+                "fastcgipp_read_pauses_total",
+                "Times an event loop stopped reading due to queued output");
+        Gauge subscribers(
+                "fastcgipp_subscribers",
+                "Requests handed off to a topic to stream from");
+        Counter subscriberDrops(
+                "fastcgipp_subscriber_drops_total",
+                "Subscribers dropped for not keeping up with their topic");
+        Counter responseCacheHits(
+                "fastcgipp_response_cache_lookups_total",
+                "Lookups of responses in response caches",
+                "result=\"hit\"");
+        Counter responseCacheNotModified(
+                "fastcgipp_response_cache_lookups_total",
+                "Lookups of responses in response caches",
+                "result=\"not_modified\"");
+        Counter responseCacheMisses(
+                "fastcgipp_response_cache_lookups_total",
+                "Lookups of responses in response caches",
+                "result=\"miss\"");
+        Gauge responseCacheBytes(
+                "fastcgipp_response_cache_bytes",
+                "Bytes taken up by response caches");
+        Counter authorizationCacheHits(
+                "fastcgipp_authorization_cache_lookups_total",
+                "Lookups of decisions in authorization caches",
+                "result=\"hit\"");
+        Counter authorizationCacheMisses(
+                "fastcgipp_authorization_cache_lookups_total",
+                "Lookups of decisions in authorization caches",
+                "result=\"miss\"");
+        Counter assetHits(
+                "fastcgipp_asset_lookups_total",
+                "Lookups of static assets in asset caches",
+                "result=\"hit\"");
+        Counter assetNotModified(
+                "fastcgipp_asset_lookups_total",
+                "Lookups of static assets in asset caches",
+                "result=\"not_modified\"");
+        Counter assetMisses(
+                "fastcgipp_asset_lookups_total",
+                "Lookups of static assets in asset caches",
+                "result=\"miss\"");
+
+        Histogram paramsTime(
+                "fastcgipp_request_phase_seconds",
+                "Time spent in each phase of requests",
+                "phase=\"params\"");
+        Histogram inTime(
+                "fastcgipp_request_phase_seconds",
+                "Time spent in each phase of requests",
+                "phase=\"in\"");
+        Histogram queueTime(
+                "fastcgipp_request_phase_seconds",
+                "Time spent in each phase of requests",
+                "phase=\"queue\"");
+        Histogram responseTime(
+                "fastcgipp_request_phase_seconds",
+                "Time spent in each phase of requests",
+                "phase=\"response\"");
+        Histogram requestTime(
+                "fastcgipp_request_phase_seconds",
+                "Time spent in each phase of requests",
+                "phase=\"total\"");
+        Histogram sendTime(
+                "fastcgipp_request_phase_seconds",
+                "Time spent in each phase of requests",
+                "phase=\"send\"");
+    }
+}
+
+namespace
+{
+    using Fastcgipp::Metrics::Counter;
+
+    const char help[] = "Records received by type";
+    const char name[] = "fastcgipp_records_received_total";
+
+    Counter receivedByType[] = {
+        {name, help, "type=\"OTHER\""},
+        {name, help, "type=\"BEGIN_REQUEST\""},
+        {name, help, "type=\"ABORT_REQUEST\""},
+        {name, help, "type=\"END_REQUEST\""},
+        {name, help, "type=\"PARAMS\""},
+        {name, help, "type=\"IN\""},
+        {name, help, "type=\"OUT\""},
+        {name, help, "type=\"ERR\""},
+        {name, help, "type=\"DATA\""},
+        {name, help, "type=\"GET_VALUES\""},
+        {name, help, "type=\"GET_VALUES_RESULT\""},
+        {name, help, "type=\"UNKNOWN_TYPE\""}};
+}
+
+Fastcgipp::Metrics::Counter& Fastcgipp::Metrics::recordsReceived(
+        unsigned type)
+{
+    const unsigned size = sizeof(receivedByType)/sizeof(Counter);
+    return receivedByType[type < size ? type : 0];
+}
@@ -32,6 +32,7 @@
 
 #include <locale>
 #include <codecvt>
+#include <algorithm>
 
 void Fastcgipp::SQL::Parameters_base::build()
 {
@@ -114,19 +115,28 @@ Fastcgipp::SQL::Parameter<std::vector<Numeric>>::operator=(
 {
     resize(x.size());
 
-    for(unsigned i=0; i < x.size(); ++i)
+    // The elements get interleaved with their lengths so they are converted
+    // a block at a time before being scattered into place
+    const unsigned blockSize = 64;
+    Numeric block[blockSize];
+    char* ptr = m_data.get() + 5*sizeof(int32_t);
+    for(unsigned i=0; i < x.size(); i += blockSize)
     {
-        char* ptr = m_data.get() + 5*sizeof(int32_t)
-            + i*(sizeof(int32_t) + sizeof(Numeric));
-
-        BigEndian<int32_t>& length(
-                *reinterpret_cast<BigEndian<int32_t>*>(ptr));
-        BigEndian<Numeric>& value(
-                *reinterpret_cast<BigEndian<Numeric>*>(
-                    ptr+sizeof(int32_t)));
-
-        length = sizeof(Numeric);
-        value = x[i];
+        const unsigned count = std::min<unsigned>(blockSize, x.size()-i);
+        std::copy_n(x.begin()+i, count, block);
+        char* const words = reinterpret_cast<char*>(block);
+        convertBigEndian(words, count, sizeof(Numeric));
+
+        for(unsigned j=0; j < count; ++j)
+        {
+            BigEndian<int32_t>& length(
+                    *reinterpret_cast<BigEndian<int32_t>*>(ptr));
+            length = sizeof(Numeric);
+            ptr = std::copy_n(
+                    words+j*sizeof(Numeric),
+                    sizeof(Numeric),
+                    ptr+sizeof(int32_t));
+        }
     }
 
     return *this;
@@ -34,10 +34,19 @@
 
 #ifdef FASTCGIPP_LINUX
 #include <sys/epoll.h>
-#elif defined FASTCGIPP_UNIX
-#include <algorithm>
 #endif
 
+#ifdef FASTCGIPP_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <poll.h>
+#include <ctime>
+#include <mutex>
+#endif
+
+#include <algorithm>
+
 #include <unistd.h>
 #include <cstring>
 
@@ -46,35 +55,381 @@ const unsigned Fastcgipp::Poll::Result::pollIn = EPOLLIN;
 const unsigned Fastcgipp::Poll::Result::pollErr = EPOLLERR;
 const unsigned Fastcgipp::Poll::Result::pollHup = EPOLLHUP;
 const unsigned Fastcgipp::Poll::Result::pollRdHup = EPOLLRDHUP;
+const unsigned Fastcgipp::Poll::Result::pollOut = EPOLLOUT;
 #elif defined FASTCGIPP_UNIX
 const unsigned Fastcgipp::Poll::Result::pollIn = POLLIN;
 const unsigned Fastcgipp::Poll::Result::pollErr = POLLERR;
 const unsigned Fastcgipp::Poll::Result::pollHup = POLLHUP;
 const unsigned Fastcgipp::Poll::Result::pollRdHup = POLLRDHUP;
+const unsigned Fastcgipp::Poll::Result::pollOut = POLLOUT;
 #endif
 
-Fastcgipp::Poll::Poll()
-#ifdef FASTCGIPP_LINUX
-    :m_poll(epoll_create1(0))
+bool Fastcgipp::Poll::ioUring = false;
+
+#ifdef FASTCGIPP_IO_URING
+struct Fastcgipp::Poll::Ring
+{
+    //! What we need to know about a socket in the poll list
+    struct Registration
+    {
+        //! Events we poll for. Zero if not in the poll list.
+        unsigned events;
+
+        //! Generation of the most recent poll request
+        uint32_t generation;
+
+        //! True if a poll request is outstanding in the kernel
+        bool armed;
+    };
+
+    //! The io_uring file descriptor
+    const int fd;
+
+    //! Submission queue ring mapping
+    void* ring;
+
+    //! Size of the ring mapping
+    size_t ringSize;
+
+    //! Submission queue entries mapping
+    io_uring_sqe* sqes;
+
+    //! Size of the submission queue entries mapping
+    size_t sqesSize;
+
+    unsigned* sqHead;
+    unsigned* sqTail;
+    unsigned sqMask;
+    unsigned sqEntries;
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned cqMask;
+    io_uring_cqe* cqes;
+
+    //! Generation to give the next poll request
+    uint32_t generation;
+
+    //! True while a thread is blocked waiting for completions
+    bool waiting;
+
+    //! Registrations indexed by socket
+    std::vector<Registration> sockets;
+
+    //! Sockets whose event was handed out and need their poll rearmed
+    std::vector<socket_t> rearm;
+
+    //! Thread safe access to the submission ring and registrations
+    std::mutex mutex;
+
+    int enter(unsigned submit, unsigned complete, unsigned flags,
+            const void* arg=nullptr, size_t size=0)
+    {
+        return syscall(
+                __NR_io_uring_enter,
+                fd,
+                submit,
+                complete,
+                flags,
+                arg,
+                size);
+    }
+
+    Ring(int descriptor, const io_uring_params& params):
+        fd(descriptor),
+        ring(MAP_FAILED),
+        ringSize(std::max(
+                    params.sq_off.array+params.sq_entries*sizeof(unsigned),
+                    params.cq_off.cqes
+                        + params.cq_entries*sizeof(io_uring_cqe))),
+        sqes(static_cast<io_uring_sqe*>(MAP_FAILED)),
+        sqesSize(params.sq_entries*sizeof(io_uring_sqe)),
+        generation(0),
+        waiting(false)
+    {
+        ring = mmap(
+                nullptr,
+                ringSize,
+                PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE,
+                fd,
+                IORING_OFF_SQ_RING);
+        if(ring == MAP_FAILED)
+            return;
+        sqes = static_cast<io_uring_sqe*>(mmap(
+                nullptr,
+                sqesSize,
+                PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE,
+                fd,
+                IORING_OFF_SQES));
+        if(sqes == MAP_FAILED)
+            return;
+
+        char* const base = static_cast<char*>(ring);
+        sqHead = reinterpret_cast<unsigned*>(base+params.sq_off.head);
+        sqTail = reinterpret_cast<unsigned*>(base+params.sq_off.tail);
+        sqMask = *reinterpret_cast<unsigned*>(base+params.sq_off.ring_mask);
+        sqEntries = params.sq_entries;
+        cqHead = reinterpret_cast<unsigned*>(base+params.cq_off.head);
+        cqTail = reinterpret_cast<unsigned*>(base+params.cq_off.tail);
+        cqMask = *reinterpret_cast<unsigned*>(base+params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(base+params.cq_off.cqes);
+
+        // The indirection array never changes so fill it once and for all
+        unsigned* const array = reinterpret_cast<unsigned*>(
+                base+params.sq_off.array);
+        for(unsigned i=0; i<sqEntries; ++i)
+            array[i] = i;
+    }
+
+    ~Ring()
+    {
+        if(sqes != MAP_FAILED)
+            munmap(sqes, sqesSize);
+        if(ring != MAP_FAILED)
+            munmap(ring, ringSize);
+        close(fd);
+    }
+
+    //! True if both mappings succeeded
+    bool valid() const
+    {
+        return ring != MAP_FAILED && sqes != MAP_FAILED;
+    }
+
+    //! Entries queued in the submission ring but not yet submitted
+    unsigned pending() const
+    {
+        return *sqTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+    }
+
+    //! Hand any queued entries to the kernel
+    void submit()
+    {
+        while(pending())
+            if(enter(pending(), 0, 0) < 0
+                    && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+                FAIL_LOG("Error submitting to io_uring: " \
+                        << std::strerror(errno))
+    }
+
+    //! Get a cleared submission queue entry to be queued with push()
+    io_uring_sqe& entry()
+    {
+        if(pending() == sqEntries)
+            submit();
+        io_uring_sqe& sqe = sqes[*sqTail & sqMask];
+        std::memset(&sqe, 0, sizeof(sqe));
+        return sqe;
+    }
+
+    //! Queue up the entry returned from entry()
+    void push()
+    {
+        __atomic_store_n(sqTail, *sqTail+1, __ATOMIC_RELEASE);
+    }
+
+    //! Submit now if another thread is waiting on the ring
+    void flush()
+    {
+        if(waiting)
+            submit();
+    }
+
+    //! Start a poll request for a socket
+    void arm(socket_t socket)
+    {
+        Registration& registration = sockets[socket];
+        if(++generation == 0)
+            ++generation;
+        registration.generation = generation;
+        registration.armed = true;
+
+        io_uring_sqe& sqe = entry();
+        sqe.opcode = IORING_OP_POLL_ADD;
+        sqe.fd = socket;
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        sqe.poll32_events = __builtin_bswap32(registration.events);
+#else
+        sqe.poll32_events = registration.events;
 #endif
-{}
+        sqe.user_data = uint64_t(generation)<<32 | uint32_t(socket);
+        push();
+    }
+
+    //! Cancel the outstanding poll request for a socket
+    void disarm(socket_t socket)
+    {
+        Registration& registration = sockets[socket];
+        registration.armed = false;
+
+        io_uring_sqe& sqe = entry();
+        sqe.opcode = IORING_OP_POLL_REMOVE;
+        sqe.fd = -1;
+        sqe.addr = uint64_t(registration.generation)<<32 | uint32_t(socket);
+        sqe.user_data = 0;
+        push();
+    }
+
+    //! Registration of a socket or nullptr if it isn't in the poll list
+    Registration* find(socket_t socket)
+    {
+        if(socket < 0
+                || size_t(socket) >= sockets.size()
+                || sockets[socket].events == 0)
+            return nullptr;
+        return &sockets[socket];
+    }
+
+    //! Create an io_uring with all the features we need or nullptr
+    static Ring* create()
+    {
+        if(!ioUring)
+            return nullptr;
+
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        params.flags = IORING_SETUP_CLAMP;
+        const int fd = syscall(__NR_io_uring_setup, 4*batchSize, &params);
+        if(fd < 0)
+            return nullptr;
+
+        const unsigned required = IORING_FEAT_SINGLE_MMAP
+            | IORING_FEAT_NODROP
+            | IORING_FEAT_EXT_ARG;
+        if((params.features & required) != required)
+        {
+            close(fd);
+            return nullptr;
+        }
+
+        Ring* const ring = new Ring(fd, params);
+        if(!ring->valid())
+        {
+            delete ring;
+            return nullptr;
+        }
+        return ring;
+    }
+};
+#endif
+
+Fastcgipp::Poll::Poll():
+#ifdef FASTCGIPP_IO_URING
+    m_ring(Ring::create()),
+    m_poll(m_ring?-1:epoll_create1(0)),
+#elif defined FASTCGIPP_LINUX
+    m_poll(epoll_create1(0)),
+#endif
+    m_next(0)
+{
+    m_batch.reserve(batchSize);
+}
 
 Fastcgipp::Poll::~Poll()
 {
 #ifdef FASTCGIPP_LINUX
-    close(m_poll);
+    if(m_poll >= 0)
+        close(m_poll);
 #endif
 }
 
-Fastcgipp::Poll::Result Fastcgipp::Poll::poll(int timeout)
+const char* Fastcgipp::Poll::backend() const
 {
+#ifdef FASTCGIPP_IO_URING
+    if(m_ring)
+        return "io_uring";
+#endif
+#ifdef FASTCGIPP_LINUX
+    return "epoll";
+#elif defined FASTCGIPP_UNIX
+    return "poll";
+#endif
+}
+
+void Fastcgipp::Poll::fill(int timeout)
+{
+    m_batch.clear();
+    m_next = 0;
+
+#ifdef FASTCGIPP_IO_URING
+    if(m_ring)
+    {
+        Ring& ring = *m_ring;
+        std::unique_lock<std::mutex> lock(ring.mutex);
+
+        for(const socket_t socket: ring.rearm)
+        {
+            const Ring::Registration* const registration = ring.find(socket);
+            if(registration && !registration->armed)
+                ring.arm(socket);
+        }
+        ring.rearm.clear();
+
+        if(__atomic_load_n(ring.cqTail, __ATOMIC_ACQUIRE) == *ring.cqHead
+                && (timeout != 0 || ring.pending()))
+        {
+            const unsigned submit = ring.pending();
+            ring.waiting = timeout != 0;
+            lock.unlock();
+
+            timespec interval;
+            interval.tv_sec = timeout/1000;
+            interval.tv_nsec = (timeout%1000)*1000000;
+            io_uring_getevents_arg arg;
+            std::memset(&arg, 0, sizeof(arg));
+            if(timeout > 0)
+                arg.ts = reinterpret_cast<uint64_t>(&interval);
+            const int result = ring.enter(
+                    submit,
+                    timeout != 0 ? 1 : 0,
+                    IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+                    &arg,
+                    sizeof(arg));
+
+            lock.lock();
+            ring.waiting = false;
+            if(result < 0 && errno != EINTR && errno != ETIME
+                    && errno != EAGAIN && errno != EBUSY)
+                FAIL_LOG("Error on io_uring poll: " << std::strerror(errno))
+        }
+
+        Result result;
+        result.m_data = true;
+        unsigned head = *ring.cqHead;
+        const unsigned tail = __atomic_load_n(ring.cqTail, __ATOMIC_ACQUIRE);
+        for(; head != tail && m_batch.size() < batchSize; ++head)
+        {
+            const io_uring_cqe& cqe = ring.cqes[head & ring.cqMask];
+            const socket_t socket = static_cast<socket_t>(
+                    cqe.user_data & 0xffffffff);
+            Ring::Registration* const registration = ring.find(socket);
+            if(cqe.user_data == 0
+                    || registration == nullptr
+                    || registration->generation != cqe.user_data>>32)
+                continue;
+
+            registration->armed = false;
+            ring.rearm.push_back(socket);
+            if(cqe.res == -ECANCELED)
+                continue;
+
+            result.m_socket = socket;
+            result.m_events = cqe.res<0 ? Result::pollErr : unsigned(cqe.res);
+            m_batch.push_back(result);
+        }
+        __atomic_store_n(ring.cqHead, head, __ATOMIC_RELEASE);
+        return;
+    }
+#endif
+
     int pollResult;
 #ifdef FASTCGIPP_LINUX
-    epoll_event epollEvent;
+    epoll_event epollEvents[batchSize];
     pollResult = epoll_wait(
             m_poll,
-            &epollEvent,
-            1,
+            epollEvents,
+            batchSize,
             timeout);
 #elif defined FASTCGIPP_UNIX
     pollResult = ::poll(
@@ -83,36 +438,77 @@ Fastcgipp::Poll::Result Fastcgipp::Poll::poll(int timeout)
             timeout);
 #endif
 
-    Result result;
-
     if(pollResult<0 && errno != EINTR)
         FAIL_LOG("Error on poll: " << std::strerror(errno))
     else if(pollResult>0)
     {
+        Result result;
         result.m_data = true;
 #ifdef FASTCGIPP_LINUX
-        result.m_socket = epollEvent.data.fd;
-        result.m_events = epollEvent.events;
+        for(int i=0; i<pollResult; ++i)
+        {
+            result.m_socket = epollEvents[i].data.fd;
+            result.m_events = epollEvents[i].events;
+            m_batch.push_back(result);
+        }
 #elif defined FASTCGIPP_UNIX
-        const auto fd = std::find_if(
-                m_poll.begin(),
-                m_poll.end(),
-                [] (const pollfd& x)
-                {
-                    return x.revents != 0;
-                });
-        if(fd == m_poll.end())
+        for(const auto& fd: m_poll)
+        {
+            if(fd.revents == 0)
+                continue;
+            result.m_socket = fd.fd;
+            result.m_events = fd.revents;
+            m_batch.push_back(result);
+            if(m_batch.size() == batchSize)
+                break;
+        }
+        if(m_batch.empty())
             FAIL_LOG("poll() gave a result >0 but no revents are non-zero")
-        result.m_socket = fd->fd;
-        result.m_events = fd->revents;
 #endif
     }
+}
+
+Fastcgipp::Poll::Result Fastcgipp::Poll::poll(int timeout)
+{
+    if(m_next == m_batch.size())
+        fill(timeout);
+
+    if(m_next < m_batch.size())
+        return m_batch[m_next++];
+    return Result();
+}
 
-    return result;
+const std::vector<Fastcgipp::Poll::Result>& Fastcgipp::Poll::batch(int timeout)
+{
+    if(m_next == m_batch.size())
+        fill(timeout);
+    else if(m_next > 0)
+        m_batch.erase(m_batch.begin(), m_batch.begin()+m_next);
+
+    m_next = m_batch.size();
+    return m_batch;
 }
 
 bool Fastcgipp::Poll::add(const socket_t socket)
 {
+#ifdef FASTCGIPP_IO_URING
+    if(m_ring)
+    {
+        std::lock_guard<std::mutex> lock(m_ring->mutex);
+        if(socket < 0 || m_ring->find(socket))
+        {
+            errno = socket<0 ? EBADF : EEXIST;
+            return false;
+        }
+        if(size_t(socket) >= m_ring->sockets.size())
+            m_ring->sockets.resize(socket+1, Ring::Registration());
+        m_ring->sockets[socket].events = POLLIN | POLLERR | POLLHUP
+            | POLLRDHUP;
+        m_ring->arm(socket);
+        m_ring->flush();
+        return true;
+    }
+#endif
 #ifdef FASTCGIPP_LINUX
     epoll_event event;
     event.data.fd = socket;
@@ -136,8 +532,99 @@ bool Fastcgipp::Poll::add(const socket_t socket)
 #endif
 }
 
+bool Fastcgipp::Poll::mod(const socket_t socket, bool out, bool in)
+{
+#ifdef FASTCGIPP_IO_URING
+    if(m_ring)
+    {
+        std::lock_guard<std::mutex> lock(m_ring->mutex);
+        Ring::Registration* const registration = m_ring->find(socket);
+        if(registration == nullptr)
+        {
+            errno = ENOENT;
+            return false;
+        }
+
+        unsigned events = POLLERR | POLLHUP;
+        if(in)
+            events |= POLLIN | POLLRDHUP;
+        if(out)
+            events |= POLLOUT;
+        if(events != registration->events)
+        {
+            registration->events = events;
+            if(registration->armed)
+            {
+                m_ring->disarm(socket);
+                m_ring->arm(socket);
+                m_ring->flush();
+            }
+        }
+        return true;
+    }
+#endif
+#ifdef FASTCGIPP_LINUX
+    epoll_event event;
+    event.data.fd = socket;
+    event.events = EPOLLERR | EPOLLHUP;
+    if(in)
+        event.events |= EPOLLIN | EPOLLRDHUP;
+    if(out)
+        event.events |= EPOLLOUT;
+    return epoll_ctl(m_poll, EPOLL_CTL_MOD, socket, &event) != -1;
+#elif defined FASTCGIPP_UNIX
+    const auto fd = std::find_if(
+            m_poll.begin(),
+            m_poll.end(),
+            [&socket] (const pollfd& x)
+            {
+                return x.fd == socket;
+            });
+    if(fd == m_poll.end())
+        return false;
+
+    fd->events = POLLERR | POLLHUP;
+    if(in)
+        fd->events |= POLLIN | POLLRDHUP;
+    if(out)
+        fd->events |= POLLOUT;
+    return true;
+#endif
+}
+
 bool Fastcgipp::Poll::del(const socket_t socket)
 {
+    m_batch.erase(
+            std::remove_if(
+                m_batch.begin()+m_next,
+                m_batch.end(),
+                [&socket] (const Result& x)
+                {
+                    return x.m_socket == socket;
+                }),
+            m_batch.end());
+
+#ifdef FASTCGIPP_IO_URING
+    if(m_ring)
+    {
+        // We submit right away as the socket is usually about to be closed
+        // and the kernel holds on to it until the poll request is gone.
+        std::lock_guard<std::mutex> lock(m_ring->mutex);
+        Ring::Registration* const registration = m_ring->find(socket);
+        if(registration == nullptr)
+        {
+            errno = ENOENT;
+            return false;
+        }
+        if(registration->armed)
+        {
+            m_ring->disarm(socket);
+            m_ring->submit();
+        }
+        registration->events = 0;
+        return true;
+    }
+#endif
 #ifdef FASTCGIPP_LINUX
     return epoll_ctl(m_poll, EPOLL_CTL_DEL, socket, nullptr) != -1;
 #elif defined FASTCGIPP_UNIX
@@ -0,0 +1,392 @@
+/*!
+ * @file       prefork.cpp
+ * @brief      Defines the Prefork class
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 15, 2026
+ * @copyright  Copyright &copy; 2026 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2026 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#include "fastcgi++/prefork.hpp"
+#include "fastcgi++/metrics.hpp"
+#include "fastcgi++/log.hpp"
+
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <sstream>
+#include <iomanip>
+#include <iostream>
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <pthread.h>
+#include <unistd.h>
+
+//! Metrics published by a single child
+/*!
+ * The text is guarded by a sequence lock so readers in other processes never
+ * see it half written. The sequence is odd while it is being written.
+ */
+struct Fastcgipp::Prefork::Slot
+{
+    std::atomic_uint sequence;
+    std::atomic_size_t size;
+
+    char* data()
+    {
+        return reinterpret_cast<char*>(this+1);
+    }
+
+    const char* data() const
+    {
+        return reinterpret_cast<const char*>(this+1);
+    }
+
+    static const size_t capacity = Prefork::slotSize-sizeof(sequence)
+        -sizeof(size);
+
+    //! Read what the child has published
+    /*!
+     * Gives up and returns nothing if the child doesn't finish writing it in
+     * a reasonable amount of time.
+     */
+    std::string read() const
+    {
+        std::string text;
+        for(unsigned attempt=0; attempt<1000; ++attempt)
+        {
+            const unsigned before = sequence.load(std::memory_order_acquire);
+            if(before & 1)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+            text.assign(
+                    data(),
+                    std::min(size.load(std::memory_order_relaxed), capacity));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if(sequence.load(std::memory_order_relaxed) == before)
+                return text;
+        }
+        return std::string();
+    }
+
+    Slot():
+        sequence(0),
+        size(0)
+    {}
+};
+
+const size_t Fastcgipp::Prefork::Slot::capacity;
+
+Fastcgipp::Prefork::Prefork(
+        unsigned processes,
+        std::chrono::milliseconds publishInterval):
+    m_processes(std::max(processes, 1U)),
+    m_publishInterval(publishInterval),
+    m_index(m_processes),
+    m_children(m_processes, 0)
+{
+    void* const memory = mmap(
+            nullptr,
+            slotSize*m_processes,
+            PROT_READ|PROT_WRITE,
+            MAP_SHARED|MAP_ANONYMOUS,
+            -1,
+            0);
+    if(memory == MAP_FAILED)
+        FAIL_LOG("Unable to map memory for prefork metrics: " \
+                << std::strerror(errno))
+    m_slots = static_cast<Slot*>(memory);
+    for(unsigned i=0; i<m_processes; ++i)
+        new(&slot(i)) Slot;
+    sigemptyset(&m_mask);
+}
+
+Fastcgipp::Prefork::~Prefork()
+{
+    munmap(m_slots, slotSize*m_processes);
+}
+
+Fastcgipp::Prefork::Slot& Fastcgipp::Prefork::slot(unsigned index) const
+{
+    return *reinterpret_cast<Slot*>(
+            reinterpret_cast<char*>(m_slots)+index*slotSize);
+}
+
+bool Fastcgipp::Prefork::fork(
+        unsigned index,
+        const std::function<int()>& child)
+{
+    const pid_t pid = ::fork();
+    if(pid < 0)
+    {
+        ERROR_LOG("Unable to fork child process: " << std::strerror(errno))
+        return false;
+    }
+    if(pid > 0)
+    {
+        m_children[index] = pid;
+        return true;
+    }
+
+    m_index = index;
+    pthread_sigmask(SIG_SETMASK, &m_mask, nullptr);
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool done = false;
+    std::thread publisher([&] ()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while(!wake.wait_for(lock, m_publishInterval, [&done] ()
+                {
+                    return done;
+                }))
+            publish();
+    });
+
+    const int status = child();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        done = true;
+    }
+    wake.notify_one();
+    publisher.join();
+    publish();
+
+    // Anything static, the listeners included, belongs to the supervisor so
+    // we leave without destroying it.
+    std::cout.flush();
+    std::cerr.flush();
+    std::clog.flush();
+    std::fflush(nullptr);
+    _exit(status);
+}
+
+int Fastcgipp::Prefork::run(const std::function<int()>& child)
+{
+    typedef std::chrono::steady_clock Clock;
+    const auto never = Clock::time_point::max();
+    const auto patience = std::chrono::seconds(1);
+
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGCHLD);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &signals, &m_mask);
+
+    std::vector<Clock::time_point> started(m_processes);
+    std::vector<Clock::time_point> restarts(m_processes, never);
+    std::vector<bool> failed(m_processes, false);
+    bool stopping = false;
+
+    for(unsigned i=0; i<m_processes; ++i)
+    {
+        started[i] = Clock::now();
+        if(!fork(i, child))
+        {
+            failed[i] = true;
+            restarts[i] = started[i]+patience;
+        }
+    }
+
+    while(true)
+    {
+        const auto next = *std::min_element(restarts.cbegin(), restarts.cend());
+        if(next == never && std::all_of(
+                    m_children.cbegin(),
+                    m_children.cend(),
+                    [] (pid_t pid) { return pid == 0; }))
+            break;
+
+        siginfo_t info;
+        int signal;
+        if(next == never)
+            signal = sigwaitinfo(&signals, &info);
+        else
+        {
+            const auto wait = std::max(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        next-Clock::now()),
+                    std::chrono::nanoseconds(0));
+            timespec timeout;
+            timeout.tv_sec = wait.count()/1000000000;
+            timeout.tv_nsec = wait.count()%1000000000;
+            signal = sigtimedwait(&signals, &info, &timeout);
+        }
+
+        if(signal == SIGINT || signal == SIGTERM || signal == SIGUSR1)
+        {
+            DIAG_LOG("Prefork passing signal " << signal << " on to children")
+            stopping = true;
+            std::fill(restarts.begin(), restarts.end(), never);
+            for(const pid_t pid: m_children)
+                if(pid != 0)
+                    kill(pid, signal==SIGINT ? SIGTERM : signal);
+        }
+
+        int status;
+        pid_t pid;
+        while((pid = waitpid(-1, &status, WNOHANG)) > 0)
+        {
+            const auto child = std::find(
+                    m_children.begin(),
+                    m_children.end(),
+                    pid);
+            if(child == m_children.end())
+                continue;
+            *child = 0;
+            const unsigned i = child-m_children.begin();
+
+            // Whatever the child was in the middle of publishing is lost
+            Slot& published = slot(i);
+            if(published.sequence & 1)
+            {
+                published.size = 0;
+                ++published.sequence;
+            }
+
+            failed[i] = !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+            if(!failed[i])
+                continue;
+
+            if(WIFSIGNALED(status))
+                ERROR_LOG("Child process " << pid << " killed by signal " \
+                        << WTERMSIG(status))
+            else
+                ERROR_LOG("Child process " << pid << " exited with status " \
+                        << WEXITSTATUS(status))
+            if(!stopping)
+                restarts[i] = std::max(Clock::now(), started[i]+patience);
+        }
+
+        for(unsigned i=0; i<m_processes; ++i)
+            if(restarts[i] <= Clock::now())
+            {
+                restarts[i] = never;
+                started[i] = Clock::now();
+                if(fork(i, child))
+                    WARNING_LOG("Restarted child process " << i)
+                else
+                    restarts[i] = started[i]+patience;
+            }
+    }
+
+    pthread_sigmask(SIG_SETMASK, &m_mask, nullptr);
+    return std::any_of(
+            failed.cbegin(),
+            failed.cend(),
+            [] (bool x) { return x; }) ? 1 : 0;
+}
+
+void Fastcgipp::Prefork::publish()
+{
+    if(m_index >= m_processes)
+        return;
+
+    std::ostringstream stream;
+    Metrics::write(stream);
+    std::string text = stream.str();
+    if(text.size() > Slot::capacity)
+        text.resize(text.rfind('\n', Slot::capacity-1)+1);
+
+    static std::mutex mutex;
+    std::lock_guard<std::mutex> lock(mutex);
+    Slot& published = slot(m_index);
+    const unsigned sequence = published.sequence.load(
+            std::memory_order_relaxed);
+    published.sequence.store(sequence+1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(published.data(), text.data(), text.size());
+    published.size.store(text.size(), std::memory_order_relaxed);
+    published.sequence.store(sequence+2, std::memory_order_release);
+}
+
+void Fastcgipp::Prefork::write(std::ostream& stream) const
+{
+    // Comment lines and series in the order they were first seen
+    std::vector<std::string> order;
+    std::set<std::string> comments;
+    std::map<std::string, double> sums;
+
+    for(unsigned i=0; i<m_processes; ++i)
+    {
+        std::string text;
+        if(i == m_index)
+        {
+            std::ostringstream current;
+            Metrics::write(current);
+            text = current.str();
+        }
+        else
+            text = slot(i).read();
+
+        std::istringstream lines(text);
+        std::string line;
+        while(std::getline(lines, line))
+        {
+            if(line.empty())
+                continue;
+            if(line[0] == '#')
+            {
+                if(comments.insert(line).second)
+                    order.push_back(line);
+                continue;
+            }
+            const size_t space = line.rfind(' ');
+            if(space == std::string::npos)
+                continue;
+            const double value = std::strtod(line.c_str()+space+1, nullptr);
+            const auto sum = sums.emplace(line.substr(0, space), value);
+            if(sum.second)
+                order.push_back(sum.first->first);
+            else
+                sum.first->second += value;
+        }
+    }
+
+    for(const auto& line: order)
+    {
+        if(line[0] == '#')
+        {
+            stream << line << '\n';
+            continue;
+        }
+        const double value = sums[line];
+        std::ostringstream formatted;
+        if(value == static_cast<double>(static_cast<long long>(value)))
+            formatted << static_cast<long long>(value);
+        else
+            formatted << std::setprecision(15) << value;
+        stream << line << ' ' << formatted.str() << '\n';
+    }
+}
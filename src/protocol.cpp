@@ -29,6 +29,8 @@
 #include "fastcgi++/protocol.hpp"
 #include "fastcgi++/config.hpp"
 
+#include <algorithm>
+
 bool Fastcgipp::Protocol::processParamHeader(
         const char* data,
         const char* const dataEnd,
@@ -79,15 +81,6 @@ bool Fastcgipp::Protocol::processParamHeader(
         return true;
 }
 
-const Fastcgipp::Protocol::ManagementReply<14, 2>
-Fastcgipp::Protocol::maxConnsReply("FCGI_MAX_CONNS", "10");
-
-const Fastcgipp::Protocol::ManagementReply<13, 2>
-Fastcgipp::Protocol::maxReqsReply("FCGI_MAX_REQS", "50");
-
-const Fastcgipp::Protocol::ManagementReply<15, 1>
-Fastcgipp::Protocol::mpxsConnsReply("FCGI_MPXS_CONNS", "1");
-
 const char Fastcgipp::version[]=FASTCGIPP_VERSION;
 
 size_t Fastcgipp::Protocol::getRecordSize(size_t contentLength)
@@ -100,3 +93,46 @@ size_t Fastcgipp::Protocol::getRecordSize(size_t contentLength)
 
     return recordSize;
 }
+
+namespace
+{
+    //! Largest content length that keeps records aligned
+    const size_t maxAlignedContent
+        = 0xffff & ~size_t(Fastcgipp::Protocol::chunkSize-1);
+}
+
+size_t Fastcgipp::Protocol::getRecordsSize(size_t contentLength)
+{
+    const size_t full = contentLength/maxAlignedContent;
+    const size_t rest = contentLength%maxAlignedContent;
+    return full*(sizeof(Header)+maxAlignedContent)
+        + (rest ? getRecordSize(rest) : 0);
+}
+
+char* Fastcgipp::Protocol::encodeRecords(
+        RecordType type,
+        FcgiId fcgiId,
+        const char* content,
+        size_t contentLength,
+        char* records)
+{
+    for(const char* const end=content+contentLength; content != end;)
+    {
+        const size_t length = std::min(size_t(end-content), maxAlignedContent);
+        const size_t recordSize = getRecordSize(length);
+        Header& header = *reinterpret_cast<Header*>(records);
+        header.version = version;
+        header.type = type;
+        header.fcgiId = fcgiId;
+        header.contentLength = length;
+        header.paddingLength = recordSize-length-sizeof(header);
+        header.reserved = 0;
+        std::fill(
+                std::copy(content, content+length, records+sizeof(header)),
+                records+recordSize,
+                0);
+        content += length;
+        records += recordSize;
+    }
+    return records;
+}
@@ -0,0 +1,114 @@
+/*!
+ * @file       ratelimiter.cpp
+ * @brief      Defines the RateLimiter class
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 15, 2026
+ * @copyright  Copyright &copy; 2026 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2026 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#include "fastcgi++/ratelimiter.hpp"
+
+#include <algorithm>
+#include <limits>
+
+namespace
+{
+    //! Smallest power of two that is at least x
+    size_t powerOfTwo(size_t x)
+    {
+        size_t power = 1;
+        while(power < x)
+            power <<= 1;
+        return power;
+    }
+}
+
+Fastcgipp::RateLimiter::RateLimiter(
+        double rate,
+        unsigned burst,
+        size_t cells):
+    m_interval(std::chrono::duration_cast<Clock::duration>(
+                std::chrono::duration<double>(1/rate))),
+    m_tolerance(m_interval*(std::max(burst, 1u)-1)),
+    m_mask(powerOfTwo(std::max(cells, size_t(2)))-1),
+    m_cells(new std::atomic<Clock::rep>[m_mask+1])
+{
+    clear();
+}
+
+bool Fastcgipp::RateLimiter::admit(
+        size_t key,
+        Clock::time_point now,
+        Clock::duration* retryAfter)
+{
+    // Keys like integers often hash to themselves so they get mixed before
+    // picking cells with either half.
+    std::uint64_t mixed = static_cast<std::uint64_t>(key)
+        * 0x9e3779b97f4a7c15ULL;
+    mixed ^= mixed >> 29;
+    std::atomic<Clock::rep>* first = &m_cells[mixed & m_mask];
+    std::atomic<Clock::rep>* second = &m_cells[(mixed >> 32) & m_mask];
+
+    Clock::rep earliest = first->load(std::memory_order_relaxed);
+    Clock::rep other = second->load(std::memory_order_relaxed);
+    if(other < earliest)
+    {
+        std::swap(first, second);
+        std::swap(earliest, other);
+    }
+
+    const Clock::rep time = now.time_since_epoch().count();
+    Clock::rep arrival;
+    do
+    {
+        const Clock::rep start = std::max(earliest, time);
+        if(start-time > m_tolerance.count())
+        {
+            if(retryAfter != nullptr)
+                *retryAfter = Clock::duration(
+                        start-time-m_tolerance.count());
+            return false;
+        }
+        arrival = start+m_interval.count();
+    } while(!first->compare_exchange_weak(
+                earliest,
+                arrival,
+                std::memory_order_relaxed));
+
+    // The other cell is only ever moved forward so clients it is shared
+    // with aren't charged twice
+    while(other < arrival && !second->compare_exchange_weak(
+                other,
+                arrival,
+                std::memory_order_relaxed));
+
+    return true;
+}
+
+void Fastcgipp::RateLimiter::clear()
+{
+    for(size_t i=0; i<=m_mask; ++i)
+        m_cells[i].store(
+                std::numeric_limits<Clock::rep>::min(),
+                std::memory_order_relaxed);
+}
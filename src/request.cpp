@@ -29,15 +29,210 @@
 #include "fastcgi++/request.hpp"
 #include "fastcgi++/log.hpp"
 
-template<class charT> void Fastcgipp::Request<charT>::complete()
+#include <algorithm>
+#include <cctype>
+#include <codecvt>
+#include <cstring>
+#include <locale>
+#include <map>
+
+std::atomic_ullong Fastcgipp::Request_base::s_serials(0);
+
+namespace
+{
+    //! What to look up entries in a ResponseCache or AuthorizationCache with
+    inline const std::string& cacheKey(const std::string& uri)
+    {
+        return uri;
+    }
+
+    inline std::string cacheKey(const std::wstring& uri)
+    {
+        try
+        {
+            std::wstring_convert<std::codecvt_utf8<wchar_t>, wchar_t>
+                converter;
+            return converter.to_bytes(uri);
+        }
+        catch(const std::range_error&)
+        {
+            WARNING_LOG("Error in code conversion to utf8 in cache key")
+            return std::string();
+        }
+    }
+
+    typedef std::map<std::string, std::locale> Locales;
+
+    //! Every locale built so far. This is replaced rather than modified.
+    std::shared_ptr<const Locales> locales(std::make_shared<Locales>());
+
+    //! Thread safe locales
+    std::mutex localesMutex;
+
+    //! The calling thread's copy of locales
+    thread_local std::shared_ptr<const Locales> threadLocales;
+
+    //! Get a locale by name, building it only the first time around
+    /*!
+     * Locales that can't be built are logged once and replaced with the
+     * classic "C" locale. The returned reference is valid until the next
+     * call from the same thread.
+     */
+    const std::locale& cachedLocale(const std::string& name)
+    {
+        if(threadLocales)
+        {
+            const auto locale = threadLocales->find(name);
+            if(locale != threadLocales->end())
+                return locale->second;
+        }
+
+        std::lock_guard<std::mutex> lock(localesMutex);
+        if(locales->find(name) == locales->end())
+        {
+            const auto updated = std::make_shared<Locales>(*locales);
+            try
+            {
+                updated->emplace(name, std::locale(name));
+            }
+            catch(...)
+            {
+                ERROR_LOG("Unable to set locale " << name.c_str())
+                updated->emplace(name, std::locale::classic());
+            }
+            locales = updated;
+        }
+        threadLocales = locales;
+        return threadLocales->find(name)->second;
+    }
+
+    //! Does a header line start with a lower case name and colon?
+    bool named(const char* line, const char* lineEnd, const char* name)
+    {
+        const size_t size = std::strlen(name);
+        return size_t(lineEnd-line) >= size && std::equal(
+                name,
+                name+size,
+                line,
+                [] (char x, char y)
+                {
+                    return x == std::tolower(static_cast<unsigned char>(y));
+                });
+    }
+
+    //! Call a function with each header line in a response's first record
+    /*!
+     * @param[in] begin Start of the OUT records holding the response
+     * @param[in] end End of the OUT records
+     * @param[in] visit Called with the start and line break of each line.
+     *                  Returning false stops the walk.
+     */
+    template<class Visit>
+    void headerLines(const char* begin, const char* end, Visit visit)
+    {
+        if(end-begin < ptrdiff_t(sizeof(Fastcgipp::Protocol::Header)))
+            return;
+        const auto& header
+            = *reinterpret_cast<const Fastcgipp::Protocol::Header*>(begin);
+
+        const char* line = begin+sizeof(header);
+        end = std::min(end, line+header.contentLength);
+        while(line < end && *line != '\r' && *line != '\n')
+        {
+            const char* const lineEnd = std::find(line, end, '\n');
+            if(!visit(line, lineEnd))
+                break;
+            line = lineEnd+1;
+        }
+    }
+
+    //! Is an authorizer's response a decision that can be cached?
+    /*!
+     * Decisions are responses with a 200, 401 or 403 status. A response
+     * without a Status header in it's first record counts as a 200.
+     *
+     * @param[in] begin Start of the OUT records holding the response
+     * @param[in] end End of the OUT records
+     */
+    bool decision(const char* begin, const char* end)
+    {
+        static const char status[] = "status:";
+        bool decided = true;
+        headerLines(begin, end, [&] (const char* line, const char* lineEnd)
+        {
+            if(!named(line, lineEnd, status))
+                return true;
+            const char* code = line+sizeof(status)-1;
+            while(code < lineEnd && *code == ' ')
+                ++code;
+            const std::string value(code, std::min(code+3, lineEnd));
+            decided = value == "200" || value == "401" || value == "403";
+            return false;
+        });
+        return decided;
+    }
+
+    //! The header lines of a response a 304 Not Modified must repeat
+    /*!
+     * @param[in] begin Start of the OUT records holding the response
+     * @param[in] end End of the OUT records
+     */
+    std::string validators(const char* begin, const char* end)
+    {
+        static const char* const names[] = {
+            "etag:",
+            "vary:",
+            "cache-control:",
+            "expires:",
+            "content-location:"
+        };
+        std::string lines;
+        headerLines(begin, end, [&] (const char* line, const char* lineEnd)
+        {
+            for(const char* name: names)
+                if(named(line, lineEnd, name))
+                {
+                    lines.append(line, lineEnd);
+                    lines += '\n';
+                    break;
+                }
+            return true;
+        });
+        return lines;
+    }
+
+    //! Is the request something a response can be cached for?
+    inline bool cacheable(Fastcgipp::Http::RequestMethod method)
+    {
+        return method == Fastcgipp::Http::RequestMethod::GET
+            || method == Fastcgipp::Http::RequestMethod::HEAD;
+    }
+}
+
+template<class charT, class Containers>
+void Fastcgipp::Request<charT, Containers>::complete(bool responded)
 {
-    out.flush();
+    Metrics::requestTime.since(m_began);
+    if(m_deadline)
+    {
+        m_timers->cancel(m_deadline);
+        m_deadline = 0;
+    }
+    if(m_cached.size() != 0)
+    {
+        err.flush();
+        m_send(m_id.m_socket, std::move(m_cached), m_kill);
+        return;
+    }
+    m_outStreamBuffer.finish();
+    Block record(m_outStreamBuffer.takeCorked());
     err.flush();
 
-    Block record(sizeof(Protocol::Header)+sizeof(Protocol::EndRequest));
+    const size_t offset = record.size();
+    record.size(offset+sizeof(Protocol::Header)+sizeof(Protocol::EndRequest));
 
     Protocol::Header& header
-        = *reinterpret_cast<Protocol::Header*>(record.begin());
+        = *reinterpret_cast<Protocol::Header*>(record.begin()+offset);
     header.version = Protocol::version;
     header.type = Protocol::RecordType::END_REQUEST;
     header.fcgiId = m_id.m_id;
@@ -45,15 +240,48 @@ template<class charT> void Fastcgipp::Request<charT>::complete()
     header.paddingLength = 0;
 
     Protocol::EndRequest& body =
-        *reinterpret_cast<Protocol::EndRequest*>(record.begin()+sizeof(header));
+        *reinterpret_cast<Protocol::EndRequest*>(
+                record.begin()+offset+sizeof(header));
     body.appStatus = 0;
     body.protocolStatus = m_status;
 
+    if(m_cache || m_authorizations)
+    {
+        if(responded
+                && m_status == Protocol::ProtocolStatus::REQUEST_COMPLETE
+                && !m_outStreamBuffer.sent())
+        {
+            auto entry = std::make_shared<ResponseCache::Entry>(m_cacheEntry);
+            entry->records = BlockPool::share(record.size());
+            std::copy(record.begin(), record.end(), entry->records.get());
+            entry->size = record.size();
+            entry->fcgiId = m_id.m_id;
+            if(m_authorizations)
+            {
+                if(decision(record.begin(), record.begin()+offset))
+                    m_authorizations->insert(
+                            m_authorization,
+                            m_authorizationVariant,
+                            std::move(entry));
+            }
+            else if(!m_cacheUri.empty())
+            {
+                entry->validators = validators(
+                        record.begin(),
+                        record.begin()+offset);
+                m_cache->insert(m_cacheUri, m_cacheVariant, std::move(entry));
+            }
+        }
+        m_outStreamBuffer.cork(m_cacheCorked);
+        m_cache = nullptr;
+        m_authorizations = nullptr;
+    }
+
     m_send(m_id.m_socket, std::move(record), m_kill);
 }
 
-template<class charT>
-std::unique_lock<std::mutex>Fastcgipp::Request<charT>::handler()
+template<class charT, class Containers>
+std::unique_lock<std::mutex>Fastcgipp::Request<charT, Containers>::handler()
 {
     std::unique_lock<std::mutex> lock(m_messagesMutex);
     while(!m_messages.empty())
@@ -62,113 +290,189 @@ std::unique_lock<std::mutex>Fastcgipp::Request<charT>::handler()
         m_messages.pop();
         lock.unlock();
 
-        if(message.type == 0)
+        if(handle(std::move(message)))
+            break;
+        lock.lock();
+    }
+    return lock;
+}
+
+template<class charT, class Containers>
+bool Fastcgipp::Request<charT, Containers>::handle(Message&& message)
+{
+    if(message.type == deadlineType)
+    {
+        // It could be for an earlier request with our ID
+        const auto serial = message.payload<unsigned long long>();
+        if(serial == nullptr || *serial != m_serial)
+            return false;
+        m_deadline = 0;
+        ++Metrics::requestTimeouts;
+        WARNING_LOG("Request " << m_id.m_id << " ran past it's deadline")
+        timeoutHandler();
+        complete();
+        return true;
+    }
+
+    if(message.type == 0)
+    {
+        const Protocol::Header& header =
+            *reinterpret_cast<Protocol::Header*>(message.data.begin());
+        const auto body = message.data.begin()+sizeof(header);
+        const auto bodyEnd = body+header.contentLength;
+
+        if(header.type == Protocol::RecordType::ABORT_REQUEST)
         {
-            const Protocol::Header& header =
-                *reinterpret_cast<Protocol::Header*>(message.data.begin());
-            const auto body = message.data.begin()+sizeof(header);
-            const auto bodyEnd = body+header.contentLength;
+            complete();
+            return true;
+        }
 
-            if(header.type == Protocol::RecordType::ABORT_REQUEST)
-            {
-                complete();
-                goto exit;
-            }
+        if(m_early
+                && header.type == Protocol::RecordType::IN
+                && header.contentLength == 0)
+        {
+            m_early = false;
+            return false;
+        }
 
-            if(header.type != m_state)
-            {
-                WARNING_LOG("Records received out of order from web server")
-                errorHandler();
-                complete();
-                goto exit;
-            }
+        if(header.type != m_state)
+        {
+            WARNING_LOG("Records received out of order from web server")
+            errorHandler();
+            complete();
+            return true;
+        }
 
-            switch(m_state)
+        switch(m_state)
+        {
+            case Protocol::RecordType::PARAMS:
             {
-                case Protocol::RecordType::PARAMS:
+                if(!(
+                            role()==Protocol::Role::RESPONDER
+                            || role()==Protocol::Role::AUTHORIZER
+                            || role()==Protocol::Role::FILTER))
                 {
-                    if(!(
-                                role()==Protocol::Role::RESPONDER
-                                || role()==Protocol::Role::AUTHORIZER))
+                    m_status = Protocol::ProtocolStatus::UNKNOWN_ROLE;
+                    WARNING_LOG("We got asked to do an unknown role")
+                    errorHandler();
+                    complete();
+                    return true;
+                }
+
+                if(header.contentLength == 0)
+                {
+                    if(!admitted())
                     {
-                        m_status = Protocol::ProtocolStatus::UNKNOWN_ROLE;
-                        WARNING_LOG("We got asked to do an unknown role")
-                        errorHandler();
                         complete();
-                        goto exit;
+                        return true;
                     }
-
-                    if(header.contentLength == 0)
+                    if(environment().contentLength > m_maxPostSize)
                     {
-                        if(environment().contentLength > m_maxPostSize)
-                        {
-                            bigPostErrorHandler();
-                            complete();
-                            goto exit;
-                        }
-                        m_state = Protocol::RecordType::IN;
-                        lock.lock();
-                        continue;
+                        bigPostErrorHandler();
+                        complete();
+                        return true;
                     }
-                    m_environment.fill(body,  bodyEnd);
-                    lock.lock();
-                    continue;
-                }
-
-                case Protocol::RecordType::IN:
-                {
-                    if(header.contentLength==0)
+                    Metrics::paramsTime.since(m_phase);
+                    m_phase = Metrics::timestamp();
+                    if(environment().contentLength == 0
+                            && role() != Protocol::Role::FILTER
+                            && earlyDispatch())
                     {
-                        if(!inProcessor() && !m_environment.parsePostBuffer())
-                        {
-                            WARNING_LOG("Unknown content type from client")
-                            unknownContentErrorHandler();
-                            complete();
-                            goto exit;
-                        }
-
-                        m_environment.clearPostBuffer();
                         m_state = Protocol::RecordType::OUT;
+                        m_early = true;
                         break;
                     }
+                    m_state = Protocol::RecordType::IN;
+                    return false;
+                }
+                m_environment.fill(body,  bodyEnd);
+                return false;
+            }
 
-                    if(m_environment.postBuffer().size()+(bodyEnd-body)
-                            > environment().contentLength)
+            case Protocol::RecordType::IN:
+            {
+                if(header.contentLength==0)
+                {
+                    if(!inProcessor() && !m_environment.parsePostBuffer())
                     {
-                        bigPostErrorHandler();
+                        WARNING_LOG("Unknown content type from client")
+                        unknownContentErrorHandler();
                         complete();
-                        goto exit;
+                        return true;
                     }
 
-                    m_environment.fillPostBuffer(body, bodyEnd);
-                    inHandler(header.contentLength);
-                    lock.lock();
-                    continue;
+                    m_environment.clearPostBuffer();
+                    Metrics::inTime.since(m_phase);
+                    if(role() == Protocol::Role::FILTER)
+                    {
+                        m_state = Protocol::RecordType::DATA;
+                        return false;
+                    }
+                    m_state = Protocol::RecordType::OUT;
+                    break;
                 }
 
-                default:
+                if(m_environment.postSize()+(bodyEnd-body)
+                        > environment().contentLength)
                 {
-                    ERROR_LOG("Our request is in a weird state.")
-                    errorHandler();
+                    bigPostErrorHandler();
                     complete();
-                    goto exit;
+                    return true;
                 }
+
+                m_environment.fillPostBuffer(body, bodyEnd);
+                inHandler(header.contentLength);
+                return false;
             }
-        }
 
-        m_message = std::move(message);
-        if(response())
-        {
-            complete();
-            break;
+            case Protocol::RecordType::DATA:
+            {
+                if(header.contentLength==0)
+                {
+                    m_state = Protocol::RecordType::OUT;
+                    break;
+                }
+
+                dataHandler(body, header.contentLength);
+                return false;
+            }
+
+            default:
+            {
+                ERROR_LOG("Our request is in a weird state.")
+                errorHandler();
+                complete();
+                return true;
+            }
         }
-        lock.lock();
     }
-exit:
-    return lock;
+
+    // Only the record that ends the input gets us here as a FastCGI message
+    if(message.type == 0
+            && role() == Protocol::Role::AUTHORIZER
+            && authorized())
+    {
+        complete();
+        return true;
+    }
+
+    m_message = std::move(message);
+    const Metrics::Clock::time_point start = Metrics::timestamp();
+    const bool finished = response();
+    Metrics::responseTime.since(start);
+    if(finished)
+    {
+        if(m_topic)
+            handOff();
+        else
+            complete(true);
+        return true;
+    }
+    return false;
 }
 
-template<class charT> void Fastcgipp::Request<charT>::errorHandler()
+template<class charT, class Containers>
+void Fastcgipp::Request<charT, Containers>::errorHandler()
 {
     out << \
 "Status: 500 Internal Server Error\n"\
@@ -184,7 +488,8 @@ template<class charT> void Fastcgipp::Request<charT>::errorHandler()
 "</html>";
 }
 
-template<class charT> void Fastcgipp::Request<charT>::bigPostErrorHandler()
+template<class charT, class Containers>
+void Fastcgipp::Request<charT, Containers>::bigPostErrorHandler()
 {
         out << \
 "Status: 413 Request Entity Too Large\n"\
@@ -200,7 +505,44 @@ template<class charT> void Fastcgipp::Request<charT>::bigPostErrorHandler()
 "</html>";
 }
 
-template<class charT> void Fastcgipp::Request<charT>::unknownContentErrorHandler()
+template<class charT, class Containers>
+void Fastcgipp::Request<charT, Containers>::timeoutHandler()
+{
+        out << \
+"Status: 504 Gateway Timeout\n"\
+"Content-Type: text/html; charset=utf-8\r\n\r\n"\
+"<!DOCTYPE html>"\
+"<html lang='en'>"\
+    "<head>"\
+        "<title>504 Gateway Timeout</title>"\
+    "</head>"\
+    "<body>"\
+        "<h1>504 Gateway Timeout</h1>"\
+    "</body>"\
+"</html>";
+}
+
+template<class charT, class Containers>
+void Fastcgipp::Request<charT, Containers>::rateLimitErrorHandler(
+        unsigned retryAfter)
+{
+        out << \
+"Status: 429 Too Many Requests\n"\
+"Retry-After: " << retryAfter << "\n"\
+"Content-Type: text/html; charset=utf-8\r\n\r\n"\
+"<!DOCTYPE html>"\
+"<html lang='en'>"\
+    "<head>"\
+        "<title>429 Too Many Requests</title>"\
+    "</head>"\
+    "<body>"\
+        "<h1>429 Too Many Requests</h1>"\
+    "</body>"\
+"</html>";
+}
+
+template<class charT, class Containers>
+void Fastcgipp::Request<charT, Containers>::unknownContentErrorHandler()
 {
         out << \
 "Status: 415 Unsupported Media Type\n"\
@@ -216,11 +558,18 @@ template<class charT> void Fastcgipp::Request<charT>::unknownContentErrorHandler
 "</html>";
 }
 
-template<class charT> void Fastcgipp::Request<charT>::configure(
+template<class charT, class Containers>
+void Fastcgipp::Request<charT, Containers>::configure(
         const Protocol::RequestId& id,
         const Protocol::Role& role,
         bool kill,
         const std::function<void(const Socket&, Block&&, bool)> send,
+        const std::function<void(
+            const Socket&,
+            Block&&,
+            const std::shared_ptr<const int>&,
+            off_t,
+            size_t)> sendFile,
         const std::function<void(Message)> callback)
 {
     using namespace std::placeholders;
@@ -230,22 +579,107 @@ template<class charT> void Fastcgipp::Request<charT>::configure(
     m_role=role;
     m_callback=callback;
     m_send=send;
+    m_began = m_phase = Metrics::timestamp();
 
     m_outStreamBuffer.configure(
             id,
             Protocol::RecordType::OUT,
-            std::bind(send, _1, _2, false));
+            std::bind(send, _1, _2, false),
+            sendFile);
     m_errStreamBuffer.configure(
             id,
             Protocol::RecordType::ERR,
-            std::bind(send, _1, _2, false));
+            std::bind(send, _1, _2, false),
+            sendFile);
 }
 
-template<class charT> unsigned Fastcgipp::Request<charT>::pickLocale(
+template<class charT, class Containers>
+void Fastcgipp::Request<charT, Containers>::configure(
+        const Protocol::RequestId& id,
+        const Protocol::Role& role,
+        bool kill,
+        const std::function<void(Message)> callback)
+{
+    m_kill=kill;
+    m_id=id;
+    m_role=role;
+    m_callback=callback;
+    m_began = m_phase = Metrics::timestamp();
+
+    m_outStreamBuffer.configure(id);
+    m_errStreamBuffer.configure(id);
+}
+
+template<class charT, class Containers>
+void Fastcgipp::Request<charT, Containers>::deadline(
+        Timers& timers,
+        std::chrono::milliseconds timeout)
+{
+    m_timers = &timers;
+    m_serial = ++s_serials;
+    if(!timeout.count())
+        return;
+
+    const auto callback = m_callback;
+    const auto serial = m_serial;
+    m_deadline = timers.add(timeout, [callback, serial] ()
+            {
+                Message message(deadlineType);
+                message.emplace<unsigned long long>(serial);
+                callback(std::move(message));
+            });
+}
+
+template<class charT, class Containers>
+Fastcgipp::Timers::Id Fastcgipp::Request<charT, Containers>::delay(
+        Timers::Clock::duration delay,
+        Message&& message)
+{
+    if(m_timers == nullptr)
+        return 0;
+
+    const auto callback = m_callback;
+    const auto delayed = std::make_shared<Message>(std::move(message));
+    return m_timers->add(delay, [callback, delayed] ()
+            {
+                callback(std::move(*delayed));
+            });
+}
+
+template<class charT, class Containers>
+void Fastcgipp::Request<charT, Containers>::reset()
+{
+    m_environment.clear();
+    m_message = Message();
+    m_state = Protocol::RecordType::PARAMS;
+    m_early = false;
+    m_status = Protocol::ProtocolStatus::REQUEST_COMPLETE;
+    m_id = Protocol::RequestId();
+    m_callback = nullptr;
+    m_deadline = 0;
+    m_topic = nullptr;
+    m_outStreamBuffer.configure(m_id);
+    m_errStreamBuffer.configure(m_id);
+
+    for(auto stream: {&out, &err})
+    {
+        stream->clear();
+        stream->flags(std::ios_base::skipws | std::ios_base::dec);
+        stream->width(0);
+        stream->precision(6);
+        stream->fill(stream->widen(' '));
+        if(stream->getloc() != std::locale::classic())
+            stream->imbue(std::locale::classic());
+    }
+}
+
+template<class charT, class Containers>
+unsigned Fastcgipp::Request<charT, Containers>::pickLocale(
         const std::vector<std::string>& locales)
 {
     unsigned index=0;
 
+    m_environment.parse("HTTP_ACCEPT_LANGUAGE");
     for(const std::string& language: environment().acceptLanguages)
     {
         if(language.size() <= 5)
@@ -272,28 +706,280 @@ template<class charT> unsigned Fastcgipp::Request<charT>::pickLocale(
     return index;
 }
 
-template<class charT> void Fastcgipp::Request<charT>::setLocale(
-        const std::string& locale)
+template<class charT, class Containers>
+Fastcgipp::Compression Fastcgipp::Request<charT, Containers>::compress()
+{
+    m_environment.parse("HTTP_ACCEPT_ENCODING");
+    return compress(Compressor::negotiate(environment().acceptEncodings));
+}
+
+template<class charT, class Containers>
+Fastcgipp::Compression Fastcgipp::Request<charT, Containers>::compress(
+        Compression compression)
+{
+    if(!Compressor::supported(compression))
+        compression = Compression::NONE;
+    if(compression != Compression::NONE)
+        out << "Content-Encoding: " << Compressor::name(compression) << "\r\n";
+    out << "Vary: Accept-Encoding\r\n\r\n";
+    if(compression != Compression::NONE)
+        m_outStreamBuffer.compress(compression);
+    return compression;
+}
+
+template<class charT, class Containers>
+Fastcgipp::Compression Fastcgipp::Request<charT, Containers>::precompressed(
+        std::initializer_list<Compression> available)
+{
+    m_environment.parse("HTTP_ACCEPT_ENCODING");
+    const Compression compression = Compressor::negotiate(
+            environment().acceptEncodings,
+            available);
+    if(compression != Compression::NONE)
+        out << "Content-Encoding: " << Compressor::name(compression) << "\r\n";
+    out << "Vary: Accept-Encoding\r\n\r\n";
+    return compression;
+}
+
+template<class charT, class Containers>
+bool Fastcgipp::Request<charT, Containers>::cached(
+        ResponseCache& cache,
+        const std::string& variant)
+{
+    if(!cacheable(environment().requestMethod))
+        return false;
+
+    m_environment.parse("REQUEST_URI");
+    const auto entry = cache.find(
+            cacheKey(environment().requestUri),
+            variant);
+    if(!entry)
+    {
+        ++Metrics::responseCacheMisses;
+        return false;
+    }
+
+    m_environment.parse("HTTP_IF_NONE_MATCH");
+    m_environment.parse("HTTP_IF_MODIFIED_SINCE");
+    const bool unchanged = environment().etag != 0
+        ? entry->etag == environment().etag
+        : environment().ifModifiedSince != 0
+            && entry->lastModified != 0
+            && entry->lastModified <= environment().ifModifiedSince;
+    if(unchanged)
+    {
+        ++Metrics::responseCacheNotModified;
+        notModified(*entry);
+        return true;
+    }
+
+    ++Metrics::responseCacheHits;
+    serve(*entry);
+    return true;
+}
+
+template<class charT, class Containers>
+bool Fastcgipp::Request<charT, Containers>::asset(const AssetCache& assets)
+{
+    if(!cacheable(environment().requestMethod))
+        return false;
+
+    m_environment.parse("REQUEST_URI");
+    std::string path(cacheKey(environment().requestUri));
+    const size_t query = path.find('?');
+    if(query != std::string::npos)
+        path.resize(query);
+    const auto asset = assets.find(path);
+    if(!asset)
+    {
+        ++Metrics::assetMisses;
+        return false;
+    }
+
+    m_environment.parse("HTTP_IF_NONE_MATCH");
+    m_environment.parse("HTTP_IF_MODIFIED_SINCE");
+    m_environment.parse("HTTP_ACCEPT_ENCODING");
+    const ResponseCache::Entry& entry = asset->response(
+            Compressor::negotiate(environment().acceptEncodings));
+    const bool unchanged = environment().etag != 0
+        ? entry.etag == environment().etag
+        : environment().ifModifiedSince != 0
+            && entry.lastModified != 0
+            && entry.lastModified <= environment().ifModifiedSince;
+    if(unchanged)
+    {
+        ++Metrics::assetNotModified;
+        notModified(entry);
+        return true;
+    }
+
+    ++Metrics::assetHits;
+    serve(entry);
+    return true;
+}
+
+template<class charT, class Containers>
+void Fastcgipp::Request<charT, Containers>::notModified(
+        const ResponseCache::Entry& entry)
+{
+    std::string header("Status: 304 Not Modified\r\n");
+    header += entry.validators;
+    header += "\r\n";
+    dump(header.data(), header.size());
+}
+
+template<class charT, class Containers>
+void Fastcgipp::Request<charT, Containers>::handOff()
 {
-    try
+    Metrics::requestTime.since(m_began);
+    if(m_deadline)
     {
-        out.imbue(std::locale(locale+codepage()));
+        m_timers->cancel(m_deadline);
+        m_deadline = 0;
     }
-    catch(...)
+    m_outStreamBuffer.finish();
+    Block records(m_outStreamBuffer.takeCorked());
+    err.flush();
+    if(m_cache || m_authorizations)
     {
-        ERROR_LOG("Unable to set locale")
-        out.imbue(std::locale("C"));
+        m_outStreamBuffer.cork(m_cacheCorked);
+        m_cache = nullptr;
+        m_authorizations = nullptr;
     }
+    if(records.size() != 0)
+        m_send(m_id.m_socket, std::move(records), false);
+
+    m_topic->subscribe(Topic::Subscriber{m_id, m_kill, m_send});
+    m_topic = nullptr;
+}
+
+template<class charT, class Containers>
+void Fastcgipp::Request<charT, Containers>::serve(
+        const ResponseCache::Entry& entry)
+{
+    if(entry.fcgiId == m_id.m_id)
+        m_cached = Block(entry.records, entry.records.get(), entry.size);
+    else
+    {
+        m_cached = Block(entry.records.get(), entry.size);
+        char* record = m_cached.begin();
+        while(record < m_cached.end())
+        {
+            Protocol::Header& header
+                = *reinterpret_cast<Protocol::Header*>(record);
+            header.fcgiId = m_id.m_id;
+            record += sizeof(header)+header.contentLength
+                +header.paddingLength;
+        }
+    }
+}
+
+template<class charT, class Containers>
+bool Fastcgipp::Request<charT, Containers>::admitted()
+{
+    RateLimiter* const limiter = rateLimiter();
+    if(limiter == nullptr)
+        return true;
+
+    RateLimiter::Clock::duration wait;
+    if(limiter->admit(rateLimitKey(), RateLimiter::Clock::now(), &wait))
+        return true;
+
+    ++Metrics::rateLimitRejections;
+    rateLimitErrorHandler(unsigned(
+                std::chrono::duration_cast<std::chrono::seconds>(wait).count()
+                +1));
+    return false;
+}
+
+template<class charT, class Containers>
+bool Fastcgipp::Request<charT, Containers>::authorized()
+{
+    AuthorizationCache* const cache = authorizationCache();
+    if(cache == nullptr)
+        return false;
+
+    m_environment.parse("HTTP_AUTHORIZATION");
+    std::string authorization(cacheKey(environment().authorization));
+    std::string variant(authorizationVariant());
+    const auto entry = cache->find(authorization, variant);
+    if(entry)
+    {
+        ++Metrics::authorizationCacheHits;
+        serve(*entry);
+        return true;
+    }
+
+    ++Metrics::authorizationCacheMisses;
+    m_cacheCorked = m_outStreamBuffer.corked();
+    m_authorizations = cache;
+    m_authorization = std::move(authorization);
+    m_authorizationVariant = std::move(variant);
+    m_cacheEntry.etag = 0;
+    m_cacheEntry.lastModified = 0;
+    m_cacheEntry.expires = AuthorizationCache::Clock::now()+cache->ttl();
+    m_outStreamBuffer.cork(true);
+    return false;
+}
+
+template<class charT, class Containers>
+void Fastcgipp::Request<charT, Containers>::cache(
+        ResponseCache& cache,
+        ResponseCache::Clock::duration ttl,
+        unsigned etag,
+        std::time_t lastModified,
+        const std::string& variant)
+{
+    if(!cacheable(environment().requestMethod) || m_authorizations)
+        return;
+
+    if(m_cache == nullptr)
+        m_cacheCorked = m_outStreamBuffer.corked();
+    m_cache = &cache;
+    m_environment.parse("REQUEST_URI");
+    m_cacheUri = cacheKey(environment().requestUri);
+    m_cacheVariant = variant;
+    m_cacheEntry.etag = etag;
+    m_cacheEntry.lastModified = lastModified;
+    m_cacheEntry.expires = ResponseCache::Clock::now()+ttl;
+    m_outStreamBuffer.cork(true);
+}
+
+template<class charT, class Containers>
+void Fastcgipp::Request<charT, Containers>::setLocale(
+        const std::string& locale)
+{
+    out.imbue(cachedLocale(locale+codepage()));
+}
+
+template<class charT, class Containers>
+void Fastcgipp::Request<charT, Containers>::cacheLocales(
+        const std::vector<std::string>& locales)
+{
+    for(const std::string& locale: locales)
+        cachedLocale(locale+codepage());
 }
 
 namespace Fastcgipp
 {
-    template<> const char* Fastcgipp::Request<wchar_t>::codepage() const
+    template<> const char* Fastcgipp::Request<wchar_t>::codepage()
+    {
+        return ".UTF-8";
+    }
+
+    template<> const char* Fastcgipp::Request<char>::codepage()
+    {
+        return "";
+    }
+
+    template<> const char*
+    Fastcgipp::Request<wchar_t, Http::FlatContainers>::codepage()
     {
         return ".UTF-8";
     }
 
-    template<> const char* Fastcgipp::Request<char>::codepage() const
+    template<> const char*
+    Fastcgipp::Request<char, Http::FlatContainers>::codepage()
     {
         return "";
     }
@@ -301,3 +987,9 @@ namespace Fastcgipp
 
 template class Fastcgipp::Request<char>;
 template class Fastcgipp::Request<wchar_t>;
+template class Fastcgipp::Request<
+    char,
+    Fastcgipp::Http::FlatContainers>;
+template class Fastcgipp::Request<
+    wchar_t,
+    Fastcgipp::Http::FlatContainers>;
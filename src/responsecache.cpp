@@ -0,0 +1,128 @@
+/*!
+ * @file       responsecache.cpp
+ * @brief      Defines the ResponseCache class
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 15, 2026
+ * @copyright  Copyright &copy; 2026 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2026 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#include "fastcgi++/responsecache.hpp"
+#include "fastcgi++/metrics.hpp"
+
+std::string Fastcgipp::ResponseCache::key(
+        const std::string& uri,
+        const std::string& variant)
+{
+    std::string key;
+    key.reserve(uri.size()+1+variant.size());
+    key += uri;
+    key += '\0';
+    key += variant;
+    return key;
+}
+
+void Fastcgipp::ResponseCache::remove(Index::iterator index)
+{
+    const size_t size = index->first.size()+index->second->entry->size;
+    m_bytes -= size;
+    Metrics::responseCacheBytes.sub(size);
+    m_items.erase(index->second);
+    m_index.erase(index);
+}
+
+std::shared_ptr<const Fastcgipp::ResponseCache::Entry>
+Fastcgipp::ResponseCache::find(
+        const std::string& uri,
+        const std::string& variant)
+{
+    const auto now = Clock::now();
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    const auto index = m_index.find(key(uri, variant));
+    if(index == m_index.end())
+        return nullptr;
+    if(index->second->entry->expires <= now)
+    {
+        remove(index);
+        return nullptr;
+    }
+
+    m_items.splice(m_items.begin(), m_items, index->second);
+    return index->second->entry;
+}
+
+void Fastcgipp::ResponseCache::insert(
+        const std::string& uri,
+        const std::string& variant,
+        std::shared_ptr<const Entry>&& entry)
+{
+    std::string key(this->key(uri, variant));
+    const size_t size = key.size()+entry->size;
+    if(size > m_maxBytes)
+        return;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    const auto existing = m_index.find(key);
+    if(existing != m_index.end())
+        remove(existing);
+    while(m_bytes+size > m_maxBytes)
+        remove(m_index.find(m_items.back().key));
+
+    m_items.push_front(Item{std::move(key), std::move(entry)});
+    m_index.emplace(m_items.front().key, m_items.begin());
+    m_bytes += size;
+    Metrics::responseCacheBytes.add(size);
+}
+
+void Fastcgipp::ResponseCache::erase(const std::string& uri)
+{
+    const std::string prefix(key(uri, std::string()));
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto index = m_index.lower_bound(prefix);
+    while(index != m_index.end()
+            && index->first.compare(0, prefix.size(), prefix) == 0)
+        remove(index++);
+}
+
+void Fastcgipp::ResponseCache::clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_index.clear();
+    m_items.clear();
+    Metrics::responseCacheBytes.sub(m_bytes);
+    m_bytes = 0;
+}
+
+size_t Fastcgipp::ResponseCache::size() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_index.size();
+}
+
+size_t Fastcgipp::ResponseCache::bytes() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_bytes;
+}
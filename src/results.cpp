@@ -34,6 +34,7 @@
 #include <locale>
 #include <codecvt>
 #include <cstdio>
+#include <cstring>
 
 // Column verification
 
@@ -61,6 +62,8 @@ template bool Fastcgipp::SQL::Results_base::verifyColumn<std::string>(
         int column) const;
 template bool Fastcgipp::SQL::Results_base::verifyColumn<std::wstring>(
         int column) const;
+template bool Fastcgipp::SQL::Results_base::verifyColumn<Fastcgipp::SQL::View>(
+        int column) const;
 template bool Fastcgipp::SQL::Results_base::verifyColumn<std::vector<char>>(
         int column) const;
 template bool Fastcgipp::SQL::Results_base::verifyColumn<std::vector<int16_t>>(
@@ -125,6 +128,14 @@ template<> void Fastcgipp::SQL::Results_base::field<std::string>(
             PQgetlength(reinterpret_cast<const PGresult*>(m_res), row, column));
 }
 
+template<> void Fastcgipp::SQL::Results_base::field<Fastcgipp::SQL::View>(
+        int row,
+        int column,
+        View& value) const
+{
+    value = view(row, column);
+}
+
 template<> void Fastcgipp::SQL::Results_base::field<std::wstring>(
         int row,
         int column,
@@ -243,24 +254,31 @@ void Fastcgipp::SQL::Results_base::field(
     const int32_t size(*reinterpret_cast<const BigEndian<int32_t>*>(
                 start+3*sizeof(int32_t)));
 
-    value.clear();
-    value.reserve(size);
+    // The elements are interleaved with their lengths so the raw words are
+    // gathered together first and converted all in one go
+    value.resize(size);
+    char* const data = reinterpret_cast<char*>(value.data());
+    size_t count = 0;
     for(int i=0; i<size; ++i)
     {
+        const char* const element = start + 5*sizeof(int32_t)
+            + i*(sizeof(int32_t) + sizeof(Numeric));
         const int32_t length(
-                *reinterpret_cast<const BigEndian<int32_t>*>(
-                    start + 5*sizeof(int32_t)
-                    + i*(sizeof(int32_t) + sizeof(Numeric))));
+                *reinterpret_cast<const BigEndian<int32_t>*>(element));
         if(length != sizeof(Numeric))
         {
             WARNING_LOG("SQL result array for Numeric has element of wrong size");
             continue;
         }
 
-        value.push_back(*reinterpret_cast<const BigEndian<Numeric>*>(
-                    start + 6*sizeof(int32_t)
-                    + i*(sizeof(int32_t) + sizeof(Numeric))));
+        std::copy_n(
+                element+sizeof(int32_t),
+                sizeof(Numeric),
+                data+count*sizeof(Numeric));
+        ++count;
     }
+    value.resize(count);
+    convertBigEndian(data, count, sizeof(Numeric));
 }
 template void Fastcgipp::SQL::Results_base::field<int16_t>(
         int row,
@@ -419,8 +437,76 @@ void Fastcgipp::SQL::Results_base::field<std::wstring>(
 
 // Done result fields
 
+// Column extraction
+
+template<typename Numeric>
+bool Fastcgipp::SQL::Results_base::column(
+        int column,
+        std::vector<Numeric>& values) const
+{
+    static_assert(
+            std::is_integral<Numeric>::value ||
+                std::is_floating_point<Numeric>::value,
+            "Numeric must be a numeric type.");
+    if(!verifyColumn<Numeric>(column))
+        return false;
+
+    const PGresult* const res = reinterpret_cast<const PGresult*>(m_res);
+    const int rows = PQntuples(res);
+    values.resize(rows);
+
+    // Gather the raw words first and convert them all in one go
+    char* const data = reinterpret_cast<char*>(values.data());
+    for(int row=0; row<rows; ++row)
+    {
+        char* const destination = data+row*sizeof(Numeric);
+        if(PQgetisnull(res, row, column))
+            std::fill_n(destination, sizeof(Numeric), char(0));
+        else
+            std::copy_n(
+                    PQgetvalue(res, row, column),
+                    sizeof(Numeric),
+                    destination);
+    }
+    convertBigEndian(data, rows, sizeof(Numeric));
+    return true;
+}
+template bool Fastcgipp::SQL::Results_base::column<int16_t>(
+        int column,
+        std::vector<int16_t>& values) const;
+template bool Fastcgipp::SQL::Results_base::column<int32_t>(
+        int column,
+        std::vector<int32_t>& values) const;
+template bool Fastcgipp::SQL::Results_base::column<int64_t>(
+        int column,
+        std::vector<int64_t>& values) const;
+template bool Fastcgipp::SQL::Results_base::column<float>(
+        int column,
+        std::vector<float>& values) const;
+template bool Fastcgipp::SQL::Results_base::column<double>(
+        int column,
+        std::vector<double>& values) const;
+
+template<> bool Fastcgipp::SQL::Results_base::column<Fastcgipp::SQL::View>(
+        int column,
+        std::vector<View>& values) const
+{
+    if(!verifyColumn<View>(column))
+        return false;
+
+    const int rows = PQntuples(reinterpret_cast<const PGresult*>(m_res));
+    values.resize(rows);
+    for(int row=0; row<rows; ++row)
+        values[row] = view(row, column);
+    return true;
+}
+
+// Done column extraction
+
 Fastcgipp::SQL::Status Fastcgipp::SQL::Results_base::status() const
 {
+    if(m_expired)
+        return Status::expired;
     if(reinterpret_cast<const PGresult*>(m_res) == nullptr)
         return Status::noResult;
 
@@ -478,6 +564,56 @@ bool Fastcgipp::SQL::Results_base::null(int row, int column) const
                 column));
 }
 
+Fastcgipp::SQL::View Fastcgipp::SQL::Results_base::view(
+        int row,
+        int column) const
+{
+    return View(
+            PQgetvalue(reinterpret_cast<const PGresult*>(m_res), row, column),
+            PQgetlength(reinterpret_cast<const PGresult*>(m_res), row, column));
+}
+
+void Fastcgipp::SQL::ResultStream_base::push(void* batch)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_batches.push_back(batch);
+}
+
+void Fastcgipp::SQL::ResultStream_base::finish()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_complete = true;
+}
+
+bool Fastcgipp::SQL::ResultStream_base::next(void*& res)
+{
+    void* batch;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if(m_batches.empty())
+            return false;
+        batch = m_batches.front();
+        m_batches.pop_front();
+    }
+
+    if(res != nullptr)
+        PQclear(reinterpret_cast<PGresult*>(res));
+    res = batch;
+    return true;
+}
+
+bool Fastcgipp::SQL::ResultStream_base::complete() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_complete && m_batches.empty();
+}
+
+Fastcgipp::SQL::ResultStream_base::~ResultStream_base()
+{
+    for(void* batch: m_batches)
+        PQclear(reinterpret_cast<PGresult*>(batch));
+}
+
 int Fastcgipp::SQL::Results_base::columns() const
 {
     return PQnfields(reinterpret_cast<const PGresult*>(m_res));
@@ -507,6 +643,8 @@ const char* Fastcgipp::SQL::statusString(const Status status)
             return "Copy Both";
         case Status::singleTuple:
             return "Single Tuple";
+        case Status::expired:
+            return "Expired";
         case Status::fatalError:
         default:
             return "Fatal Error";
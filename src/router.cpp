@@ -0,0 +1,535 @@
+/*!
+ * @file       router.cpp
+ * @brief      Defines the Router class
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 15, 2026
+ * @copyright  Copyright &copy; 2026 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2026 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#include "fastcgi++/router.hpp"
+#include "fastcgi++/log.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+    //! Request method from it's label
+    Fastcgipp::Http::RequestMethod requestMethod(
+            const char* value,
+            const char* end)
+    {
+        using Fastcgipp::Http::requestMethodLabels;
+        for(unsigned i=1; i<requestMethodLabels.size(); ++i)
+            if(size_t(end-value) == std::strlen(requestMethodLabels[i])
+                    && std::equal(value, end, requestMethodLabels[i]))
+                return static_cast<Fastcgipp::Http::RequestMethod>(i);
+        return Fastcgipp::Http::RequestMethod::ERROR;
+    }
+
+    //! Does a raw parameter name equal a string
+    bool named(const char* name, const char* end, const char* string)
+    {
+        return size_t(end-name) == std::strlen(string)
+            && std::equal(name, end, string);
+    }
+
+    //! Responds with a 404 Not Found or 405 Method Not Allowed
+    class Status: public Fastcgipp::Request<char>
+    {
+    public:
+        //! Construct with the methods that are allowed or 0 for not found
+        Status(unsigned allowed):
+            m_allowed(allowed)
+        {}
+
+    private:
+        //! Bit set for each RequestMethod that is allowed
+        const unsigned m_allowed;
+
+        bool response()
+        {
+            if(m_allowed == 0)
+            {
+                out << \
+"Status: 404 Not Found\r\n"\
+"Content-Type: text/html; charset=utf-8\r\n\r\n"\
+"<!DOCTYPE html>"\
+"<html lang='en'>"\
+    "<head>"\
+        "<title>404 Not Found</title>"\
+    "</head>"\
+    "<body>"\
+        "<h1>404 Not Found</h1>"\
+    "</body>"\
+"</html>";
+                return true;
+            }
+
+            out << "Status: 405 Method Not Allowed\r\nAllow: ";
+            const char* separator = "";
+            for(unsigned i=1; i<Fastcgipp::Http::requestMethodLabels.size();
+                    ++i)
+                if(m_allowed & 1<<i)
+                {
+                    out << separator << Fastcgipp::Http::requestMethodLabels[i];
+                    separator = ", ";
+                }
+            out << "\r\n"\
+"Content-Type: text/html; charset=utf-8\r\n\r\n"\
+"<!DOCTYPE html>"\
+"<html lang='en'>"\
+    "<head>"\
+        "<title>405 Method Not Allowed</title>"\
+    "</head>"\
+    "<body>"\
+        "<h1>405 Method Not Allowed</h1>"\
+    "</body>"\
+"</html>";
+            return true;
+        }
+    };
+}
+
+std::string Fastcgipp::Route::value(size_t index) const
+{
+    const Capture& capture = m_captures[index];
+    std::string value(capture.end-capture.begin, 0);
+    char* destination = &value[0];
+
+    // A plus is only a space in query strings so don't let it be converted
+    const char* start = capture.begin;
+    while(true)
+    {
+        const char* const plus = std::find(start, capture.end, '+');
+        destination = Http::percentEscapedToRealBytes(
+                start,
+                plus,
+                destination);
+        if(plus == capture.end)
+            break;
+        *destination++ = '+';
+        start = plus+1;
+    }
+
+    value.resize(destination-value.data());
+    return value;
+}
+
+std::string Fastcgipp::Route::value(const std::string& name) const
+{
+    for(size_t i=0; i<m_size; ++i)
+        if(*m_captures[i].name == name)
+            return value(i);
+    return std::string();
+}
+
+struct Fastcgipp::Router::Node
+{
+    //! Static bytes leading into this node
+    std::string prefix;
+
+    //! First byte of the prefix of each static child
+    std::string indices;
+
+    //! Children with a static prefix
+    std::vector<std::unique_ptr<Node>> children;
+
+    //! Child capturing a single segment
+    std::unique_ptr<Node> segment;
+
+    //! Child capturing the rest of the path
+    std::unique_ptr<Node> rest;
+
+    //! Name of the capture if this is a segment or rest node
+    std::string name;
+
+    //! Factories of routes ending here indexed by RequestMethod
+    /*!
+     * RequestMethod::ERROR is for routes that serve any method.
+     */
+    std::array<Factory, 9> factories;
+
+    Node():
+        factories{}
+    {}
+
+    //! Pick the factory for a request method
+    Factory pick(Http::RequestMethod method, unsigned& allowed) const
+    {
+        const Factory factory = factories[static_cast<int>(method)];
+        if(factory)
+            return factory;
+        if(method == Http::RequestMethod::HEAD)
+        {
+            const Factory get = factories[
+                static_cast<int>(Http::RequestMethod::GET)];
+            if(get)
+                return get;
+        }
+        if(factories[static_cast<int>(Http::RequestMethod::ERROR)])
+            return factories[static_cast<int>(Http::RequestMethod::ERROR)];
+
+        for(unsigned i=1; i<factories.size(); ++i)
+            if(factories[i])
+                allowed |= 1<<i;
+        if(factories[static_cast<int>(Http::RequestMethod::GET)])
+            allowed |= 1<<static_cast<int>(Http::RequestMethod::HEAD);
+        return nullptr;
+    }
+};
+
+class Fastcgipp::Router::Dispatch: public Request_base
+{
+public:
+    Dispatch(
+            Router& router,
+            const Protocol::RequestId& id,
+            const Protocol::Role& role,
+            bool kill):
+        m_router(router),
+        m_id(id),
+        m_role(role),
+        m_kill(kill)
+    {}
+
+    std::unique_lock<std::mutex> handler()
+    {
+        std::unique_lock<std::mutex> lock(m_messagesMutex);
+        while(!m_messages.empty())
+        {
+            Message message = std::move(m_messages.front());
+            m_messages.pop();
+            lock.unlock();
+
+            if(handle(std::move(message)))
+                break;
+            lock.lock();
+        }
+        return lock;
+    }
+
+    bool handle(Message&& message);
+
+    bool trailing() const
+    {
+        return m_request && m_request->trailing();
+    }
+
+private:
+    //! Router that made us
+    Router& m_router;
+
+    //! Complete ID of the request
+    const Protocol::RequestId m_id;
+
+    //! The role that the other side expects the request to play
+    const Protocol::Role m_role;
+
+    //! Should the socket be closed upon completion
+    const bool m_kill;
+
+    //! Messages received before the route was known
+    std::vector<Message> m_held;
+
+    //! The request that was routed to
+    std::unique_ptr<Request_base> m_request;
+};
+
+bool Fastcgipp::Router::Dispatch::handle(Message&& message)
+{
+    if(m_request)
+        return m_request->handle(std::move(message));
+
+    bool more = false;
+    if(message.type == 0)
+    {
+        const Protocol::Header& header
+            = *reinterpret_cast<const Protocol::Header*>(message.data.begin());
+        more = header.type == Protocol::RecordType::PARAMS
+            && header.contentLength != 0;
+    }
+    m_held.push_back(std::move(message));
+    if(more)
+        return false;
+
+    Route route;
+    route.m_method = Http::RequestMethod::ERROR;
+    route.m_id = m_id;
+    route.m_role = m_role;
+    route.m_kill = m_kill;
+    const char* uri = nullptr;
+    const char* uriEnd = nullptr;
+
+    for(const Message& held: m_held)
+    {
+        if(held.type != 0)
+            continue;
+        const Protocol::Header& header
+            = *reinterpret_cast<const Protocol::Header*>(held.data.begin());
+        if(header.type != Protocol::RecordType::PARAMS)
+            continue;
+
+        const char* data = held.data.begin()+sizeof(header);
+        const char* const dataEnd = data+header.contentLength;
+        const char* name;
+        const char* value;
+        const char* end;
+        while(Protocol::processParamHeader(data, dataEnd, name, value, end))
+        {
+            if(named(name, value, "REQUEST_URI"))
+            {
+                uri = value;
+                uriEnd = end;
+            }
+            else if(named(name, value, "REQUEST_METHOD"))
+                route.m_method = requestMethod(value, end);
+            data = end;
+        }
+    }
+
+    m_request = m_router.dispatch(route, uri, uriEnd);
+
+    bool complete = false;
+    for(Message& held: m_held)
+        if(!complete)
+            complete = m_request->handle(std::move(held));
+    m_held.clear();
+    return complete;
+}
+
+Fastcgipp::Router::Router(unsigned threads):
+    Manager_base(threads),
+    m_root(new Node),
+    m_fallback(nullptr)
+{}
+
+Fastcgipp::Router::~Router()
+{}
+
+bool Fastcgipp::Router::add(
+        Http::RequestMethod method,
+        const std::string& route,
+        Factory factory)
+{
+    if(route.empty() || route.front() != '/')
+    {
+        ERROR_LOG("Route " << route.c_str() << " doesn't start with a slash")
+        return false;
+    }
+
+    Node* node = m_root.get();
+    const char* pattern = route.data();
+    const char* const end = route.data()+route.size();
+    size_t captures = 0;
+
+    while(pattern != end)
+    {
+        if(*pattern == ':' || *pattern == '*')
+        {
+            const bool rest = *pattern == '*';
+            const char* const nameEnd = rest ? end : std::find(
+                    pattern,
+                    end,
+                    '/');
+            const std::string name(pattern+1, nameEnd);
+            if(pattern[-1] != '/' || name.empty()
+                    || ++captures > Route::maxCaptures)
+            {
+                ERROR_LOG("Route " << route.c_str() << " is malformed")
+                return false;
+            }
+
+            std::unique_ptr<Node>& child = rest ? node->rest : node->segment;
+            if(!child)
+            {
+                child.reset(new Node);
+                child->name = name;
+            }
+            else if(child->name != name)
+            {
+                ERROR_LOG("Route " << route.c_str() << " captures " \
+                        << name.c_str() << " where another route captures " \
+                        << child->name.c_str())
+                return false;
+            }
+            node = child.get();
+            pattern = nameEnd;
+            continue;
+        }
+
+        const char* const staticEnd = std::find_if(
+                pattern,
+                end,
+                [] (char x) { return x == ':' || x == '*'; });
+        const size_t position = node->indices.find(*pattern);
+        if(position == std::string::npos)
+        {
+            node->indices += *pattern;
+            node->children.emplace_back(new Node);
+            node = node->children.back().get();
+            node->prefix.assign(pattern, staticEnd);
+            pattern = staticEnd;
+            continue;
+        }
+
+        Node& child = *node->children[position];
+        const size_t common = std::mismatch(
+                pattern,
+                staticEnd,
+                child.prefix.cbegin(),
+                child.prefix.cend()).first - pattern;
+        if(common < child.prefix.size())
+        {
+            std::unique_ptr<Node> split(new Node);
+            split->prefix.assign(child.prefix, 0, common);
+            child.prefix.erase(0, common);
+            split->indices = child.prefix.front();
+            split->children.push_back(std::move(node->children[position]));
+            node->children[position] = std::move(split);
+        }
+        node = node->children[position].get();
+        pattern += common;
+    }
+
+    Factory& slot = node->factories[static_cast<int>(method)];
+    if(slot)
+    {
+        ERROR_LOG("Route " << route.c_str() << " was already added")
+        return false;
+    }
+    slot = factory;
+    return true;
+}
+
+Fastcgipp::Router::Factory Fastcgipp::Router::find(
+        const Node& node,
+        Route& route,
+        const char* path,
+        const char* end,
+        unsigned& allowed) const
+{
+    Factory factory;
+
+    if(path == end)
+    {
+        factory = node.pick(route.m_method, allowed);
+        if(factory)
+            return factory;
+    }
+    else
+    {
+        const size_t position = node.indices.find(*path);
+        if(position != std::string::npos)
+        {
+            const Node& child = *node.children[position];
+            if(size_t(end-path) >= child.prefix.size() && std::equal(
+                        child.prefix.cbegin(),
+                        child.prefix.cend(),
+                        path))
+            {
+                factory = find(
+                        child,
+                        route,
+                        path+child.prefix.size(),
+                        end,
+                        allowed);
+                if(factory)
+                    return factory;
+            }
+        }
+
+        if(node.segment && *path != '/')
+        {
+            const char* const segmentEnd = std::find(path, end, '/');
+            route.m_captures[route.m_size++] = {
+                &node.segment->name,
+                path,
+                segmentEnd};
+            factory = find(*node.segment, route, segmentEnd, end, allowed);
+            if(factory)
+                return factory;
+            --route.m_size;
+        }
+    }
+
+    if(node.rest)
+    {
+        route.m_captures[route.m_size++] = {&node.rest->name, path, end};
+        factory = node.rest->pick(route.m_method, allowed);
+        if(factory)
+            return factory;
+        --route.m_size;
+    }
+
+    return nullptr;
+}
+
+bool Fastcgipp::Router::match(
+        Http::RequestMethod method,
+        const char* path,
+        const char* end,
+        Route& route) const
+{
+    unsigned allowed = 0;
+    route.m_method = method;
+    route.m_size = 0;
+    return find(*m_root, route, path, end, allowed) != nullptr;
+}
+
+std::unique_ptr<Fastcgipp::Request_base> Fastcgipp::Router::dispatch(
+        Route& route,
+        const char* uri,
+        const char* uriEnd)
+{
+    unsigned allowed = 0;
+    route.m_size = 0;
+    const Factory factory = find(
+            *m_root,
+            route,
+            uri,
+            std::find(uri, uriEnd, '?'),
+            allowed);
+    if(factory)
+        return (this->*factory)(route);
+
+    route.m_size = 0;
+    if(m_fallback)
+        return (this->*m_fallback)(route);
+    return status(route, allowed);
+}
+
+std::unique_ptr<Fastcgipp::Request_base> Fastcgipp::Router::status(
+        const Route& route,
+        unsigned allowed)
+{
+    return configure(std::unique_ptr<Status>(new Status(allowed)), route);
+}
+
+std::unique_ptr<Fastcgipp::Request_base> Fastcgipp::Router::makeRequest(
+        const Protocol::RequestId& id,
+        const Protocol::Role& role,
+        bool kill)
+{
+    return std::unique_ptr<Request_base>(new Dispatch(*this, id, role, kill));
+}
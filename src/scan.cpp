@@ -0,0 +1,447 @@
+/*!
+ * @file       scan.cpp
+ * @brief      Defines vectorized byte scanning functions
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 14, 2026
+ * @copyright  Copyright &copy; 2026 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2026 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#include "fastcgi++/scan.hpp"
+
+#include <cstring>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define FASTCGIPP_SCAN_X86
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define FASTCGIPP_SCAN_NEON
+#include <arm_neon.h>
+#endif
+
+namespace
+{
+    // The vector kernels test the first and last byte of the needle across a
+    // whole register at once and only compare the full needle at candidate
+    // positions. Whatever doesn't fill a register is left to these.
+
+    const char* findScalar(
+            const char* position,
+            const char* const end,
+            const char* const needle,
+            const size_t size)
+    {
+        if(size_t(end-position) < size)
+            return end;
+        const char* const last = end-size+1;
+        while(position < last)
+        {
+            position = static_cast<const char*>(
+                    std::memchr(position, *needle, last-position));
+            if(position == nullptr)
+                break;
+            if(std::memcmp(position, needle, size) == 0)
+                return position;
+            ++position;
+        }
+        return end;
+    }
+
+    const char* findEitherScalar(
+            const char* position,
+            const char* const end,
+            const char first,
+            const char second)
+    {
+        for(; position < end; ++position)
+            if(*position == first || *position == second)
+                return position;
+        return end;
+    }
+
+    const char* findAnyScalar(
+            const char* position,
+            const char* const end,
+            const Fastcgipp::Scan::Set& set)
+    {
+        for(; position < end; ++position)
+            if(set.contains(*position))
+                return position;
+        return end;
+    }
+
+#ifdef FASTCGIPP_SCAN_X86
+    __attribute__((target("sse2")))
+    const char* findSse2(
+            const char* position,
+            const char* const end,
+            const char* const needle,
+            const size_t size)
+    {
+        const __m128i first = _mm_set1_epi8(needle[0]);
+        const __m128i last = _mm_set1_epi8(needle[size-1]);
+
+        while(size_t(end-position) >= 16+size-1)
+        {
+            const __m128i head = _mm_loadu_si128(
+                    reinterpret_cast<const __m128i*>(position));
+            const __m128i tail = _mm_loadu_si128(
+                    reinterpret_cast<const __m128i*>(position+size-1));
+            unsigned mask = _mm_movemask_epi8(_mm_and_si128(
+                        _mm_cmpeq_epi8(head, first),
+                        _mm_cmpeq_epi8(tail, last)));
+            while(mask)
+            {
+                const char* const candidate = position+__builtin_ctz(mask);
+                if(std::memcmp(candidate, needle, size) == 0)
+                    return candidate;
+                mask &= mask-1;
+            }
+            position += 16;
+        }
+
+        return findScalar(position, end, needle, size);
+    }
+
+    __attribute__((target("sse2")))
+    const char* findEitherSse2(
+            const char* position,
+            const char* const end,
+            const char first,
+            const char second)
+    {
+        const __m128i a = _mm_set1_epi8(first);
+        const __m128i b = _mm_set1_epi8(second);
+
+        while(end-position >= 16)
+        {
+            const __m128i data = _mm_loadu_si128(
+                    reinterpret_cast<const __m128i*>(position));
+            const unsigned mask = _mm_movemask_epi8(_mm_or_si128(
+                        _mm_cmpeq_epi8(data, a),
+                        _mm_cmpeq_epi8(data, b)));
+            if(mask)
+                return position+__builtin_ctz(mask);
+            position += 16;
+        }
+
+        return findEitherScalar(position, end, first, second);
+    }
+
+    __attribute__((target("avx2")))
+    const char* findAvx2(
+            const char* position,
+            const char* const end,
+            const char* const needle,
+            const size_t size)
+    {
+        const __m256i first = _mm256_set1_epi8(needle[0]);
+        const __m256i last = _mm256_set1_epi8(needle[size-1]);
+
+        while(size_t(end-position) >= 32+size-1)
+        {
+            const __m256i head = _mm256_loadu_si256(
+                    reinterpret_cast<const __m256i*>(position));
+            const __m256i tail = _mm256_loadu_si256(
+                    reinterpret_cast<const __m256i*>(position+size-1));
+            unsigned mask = _mm256_movemask_epi8(_mm256_and_si256(
+                        _mm256_cmpeq_epi8(head, first),
+                        _mm256_cmpeq_epi8(tail, last)));
+            while(mask)
+            {
+                const char* const candidate = position+__builtin_ctz(mask);
+                if(std::memcmp(candidate, needle, size) == 0)
+                    return candidate;
+                mask &= mask-1;
+            }
+            position += 32;
+        }
+
+        return findSse2(position, end, needle, size);
+    }
+
+    __attribute__((target("avx2")))
+    const char* findEitherAvx2(
+            const char* position,
+            const char* const end,
+            const char first,
+            const char second)
+    {
+        const __m256i a = _mm256_set1_epi8(first);
+        const __m256i b = _mm256_set1_epi8(second);
+
+        while(end-position >= 32)
+        {
+            const __m256i data = _mm256_loadu_si256(
+                    reinterpret_cast<const __m256i*>(position));
+            const unsigned mask = _mm256_movemask_epi8(_mm256_or_si256(
+                        _mm256_cmpeq_epi8(data, a),
+                        _mm256_cmpeq_epi8(data, b)));
+            if(mask)
+                return position+__builtin_ctz(mask);
+            position += 32;
+        }
+
+        return findEitherSse2(position, end, first, second);
+    }
+
+    // The bitmap is looked up by low nibble and tested against the bit for
+    // the high nibble. Bytes with the top bit set shuffle in a zero for the
+    // latter and so never match.
+
+    __attribute__((target("ssse3")))
+    const char* findAnySsse3(
+            const char* position,
+            const char* const end,
+            const Fastcgipp::Scan::Set& set)
+    {
+        const __m128i bitmap = _mm_loadu_si128(
+                reinterpret_cast<const __m128i*>(set.bitmap));
+        const __m128i bits = _mm_setr_epi8(
+                1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0);
+        const __m128i nibble = _mm_set1_epi8(0x0f);
+
+        while(end-position >= 16)
+        {
+            const __m128i data = _mm_loadu_si128(
+                    reinterpret_cast<const __m128i*>(position));
+            const __m128i low = _mm_shuffle_epi8(
+                    bitmap,
+                    _mm_and_si128(data, nibble));
+            const __m128i high = _mm_shuffle_epi8(
+                    bits,
+                    _mm_and_si128(_mm_srli_epi16(data, 4), nibble));
+            const unsigned mask = ~_mm_movemask_epi8(_mm_cmpeq_epi8(
+                        _mm_and_si128(low, high),
+                        _mm_setzero_si128())) & 0xffff;
+            if(mask)
+                return position+__builtin_ctz(mask);
+            position += 16;
+        }
+
+        return findAnyScalar(position, end, set);
+    }
+
+    __attribute__((target("avx2")))
+    const char* findAnyAvx2(
+            const char* position,
+            const char* const end,
+            const Fastcgipp::Scan::Set& set)
+    {
+        const __m256i bitmap = _mm256_broadcastsi128_si256(_mm_loadu_si128(
+                reinterpret_cast<const __m128i*>(set.bitmap)));
+        const __m256i bits = _mm256_setr_epi8(
+                1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0,
+                1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0);
+        const __m256i nibble = _mm256_set1_epi8(0x0f);
+
+        while(end-position >= 32)
+        {
+            const __m256i data = _mm256_loadu_si256(
+                    reinterpret_cast<const __m256i*>(position));
+            const __m256i low = _mm256_shuffle_epi8(
+                    bitmap,
+                    _mm256_and_si256(data, nibble));
+            const __m256i high = _mm256_shuffle_epi8(
+                    bits,
+                    _mm256_and_si256(_mm256_srli_epi16(data, 4), nibble));
+            const unsigned mask = ~unsigned(_mm256_movemask_epi8(
+                        _mm256_cmpeq_epi8(
+                            _mm256_and_si256(low, high),
+                            _mm256_setzero_si256())));
+            if(mask)
+                return position+__builtin_ctz(mask);
+            position += 32;
+        }
+
+        return findAnySsse3(position, end, set);
+    }
+#endif
+
+#ifdef FASTCGIPP_SCAN_NEON
+    // NEON has no movemask so we narrow each byte to a nibble instead
+    inline uint64_t nibbleMask(const uint8x16_t matches)
+    {
+        return vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(
+                        vreinterpretq_u16_u8(matches), 4)), 0);
+    }
+
+    const char* findNeon(
+            const char* position,
+            const char* const end,
+            const char* const needle,
+            const size_t size)
+    {
+        const uint8x16_t first = vdupq_n_u8(needle[0]);
+        const uint8x16_t last = vdupq_n_u8(needle[size-1]);
+
+        while(size_t(end-position) >= 16+size-1)
+        {
+            const uint8x16_t head = vld1q_u8(
+                    reinterpret_cast<const uint8_t*>(position));
+            const uint8x16_t tail = vld1q_u8(
+                    reinterpret_cast<const uint8_t*>(position+size-1));
+            uint64_t mask = nibbleMask(vandq_u8(
+                        vceqq_u8(head, first),
+                        vceqq_u8(tail, last)));
+            while(mask)
+            {
+                const unsigned index = __builtin_ctzll(mask)>>2;
+                const char* const candidate = position+index;
+                if(std::memcmp(candidate, needle, size) == 0)
+                    return candidate;
+                mask &= ~(uint64_t(0xf) << (index<<2));
+            }
+            position += 16;
+        }
+
+        return findScalar(position, end, needle, size);
+    }
+
+    const char* findEitherNeon(
+            const char* position,
+            const char* const end,
+            const char first,
+            const char second)
+    {
+        const uint8x16_t a = vdupq_n_u8(first);
+        const uint8x16_t b = vdupq_n_u8(second);
+
+        while(end-position >= 16)
+        {
+            const uint8x16_t data = vld1q_u8(
+                    reinterpret_cast<const uint8_t*>(position));
+            const uint64_t mask = nibbleMask(vorrq_u8(
+                        vceqq_u8(data, a),
+                        vceqq_u8(data, b)));
+            if(mask)
+                return position+(__builtin_ctzll(mask)>>2);
+            position += 16;
+        }
+
+        return findEitherScalar(position, end, first, second);
+    }
+
+    const char* findAnyNeon(
+            const char* position,
+            const char* const end,
+            const Fastcgipp::Scan::Set& set)
+    {
+        const uint8x16_t bitmap = vld1q_u8(set.bitmap);
+        static const uint8_t bitsArray[16] =
+            {1, 2, 4, 8, 16, 32, 64, 128, 0, 0, 0, 0, 0, 0, 0, 0};
+        const uint8x16_t bits = vld1q_u8(bitsArray);
+        const uint8x16_t nibble = vdupq_n_u8(0x0f);
+
+        while(end-position >= 16)
+        {
+            const uint8x16_t data = vld1q_u8(
+                    reinterpret_cast<const uint8_t*>(position));
+            const uint8x16_t low = vqtbl1q_u8(bitmap, vandq_u8(data, nibble));
+            const uint8x16_t high = vqtbl1q_u8(bits, vshrq_n_u8(data, 4));
+            const uint64_t mask = nibbleMask(vtstq_u8(low, high));
+            if(mask)
+                return position+(__builtin_ctzll(mask)>>2);
+            position += 16;
+        }
+
+        return findAnyScalar(position, end, set);
+    }
+#endif
+
+    struct Implementation
+    {
+        const char* (*find)(
+                const char*,
+                const char*,
+                const char*,
+                size_t);
+        const char* (*findEither)(
+                const char*,
+                const char*,
+                char,
+                char);
+        const char* (*findAny)(
+                const char*,
+                const char*,
+                const Fastcgipp::Scan::Set&);
+        const char* name;
+    };
+
+    Implementation resolve()
+    {
+#if defined(FASTCGIPP_SCAN_X86)
+        __builtin_cpu_init();
+        if(__builtin_cpu_supports("avx2"))
+            return {findAvx2, findEitherAvx2, findAnyAvx2, "avx2"};
+        if(__builtin_cpu_supports("ssse3"))
+            return {findSse2, findEitherSse2, findAnySsse3, "ssse3"};
+        if(__builtin_cpu_supports("sse2"))
+            return {findSse2, findEitherSse2, findAnyScalar, "sse2"};
+#elif defined(FASTCGIPP_SCAN_NEON)
+        return {findNeon, findEitherNeon, findAnyNeon, "neon"};
+#endif
+        return {findScalar, findEitherScalar, findAnyScalar, "scalar"};
+    }
+
+    inline const Implementation& chosen()
+    {
+        static const Implementation implementation = resolve();
+        return implementation;
+    }
+}
+
+const char* Fastcgipp::Scan::find(
+        const char* start,
+        const char* end,
+        const char* needle,
+        size_t size)
+{
+    if(size == 0)
+        return start;
+    if(size_t(end-start) < size)
+        return end;
+    return chosen().find(start, end, needle, size);
+}
+
+const char* Fastcgipp::Scan::findEither(
+        const char* start,
+        const char* end,
+        char first,
+        char second)
+{
+    return chosen().findEither(start, end, first, second);
+}
+
+const char* Fastcgipp::Scan::findAny(
+        const char* start,
+        const char* end,
+        const Set& set)
+{
+    return chosen().findAny(start, end, set);
+}
+
+const char* Fastcgipp::Scan::implementation()
+{
+    return chosen().name;
+}
@@ -0,0 +1,371 @@
+/*!
+ * @file       sessionstore.cpp
+ * @brief      Defines the SharedSessionStore class
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 14, 2026
+ * @copyright  Copyright &copy; 2026 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2026 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#include "fastcgi++/sessionstore.hpp"
+#include "fastcgi++/log.hpp"
+
+#include <atomic>
+#include <thread>
+#include <limits>
+#include <cstring>
+#include <cerrno>
+#include <chrono>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+struct Fastcgipp::Http::SharedSessionStore::Header
+{
+    //! Amount of slots in the table
+    std::atomic<uint64_t> slots;
+
+    //! Maximum size of serialized session data
+    std::atomic<uint64_t> slotSize;
+};
+
+struct Fastcgipp::Http::SharedSessionStore::Slot
+{
+    //! Sequence number in the low half and owner in the high half
+    /*!
+     * The sequence number is odd while the slot is being written to. The
+     * owner is the ID of the process writing to it.
+     */
+    std::atomic<uint64_t> lock;
+
+    //! Size of the serialized session data
+    uint32_t size;
+
+    //! Time of last access. Zero means the slot is empty.
+    std::atomic<int64_t> timestamp;
+
+    //! Session ID data
+    unsigned char id[SessionId::size];
+
+    //! Serialized session data follows the slot
+    char* data()
+    {
+        return reinterpret_cast<char*>(this+1);
+    }
+
+    const char* data() const
+    {
+        return reinterpret_cast<const char*>(this+1);
+    }
+};
+
+namespace
+{
+    //! Space reserved at the start of the mapping for the header
+    const size_t headerSize = 64;
+
+    //! Sequence number part of a slot lock
+    const uint64_t sequenceMask = 0xffffffff;
+
+    //! How long a slot can be locked before it's owner is checked on
+    const std::chrono::milliseconds checkAfter(1);
+
+    //! How long a slot can be locked before it is taken from a live owner
+    const std::chrono::seconds abandonAfter(10);
+
+    //! Owner part of a slot lock for this process
+    inline uint64_t self()
+    {
+        return uint64_t(::getpid())<<32;
+    }
+}
+
+Fastcgipp::Http::SharedSessionStore::SharedSessionStore(
+        const std::string& name,
+        size_t slots,
+        size_t slotSize):
+    m_slots(slots?slots:1),
+    m_slotSize(slotSize),
+    m_stride((sizeof(Slot)+slotSize+63)/64*64),
+    m_length(headerSize+m_slots*m_stride),
+    m_memory(nullptr)
+{
+    static_assert(
+            sizeof(Header) <= headerSize,
+            "SharedSessionStore header doesn't fit");
+
+    const int fd = ::shm_open(name.c_str(), O_RDWR|O_CREAT, 0600);
+    if(fd == -1)
+        FAIL_LOG("Unable to open shared session store " << name << ": " \
+                << std::strerror(errno))
+
+    struct stat status;
+    if(::fstat(fd, &status) == -1)
+        FAIL_LOG("Unable to stat shared session store " << name << ": " \
+                << std::strerror(errno))
+    if(size_t(status.st_size) < m_length && ::ftruncate(fd, m_length) == -1)
+        FAIL_LOG("Unable to size shared session store " << name << ": " \
+                << std::strerror(errno))
+
+    void* const memory = ::mmap(
+            nullptr,
+            m_length,
+            PROT_READ | PROT_WRITE,
+            MAP_SHARED,
+            fd,
+            0);
+    ::close(fd);
+    if(memory == MAP_FAILED)
+        FAIL_LOG("Unable to map shared session store " << name << ": " \
+                << std::strerror(errno))
+    m_memory = static_cast<unsigned char*>(memory);
+
+    Header& header = *reinterpret_cast<Header*>(m_memory);
+    uint64_t existing = 0;
+    header.slots.compare_exchange_strong(existing, m_slots);
+    if(existing != 0 && existing != m_slots)
+        FAIL_LOG("Shared session store " << name << " has " << existing \
+                << " slots instead of " << m_slots)
+    existing = 0;
+    header.slotSize.compare_exchange_strong(existing, m_slotSize);
+    if(existing != 0 && existing != m_slotSize)
+        FAIL_LOG("Shared session store " << name << " has a slot size of " \
+                << existing << " instead of " << m_slotSize)
+}
+
+Fastcgipp::Http::SharedSessionStore::~SharedSessionStore()
+{
+    ::munmap(m_memory, m_length);
+}
+
+Fastcgipp::Http::SharedSessionStore::Slot&
+Fastcgipp::Http::SharedSessionStore::slot(size_t index) const
+{
+    return *reinterpret_cast<Slot*>(m_memory+headerSize+index*m_stride);
+}
+
+size_t Fastcgipp::Http::SharedSessionStore::home(const SessionId& id) const
+{
+    uint64_t hash;
+    std::memcpy(&hash, id.data().data(), sizeof(hash));
+    return hash%m_slots;
+}
+
+void Fastcgipp::Http::SharedSessionStore::lock(Slot& slot)
+{
+    Stuck stuck;
+    while(true)
+    {
+        uint64_t word = slot.lock.load(std::memory_order_relaxed);
+        if(word&1)
+        {
+            if(wait(slot, word, stuck))
+                return;
+        }
+        else if(slot.lock.compare_exchange_weak(
+                    word,
+                    ((word+1)&sequenceMask) | self(),
+                    std::memory_order_acquire))
+            return;
+    }
+}
+
+void Fastcgipp::Http::SharedSessionStore::unlock(Slot& slot)
+{
+    uint64_t word = slot.lock.load(std::memory_order_relaxed);
+
+    // Somebody took the lock over because we held it for far too long
+    if((word&~sequenceMask) != self())
+        return;
+    slot.lock.compare_exchange_strong(
+            word,
+            (word+1)&sequenceMask,
+            std::memory_order_release);
+}
+
+bool Fastcgipp::Http::SharedSessionStore::wait(
+        Slot& slot,
+        uint64_t word,
+        Stuck& stuck)
+{
+    const auto now = std::chrono::steady_clock::now();
+    if(word != stuck.word)
+    {
+        stuck.word = word;
+        stuck.since = now;
+    }
+    else if(now-stuck.since >= checkAfter)
+    {
+        const pid_t owner = pid_t(word>>32);
+        const bool dead = owner != ::getpid()
+            && ::kill(owner, 0) == -1
+            && errno == ESRCH;
+        if((dead || now-stuck.since >= abandonAfter)
+                && slot.lock.compare_exchange_strong(
+                    word,
+                    (word&sequenceMask) | self(),
+                    std::memory_order_acquire))
+        {
+            WARNING_LOG("Recovering shared session store slot abandoned " \
+                    "mid write by process " << owner)
+            std::fill(slot.id, slot.id+SessionId::size, 0);
+            slot.timestamp.store(0, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    std::this_thread::yield();
+    return false;
+}
+
+int64_t Fastcgipp::Http::SharedSessionStore::read(
+        const Slot& slot,
+        const SessionId& id,
+        bool& match,
+        std::string* data) const
+{
+    Stuck stuck;
+    while(true)
+    {
+        const uint64_t word = slot.lock.load(std::memory_order_acquire);
+        if(word&1)
+        {
+            // A writer died on us so the slot is now empty
+            Slot& writable = const_cast<Slot&>(slot);
+            if(wait(writable, word, stuck))
+                unlock(writable);
+            continue;
+        }
+
+        const int64_t timestamp = slot.timestamp.load(
+                std::memory_order_relaxed);
+        match = timestamp != 0
+            && std::memcmp(slot.id, id.data().data(), SessionId::size) == 0;
+        if(match && data)
+            data->assign(
+                    slot.data(),
+                    std::min(size_t(slot.size), m_slotSize));
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if(slot.lock.load(std::memory_order_relaxed) == word)
+            return timestamp;
+    }
+}
+
+bool Fastcgipp::Http::SharedSessionStore::insert(
+        const SessionId& id,
+        const std::string& data,
+        std::time_t now)
+{
+    if(data.size() > m_slotSize)
+    {
+        ERROR_LOG("Session data of " << data.size() << " bytes doesn't fit " \
+                "in a shared session store slot of " << m_slotSize \
+                << " bytes")
+        return true;
+    }
+
+    while(true)
+    {
+        size_t oldest = 0;
+        int64_t oldestTime = std::numeric_limits<int64_t>::max();
+        for(size_t i=0; i<std::min(probes, m_slots); ++i)
+        {
+            const size_t index = (home(id)+i)%m_slots;
+            bool match;
+            const int64_t timestamp = read(slot(index), id, match, nullptr);
+            if(match)
+                return false;
+            if(timestamp < oldestTime)
+            {
+                oldest = index;
+                oldestTime = timestamp;
+            }
+        }
+
+        Slot& slot = this->slot(oldest);
+        lock(slot);
+        if(slot.timestamp.load(std::memory_order_relaxed) == oldestTime)
+        {
+            std::memcpy(slot.id, id.data().data(), SessionId::size);
+            slot.size = static_cast<uint32_t>(data.size());
+            std::memcpy(slot.data(), data.data(), data.size());
+            slot.timestamp.store(now, std::memory_order_relaxed);
+            unlock(slot);
+            return true;
+        }
+        unlock(slot);
+    }
+}
+
+bool Fastcgipp::Http::SharedSessionStore::fetch(
+        const SessionId& id,
+        std::time_t oldest,
+        std::time_t now,
+        std::string* data)
+{
+    for(size_t i=0; i<std::min(probes, m_slots); ++i)
+    {
+        Slot& slot = this->slot((home(id)+i)%m_slots);
+        bool match;
+        int64_t timestamp = read(slot, id, match, data);
+        if(match)
+        {
+            if(timestamp < oldest)
+                return false;
+            // Only refresh the session if nobody replaced it in the meantime
+            if(timestamp < now)
+                slot.timestamp.compare_exchange_strong(timestamp, now);
+            return true;
+        }
+    }
+    return false;
+}
+
+void Fastcgipp::Http::SharedSessionStore::erase(const SessionId& id)
+{
+    for(size_t i=0; i<std::min(probes, m_slots); ++i)
+    {
+        Slot& slot = this->slot((home(id)+i)%m_slots);
+        bool match;
+        read(slot, id, match, nullptr);
+        if(match)
+        {
+            lock(slot);
+            if(std::memcmp(slot.id, id.data().data(), SessionId::size) == 0)
+            {
+                std::fill(slot.id, slot.id+SessionId::size, 0);
+                slot.timestamp.store(0, std::memory_order_relaxed);
+            }
+            unlock(slot);
+            return;
+        }
+    }
+}
+
+bool Fastcgipp::Http::SharedSessionStore::remove(const std::string& name)
+{
+    return ::shm_unlink(name.c_str()) == 0;
+}
+
+const size_t Fastcgipp::Http::SharedSessionStore::probes;
@@ -28,11 +28,16 @@
 
 #include "fastcgi++/sockets.hpp"
 #include "fastcgi++/log.hpp"
+#include "fastcgi++/metrics.hpp"
 
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#ifdef FASTCGIPP_LINUX
+#include <sys/sendfile.h>
+#include <sys/eventfd.h>
+#endif
 #include <sys/socket.h>
 #include <netdb.h>
 #include <unistd.h>
@@ -40,6 +45,7 @@
 #include <pwd.h>
 #include <grp.h>
 #include <cstring>
+#include <algorithm>
 
 Fastcgipp::Socket::Socket(
         const socket_t& socket,
@@ -54,6 +60,8 @@ Fastcgipp::Socket::Socket(
                 << std::strerror(errno))
         close();
     }
+    else if(group.m_paused)
+        group.m_poll.mod(socket, false, false);
 }
 
 ssize_t Fastcgipp::Socket::read(char* buffer, size_t size) const
@@ -73,16 +81,12 @@ ssize_t Fastcgipp::Socket::read(char* buffer, size_t size) const
     }
     if(count == 0 && m_data->m_closing)
     {
-#if FASTCGIPP_LOG_LEVEL > 3
-        ++m_data->m_group.m_connectionRDHupCount;
-#endif
+        ++Metrics::socketHangups;
         close();
         return -1;
     }
 
-#if FASTCGIPP_LOG_LEVEL > 3
-    m_data->m_group.m_bytesReceived += count;
-#endif
+    Metrics::bytesReceived += count;
 
     return count;
 }
@@ -96,16 +100,104 @@ ssize_t Fastcgipp::Socket::write(const char* buffer, size_t size) const
     if(count<0)
     {
         if(errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            m_data->m_group.block(*m_data);
             return 0;
+        }
         WARNING_LOG("Socket write() error on fd " \
                 << m_data->m_socket << ": " << strerror(errno))
         close();
         return -1;
     }
 
-#if FASTCGIPP_LOG_LEVEL > 3
-    m_data->m_group.m_bytesSent += count;
+    if(size_t(count) < size)
+        m_data->m_group.block(*m_data);
+
+    Metrics::bytesSent += count;
+
+    return count;
+}
+
+ssize_t Fastcgipp::Socket::write(const iovec* buffers, size_t count) const
+{
+    if(!valid() || m_data->m_closing)
+        return -1;
+
+    msghdr message;
+    std::memset(&message, 0, sizeof(message));
+    message.msg_iov = const_cast<iovec*>(buffers);
+    message.msg_iovlen = count;
+
+    const ssize_t sent = ::sendmsg(m_data->m_socket, &message, MSG_NOSIGNAL);
+    if(sent<0)
+    {
+        if(errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            m_data->m_group.block(*m_data);
+            return 0;
+        }
+        WARNING_LOG("Socket write() error on fd " \
+                << m_data->m_socket << ": " << strerror(errno))
+        close();
+        return -1;
+    }
+
+    size_t size = 0;
+    for(size_t i=0; i<count; ++i)
+        size += buffers[i].iov_len;
+    if(size_t(sent) < size)
+        m_data->m_group.block(*m_data);
+
+    Metrics::bytesSent += sent;
+
+    return sent;
+}
+
+ssize_t Fastcgipp::Socket::write(int file, off_t& offset, size_t size) const
+{
+    if(!valid() || m_data->m_closing)
+        return -1;
+
+#ifdef FASTCGIPP_LINUX
+    const size_t attempted = size;
+    const ssize_t count = ::sendfile(m_data->m_socket, file, &offset, size);
+#else
+    // No portable sendfile() so bounce it through a buffer
+    char buffer[0x4000];
+    const size_t attempted = std::min(size, sizeof(buffer));
+    ssize_t count = ::pread(file, buffer, attempted, offset);
+    if(count > 0)
+    {
+        count = ::send(m_data->m_socket, buffer, count, MSG_NOSIGNAL);
+        if(count > 0)
+            offset += count;
+    }
 #endif
+    if(count<0)
+    {
+        if(errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            m_data->m_group.block(*m_data);
+            return 0;
+        }
+        WARNING_LOG("Socket sendfile() error on fd " \
+                << m_data->m_socket << ": " << strerror(errno))
+        close();
+        return -1;
+    }
+
+    if(count == 0 && size != 0)
+    {
+        WARNING_LOG("Socket sendfile() on fd " << m_data->m_socket \
+                << " ran out of file with " << size << " bytes to go")
+        close();
+        return -1;
+    }
+
+    if(size_t(count) < attempted)
+        m_data->m_group.block(*m_data);
+
+    Metrics::bytesSent += count;
 
     return count;
 }
@@ -114,15 +206,15 @@ void Fastcgipp::Socket::close() const
 {
     if(valid())
     {
-        ::shutdown(m_data->m_socket, SHUT_RDWR);
-        m_data->m_group.m_poll.del(m_data->m_socket);
-        ::close(m_data->m_socket);
-        m_data->m_valid = false;
-        m_data->m_group.m_sockets.erase(m_data->m_socket);
-#if FASTCGIPP_LOG_LEVEL > 3
-        if(!m_data->m_closing)
-            ++m_data->m_group.m_connectionKillCount;
-#endif
+        // We may be the very socket being erased so hold on to the data
+        const std::shared_ptr<Data> data(m_data);
+        ::shutdown(data->m_socket, SHUT_RDWR);
+        data->m_group.m_poll.del(data->m_socket);
+        ::close(data->m_socket);
+        data->m_valid = false;
+        data->m_group.erase(data->m_socket);
+        if(!data->m_closing)
+            ++Metrics::socketKills;
     }
 }
 
@@ -138,50 +230,71 @@ Fastcgipp::Socket::~Socket()
 }
 
 Fastcgipp::SocketGroup::SocketGroup():
+    m_timers(std::bind(&SocketGroup::wake, this)),
     m_waking(false),
     m_reuse(false),
     m_accept(true),
-    m_refreshListeners(false)
-#if FASTCGIPP_LOG_LEVEL > 3
-    ,m_incomingConnectionCount(0),
-    m_outgoingConnectionCount(0),
-    m_connectionKillCount(0),
-    m_connectionRDHupCount(0),
-    m_bytesSent(0),
-    m_bytesReceived(0)
-#endif
+    m_refreshListeners(false),
+    m_size(0),
+    m_paused(false),
+    m_queued(0),
+    m_nextGroup(0),
+    m_dedicated(false),
+    m_adoptive(false),
+    m_handOffListener(-1)
 {
     // Add our wakeup socket into the poll list
+#ifdef FASTCGIPP_LINUX
+    m_wakeSockets[0] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(m_wakeSockets[0] < 0)
+        FAIL_LOG("Unable to create SocketGroup wakeup eventfd: " \
+                << std::strerror(errno))
+    m_wakeSockets[1] = m_wakeSockets[0];
+#else
     socketpair(AF_UNIX, SOCK_STREAM, 0, m_wakeSockets);
+#endif
     m_poll.add(m_wakeSockets[1]);
+    if(m_timers.descriptor() >= 0)
+        m_poll.add(m_timers.descriptor());
     DIAG_LOG("SocketGroup::SocketGroup(): Initialized ")
 }
 
 Fastcgipp::SocketGroup::~SocketGroup()
 {
     close(m_wakeSockets[0]);
-    close(m_wakeSockets[1]);
+    if(m_wakeSockets[1] != m_wakeSockets[0])
+        close(m_wakeSockets[1]);
+    // Listen sockets may be shared with other processes so they are only ever
+    // closed. Shutting one down would shut it down for everyone.
     for(const auto& listener: m_listeners)
-    {
-        ::shutdown(listener, SHUT_RDWR);
         ::close(listener);
-    }
     for(const auto& filename: m_filenames)
         std::remove(filename.c_str());
+    if(m_handOffListener != -1)
+    {
+        ::close(m_handOffListener);
+        std::remove(m_handOffName.c_str());
+    }
+    for(const auto& adoptee: m_adoptees)
+    {
+        ::shutdown(adoptee, SHUT_RDWR);
+        ::close(adoptee);
+    }
 
     DIAG_LOG("SocketGroup::~SocketGroup(): Incoming sockets ======== " \
-            << m_incomingConnectionCount)
+            << Metrics::incomingConnections.value())
     DIAG_LOG("SocketGroup::~SocketGroup(): Outgoing sockets ======== " \
-            << m_outgoingConnectionCount)
+            << Metrics::outgoingConnections.value())
     DIAG_LOG("SocketGroup::~SocketGroup(): Locally closed sockets == " \
-            << m_connectionKillCount)
+            << Metrics::socketKills.value())
     DIAG_LOG("SocketGroup::~SocketGroup(): Remotely closed sockets = " \
-            << m_connectionRDHupCount)
+            << Metrics::socketHangups.value())
     DIAG_LOG("SocketGroup::~SocketGroup(): Remaining sockets ======= " \
-            << m_sockets.size())
-    DIAG_LOG("SocketGroup::~SocketGroup(): Bytes sent ===== " << m_bytesSent)
+            << m_size)
+    DIAG_LOG("SocketGroup::~SocketGroup(): Bytes sent ===== " \
+            << Metrics::bytesSent.value())
     DIAG_LOG("SocketGroup::~SocketGroup(): Bytes received = " \
-            << m_bytesReceived)
+            << Metrics::bytesReceived.value())
 }
 
 static void set_reuse(int sock)
@@ -301,6 +414,7 @@ bool Fastcgipp::SocketGroup::listen(
         return false;
     }
 
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL)|O_NONBLOCK);
     m_filenames.emplace_back(name);
     m_listeners.insert(fd);
     m_refreshListeners = true;
@@ -361,11 +475,293 @@ bool Fastcgipp::SocketGroup::listen(
         return false;
     }
 
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL)|O_NONBLOCK);
     m_listeners.insert(fd);
     m_refreshListeners = true;
     return true;
 }
 
+bool Fastcgipp::SocketGroup::handOff(
+        const char* name,
+        const std::function<void()>& callback)
+{
+    if(m_handOffListener != -1)
+    {
+        ERROR_LOG("Already waiting on \"" << m_handOffName.c_str() \
+                << "\" to hand off listeners")
+        return false;
+    }
+
+    if(std::remove(name) != 0 && errno != ENOENT)
+    {
+        ERROR_LOG("Unable to delete file \"" << name << "\": " \
+                << std::strerror(errno))
+        return false;
+    }
+
+    const auto fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd == -1)
+    {
+        ERROR_LOG("Unable to create unix socket: " << std::strerror(errno))
+        return false;
+    }
+
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, name, sizeof(address.sun_path) - 1);
+
+    // Nobody but us gets to connect and take our listeners
+    if(bind(
+                fd,
+                reinterpret_cast<struct sockaddr*>(&address),
+                sizeof(address)) < 0
+            || chmod(name, 0600) < 0
+            || ::listen(fd, 1) < 0)
+    {
+        ERROR_LOG("Unable to listen on hand off socket \"" << name << "\": " \
+                << std::strerror(errno));
+        close(fd);
+        std::remove(name);
+        return false;
+    }
+
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL)|O_NONBLOCK);
+    if(!m_poll.add(fd))
+    {
+        ERROR_LOG("Unable to add hand off socket to the poll list: " \
+                << std::strerror(errno))
+        close(fd);
+        std::remove(name);
+        return false;
+    }
+
+    m_handOffListener = fd;
+    m_handOffName = name;
+    m_handedOff = callback;
+    return true;
+}
+
+void Fastcgipp::SocketGroup::handOff()
+{
+    const socket_t connection = ::accept(m_handOffListener, nullptr, nullptr);
+    if(connection == -1)
+    {
+        if(errno != EAGAIN && errno != EWOULDBLOCK)
+            ERROR_LOG("Unable to accept on hand off socket: " \
+                    << std::strerror(errno))
+        return;
+    }
+
+    // Make sure the new process is running as the same user we are
+#ifdef FASTCGIPP_LINUX
+    ucred credentials;
+    socklen_t length = sizeof(credentials);
+    const bool identified = getsockopt(
+            connection,
+            SOL_SOCKET,
+            SO_PEERCRED,
+            &credentials,
+            &length) == 0;
+    const uid_t user = credentials.uid;
+#else
+    uid_t user;
+    gid_t group;
+    const bool identified = getpeereid(connection, &user, &group) == 0;
+#endif
+    if(!identified || user != geteuid())
+    {
+        WARNING_LOG("Refusing to hand off listeners to another user")
+        close(connection);
+        return;
+    }
+
+    const std::vector<int> listeners(m_listeners.cbegin(), m_listeners.cend());
+    if(listeners.empty() || listeners.size() > maxHandOff)
+    {
+        ERROR_LOG("Unable to hand off " << listeners.size() << " listeners")
+        close(connection);
+        return;
+    }
+
+    // Send the names of our named sockets along so they get cleaned up
+    std::string names;
+    for(const auto& filename: m_filenames)
+    {
+        names += filename;
+        names += '\0';
+    }
+    if(names.empty())
+        names += '\0';
+
+    std::vector<char> control(CMSG_SPACE(sizeof(int)*listeners.size()));
+    iovec vector;
+    vector.iov_base = &names[0];
+    vector.iov_len = names.size();
+    msghdr message;
+    std::memset(&message, 0, sizeof(message));
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+    message.msg_control = control.data();
+    message.msg_controllen = control.size();
+    cmsghdr* const header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(int)*listeners.size());
+    std::memcpy(
+            CMSG_DATA(header),
+            listeners.data(),
+            sizeof(int)*listeners.size());
+
+    ssize_t sent = sendmsg(connection, &message, MSG_NOSIGNAL);
+    while(sent >= 0 && size_t(sent) < names.size())
+    {
+        const ssize_t more = send(
+                connection,
+                names.data()+sent,
+                names.size()-sent,
+                MSG_NOSIGNAL);
+        sent = more<0 ? more : sent+more;
+    }
+    if(sent < 0)
+    {
+        ERROR_LOG("Unable to hand off listeners: " << std::strerror(errno))
+        close(connection);
+        return;
+    }
+    close(connection);
+
+    for(const auto& listener: m_listeners)
+    {
+        m_poll.del(listener);
+        close(listener);
+    }
+    m_listeners.clear();
+    m_filenames.clear();
+
+    m_poll.del(m_handOffListener);
+    close(m_handOffListener);
+    std::remove(m_handOffName.c_str());
+    m_handOffListener = -1;
+
+    INFO_LOG("Handed off " << listeners.size() << " listeners")
+    if(m_handedOff)
+        m_handedOff();
+}
+
+bool Fastcgipp::SocketGroup::inherit(const char* name)
+{
+    const auto fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd == -1)
+    {
+        ERROR_LOG("Unable to create unix socket: " << std::strerror(errno))
+        return false;
+    }
+
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, name, sizeof(address.sun_path) - 1);
+
+    if(::connect(
+                fd,
+                reinterpret_cast<struct sockaddr*>(&address),
+                sizeof(address))==-1)
+    {
+        WARNING_LOG("Unable to connect to hand off socket \"" << name \
+                << "\": " << std::strerror(errno));
+        close(fd);
+        return false;
+    }
+
+    char buffer[4096];
+    std::vector<char> control(CMSG_SPACE(sizeof(int)*maxHandOff));
+    iovec vector;
+    vector.iov_base = buffer;
+    vector.iov_len = sizeof(buffer);
+    msghdr message;
+    std::memset(&message, 0, sizeof(message));
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+    message.msg_control = control.data();
+    message.msg_controllen = control.size();
+
+    ssize_t received;
+    do
+        received = recvmsg(fd, &message, 0);
+    while(received < 0 && errno == EINTR);
+    if(received < 0)
+    {
+        ERROR_LOG("Unable to receive listeners from \"" << name << "\": " \
+                << std::strerror(errno))
+        close(fd);
+        return false;
+    }
+
+    std::vector<int> listeners;
+    for(
+            cmsghdr* header = CMSG_FIRSTHDR(&message);
+            header != nullptr;
+            header = CMSG_NXTHDR(&message, header))
+        if(header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS)
+        {
+            const size_t count = (header->cmsg_len-CMSG_LEN(0))/sizeof(int);
+            const size_t offset = listeners.size();
+            listeners.resize(offset+count);
+            std::memcpy(
+                    listeners.data()+offset,
+                    CMSG_DATA(header),
+                    count*sizeof(int));
+        }
+    if(message.msg_flags & MSG_CTRUNC)
+        ERROR_LOG("Some listeners from \"" << name << "\" were lost")
+
+    std::string names(buffer, received);
+    while(received > 0)
+    {
+        received = recv(fd, buffer, sizeof(buffer), 0);
+        if(received > 0)
+            names.append(buffer, received);
+    }
+    close(fd);
+
+    for(const int listener: listeners)
+    {
+        fcntl(listener, F_SETFL, fcntl(listener, F_GETFL)|O_NONBLOCK);
+        m_listeners.insert(listener);
+    }
+    for(size_t start=0; start<names.size();)
+    {
+        const size_t end = std::min(names.find('\0', start), names.size());
+        if(end > start)
+            m_filenames.emplace_back(names, start, end-start);
+        start = end+1;
+    }
+    m_refreshListeners = true;
+
+    INFO_LOG("Inherited " << listeners.size() << " listeners")
+    return !listeners.empty();
+}
+
+bool Fastcgipp::SocketGroup::inherit(const socket_t listener)
+{
+    if(m_listeners.find(listener) != m_listeners.end())
+    {
+        ERROR_LOG("Socket " << listener << " already being listened to")
+        return false;
+    }
+
+    if(fcntl(listener, F_SETFL, fcntl(listener, F_GETFL)|O_NONBLOCK) < 0)
+    {
+        ERROR_LOG("Unable to inherit listen socket " << listener << ": " \
+                << std::strerror(errno))
+        return false;
+    }
+    m_listeners.insert(listener);
+    m_refreshListeners = true;
+    return true;
+}
+
 Fastcgipp::Socket Fastcgipp::SocketGroup::connect(const char* name)
 {
     const auto fd = socket(AF_UNIX, SOCK_STREAM, 0);
@@ -391,13 +787,9 @@ Fastcgipp::Socket Fastcgipp::SocketGroup::connect(const char* name)
         return Socket();
     }
 
-#if FASTCGIPP_LOG_LEVEL > 3
-    ++m_outgoingConnectionCount;
-#endif
+    ++Metrics::outgoingConnections;
 
-    return m_sockets.emplace(
-            fd,
-            Socket(fd, *this)).first->second;
+    return insert(fd);
 }
 
 Fastcgipp::Socket Fastcgipp::SocketGroup::connect(
@@ -454,18 +846,14 @@ Fastcgipp::Socket Fastcgipp::SocketGroup::connect(
         return Socket();
     }
 
-#if FASTCGIPP_LOG_LEVEL > 3
-    ++m_outgoingConnectionCount;
-#endif
+    ++Metrics::outgoingConnections;
 
-    return m_sockets.emplace(
-            fd,
-            Socket(fd, *this)).first->second;
+    return insert(fd);
 }
 
 Fastcgipp::Socket Fastcgipp::SocketGroup::poll(bool block)
 {
-    while(m_listeners.size()+m_sockets.size() > 0)
+    while(m_listeners.size()+m_size > 0 || m_adoptive)
     {
         if(m_refreshListeners)
         {
@@ -479,15 +867,37 @@ Fastcgipp::Socket Fastcgipp::SocketGroup::poll(bool block)
             m_refreshListeners=false;
         }
 
-        const auto result = m_poll.poll(block?-1:0);
+        // Without a timerfd the poll has to time out for the timers
+        int timeout = block?-1:0;
+        if(m_timers.descriptor() < 0)
+        {
+            const int remaining = m_timers.timeout();
+            if(remaining == 0)
+            {
+                m_timers.expire();
+                break;
+            }
+            if(block && remaining > 0)
+                timeout = remaining;
+        }
+
+        const auto result = m_poll.poll(timeout);
+
+        if(!result && timeout > 0)
+            continue;
 
         if(result)
         {
-            if(m_listeners.find(result.socket()) != m_listeners.end())
+            if(result.socket() == m_timers.descriptor())
+            {
+                m_timers.expire();
+                break;
+            }
+            else if(m_listeners.find(result.socket()) != m_listeners.end())
             {
                 if(result.onlyIn())
                 {
-                    createSocket(result.socket());
+                    createSockets(result.socket());
                     continue;
                 }
                 else if(result.err())
@@ -498,16 +908,36 @@ Fastcgipp::Socket Fastcgipp::SocketGroup::poll(bool block)
                     FAIL_LOG("Got a weird event 0x" << std::hex \
                             << result.events() << " on listen poll." )
             }
+            else if(result.socket() == m_handOffListener)
+            {
+                handOff();
+                continue;
+            }
             else if(result.socket() == m_wakeSockets[1])
             {
                 if(result.onlyIn())
                 {
-                    std::lock_guard<std::mutex> lock(m_wakingMutex);
+                    // Clear the flag only once the wake is read out so
+                    // that a wake() in between can't get lost
+#ifdef FASTCGIPP_LINUX
+                    uint64_t x;
+                    if(read(m_wakeSockets[1], &x, sizeof(x))<1
+                            && errno != EAGAIN)
+#else
                     char x[256];
                     if(read(m_wakeSockets[1], x, 256)<1)
+#endif
                         FAIL_LOG("Unable to read out of SocketGroup wakeup socket: " << \
                                 std::strerror(errno))
                     m_waking=false;
+
+                    std::deque<socket_t> adoptees;
+                    {
+                        std::lock_guard<std::mutex> lock(m_adopteesMutex);
+                        adoptees.swap(m_adoptees);
+                    }
+                    for(const auto adoptee: adoptees)
+                        insert(adoptee);
                     block=false;
                     continue;
                 }
@@ -518,8 +948,8 @@ Fastcgipp::Socket Fastcgipp::SocketGroup::poll(bool block)
             }
             else
             {
-                const auto socket = m_sockets.find(result.socket());
-                if(socket == m_sockets.end())
+                if(size_t(result.socket()) >= m_sockets.size()
+                        || !m_sockets[result.socket()].valid())
                 {
                     ERROR_LOG("Poll gave fd " << result.socket() \
                             << " which isn't in m_sockets.")
@@ -527,23 +957,36 @@ Fastcgipp::Socket Fastcgipp::SocketGroup::poll(bool block)
                     close(result.socket());
                     continue;
                 }
+                const Socket& socket = m_sockets[result.socket()];
+
+                if(result.out())
+                {
+                    socket.m_data->m_blocked=false;
+                    m_poll.mod(result.socket(), false, !m_paused);
+                    if(!(result.in() || result.rdHup() || result.hup()
+                                || result.err()))
+                    {
+                        block=false;
+                        continue;
+                    }
+                }
 
                 if(result.rdHup())
-                    socket->second.m_data->m_closing=true;
+                    socket.m_data->m_closing=true;
                 else if(result.hup())
                 {
                     WARNING_LOG("Socket " << result.socket() << " hung up")
-                    socket->second.m_data->m_closing=true;
+                    socket.m_data->m_closing=true;
                 }
                 else if(result.err())
                 {
                     ERROR_LOG("Error in socket " << result.socket())
-                    socket->second.m_data->m_closing=true;
+                    socket.m_data->m_closing=true;
                 }
                 else if(!result.in())
                     FAIL_LOG("Got a weird event 0x" << std::hex \
                             << result.events() << " on socket poll." )
-                return socket->second;
+                return socket;
             }
         }
         break;
@@ -553,52 +996,122 @@ Fastcgipp::Socket Fastcgipp::SocketGroup::poll(bool block)
 
 void Fastcgipp::SocketGroup::wake()
 {
-    std::lock_guard<std::mutex> lock(m_wakingMutex);
-    if(!m_waking)
+    if(!m_waking.exchange(true))
     {
-        m_waking=true;
+#ifdef FASTCGIPP_LINUX
+        static const uint64_t x=1;
+#else
         static const char x=0;
-        if(write(m_wakeSockets[0], &x, 1) != 1)
+#endif
+        if(write(m_wakeSockets[0], &x, sizeof(x)) != sizeof(x))
             FAIL_LOG("Unable to write to wakeup socket in SocketGroup: " \
                     << std::strerror(errno))
     }
 }
 
-void Fastcgipp::SocketGroup::createSocket(const socket_t listener)
+void Fastcgipp::SocketGroup::block(Socket::Data& data)
 {
-    sockaddr_un addr;
-    socklen_t addrlen=sizeof(sockaddr_un);
-    const socket_t socket=::accept(
-            listener,
-            reinterpret_cast<sockaddr*>(&addr),
-            &addrlen);
-    if(socket<0)
-        FAIL_LOG("Unable to accept() with fd " \
-                << listener << ": " \
-                << std::strerror(errno))
-    if(fcntl(
-            socket,
-            F_SETFL,
-            fcntl(socket, F_GETFL)|O_NONBLOCK)
-            < 0)
-    {
-        ERROR_LOG("Unable to set NONBLOCK on fd " << socket \
-                << " with fcntl(): " << std::strerror(errno))
-        close(socket);
-        return;
+    if(!data.m_blocked)
+    {
+        data.m_blocked = true;
+        if(!m_poll.mod(data.m_socket, true, !m_paused))
+            ERROR_LOG("Unable to poll socket " << data.m_socket \
+                    << " for writability: " << std::strerror(errno))
     }
+}
 
-    if(m_accept)
+void Fastcgipp::SocketGroup::createSockets(const socket_t listener)
+{
+    for(unsigned i=0; i<acceptBatch; ++i)
     {
-        m_sockets.emplace(
+#ifdef FASTCGIPP_LINUX
+        const socket_t socket=::accept4(
+                listener,
+                nullptr,
+                nullptr,
+                SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+        const socket_t socket=::accept(listener, nullptr, nullptr);
+#endif
+        if(socket<0)
+        {
+            if(errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            if(errno == EINTR || errno == ECONNABORTED || errno == EPROTO)
+                continue;
+            FAIL_LOG("Unable to accept() with fd " \
+                    << listener << ": " \
+                    << std::strerror(errno))
+        }
+#ifndef FASTCGIPP_LINUX
+        if(fcntl(
                 socket,
-                Socket(socket, *this));
-#if FASTCGIPP_LOG_LEVEL > 3
-        ++m_incomingConnectionCount;
+                F_SETFL,
+                fcntl(socket, F_GETFL)|O_NONBLOCK)
+                < 0)
+        {
+            ERROR_LOG("Unable to set NONBLOCK on fd " << socket \
+                    << " with fcntl(): " << std::strerror(errno))
+            close(socket);
+            continue;
+        }
 #endif
+
+        if(!m_accept)
+        {
+            close(socket);
+            continue;
+        }
+
+        const size_t groups = m_groups.size() + (m_dedicated?0:1);
+        const size_t group = m_nextGroup++ % groups + (m_dedicated?1:0);
+        if(group == 0)
+            insert(socket);
+        else
+            m_groups[group-1]->adopt(socket);
+        ++Metrics::incomingConnections;
     }
-    else
-        close(socket);
+}
+
+Fastcgipp::Socket Fastcgipp::SocketGroup::insert(const socket_t socket)
+{
+    Socket created(socket, *this);
+    if(!created.valid())
+        return Socket();
+    if(size_t(socket) >= m_sockets.size())
+        m_sockets.resize(socket+1);
+    m_sockets[socket] = std::move(created);
+    ++m_size;
+    return m_sockets[socket];
+}
+
+void Fastcgipp::SocketGroup::erase(const socket_t socket)
+{
+    if(size_t(socket) < m_sockets.size() && m_sockets[socket].m_data)
+    {
+        m_sockets[socket] = Socket();
+        --m_size;
+    }
+}
+
+void Fastcgipp::SocketGroup::distribute(
+        const std::vector<SocketGroup*>& groups,
+        bool dedicated)
+{
+    m_groups = groups;
+    m_nextGroup = 0;
+    m_dedicated = dedicated && !m_groups.empty();
+    for(auto& group: m_groups)
+        group->m_adoptive = true;
+}
+
+void Fastcgipp::SocketGroup::adopt(const socket_t socket)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_adopteesMutex);
+        m_adoptees.push_back(socket);
+    }
+    wake();
 }
 
 Fastcgipp::Socket::Socket():
@@ -606,6 +1119,39 @@ Fastcgipp::Socket::Socket():
     m_original(false)
 {}
 
+void Fastcgipp::Socket::enqueued(size_t bytes) const
+{
+    if(m_data)
+    {
+        m_data->m_queued += bytes;
+        m_data->m_group.m_queued += bytes;
+    }
+}
+
+void Fastcgipp::Socket::dequeued(size_t bytes) const
+{
+    if(m_data)
+    {
+        m_data->m_queued -= bytes;
+        m_data->m_group.m_queued -= bytes;
+    }
+}
+
+void Fastcgipp::SocketGroup::pause(bool status)
+{
+    if(status == m_paused)
+        return;
+    m_paused = status;
+    for(const auto& socket: m_sockets)
+        if(socket.valid() && !m_poll.mod(
+                    socket.m_data->m_socket,
+                    socket.m_data->m_blocked,
+                    !m_paused))
+            ERROR_LOG("Unable to change polling of socket " \
+                    << socket.m_data->m_socket \
+                    << ": " << std::strerror(errno))
+}
+
 void Fastcgipp::SocketGroup::accept(bool status)
 {
     if(status != m_accept)
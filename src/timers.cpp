@@ -0,0 +1,331 @@
+/*!
+ * @file       timers.cpp
+ * @brief      Defines the Timers class
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 14, 2026
+ * @copyright  Copyright &copy; 2026 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2026 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#include "fastcgi++/timers.hpp"
+#include "fastcgi++/log.hpp"
+#include "fastcgi++/metrics.hpp"
+
+#include <cstring>
+#include <cerrno>
+#ifdef FASTCGIPP_LINUX
+#include <sys/timerfd.h>
+#include <unistd.h>
+#endif
+
+const std::chrono::microseconds Fastcgipp::Timers::resolution(1000);
+const uint32_t Fastcgipp::Timers::npos;
+const uint64_t Fastcgipp::Timers::never;
+
+Fastcgipp::Timers::Timers(const std::function<void()>& wake):
+    m_free(npos),
+    m_now(0),
+    m_origin(Clock::now()),
+    m_armed(never),
+    m_size(0),
+    m_fd(-1),
+    m_wake(wake)
+{
+    std::fill(std::begin(m_heads), std::end(m_heads), npos);
+    std::memset(m_occupied, 0, sizeof(m_occupied));
+#ifdef FASTCGIPP_LINUX
+    m_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if(m_fd < 0)
+        FAIL_LOG("Unable to create timerfd: " << std::strerror(errno))
+#endif
+}
+
+Fastcgipp::Timers::~Timers()
+{
+    Metrics::pendingTimers.sub(m_size);
+#ifdef FASTCGIPP_LINUX
+    close(m_fd);
+#endif
+}
+
+Fastcgipp::Timers::Id Fastcgipp::Timers::add(
+        Clock::time_point when,
+        std::function<void()> callback)
+{
+    const auto offset = when-m_origin;
+    uint64_t expiry = 0;
+    if(offset > Clock::duration::zero())
+        expiry = (offset+resolution-Clock::duration(1))/resolution;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    uint32_t node = m_free;
+    if(node == npos)
+    {
+        node = m_nodes.size();
+        m_nodes.emplace_back();
+        m_nodes.back().generation = 0;
+    }
+    else
+        m_free = m_nodes[node].next;
+
+    Node& x = m_nodes[node];
+    x.callback = std::move(callback);
+    x.expiry = std::max(expiry, m_now+1);
+    x.active = true;
+    link(node);
+    ++m_size;
+    ++Metrics::pendingTimers;
+
+    if(x.expiry < m_armed)
+        arm();
+
+    return (uint64_t(x.generation) << 32) | (uint64_t(node)+1);
+}
+
+bool Fastcgipp::Timers::cancel(Id id)
+{
+    const uint64_t index = (id & 0xffffffff);
+    if(index == 0)
+        return false;
+    const uint32_t node = index-1;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(node >= m_nodes.size())
+        return false;
+    Node& x = m_nodes[node];
+    if(!x.active || x.generation != (id >> 32))
+        return false;
+
+    unlink(node);
+    x.callback = nullptr;
+    x.active = false;
+    ++x.generation;
+    x.next = m_free;
+    m_free = node;
+    --m_size;
+    --Metrics::pendingTimers;
+    if(!m_size)
+        arm();
+    return true;
+}
+
+size_t Fastcgipp::Timers::size() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_size;
+}
+
+int Fastcgipp::Timers::timeout() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(m_armed == never)
+        return -1;
+    const auto remaining = m_origin+m_armed*resolution-Clock::now();
+    if(remaining <= Clock::duration::zero())
+        return 0;
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+            remaining+std::chrono::milliseconds(1)
+            -Clock::duration(1)).count();
+}
+
+void Fastcgipp::Timers::expire()
+{
+#ifdef FASTCGIPP_LINUX
+    uint64_t expirations;
+    if(read(m_fd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN)
+        ERROR_LOG("Unable to read from timerfd: " << std::strerror(errno))
+#endif
+
+    std::vector<std::function<void()>> expired;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        advance((Clock::now()-m_origin)/resolution);
+        m_armed = never;
+        arm();
+        expired.swap(m_expired);
+    }
+
+    for(auto& callback: expired)
+        callback();
+
+    // Hand the storage back for next time
+    expired.clear();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(m_expired.empty())
+        m_expired.swap(expired);
+}
+
+void Fastcgipp::Timers::link(uint32_t node)
+{
+    Node& x = m_nodes[node];
+
+    const uint64_t difference = x.expiry ^ m_now;
+    unsigned level = 0;
+    while(level < levels && (difference >> (slotBits*(level+1))))
+        ++level;
+    if(level == levels)
+        x.slot = overflow;
+    else
+    {
+        const unsigned slot = (x.expiry >> (slotBits*level)) & (slots-1);
+        x.slot = level*slots+slot;
+        m_occupied[level][slot/64] |= uint64_t(1) << (slot%64);
+    }
+
+    x.prev = npos;
+    x.next = m_heads[x.slot];
+    if(x.next != npos)
+        m_nodes[x.next].prev = node;
+    m_heads[x.slot] = node;
+}
+
+void Fastcgipp::Timers::unlink(uint32_t node)
+{
+    Node& x = m_nodes[node];
+
+    if(x.prev != npos)
+        m_nodes[x.prev].next = x.next;
+    else
+        m_heads[x.slot] = x.next;
+    if(x.next != npos)
+        m_nodes[x.next].prev = x.prev;
+
+    if(x.slot != overflow && m_heads[x.slot] == npos)
+    {
+        const unsigned level = x.slot/slots;
+        const unsigned slot = x.slot%slots;
+        m_occupied[level][slot/64] &= ~(uint64_t(1) << (slot%64));
+    }
+}
+
+uint64_t Fastcgipp::Timers::next() const
+{
+    // A timer in a level is always in a slot after the current one so the
+    // first occupied slot found from the bottom up is the next thing to do.
+    // Above level zero that is when the slot has to be cascaded down.
+    for(unsigned level=0; level<levels; ++level)
+    {
+        const unsigned shift = slotBits*level;
+        const unsigned current = (m_now >> shift) & (slots-1);
+        for(unsigned word=(current+1)/64; word<slots/64; ++word)
+        {
+            uint64_t bits = m_occupied[level][word];
+            if(word == (current+1)/64)
+                bits &= ~uint64_t(0) << ((current+1)%64);
+            if(bits)
+            {
+                const uint64_t slot = word*64+__builtin_ctzll(bits);
+                const unsigned span = shift+slotBits;
+                return ((m_now >> span) << span) | (slot << shift);
+            }
+        }
+    }
+    if(m_heads[overflow] != npos)
+    {
+        const unsigned span = slotBits*levels;
+        return ((m_now >> span)+1) << span;
+    }
+    return never;
+}
+
+void Fastcgipp::Timers::advance(uint64_t target)
+{
+    while(m_now < target)
+    {
+        const uint64_t tick = m_size ? next() : never;
+        if(tick > target)
+        {
+            m_now = target;
+            break;
+        }
+        m_now = tick;
+
+        // Cascade everything whose level just came around, top down so
+        // that timers can fall through more than one level
+        for(unsigned level=levels; level>0; --level)
+        {
+            const unsigned shift = slotBits*level;
+            if(m_now & ((uint64_t(1) << shift)-1))
+                continue;
+            const unsigned slot = level==levels?
+                overflow:
+                level*slots+((m_now >> shift) & (slots-1));
+            uint32_t node = m_heads[slot];
+            while(node != npos)
+            {
+                const uint32_t following = m_nodes[node].next;
+                unlink(node);
+                link(node);
+                node = following;
+            }
+        }
+
+        const unsigned slot = m_now & (slots-1);
+        uint32_t node = m_heads[slot];
+        while(node != npos)
+        {
+            Node& x = m_nodes[node];
+            const uint32_t following = x.next;
+            unlink(node);
+            m_expired.push_back(std::move(x.callback));
+            x.callback = nullptr;
+            x.active = false;
+            ++x.generation;
+            x.next = m_free;
+            m_free = node;
+            --m_size;
+            --Metrics::pendingTimers;
+            node = following;
+        }
+    }
+}
+
+void Fastcgipp::Timers::arm()
+{
+    const uint64_t tick = m_size ? next() : never;
+    if(tick == m_armed)
+        return;
+    m_armed = tick;
+
+#ifdef FASTCGIPP_LINUX
+    itimerspec spec;
+    std::memset(&spec, 0, sizeof(spec));
+    if(tick != never)
+    {
+        const auto when = (m_origin+tick*resolution).time_since_epoch();
+        const auto seconds
+            = std::chrono::duration_cast<std::chrono::seconds>(when);
+        spec.it_value.tv_sec = seconds.count();
+        spec.it_value.tv_nsec
+            = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    when-seconds).count();
+        if(spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0)
+            spec.it_value.tv_nsec = 1;
+    }
+    if(timerfd_settime(m_fd, TFD_TIMER_ABSTIME, &spec, nullptr) < 0)
+        ERROR_LOG("Unable to arm timerfd: " << std::strerror(errno))
+#else
+    if(m_wake)
+        m_wake();
+#endif
+}
@@ -0,0 +1,234 @@
+/*!
+ * @file       topic.cpp
+ * @brief      Defines the Topic class
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 15, 2026
+ * @copyright  Copyright &copy; 2026 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2026 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#include "fastcgi++/topic.hpp"
+#include "fastcgi++/log.hpp"
+#include "fastcgi++/metrics.hpp"
+
+#include <algorithm>
+#include <utility>
+
+namespace
+{
+    //! Request ID output is encoded with before it is needed for any other
+    const Fastcgipp::Protocol::FcgiId encodedId = 1;
+
+    //! Thread safe topics()
+    std::mutex& topicsMutex()
+    {
+        static std::mutex mutex;
+        return mutex;
+    }
+
+    //! Every topic in existence so aborted requests can be found
+    std::vector<Fastcgipp::Topic*>& topics()
+    {
+        static std::vector<Fastcgipp::Topic*> topics;
+        return topics;
+    }
+}
+
+Fastcgipp::Topic::Topic(size_t backlog):
+    m_backlog(backlog)
+{
+    std::lock_guard<std::mutex> lock(topicsMutex());
+    topics().push_back(this);
+}
+
+Fastcgipp::Topic::~Topic()
+{
+    {
+        std::lock_guard<std::mutex> lock(topicsMutex());
+        topics().erase(std::find(topics().begin(), topics().end(), this));
+    }
+    close();
+}
+
+void Fastcgipp::Topic::subscribe(Subscriber&& subscriber)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_subscribers.push_back(std::move(subscriber));
+    ++Metrics::subscribers;
+}
+
+void Fastcgipp::Topic::publish(const char* data, size_t size)
+{
+    // An empty record would end the output
+    if(size == 0)
+        return;
+
+    const size_t total = Protocol::getRecordsSize(size);
+    std::shared_ptr<char> records(BlockPool::share(total));
+    Protocol::encodeRecords(
+            Protocol::RecordType::OUT,
+            encodedId,
+            data,
+            size,
+            records.get());
+
+    // Copies of the records for subscribers with other request IDs
+    std::vector<std::pair<Protocol::FcgiId, std::shared_ptr<char>>> copies;
+    const auto recordsFor = [&] (Protocol::FcgiId id)
+        -> const std::shared_ptr<char>&
+    {
+        if(id == encodedId)
+            return records;
+        for(const auto& copy: copies)
+            if(copy.first == id)
+                return copy.second;
+
+        copies.emplace_back(id, BlockPool::share(total));
+        char* const copy = copies.back().second.get();
+        std::copy(records.get(), records.get()+total, copy);
+        for(char* record=copy; record != copy+total;)
+        {
+            Protocol::Header& header
+                = *reinterpret_cast<Protocol::Header*>(record);
+            header.fcgiId = id;
+            record += sizeof(header)+header.contentLength
+                +header.paddingLength;
+        }
+        return copies.back().second;
+    };
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto kept = m_subscribers.begin();
+    for(auto& subscriber: m_subscribers)
+    {
+        const Socket& socket = subscriber.id.m_socket;
+        if(!socket.valid())
+        {
+            --Metrics::subscribers;
+            continue;
+        }
+        if(socket.queued() > m_backlog)
+        {
+            WARNING_LOG("Dropping subscriber with " << socket.queued() \
+                    << " bytes waiting to be sent")
+            end(subscriber);
+            --Metrics::subscribers;
+            ++Metrics::subscriberDrops;
+            continue;
+        }
+
+        const std::shared_ptr<char>& shared = recordsFor(subscriber.id.m_id);
+        subscriber.send(socket, Block(shared, shared.get(), total), false);
+        if(&*kept != &subscriber)
+            *kept = std::move(subscriber);
+        ++kept;
+    }
+    m_subscribers.erase(kept, m_subscribers.end());
+}
+
+void Fastcgipp::Topic::event(
+        const std::string& data,
+        const std::string& type,
+        const std::string& id)
+{
+    std::string text;
+    text.reserve(data.size()+type.size()+id.size()+32);
+    if(!id.empty())
+    {
+        text += "id: ";
+        text += id;
+        text += '\n';
+    }
+    if(!type.empty())
+    {
+        text += "event: ";
+        text += type;
+        text += '\n';
+    }
+    size_t line = 0;
+    do
+    {
+        const size_t lineEnd = std::min(data.find('\n', line), data.size());
+        text += "data: ";
+        text.append(data, line, lineEnd-line);
+        text += '\n';
+        line = lineEnd+1;
+    } while(line <= data.size());
+    text += '\n';
+    publish(text);
+}
+
+void Fastcgipp::Topic::close()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for(const auto& subscriber: m_subscribers)
+        if(subscriber.id.m_socket.valid())
+            end(subscriber);
+    Metrics::subscribers.sub(m_subscribers.size());
+    m_subscribers.clear();
+}
+
+bool Fastcgipp::Topic::abort(const Protocol::RequestId& id)
+{
+    std::lock_guard<std::mutex> topicsLock(topicsMutex());
+    for(Topic* topic: topics())
+    {
+        std::lock_guard<std::mutex> lock(topic->m_mutex);
+        const auto subscriber = std::find_if(
+                topic->m_subscribers.begin(),
+                topic->m_subscribers.end(),
+                [&id] (const Subscriber& subscriber)
+                {
+                    return subscriber.id.m_id == id.m_id
+                        && subscriber.id.m_socket == id.m_socket;
+                });
+        if(subscriber != topic->m_subscribers.end())
+        {
+            end(*subscriber);
+            topic->m_subscribers.erase(subscriber);
+            --Metrics::subscribers;
+            return true;
+        }
+    }
+    return false;
+}
+
+void Fastcgipp::Topic::end(const Subscriber& subscriber)
+{
+    Block record(sizeof(Protocol::Header)+sizeof(Protocol::EndRequest));
+
+    Protocol::Header& header
+        = *reinterpret_cast<Protocol::Header*>(record.begin());
+    header.version = Protocol::version;
+    header.type = Protocol::RecordType::END_REQUEST;
+    header.fcgiId = subscriber.id.m_id;
+    header.contentLength = sizeof(Protocol::EndRequest);
+    header.paddingLength = 0;
+    header.reserved = 0;
+
+    Protocol::EndRequest& body = *reinterpret_cast<Protocol::EndRequest*>(
+            record.begin()+sizeof(header));
+    body.appStatus = 0;
+    body.protocolStatus = Protocol::ProtocolStatus::REQUEST_COMPLETE;
+
+    subscriber.send(subscriber.id.m_socket, std::move(record), subscriber.kill);
+}
@@ -29,177 +29,419 @@
 #include "fastcgi++/transceiver.hpp"
 
 #include "fastcgi++/log.hpp"
-bool Fastcgipp::Transceiver::transmit()
+
+#include <climits>
+
+void Fastcgipp::Transceiver::transmit(Loop& loop)
 {
-    std::unique_ptr<Record> record;
+    {
+        std::lock_guard<std::mutex> lock(loop.sendBufferMutex);
+        loop.pending.swap(loop.sendBuffer);
+    }
+    for(auto& record: loop.pending)
+    {
+        auto& requests = loop.sendQueues[record->socket];
+        auto request = std::find_if(
+                requests.begin(),
+                requests.end(),
+                [&record] (const RequestQueue& x)
+                {
+                    return x.id == record->id;
+                });
+        if(request == requests.end())
+        {
+            requests.emplace_back();
+            request = requests.end()-1;
+            request->id = record->id;
+        }
+        request->records.push_back(std::move(record));
+    }
+    loop.pending.clear();
 
-    while(!m_sendBuffer.empty())
+    static const char zeros[0x100] = {};
+    static const size_t npos = ~size_t(0);
+
+    auto queue = loop.sendQueues.begin();
+    while(queue != loop.sendQueues.end())
     {
+        const Socket socket(queue->first);
+        auto& requests = queue->second;
+
+        if(socket.blocked())
         {
-            std::lock_guard<std::mutex> lock(m_sendBufferMutex);
-            record = std::move(m_sendBuffer.front());
-            m_sendBuffer.pop_front();
+            ++queue;
+            continue;
         }
 
-        const ssize_t sent = record->socket.write(
-                record->read,
-                record->data.end()-record->read);
-        if(sent>=0)
+        // Take records from each request in turn
+        loop.vectors.clear();
+        loop.gathered.clear();
+        size_t size = 0;
+        bool full = false;
+        for(size_t depth=0; !full; ++depth)
         {
-            record->read += sent;
-            if(record->read != record->data.end())
+            bool found = false;
+            for(size_t i=0; i<requests.size(); ++i)
             {
+                if(depth >= requests[i].records.size())
+                    continue;
+                found = true;
+                if(loop.vectors.size() == IOV_MAX)
                 {
-                    std::lock_guard<std::mutex> lock(m_sendBufferMutex);
-                    m_sendBuffer.push_front(std::move(record));
+                    full = true;
+                    break;
+                }
+                const Record& record = *requests[i].records[depth];
+                if(record.read != record.data.end())
+                {
+                    loop.vectors.emplace_back();
+                    loop.vectors.back().iov_base
+                        = const_cast<char*>(record.read);
+                    loop.vectors.back().iov_len
+                        = record.data.end()-record.read;
+                    size += loop.vectors.back().iov_len;
+                }
+                loop.gathered.push_back(i);
+                if(record.kill || record.trailing())
+                {
+                    full = true;
+                    break;
                 }
-                return false;
             }
-#if FASTCGIPP_LOG_LEVEL > 3
-            ++m_recordsSent;
-#endif
-            if(record->kill)
+            if(!found)
+                break;
+        }
+
+        ssize_t sent = 0;
+        if(!loop.vectors.empty())
+            sent = socket.write(loop.vectors.data(), loop.vectors.size());
+        if(sent<0)
+        {
+            queue = loop.sendQueues.erase(queue);
+            continue;
+        }
+        if(sent>0 && m_idleTimeout.count())
+        {
+            const auto buffer = loop.receiveBuffers.find(socket);
+            if(buffer != loop.receiveBuffers.end())
+                buffer->second.active = Timers::Clock::now();
+        }
+
+        // Anything trailing the data can only be sent once everything before
+        // it has been
+        bool partial = size_t(sent) != size;
+        size_t unfinished = npos;
+        size_t remaining = sent;
+        for(const size_t i: loop.gathered)
+        {
+            Record& record = *requests[i].records.front();
+            const size_t recordSize = record.data.end()-record.read;
+            if(remaining < recordSize)
             {
-                record->socket.close();
-                m_receiveBuffers.erase(record->socket);
-#if FASTCGIPP_LOG_LEVEL > 3
-                ++m_connectionKillCount;
-#endif
+                record.read += remaining;
+                if(record.read != record.data.begin())
+                    unfinished = i;
+                break;
             }
+            remaining -= recordSize;
+            record.read = record.data.end();
+            unfinished = i;
+
+            if(record.trailing())
+            {
+                if(partial)
+                    break;
+
+                while(record.fileSize)
+                {
+                    const ssize_t fileSent = socket.write(
+                            *record.file,
+                            record.fileOffset,
+                            record.fileSize);
+                    if(fileSent<=0)
+                        break;
+                    record.fileSize -= fileSent;
+                }
+                while(!record.fileSize && record.padding)
+                {
+                    const ssize_t paddingSent = socket.write(
+                            zeros,
+                            record.padding);
+                    if(paddingSent<=0)
+                        break;
+                    record.padding -= paddingSent;
+                }
+                if(!socket.valid())
+                {
+                    sent = -1;
+                    break;
+                }
+                if(record.trailing())
+                {
+                    partial = true;
+                    break;
+                }
+            }
+
+            unfinished = npos;
+            ++Metrics::recordsSent;
+            Metrics::sendTime.since(record.created);
+            if(record.kill)
+            {
+                socket.close();
+                loop.receiveBuffers.erase(socket);
+                requests.clear();
+                ++Metrics::connectionKills;
+                break;
+            }
+            requests[i].records.pop_front();
         }
-    }
 
-    return true;
+        if(sent<0 || requests.empty())
+        {
+            queue = loop.sendQueues.erase(queue);
+            continue;
+        }
+
+        // Whoever has a record on the wire goes first. Otherwise the next
+        // request gets to.
+        if(unfinished != npos)
+            std::rotate(
+                    requests.begin(),
+                    requests.begin()+unfinished,
+                    requests.end());
+        else
+            std::rotate(
+                    requests.begin(),
+                    requests.begin()+1,
+                    requests.end());
+        requests.erase(
+                std::remove_if(
+                    requests.begin(),
+                    requests.end(),
+                    [] (const RequestQueue& x)
+                    {
+                        return x.records.empty();
+                    }),
+                requests.end());
+
+        if(requests.empty())
+            queue = loop.sendQueues.erase(queue);
+        else if(partial)
+            ++queue;
+    }
 }
 
-void Fastcgipp::Transceiver::handler()
+void Fastcgipp::Transceiver::handler(Loop& loop)
 {
-    bool flushed=false;
     Socket socket;
 
-    while(!m_terminate && !(m_stop && m_sockets.size()==0))
+    if(!m_cpus.empty())
+        m_cpus.pin(std::find_if(
+                    m_loops.cbegin(),
+                    m_loops.cend(),
+                    [&loop] (const std::unique_ptr<Loop>& other)
+                    {
+                        return other.get() == &loop;
+                    }) - m_loops.cbegin());
+
+    while(!m_terminate && !(m_stop && loop.sockets.size()==0))
     {
-        socket = m_sockets.poll(flushed);
-        receive(socket);
-        flushed = transmit();
+        transmit(loop);
+        if(m_sendLimit)
+            throttle(loop);
+        socket = loop.sockets.poll(true);
+        receive(loop, socket);
     }
 }
 
+void Fastcgipp::Transceiver::throttle(Loop& loop)
+{
+    const size_t queued = loop.sockets.queued();
+    if(!loop.sockets.paused())
+    {
+        if(queued <= m_sendLimit)
+            return;
+        WARNING_LOG("Pausing reads with " << queued << " bytes queued")
+        loop.sockets.pause(true);
+        ++Metrics::readPauses;
+    }
+    else if(queued <= m_sendLimit/2)
+        loop.sockets.pause(false);
+}
+
 void Fastcgipp::Transceiver::stop()
 {
     m_stop=true;
-    m_sockets.accept(false);
+    m_loops.front()->sockets.accept(false);
+    for(auto& loop: m_loops)
+        loop->sockets.wake();
 }
 
 void Fastcgipp::Transceiver::terminate()
 {
     m_terminate=true;
-    m_sockets.wake();
+    for(auto& loop: m_loops)
+        loop->sockets.wake();
 }
 
 void Fastcgipp::Transceiver::start()
 {
     m_stop=false;
     m_terminate=false;
-    m_sockets.accept(true);
-    if(!m_thread.joinable())
-    {
-        std::thread thread(&Fastcgipp::Transceiver::handler, this);
-        m_thread.swap(thread);
-    }
+    m_loops.front()->sockets.accept(true);
+    for(auto& loop: m_loops)
+        if(!loop->thread.joinable())
+        {
+            std::thread thread(
+                    &Fastcgipp::Transceiver::handler,
+                    this,
+                    std::ref(*loop));
+            loop->thread.swap(thread);
+        }
 }
 
 void Fastcgipp::Transceiver::join()
 {
-    if(m_thread.joinable())
+    for(auto& loop: m_loops)
+        if(loop->thread.joinable())
+            loop->thread.join();
+}
+
+void Fastcgipp::Transceiver::resizeLoops(unsigned loops, bool acceptor)
+{
+    for(const auto& loop: m_loops)
+        if(loop->thread.joinable())
+            return;
+
+    m_loops.resize(std::max(loops, 1U) + (acceptor?1:0));
+    std::vector<SocketGroup*> groups;
+    for(auto loop = m_loops.begin()+1; loop != m_loops.end(); ++loop)
     {
-        m_thread.join();
+        if(!*loop)
+            loop->reset(new Loop);
+        groups.push_back(&(*loop)->sockets);
     }
+    m_loops.front()->sockets.distribute(groups, acceptor);
 }
 
 Fastcgipp::Transceiver::Transceiver(
         const std::function<void(Protocol::RequestId, Message&&)> sendMessage):
-    m_sendMessage(sendMessage)
-#if FASTCGIPP_LOG_LEVEL > 3
-    ,m_connectionKillCount(0),
-    m_connectionRDHupCount(0),
-    m_recordsSent(0),
-    m_recordsQueued(0),
-    m_recordsReceived(0)
-#endif
+    m_loops(1),
+    m_sendMessage(sendMessage),
+    m_sendLimit(0),
+    m_idleTimeout(0)
 {
+    m_loops.front().reset(new Loop);
     DIAG_LOG("Transceiver::Transciever(): Initialized")
 }
 
-void Fastcgipp::Transceiver::receive(Socket& socket)
+void Fastcgipp::Transceiver::receive(Loop& loop, Socket& socket)
 {
     if(socket.valid())
     {
-        Block& buffer=m_receiveBuffers[socket];
+        ReceiveBuffer& buffer=loop.receiveBuffers[socket];
 
-        // Are we receiving a header?
-        if(buffer.size() < sizeof(Protocol::Header))
+        if(m_idleTimeout.count())
         {
-            buffer.reserve(sizeof(Protocol::Header));
-
-            const ssize_t read = socket.read(
-                    buffer.begin()+buffer.size(),
-                    buffer.reserve()-buffer.size());
-            if(read<0)
+            buffer.active = Timers::Clock::now();
+            if(!buffer.watched)
             {
-                cleanupSocket(socket);
-                return;
+                buffer.watched = true;
+                loop.sockets.timers().add(
+                        buffer.active+m_idleTimeout,
+                        std::bind(
+                            &Transceiver::idle,
+                            this,
+                            std::ref(loop),
+                            socket));
             }
-            buffer.size(buffer.size() + read);
-            if(buffer.size() < sizeof(Protocol::Header))
-                return;
         }
 
-        if(buffer.size() == sizeof(Protocol::Header))
-            buffer.reserve(sizeof(Protocol::Header)
-                +reinterpret_cast<Protocol::Header*>(
-                    buffer.begin())->contentLength
-                +reinterpret_cast<Protocol::Header*>(
-                    buffer.begin())->paddingLength);
-
-        Protocol::Header& header
-            = *reinterpret_cast<Protocol::Header*>(buffer.begin());
+        if(buffer.begin == buffer.end && buffer.data.use_count() == 1)
+            buffer.begin = buffer.end = 0;
+        else if(!buffer.data || buffer.end == s_receiveSize)
+        {
+            std::shared_ptr<char> data(BlockPool::share(s_receiveSize));
+            if(buffer.data)
+                std::copy(
+                        buffer.data.get()+buffer.begin,
+                        buffer.data.get()+buffer.end,
+                        data.get());
+            buffer.end -= buffer.begin;
+            buffer.begin = 0;
+            buffer.data = std::move(data);
+        }
 
         const ssize_t read = socket.read(
-                buffer.begin()+buffer.size(),
-                buffer.reserve()-buffer.size());
-
+                buffer.data.get()+buffer.end,
+                s_receiveSize-buffer.end);
         if(read<0)
         {
-            cleanupSocket(socket);
+            cleanupSocket(loop, socket);
             return;
         }
-        buffer.size(buffer.size() + read);
-        if(buffer.size() < buffer.reserve())
-            return;
+        buffer.end += read;
 
-        Message message;
-        message.data = std::move(buffer);
+        while(buffer.end-buffer.begin >= sizeof(Protocol::Header))
+        {
+            char* const begin = buffer.data.get()+buffer.begin;
+            const Protocol::Header& header
+                = *reinterpret_cast<const Protocol::Header*>(begin);
+            const size_t size = sizeof(Protocol::Header)
+                + header.contentLength
+                + header.paddingLength;
+            if(buffer.end-buffer.begin < size)
+                break;
 
-        m_sendMessage(
-                Protocol::RequestId(header.fcgiId, socket),
-                std::move(message));
-#if FASTCGIPP_LOG_LEVEL > 3
-        ++m_recordsReceived;
-#endif
+            Message message;
+            message.data = Block(buffer.data, begin, size);
+            buffer.begin += size;
+
+            ++Metrics::recordsReceived(static_cast<unsigned>(header.type));
+            m_sendMessage(
+                    Protocol::RequestId(header.fcgiId, socket),
+                    std::move(message));
+        }
     }
 }
 
-void Fastcgipp::Transceiver::cleanupSocket(const Socket& socket)
+void Fastcgipp::Transceiver::cleanupSocket(
+        Loop& loop,
+        const Socket& socket)
 {
-    m_receiveBuffers.erase(socket);
+    loop.receiveBuffers.erase(socket);
     m_sendMessage(
             Fastcgipp::Protocol::RequestId(Protocol::badFcgiId, socket),
             Message());
     socket.close();
-#if FASTCGIPP_LOG_LEVEL > 3
-    ++m_connectionRDHupCount;
-#endif
+    ++Metrics::connectionHangups;
+}
+
+void Fastcgipp::Transceiver::idle(Loop& loop, const Socket& socket)
+{
+    const auto buffer = loop.receiveBuffers.find(socket);
+    if(buffer == loop.receiveBuffers.end() || !socket.valid())
+        return;
+
+    const auto now = Timers::Clock::now();
+    auto deadline = buffer->second.active+m_idleTimeout;
+    if(loop.sendQueues.find(socket) != loop.sendQueues.end())
+        deadline = now+m_idleTimeout;
+    if(deadline > now)
+    {
+        loop.sockets.timers().add(
+                deadline,
+                std::bind(&Transceiver::idle, this, std::ref(loop), socket));
+        return;
+    }
+
+    loop.receiveBuffers.erase(buffer);
+    m_sendMessage(
+            Fastcgipp::Protocol::RequestId(Protocol::badFcgiId, socket),
+            Message());
+    socket.close();
+    ++Metrics::idleKills;
 }
 
 void Fastcgipp::Transceiver::send(
@@ -207,33 +449,66 @@ void Fastcgipp::Transceiver::send(
         Block&& data,
         bool kill)
 {
-    std::unique_ptr<Record> record(new Record(
+    enqueue(std::unique_ptr<Record>(new Record(
+                socket,
+                std::move(data),
+                kill)));
+}
+
+void Fastcgipp::Transceiver::sendFile(
+        const Socket& socket,
+        Block&& data,
+        const std::shared_ptr<const int>& file,
+        off_t offset,
+        size_t size)
+{
+    enqueue(std::unique_ptr<Record>(new Record(
                 socket,
                 std::move(data),
-                kill));
+                file,
+                offset,
+                size)));
+}
+
+void Fastcgipp::Transceiver::enqueue(std::unique_ptr<Record>&& record)
+{
+    Loop* loop = m_loops.front().get();
+    if(m_loops.size() > 1)
+        for(auto& candidate: m_loops)
+            if(record->socket.member(candidate->sockets))
+            {
+                loop = candidate.get();
+                break;
+            }
+
     {
-        std::lock_guard<std::mutex> lock(m_sendBufferMutex);
-        m_sendBuffer.push_back(std::move(record));
+        std::lock_guard<std::mutex> lock(loop->sendBufferMutex);
+        loop->sendBuffer.push_back(std::move(record));
     }
-    m_sockets.wake();
-#if FASTCGIPP_LOG_LEVEL > 3
-    ++m_recordsQueued;
-#endif
+    loop->sockets.wake();
+    ++Metrics::recordsQueued;
 }
 
 Fastcgipp::Transceiver::~Transceiver()
 {
     terminate();
     DIAG_LOG("Transceiver::~Transceiver(): Locally closed sockets ==== " \
-            << m_connectionKillCount)
+            << Metrics::connectionKills.value())
     DIAG_LOG("Transceiver::~Transceiver(): Remotely closed sockets === " \
-            << m_connectionRDHupCount)
-    DIAG_LOG("Transceiver::~Transceiver(): Remaining receive buffers = " \
-            << m_receiveBuffers.size())
+            << Metrics::connectionHangups.value())
+    DIAG_LOG("Transceiver::~Transceiver(): Event loops ============= " \
+            << m_loops.size())
     DIAG_LOG("Transceiver::~Transceiver(): Records queued === " \
-            << m_recordsQueued)
+            << Metrics::recordsQueued.value())
     DIAG_LOG("Transceiver::~Transceiver(): Records sent ===== " \
-            << m_recordsSent)
+            << Metrics::recordsSent.value())
+#if FASTCGIPP_LOG_LEVEL > 3
+    long long received = 0;
+    const unsigned types
+        = static_cast<unsigned>(Protocol::RecordType::UNKNOWN_TYPE);
+    for(unsigned type=0; type<=types; ++type)
+        received += Metrics::recordsReceived(type).value();
+#endif
     DIAG_LOG("Transceiver::~Transceiver(): Records received = " \
-            << m_recordsReceived)
+            << received)
 }
@@ -27,6 +27,7 @@
 
 #include "fastcgi++/webstreambuf.hpp"
 #include "fastcgi++/log.hpp"
+#include "fastcgi++/scan.hpp"
 
 #include <algorithm>
 
@@ -57,87 +58,137 @@ std::basic_ostream<charT, traits>& Fastcgipp::operator<<(
     return os;
 }
 
-namespace Fastcgipp
+namespace
 {
-    template <>
-    const std::map<char, const std::basic_string<char>>
-    Fastcgipp::WebStreambuf<char, std::char_traits<char>>::htmlCharacters
+    //! Escape sequence for a single character
+    struct Escape
     {
-        std::make_pair('"', "&quot;"),
-        std::make_pair('>', "&gt;"),
-        std::make_pair('<', "&lt;"),
-        std::make_pair('&', "&amp;"),
-        std::make_pair(0x27, "&apos;")
+        //! Size of the escape sequence. Zero if no escaping is needed.
+        unsigned char size;
+
+        //! The escape sequence itself
+        char text[7];
     };
 
-    template <>
-    const std::map<wchar_t, const std::basic_string<wchar_t>>
-    Fastcgipp::WebStreambuf<wchar_t, std::char_traits<wchar_t>>::htmlCharacters
+    //! Escape sequences for every byte value of an encoding
+    struct Escapes
     {
-        std::make_pair('"', L"&quot;"),
-        std::make_pair('>', L"&gt;"),
-        std::make_pair('<', L"&lt;"),
-        std::make_pair('&', L"&amp;"),
-        std::make_pair(0x27, L"&apos;")
+        Escape entries[256];
+
+        constexpr void assign(unsigned char character, const char* text)
+        {
+            Escape& escape = entries[character];
+            escape.size = 0;
+            while(text[escape.size])
+            {
+                escape.text[escape.size] = text[escape.size];
+                ++escape.size;
+            }
+        }
+
+        constexpr void assignHex(
+                unsigned char character,
+                const char* prefix)
+        {
+            const char hex[] = "0123456789ABCDEF";
+            char text[7] = {};
+            unsigned size = 0;
+            while(prefix[size])
+            {
+                text[size] = prefix[size];
+                ++size;
+            }
+            text[size++] = hex[character>>4];
+            text[size++] = hex[character&0xf];
+            assign(character, text);
+        }
+
+        constexpr explicit Escapes(Fastcgipp::Encoding encoding):
+            entries{}
+        {
+            switch(encoding)
+            {
+                case Fastcgipp::Encoding::HTML:
+                {
+                    assign('"', "&quot;");
+                    assign('>', "&gt;");
+                    assign('<', "&lt;");
+                    assign('&', "&amp;");
+                    assign(0x27, "&apos;");
+                    break;
+                }
+                case Fastcgipp::Encoding::URL:
+                {
+                    const char characters[] = "!][#?/,$+=&@:;)('*<>\" %";
+                    for(unsigned i=0; characters[i]; ++i)
+                        assignHex(characters[i], "%");
+                    break;
+                }
+                case Fastcgipp::Encoding::JSON:
+                {
+                    for(unsigned char character=0; character<0x20; ++character)
+                        assignHex(character, "\\u00");
+                    assign('"', "\\\"");
+                    assign('\\', "\\\\");
+                    assign('\b', "\\b");
+                    assign('\f', "\\f");
+                    assign('\n', "\\n");
+                    assign('\r', "\\r");
+                    assign('\t', "\\t");
+                    break;
+                }
+                default:
+                    break;
+            }
+        }
+
+        //! True if the character needs escaping
+        constexpr bool operator()(unsigned char character) const
+        {
+            return entries[character].size != 0;
+        }
     };
 
-    template <>
-    const std::map<char, const std::basic_string<char>>
-    Fastcgipp::WebStreambuf<char, std::char_traits<char>>::urlCharacters
+    //! Everything needed to encode a stream
+    struct Table
     {
-        std::make_pair('!', "%21"),
-        std::make_pair(']', "%5D"),
-        std::make_pair('[', "%5B"),
-        std::make_pair('#', "%23"),
-        std::make_pair('?', "%3F"),
-        std::make_pair('/', "%2F"),
-        std::make_pair(',', "%2C"),
-        std::make_pair('$', "%24"),
-        std::make_pair('+', "%2B"),
-        std::make_pair('=', "%3D"),
-        std::make_pair('&', "%26"),
-        std::make_pair('@', "%40"),
-        std::make_pair(':', "%3A"),
-        std::make_pair(';', "%3B"),
-        std::make_pair(')', "%29"),
-        std::make_pair('(', "%28"),
-        std::make_pair(0x27, "%27"),
-        std::make_pair('*', "%2A"),
-        std::make_pair('<', "%3C"),
-        std::make_pair('>', "%3E"),
-        std::make_pair('"', "%22"),
-        std::make_pair(' ', "%20"),
-        std::make_pair('%', "%25")
+        //! Escape sequences indexed by character
+        const Escapes escapes;
+
+        //! Set of all characters that need escaping
+        const Fastcgipp::Scan::Set set;
+
+        constexpr explicit Table(Fastcgipp::Encoding encoding):
+            escapes(encoding),
+            set(escapes)
+        {}
     };
 
-    template <>
-    const std::map<wchar_t, const std::basic_string<wchar_t>>
-    Fastcgipp::WebStreambuf<wchar_t, std::char_traits<wchar_t>>::urlCharacters
+    constexpr Table htmlTable(Fastcgipp::Encoding::HTML);
+    constexpr Table urlTable(Fastcgipp::Encoding::URL);
+    constexpr Table jsonTable(Fastcgipp::Encoding::JSON);
+
+    //! Find the next character that needs escaping
+    inline const char* findEscape(
+            const char* start,
+            const char* end,
+            const Fastcgipp::Scan::Set& set)
     {
-        std::make_pair('!', L"%21"),
-        std::make_pair(']', L"%5D"),
-        std::make_pair('[', L"%5B"),
-        std::make_pair('#', L"%23"),
-        std::make_pair('?', L"%3F"),
-        std::make_pair('/', L"%2F"),
-        std::make_pair(',', L"%2C"),
-        std::make_pair('$', L"%24"),
-        std::make_pair('+', L"%2B"),
-        std::make_pair('=', L"%3D"),
-        std::make_pair('&', L"%26"),
-        std::make_pair('@', L"%40"),
-        std::make_pair(':', L"%3A"),
-        std::make_pair(';', L"%3B"),
-        std::make_pair(')', L"%29"),
-        std::make_pair('(', L"%28"),
-        std::make_pair(0x27, L"%27"),
-        std::make_pair('*', L"%2A"),
-        std::make_pair('<', L"%3C"),
-        std::make_pair('>', L"%3E"),
-        std::make_pair('"', L"%22"),
-        std::make_pair(' ', L"%20"),
-        std::make_pair('%', L"%25")
-    };
+        return Fastcgipp::Scan::findAny(start, end, set);
+    }
+
+    //! Find the next character that needs escaping
+    inline const wchar_t* findEscape(
+            const wchar_t* start,
+            const wchar_t* end,
+            const Fastcgipp::Scan::Set& set)
+    {
+        for(; start < end; ++start)
+            if(static_cast<unsigned long>(*start) < 0x80
+                    && set.contains(static_cast<unsigned char>(*start)))
+                return start;
+        return end;
+    }
 }
 
 template <class charT, class traits>
@@ -160,39 +211,45 @@ std::streamsize Fastcgipp::WebStreambuf<charT, traits>::xsputn(
         }
         else
         {
-            const std::map<charT, const std::basic_string<charT>>* map;
+            const Table* table;
             if(m_encoding == Encoding::HTML)
-                map = &htmlCharacters;
+                table = &htmlTable;
+            else if(m_encoding == Encoding::URL)
+                table = &urlTable;
             else
-                map = &urlCharacters;
+                table = &jsonTable;
 
             while(s<end)
             {
-                const size_t writeSpace = this->epptr() - this->pptr();
-                const auto mapping = map->find(*s);
-                if(mapping == map->cend())
-                {
-                    if(writeSpace < 1)
-                        break;
-                    *this->pptr() = *s++;
-                    this->pbump(1);
-                }
-                else
-                {
-                    if(writeSpace < mapping->second.size())
-                        break;
-                    std::copy(
-                            mapping->second.cbegin(),
-                            mapping->second.cend(),
-                            this->pptr());
-                    this->pbump(mapping->second.size());
-                    ++s;
-                }
+                // Copy out everything up to the next escape in one go
+                const char_type* const limit = s + std::min(
+                        end-s,
+                        this->epptr()-this->pptr());
+                const char_type* const run = findEscape(s, limit, table->set);
+                std::copy(s, run, this->pptr());
+                this->pbump(run-s);
+                s = run;
+                if(s == limit)
+                    break;
+
+                const Escape& escape = table->escapes.entries[
+                    static_cast<unsigned char>(*s)];
+                if(this->epptr()-this->pptr() < escape.size)
+                    break;
+                std::copy(
+                        escape.text,
+                        escape.text+escape.size,
+                        this->pptr());
+                this->pbump(escape.size);
+                ++s;
             }
         }
 
         if(s<end)
-            this->sync();
+        {
+            if(!emptyBuffer())
+                break;
+        }
         else
             break;
     }
@@ -0,0 +1,275 @@
+#include "fastcgi++/log.hpp"
+#include "fastcgi++/request.hpp"
+#include "fastcgi++/assetcache.hpp"
+
+#include <cstdio>
+#include <string>
+#include <utility>
+
+#include <unistd.h>
+
+namespace
+{
+    Fastcgipp::AssetCache assets;
+
+    //! Serves assets and says so when there isn't one
+    class Static: public Fastcgipp::Request<char>
+    {
+    public:
+        static unsigned responded;
+
+    private:
+        bool response()
+        {
+            if(asset(assets))
+                return true;
+            ++responded;
+            out << "Status: 404 Not Found\r\n\r\n";
+            return true;
+        }
+    };
+
+    unsigned Static::responded = 0;
+
+    //! Append a record to a message
+    void record(
+            Fastcgipp::Message& message,
+            Fastcgipp::Protocol::RecordType type,
+            Fastcgipp::Protocol::FcgiId id,
+            const std::string& content)
+    {
+        Fastcgipp::Block& data = message.data;
+        data.size(sizeof(Fastcgipp::Protocol::Header)+content.size());
+        Fastcgipp::Protocol::Header& header
+            = *reinterpret_cast<Fastcgipp::Protocol::Header*>(data.begin());
+        header.version = Fastcgipp::Protocol::version;
+        header.type = type;
+        header.fcgiId = id;
+        header.contentLength = content.size();
+        header.paddingLength = 0;
+        header.reserved = 0;
+        std::copy(
+                content.cbegin(),
+                content.cend(),
+                data.begin()+sizeof(header));
+    }
+
+    //! Request a path and return the output
+    std::string get(
+            const std::string& uri,
+            Fastcgipp::Protocol::FcgiId id=1,
+            const std::string& acceptEncoding=std::string(),
+            const std::string& ifNoneMatch=std::string())
+    {
+        std::string output;
+        bool ended = false;
+        Static request;
+        request.configure(
+                Fastcgipp::Protocol::RequestId(id, Fastcgipp::Socket()),
+                Fastcgipp::Protocol::Role::RESPONDER,
+                false,
+                [&output, &ended, id] (
+                    const Fastcgipp::Socket&,
+                    Fastcgipp::Block&& block,
+                    bool)
+                {
+                    const char* position = block.begin();
+                    while(position < block.end())
+                    {
+                        const Fastcgipp::Protocol::Header& header
+                            = *reinterpret_cast<
+                                const Fastcgipp::Protocol::Header*>(position);
+                        if(header.fcgiId != id)
+                            FAIL_LOG("Asset wasn't sent with our ID")
+                        if(header.type == Fastcgipp::Protocol::RecordType::OUT)
+                            output.append(
+                                    position+sizeof(header),
+                                    header.contentLength);
+                        else if(header.type
+                                == Fastcgipp::Protocol::RecordType::END_REQUEST)
+                            ended = true;
+                        position += sizeof(header)+header.contentLength
+                            +header.paddingLength;
+                    }
+                },
+                nullptr,
+                nullptr);
+
+        std::string params;
+        for(const auto& param: {
+                std::make_pair(
+                    std::string("REQUEST_METHOD"),
+                    std::string("GET")),
+                std::make_pair(std::string("REQUEST_URI"), uri),
+                std::make_pair(
+                    std::string("HTTP_ACCEPT_ENCODING"),
+                    acceptEncoding),
+                std::make_pair(
+                    std::string("HTTP_IF_NONE_MATCH"),
+                    ifNoneMatch)})
+        {
+            params += char(param.first.size());
+            params += char(param.second.size());
+            params += param.first;
+            params += param.second;
+        }
+
+        const auto send = [&request, id] (
+                Fastcgipp::Protocol::RecordType type,
+                const std::string& content)
+        {
+            Fastcgipp::Message message;
+            record(message, type, id, content);
+            return request.handle(std::move(message));
+        };
+
+        if(send(Fastcgipp::Protocol::RecordType::PARAMS, params)
+                || send(Fastcgipp::Protocol::RecordType::PARAMS, std::string())
+                || !send(Fastcgipp::Protocol::RecordType::IN, std::string()))
+            FAIL_LOG("Request didn't complete when it should have")
+        if(!ended)
+            FAIL_LOG("Request wasn't ended")
+        return output;
+    }
+
+    //! Value of a header in a response
+    std::string header(const std::string& response, const std::string& name)
+    {
+        const size_t start = response.find(name+": ");
+        if(start == std::string::npos
+                || start > response.find("\r\n\r\n"))
+            return std::string();
+        const size_t value = start+name.size()+2;
+        return response.substr(value, response.find("\r\n", value)-value);
+    }
+
+    //! Body of a response
+    std::string body(const std::string& response)
+    {
+        return response.substr(response.find("\r\n\r\n")+4);
+    }
+}
+
+int main()
+{
+    const std::string page(
+            "<!DOCTYPE html><html><body>"
+            + std::string(2000, 'x')
+            + "</body></html>");
+    assets.insert("/index.html", page.data(), page.size(), "text/html");
+
+    // Assets are served as is with the headers to go with them
+    {
+        const std::string response = get("/index.html?x=y");
+        if(body(response) != page)
+            FAIL_LOG("Asset wasn't served as is")
+        if(header(response, "Content-Type") != "text/html"
+                || header(response, "Content-Length")
+                    != std::to_string(page.size())
+                || !header(response, "Content-Encoding").empty()
+                || header(response, "ETag").empty())
+            FAIL_LOG("Asset headers are wrong. Got " << response.c_str())
+        if(get("/index.html", 9) != response)
+            FAIL_LOG("Asset wasn't patched with the request ID")
+        if(Static::responded != 0)
+            FAIL_LOG("Asset was responded to")
+
+        const std::string etag = header(response, "ETag");
+        if(etag.size() < 3 || etag.front() != '"' || etag.back() != '"')
+            FAIL_LOG("Asset ETag isn't quoted. Got " << etag.c_str())
+
+        const std::string notModified = get(
+                "/index.html",
+                1,
+                std::string(),
+                etag);
+        if(notModified.find("Status: 304 Not Modified\r\n") != 0
+                || header(notModified, "ETag") != etag
+                || header(notModified, "Vary") != header(response, "Vary")
+                || !body(notModified).empty())
+            FAIL_LOG("Matching ETag didn't get a 304 with the validators. "\
+                    "Got " << notModified.c_str())
+        if(get("/index.html", 1, std::string(), "W/"+etag) != notModified)
+            FAIL_LOG("Matching weak ETag didn't get a 304")
+
+        if(get("/missing") != "Status: 404 Not Found\r\n\r\n"
+                || Static::responded != 1)
+            FAIL_LOG("Missing asset was served")
+    }
+
+    // Compressed variants are served to those that accept them
+    for(const auto coding: {
+            Fastcgipp::Compression::GZIP,
+            Fastcgipp::Compression::BROTLI,
+            Fastcgipp::Compression::ZSTD})
+    {
+        const std::string name(Fastcgipp::Compressor::name(coding));
+        const std::string response = get("/index.html", 1, name);
+        if(!Fastcgipp::Compressor::supported(coding))
+        {
+            if(body(response) != page)
+                FAIL_LOG("Unsupported coding " << name.c_str() << " was used")
+            continue;
+        }
+        if(header(response, "Content-Encoding") != name
+                || header(response, "Vary") != "Accept-Encoding"
+                || body(response).size() >= page.size()
+                || header(response, "Content-Length")
+                    != std::to_string(body(response).size()))
+            FAIL_LOG("Asset wasn't compressed with " << name.c_str())
+        std::string etag = header(get("/index.html"), "ETag");
+        etag.insert(etag.size()-1, "-"+name);
+        if(header(response, "ETag") != etag)
+            FAIL_LOG("Compressed asset doesn't have it's own ETag. Got "\
+                    << header(response, "ETag").c_str())
+
+        const std::string notModified = get("/index.html", 1, name, etag);
+        if(notModified.find("Status: 304 Not Modified\r\n") != 0
+                || header(notModified, "ETag") != etag
+                || header(notModified, "Vary") != "Accept-Encoding")
+            FAIL_LOG("Compressed asset 304 doesn't have it's validators")
+    }
+
+    // Large assets span records and files are loaded with their details
+    {
+        const std::string filename = "/tmp/fastcgipp-assetcache-test-"
+            + std::to_string(::getpid()) + ".js";
+        std::string script;
+        for(unsigned i=0; script.size() < 200000; ++i)
+            script += "var x" + std::to_string(i) + "=" + std::to_string(i*i)
+                + ";\n";
+        std::FILE* file = std::fopen(filename.c_str(), "w");
+        std::fwrite(script.data(), 1, script.size(), file);
+        std::fclose(file);
+
+        if(assets.load("/missing.js", filename+".missing"))
+            FAIL_LOG("Missing file was loaded")
+        if(!assets.load("/app.js", filename))
+            FAIL_LOG("Unable to load " << filename.c_str())
+        ::unlink(filename.c_str());
+
+        const std::string response = get("/app.js", 3);
+        if(body(response) != script)
+            FAIL_LOG("Large asset wasn't served as is")
+        if(header(response, "Content-Type") != "text/javascript; charset=utf-8"
+                || header(response, "Last-Modified").empty())
+            FAIL_LOG("Loaded asset headers are wrong")
+
+        if(assets.size() != 2 || assets.bytes() <= script.size())
+            FAIL_LOG("Cache doesn't account for every asset")
+        assets.erase("/app.js");
+        if(assets.find("/app.js") || assets.size() != 1)
+            FAIL_LOG("Asset wasn't erased")
+        assets.clear();
+        if(assets.size() != 0 || assets.bytes() != 0)
+            FAIL_LOG("Cache wasn't cleared")
+    }
+
+    if(Fastcgipp::AssetCache::contentType("a.b/c") != std::string(
+                "application/octet-stream")
+            || Fastcgipp::AssetCache::contentType("x.PNG") != std::string(
+                "image/png"))
+        FAIL_LOG("Content type wasn't guessed properly")
+
+    return 0;
+}
@@ -0,0 +1,224 @@
+#include "fastcgi++/log.hpp"
+#include "fastcgi++/request.hpp"
+#include "fastcgi++/authorizationcache.hpp"
+
+#include <string>
+#include <vector>
+#include <utility>
+
+namespace
+{
+    Fastcgipp::AuthorizationCache decisions(std::chrono::seconds(60), 8, 2);
+
+    //! Lets in anyone with the right token
+    class Authorizer: public Fastcgipp::Request<char>
+    {
+    public:
+        static unsigned checked;
+
+    private:
+        Fastcgipp::AuthorizationCache* authorizationCache()
+        {
+            return &decisions;
+        }
+
+        std::string authorizationVariant()
+        {
+            return environment().requestUri;
+        }
+
+        bool response()
+        {
+            ++checked;
+            if(environment().authorization == "Bearer good")
+                out << "Status: 200 OK\r\nVariable-User: good\r\n\r\n";
+            else if(environment().authorization == "Bearer plain")
+                out << "Variable-User: plain\r\n\r\n";
+            else if(environment().authorization.empty())
+                out << "Status: 401 Unauthorized\r\n"
+                    "WWW-Authenticate: Bearer\r\n\r\n";
+            else if(environment().authorization == "Bearer broken")
+                out << "Content-Type: text/plain\r\n"
+                    "status: 500 Internal Server Error\r\n\r\n";
+            else
+                out << "Status: 403 Forbidden\r\n\r\n";
+            return true;
+        }
+    };
+
+    unsigned Authorizer::checked = 0;
+
+    //! Append a record to a message
+    void record(
+            Fastcgipp::Message& message,
+            Fastcgipp::Protocol::RecordType type,
+            Fastcgipp::Protocol::FcgiId id,
+            const std::string& content)
+    {
+        Fastcgipp::Block& data = message.data;
+        data.size(sizeof(Fastcgipp::Protocol::Header)+content.size());
+        Fastcgipp::Protocol::Header& header
+            = *reinterpret_cast<Fastcgipp::Protocol::Header*>(data.begin());
+        header.version = Fastcgipp::Protocol::version;
+        header.type = type;
+        header.fcgiId = id;
+        header.contentLength = content.size();
+        header.paddingLength = 0;
+        header.reserved = 0;
+        std::copy(
+                content.cbegin(),
+                content.cend(),
+                data.begin()+sizeof(header));
+    }
+
+    //! Run an authorization and return it's output
+    std::string authorize(
+            Fastcgipp::Protocol::FcgiId id,
+            const std::string& authorization,
+            const std::string& uri="/")
+    {
+        std::string output;
+        Authorizer authorizer;
+        authorizer.configure(
+                Fastcgipp::Protocol::RequestId(id, Fastcgipp::Socket()),
+                Fastcgipp::Protocol::Role::AUTHORIZER,
+                false,
+                [&output, id] (
+                    const Fastcgipp::Socket&,
+                    Fastcgipp::Block&& block,
+                    bool)
+                {
+                    const char* position = block.begin();
+                    while(position < block.end())
+                    {
+                        const Fastcgipp::Protocol::Header& header
+                            = *reinterpret_cast<
+                                const Fastcgipp::Protocol::Header*>(position);
+                        if(header.fcgiId != id)
+                            FAIL_LOG("Decision wasn't sent with our ID")
+                        if(header.type == Fastcgipp::Protocol::RecordType::OUT)
+                            output.append(
+                                    position+sizeof(header),
+                                    header.contentLength);
+                        position += sizeof(header)+header.contentLength
+                            +header.paddingLength;
+                    }
+                },
+                nullptr,
+                nullptr);
+
+        std::string params;
+        for(const auto& param: {
+                std::make_pair(std::string("REQUEST_URI"), uri),
+                std::make_pair(
+                    std::string("HTTP_AUTHORIZATION"),
+                    authorization)})
+        {
+            params += char(param.first.size());
+            params += char(param.second.size());
+            params += param.first;
+            params += param.second;
+        }
+
+        const auto send = [&authorizer, id] (
+                Fastcgipp::Protocol::RecordType type,
+                const std::string& content)
+        {
+            Fastcgipp::Message message;
+            record(message, type, id, content);
+            return authorizer.handle(std::move(message));
+        };
+
+        if(send(Fastcgipp::Protocol::RecordType::PARAMS, params)
+                || send(Fastcgipp::Protocol::RecordType::PARAMS, std::string())
+                || !send(Fastcgipp::Protocol::RecordType::IN, std::string()))
+            FAIL_LOG("Authorization didn't complete when it should have")
+        return output;
+    }
+}
+
+int main()
+{
+    const std::string allowed("Status: 200 OK\r\nVariable-User: good\r\n\r\n");
+    const std::string denied("Status: 403 Forbidden\r\n\r\n");
+
+    // Decisions are made once and answered from the cache afterwards
+    {
+        if(authorize(1, "Bearer good") != allowed || Authorizer::checked != 1)
+            FAIL_LOG("First authorization wasn't made properly")
+        if(authorize(1, "Bearer good") != allowed || Authorizer::checked != 1)
+            FAIL_LOG("Cached authorization wasn't answered from the cache")
+        if(authorize(5, "Bearer good") != allowed || Authorizer::checked != 1)
+            FAIL_LOG("Cached authorization wasn't patched with the request ID")
+
+        if(authorize(1, "Bearer bad") != denied || Authorizer::checked != 2)
+            FAIL_LOG("Denial wasn't made properly")
+        if(authorize(1, "Bearer bad") != denied || Authorizer::checked != 2)
+            FAIL_LOG("Denial wasn't answered from the cache")
+    }
+
+    // The variant keeps decisions apart and revoking takes out all of them
+    {
+        if(authorize(1, "Bearer good", "/x") != allowed
+                || Authorizer::checked != 3)
+            FAIL_LOG("Decision for another variant was answered from the cache")
+        if(decisions.size() != 3)
+            FAIL_LOG("Cache doesn't hold every decision")
+
+        decisions.erase("Bearer good");
+        if(decisions.size() != 1 || !decisions.find("Bearer bad", "/"))
+            FAIL_LOG("Revoking didn't take out exactly all variants")
+        authorize(1, "Bearer good");
+        if(Authorizer::checked != 4)
+            FAIL_LOG("Revoked decision was answered from the cache")
+    }
+
+    // Only responses that are decisions get cached
+    {
+        decisions.clear();
+        const unsigned checked = Authorizer::checked;
+        for(unsigned i=0; i<2; ++i)
+        {
+            authorize(1, "Bearer plain");
+            authorize(1, "");
+            if(authorize(1, "Bearer broken").find("500") == std::string::npos)
+                FAIL_LOG("Broken authorization didn't fail")
+        }
+        if(Authorizer::checked != checked+4 || decisions.size() != 2)
+            FAIL_LOG("Cached the wrong authorization responses")
+        if(decisions.find("Bearer broken", "/"))
+            FAIL_LOG("Failure was cached as a decision")
+    }
+
+    // Full shards make room by dropping the least recently used decision
+    {
+        for(unsigned i=0; i<20; ++i)
+            authorize(1, "Bearer "+std::to_string(i));
+        if(decisions.size() > 8)
+            FAIL_LOG("Cache grew beyond it's limit")
+
+        Fastcgipp::AuthorizationCache recent(std::chrono::seconds(60), 2, 1);
+        for(const char* authorization: {"a", "b", "a", "c"})
+        {
+            if(recent.find(authorization))
+                continue;
+            auto entry
+                = std::make_shared<Fastcgipp::AuthorizationCache::Entry>();
+            entry->expires = Fastcgipp::AuthorizationCache::Clock::now()
+                +recent.ttl();
+            recent.insert(authorization, "", std::move(entry));
+        }
+        if(recent.size() != 2 || !recent.find("a") || recent.find("b")
+                || !recent.find("c"))
+            FAIL_LOG("Least recently used decision wasn't the one dropped")
+
+        Fastcgipp::AuthorizationCache expiring(std::chrono::seconds(0));
+        auto entry = std::make_shared<Fastcgipp::AuthorizationCache::Entry>();
+        entry->expires = Fastcgipp::AuthorizationCache::Clock::now();
+        expiring.insert("Bearer good", "", std::move(entry));
+        if(expiring.find("Bearer good") || expiring.size() != 0)
+            FAIL_LOG("Expired decision was found")
+    }
+
+    return 0;
+}
@@ -0,0 +1,81 @@
+#include "fastcgi++/log.hpp"
+#include "fastcgi++/chunkstreambuf.hpp"
+
+#include <string>
+#include <ostream>
+#include <utility>
+
+namespace
+{
+    //! Put all the chunks back together
+    std::string join(const Fastcgipp::ChunkStreamBuf_base::Chunks& chunks)
+    {
+        std::string joined;
+        for(const auto& chunk: chunks)
+            joined.append(chunk.data.get(), chunk.size);
+        return joined;
+    }
+}
+
+int main()
+{
+    // Chunks grow as the body does and hold it all in order
+    {
+        std::string expected;
+        for(unsigned i=0; i<1000000; ++i)
+            expected.push_back('a'+i%26);
+
+        Fastcgipp::ChunkStreamBuf<char> buffer;
+        std::ostream stream(&buffer);
+        stream << expected.substr(0, 100);
+        buffer.emptyBuffer();
+        if(buffer.m_body.size() != 1
+                || buffer.m_body.front().capacity()
+                    != Fastcgipp::ChunkStreamBuf_base::Chunk::initial)
+            FAIL_LOG("Short body doesn't fit in a single small chunk")
+
+        stream << expected.substr(100);
+        buffer.emptyBuffer();
+        if(join(buffer.m_body) != expected)
+            FAIL_LOG("Chunks don't hold the body")
+        if(buffer.m_body.size() > 10)
+            FAIL_LOG("Chunks didn't grow, there are " << buffer.m_body.size())
+        for(unsigned i=1; i<buffer.m_body.size(); ++i)
+            if(buffer.m_body[i].capacity() < buffer.m_body[i-1].capacity()
+                    || buffer.m_body[i].capacity()
+                        > Fastcgipp::ChunkStreamBuf_base::Chunk::maximum)
+                FAIL_LOG("Chunk " << i << " is the wrong size")
+
+        buffer.clear();
+        stream << "after";
+        buffer.emptyBuffer();
+        if(join(buffer.m_body) != "after")
+            FAIL_LOG("Clearing the chunks didn't start over")
+
+        // Taking the body leaves the stream buffer harmless
+        const auto body = std::move(buffer.m_body);
+        buffer.emptyBuffer();
+    }
+
+    // Wide characters are encoded to UTF-8 across chunk boundaries
+    {
+        std::wstring input;
+        std::string expected;
+        for(unsigned i=0; i<20000; ++i)
+        {
+            input += L"Привет 黑暗森林 ";
+            expected += "Привет 黑暗森林 ";
+        }
+
+        Fastcgipp::ChunkStreamBuf<wchar_t> buffer;
+        std::wostream stream(&buffer);
+        stream << input;
+        buffer.emptyBuffer();
+        if(join(buffer.m_body) != expected)
+            FAIL_LOG("Wide characters weren't encoded properly")
+        if(buffer.m_body.size() < 2)
+            FAIL_LOG("Wide body didn't span multiple chunks")
+    }
+
+    return 0;
+}
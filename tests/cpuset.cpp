@@ -0,0 +1,116 @@
+#include "fastcgi++/block.hpp"
+#include "fastcgi++/cpuset.hpp"
+#include "fastcgi++/log.hpp"
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifdef FASTCGIPP_LINUX
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace
+{
+    //! A pooled block released during static destruction
+    /*!
+     * This is constructed before anything looks at the NUMA topology so it
+     * is destroyed after the topology would be. With the thread's cache
+     * gone by then, releasing the block has to look up the current node.
+     */
+    std::shared_ptr<char> lingering;
+}
+
+int main()
+{
+    // Lists are parsed like the ones in sysfs
+    {
+        const std::vector<std::pair<std::string, std::vector<unsigned>>>
+            lists = {
+                {"0-3,8-11", {0, 1, 2, 3, 8, 9, 10, 11}},
+                {"10-11,2", {2, 10, 11}},
+                {"5,1-2,2,5,0-1", {0, 1, 2, 5}},
+                {"3-1,x,4-,-,7-y,,-2,9", {3, 4, 7, 9}},
+                {"4000000000,4000000000-4000000003", {}},
+                {"", {}}};
+        for(const auto& list: lists)
+            if(Fastcgipp::CpuSet::parse(list.first).cpus() != list.second)
+                FAIL_LOG("CpuSet::parse() got " << list.first.c_str() \
+                        << " wrong")
+    }
+
+    // Ranges stop at the most CPUs a thread can be pinned to
+    {
+        const Fastcgipp::CpuSet set(
+                Fastcgipp::CpuSet::parse("0-4000000000"));
+        const std::vector<unsigned>& cpus = set.cpus();
+        if(cpus.empty()
+                || cpus.size() > 0x10000
+                || cpus.back()+1 != cpus.size())
+            FAIL_LOG("CpuSet::parse() didn't clamp a huge range")
+#ifdef FASTCGIPP_LINUX
+        if(cpus.size() != CPU_SETSIZE)
+            FAIL_LOG("CpuSet::parse() didn't clamp to CPU_SETSIZE")
+#endif
+    }
+
+#ifdef FASTCGIPP_LINUX
+    // Spread sets pin each thread to the CPU at it's index
+    {
+        cpu_set_t allowed;
+        if(sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+            FAIL_LOG("Unable to get the CPUs we're allowed on")
+
+        // One CPU we can't be pinned to shows that failures come through
+        std::string list;
+        bool unavailable = false;
+        for(unsigned cpu=0; cpu<CPU_SETSIZE; ++cpu)
+            if(CPU_ISSET(cpu, &allowed) || !unavailable)
+            {
+                unavailable = unavailable || !CPU_ISSET(cpu, &allowed);
+                if(!list.empty())
+                    list += ',';
+                list += std::to_string(cpu);
+            }
+        const Fastcgipp::CpuSet set(Fastcgipp::CpuSet::parse(list));
+        const Fastcgipp::CpuSet spread(set.spread());
+        const std::vector<unsigned>& cpus = set.cpus();
+
+        std::thread thread([&] {
+            for(unsigned index=0; index<2*cpus.size(); ++index)
+            {
+                const unsigned expected = cpus[index%cpus.size()];
+                const bool available = CPU_ISSET(expected, &allowed);
+                if(spread.pin(index) != available)
+                    FAIL_LOG("Spread pin() to CPU " << expected \
+                            << " should have " \
+                            << (available?"worked":"failed"))
+
+                cpu_set_t pinned;
+                pthread_getaffinity_np(pthread_self(), sizeof(pinned), &pinned);
+                if(available && (CPU_COUNT(&pinned) != 1
+                            || !CPU_ISSET(expected, &pinned)))
+                    FAIL_LOG("Spread pin() with index " << index \
+                            << " didn't pin to CPU " << expected)
+            }
+
+            if(!set.pin(1))
+                FAIL_LOG("Unable to pin to every CPU in the set")
+            cpu_set_t pinned;
+            pthread_getaffinity_np(pthread_self(), sizeof(pinned), &pinned);
+            if(!CPU_EQUAL(&pinned, &allowed))
+                FAIL_LOG("Unspread pin() didn't pin to the whole set")
+        });
+        thread.join();
+    }
+#endif
+
+    // Blocks can still be released after main() returns
+    Fastcgipp::CpuSet::currentNode();
+    lingering = Fastcgipp::BlockPool::share(0x400);
+
+    return 0;
+}
@@ -0,0 +1,62 @@
+#include "fastcgi++/log.hpp"
+#include "fastcgi++/endian.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace
+{
+    //! Check bulk conversion against BigEndian for every run length
+    template<typename T> void check()
+    {
+        // An odd offset makes sure no alignment is assumed
+        std::vector<char> buffer(1+100*sizeof(T));
+        for(size_t i=0; i<buffer.size(); ++i)
+            buffer[i] = char(i*7+3);
+
+        for(size_t count=0; count<=100; ++count)
+        {
+            std::vector<char> data(buffer.begin(), buffer.end());
+            Fastcgipp::convertBigEndian(data.data()+1, count, sizeof(T));
+
+            if(data[0] != buffer[0])
+                FAIL_LOG("Conversion wrote before it's words")
+            for(size_t i=0; i<100; ++i)
+            {
+                const char* const converted = data.data()+1+i*sizeof(T);
+                const char* const original = buffer.data()+1+i*sizeof(T);
+                T value;
+                std::copy_n(
+                        converted,
+                        sizeof(T),
+                        reinterpret_cast<char*>(&value));
+                if(i < count)
+                {
+                    if(value != Fastcgipp::BigEndian<T>::read(original))
+                        FAIL_LOG("Word " << i << " of " << count << " with " \
+                                "width " << sizeof(T) << " converted wrong")
+                }
+                else if(!std::equal(converted, converted+sizeof(T), original))
+                    FAIL_LOG("Word " << i << " past " << count << " with " \
+                            "width " << sizeof(T) << " was changed")
+            }
+        }
+
+        // Converting is the same both ways
+        std::vector<char> data(buffer.begin(), buffer.end());
+        Fastcgipp::convertBigEndian(data.data()+1, 100, sizeof(T));
+        Fastcgipp::convertBigEndian(data.data()+1, 100, sizeof(T));
+        if(data != buffer)
+            FAIL_LOG("Converting twice didn't give back the original")
+    }
+}
+
+int main()
+{
+    check<std::uint16_t>();
+    check<std::uint32_t>();
+    check<std::uint64_t>();
+
+    return 0;
+}
@@ -5,6 +5,18 @@
 #include <algorithm>
 #include <iostream>
 #include <string>
+#include <vector>
+#include <locale>
+#include <codecvt>
+#include <cstdio>
+#include <random>
+#include <cstring>
+
+#include <unistd.h>
+
+#ifdef FASTCGIPP_ZLIB
+#include <zlib.h>
+#endif
 
 unsigned called;
 
@@ -388,5 +400,486 @@ int main()
 
     if(called != 5)
         FAIL_LOG("Our checker() was not called as many times as it should have")
+
+    // Testing UTF-8 encoding across many records
+    {
+        std::wstring text;
+        for(unsigned i=0; i<20000; ++i)
+        {
+            text += L"Plain ASCII text that runs long enough to vectorize ";
+            text += static_cast<wchar_t>(0x80+i%0x780);
+            text += static_cast<wchar_t>(0x800+i%0xc000);
+            text += static_cast<wchar_t>(0x1f333);
+        }
+
+        std::string encoded;
+        {
+            Fastcgipp::FcgiStreambuf<wchar_t> streambuf;
+            streambuf.configure(
+                    Fastcgipp::Protocol::RequestId(
+                        FCGIID,
+                        Fastcgipp::Socket()),
+                    Fastcgipp::Protocol::RecordType::OUT,
+                    [&encoded] (
+                        const Fastcgipp::Socket&,
+                        Fastcgipp::Block&& record)
+                    {
+                        const Fastcgipp::Protocol::Header& header
+                            = *reinterpret_cast<Fastcgipp::Protocol::Header*>(
+                                    record.begin());
+                        if(record.size() % Fastcgipp::Protocol::chunkSize)
+                            FAIL_LOG("Our record is not sized properly")
+                        encoded.append(
+                                record.begin()+sizeof(header),
+                                header.contentLength);
+                    });
+            std::basic_ostream<wchar_t> out(&streambuf);
+            out << text;
+        }
+
+        std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
+        if(encoded != converter.to_bytes(text))
+            FAIL_LOG("UTF-8 encoding didn't match std::codecvt_utf8")
+    }
+
+    // Testing every encoding across many records against a plain encoder
+    {
+        const auto reference = [] (Fastcgipp::Encoding encoding, wchar_t x)
+        {
+            static const char hex[] = "0123456789ABCDEF";
+            const std::string escaped{'%', hex[(x>>4)&0xf], hex[x&0xf]};
+            switch(encoding)
+            {
+                case Fastcgipp::Encoding::HTML:
+                    switch(x)
+                    {
+                        case '"': return std::string("&quot;");
+                        case '>': return std::string("&gt;");
+                        case '<': return std::string("&lt;");
+                        case '&': return std::string("&amp;");
+                        case '\'': return std::string("&apos;");
+                    }
+                    break;
+                case Fastcgipp::Encoding::URL:
+                    if(x < 0x80 && std::string("!][#?/,$+=&@:;)('*<>\" %")
+                            .find(char(x)) != std::string::npos)
+                        return escaped;
+                    break;
+                case Fastcgipp::Encoding::JSON:
+                    switch(x)
+                    {
+                        case '"': return std::string("\\\"");
+                        case '\\': return std::string("\\\\");
+                        case '\b': return std::string("\\b");
+                        case '\f': return std::string("\\f");
+                        case '\n': return std::string("\\n");
+                        case '\r': return std::string("\\r");
+                        case '\t': return std::string("\\t");
+                    }
+                    if(x >= 0 && x < 0x20)
+                        return "\\u00"+escaped.substr(1);
+                    break;
+                default:
+                    break;
+            }
+            return std::string();
+        };
+
+        std::mt19937 generator(2006);
+        std::uniform_int_distribution<int> ascii(0, 0x7f);
+        std::uniform_int_distribution<int> plain('a', 'z');
+        std::uniform_int_distribution<int> kind(0, 15);
+        std::wstring wide;
+        std::string narrow;
+        for(unsigned i=0; i<100000; ++i)
+        {
+            const int which = kind(generator);
+            const wchar_t x = wchar_t(which==0?ascii(generator):plain(generator));
+            narrow += char(x);
+            wide += x;
+            if(which == 1)
+                wide += wchar_t(0x430+i%32);
+        }
+
+        std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
+        for(const auto encoding: {
+                Fastcgipp::Encoding::HTML,
+                Fastcgipp::Encoding::URL,
+                Fastcgipp::Encoding::JSON})
+        {
+            std::string expectedNarrow;
+            for(const char x: narrow)
+            {
+                const std::string escape = reference(encoding, x);
+                expectedNarrow += escape.empty()?std::string(1, x):escape;
+            }
+            std::wstring expectedWide;
+            for(const wchar_t x: wide)
+            {
+                const std::string escape = reference(encoding, x);
+                if(escape.empty())
+                    expectedWide += x;
+                else
+                    expectedWide += converter.from_bytes(escape);
+            }
+
+            const auto collect = [] (std::string& output)
+            {
+                return [&output] (
+                        const Fastcgipp::Socket&,
+                        Fastcgipp::Block&& record)
+                {
+                    const Fastcgipp::Protocol::Header& header
+                        = *reinterpret_cast<Fastcgipp::Protocol::Header*>(
+                                record.begin());
+                    output.append(
+                            record.begin()+sizeof(header),
+                            header.contentLength);
+                };
+            };
+
+            std::string encodedNarrow;
+            {
+                Fastcgipp::FcgiStreambuf<char> streambuf;
+                streambuf.configure(
+                        Fastcgipp::Protocol::RequestId(
+                            FCGIID,
+                            Fastcgipp::Socket()),
+                        Fastcgipp::Protocol::RecordType::OUT,
+                        collect(encodedNarrow));
+                std::basic_ostream<char> out(&streambuf);
+                out << encoding << narrow << Fastcgipp::Encoding::NONE;
+            }
+            if(encodedNarrow != expectedNarrow)
+                FAIL_LOG("Narrow encoding " << int(encoding) \
+                        << " didn't match the reference")
+
+            std::string encodedWide;
+            {
+                Fastcgipp::FcgiStreambuf<wchar_t> streambuf;
+                streambuf.configure(
+                        Fastcgipp::Protocol::RequestId(
+                            FCGIID,
+                            Fastcgipp::Socket()),
+                        Fastcgipp::Protocol::RecordType::OUT,
+                        collect(encodedWide));
+                std::basic_ostream<wchar_t> out(&streambuf);
+                out << encoding << wide << Fastcgipp::Encoding::NONE;
+            }
+            if(encodedWide != converter.to_bytes(expectedWide))
+                FAIL_LOG("Wide encoding " << int(encoding) \
+                        << " didn't match the reference")
+        }
+    }
+
+    // Testing file dumping both by descriptor and by reading it ourselves
+    {
+        std::string contents;
+        for(unsigned i=0; i<30000; ++i)
+            contents += std::to_string(i);
+
+        FILE* const file = std::tmpfile();
+        if(file == nullptr)
+            FAIL_LOG("Unable to create temporary file")
+        std::fwrite(contents.data(), 1, contents.size(), file);
+        std::fflush(file);
+        const int descriptor = fileno(file);
+        const off_t offset = 1234;
+
+        for(bool byDescriptor: {true, false})
+        {
+            std::string dumped;
+            const auto appendRecord = [&dumped] (
+                    const Fastcgipp::Block& record,
+                    size_t bytes)
+            {
+                const Fastcgipp::Protocol::Header& header
+                    = *reinterpret_cast<const Fastcgipp::Protocol::Header*>(
+                            record.begin());
+                if(header.type != Fastcgipp::Protocol::RecordType::OUT)
+                    FAIL_LOG("FastCGI record type wrong")
+                if(header.fcgiId != FCGIID)
+                    FAIL_LOG("FastCGI request ID wrong")
+                if(size_t(header.contentLength) != bytes)
+                    FAIL_LOG("FastCGI content length wrong")
+                if((sizeof(header)+bytes+header.paddingLength)
+                        % Fastcgipp::Protocol::chunkSize)
+                    FAIL_LOG("Our record is not padded properly")
+            };
+
+            Fastcgipp::FcgiStreambuf<char> streambuf;
+            streambuf.configure(
+                    Fastcgipp::Protocol::RequestId(
+                        FCGIID,
+                        Fastcgipp::Socket()),
+                    Fastcgipp::Protocol::RecordType::OUT,
+                    [&] (
+                        const Fastcgipp::Socket&,
+                        Fastcgipp::Block&& record)
+                    {
+                        const Fastcgipp::Protocol::Header& header
+                            = *reinterpret_cast<Fastcgipp::Protocol::Header*>(
+                                    record.begin());
+                        appendRecord(record, header.contentLength);
+                        dumped.append(
+                                record.begin()+sizeof(header),
+                                header.contentLength);
+                    },
+                    byDescriptor ? [&] (
+                        const Fastcgipp::Socket&,
+                        Fastcgipp::Block&& record,
+                        const std::shared_ptr<const int>& shared,
+                        off_t position,
+                        size_t size)
+                    {
+                        if(record.size() != sizeof(Fastcgipp::Protocol::Header))
+                            FAIL_LOG("File record header is the wrong size")
+                        appendRecord(record, size);
+                        std::string chunk(size, 0);
+                        if(::pread(*shared, &chunk[0], size, position)
+                                != ssize_t(size))
+                            FAIL_LOG("Unable to read the shared descriptor")
+                        dumped += chunk;
+                    } : std::function<void(
+                        const Fastcgipp::Socket&,
+                        Fastcgipp::Block&&,
+                        const std::shared_ptr<const int>&,
+                        off_t,
+                        size_t)>());
+
+            if(!streambuf.dumpFile(
+                        descriptor,
+                        offset,
+                        contents.size()-offset))
+                FAIL_LOG("dumpFile() failed")
+            if(dumped != contents.substr(offset))
+                FAIL_LOG("Dumped file contents don't match")
+            if(!byDescriptor
+                    && streambuf.dumpFile(descriptor, offset, contents.size()))
+                FAIL_LOG("dumpFile() didn't notice the end of the file")
+        }
+
+        std::fclose(file);
+    }
+
+    // Testing buffer size and cork mode
+    {
+        const auto unpack = [] (
+                const Fastcgipp::Block& block,
+                std::string& content,
+                std::vector<size_t>& sizes)
+        {
+            const char* record = block.begin();
+            while(record < block.end())
+            {
+                const Fastcgipp::Protocol::Header& header
+                    = *reinterpret_cast<const Fastcgipp::Protocol::Header*>(
+                            record);
+                if(header.fcgiId != FCGIID)
+                    FAIL_LOG("FastCGI request ID wrong")
+                content.append(record+sizeof(header), header.contentLength);
+                sizes.push_back(header.contentLength);
+                record += sizeof(header)+header.contentLength
+                    +header.paddingLength;
+            }
+            if(record != block.end())
+                FAIL_LOG("Records don't fill up their block")
+        };
+
+        std::string text;
+        for(unsigned i=0; i<20000; ++i)
+            text += std::to_string(i);
+
+        std::string sent;
+        std::vector<size_t> sizes;
+        unsigned sends = 0;
+        Fastcgipp::FcgiStreambuf<char> streambuf;
+        streambuf.configure(
+                Fastcgipp::Protocol::RequestId(
+                    FCGIID,
+                    Fastcgipp::Socket()),
+                Fastcgipp::Protocol::RecordType::OUT,
+                [&] (
+                    const Fastcgipp::Socket&,
+                    Fastcgipp::Block&& block)
+                {
+                    unpack(block, sent, sizes);
+                    ++sends;
+                });
+        std::basic_ostream<char> out(&streambuf);
+
+        streambuf.bufferSize(1000);
+        out << text.substr(0, 5500) << std::flush;
+        if(sent != text.substr(0, 5500) || sizes.size() != 6
+                || sizes.front() != 1000 || sizes.back() != 500)
+            FAIL_LOG("Buffer size wasn't respected")
+        sent.clear();
+        sizes.clear();
+        sends = 0;
+
+        streambuf.cork(true);
+        out << text;
+        streambuf.dump(text.data(), 10);
+        out << text;
+        if(sends != 0)
+            FAIL_LOG("Cork mode sent something before being flushed")
+        const Fastcgipp::Block corked(streambuf.takeCorked());
+        if(sends != 0)
+            FAIL_LOG("takeCorked() sent something")
+        unpack(corked, sent, sizes);
+        if(sent != text+text.substr(0, 10)+text)
+            FAIL_LOG("Corked content is wrong")
+        if(sizes.front() != 0xfff8)
+            FAIL_LOG("Cork mode didn't use large records")
+        sent.clear();
+        sizes.clear();
+
+        out << text << std::flush;
+        if(sends != 1 || sent != text)
+            FAIL_LOG("Flushing in cork mode didn't send everything at once")
+        sent.clear();
+
+        out << "Uncorked";
+        streambuf.cork(false);
+        out << text.substr(0, 1000) << std::flush;
+        if(sends != 3 || sent != "Uncorked"+text.substr(0, 1000))
+            FAIL_LOG("Disabling cork mode didn't send what was held back")
+    }
+
+    // Testing content coding negotiation
+    {
+        using Fastcgipp::Compression;
+        using Fastcgipp::Compressor;
+
+        if(Compressor::negotiate(
+                    std::string("gzip;q=0.5, br;q=0.8"),
+                    {Compression::GZIP, Compression::BROTLI})
+                != Compression::BROTLI)
+            FAIL_LOG("Negotiation didn't respect quality values")
+        if(Compressor::negotiate(
+                    std::string("gzip, br"),
+                    {Compression::GZIP, Compression::BROTLI})
+                != Compression::GZIP)
+            FAIL_LOG("Negotiation didn't break ties by order")
+        if(Compressor::negotiate(
+                    std::string("*;q=0.1, gzip;q=0"),
+                    {Compression::GZIP, Compression::ZSTD})
+                != Compression::ZSTD)
+            FAIL_LOG("Negotiation didn't handle the wildcard")
+        if(Compressor::negotiate(
+                    std::wstring(L"identity, X-GZIP ; Q=0.3"),
+                    {Compression::BROTLI, Compression::GZIP})
+                != Compression::GZIP)
+            FAIL_LOG("Negotiation didn't handle case and spacing")
+        if(Compressor::negotiate(std::string("identity")) != Compression::NONE
+                || Compressor::negotiate(std::string()) != Compression::NONE)
+            FAIL_LOG("Negotiation picked a coding that wasn't accepted")
+        if(Compressor::negotiate(std::string("gzip")) != (
+                    Compressor::supported(Compression::GZIP)
+                    ?Compression::GZIP:Compression::NONE))
+            FAIL_LOG("Negotiation picked a coding that isn't supported")
+    }
+
+#ifdef FASTCGIPP_ZLIB
+    // Testing gzip compression with plain and corked output
+    {
+        const auto decompress = [] (const std::string& compressed)
+        {
+            z_stream stream;
+            std::memset(&stream, 0, sizeof(stream));
+            inflateInit2(&stream, 15+16);
+            std::string output;
+            char buffer[4096];
+            stream.next_in = reinterpret_cast<Bytef*>(
+                    const_cast<char*>(compressed.data()));
+            stream.avail_in = compressed.size();
+            int result;
+            do
+            {
+                stream.next_out = reinterpret_cast<Bytef*>(buffer);
+                stream.avail_out = sizeof(buffer);
+                result = inflate(&stream, Z_NO_FLUSH);
+                output.append(buffer, sizeof(buffer)-stream.avail_out);
+            } while(result == Z_OK && stream.avail_out == 0);
+            if(result == Z_STREAM_END && stream.avail_in != 0)
+                FAIL_LOG("Trailing garbage after the compressed stream")
+            inflateEnd(&stream);
+            return std::make_pair(output, result == Z_STREAM_END);
+        };
+
+        std::wstring text;
+        for(unsigned i=0; i<20000; ++i)
+        {
+            text += L"Compress me " + std::to_wstring(i%100) + L' ';
+            text += static_cast<wchar_t>(0x430+i%32);
+        }
+        std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
+        const std::string narrow(converter.to_bytes(text));
+        const std::string headers("Content-Type: text/plain\r\n\r\n");
+
+        for(bool corked: {false, true})
+        {
+            std::string sent;
+            Fastcgipp::FcgiStreambuf<wchar_t> streambuf;
+            streambuf.configure(
+                    Fastcgipp::Protocol::RequestId(
+                        FCGIID,
+                        Fastcgipp::Socket()),
+                    Fastcgipp::Protocol::RecordType::OUT,
+                    [&sent] (
+                        const Fastcgipp::Socket&,
+                        Fastcgipp::Block&& block)
+                    {
+                        const char* record = block.begin();
+                        while(record < block.end())
+                        {
+                            const Fastcgipp::Protocol::Header& header
+                                = *reinterpret_cast<
+                                    const Fastcgipp::Protocol::Header*>(record);
+                            sent.append(
+                                    record+sizeof(header),
+                                    header.contentLength);
+                            record += sizeof(header)+header.contentLength
+                                +header.paddingLength;
+                        }
+                    });
+            streambuf.cork(corked);
+            std::basic_ostream<wchar_t> out(&streambuf);
+
+            out << headers.c_str();
+            if(!streambuf.compress(Fastcgipp::Compression::GZIP))
+                FAIL_LOG("Unable to start gzip compression")
+            if(streambuf.compression() != Fastcgipp::Compression::GZIP)
+                FAIL_LOG("Stream buffer doesn't report it's compression")
+            out << text;
+            out.flush();
+            if(sent.compare(0, headers.size(), headers) != 0)
+                FAIL_LOG("Headers weren't sent ahead uncompressed")
+            if(decompress(sent.substr(headers.size())).first != narrow)
+                FAIL_LOG("Flushing didn't send everything compressed so far")
+
+            streambuf.dump(narrow.data(), narrow.size());
+            out << text;
+            streambuf.finish();
+            if(streambuf.compression() != Fastcgipp::Compression::NONE)
+                FAIL_LOG("Finishing didn't stop compression")
+            out << "Uncompressed";
+            out.flush();
+
+            const std::string trailer("Uncompressed");
+            if(sent.compare(sent.size()-trailer.size(), trailer.size(), trailer)
+                    != 0)
+                FAIL_LOG("Output after finishing was compressed")
+            const auto result = decompress(sent.substr(
+                        headers.size(),
+                        sent.size()-headers.size()-trailer.size()));
+            if(!result.second || result.first != narrow+narrow+narrow)
+                FAIL_LOG("Decompressed output doesn't match")
+            if(sent.size() > narrow.size())
+                FAIL_LOG("Output wasn't actually compressed")
+        }
+    }
+#endif
+
     return 0;
 }
@@ -0,0 +1,134 @@
+#include "fastcgi++/log.hpp"
+#include "fastcgi++/request.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <string>
+
+namespace
+{
+    //! Upper cases the file it is handed on the fly
+    class Upper: public Fastcgipp::Request<char>
+    {
+    public:
+        static size_t largest;
+        static bool responded;
+
+    private:
+        void dataHandler(const char* data, size_t size)
+        {
+            if(responded)
+                FAIL_LOG("File data arrived after the response")
+            if(environment().dataLength != 26
+                    || environment().dataLastModified != 1234567890)
+                FAIL_LOG("File data parameters weren't parsed")
+            if(largest == 0)
+                out << "Content-Type: text/plain\r\n\r\n";
+            largest = std::max(largest, size);
+            for(const char* byte=data; byte != data+size; ++byte)
+                out << char(std::toupper(*byte));
+        }
+
+        bool response()
+        {
+            responded = true;
+            out << '.';
+            return true;
+        }
+    };
+
+    size_t Upper::largest = 0;
+    bool Upper::responded = false;
+
+    //! Make a message out of a record
+    Fastcgipp::Message record(
+            Fastcgipp::Protocol::RecordType type,
+            const std::string& content)
+    {
+        Fastcgipp::Message message;
+        Fastcgipp::Block& data = message.data;
+        data.size(sizeof(Fastcgipp::Protocol::Header)+content.size());
+        Fastcgipp::Protocol::Header& header
+            = *reinterpret_cast<Fastcgipp::Protocol::Header*>(data.begin());
+        header.version = Fastcgipp::Protocol::version;
+        header.type = type;
+        header.fcgiId = 1;
+        header.contentLength = content.size();
+        header.paddingLength = 0;
+        header.reserved = 0;
+        std::copy(
+                content.cbegin(),
+                content.cend(),
+                data.begin()+sizeof(header));
+        return message;
+    }
+
+    //! Encode a name-value pair
+    std::string pair(const std::string& name, const std::string& value)
+    {
+        return char(name.size()) + (char(value.size()) + name) + value;
+    }
+}
+
+int main()
+{
+    using Fastcgipp::Protocol::RecordType;
+
+    std::string output;
+    Fastcgipp::Protocol::ProtocolStatus status
+        = Fastcgipp::Protocol::ProtocolStatus::UNKNOWN_ROLE;
+    Upper upper;
+    upper.configure(
+            Fastcgipp::Protocol::RequestId(1, Fastcgipp::Socket()),
+            Fastcgipp::Protocol::Role::FILTER,
+            false,
+            [&] (const Fastcgipp::Socket&, Fastcgipp::Block&& block, bool)
+            {
+                const char* position = block.begin();
+                while(position < block.end())
+                {
+                    const Fastcgipp::Protocol::Header& header
+                        = *reinterpret_cast<
+                            const Fastcgipp::Protocol::Header*>(position);
+                    const char* const body = position+sizeof(header);
+                    if(header.type == RecordType::OUT)
+                        output.append(body, header.contentLength);
+                    else if(header.type == RecordType::END_REQUEST)
+                        status = reinterpret_cast<
+                            const Fastcgipp::Protocol::EndRequest*>(
+                                    body)->protocolStatus;
+                    position = body+header.contentLength
+                        +header.paddingLength;
+                }
+            },
+            nullptr,
+            nullptr);
+
+    const std::string file = "abcdefghijklmnopqrstuvwxyz";
+    if(upper.handle(record(
+                    RecordType::PARAMS,
+                    pair("REQUEST_METHOD", "GET")
+                        + pair("FCGI_DATA_LENGTH", "26")
+                        + pair("FCGI_DATA_LAST_MOD", "1234567890")))
+            || upper.handle(record(RecordType::PARAMS, ""))
+            || upper.handle(record(RecordType::IN, "")))
+        FAIL_LOG("Filter completed before it's file data")
+
+    for(size_t i=0; i<file.size(); i+=10)
+        if(upper.handle(record(RecordType::DATA, file.substr(i, 10))))
+            FAIL_LOG("Filter completed in the middle of it's file data")
+
+    if(Upper::responded)
+        FAIL_LOG("Filter responded before the end of it's file data")
+    if(!upper.handle(record(RecordType::DATA, "")))
+        FAIL_LOG("Filter didn't complete at the end of it's file data")
+
+    if(status != Fastcgipp::Protocol::ProtocolStatus::REQUEST_COMPLETE)
+        FAIL_LOG("Filter role was refused")
+    if(output != "Content-Type: text/plain\r\n\r\nABCDEFGHIJKLMNOPQRSTUVWXYZ.")
+        FAIL_LOG("Filter output is wrong")
+    if(Upper::largest != 10)
+        FAIL_LOG("File data wasn't handed over a record at a time")
+
+    return 0;
+}
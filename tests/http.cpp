@@ -1,5 +1,7 @@
 #include "fastcgi++/log.hpp"
 #include "fastcgi++/http.hpp"
+#include "fastcgi++/sessionstore.hpp"
+#include "fastcgi++/scan.hpp"
 
 #include <list>
 #include <array>
@@ -8,9 +10,16 @@
 #include <string>
 #include <map>
 #include <thread>
+#include <atomic>
 #include <chrono>
 #include <random>
 #include <cstring>
+#include <set>
+#include <unordered_set>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <fcntl.h>
 
 int main()
 {
@@ -187,6 +196,94 @@ int main()
             if(addresses != correctAddresses)
                 FAIL_LOG("Fastcgipp::Address sorting")
         }
+
+        // Test round trips through assign() and format()
+        {
+            const std::pair<std::string, std::string> addresses[] = {
+                {"::", "::"},
+                {"::1", "::1"},
+                {"1::", "1::"},
+                {"0:0:0:0:0:0:0:1", "::1"},
+                {"1:0:2:3:4:5:6:7", "1:0:2:3:4:5:6:7"},
+                {"1:0:0:2:0:0:0:3", "1:0:0:2::3"},
+                {"1:0:0:2:3:0:0:4", "1::2:3:0:0:4"},
+                {"1:2:3:4:5:6:7::", "1:2:3:4:5:6:7:0"},
+                {"::2:3:4:5:6:7:8", "0:2:3:4:5:6:7:8"},
+                {"2001:DB8::0001", "2001:db8::1"},
+                {"::FFFF:10.0.0.255", "::ffff:10.0.0.255"},
+                {"0.0.0.0", "::ffff:0.0.0.0"},
+                {"64:ff9b::1.2.3.4", "64:ff9b::102:304"},
+                {"ffff:ffff:ffff:ffff:ffff:ffff:ffff:ffff",
+                    "ffff:ffff:ffff:ffff:ffff:ffff:ffff:ffff"}};
+            for(const auto& address: addresses)
+            {
+                Fastcgipp::Address parsed;
+                parsed.assign(
+                        address.first.data(),
+                        address.first.data()+address.first.size());
+                char buffer[Fastcgipp::Address::textSize];
+                const std::string formatted(buffer, parsed.format(buffer));
+                if(formatted != address.second)
+                    FAIL_LOG("Fastcgipp::Address " \
+                            << address.first.c_str() << " came back as " \
+                            << formatted.c_str())
+
+                wchar_t wideBuffer[Fastcgipp::Address::textSize];
+                const std::wstring wide(
+                        wideBuffer,
+                        parsed.format(wideBuffer));
+                if(!std::equal(
+                            wide.begin(),
+                            wide.end(),
+                            address.second.begin(),
+                            address.second.end()))
+                    FAIL_LOG("Fastcgipp::Address wide format with " \
+                            << address.first.c_str())
+            }
+
+            const char* const bad[] = {
+                "", ":", ":::", "1:", ":1", "1::2::3", "12345::", "1.2.3",
+                "1.2.3.4.5", "1.2.3.256", "1.2.3.4a", "1..2.3", "1.2.3.1234",
+                "1:2:3:4:5:6:7:8:9", "1:2:3:4:5:6:7:1.2.3.4", "::1.2.3",
+                "g::", "1:2:3:4:5:6:7:8::", "::1:2:3:4:5:6:7:8",
+                "1:2:3:4::5:6:7:8", "1:2:3:4:5:6::1.2.3.4"};
+            Fastcgipp::Logging::suppress=true;
+            for(const char* address: bad)
+            {
+                Fastcgipp::Address parsed(randomAddress1);
+                parsed.assign(address, address+std::strlen(address));
+                if(parsed)
+                    FAIL_LOG("Fastcgipp::Address accepted " << address)
+            }
+            Fastcgipp::Logging::suppress=false;
+
+            if(!ipv4Address.ipv4() || randomAddress1.ipv4())
+                FAIL_LOG("Fastcgipp::Address::ipv4() is wrong")
+        }
+
+        // Test hashing
+        {
+            std::unordered_set<Fastcgipp::Address> addresses;
+            for(unsigned i=0; i<1024; ++i)
+            {
+                const std::string address = "10.0." + std::to_string(i/256)
+                    + '.' + std::to_string(i%256);
+                addresses.insert(Fastcgipp::Address(address.c_str()));
+            }
+            addresses.insert(ipv4Address);
+            addresses.insert(ipv4Address);
+            addresses.insert(randomAddress1);
+            if(addresses.size() != 1026
+                    || addresses.count(Fastcgipp::Address("10.0.3.255")) != 1
+                    || addresses.count(randomAddress2) != 0)
+                FAIL_LOG("Fastcgipp::Address hashing")
+
+            std::set<size_t> buckets;
+            for(const auto& address: addresses)
+                buckets.insert(addresses.bucket(address));
+            if(buckets.size() < addresses.size()/2)
+                FAIL_LOG("Fastcgipp::Address hashes collide too much")
+        }
     }
 
     // Test base64 encoding/decoding stuff
@@ -384,6 +481,144 @@ int main()
         }
     }
 
+    // Test Fastcgipp::Scan
+    {
+        std::mt19937 generator(1234);
+        std::uniform_int_distribution<int> byte('a', 'e');
+        std::uniform_int_distribution<size_t> length(0, 300);
+        std::uniform_int_distribution<size_t> needleLength(1, 40);
+
+        for(unsigned test=0; test<2000; ++test)
+        {
+            std::vector<char> haystack(length(generator));
+            for(auto& character: haystack)
+                character = char(byte(generator));
+            std::vector<char> needle(needleLength(generator));
+            for(auto& character: needle)
+                character = char(byte(generator));
+            if(test%2 && needle.size() <= haystack.size())
+            {
+                std::uniform_int_distribution<size_t> offset(
+                        0,
+                        haystack.size()-needle.size());
+                std::copy(
+                        needle.cbegin(),
+                        needle.cend(),
+                        haystack.begin()+offset(generator));
+            }
+
+            const char* const begin = haystack.data();
+            const char* const end = haystack.data()+haystack.size();
+            const char first = char(byte(generator));
+            const char second = char(byte(generator));
+
+            if(
+                    Fastcgipp::Scan::find(
+                        begin,
+                        end,
+                        needle.data(),
+                        needle.size())
+                    != std::search(begin, end, needle.cbegin(), needle.cend())
+                    || Fastcgipp::Scan::findEither(begin, end, first, second)
+                    != std::find_if(begin, end, [&](char x)
+                    {
+                        return x == first || x == second;
+                    }))
+                FAIL_LOG("Fastcgipp::Scan with " \
+                        << Fastcgipp::Scan::implementation())
+        }
+
+        struct Members
+        {
+            constexpr bool operator()(unsigned char x) const
+            {
+                return x<0x20 || x=='"' || x=='&' || x=='~';
+            }
+        };
+        const Fastcgipp::Scan::Set set{Members()};
+        std::uniform_int_distribution<int> anyByte(0, 255);
+        std::uniform_int_distribution<int> member(0, 40);
+        for(unsigned test=0; test<2000; ++test)
+        {
+            std::vector<char> haystack(length(generator));
+            for(auto& character: haystack)
+            {
+                character = char(anyByte(generator));
+                while(Members()(character) && member(generator))
+                    character = char(anyByte(generator));
+            }
+
+            const char* const begin = haystack.data();
+            const char* const end = haystack.data()+haystack.size();
+            if(Fastcgipp::Scan::findAny(begin, end, set)
+                    != std::find_if(begin, end, [](char x)
+                    {
+                        return Members()(x);
+                    }))
+                FAIL_LOG("Fastcgipp::Scan::findAny() with " \
+                        << Fastcgipp::Scan::implementation())
+        }
+    }
+
+    // Test Fastcgipp::FlatMultimap
+    {
+        std::mt19937 generator(4321);
+        std::uniform_int_distribution<int> key(0, 15);
+        std::uniform_int_distribution<int> value(0, 1000);
+        Fastcgipp::FlatMultimap<std::string, std::string> flat;
+        const auto samePair = [] (
+                const std::pair<std::string, std::string>& x,
+                const std::pair<const std::string, std::string>& y)
+        {
+            return x.first == y.first && x.second == y.second;
+        };
+
+        for(unsigned round=0; round<50; ++round)
+        {
+            std::multimap<std::string, std::string> tree;
+            flat.clear();
+
+            for(unsigned i=0; i<30; ++i)
+            {
+                auto pair = std::make_pair(
+                        std::to_string(key(generator)),
+                        std::to_string(value(generator)));
+                tree.insert(pair);
+                if(i%2)
+                    flat.insert(pair);
+                else
+                    flat.insert(std::move(pair));
+            }
+
+            const std::string erased = std::to_string(key(generator));
+            if(flat.erase(erased) != tree.erase(erased))
+                FAIL_LOG("Fastcgipp::FlatMultimap::erase()")
+
+            for(int i=0; i<16; ++i)
+            {
+                const std::string search = std::to_string(i);
+                const auto flatIt = flat.find(search);
+                const auto treeIt = tree.find(search);
+                if(
+                        flat.count(search) != tree.count(search) ||
+                        (flatIt == flat.end()) != (treeIt == tree.end()) ||
+                        (flatIt != flat.end() && (
+                            flatIt->first != treeIt->first ||
+                            flatIt->second != treeIt->second)))
+                    FAIL_LOG("Fastcgipp::FlatMultimap::find()")
+            }
+
+            if(
+                    flat.size() != tree.size() ||
+                    !std::equal(
+                        flat.begin(),
+                        flat.end(),
+                        tree.begin(),
+                        samePair))
+                FAIL_LOG("Fastcgipp::FlatMultimap ordering")
+        }
+    }
+
     // Test Fastcgipp::Http::percentEscapedToRealBytes()
     {
         const char properDecoded[] =
@@ -628,6 +863,215 @@ int main()
             }
         }
 
+        // Doing test with flat containers
+        {
+            Fastcgipp::Http::Environment<
+                wchar_t,
+                Fastcgipp::Http::FlatContainers> environment;
+            const auto samePair = [] (
+                    const std::pair<std::wstring, std::wstring>& x,
+                    const std::pair<const std::wstring, std::wstring>& y)
+            {
+                return x.first == y.first && x.second == y.second;
+            };
+            for(unsigned round=0; round<2; ++round)
+            {
+                environment.clear();
+                {
+                    const unsigned char parms[] = 
+#include "multipartParam.hpp"
+                    environment.fill(
+                            reinterpret_cast<const char*>(parms),
+                            reinterpret_cast<const char*>(
+                                parms+sizeof(parms)-1));
+                }
+
+                if(
+                        environment.gets.size() != properGets.size() ||
+                        !std::equal(
+                            environment.gets.begin(),
+                            environment.gets.end(),
+                            properGets.begin(),
+                            samePair) ||
+                        environment.cookies.size() != properCookies.size() ||
+                        !std::equal(
+                            environment.cookies.begin(),
+                            environment.cookies.end(),
+                            properCookies.begin(),
+                            samePair))
+                    FAIL_LOG("Fastcgipp::Http::Environment flat containers "\
+                            "didn't decode properly")
+            }
+        }
+
+        // Doing test with lazily parsed parameters
+        {
+            Fastcgipp::Http::Environment<wchar_t> environment;
+            environment.parseLazily();
+            {
+                const unsigned char parms[] = 
+#include "multipartParam.hpp"
+                environment.fill(
+                        reinterpret_cast<const char*>(parms),
+                        reinterpret_cast<const char*>(parms+sizeof(parms)-1));
+            }
+
+            if(
+                    environment.contentType != L"multipart/form-data" ||
+                    environment.requestMethod !=
+                        Fastcgipp::Http::RequestMethod::POST ||
+                    environment.contentLength != 59071 ||
+                    !environment.host.empty() ||
+                    !environment.gets.empty() ||
+                    !environment.cookies.empty() ||
+                    !environment.others.empty() ||
+                    environment.raw("HTTP_HOST") != "localhost" ||
+                    environment.raw("REMOTE_PORT") != "49003" ||
+                    environment.raw("HTTP_NOT_THERE"))
+                FAIL_LOG("Fastcgipp::Http::Environment lazy parameters "\
+                        "weren't stored properly")
+
+            environment.parse("HTTP_COOKIE");
+            if(properCookies != environment.cookies ||
+                    !environment.gets.empty())
+                FAIL_LOG("Fastcgipp::Http::Environment lazy cookies "\
+                        "didn't decode properly")
+
+            environment.parse();
+            environment.parse();
+            if(
+                    environment.host != L"localhost" ||
+                    environment.remotePort != 49003 ||
+                    environment.acceptLanguages != properLanguages ||
+                    properPath != environment.pathInfo ||
+                    properGets != environment.gets ||
+                    properCookies != environment.cookies)
+                FAIL_LOG("Fastcgipp::Http::Environment lazy parameters "\
+                        "didn't decode properly")
+
+            environment.clear();
+            if(environment.raw("HTTP_HOST"))
+                FAIL_LOG("Fastcgipp::Http::Environment lazy parameters "\
+                        "didn't clear")
+        }
+
+        // Doing test with streamed multipart POST
+        {
+            static const unsigned char gnu_png[] = 
+#include "gnu.png.hpp"
+
+            Fastcgipp::Http::Environment<wchar_t> environment;
+            environment.streamPosts(1024);
+            {
+                const unsigned char parms[] = 
+#include "multipartParam.hpp"
+                environment.fill(
+                        reinterpret_cast<const char*>(parms),
+                        reinterpret_cast<const char*>(parms+sizeof(parms)-1));
+            }
+            {
+                static const unsigned char data[] = 
+#include "multipartPost.hpp"
+                const char* const dataEnd =
+                    reinterpret_cast<const char*>(data+sizeof(data));
+                for(
+                        const char* chunk = reinterpret_cast<const char*>(data);
+                        chunk < dataEnd;
+                        chunk += 333)
+                    environment.fillPostBuffer(
+                            chunk,
+                            std::min(chunk+333, dataEnd));
+                environment.parsePostBuffer();
+            }
+            if(properPosts != environment.posts)
+                FAIL_LOG("Fastcgipp::Http::Environment streamed multipart "\
+                        "posts didn't decode properly")
+            if(environment.postBuffer().size() >= 1024)
+                FAIL_LOG("Fastcgipp::Http::Environment streamed multipart "\
+                        "buffered too much data")
+
+            if(
+                    environment.files.size() != 1 ||
+                    environment.files.begin()->first != L"aFile" ||
+                    environment.files.begin()->second.filename
+                        != L"gnu.png" ||
+                    environment.files.begin()->second.contentType
+                        != L"image/png" ||
+                    environment.files.begin()->second.size != 58587 ||
+                    environment.files.begin()->second.data ||
+                    !environment.files.begin()->second.stream)
+                FAIL_LOG("Fastcgipp::Http::Environment streamed multipart "\
+                        "files didn't decode properly")
+            std::vector<char> spilled(58588);
+            if(
+                    std::fread(
+                        spilled.data(),
+                        1,
+                        spilled.size(),
+                        environment.files.begin()->second.stream.get())
+                        != sizeof(gnu_png) ||
+                    !std::equal(
+                        reinterpret_cast<const char*>(gnu_png),
+                        reinterpret_cast<const char*>(gnu_png)
+                            +sizeof(gnu_png),
+                        spilled.cbegin()))
+                FAIL_LOG("Fastcgipp::Http::Environment streamed multipart "\
+                        "file didn't spill properly")
+
+            // Now through a sink
+            std::vector<char> sunk;
+            bool completed = false;
+            environment.clear();
+            environment.streamPosts(
+                    1024,
+                    [&](
+                        const std::wstring& name,
+                        const Fastcgipp::Http::File<wchar_t>& file,
+                        const char* data,
+                        size_t size)
+                    {
+                        if(name != L"aFile" || file.filename != L"gnu.png")
+                            FAIL_LOG("Fastcgipp::Http::Environment file sink "\
+                                    "got the wrong file")
+                        if(size)
+                            sunk.insert(sunk.end(), data, data+size);
+                        else
+                            completed = true;
+                    });
+            {
+                const unsigned char parms[] = 
+#include "multipartParam.hpp"
+                environment.fill(
+                        reinterpret_cast<const char*>(parms),
+                        reinterpret_cast<const char*>(parms+sizeof(parms)-1));
+            }
+            {
+                static const unsigned char data[] = 
+#include "multipartPost.hpp"
+                const char* const dataEnd =
+                    reinterpret_cast<const char*>(data+sizeof(data));
+                for(
+                        const char* chunk = reinterpret_cast<const char*>(data);
+                        chunk < dataEnd;
+                        chunk += 1000)
+                    environment.fillPostBuffer(
+                            chunk,
+                            std::min(chunk+1000, dataEnd));
+                environment.parsePostBuffer();
+            }
+            if(
+                    properPosts != environment.posts ||
+                    !completed ||
+                    sunk.size() != sizeof(gnu_png) ||
+                    !std::equal(
+                        reinterpret_cast<const char*>(gnu_png),
+                        reinterpret_cast<const char*>(gnu_png)
+                            +sizeof(gnu_png),
+                        sunk.cbegin()))
+                FAIL_LOG("Fastcgipp::Http::Environment file sink "\
+                        "didn't receive the file properly")
+        }
+
         // Doing test with urlencoded POST
         {
             Fastcgipp::Http::Environment<wchar_t> environment;
@@ -720,6 +1164,28 @@ int main()
                 if(properPosts != environment.posts)
                     FAIL_LOG("Fastcgipp::Http::Environment urlencoded "\
                             "posts didn't decode properly")
+
+                // Checking streamed posts
+                {
+                    const unsigned char data[] = 
+#include "urlencodedPost.hpp"
+                    const char* const dataEnd =
+                        reinterpret_cast<const char*>(data+sizeof(data));
+                    environment.posts.clear();
+                    environment.streamPosts();
+                    for(
+                            const char* chunk =
+                                reinterpret_cast<const char*>(data);
+                            chunk < dataEnd;
+                            chunk += 7)
+                        environment.fillPostBuffer(
+                                chunk,
+                                std::min(chunk+7, dataEnd));
+                    environment.parsePostBuffer();
+                }
+                if(properPosts != environment.posts)
+                    FAIL_LOG("Fastcgipp::Http::Environment urlencoded "\
+                            "posts didn't stream properly")
             }
         }
     }
@@ -735,6 +1201,71 @@ int main()
             FAIL_LOG("Fastcgipp::Http::SessionId")
     }
 
+    // Testing Fastcgipp::Http::SessionId generation
+    {
+        typedef std::array<unsigned char, Fastcgipp::Http::SessionId::size>
+            Data;
+        const unsigned count = 100000;
+        std::set<Data> ids;
+        unsigned histogram[256] = {0};
+
+        for(unsigned i=0; i<count; ++i)
+        {
+            const Fastcgipp::Http::SessionId id;
+            if(!ids.insert(id.data()).second)
+                FAIL_LOG("Fastcgipp::Http::SessionId repeated itself")
+            for(const unsigned char byte: id.data())
+                ++histogram[byte];
+
+            if(i%1000 == 0)
+            {
+                std::ostringstream ss;
+                ss << id;
+                if(ss.str().size() != Fastcgipp::Http::SessionId::stringLength
+                        || !(Fastcgipp::Http::SessionId(ss.str()) == id))
+                    FAIL_LOG("Fastcgipp::Http::SessionId string round trip "\
+                            "failed")
+            }
+        }
+
+        const double expected = double(count)*ids.begin()->size()/256;
+        for(const unsigned frequency: histogram)
+            if(frequency < expected*0.9 || frequency > expected*1.1)
+                FAIL_LOG("Fastcgipp::Http::SessionId bytes aren't uniform")
+
+        Data other;
+        std::thread thread([&other] ()
+                {
+                    other = Fastcgipp::Http::SessionId().data();
+                });
+        thread.join();
+        if(ids.count(other))
+            FAIL_LOG("Fastcgipp::Http::SessionId repeated itself in a thread")
+
+        int pipe[2];
+        if(::pipe(pipe) != 0)
+            FAIL_LOG("Unable to create a pipe")
+        const pid_t child = ::fork();
+        if(child == 0)
+        {
+            const Fastcgipp::Http::SessionId id;
+            _exit(::write(pipe[1], id.data().data(), id.data().size())
+                    == ssize_t(id.data().size())?0:1);
+        }
+        const Fastcgipp::Http::SessionId parent;
+        int status;
+        if(::waitpid(child, &status, 0) != child
+                || !WIFEXITED(status)
+                || WEXITSTATUS(status) != 0
+                || ::read(pipe[0], other.data(), other.size())
+                    != ssize_t(other.size()))
+            FAIL_LOG("Forked child didn't produce a session ID")
+        ::close(pipe[0]);
+        ::close(pipe[1]);
+        if(other == parent.data() || ids.count(other))
+            FAIL_LOG("Fastcgipp::Http::SessionId repeated itself after a fork")
+    }
+
     // Testing Fastcgipp::Http::Sessions
     {
         char properExpiration[30];
@@ -840,5 +1371,146 @@ int main()
             FAIL_LOG("Fastcgipp::Http::Sessions::erase() didn't work");
     }
 
+    // Testing Fastcgipp::Http::SharedSessionStore
+    {
+        const std::string name("/fastcgipp-test-"+std::to_string(getpid()));
+        const auto serialize = [] (const std::string& x) { return x; };
+        const auto deserialize = [] (const std::string& x)
+        {
+            return std::make_shared<const std::string>(x);
+        };
+
+        Fastcgipp::Http::Sessions<std::string> first(
+                60,
+                std::make_shared<Fastcgipp::Http::SharedSessionStore>(
+                    name, 256, 32),
+                serialize,
+                deserialize);
+        Fastcgipp::Http::Sessions<std::string> second(
+                60,
+                std::make_shared<Fastcgipp::Http::SharedSessionStore>(
+                    name, 256, 32),
+                serialize,
+                deserialize);
+
+        std::vector<std::pair<Fastcgipp::Http::SessionId, std::string>> ids;
+        for(int i=0; i<32; ++i)
+        {
+            const std::string data("session"+std::to_string(i));
+            ids.emplace_back(
+                    first.generate(std::make_shared<std::string>(data)),
+                    data);
+        }
+
+        for(const auto& id: ids)
+        {
+            const auto data = second.get(id.first);
+            if(!data || *data != id.second)
+                FAIL_LOG("Fastcgipp::Http::SharedSessionStore session " \
+                        "missing from other store");
+        }
+
+        second.erase(ids.front().first);
+        if(first.get(ids.front().first))
+            FAIL_LOG("Fastcgipp::Http::SharedSessionStore erase not shared");
+        if(!first.get(ids.back().first))
+            FAIL_LOG("Fastcgipp::Http::SharedSessionStore erased too much");
+
+        if(!Fastcgipp::Http::SharedSessionStore::remove(name))
+            FAIL_LOG("Fastcgipp::Http::SharedSessionStore::remove() failed");
+    }
+
+    // Testing recovery of a SharedSessionStore slot abandoned mid write
+    {
+        const std::string name(
+                "/fastcgipp-test-abandoned-"+std::to_string(getpid()));
+        Fastcgipp::Http::SharedSessionStore store(name, 1, 32);
+        const Fastcgipp::Http::SessionId id;
+        if(!store.insert(id, "data", 100))
+            FAIL_LOG("Fastcgipp::Http::SharedSessionStore insert failed");
+
+        // A process that has come and gone
+        const pid_t child = fork();
+        if(child == 0)
+            _exit(0);
+        waitpid(child, nullptr, 0);
+
+        // Leave the only slot locked by it in the middle of a write. The
+        // lock is the first thing in the slot, right after the header.
+        const int fd = shm_open(name.c_str(), O_RDWR, 0600);
+        void* const memory = mmap(
+                nullptr,
+                4096,
+                PROT_READ|PROT_WRITE,
+                MAP_SHARED,
+                fd,
+                0);
+        close(fd);
+        if(memory == MAP_FAILED)
+            FAIL_LOG("Unable to map Fastcgipp::Http::SharedSessionStore");
+        std::atomic<uint64_t>& lock = *reinterpret_cast<std::atomic<uint64_t>*>(
+                static_cast<char*>(memory)+64);
+        lock = (uint64_t(child)<<32) | (lock&0xffffffff) | 1;
+
+        if(store.fetch(id, 0, 200, nullptr))
+            FAIL_LOG("Fastcgipp::Http::SharedSessionStore abandoned slot "\
+                    "wasn't emptied");
+        if(lock&1)
+            FAIL_LOG("Fastcgipp::Http::SharedSessionStore abandoned slot "\
+                    "wasn't unlocked");
+        if(!store.insert(id, "data", 300) || !store.fetch(id, 0, 300, nullptr))
+            FAIL_LOG("Fastcgipp::Http::SharedSessionStore recovered slot "\
+                    "unusable");
+        munmap(memory, 4096);
+
+        if(!Fastcgipp::Http::SharedSessionStore::remove(name))
+            FAIL_LOG("Fastcgipp::Http::SharedSessionStore::remove() failed");
+    }
+
+    // Testing If-None-Match entity tags
+    for(const auto& tag: {
+            std::make_pair(std::string("17"), 17U),
+            std::make_pair(std::string("\"4294967295\""), 4294967295U),
+            std::make_pair(std::string(" W/\"12-gzip\", \"13\""), 12U),
+            std::make_pair(std::string("*"), 0U)})
+    {
+        std::string parms("\x12");
+        parms += char(tag.first.size());
+        parms += "HTTP_IF_NONE_MATCH";
+        parms += tag.first;
+        Fastcgipp::Http::Environment<char> environment;
+        environment.fill(parms.data(), parms.data()+parms.size());
+        if(environment.etag != tag.second)
+            FAIL_LOG("Fastcgipp::Http::Environment didn't parse the "\
+                    "If-None-Match " << tag.first.c_str())
+    }
+
+    // Testing which unrecognized parameters are kept
+    {
+        const unsigned char parms[] = 
+#include "multipartParam.hpp"
+        Fastcgipp::Http::Environment<wchar_t> environment;
+        environment.fill(
+                reinterpret_cast<const char*>(parms),
+                reinterpret_cast<const char*>(parms+sizeof(parms)-1));
+        if(environment.others.size() != 14
+                || environment.others.count(L"HTTP_HOST")
+                || environment.others[L"SERVER_NAME"] != L"localhost")
+            FAIL_LOG("Fastcgipp::Http::Environment didn't keep all the "\
+                    "unrecognized parameters")
+
+        Fastcgipp::Http::keepOthers({"SERVER_NAME", "HTTP_DNT", "NOT_THERE"});
+        environment.clear();
+        environment.fill(
+                reinterpret_cast<const char*>(parms),
+                reinterpret_cast<const char*>(parms+sizeof(parms)-1));
+        if(environment.others.size() != 2
+                || environment.others[L"SERVER_NAME"] != L"localhost"
+                || environment.others[L"HTTP_DNT"] != L"1"
+                || environment.host != L"localhost")
+            FAIL_LOG("Fastcgipp::Http::Environment didn't keep only the "\
+                    "unrecognized parameters asked for")
+    }
+
     return 0;
 }
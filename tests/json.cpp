@@ -0,0 +1,269 @@
+#include "fastcgi++/log.hpp"
+#include "fastcgi++/json.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace
+{
+    //! Collects everything sent out of a stream buffer
+    template<class charT> class Collector
+    {
+    public:
+        Fastcgipp::FcgiStreambuf<charT> streambuf;
+
+        Collector()
+        {
+            streambuf.configure(
+                    Fastcgipp::Protocol::RequestId(1, Fastcgipp::Socket()),
+                    Fastcgipp::Protocol::RecordType::OUT,
+                    [this] (const Fastcgipp::Socket&, Fastcgipp::Block&& block)
+                    {
+                        const char* position = block.begin();
+                        while(position < block.end())
+                        {
+                            const Fastcgipp::Protocol::Header& header
+                                = *reinterpret_cast<
+                                    const Fastcgipp::Protocol::Header*>(
+                                            position);
+                            m_output.append(
+                                    position+sizeof(header),
+                                    header.contentLength);
+                            position += sizeof(header)+header.contentLength
+                                +header.paddingLength;
+                        }
+                    });
+        }
+
+        //! Flush and take everything sent so far
+        std::string take()
+        {
+            streambuf.pubsync();
+            std::string output;
+            output.swap(m_output);
+            return output;
+        }
+
+    private:
+        std::string m_output;
+    };
+
+    struct User
+    {
+        int id;
+        std::string name;
+        std::vector<int> groups;
+    };
+
+    inline auto jsonFields(const User*)
+    {
+        return std::make_tuple(
+                Fastcgipp::jsonField("id", &User::id),
+                Fastcgipp::jsonField("name", &User::name),
+                Fastcgipp::jsonField("groups", &User::groups));
+    }
+
+    //! Looks enough like SQL::Results
+    struct Results
+    {
+        unsigned rows() const
+        {
+            return 2;
+        }
+
+        std::tuple<int, std::string, double> row(unsigned row) const
+        {
+            return std::make_tuple(int(row), std::string(row, 'x'), 0.5*row);
+        }
+    };
+}
+
+int main()
+{
+    // Values, objects and arrays get their commas and colons
+    {
+        Collector<char> collector;
+        {
+            Fastcgipp::Json<char> json(collector.streambuf);
+            json.beginObject()
+                .field("a", 1)
+                .field("b", -17)
+                .key("c").beginArray()
+                    .value(true).value(false).value(nullptr)
+                    .beginArray().endArray()
+                    .beginObject().endObject()
+                .endArray()
+                .field("d", 0.1)
+                .field("e", std::string("x"))
+                .field("f", std::map<std::string, unsigned>{{"y", 2}, {"z", 3}})
+                .endObject();
+        }
+        const std::string output = collector.take();
+        if(output != "{\"a\":1,\"b\":-17,\"c\":[true,false,null,[],{}],"
+                "\"d\":0.1,\"e\":\"x\",\"f\":{\"y\":2,\"z\":3}}")
+            FAIL_LOG("Structure came out wrong: " << output.c_str())
+    }
+
+    // Strings are escaped on both sides of the vectorized scan
+    {
+        Collector<char> collector;
+        {
+            Fastcgipp::Json<char> json(collector.streambuf);
+            json.value(
+                    "a\"b\\c\n\t\x01 and a whole lot more text to scan/\x1f");
+        }
+        const std::string output = collector.take();
+        if(output != "\"a\\\"b\\\\c\\n\\t\\u0001 and a whole lot more text to "
+                "scan/\\u001f\"")
+            FAIL_LOG("String was escaped wrong: " << output.c_str())
+    }
+
+    // Numbers are exact and as short as they can be
+    {
+        Collector<char> collector;
+        const double third = 1.0/3;
+        {
+            Fastcgipp::Json<char> json(collector.streambuf);
+            json.beginArray()
+                .value(std::numeric_limits<std::int64_t>::min())
+                .value(std::numeric_limits<std::uint64_t>::max())
+                .value(0).value(short(-5)).value(100.0).value(1.5e300)
+                .value(0.1f).value(-0.25f)
+                .value(std::nan("")).value(HUGE_VAL)
+                .endArray()
+                .value(third);
+        }
+        const std::string output = collector.take();
+        const std::string expected = "[-9223372036854775808,"
+            "18446744073709551615,0,-5,100,1.5e+300,0.1,-0.25,null,null]";
+        if(output.compare(0, expected.size(), expected) != 0)
+            FAIL_LOG("Numbers came out wrong: " << output.c_str())
+        if(std::strtod(output.c_str()+expected.size()+1, nullptr) != third)
+            FAIL_LOG("Double didn't survive the round trip: " << output.c_str())
+    }
+
+    // Every double and float comes back exactly as it went out
+    {
+        std::vector<double> doubles;
+        std::vector<float> floats;
+        for(int i=-500; i<500; ++i)
+        {
+            doubles.push_back(i*0.37);
+            doubles.push_back(i*1e-7);
+            doubles.push_back(i*123456.789e10);
+            doubles.push_back(1.0/(i|1));
+            floats.push_back(i*0.37f);
+            floats.push_back(1.0f/(i|1));
+        }
+
+        Collector<char> collector;
+        {
+            Fastcgipp::Json<char> json(collector.streambuf);
+            json.value(doubles).value(floats);
+        }
+        const std::string output = collector.take();
+        const char* position = output.c_str();
+        char* end;
+        for(const double x: doubles)
+        {
+            if(std::strtod(++position, &end) != x)
+                FAIL_LOG("Double " << x << " came out as " \
+                        << std::string(position, end-position).c_str())
+            position = end;
+        }
+        position += 2;
+        for(const float x: floats)
+        {
+            if(float(std::strtod(++position, &end)) != x)
+                FAIL_LOG("Float " << x << " came out as " \
+                        << std::string(position, end-position).c_str())
+            position = end;
+        }
+        if(output.find(",0.37,") == std::string::npos)
+            FAIL_LOG("Short fraction wasn't written as such")
+    }
+
+    // Structs, tuples and result sets
+    {
+        Collector<char> collector;
+        {
+            Fastcgipp::Json<char> json(collector.streambuf);
+            json.beginArray()
+                .value(std::vector<User>{{1, "one", {2, 3}}, {4, "four", {}}})
+                .value(std::make_tuple(1, "a", false))
+                .object(std::make_tuple(2, "b"), {"x", "y"})
+                .rows(Results())
+                .rows(Results(), {"id", "name", "half"})
+                .endArray();
+        }
+        const std::string output = collector.take();
+        if(output != "[[{\"id\":1,\"name\":\"one\",\"groups\":[2,3]},"
+                "{\"id\":4,\"name\":\"four\",\"groups\":[]}],"
+                "[1,\"a\",false],{\"x\":2,\"y\":\"b\"},"
+                "[[0,\"\",0],[1,\"x\",0.5]],"
+                "[{\"id\":0,\"name\":\"\",\"half\":0},"
+                "{\"id\":1,\"name\":\"x\",\"half\":0.5}]]")
+            FAIL_LOG("Compound values came out wrong: " << output.c_str())
+    }
+
+    // Wide strings are encoded properly by either kind of writer
+    {
+        Collector<char> narrow;
+        Collector<wchar_t> wide;
+        {
+            Fastcgipp::Json<char> json(narrow.streambuf);
+            json.value(L"\u00e9\u20ac\U0001f600\"\n");
+        }
+        {
+            Fastcgipp::Json<wchar_t> json(wide.streambuf);
+            json.beginObject()
+                .field("text", std::wstring(L"\u00e9\u20ac\U0001f600\"\n"))
+                .field("number", 12)
+                .endObject();
+        }
+        const std::string text
+            = "\"\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80\\\"\\n\"";
+        const std::string output = narrow.take();
+        if(output != text)
+            FAIL_LOG("Wide string was encoded wrong: " << output.c_str())
+        const std::string wideOutput = wide.take();
+        if(wideOutput != "{\"text\":"+text+",\"number\":12}")
+            FAIL_LOG("Wide writer came out wrong: " << wideOutput.c_str())
+    }
+
+    // Tiny buffers get emptied along the way and mix with the stream
+    {
+        Collector<char> collector;
+        collector.streambuf.bufferSize(7);
+        std::ostream out(&collector.streambuf);
+        std::ostringstream expected;
+
+        out << "head ";
+        expected << "head [";
+        {
+            Fastcgipp::Json<char> json(out);
+            json.beginArray();
+            for(int i=0; i<1000; ++i)
+            {
+                json.value(i*7919).value("escape \"this\"");
+                expected << (i?",":"") << i*7919 << ",\"escape \\\"this\\\"\"";
+            }
+            json.endArray();
+        }
+        out << " tail";
+        expected << "] tail";
+
+        const std::string output = collector.take();
+        if(output != expected.str())
+            FAIL_LOG("Output through a tiny buffer came out wrong")
+    }
+
+    return 0;
+}
@@ -0,0 +1,697 @@
+#include "fastcgi++/log.hpp"
+#include "fastcgi++/manager.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace
+{
+    //! Size of the text for "/large"
+    const size_t large = 0x800000;
+
+    //! Holds requests up until it is opened
+    class Gate
+    {
+    public:
+        Gate():
+            m_open(true),
+            m_waiting(0)
+        {}
+
+        void open()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_open = true;
+            m_opened.notify_all();
+        }
+
+        void close()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_open = false;
+        }
+
+        //! Wait until the gate is open
+        void pass()
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            ++m_waiting;
+            m_opened.wait(lock, [this] { return m_open; });
+            --m_waiting;
+        }
+
+        //! How many are waiting to pass
+        unsigned waiting() const
+        {
+            return m_waiting;
+        }
+
+    private:
+        std::mutex m_mutex;
+        std::condition_variable m_opened;
+        bool m_open;
+        std::atomic_uint m_waiting;
+    } gate;
+
+    //! Answers with a short bit of text
+    /*!
+     * Requests for "/stuck" wait at the gate first and so do requests for
+     * "/blocking" but in a blocking section. Requests for "/large" get a
+     * lot more text. Requests for anything under "/early" are dispatched
+     * early and those for "/early/stuck" wait at the gate too.
+     */
+    class Hello: public Fastcgipp::Request<char>
+    {
+        bool earlyDispatch()
+        {
+            return environment().requestUri.compare(0, 6, "/early") == 0;
+        }
+
+        bool response()
+        {
+            if(environment().requestUri == "/large")
+            {
+                out << "Content-Type: text/plain\r\n\r\n"
+                    << std::string(large, 'x');
+                return true;
+            }
+            else if(environment().requestUri == "/stuck"
+                    || environment().requestUri == "/early/stuck")
+                gate.pass();
+            else if(environment().requestUri == "/blocking")
+            {
+                Fastcgipp::Manager_base::Blocking blocking;
+                gate.pass();
+            }
+            out << "Content-Type: text/plain\r\n\r\nhello";
+            return true;
+        }
+    };
+
+    //! A record as received from the Manager
+    struct Record
+    {
+        Fastcgipp::Protocol::RecordType type;
+        Fastcgipp::Protocol::FcgiId id;
+        std::string content;
+
+        //! The protocol status of an END_REQUEST record
+        Fastcgipp::Protocol::ProtocolStatus status() const
+        {
+            return reinterpret_cast<const Fastcgipp::Protocol::EndRequest*>(
+                    content.data())->protocolStatus;
+        }
+    };
+
+    //! The web server side of a single connection
+    class Client
+    {
+    public:
+        Client(const std::string& path):
+            m_fd(::socket(AF_UNIX, SOCK_STREAM, 0))
+        {
+            sockaddr_un address;
+            std::memset(&address, 0, sizeof(address));
+            address.sun_family = AF_UNIX;
+            std::strncpy(
+                    address.sun_path,
+                    path.c_str(),
+                    sizeof(address.sun_path)-1);
+            if(::connect(
+                        m_fd,
+                        reinterpret_cast<sockaddr*>(&address),
+                        sizeof(address)) != 0)
+                FAIL_LOG("Unable to connect to " << path.c_str())
+        }
+
+        ~Client()
+        {
+            hangUp();
+        }
+
+        void hangUp()
+        {
+            if(m_fd >= 0)
+                ::close(m_fd);
+            m_fd = -1;
+        }
+
+        //! Send a single record
+        void send(
+                Fastcgipp::Protocol::RecordType type,
+                Fastcgipp::Protocol::FcgiId id,
+                const std::string& content)
+        {
+            Fastcgipp::Protocol::Header header;
+            header.version = Fastcgipp::Protocol::version;
+            header.type = type;
+            header.fcgiId = id;
+            header.contentLength = content.size();
+            header.paddingLength = 0;
+            header.reserved = 0;
+            std::string buffer(
+                    reinterpret_cast<const char*>(&header),
+                    sizeof(header));
+            buffer += content;
+            if(::send(m_fd, buffer.data(), buffer.size(), MSG_NOSIGNAL)
+                    != ssize_t(buffer.size()))
+                FAIL_LOG("Unable to send a record")
+        }
+
+        //! Begin a request keeping the connection open
+        void begin(Fastcgipp::Protocol::FcgiId id)
+        {
+            Fastcgipp::Protocol::BeginRequest body;
+            std::memset(&body, 0, sizeof(body));
+            body.role = Fastcgipp::Protocol::Role::RESPONDER;
+            body.flags = Fastcgipp::Protocol::BeginRequest::keepConnBit;
+            send(
+                    Fastcgipp::Protocol::RecordType::BEGIN_REQUEST,
+                    id,
+                    std::string(
+                        reinterpret_cast<const char*>(&body),
+                        sizeof(body)));
+        }
+
+        //! Send the parameters of a begun request
+        void params(
+                Fastcgipp::Protocol::FcgiId id,
+                const std::string& uri = "/")
+        {
+            using Fastcgipp::Protocol::RecordType;
+            send(
+                    RecordType::PARAMS,
+                    id,
+                    "\x0e\x03REQUEST_METHODGET\x0b" + std::string(1, uri.size())
+                    + "REQUEST_URI" + uri);
+            send(RecordType::PARAMS, id, "");
+        }
+
+        //! Send the parameters and input of a begun request
+        void complete(
+                Fastcgipp::Protocol::FcgiId id,
+                const std::string& uri = "/")
+        {
+            params(id, uri);
+            send(Fastcgipp::Protocol::RecordType::IN, id, "");
+        }
+
+        //! True if something has been received
+        bool pending(int timeout)
+        {
+            pollfd descriptor = {m_fd, POLLIN, 0};
+            return !m_received.empty() || ::poll(&descriptor, 1, timeout) == 1;
+        }
+
+        //! Take the next record received within a few seconds
+        bool next(Record& record)
+        {
+            const size_t headerSize = sizeof(Fastcgipp::Protocol::Header);
+            while(true)
+            {
+                if(m_received.size() >= headerSize)
+                {
+                    const Fastcgipp::Protocol::Header& header
+                        = *reinterpret_cast<const Fastcgipp::Protocol::Header*>(
+                                m_received.data());
+                    const size_t size = headerSize+header.contentLength
+                        +header.paddingLength;
+                    if(m_received.size() >= size)
+                    {
+                        record.type = header.type;
+                        record.id = header.fcgiId;
+                        record.content.assign(
+                                m_received,
+                                headerSize,
+                                header.contentLength);
+                        m_received.erase(0, size);
+                        return true;
+                    }
+                }
+
+                if(!receive())
+                    return false;
+            }
+        }
+
+        //! Receive at least a number of bytes without taking any records
+        bool buffer(size_t size)
+        {
+            while(m_received.size() < size)
+                if(!receive())
+                    return false;
+            return true;
+        }
+
+        //! Take the output of a request up to it's END_REQUEST record
+        bool output(
+                Fastcgipp::Protocol::FcgiId id,
+                std::string& output,
+                Fastcgipp::Protocol::ProtocolStatus& status)
+        {
+            output.clear();
+            Record record;
+            while(next(record))
+            {
+                if(record.id != id)
+                    FAIL_LOG("Got a record for the wrong request")
+                if(record.type == Fastcgipp::Protocol::RecordType::OUT)
+                    output += record.content;
+                else if(record.type
+                        == Fastcgipp::Protocol::RecordType::END_REQUEST)
+                {
+                    status = record.status();
+                    return true;
+                }
+            }
+            return false;
+        }
+
+    private:
+        int m_fd;
+        std::string m_received;
+
+        //! Receive whatever arrives within a few seconds
+        bool receive()
+        {
+            pollfd descriptor = {m_fd, POLLIN, 0};
+            if(::poll(&descriptor, 1, 5000) != 1)
+                return false;
+            char chunk[0x10000];
+            const ssize_t size = ::read(m_fd, chunk, sizeof(chunk));
+            if(size <= 0)
+                return false;
+            m_received.append(chunk, size);
+            return true;
+        }
+    };
+
+    const std::string hello = "Content-Type: text/plain\r\n\r\nhello";
+
+    //! Wait for something to settle on a value
+    bool settles(const std::function<int64_t()>& current, int64_t value)
+    {
+        for(unsigned i=0; i<500 && current() != value; ++i)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        return current() == value;
+    }
+
+    //! Wait for a metric to settle on a value
+    template<class Metric>
+    bool reaches(const Metric& metric, int64_t value)
+    {
+        return settles([&metric] { return int64_t(metric.value()); }, value);
+    }
+
+    //! Make a request on it's own connection
+    std::unique_ptr<Client> request(
+            const std::string& path,
+            const std::string& uri = "/")
+    {
+        std::unique_ptr<Client> client(new Client(path));
+        client->begin(1);
+        client->complete(1, uri);
+        return client;
+    }
+
+    //! Check the output of a request made with request()
+    bool answered(Client& client)
+    {
+        std::string output;
+        Fastcgipp::Protocol::ProtocolStatus status;
+        return client.output(1, output, status)
+            && status == Fastcgipp::Protocol::ProtocolStatus::REQUEST_COMPLETE
+            && output == hello;
+    }
+
+}
+
+int main()
+{
+    using Fastcgipp::Protocol::RecordType;
+    using Fastcgipp::Protocol::ProtocolStatus;
+    const std::string path = "/tmp/fastcgipp-manager-test-"
+        + std::to_string(::getpid());
+
+    // Management records report our limits
+    {
+        Fastcgipp::Manager<Hello> manager(2);
+        manager.maxConnections(10);
+        manager.maxRequests(3);
+        manager.multiplex(false);
+        if(!manager.listen(path.c_str()))
+            FAIL_LOG("Unable to listen on " << path.c_str())
+        manager.start();
+
+        Client client(path);
+        client.send(
+                RecordType::GET_VALUES,
+                0,
+                std::string("\x0e\x00" "FCGI_MAX_CONNS", 16)
+                + std::string("\x0d\x00" "FCGI_MAX_REQS", 15)
+                + std::string("\x0f\x00" "FCGI_MPXS_CONNS", 17)
+                + std::string("\x07\x00" "UNKNOWN", 9));
+        Record record;
+        if(!client.next(record)
+                || record.type != RecordType::GET_VALUES_RESULT
+                || record.id != 0)
+            FAIL_LOG("Didn't get a GET_VALUES_RESULT record")
+        if(record.content != "\x0e\x02" "FCGI_MAX_CONNS" "10"
+                    "\x0d\x01" "FCGI_MAX_REQS" "3"
+                    "\x0f\x01" "FCGI_MPXS_CONNS" "0")
+            FAIL_LOG("GET_VALUES_RESULT has the wrong values")
+
+        client.hangUp();
+        manager.stop();
+        manager.join();
+        ::unlink(path.c_str());
+    }
+
+    // Concurrent requests beyond the limit are overloaded in either mode
+    for(const bool affinity: {false, true})
+    {
+        const unsigned limit = 8;
+        const unsigned connections = 32;
+        Fastcgipp::Manager<Hello> manager(4);
+        manager.maxRequests(limit);
+        manager.affinity(affinity);
+        if(!manager.listen(path.c_str()))
+            FAIL_LOG("Unable to listen on " << path.c_str())
+        manager.start();
+
+        const uint64_t rejections
+            = Fastcgipp::Metrics::requestLimitRejections.value();
+        std::vector<std::unique_ptr<Client>> clients;
+        for(unsigned i=0; i<connections; ++i)
+            clients.emplace_back(new Client(path));
+        for(auto& client: clients)
+            client->begin(1);
+
+        if(!reaches(
+                    Fastcgipp::Metrics::requestLimitRejections,
+                    rejections+connections-limit))
+            FAIL_LOG("Got the wrong number of OVERLOADED rejections")
+        if(Fastcgipp::Metrics::activeRequests.value() != limit)
+            FAIL_LOG("More requests were admitted than the limit")
+
+        unsigned overloaded = 0;
+        for(auto& client: clients)
+        {
+            std::string output;
+            ProtocolStatus status;
+            // Rejected requests already have their END_REQUEST waiting
+            if(!client->pending(100))
+                client->complete(1);
+            if(!client->output(1, output, status))
+                FAIL_LOG("Request never ended")
+            if(status == ProtocolStatus::OVERLOADED)
+                ++overloaded;
+            else if(status != ProtocolStatus::REQUEST_COMPLETE
+                    || output != hello)
+                FAIL_LOG("Admitted request didn't complete")
+        }
+        if(overloaded != connections-limit)
+            FAIL_LOG("Wrong requests were told they were OVERLOADED")
+
+        clients.clear();
+        manager.stop();
+        manager.join();
+        ::unlink(path.c_str());
+    }
+
+    // Without multiplexing a busy connection can't take another request
+    {
+        Fastcgipp::Manager<Hello> manager(2);
+        manager.multiplex(false);
+        if(!manager.listen(path.c_str()))
+            FAIL_LOG("Unable to listen on " << path.c_str())
+        manager.start();
+
+        Client client(path);
+        std::string output;
+        ProtocolStatus status;
+        client.begin(1);
+        client.begin(2);
+        if(!client.output(2, output, status)
+                || status != ProtocolStatus::CANT_MPX_CONN
+                || !output.empty())
+            FAIL_LOG("Multiplexed request wasn't rejected")
+
+        client.complete(1);
+        if(!client.output(1, output, status)
+                || status != ProtocolStatus::REQUEST_COMPLETE
+                || output != hello)
+            FAIL_LOG("First request didn't complete")
+
+        client.begin(2);
+        client.complete(2);
+        if(!client.output(2, output, status)
+                || status != ProtocolStatus::REQUEST_COMPLETE
+                || output != hello)
+            FAIL_LOG("Request after the first didn't complete")
+
+        client.hangUp();
+        manager.stop();
+        manager.join();
+        ::unlink(path.c_str());
+    }
+
+    // Threads can be added and removed while running
+    {
+        using Fastcgipp::Metrics::handlerThreads;
+        Fastcgipp::Manager<Hello> manager(4);
+        if(!manager.listen(path.c_str()))
+            FAIL_LOG("Unable to listen on " << path.c_str())
+        manager.start();
+
+        if(!reaches(handlerThreads, 4))
+            FAIL_LOG("Manager didn't start all it's threads")
+        manager.resizeThreads(2);
+        if(!reaches(handlerThreads, 2))
+            FAIL_LOG("Surplus threads didn't quit")
+        if(!answered(*request(path)))
+            FAIL_LOG("Request wasn't answered with fewer threads")
+        manager.resizeThreads(4);
+        if(!reaches(handlerThreads, 4))
+            FAIL_LOG("Threads weren't added")
+        if(!answered(*request(path)))
+            FAIL_LOG("Request wasn't answered with more threads")
+
+        manager.stop();
+        manager.join();
+        ::unlink(path.c_str());
+    }
+
+    // Joining has to wait for threads that are retiring
+    for(unsigned i=0; i<10; ++i)
+    {
+        Fastcgipp::Manager<Hello> manager(8);
+        if(!manager.listen(path.c_str()))
+            FAIL_LOG("Unable to listen on " << path.c_str())
+        manager.start();
+        manager.resizeThreads(1);
+        manager.stop();
+        manager.join();
+        if(Fastcgipp::Metrics::handlerThreads.value() != 0)
+            FAIL_LOG("Threads are still running after a join")
+        ::unlink(path.c_str());
+    }
+
+    // The pool grows even when all threads are stuck and shrinks when idle
+    {
+        using Fastcgipp::Metrics::handlerThreads;
+        Fastcgipp::Manager<Hello> manager;
+        manager.scaleThreads(
+                1,
+                4,
+                std::chrono::milliseconds(5),
+                std::chrono::milliseconds(100));
+        if(!manager.listen(path.c_str()))
+            FAIL_LOG("Unable to listen on " << path.c_str())
+        manager.start();
+        if(!reaches(handlerThreads, 1))
+            FAIL_LOG("Scaling didn't start with the minimum")
+
+        gate.close();
+        std::vector<std::unique_ptr<Client>> clients;
+        for(unsigned i=0; i<5; ++i)
+            clients.push_back(request(path, "/stuck"));
+        if(!settles([] { return gate.waiting(); }, 4)
+                || !reaches(handlerThreads, 4))
+            FAIL_LOG("Stuck threads weren't made up for")
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        if(handlerThreads.value() != 4 || gate.waiting() != 4)
+            FAIL_LOG("Pool grew beyond it's maximum")
+        gate.open();
+        for(auto& client: clients)
+            if(!answered(*client))
+                FAIL_LOG("Stuck request wasn't answered")
+        clients.clear();
+
+        if(!reaches(handlerThreads, 1))
+            FAIL_LOG("Idle threads didn't quit")
+        if(!answered(*request(path)))
+            FAIL_LOG("Request wasn't answered after shrinking")
+
+        manager.stop();
+        manager.join();
+        ::unlink(path.c_str());
+    }
+
+    // Blocking sections get a thread started in their place
+    {
+        using Fastcgipp::Metrics::handlerThreads;
+        using Fastcgipp::Metrics::blockedThreads;
+        Fastcgipp::Manager<Hello> manager(1);
+        if(!manager.listen(path.c_str()))
+            FAIL_LOG("Unable to listen on " << path.c_str())
+        manager.start();
+
+        gate.close();
+        auto blocked = request(path, "/blocking");
+        if(!settles([] { return gate.waiting(); }, 1)
+                || !reaches(blockedThreads, 1)
+                || !reaches(handlerThreads, 2))
+            FAIL_LOG("Blocking section didn't start another thread")
+        if(!answered(*request(path)))
+            FAIL_LOG("Request wasn't answered during a blocking section")
+        gate.open();
+        if(!answered(*blocked))
+            FAIL_LOG("Blocking request wasn't answered")
+        blocked.reset();
+        if(!reaches(blockedThreads, 0) || !reaches(handlerThreads, 1))
+            FAIL_LOG("Surplus thread didn't quit after a blocking section")
+
+        manager.stop();
+        manager.join();
+        ::unlink(path.c_str());
+    }
+
+    // Only the loop with too much output queued stops reading
+    {
+        Fastcgipp::Manager<Hello> manager(2);
+        manager.resizeLoops(2);
+        manager.maxSendBytes(large/2);
+        manager.overloadResponse(true);
+        if(!manager.listen(path.c_str()))
+            FAIL_LOG("Unable to listen on " << path.c_str())
+        manager.start();
+
+        // Connections go round-robin between the loops
+        const uint64_t pauses = Fastcgipp::Metrics::readPauses.value();
+        Client slow(path);
+        Client other(path);
+        Client same(path);
+        slow.begin(1);
+        slow.complete(1, "/large");
+        if(!reaches(Fastcgipp::Metrics::readPauses, pauses+1))
+            FAIL_LOG("Loop with a backlog didn't pause")
+
+        std::string output;
+        ProtocolStatus status;
+        other.begin(1);
+        if(!other.output(1, output, status)
+                || status != ProtocolStatus::REQUEST_COMPLETE
+                || output != "Status: 503 Service Unavailable\r\n"
+                    "Retry-After: 1\r\n"
+                    "Content-Type: text/plain; charset=utf-8\r\n\r\n"
+                    "503 Service Unavailable")
+            FAIL_LOG("Other loop didn't respond with a 503 while congested")
+
+        // Short of half the limit the loop stays paused
+        same.begin(1);
+        same.complete(1);
+        if(!slow.buffer(large*5/8) || same.pending(200))
+            FAIL_LOG("Loop resumed before it's backlog was down to half")
+
+        if(!slow.output(1, output, status)
+                || status != ProtocolStatus::REQUEST_COMPLETE
+                || output.size() != hello.size()-5+large)
+            FAIL_LOG("Large output didn't come through")
+        if(!answered(same))
+            FAIL_LOG("Loop didn't resume once it's backlog was gone")
+        if(Fastcgipp::Metrics::readPauses.value() != pauses+1)
+            FAIL_LOG("Loop paused more often than it should have")
+
+        slow.hangUp();
+        other.hangUp();
+        same.hangUp();
+        manager.stop();
+        manager.join();
+        ::unlink(path.c_str());
+    }
+
+    // Only the empty IN records trailing early dispatches go unreported
+    for(const bool affinity: {false, true})
+    {
+        using Fastcgipp::Metrics::orphanRecords;
+        Fastcgipp::Manager<Hello> manager(2);
+        manager.affinity(affinity);
+        if(!manager.listen(path.c_str()))
+            FAIL_LOG("Unable to listen on " << path.c_str())
+        manager.start();
+
+        Client client(path);
+        const auto answered = [&client] (Fastcgipp::Protocol::FcgiId id)
+        {
+            std::string output;
+            ProtocolStatus status;
+            return client.output(id, output, status)
+                && status == ProtocolStatus::REQUEST_COMPLETE
+                && output == hello;
+        };
+        const uint64_t orphans = orphanRecords.value();
+
+        // Completed before it's input was terminated
+        client.begin(1);
+        client.params(1, "/early");
+        if(!answered(1))
+            FAIL_LOG("Early request wasn't answered before it's input")
+        client.send(RecordType::IN, 1, "");
+
+        // Still responding when it's input was terminated
+        gate.close();
+        client.begin(2);
+        client.params(2, "/early/stuck");
+        if(!settles([] { return gate.waiting(); }, 1))
+            FAIL_LOG("Early request wasn't dispatched")
+        client.send(RecordType::IN, 2, "");
+        gate.open();
+        if(!answered(2))
+            FAIL_LOG("Stuck early request wasn't answered")
+
+        client.begin(3);
+        client.complete(3);
+        if(!answered(3) || orphanRecords.value() != orphans)
+            FAIL_LOG("Trailing IN record was taken for an orphan")
+
+        // Nothing else trails
+        client.send(RecordType::IN, 1, "");
+        client.send(RecordType::IN, 7, "");
+        client.begin(4);
+        client.complete(4);
+        if(!answered(4) || orphanRecords.value() != orphans+2)
+            FAIL_LOG("Empty IN records for missing requests weren't "\
+                    "reported")
+
+        client.hangUp();
+        manager.stop();
+        manager.join();
+        ::unlink(path.c_str());
+    }
+
+    return 0;
+}
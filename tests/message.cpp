@@ -0,0 +1,102 @@
+#include "fastcgi++/log.hpp"
+#include "fastcgi++/message.hpp"
+
+#include <memory>
+#include <string>
+#include <queue>
+
+namespace
+{
+    //! Counts how many of it are alive
+    struct Counted
+    {
+        static int alive;
+        int value;
+
+        Counted(int value_):
+            value(value_)
+        {
+            ++alive;
+        }
+
+        Counted(Counted&& x) noexcept:
+            value(x.value)
+        {
+            ++alive;
+        }
+
+        ~Counted()
+        {
+            --alive;
+        }
+    };
+
+    int Counted::alive = 0;
+
+    //! Too big to be stored inline
+    struct Big
+    {
+        Counted counted;
+        char padding[Fastcgipp::Message::inlineSize];
+
+        Big(int value):
+            counted(value)
+        {}
+    };
+}
+
+int main()
+{
+    // Small payloads live inside the message and move along with it
+    {
+        Fastcgipp::Message message(7);
+        if(message.payload<int>() != nullptr)
+            FAIL_LOG("Empty message has a payload")
+        message.emplace<Counted>(3);
+        const char* const address = reinterpret_cast<const char*>(
+                message.payload<Counted>());
+        if(address < reinterpret_cast<const char*>(&message)
+                || address >= reinterpret_cast<const char*>(&message+1))
+            FAIL_LOG("Small payload wasn't stored inline")
+        if(message.payload<int>() != nullptr)
+            FAIL_LOG("Payload was found as the wrong type")
+
+        std::queue<Fastcgipp::Message> queue;
+        queue.push(std::move(message));
+        if(message.payload<Counted>() != nullptr)
+            FAIL_LOG("Moved from message still has it's payload")
+        Fastcgipp::Message moved;
+        moved = std::move(queue.front());
+        queue.pop();
+        if(moved.type != 7 || moved.payload<Counted>() == nullptr
+                || moved.payload<Counted>()->value != 3)
+            FAIL_LOG("Payload didn't survive being moved")
+        if(Counted::alive != 1)
+            FAIL_LOG("Moving leaked or lost payloads")
+    }
+    if(Counted::alive != 0)
+        FAIL_LOG("Small payload wasn't destroyed")
+
+    // Large and move-only payloads are held by pointer
+    {
+        Fastcgipp::Message message(8);
+        Big& big = message.emplace<Big>(5);
+        Fastcgipp::Message moved(std::move(message));
+        if(moved.payload<Big>() != &big || big.counted.value != 5)
+            FAIL_LOG("Large payload was moved instead of it's pointer")
+
+        moved.emplace<std::unique_ptr<std::string>>(new std::string("abc"));
+        if(Counted::alive != 0)
+            FAIL_LOG("Replaced payload wasn't destroyed")
+        const Fastcgipp::Message& constant = moved;
+        if(!constant.payload<std::unique_ptr<std::string>>()
+                || **constant.payload<std::unique_ptr<std::string>>()
+                    != "abc")
+            FAIL_LOG("Move-only payload didn't come through")
+        moved.reset();
+        if(moved.payload<std::unique_ptr<std::string>>() != nullptr)
+            FAIL_LOG("Reset message still has a payload")
+    }
+
+    return 0;
+}
@@ -0,0 +1,178 @@
+#include "fastcgi++/log.hpp"
+#include "fastcgi++/metrics.hpp"
+
+#include <thread>
+#include <vector>
+#include <sstream>
+#include <string>
+
+int main()
+{
+    // Testing Fastcgipp::Metrics::Counter and Gauge across threads
+    {
+        Fastcgipp::Metrics::Counter counter(
+                "test_counter_total",
+                "A test counter");
+        Fastcgipp::Metrics::Gauge gauge(
+                "test_gauge",
+                "A test gauge");
+
+        std::vector<std::thread> threads;
+        for(int i=0; i<20; ++i)
+            threads.emplace_back([&counter, &gauge] ()
+            {
+                for(int j=0; j<10000; ++j)
+                {
+                    ++counter;
+                    gauge.add(3);
+                    gauge.sub(2);
+                }
+            });
+        for(auto& thread: threads)
+            thread.join();
+
+        if(counter.value() != 200000)
+            FAIL_LOG("Fastcgipp::Metrics::Counter lost updates: " \
+                    << counter.value())
+        if(gauge.value() != 200000)
+            FAIL_LOG("Fastcgipp::Metrics::Gauge lost updates: " \
+                    << gauge.value())
+    }
+
+    // Testing Fastcgipp::Metrics::Peak
+    {
+        Fastcgipp::Metrics::Peak peak("test_peak", "A test peak");
+        peak.update(5);
+        peak.update(17);
+        peak.update(3);
+        if(peak.value() != 17)
+            FAIL_LOG("Fastcgipp::Metrics::Peak is " << peak.value())
+    }
+
+    // Testing Fastcgipp::Metrics::each() and write()
+    {
+        Fastcgipp::Metrics::Counter first(
+                "test_labelled_total",
+                "A labelled counter",
+                "kind=\"first\"");
+        Fastcgipp::Metrics::Counter second(
+                "test_labelled_total",
+                "A labelled counter",
+                "kind=\"second\"");
+        first += 4;
+        second += 9;
+
+        unsigned found = 0;
+        bool unregistered = true;
+        Fastcgipp::Metrics::each([&] (const Fastcgipp::Metrics::Metric& x)
+        {
+            if(std::string(x.name) == "test_labelled_total")
+                ++found;
+            if(std::string(x.name) == "test_peak")
+                unregistered = false;
+        });
+        if(found != 2)
+            FAIL_LOG("Fastcgipp::Metrics::each() found " << found)
+        if(!unregistered)
+            FAIL_LOG("Fastcgipp::Metrics::Metric wasn't unregistered")
+
+        std::ostringstream text;
+        Fastcgipp::Metrics::write(text);
+        const std::string expected(
+                "# HELP test_labelled_total A labelled counter\n"
+                "# TYPE test_labelled_total counter\n"
+                "test_labelled_total{kind=\"first\"} 4\n"
+                "test_labelled_total{kind=\"second\"} 9\n");
+        if(text.str().find(expected) == std::string::npos)
+            FAIL_LOG("Fastcgipp::Metrics::write() gave\n" << text.str().c_str())
+        if(text.str().find(
+                    "# TYPE fastcgipp_records_received_total counter\n"
+                    "fastcgipp_records_received_total{type=\"OTHER\"} 0\n")
+                == std::string::npos)
+            FAIL_LOG("Fastcgipp::Metrics::write() is missing library metrics")
+    }
+
+    // Testing Fastcgipp::Metrics::Histogram buckets
+    {
+        typedef Fastcgipp::Metrics::Histogram Histogram;
+        for(unsigned i=0; i+1<Histogram::buckets; ++i)
+        {
+            if(Histogram::bucket(Histogram::lower(i)) != i
+                    || Histogram::bucket(Histogram::upper(i)) != i
+                    || Histogram::upper(i)+1 != Histogram::lower(i+1))
+                FAIL_LOG("Fastcgipp::Metrics::Histogram bucket " << i \
+                        << " is broken")
+            if(i >= 16 && Histogram::upper(i)-Histogram::lower(i)
+                    > Histogram::lower(i)/Histogram::subBuckets)
+                FAIL_LOG("Fastcgipp::Metrics::Histogram bucket " << i \
+                        << " is too wide")
+        }
+        if(Histogram::bucket(~0ULL) != Histogram::buckets-1)
+            FAIL_LOG("Fastcgipp::Metrics::Histogram doesn't clamp")
+    }
+
+    // Testing Fastcgipp::Metrics::Histogram recording and quantiles
+    {
+        Fastcgipp::Metrics::Histogram histogram(
+                "test_hist",
+                "A test histogram",
+                "phase=\"test\"");
+        if(histogram.quantile(0.5) != 0)
+            FAIL_LOG("Fastcgipp::Metrics::Histogram empty quantile")
+
+        for(unsigned i=1; i<=1000; ++i)
+            histogram.record(i);
+        histogram.record(3000000);
+
+        if(histogram.count() != 1001 || histogram.sum() != 3500500)
+            FAIL_LOG("Fastcgipp::Metrics::Histogram count/sum are " \
+                    << histogram.count() << '/' << histogram.sum())
+        const unsigned long long median = histogram.quantile(0.5);
+        if(median < 500 || median > 500+500/8)
+            FAIL_LOG("Fastcgipp::Metrics::Histogram p50 is " << median)
+        const unsigned long long p99 = histogram.quantile(0.99);
+        if(p99 < 990 || p99 > 990+990/8)
+            FAIL_LOG("Fastcgipp::Metrics::Histogram p99 is " << p99)
+        if(histogram.quantile(1) < 3000000)
+            FAIL_LOG("Fastcgipp::Metrics::Histogram p100 is " \
+                    << histogram.quantile(1))
+
+        histogram.since(Fastcgipp::Metrics::timestamp());
+        if(histogram.count() != 1001)
+            FAIL_LOG("Fastcgipp::Metrics::Histogram recorded without timing")
+
+        std::ostringstream text;
+        Fastcgipp::Metrics::write(text);
+        for(const char* line: {
+                "# TYPE test_hist histogram\n",
+                "test_hist_bucket{phase=\"test\",le=\"0.000016\"} 15\n",
+                "test_hist_bucket{phase=\"test\",le=\"0.001024\"} 1000\n",
+                "test_hist_bucket{phase=\"test\",le=\"2.097152\"} 1000\n",
+                "test_hist_bucket{phase=\"test\",le=\"4.194304\"} 1001\n",
+                "test_hist_bucket{phase=\"test\",le=\"+Inf\"} 1001\n",
+                "test_hist_sum{phase=\"test\"} 3.5005\n",
+                "test_hist_count{phase=\"test\"} 1001\n"})
+            if(text.str().find(line) == std::string::npos)
+                FAIL_LOG("Fastcgipp::Metrics::write() is missing " << line)
+
+        Fastcgipp::Metrics::timing = true;
+        histogram.since(Fastcgipp::Metrics::timestamp());
+        Fastcgipp::Metrics::timing = false;
+        if(histogram.count() != 1002)
+            FAIL_LOG("Fastcgipp::Metrics::Histogram didn't record with timing")
+    }
+
+    // Testing Fastcgipp::Metrics::recordsReceived()
+    {
+        Fastcgipp::Metrics::Counter& begin
+            = Fastcgipp::Metrics::recordsReceived(1);
+        if(std::string(begin.labels) != "type=\"BEGIN_REQUEST\"")
+            FAIL_LOG("Fastcgipp::Metrics::recordsReceived(1) is " \
+                    << begin.labels)
+        if(&Fastcgipp::Metrics::recordsReceived(200)
+                != &Fastcgipp::Metrics::recordsReceived(0))
+            FAIL_LOG("Fastcgipp::Metrics::recordsReceived(200) isn't OTHER")
+    }
+
+    return 0;
+}
@@ -0,0 +1,100 @@
+#include "fastcgi++/log.hpp"
+#include "fastcgi++/poll.hpp"
+
+#include <cstring>
+#include <string>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Exercise whichever polling mechanism is in use the same way SocketGroup does
+
+void test()
+{
+    Fastcgipp::Poll poll;
+    INFO_LOG("Testing poll backend " << poll.backend())
+
+    int pair[2];
+    if(socketpair(AF_UNIX, SOCK_STREAM, 0, pair) != 0)
+        FAIL_LOG("Unable to create socket pair: " << std::strerror(errno))
+
+    if(!poll.add(pair[0]))
+        FAIL_LOG("Unable to add socket to poll")
+    if(poll.add(pair[0]))
+        FAIL_LOG("Added the same socket to poll twice")
+    if(poll.poll(0))
+        FAIL_LOG("Got an event from an idle socket")
+
+    // Readability should be reported until the data is read
+    if(write(pair[1], "x", 1) != 1)
+        FAIL_LOG("Unable to write to socket pair")
+    for(int i=0; i<3; ++i)
+    {
+        const auto result = poll.poll(1000);
+        if(!result || result.socket() != pair[0] || !result.onlyIn())
+            FAIL_LOG("Didn't get the read event " << i)
+    }
+    char x;
+    if(read(pair[0], &x, 1) != 1)
+        FAIL_LOG("Unable to read from socket pair")
+    if(poll.poll(0))
+        FAIL_LOG("Got an event after reading out the data")
+
+    // Writability only when asked for
+    if(!poll.mod(pair[0], true))
+        FAIL_LOG("Unable to poll for writability")
+    {
+        const auto result = poll.poll(1000);
+        if(!result || !result.out() || result.in())
+            FAIL_LOG("Didn't get the write event")
+    }
+    if(!poll.mod(pair[0], false))
+        FAIL_LOG("Unable to stop polling for writability")
+    if(poll.poll(0))
+        FAIL_LOG("Got an event after no longer polling for writability")
+
+    // Paused reading
+    if(write(pair[1], "x", 1) != 1)
+        FAIL_LOG("Unable to write to socket pair")
+    if(!poll.mod(pair[0], false, false))
+        FAIL_LOG("Unable to stop polling for readability")
+    if(poll.poll(50))
+        FAIL_LOG("Got a read event while not polling for it")
+    if(!poll.mod(pair[0], false, true))
+        FAIL_LOG("Unable to resume polling for readability")
+    {
+        const auto result = poll.poll(1000);
+        if(!result || !result.onlyIn())
+            FAIL_LOG("Didn't get the read event after resuming")
+    }
+
+    // Hang ups
+    close(pair[1]);
+    {
+        const auto result = poll.poll(1000);
+        if(!result || !result.rdHup())
+            FAIL_LOG("Didn't get the hang up event")
+    }
+
+    if(!poll.del(pair[0]))
+        FAIL_LOG("Unable to remove socket from poll")
+    if(poll.del(pair[0]))
+        FAIL_LOG("Removed the same socket from poll twice")
+    if(poll.poll(50))
+        FAIL_LOG("Got an event from a removed socket")
+    if(poll.mod(pair[0], true))
+        FAIL_LOG("Modified a removed socket")
+    close(pair[0]);
+
+    // A timeout should return empty handed
+    if(poll.poll(10))
+        FAIL_LOG("Got an event from an empty poll")
+}
+
+int main()
+{
+    test();
+    Fastcgipp::Poll::ioUring = true;
+    test();
+    return 0;
+}
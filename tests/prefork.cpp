@@ -0,0 +1,70 @@
+#include "fastcgi++/log.hpp"
+#include "fastcgi++/metrics.hpp"
+#include "fastcgi++/prefork.hpp"
+
+#include <random>
+#include <sstream>
+#include <string>
+#include <cstdio>
+
+#include <unistd.h>
+
+namespace
+{
+    Fastcgipp::Metrics::Counter children(
+            "test_prefork_children",
+            "Test counter summed across children");
+}
+
+int main()
+{
+    std::string port;
+    {
+        std::random_device trueRand;
+        std::uniform_int_distribution<> portDist(2048, 65534);
+        port = std::to_string(portDist(trueRand));
+    }
+
+    const std::string marker = "/tmp/fastcgipp-prefork-test-"
+        + std::to_string(getpid()) + "-";
+
+    Fastcgipp::Prefork prefork(2, std::chrono::milliseconds(50));
+    if(!prefork.listen("127.0.0.1", port.c_str()))
+        FAIL_LOG("Unable to listen")
+    if(prefork.index() != 2)
+        FAIL_LOG("Supervisor thinks it's a child")
+
+    // Every child fails the first time around and succeeds once restarted
+    const int result = prefork.run([&] ()
+    {
+        const std::string name = marker+std::to_string(prefork.index());
+        std::FILE* const file = std::fopen(name.c_str(), "r");
+        if(file == nullptr)
+        {
+            std::fclose(std::fopen(name.c_str(), "w"));
+            return 3;
+        }
+        std::fclose(file);
+
+        if(prefork.listeners().size() != 1)
+            return 4;
+        children += 5;
+        return 0;
+    });
+
+    for(unsigned i=0; i<2; ++i)
+        if(std::remove((marker+std::to_string(i)).c_str()) != 0)
+            FAIL_LOG("Child " << i << " never ran")
+    if(result != 0)
+        FAIL_LOG("Restarted children didn't exit cleanly")
+
+    std::ostringstream metrics;
+    prefork.write(metrics);
+    if(metrics.str().find("\ntest_prefork_children 10\n") == std::string::npos)
+        FAIL_LOG("Metrics weren't summed across children")
+    if(metrics.str().find("# TYPE test_prefork_children counter\n")
+            == std::string::npos)
+        FAIL_LOG("Metric types weren't carried over")
+
+    return 0;
+}
@@ -4,6 +4,8 @@
 #include <random>
 #include <memory>
 #include <cstdint>
+#include <vector>
+#include <cstdio>
 
 int main()
 {
@@ -238,5 +240,84 @@ int main()
                     "values and long names")
     }
 
+    // Testing Fastcgipp::Protocol::RequestTable against std::map
+    {
+        const char socketName[] = "protocolTestSocket";
+        std::remove(socketName);
+        Fastcgipp::SocketGroup group;
+        if(!group.listen(socketName))
+            FAIL_LOG("Unable to listen for Fastcgipp::Protocol::RequestTable")
+
+        std::vector<Fastcgipp::Socket> sockets;
+        for(unsigned i=0; i<64; ++i)
+        {
+            sockets.push_back(group.connect(socketName));
+            if(!sockets.back().valid())
+                FAIL_LOG("Unable to connect for "\
+                        "Fastcgipp::Protocol::RequestTable")
+        }
+
+        std::random_device rd;
+        std::uniform_int_distribution<unsigned> socketDist(
+                0,
+                sockets.size()-1);
+        std::uniform_int_distribution<unsigned> idDist(1, 12);
+        std::uniform_int_distribution<unsigned> actionDist(0, 99);
+
+        Fastcgipp::Protocol::RequestTable<unsigned> table;
+        Fastcgipp::Protocol::Requests<unsigned> map;
+
+        for(unsigned i=0; i<200000; ++i)
+        {
+            const Fastcgipp::Protocol::RequestId id(
+                    idDist(rd),
+                    sockets[socketDist(rd)]);
+            const unsigned action = actionDist(rd);
+
+            if(action < 45)
+            {
+                table[id] = i;
+                map[id] = i;
+            }
+            else if(action < 90)
+            {
+                if(table.erase(id) != bool(map.erase(id)))
+                    FAIL_LOG("Fastcgipp::Protocol::RequestTable::erase() on "\
+                            "a single request")
+            }
+            else if(action < 92)
+            {
+                const auto range = map.equal_range(id.m_socket);
+                const size_t count = std::distance(range.first, range.second);
+                map.erase(range.first, range.second);
+                if(table.erase(id.m_socket) != count)
+                    FAIL_LOG("Fastcgipp::Protocol::RequestTable::erase() on "\
+                            "a connection")
+            }
+            else
+            {
+                const auto found = table.find(id);
+                const auto expected = map.find(id);
+                if((found == nullptr) != (expected == map.end())
+                        || (found != nullptr && *found != expected->second))
+                    FAIL_LOG("Fastcgipp::Protocol::RequestTable::find()")
+            }
+
+            if(table.size() != map.size())
+                FAIL_LOG("Fastcgipp::Protocol::RequestTable::size()")
+            if(table.count(id.m_socket) != map.count(id.m_socket))
+                FAIL_LOG("Fastcgipp::Protocol::RequestTable::count()")
+        }
+
+        for(const auto& request: map)
+        {
+            const auto found = table.find(request.first);
+            if(found == nullptr || *found != request.second)
+                FAIL_LOG("Fastcgipp::Protocol::RequestTable contents")
+        }
+
+        std::remove(socketName);
+    }
+
     return 0;
 }
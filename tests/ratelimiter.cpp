@@ -0,0 +1,226 @@
+#include "fastcgi++/log.hpp"
+#include "fastcgi++/request.hpp"
+#include "fastcgi++/ratelimiter.hpp"
+
+#include <string>
+#include <thread>
+#include <vector>
+#include <atomic>
+
+namespace
+{
+    Fastcgipp::RateLimiter limiter(1, 2);
+
+    //! Answers anyone that isn't making too many requests
+    class Limited: public Fastcgipp::Request<char>
+    {
+    public:
+        static unsigned responded;
+
+        Limited():
+            Fastcgipp::Request<char>(1024)
+        {}
+
+    private:
+        Fastcgipp::RateLimiter* rateLimiter()
+        {
+            return &limiter;
+        }
+
+        bool inProcessor()
+        {
+            return true;
+        }
+
+        bool response()
+        {
+            ++responded;
+            out << "Content-Type: text/plain\r\n\r\nhello";
+            return true;
+        }
+    };
+
+    unsigned Limited::responded = 0;
+
+    //! Same as Limited but only parses parameters as they are needed
+    class LazyLimited: public Limited
+    {
+    public:
+        LazyLimited()
+        {
+            environment().parseLazily();
+        }
+    };
+
+    //! Make a message out of a record
+    Fastcgipp::Message record(
+            Fastcgipp::Protocol::RecordType type,
+            const std::string& content)
+    {
+        Fastcgipp::Message message;
+        Fastcgipp::Block& data = message.data;
+        data.size(sizeof(Fastcgipp::Protocol::Header)+content.size());
+        Fastcgipp::Protocol::Header& header
+            = *reinterpret_cast<Fastcgipp::Protocol::Header*>(data.begin());
+        header.version = Fastcgipp::Protocol::version;
+        header.type = type;
+        header.fcgiId = 1;
+        header.contentLength = content.size();
+        header.paddingLength = 0;
+        header.reserved = 0;
+        std::copy(
+                content.cbegin(),
+                content.cend(),
+                data.begin()+sizeof(header));
+        return message;
+    }
+
+    //! Encode a name-value pair
+    std::string pair(const std::string& name, const std::string& value)
+    {
+        return char(name.size()) + (char(value.size()) + name) + value;
+    }
+
+    //! Post from an address and return the output
+    template<class Request = Limited>
+    std::string post(const std::string& address)
+    {
+        using Fastcgipp::Protocol::RecordType;
+
+        std::string output;
+        Request request;
+        request.configure(
+                Fastcgipp::Protocol::RequestId(1, Fastcgipp::Socket()),
+                Fastcgipp::Protocol::Role::RESPONDER,
+                false,
+                [&output] (
+                    const Fastcgipp::Socket&,
+                    Fastcgipp::Block&& block,
+                    bool)
+                {
+                    const char* position = block.begin();
+                    while(position < block.end())
+                    {
+                        const Fastcgipp::Protocol::Header& header
+                            = *reinterpret_cast<
+                                const Fastcgipp::Protocol::Header*>(position);
+                        if(header.type == RecordType::OUT)
+                            output.append(
+                                    position+sizeof(header),
+                                    header.contentLength);
+                        position += sizeof(header)+header.contentLength
+                            +header.paddingLength;
+                    }
+                },
+                nullptr,
+                nullptr);
+
+        if(request.handle(record(
+                        RecordType::PARAMS,
+                        pair("REQUEST_METHOD", "POST")
+                            + pair("REMOTE_ADDR", address)
+                            + pair("CONTENT_TYPE", "text/plain")
+                            + pair("CONTENT_LENGTH", "4"))))
+            FAIL_LOG("Request completed in the middle of it's parameters")
+
+        // A rejected request completes before any post data is accepted
+        if(request.handle(record(RecordType::PARAMS, "")))
+            return output;
+        if(request.handle(record(RecordType::IN, "data"))
+                || !request.handle(record(RecordType::IN, "")))
+            FAIL_LOG("Admitted request didn't complete at the end of input")
+        return output;
+    }
+}
+
+int main()
+{
+    typedef Fastcgipp::RateLimiter::Clock Clock;
+
+    // Bursts are admitted and the rate is kept to after that
+    {
+        Fastcgipp::RateLimiter limited(10, 3, 16);
+        const Clock::time_point start = Clock::now();
+
+        for(unsigned i=0; i<3; ++i)
+            if(!limited.admit(7, start))
+                FAIL_LOG("Request " << i << " of a burst wasn't admitted")
+        Clock::duration wait;
+        if(limited.admit(7, start, &wait))
+            FAIL_LOG("Request past the burst was admitted")
+        if(wait != std::chrono::milliseconds(100))
+            FAIL_LOG("Wrong wait until the next request is admitted")
+
+        if(limited.admit(7, start+std::chrono::milliseconds(99)))
+            FAIL_LOG("Request was admitted before it's time")
+        if(!limited.admit(7, start+std::chrono::milliseconds(100)))
+            FAIL_LOG("Request wasn't admitted after waiting")
+        if(limited.admit(7, start+std::chrono::milliseconds(100)))
+            FAIL_LOG("Waiting admitted more than one request")
+
+        if(!limited.admit(8, start))
+            FAIL_LOG("Another client was limited along with the first")
+
+        for(unsigned i=0; i<3; ++i)
+            if(!limited.admit(7, start+std::chrono::seconds(10)))
+                FAIL_LOG("Burst wasn't refilled after a long wait")
+
+        limited.clear();
+        if(!limited.admit(7, start+std::chrono::seconds(10)))
+            FAIL_LOG("Clearing didn't forget about the client")
+    }
+
+    // Concurrent requests from one client never get past the burst
+    {
+        Fastcgipp::RateLimiter limited(1, 100);
+        const Clock::time_point start = Clock::now();
+        std::atomic_uint admitted(0);
+        std::vector<std::thread> threads;
+        for(unsigned i=0; i<4; ++i)
+            threads.emplace_back([&] ()
+                {
+                    for(unsigned j=0; j<1000; ++j)
+                        if(limited.admit(1, start))
+                            ++admitted;
+                });
+        for(auto& thread: threads)
+            thread.join();
+        if(admitted != 100)
+            FAIL_LOG("Concurrent clients got " << admitted << " requests in")
+    }
+
+    // Requests over the limit are rejected before their post data
+    {
+        const std::string hello("Content-Type: text/plain\r\n\r\nhello");
+        if(post("10.0.0.1") != hello || post("10.0.0.1") != hello)
+            FAIL_LOG("Requests within the burst weren't answered")
+
+        const std::string status(
+                "Status: 429 Too Many Requests\nRetry-After: 1\n");
+        const std::string rejected = post("10.0.0.1");
+        if(rejected.compare(0, status.size(), status) != 0)
+            FAIL_LOG("Request over the limit wasn't rejected. Got " \
+                    << rejected.c_str())
+        if(Limited::responded != 2)
+            FAIL_LOG("Rejected request was responded to")
+
+        if(post("10.0.0.2") != hello)
+            FAIL_LOG("Request from another address was rejected")
+    }
+
+    // Clients are told apart even when parameters are parsed lazily
+    {
+        const std::string hello("Content-Type: text/plain\r\n\r\nhello");
+        if(post<LazyLimited>("10.0.1.1") != hello
+                || post<LazyLimited>("10.0.1.1") != hello)
+            FAIL_LOG("Lazy requests within the burst weren't answered")
+        if(post<LazyLimited>("10.0.1.1") == hello)
+            FAIL_LOG("Lazy request over the limit wasn't rejected")
+        if(post<LazyLimited>("10.0.1.2") != hello)
+            FAIL_LOG("Lazy request from another address was rejected")
+        if(Limited::responded != 6)
+            FAIL_LOG("Rejected lazy request was responded to")
+    }
+
+    return 0;
+}
@@ -0,0 +1,289 @@
+#include "fastcgi++/log.hpp"
+#include "fastcgi++/request.hpp"
+#include "fastcgi++/responsecache.hpp"
+
+#include <string>
+#include <vector>
+#include <utility>
+
+namespace
+{
+    Fastcgipp::ResponseCache pages;
+
+    //! Caches every page it generates
+    class Page: public Fastcgipp::Request<char>
+    {
+    public:
+        static unsigned generated;
+
+    private:
+        bool response()
+        {
+            if(cached(pages))
+                return true;
+            ++generated;
+            cache(pages, std::chrono::seconds(60), 17, 1000);
+            out << "ETag: \"17\"\r\n";
+            out << "Cache-Control: max-age=60\r\n";
+            out << "Content-Type: text/plain\r\n\r\n";
+            out << "Generated " << environment().requestUri;
+            return true;
+        }
+    };
+
+    unsigned Page::generated = 0;
+
+    //! What a request sent and with what IDs
+    struct Sent
+    {
+        std::string output;
+        std::vector<Fastcgipp::Protocol::FcgiId> ids;
+        Fastcgipp::Block block;
+        unsigned sends;
+    };
+
+    //! Append a record to a message
+    void record(
+            Fastcgipp::Message& message,
+            Fastcgipp::Protocol::RecordType type,
+            Fastcgipp::Protocol::FcgiId id,
+            const std::string& content)
+    {
+        Fastcgipp::Block& data = message.data;
+        data.reserve(sizeof(Fastcgipp::Protocol::Header)+content.size());
+        data.size(sizeof(Fastcgipp::Protocol::Header)+content.size());
+        Fastcgipp::Protocol::Header& header
+            = *reinterpret_cast<Fastcgipp::Protocol::Header*>(data.begin());
+        header.version = Fastcgipp::Protocol::version;
+        header.type = type;
+        header.fcgiId = id;
+        header.contentLength = content.size();
+        header.paddingLength = 0;
+        header.reserved = 0;
+        std::copy(
+                content.cbegin(),
+                content.cend(),
+                data.begin()+sizeof(header));
+    }
+
+    //! Run a request to completion
+    Sent run(
+            Fastcgipp::Protocol::FcgiId id,
+            const std::vector<std::pair<std::string, std::string>>& params)
+    {
+        Sent sent;
+        sent.sends = 0;
+        Page page;
+        page.configure(
+                Fastcgipp::Protocol::RequestId(id, Fastcgipp::Socket()),
+                Fastcgipp::Protocol::Role::RESPONDER,
+                false,
+                [&sent] (
+                    const Fastcgipp::Socket&,
+                    Fastcgipp::Block&& block,
+                    bool)
+                {
+                    ++sent.sends;
+                    const char* position = block.begin();
+                    while(position < block.end())
+                    {
+                        const Fastcgipp::Protocol::Header& header
+                            = *reinterpret_cast<
+                                const Fastcgipp::Protocol::Header*>(position);
+                        sent.ids.push_back(header.fcgiId);
+                        if(header.type == Fastcgipp::Protocol::RecordType::OUT)
+                            sent.output.append(
+                                    position+sizeof(header),
+                                    header.contentLength);
+                        position += sizeof(header)+header.contentLength
+                            +header.paddingLength;
+                    }
+                    sent.block = std::move(block);
+                },
+                nullptr,
+                nullptr);
+
+        std::string encoded;
+        for(const auto& param: params)
+        {
+            encoded += char(param.first.size());
+            encoded += char(param.second.size());
+            encoded += param.first;
+            encoded += param.second;
+        }
+
+        const auto send = [&page, id] (
+                Fastcgipp::Protocol::RecordType type,
+                const std::string& content)
+        {
+            Fastcgipp::Message message;
+            record(message, type, id, content);
+            return page.handle(std::move(message));
+        };
+
+        if(send(Fastcgipp::Protocol::RecordType::PARAMS, encoded)
+                || send(Fastcgipp::Protocol::RecordType::PARAMS, std::string())
+                || !send(Fastcgipp::Protocol::RecordType::IN, std::string()))
+            FAIL_LOG("Request didn't complete when it should have")
+        return sent;
+    }
+
+    //! A cache entry of a certain size
+    std::shared_ptr<const Fastcgipp::ResponseCache::Entry> entry(
+            size_t size,
+            Fastcgipp::ResponseCache::Clock::duration ttl)
+    {
+        auto entry = std::make_shared<Fastcgipp::ResponseCache::Entry>();
+        entry->records = Fastcgipp::BlockPool::share(size);
+        entry->size = size;
+        entry->fcgiId = 1;
+        entry->etag = 0;
+        entry->lastModified = 0;
+        entry->expires = Fastcgipp::ResponseCache::Clock::now()+ttl;
+        return entry;
+    }
+}
+
+int main()
+{
+    using Fastcgipp::Protocol::FcgiId;
+    const std::string expected(
+            "ETag: \"17\"\r\n"
+            "Cache-Control: max-age=60\r\n"
+            "Content-Type: text/plain\r\n\r\n"
+            "Generated /page");
+    const std::string notModified(
+            "Status: 304 Not Modified\r\n"
+            "ETag: \"17\"\r\n"
+            "Cache-Control: max-age=60\r\n\r\n");
+
+    // Responses are generated once and served from the cache afterwards
+    {
+        const Sent first = run(1, {
+                {"REQUEST_METHOD", "GET"},
+                {"REQUEST_URI", "/page"}});
+        if(Page::generated != 1 || first.output != expected)
+            FAIL_LOG("First response wasn't generated properly")
+        if(first.sends != 1 || pages.size() != 1)
+            FAIL_LOG("First response wasn't cached in a single piece")
+
+        const Sent second = run(1, {
+                {"REQUEST_METHOD", "GET"},
+                {"REQUEST_URI", "/page"}});
+        if(Page::generated != 1)
+            FAIL_LOG("Cached response was generated again")
+        if(second.sends != 1
+                || second.block.size() != first.block.size()
+                || !std::equal(
+                    first.block.begin(),
+                    first.block.end(),
+                    second.block.begin()))
+            FAIL_LOG("Cached response doesn't match the original")
+
+        const Sent other = run(7, {
+                {"REQUEST_METHOD", "HEAD"},
+                {"REQUEST_URI", "/page"}});
+        if(Page::generated != 1 || other.output != expected)
+            FAIL_LOG("Cached response wasn't served for another request ID")
+        for(const FcgiId id: other.ids)
+            if(id != 7)
+                FAIL_LOG("Cached response wasn't patched with the request ID")
+        if(first.ids.front() != 1)
+            FAIL_LOG("Patching the request ID changed the cache")
+    }
+
+    // Conditional requests get 304 Not Modified
+    {
+        const Sent etag = run(1, {
+                {"REQUEST_METHOD", "GET"},
+                {"REQUEST_URI", "/page"},
+                {"HTTP_IF_NONE_MATCH", "\"17\""}});
+        if(etag.output != notModified)
+            FAIL_LOG("Matching ETag didn't get a 304 with the validators")
+
+        const Sent weak = run(1, {
+                {"REQUEST_METHOD", "GET"},
+                {"REQUEST_URI", "/page"},
+                {"HTTP_IF_NONE_MATCH", "W/\"17\", \"18\""}});
+        if(weak.output != notModified)
+            FAIL_LOG("Matching weak ETag didn't get a 304")
+
+        const Sent stale = run(1, {
+                {"REQUEST_METHOD", "GET"},
+                {"REQUEST_URI", "/page"},
+                {"HTTP_IF_NONE_MATCH", "\"18\""},
+                {"HTTP_IF_MODIFIED_SINCE", "Thu, 01 Jan 1970 00:20:00 GMT"}});
+        if(stale.output != expected)
+            FAIL_LOG("Mismatched ETag didn't get the full response")
+
+        const Sent modified = run(1, {
+                {"REQUEST_METHOD", "GET"},
+                {"REQUEST_URI", "/page"},
+                {"HTTP_IF_MODIFIED_SINCE", "Thu, 01 Jan 1970 00:20:00 GMT"}});
+        if(modified.output != notModified)
+            FAIL_LOG("Unmodified response didn't get a 304")
+        if(Page::generated != 1)
+            FAIL_LOG("Conditional requests generated a response")
+    }
+
+    // Only GET and HEAD are cached and invalidation works
+    {
+        run(1, {
+                {"REQUEST_METHOD", "POST"},
+                {"REQUEST_URI", "/page"}});
+        if(Page::generated != 2 || pages.size() != 1)
+            FAIL_LOG("POST request was served from or stored in the cache")
+
+        pages.erase("/page");
+        if(pages.size() != 0 || pages.bytes() != 0)
+            FAIL_LOG("Erasing a response didn't empty the cache")
+        run(1, {
+                {"REQUEST_METHOD", "GET"},
+                {"REQUEST_URI", "/page"}});
+        if(Page::generated != 3 || pages.size() != 1)
+            FAIL_LOG("Erased response wasn't generated again")
+        pages.clear();
+    }
+
+    // Least recently used entries are evicted and expired ones removed
+    {
+        const auto minute = std::chrono::minutes(1);
+        Fastcgipp::ResponseCache cache(320);
+        cache.insert("/a", "", entry(100, minute));
+        cache.insert("/b", "", entry(100, minute));
+        if(!cache.find("/a"))
+            FAIL_LOG("Cached entry wasn't found")
+        cache.insert("/c", "", entry(100, minute));
+        if(cache.size() != 3 || cache.bytes() != 309)
+            FAIL_LOG("Cache size is wrong")
+        cache.insert("/d", "", entry(100, minute));
+        if(cache.find("/b") || !cache.find("/a") || !cache.find("/c")
+                || !cache.find("/d"))
+            FAIL_LOG("Least recently used entry wasn't the one evicted")
+
+        cache.insert("/e", "", entry(1000, minute));
+        if(cache.find("/e") || cache.size() != 3)
+            FAIL_LOG("Entry larger than the cache was inserted")
+
+        cache.insert("/a", "", entry(10, -minute));
+        if(cache.find("/a") || cache.size() != 2)
+            FAIL_LOG("Expired entry was found")
+    }
+
+    // Invalidating a URI takes out all of it's variants and nothing else
+    {
+        const auto minute = std::chrono::minutes(1);
+        Fastcgipp::ResponseCache cache;
+        cache.insert("/v", "", entry(10, minute));
+        cache.insert("/v", "gzip", entry(10, minute));
+        cache.insert("/v", "br", entry(10, minute));
+        cache.insert("/vv", "", entry(10, minute));
+        if(!cache.find("/v", "gzip") || cache.find("/v", "zstd"))
+            FAIL_LOG("Variants aren't told apart")
+        cache.erase("/v");
+        if(cache.size() != 1 || !cache.find("/vv"))
+            FAIL_LOG("Erasing didn't take out exactly all variants")
+    }
+
+    return 0;
+}
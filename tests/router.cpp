@@ -0,0 +1,354 @@
+#include "fastcgi++/log.hpp"
+#include "fastcgi++/router.hpp"
+
+#include <cstring>
+#include <iostream>
+#include <locale>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace
+{
+    //! Answers with the user it was routed to
+    class User: public Fastcgipp::Request<char>
+    {
+    public:
+        User(const Fastcgipp::Route& route):
+            m_id(route.value("id"))
+        {}
+
+    private:
+        const std::string m_id;
+
+        bool response()
+        {
+            out << "Content-Type: text/plain\r\n\r\nuser " << m_id;
+            return true;
+        }
+    };
+
+    //! Answers with the file path it was routed to
+    class File: public Fastcgipp::Request<char>
+    {
+    public:
+        File(const Fastcgipp::Route& route):
+            m_path(route.value("path"))
+        {}
+
+    private:
+        const std::string m_path;
+
+        bool response()
+        {
+            out << "Content-Type: text/plain\r\n\r\nfile " << m_path;
+            return true;
+        }
+    };
+
+    //! Answers with the request URI and takes post data
+    class About: public Fastcgipp::Request<char>
+    {
+    public:
+        About():
+            Fastcgipp::Request<char>(1024)
+        {}
+
+    private:
+        bool inProcessor()
+        {
+            return true;
+        }
+
+        bool response()
+        {
+            out << "Content-Type: text/plain\r\n\r\nabout "
+                << environment().requestUri;
+            return true;
+        }
+    };
+
+    //! Answers with the name and ctype facet of the locale it was routed to
+    class Localized: public Fastcgipp::Request<char>
+    {
+    public:
+        Localized(const Fastcgipp::Route& route):
+            m_name(route.value("name"))
+        {}
+
+    private:
+        const std::string m_name;
+
+        bool response()
+        {
+            setLocale(m_name);
+            out << "Content-Type: text/plain\r\n\r\n"
+                << out.getloc().name() << ' '
+                << &std::use_facet<std::ctype<char>>(out.getloc());
+            return true;
+        }
+    };
+
+    //! Append a FastCGI record to a buffer
+    void record(
+            std::vector<char>& buffer,
+            Fastcgipp::Protocol::RecordType type,
+            const std::string& content)
+    {
+        Fastcgipp::Protocol::Header header;
+        header.version = Fastcgipp::Protocol::version;
+        header.type = type;
+        header.fcgiId = 1;
+        header.contentLength = content.size();
+        header.paddingLength = 0;
+        header.reserved = 0;
+        const char* const raw = reinterpret_cast<const char*>(&header);
+        buffer.insert(buffer.end(), raw, raw+sizeof(header));
+        buffer.insert(buffer.end(), content.begin(), content.end());
+    }
+
+    //! Send a request over a fresh connection and return it's output
+    std::string request(
+            const std::string& path,
+            const std::string& method,
+            const std::string& uri,
+            const std::string& post=std::string())
+    {
+        const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        sockaddr_un address;
+        std::memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        std::strncpy(
+                address.sun_path,
+                path.c_str(),
+                sizeof(address.sun_path)-1);
+        if(::connect(
+                    fd,
+                    reinterpret_cast<sockaddr*>(&address),
+                    sizeof(address)) != 0)
+            FAIL_LOG("Unable to connect to " << path.c_str())
+
+        std::vector<char> buffer;
+        Fastcgipp::Protocol::BeginRequest begin;
+        std::memset(&begin, 0, sizeof(begin));
+        begin.role = Fastcgipp::Protocol::Role::RESPONDER;
+        record(
+                buffer,
+                Fastcgipp::Protocol::RecordType::BEGIN_REQUEST,
+                std::string(
+                    reinterpret_cast<const char*>(&begin),
+                    sizeof(begin)));
+
+        const std::pair<std::string, std::string> parameters[] = {
+            {"REQUEST_METHOD", method},
+            {"REQUEST_URI", uri},
+            {"CONTENT_LENGTH", std::to_string(post.size())},
+            {"CONTENT_TYPE", "text/plain"}};
+        for(const auto& parameter: parameters)
+        {
+            std::string params;
+            params += char(parameter.first.size());
+            params += char(parameter.second.size());
+            params += parameter.first;
+            params += parameter.second;
+            record(buffer, Fastcgipp::Protocol::RecordType::PARAMS, params);
+        }
+        record(buffer, Fastcgipp::Protocol::RecordType::PARAMS, "");
+        if(!post.empty())
+            record(buffer, Fastcgipp::Protocol::RecordType::IN, post);
+        record(buffer, Fastcgipp::Protocol::RecordType::IN, "");
+        if(::send(fd, buffer.data(), buffer.size(), MSG_NOSIGNAL)
+                != ssize_t(buffer.size()))
+            FAIL_LOG("Unable to send request")
+
+        std::string received;
+        char chunk[4096];
+        ssize_t size;
+        while((size = ::read(fd, chunk, sizeof(chunk))) > 0)
+            received.append(chunk, size);
+        ::close(fd);
+
+        std::string output;
+        size_t position = 0;
+        while(received.size()-position >= sizeof(Fastcgipp::Protocol::Header))
+        {
+            const Fastcgipp::Protocol::Header& header
+                = *reinterpret_cast<const Fastcgipp::Protocol::Header*>(
+                        received.data()+position);
+            position += sizeof(header);
+            if(header.type == Fastcgipp::Protocol::RecordType::OUT)
+                output.append(received, position, header.contentLength);
+            position += header.contentLength+header.paddingLength;
+        }
+        return output;
+    }
+
+    //! Match a path and return the captures as name=value pairs
+    std::string match(
+            const Fastcgipp::Router& router,
+            Fastcgipp::Http::RequestMethod method,
+            const std::string& path)
+    {
+        Fastcgipp::Route route;
+        if(!router.match(method, path.data(), path.data()+path.size(), route))
+            return "none";
+        std::string captures;
+        for(size_t i=0; i<route.size(); ++i)
+            captures += route.name(i) + '=' + route.value(i) + ';';
+        return captures;
+    }
+}
+
+int main()
+{
+    using Fastcgipp::Http::RequestMethod;
+
+    Fastcgipp::Router router(2);
+
+    // Routes go into the tree and bad ones are refused
+    {
+        if(!router.route<User>(RequestMethod::GET, "/users/:id")
+                || !router.route<About>(RequestMethod::GET, "/users/me")
+                || !router.route<File>("/users/:id/files/*path")
+                || !router.route<About>("/a/:x/c")
+                || !router.route<About>("/a/b/d")
+                || !router.route<About>("/about")
+                || !router.route<About>(RequestMethod::POST, "/about/us")
+                || !router.route<File>(RequestMethod::GET, "/static/*path")
+                || !router.route<Localized>(
+                    RequestMethod::GET,
+                    "/locales/:name"))
+            FAIL_LOG("Unable to add a route")
+
+        if(router.route<User>(RequestMethod::GET, "/users/:id"))
+            FAIL_LOG("Duplicate route was added")
+        if(router.route<User>("/users/:name/x"))
+            FAIL_LOG("Route with a conflicting capture name was added")
+        if(router.route<User>("users") || router.route<User>("/x:y")
+                || router.route<User>("/x/:"))
+            FAIL_LOG("Malformed route was added")
+    }
+
+    // Paths match the right route with the right captures
+    {
+        const std::pair<std::string, std::string> paths[] = {
+            {"/users/17", "id=17;"},
+            {"/users/me", ""},
+            {"/users/a%20b", "id=a b;"},
+            {"/users/a+b", "id=a+b;"},
+            {"/users/17/files/x/y.txt", "id=17;path=x/y.txt;"},
+            {"/users/17/files/", "id=17;path=;"},
+            {"/users/17/", "none"},
+            {"/users", "none"},
+            {"/a/b/c", "x=b;"},
+            {"/a/b/d", ""},
+            {"/a/q/c", "x=q;"},
+            {"/about", ""},
+            {"/abou", "none"},
+            {"/aboutx", "none"},
+            {"/static/", "path=;"},
+            {"", "none"}};
+        for(const auto& path: paths)
+        {
+            const std::string captures = match(
+                    router,
+                    RequestMethod::GET,
+                    path.first);
+            if(captures != path.second)
+                FAIL_LOG("Path " << path.first.c_str() << " matched " \
+                        << captures.c_str() << " instead of " \
+                        << path.second.c_str())
+        }
+
+        if(match(router, RequestMethod::HEAD, "/users/17") != "id=17;")
+            FAIL_LOG("HEAD didn't fall back to the GET route")
+        if(match(router, RequestMethod::POST, "/users/17") != "none")
+            FAIL_LOG("POST matched a GET route")
+        if(match(router, RequestMethod::DELETE, "/about") != "")
+            FAIL_LOG("Route for any method didn't match")
+        if(match(router, RequestMethod::GET, "/about/us") != "none")
+            FAIL_LOG("GET matched a POST route")
+    }
+
+    // Requests are built as the type of the route they match
+    {
+        const std::string path = "/tmp/fastcgipp-router-test-"
+            + std::to_string(::getpid());
+        if(!router.listen(path.c_str()))
+            FAIL_LOG("Unable to listen on " << path.c_str())
+        router.start();
+
+        const std::string text = "Content-Type: text/plain\r\n\r\n";
+        if(request(path, "GET", "/users/17?x=y") != text+"user 17")
+            FAIL_LOG("Request wasn't routed with it's captures")
+        if(request(path, "GET", "/users/17/files/a%2Fb")
+                != text+"file a/b")
+            FAIL_LOG("Request wasn't routed to the rest of the path")
+        if(request(path, "POST", "/about", "posted") != text+"about /about")
+            FAIL_LOG("Request with post data wasn't routed")
+
+        const std::string missing = request(path, "GET", "/missing");
+        if(missing.compare(0, 23, "Status: 404 Not Found\r\n") != 0)
+            FAIL_LOG("Unknown path didn't get a 404")
+        const std::string method = request(path, "POST", "/users/17");
+        if(method.compare(0, 50,
+                    "Status: 405 Method Not Allowed\r\nAllow: HEAD, GET\r\n")
+                != 0)
+            FAIL_LOG("Wrong method didn't get a 405")
+
+        // Locales are built once and unknown ones fall back to classic
+        std::wostringstream log;
+        Fastcgipp::Logging::logstream = &log;
+        Fastcgipp::Request<char>::cacheLocales({"zz_ZZ"});
+        const std::wstring cached = log.str();
+        const std::string utf8[] = {
+            request(path, "GET", "/locales/C.utf8"),
+            request(path, "GET", "/locales/C.utf8")};
+        std::vector<std::string> unknown;
+        for(const std::string name: {"yy_YY", "yy_YY", "zz_ZZ", "zz_ZZ"})
+            unknown.push_back(request(path, "GET", "/locales/"+name));
+        {
+            std::lock_guard<std::mutex> lock(Fastcgipp::Logging::mutex);
+            Fastcgipp::Logging::logstream = &std::wcerr;
+        }
+
+        const auto failures = [] (
+                const std::wstring& text,
+                const std::wstring& name)
+        {
+            const std::wstring message = L"Unable to set locale " + name;
+            size_t count = 0;
+            for(size_t position = text.find(message);
+                    position != std::wstring::npos;
+                    position = text.find(message, position+1))
+                ++count;
+            return count;
+        };
+        if(failures(cached, L"zz_ZZ") != 1)
+            FAIL_LOG("cacheLocales() didn't build an unknown locale")
+        if(utf8[0].compare(0, text.size()+7, text+"C.utf8 ") != 0)
+            FAIL_LOG("setLocale() didn't set the locale")
+        if(utf8[1] != utf8[0])
+            FAIL_LOG("setLocale() didn't reuse the cached locale")
+        const std::string classic = text+std::locale::classic().name()+' ';
+        for(const std::string& output: unknown)
+            if(output.compare(0, classic.size(), classic) != 0)
+                FAIL_LOG("Unknown locale didn't fall back to classic")
+        if(failures(log.str(), L"yy_YY") != 1)
+            FAIL_LOG("Unknown locale wasn't logged exactly once")
+        if(failures(log.str(), L"zz_ZZ") != 1)
+            FAIL_LOG("Locale cached with cacheLocales() was built again")
+
+        router.stop();
+        router.join();
+        ::unlink(path.c_str());
+    }
+
+    return 0;
+}
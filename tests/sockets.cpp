@@ -11,6 +11,10 @@
 #include <string>
 #include <condition_variable>
 
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
 const unsigned int chunkSize=1024;
 const unsigned int tranCount=768;
 const unsigned int socketCount=512;
@@ -67,7 +71,7 @@ void client()
                             (buffer.send == buffer.data.cend() ||
                              buffer.send == buffer.data.cbegin())))
                         FAIL_LOG("Socket killed when it's not done echoing")
-                    if(buffer.send == buffer.data.cend())
+                    if(buffer.send != buffer.data.cend())
                         --sends;
                     buffers.erase(pair);
                     continue;
@@ -204,6 +208,7 @@ void client()
 
 std::condition_variable cv;
 std::mutex cvMutex;
+bool listening;
 
 void server()
 {
@@ -219,6 +224,7 @@ void server()
     serverGroup = &group;
     if(!group.listen("127.0.0.1", port.c_str()))
         FAIL_LOG("Unable to listen")
+    listening=true;
     cv.notify_all();
     cvLock.unlock();
     std::map<Fastcgipp::Socket, Buffer> buffers;
@@ -356,6 +362,66 @@ unsigned int openfds()
 }
 #endif
 
+//! Hand listeners off from one group to another like a hot restart would
+void handOff()
+{
+    const std::string handOffPort = std::to_string(std::stoi(port)+1);
+    const char handOffName[] = "/tmp/fastcgipp-sockets-test-handoff";
+
+    Fastcgipp::SocketGroup old;
+    if(!old.listen("127.0.0.1", handOffPort.c_str()))
+        FAIL_LOG("Unable to listen before handing off")
+    bool handedOff = false;
+    if(!old.handOff(handOffName, [&handedOff] () { handedOff = true; }))
+        FAIL_LOG("Unable to wait for a hand off")
+
+    struct stat status;
+    if(stat(handOffName, &status) != 0 || (status.st_mode & 0777) != 0600)
+        FAIL_LOG("Hand off socket is accessible to others")
+
+    // Other users are turned away even if they can get at the socket
+    if(geteuid() == 0)
+    {
+        chmod(handOffName, 0666);
+        const pid_t child = fork();
+        if(child == 0)
+        {
+            Fastcgipp::SocketGroup thief;
+            _exit(setuid(65534) == 0 && !thief.inherit(handOffName) ? 0 : 1);
+        }
+        int result;
+        while(waitpid(child, &result, WNOHANG) == 0)
+            old.poll(false);
+        if(!WIFEXITED(result) || WEXITSTATUS(result) != 0 || handedOff)
+            FAIL_LOG("Listeners were handed off to another user")
+    }
+
+    Fastcgipp::SocketGroup replacement;
+    bool inherited = false;
+    std::thread inheritor([&] ()
+    {
+        inherited = replacement.inherit(handOffName);
+    });
+    while(!handedOff)
+        old.poll(true);
+    inheritor.join();
+    if(!inherited)
+        FAIL_LOG("Listeners weren't inherited")
+
+    Fastcgipp::SocketGroup clients;
+    const Fastcgipp::Socket client = clients.connect(
+            "127.0.0.1",
+            handOffPort.c_str());
+    if(!client.valid() || client.write("x", 1) != 1)
+        FAIL_LOG("Unable to connect to inherited listener")
+    const Fastcgipp::Socket accepted = replacement.poll(true);
+    char x;
+    if(!accepted.valid() || accepted.read(&x, 1) != 1 || x != 'x')
+        FAIL_LOG("Inherited listener didn't accept the connection")
+    if(old.size() != 0)
+        FAIL_LOG("Old group is still holding on to something")
+}
+
 int main()
 {
     const auto initialFds = openfds();
@@ -367,13 +433,15 @@ int main()
     }
 
     done=false;
+    listening=false;
     std::thread serverThread(server);
     {
         std::unique_lock<std::mutex> cvLock(cvMutex);
-        cv.wait(cvLock);
+        cv.wait(cvLock, [] { return listening; });
     }
     client();
     serverThread.join();
+    handOff();
 
     if(openfds() != initialFds)
         FAIL_LOG("There are leftover file descriptors after they should all "\
@@ -7,6 +7,8 @@
 #include <random>
 #include <sstream>
 #include <iomanip>
+#include <cstring>
+#include <thread>
 
 #include "fastcgi++/sql/connection.hpp"
 #include "fastcgi++/log.hpp"
@@ -472,6 +474,100 @@ bool TestQuery::handle()
     return false;
 }
 
+namespace
+{
+    //! Queries all queued at once and waited on together
+    class Batch
+    {
+    public:
+        Batch(Fastcgipp::SQL::Connection& connection):
+            m_connection(connection),
+            m_queued(0),
+            m_remaining(0)
+        {}
+
+        //! Queue a query
+        void queue(Fastcgipp::SQL::Query query)
+        {
+            unsigned index;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                index = m_queued++;
+                ++m_remaining;
+            }
+            query.callback = [this, index] (Fastcgipp::Message)
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_completed.push_back(index);
+                --m_remaining;
+                m_wake.notify_one();
+            };
+
+            // Wait for the connection to come up
+            for(unsigned i=0; !m_connection.queue(query); ++i)
+            {
+                if(i == 500)
+                    FAIL_LOG("Unable to queue SQL query")
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+        }
+
+        //! Wait until every queued query is complete
+        void wait()
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if(!m_wake.wait_for(
+                        lock,
+                        std::chrono::seconds(30),
+                        [this] () { return m_remaining == 0; }))
+                FAIL_LOG("SQL queries never completed")
+        }
+
+        //! Indices of the queries in the order they were completed
+        const std::vector<unsigned>& completed() const
+        {
+            return m_completed;
+        }
+
+    private:
+        Fastcgipp::SQL::Connection& m_connection;
+        unsigned m_queued;
+        unsigned m_remaining;
+        std::vector<unsigned> m_completed;
+        std::mutex m_mutex;
+        std::condition_variable m_wake;
+    };
+
+    //! Build a query without parameters
+    Fastcgipp::SQL::Query query(
+            const char* statement,
+            std::shared_ptr<Fastcgipp::SQL::Results_base> results)
+    {
+        Fastcgipp::SQL::Query query;
+        query.statement = statement;
+        query.results = results;
+        return query;
+    }
+
+    //! Connect to the test database
+    void connect(
+            Fastcgipp::SQL::Connection& connection,
+            unsigned concurrency=1,
+            unsigned pipeline=1)
+    {
+        connection.init(
+                "",
+                "fastcgipp_test",
+                "fastcgipp_test",
+                "fastcgipp_test",
+                concurrency,
+                5432,
+                5432,
+                30,
+                pipeline);
+    }
+}
+
 int main()
 {
     // Test the SQL parameters stuff
@@ -660,6 +756,115 @@ int main()
                 FAIL_LOG("Fastcgipp::SQL::Parameters failed formats array")
     }
 
+    // Test the SQL bulk copy data
+    {
+        static const std::array<unsigned char, 46> proper{
+            'P', 'G', 'C', 'O', 'P', 'Y', '\n', 0xff, '\r', '\n', 0x00,
+            0x00, 0x00, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x00,
+            0x00, 0x02,
+            0x00, 0x00, 0x00, 0x02,
+            0xfa, 0x7b,
+            0x00, 0x00, 0x00, 0x03,
+            'a', 'b', 'c',
+            0x00, 0x02,
+            0x00, 0x00, 0x00, 0x02,
+            0x00, 0x07,
+            0x00, 0x00, 0x00, 0x00
+        };
+
+        auto copy(Fastcgipp::SQL::make_Copy<int16_t, std::string>());
+        copy->push(-1413, "abc");
+        copy->push(std::make_tuple(int16_t(7), std::string()));
+        if(copy->rows() != 2)
+            FAIL_LOG("Fastcgipp::SQL::Copy row count is wrong")
+        copy->finish();
+        copy->finish();
+        if(
+                copy->size() != proper.size()+2 ||
+                !std::equal(
+                    reinterpret_cast<const char*>(proper.begin()),
+                    reinterpret_cast<const char*>(proper.end()),
+                    copy->data()) ||
+                Fastcgipp::BigEndian<int16_t>::read(
+                    copy->data()+proper.size()) != -1)
+            FAIL_LOG("Fastcgipp::SQL::Copy data is wrong")
+    }
+
+    // Test zero copy fields and column extraction
+    {
+        struct LocalResults:
+            public Fastcgipp::SQL::Results<int64_t, Fastcgipp::SQL::View>
+        {
+            LocalResults(PGresult* res)
+            {
+                m_res = res;
+            }
+        };
+
+        PGresult* res = PQmakeEmptyPGresult(nullptr, PGRES_TUPLES_OK);
+        PGresAttDesc attributes[2] = {
+            {const_cast<char*>("number"), 0, 0, 1, INT8OID, 8, -1},
+            {const_cast<char*>("name"), 0, 0, 1, TEXTOID, -1, -1}
+        };
+        if(!PQsetResultAttrs(res, 2, attributes))
+            FAIL_LOG("Unable to build local SQL result set")
+
+        const unsigned rows = 37;
+        std::vector<int64_t> numbers;
+        std::vector<std::string> names;
+        for(unsigned i=0; i<rows; ++i)
+        {
+            numbers.push_back(int64_t(i)*-0x0102030405060708LL);
+            names.push_back("row" + std::to_string(i));
+            const Fastcgipp::BigEndian<int64_t> number(numbers.back());
+            PQsetvalue(
+                    res,
+                    i,
+                    0,
+                    const_cast<char*>(number.data()),
+                    sizeof(int64_t));
+            PQsetvalue(
+                    res,
+                    i,
+                    1,
+                    const_cast<char*>(names.back().data()),
+                    names.back().size());
+        }
+        PQsetvalue(res, rows, 0, nullptr, -1);
+        PQsetvalue(res, rows, 1, nullptr, -1);
+        numbers.push_back(0);
+        names.emplace_back();
+
+        LocalResults results(res);
+        if(results.verify() != 0)
+            FAIL_LOG("Fastcgipp::SQL::View columns don't verify")
+
+        std::vector<int64_t> numberColumn;
+        if(!results.column(0, numberColumn) || numberColumn != numbers)
+            FAIL_LOG("Fastcgipp::SQL::Results_base::column() numbers are wrong")
+
+        std::vector<Fastcgipp::SQL::View> nameColumn;
+        if(!results.column(1, nameColumn) || nameColumn.size() != rows+1)
+            FAIL_LOG("Fastcgipp::SQL::Results_base::column() names are wrong")
+        for(unsigned i=0; i<=rows; ++i)
+            if(nameColumn[i].str() != names[i])
+                FAIL_LOG("Fastcgipp::SQL::Results_base::column() names are "\
+                        "wrong")
+
+        std::vector<int32_t> wrongColumn;
+        if(results.column(0, wrongColumn) || results.column(1, numberColumn))
+            FAIL_LOG("Fastcgipp::SQL::Results_base::column() accepted the "\
+                    "wrong type")
+
+        const auto row = results.row(5);
+        if(
+                std::get<0>(row) != numbers[5] ||
+                std::get<1>(row) != results.view(5, 1) ||
+                std::get<1>(row).data() != results.view(5, 1).data())
+            FAIL_LOG("Fastcgipp::SQL::View row data is wrong")
+    }
+
     // Test the SQL Connection
     {
         using namespace std::chrono_literals;
@@ -669,5 +874,293 @@ int main()
         TestQuery::stop();
     }
 
+    // Errors in a pipeline only take out the query they belong to
+    {
+        typedef Fastcgipp::SQL::Results<int32_t> Results;
+        static const char one[] = "SELECT 1::int4;";
+        static const char divide[] = "SELECT (1/0)::int4;";
+        static const char missing[] = "SELECT nothere FROM fastcgipp_test;";
+
+        Fastcgipp::SQL::Connection connection;
+        connect(connection, 1, 16);
+        connection.start();
+
+        for(unsigned round=0; round<2; ++round)
+        {
+            Batch batch(connection);
+            std::vector<std::shared_ptr<Results>> good;
+            std::vector<std::shared_ptr<Results>> bad;
+            for(unsigned i=0; i<12; ++i)
+            {
+                std::shared_ptr<Results> results(new Results);
+                const char* statement = one;
+                if(i%4 == 1)
+                    statement = divide;
+                else if(i%4 == 2 || i%4 == 3)
+                    statement = missing;
+                batch.queue(query(statement, results));
+                (statement == one ? good : bad).push_back(results);
+            }
+            batch.wait();
+
+            for(const auto& results: good)
+                if(results->status() != Fastcgipp::SQL::Status::rowsOk
+                        || results->rows() != 1
+                        || std::get<0>(results->row(0)) != 1)
+                    FAIL_LOG("Pipelined query was taken out by another's " \
+                            "error: " << results->errorMessage())
+            for(const auto& results: bad)
+                if(results->status() != Fastcgipp::SQL::Status::fatalError
+                        || std::strstr(results->errorMessage(), "abort"))
+                    FAIL_LOG("Failing pipelined query didn't get it's own " \
+                            "error: " << results->errorMessage())
+        }
+
+        connection.stop();
+        connection.join();
+    }
+
+    // Statements are prepared once per connection and run by name after
+    {
+        typedef Fastcgipp::SQL::Results<int32_t> Results;
+        static const char one[] = "SELECT 1::int4;";
+        static const char same[] = "SELECT 1::int4;";
+        static const char missing[] = "SELECT nothere FROM fastcgipp_test;";
+
+        Fastcgipp::SQL::Connection connection;
+        connect(connection);
+        connection.start();
+
+        const auto run = [&connection] (const char* statement)
+        {
+            std::shared_ptr<Results> results(new Results);
+            Batch batch(connection);
+            batch.queue(query(statement, results));
+            batch.wait();
+            return results;
+        };
+        const auto counts = [&connection] (
+                unsigned long long hits,
+                unsigned long long misses)
+        {
+            return connection.statementHits() == hits
+                && connection.statementMisses() == misses;
+        };
+
+        for(unsigned i=0; i<3; ++i)
+            if(run(one)->status() != Fastcgipp::SQL::Status::rowsOk)
+                FAIL_LOG("Cached statement didn't run")
+        if(!counts(2, 1))
+            FAIL_LOG("Statement wasn't prepared once and then reused")
+
+        // Statements are found by address so the same text is a miss
+        if(run(same)->status() != Fastcgipp::SQL::Status::rowsOk
+                || !counts(2, 2))
+            FAIL_LOG("Statement at another address wasn't a miss")
+
+        // Statements that fail to prepare are a miss every time
+        for(unsigned i=0; i<2; ++i)
+            if(run(missing)->status() != Fastcgipp::SQL::Status::fatalError)
+                FAIL_LOG("Broken statement didn't fail")
+        if(!counts(2, 4))
+            FAIL_LOG("Broken statement wasn't a miss both times")
+
+        // Once full, further statements run unprepared and nothing already
+        // prepared is pushed out. There is room for 256 per connection.
+        const unsigned room = 256-2;
+        std::vector<std::string> statements;
+        for(unsigned i=0; i<room+20; ++i)
+            statements.push_back(
+                    "SELECT " + std::to_string(i) + "::int4;");
+        for(unsigned round=0; round<2; ++round)
+        {
+            Batch batch(connection);
+            std::vector<std::shared_ptr<Results>> results;
+            for(const auto& statement: statements)
+            {
+                results.emplace_back(new Results);
+                batch.queue(query(statement.c_str(), results.back()));
+            }
+            batch.wait();
+
+            for(unsigned i=0; i<results.size(); ++i)
+                if(results[i]->status() != Fastcgipp::SQL::Status::rowsOk
+                        || std::get<0>(results[i]->row(0)) != int32_t(i))
+                    FAIL_LOG("Statement beyond a full cache didn't run: " \
+                            << results[i]->errorMessage())
+        }
+        if(!counts(2+room, 4+room+20+20))
+            FAIL_LOG("Full statement cache didn't count properly")
+        if(run(one)->status() != Fastcgipp::SQL::Status::rowsOk
+                || !counts(3+room, 4+room+40))
+            FAIL_LOG("Statement was pushed out of a full cache")
+
+        connection.stop();
+        connection.join();
+    }
+
+    // Queries are sent by priority and dropped once past their deadline
+    {
+        typedef Fastcgipp::SQL::Results<int32_t> Results;
+        static const char one[] = "SELECT 1::int4;";
+        static const char sleep[] = "SELECT 1::int4 FROM pg_sleep(0.5);";
+
+        Fastcgipp::SQL::Connection connection;
+        connect(connection);
+        connection.start();
+
+        // The first query keeps the only connection busy while the rest
+        // queue up behind it
+        {
+            Batch batch(connection);
+            batch.queue(query(sleep, std::make_shared<Results>()));
+            for(const unsigned priority: {3, 3, 0, 0, 1})
+            {
+                auto queued = query(one, std::make_shared<Results>());
+                queued.priority = priority;
+                batch.queue(queued);
+            }
+            batch.wait();
+            if(batch.completed() != std::vector<unsigned>{0, 3, 4, 5, 1, 2})
+                FAIL_LOG("SQL queries weren't sent in order of priority")
+        }
+
+        {
+            const auto now = std::chrono::steady_clock::now();
+            const auto expiring = std::make_shared<Results>();
+            const auto lasting = std::make_shared<Results>();
+            Batch batch(connection);
+            batch.queue(query(sleep, std::make_shared<Results>()));
+            auto expires = query(one, expiring);
+            expires.deadline = now+std::chrono::milliseconds(100);
+            batch.queue(expires);
+            auto lasts = query(one, lasting);
+            lasts.deadline = now+std::chrono::seconds(30);
+            batch.queue(lasts);
+            batch.wait();
+            if(expiring->status() != Fastcgipp::SQL::Status::expired)
+                FAIL_LOG("SQL query wasn't dropped past it's deadline")
+            if(lasting->status() != Fastcgipp::SQL::Status::rowsOk)
+                FAIL_LOG("SQL query within it's deadline didn't run")
+        }
+
+        connection.stop();
+        connection.join();
+    }
+
+    // The pool grows while queries back up and shrinks once idle
+    {
+        typedef Fastcgipp::SQL::Results<int32_t> Results;
+        static const char backend[]
+            = "SELECT pg_backend_pid() FROM pg_sleep(0.2);";
+        static const char connections[]
+            = "SELECT count(*)::int4 FROM pg_stat_activity "
+            "WHERE usename = current_user;";
+
+        Fastcgipp::SQL::Connection connection;
+        connect(connection);
+        connection.pool(4, 1, 10);
+        connection.start();
+
+        std::vector<std::shared_ptr<Results>> results;
+        Batch batch(connection);
+        for(unsigned i=0; i<16; ++i)
+        {
+            results.push_back(std::make_shared<Results>());
+            batch.queue(query(backend, results.back()));
+        }
+        batch.wait();
+
+        std::vector<int32_t> backends;
+        for(const auto& result: results)
+        {
+            if(result->status() != Fastcgipp::SQL::Status::rowsOk)
+                FAIL_LOG("SQL query in a growing pool failed: " \
+                        << result->errorMessage())
+            backends.push_back(std::get<0>(result->row(0)));
+        }
+        std::sort(backends.begin(), backends.end());
+        const size_t size = std::unique(backends.begin(), backends.end())
+            - backends.begin();
+        if(size < 2 || size > 4)
+            FAIL_LOG("SQL pool grew to " << size << " connections")
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(2500));
+        const auto count = std::make_shared<Results>();
+        Batch counting(connection);
+        counting.queue(query(connections, count));
+        counting.wait();
+        if(count->status() != Fastcgipp::SQL::Status::rowsOk
+                || std::get<0>(count->row(0)) != 1)
+            FAIL_LOG("Idle SQL connections beyond the first weren't closed")
+
+        connection.stop();
+        connection.join();
+    }
+
+    // Large result sets are streamed in batches of rows
+    {
+        typedef Fastcgipp::SQL::StreamResults<int32_t> Results;
+        static const char series[]
+            = "SELECT x::int4 FROM generate_series(1, 1000) AS x;";
+
+        Fastcgipp::SQL::Connection connection;
+        connect(connection);
+        connection.start();
+
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::vector<int32_t> rows;
+        unsigned batches = 0;
+        bool broken = false;
+        bool complete = false;
+
+        const auto results = std::make_shared<Results>();
+        auto streamed = query(series, results);
+        streamed.batch = 100;
+        streamed.callback = [&] (Fastcgipp::Message)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            while(results->next())
+            {
+                if(results->status() != Fastcgipp::SQL::Status::rowsOk
+                        || results->verify() != 0
+                        || results->rows() > 100)
+                    broken = true;
+                if(results->rows() != 0)
+                    ++batches;
+                for(unsigned i=0; i<results->rows(); ++i)
+                    rows.push_back(std::get<0>(results->row(i)));
+            }
+            complete = results->complete();
+            wake.notify_one();
+        };
+        for(unsigned i=0; !connection.queue(streamed); ++i)
+        {
+            if(i == 500)
+                FAIL_LOG("Unable to queue SQL query")
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+
+        std::unique_lock<std::mutex> lock(mutex);
+        if(!wake.wait_for(
+                    lock,
+                    std::chrono::seconds(30),
+                    [&complete] () { return complete; }))
+            FAIL_LOG("Streamed SQL query never completed")
+        if(broken)
+            FAIL_LOG("Streamed SQL rows came in a bad batch")
+        if(batches != 10 || rows.size() != 1000)
+            FAIL_LOG("Streamed SQL rows came in " << batches \
+                    << " batches of " << rows.size() << " rows")
+        for(unsigned i=0; i<rows.size(); ++i)
+            if(rows[i] != int32_t(i+1))
+                FAIL_LOG("Streamed SQL rows came out of order")
+        lock.unlock();
+
+        connection.stop();
+        connection.join();
+    }
+
     return 0;
 }
@@ -0,0 +1,168 @@
+#include "fastcgi++/log.hpp"
+#include "fastcgi++/timers.hpp"
+
+#include <vector>
+#include <random>
+#include <algorithm>
+
+#include <poll.h>
+
+namespace
+{
+    //! Expire the timers until there are none left or we give up
+    void run(Fastcgipp::Timers& timers, Fastcgipp::Timers::Clock::duration limit)
+    {
+        const auto end = Fastcgipp::Timers::Clock::now()+limit;
+        while(timers.size() && Fastcgipp::Timers::Clock::now() < end)
+        {
+            pollfd descriptor;
+            descriptor.fd = timers.descriptor();
+            descriptor.events = POLLIN;
+            const int timeout = timers.timeout();
+            if(descriptor.fd >= 0)
+                ::poll(&descriptor, 1, 100);
+            else if(timeout > 0)
+                ::poll(nullptr, 0, timeout);
+            timers.expire();
+        }
+    }
+}
+
+int main()
+{
+    typedef Fastcgipp::Timers::Clock Clock;
+
+    // Timers fire in order, never early and not too late
+    {
+        Fastcgipp::Timers timers(nullptr);
+        std::mt19937 random(1);
+        std::uniform_int_distribution<int> delays(0, 1500);
+
+        const unsigned count = 500;
+        std::vector<Clock::time_point> due(count);
+        std::vector<Clock::time_point> fired(count);
+        const auto start = Clock::now();
+        for(unsigned i=0; i<count; ++i)
+        {
+            due[i] = start+std::chrono::milliseconds(delays(random));
+            timers.add(due[i], [&fired, i] ()
+                    {
+                        fired[i] = Clock::now();
+                    });
+        }
+        if(timers.size() != count)
+            FAIL_LOG("Fastcgipp::Timers has " << timers.size() \
+                    << " timers instead of " << count)
+
+        run(timers, std::chrono::seconds(5));
+
+        if(timers.size() != 0)
+            FAIL_LOG("Fastcgipp::Timers didn't fire all timers")
+        for(unsigned i=0; i<count; ++i)
+        {
+            if(fired[i] < due[i])
+                FAIL_LOG("Fastcgipp::Timers fired a timer early")
+            if(fired[i]-due[i] > std::chrono::milliseconds(200))
+                FAIL_LOG("Fastcgipp::Timers fired a timer " \
+                        << std::chrono::duration_cast<std::chrono::milliseconds>(
+                            fired[i]-due[i]).count() << "ms late")
+        }
+    }
+
+    // Cancelled timers don't fire and Ids don't get reused
+    {
+        Fastcgipp::Timers timers(nullptr);
+        std::vector<Fastcgipp::Timers::Id> ids;
+        std::vector<int> fired(100, 0);
+        for(unsigned i=0; i<fired.size(); ++i)
+            ids.push_back(timers.add(
+                        std::chrono::milliseconds(10+i),
+                        [&fired, i] ()
+                        {
+                            ++fired[i];
+                        }));
+        for(unsigned i=0; i<ids.size(); i+=2)
+            if(!timers.cancel(ids[i]))
+                FAIL_LOG("Fastcgipp::Timers couldn't cancel a timer")
+        if(timers.cancel(ids[0]))
+            FAIL_LOG("Fastcgipp::Timers cancelled a timer twice")
+        if(timers.cancel(0))
+            FAIL_LOG("Fastcgipp::Timers cancelled timer zero")
+
+        run(timers, std::chrono::seconds(5));
+
+        for(unsigned i=0; i<fired.size(); ++i)
+            if(fired[i] != int(i%2))
+                FAIL_LOG("Fastcgipp::Timers fired timer " << i << ' ' \
+                        << fired[i] << " times")
+        if(timers.cancel(ids[1]))
+            FAIL_LOG("Fastcgipp::Timers cancelled a fired timer")
+
+        // The freed nodes get reused but the old Ids must stay dead
+        const auto id = timers.add(std::chrono::hours(1), [] () {});
+        for(const auto old: ids)
+            if(old == id || timers.cancel(old))
+                FAIL_LOG("Fastcgipp::Timers reused an Id")
+        if(!timers.cancel(id))
+            FAIL_LOG("Fastcgipp::Timers couldn't cancel a reused node")
+    }
+
+    // Timers can add and cancel timers from within a timer
+    {
+        Fastcgipp::Timers timers(nullptr);
+        int ticks = 0;
+        std::function<void()> tick;
+        tick = [&] ()
+        {
+            if(++ticks < 5)
+                timers.add(std::chrono::milliseconds(3), tick);
+        };
+        timers.add(std::chrono::milliseconds(3), tick);
+        run(timers, std::chrono::seconds(5));
+        if(ticks != 5)
+            FAIL_LOG("Fastcgipp::Timers ran a rescheduling timer " << ticks \
+                    << " times")
+    }
+
+    // Far off timers across every level don't fire early
+    {
+        Fastcgipp::Timers timers(nullptr);
+        std::mt19937 random(2);
+        std::uniform_int_distribution<long long> delays(
+                1, 60LL*24*3600*1000);
+        std::vector<Fastcgipp::Timers::Id> ids;
+        const unsigned count = 10000;
+        const auto nearest = std::chrono::seconds(10);
+        const Clock::time_point start = Clock::now();
+        ids.reserve(count);
+        for(unsigned i=0; i<count; ++i)
+            ids.push_back(timers.add(
+                        start+nearest+std::chrono::milliseconds(
+                            delays(random)),
+                        [] ()
+                        {
+                            FAIL_LOG("Fastcgipp::Timers fired a far off timer")
+                        }));
+        if(timers.size() != count)
+            FAIL_LOG("Fastcgipp::Timers lost far off timers")
+
+        // Whatever time went by since the start comes off the timeout
+        const int timeout = timers.timeout();
+        const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                start+nearest-Clock::now()).count();
+        if(timeout < left-100 || timeout > 66000)
+            FAIL_LOG("Fastcgipp::Timers has a weird timeout of " << timeout \
+                    << " with " << left << "ms left")
+        if(Clock::now() < start+nearest)
+            timers.expire();
+
+        std::shuffle(ids.begin(), ids.end(), random);
+        for(const auto id: ids)
+            if(!timers.cancel(id))
+                FAIL_LOG("Fastcgipp::Timers couldn't cancel a far off timer")
+        if(timers.size() != 0 || timers.timeout() != -1)
+            FAIL_LOG("Fastcgipp::Timers isn't empty after cancelling")
+    }
+
+    return 0;
+}
@@ -0,0 +1,282 @@
+#include "fastcgi++/log.hpp"
+#include "fastcgi++/manager.hpp"
+#include "fastcgi++/topic.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace
+{
+    Fastcgipp::Topic events(4096);
+
+    //! Streams whatever is published to events
+    class Events: public Fastcgipp::Request<char>
+    {
+        bool response()
+        {
+            out << "Content-Type: text/event-stream\r\n\r\n";
+            subscribe(events);
+            return true;
+        }
+    };
+
+    //! Append a FastCGI record to a buffer
+    void record(
+            std::vector<char>& buffer,
+            Fastcgipp::Protocol::RecordType type,
+            Fastcgipp::Protocol::FcgiId id,
+            const std::string& content)
+    {
+        Fastcgipp::Protocol::Header header;
+        header.version = Fastcgipp::Protocol::version;
+        header.type = type;
+        header.fcgiId = id;
+        header.contentLength = content.size();
+        header.paddingLength = 0;
+        header.reserved = 0;
+        const char* const raw = reinterpret_cast<const char*>(&header);
+        buffer.insert(buffer.end(), raw, raw+sizeof(header));
+        buffer.insert(buffer.end(), content.begin(), content.end());
+    }
+
+    //! A client of the web server streaming events
+    class Client
+    {
+    public:
+        //! Connect and make the request
+        Client(const std::string& path, Fastcgipp::Protocol::FcgiId id):
+            m_fd(::socket(AF_UNIX, SOCK_STREAM, 0)),
+            m_id(id),
+            m_ended(false)
+        {
+            sockaddr_un address;
+            std::memset(&address, 0, sizeof(address));
+            address.sun_family = AF_UNIX;
+            std::strncpy(
+                    address.sun_path,
+                    path.c_str(),
+                    sizeof(address.sun_path)-1);
+            if(::connect(
+                        m_fd,
+                        reinterpret_cast<sockaddr*>(&address),
+                        sizeof(address)) != 0)
+                FAIL_LOG("Unable to connect to " << path.c_str())
+
+            using Fastcgipp::Protocol::RecordType;
+            std::vector<char> buffer;
+            Fastcgipp::Protocol::BeginRequest begin;
+            std::memset(&begin, 0, sizeof(begin));
+            begin.role = Fastcgipp::Protocol::Role::RESPONDER;
+            record(
+                    buffer,
+                    RecordType::BEGIN_REQUEST,
+                    id,
+                    std::string(
+                        reinterpret_cast<const char*>(&begin),
+                        sizeof(begin)));
+            record(
+                    buffer,
+                    RecordType::PARAMS,
+                    id,
+                    std::string("\x0e\x03REQUEST_METHODGET"));
+            record(buffer, RecordType::PARAMS, id, "");
+            record(buffer, RecordType::IN, id, "");
+            if(::send(m_fd, buffer.data(), buffer.size(), MSG_NOSIGNAL)
+                    != ssize_t(buffer.size()))
+                FAIL_LOG("Unable to send request")
+        }
+
+        ~Client()
+        {
+            hangUp();
+        }
+
+        //! Have the web server abort the request
+        void abort()
+        {
+            std::vector<char> buffer;
+            record(
+                    buffer,
+                    Fastcgipp::Protocol::RecordType::ABORT_REQUEST,
+                    m_id,
+                    "");
+            if(::send(m_fd, buffer.data(), buffer.size(), MSG_NOSIGNAL)
+                    != ssize_t(buffer.size()))
+                FAIL_LOG("Unable to send abort")
+        }
+
+        void hangUp()
+        {
+            if(m_fd >= 0)
+                ::close(m_fd);
+            m_fd = -1;
+        }
+
+        //! Take the next size bytes of output
+        std::string next(size_t size)
+        {
+            while(m_output.size() < size && receive()) {}
+            if(m_output.size() < size)
+                FAIL_LOG("Only got " << m_output.size() << " of " << size \
+                        << " bytes of output")
+            const std::string output(m_output, 0, size);
+            m_output.erase(0, size);
+            return output;
+        }
+
+        //! Wait until the request ends
+        bool ended()
+        {
+            while(!m_ended && receive()) {}
+            return m_ended;
+        }
+
+    private:
+        int m_fd;
+        const Fastcgipp::Protocol::FcgiId m_id;
+        std::string m_received;
+        std::string m_output;
+        bool m_ended;
+
+        //! Receive whatever arrives within a few seconds
+        bool receive()
+        {
+            pollfd descriptor = {m_fd, POLLIN, 0};
+            if(::poll(&descriptor, 1, 5000) != 1)
+                return false;
+            char chunk[0x10000];
+            const ssize_t size = ::read(m_fd, chunk, sizeof(chunk));
+            if(size <= 0)
+                return false;
+            m_received.append(chunk, size);
+
+            const size_t headerSize = sizeof(Fastcgipp::Protocol::Header);
+            while(m_received.size() >= headerSize)
+            {
+                const Fastcgipp::Protocol::Header& header
+                    = *reinterpret_cast<const Fastcgipp::Protocol::Header*>(
+                            m_received.data());
+                const size_t recordSize = headerSize+header.contentLength
+                    +header.paddingLength;
+                if(m_received.size() < recordSize)
+                    break;
+                if(header.type == Fastcgipp::Protocol::RecordType::OUT)
+                    m_output.append(
+                            m_received,
+                            headerSize,
+                            header.contentLength);
+                else if(header.type
+                        == Fastcgipp::Protocol::RecordType::END_REQUEST)
+                    m_ended = true;
+                m_received.erase(0, recordSize);
+            }
+            return true;
+        }
+    };
+
+    //! Wait for the topic to have a number of subscribers
+    bool subscribers(size_t count)
+    {
+        for(unsigned i=0; i<500 && events.size() != count; ++i)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        return events.size() == count;
+    }
+}
+
+int main()
+{
+    const std::string path = "/tmp/fastcgipp-topic-test-"
+        + std::to_string(::getpid());
+    Fastcgipp::Manager<Events> manager(2);
+    if(!manager.listen(path.c_str()))
+        FAIL_LOG("Unable to listen on " << path.c_str())
+    manager.start();
+
+    const std::string headers = "Content-Type: text/event-stream\r\n\r\n";
+    Client first(path, 1);
+    Client second(path, 1);
+    Client other(path, 7);
+
+    // Requests hand themselves off once their headers are out
+    {
+        if(!subscribers(3))
+            FAIL_LOG("Requests didn't subscribe")
+        if(first.next(headers.size()) != headers
+                || second.next(headers.size()) != headers
+                || other.next(headers.size()) != headers)
+            FAIL_LOG("Headers didn't come before subscribing")
+        if(Fastcgipp::Metrics::activeRequests.value() != 0
+                || Fastcgipp::Metrics::subscribers.value() != 3)
+            FAIL_LOG("Subscribed requests are still active")
+    }
+
+    // Everyone gets everything published whatever their request ID
+    {
+        events.event("hello\nworld", "greeting", "7");
+        events.heartbeat();
+        const std::string event
+            = "id: 7\nevent: greeting\ndata: hello\ndata: world\n\n:\n";
+        for(Client* client: {&first, &second, &other})
+            if(client->next(event.size()) != event)
+                FAIL_LOG("Event didn't come through")
+
+        const std::string large(100000, 'x');
+        events.publish(large);
+        for(Client* client: {&first, &second, &other})
+            if(client->next(large.size()) != large)
+                FAIL_LOG("Output spanning records didn't come through")
+    }
+
+    // Aborted requests are ended and the rest carry on
+    {
+        Client aborted(path, 3);
+        if(!subscribers(4) || aborted.next(headers.size()) != headers)
+            FAIL_LOG("Request to abort didn't subscribe")
+        aborted.abort();
+        if(!aborted.ended())
+            FAIL_LOG("Aborted request wasn't ended")
+        if(events.size() != 3 || Fastcgipp::Metrics::subscribers.value() != 3)
+            FAIL_LOG("Aborted request is still subscribed")
+
+        events.publish("z");
+        for(Client* client: {&first, &second, &other})
+            if(client->next(1) != "z")
+                FAIL_LOG("Subscribers missed out after an abort")
+    }
+
+    // Gone and slow subscribers are left behind
+    {
+        second.hangUp();
+        const std::string chunk(0x400, 'y');
+        for(unsigned i=0; i<10000 && events.size() > 1; ++i)
+        {
+            events.publish(chunk);
+            if(first.next(chunk.size()) != chunk)
+                FAIL_LOG("Subscriber that keeps up missed out")
+        }
+        if(events.size() != 1
+                || Fastcgipp::Metrics::subscriberDrops.value() != 1)
+            FAIL_LOG("Subscribers weren't dropped properly")
+    }
+
+    events.close();
+    if(!first.ended())
+        FAIL_LOG("Closing the topic didn't end the request")
+    if(events.size() != 0 || Fastcgipp::Metrics::subscribers.value() != 0)
+        FAIL_LOG("Closed topic still has subscribers")
+
+    other.hangUp();
+    manager.stop();
+    manager.join();
+    ::unlink(path.c_str());
+
+    return 0;
+}
@@ -15,6 +15,9 @@
 #include <atomic>
 #include <condition_variable>
 #include <array>
+#include <cstdio>
+
+#include <unistd.h>
 
 const unsigned int maxConnections=64;
 const unsigned int maxRequests=2024;
@@ -49,6 +52,11 @@ std::queue<Echo> echoQueue;
 std::condition_variable echoCv;
 std::atomic_bool echoTerminate;
 
+// Every other echo is sent back by way of this file
+std::shared_ptr<const int> echoFile;
+std::atomic<off_t> echoFileOffset;
+std::atomic_uint echoCount;
+
 std::vector<std::pair<size_t, Fastcgipp::Protocol::FcgiId>> sizes;
 
 void receive(
@@ -81,10 +89,32 @@ void echo()
 
             const Kill& killer = *reinterpret_cast<Kill*>(echo.data.begin()
                     +sizeof(Fastcgipp::Protocol::Header));
-            transceiver.send(
-                    echo.id.m_socket,
-                    std::move(echo.data),
-                    killer==Kill::SERVER);
+            if(killer!=Kill::SERVER && ++echoCount%2)
+            {
+                const size_t size = reinterpret_cast<
+                    Fastcgipp::Protocol::Header*>(
+                            echo.data.begin())->contentLength;
+                const off_t offset = echoFileOffset.fetch_add(size);
+                if(::pwrite(
+                            *echoFile,
+                            echo.data.begin()
+                                +sizeof(Fastcgipp::Protocol::Header),
+                            size,
+                            offset) != ssize_t(size))
+                    FAIL_LOG("Unable to write echo to file")
+                echo.data.size(sizeof(Fastcgipp::Protocol::Header));
+                transceiver.sendFile(
+                        echo.id.m_socket,
+                        std::move(echo.data),
+                        echoFile,
+                        offset,
+                        size);
+            }
+            else
+                transceiver.send(
+                        echo.id.m_socket,
+                        std::move(echo.data),
+                        killer==Kill::SERVER);
 
             lock.lock();
         }
@@ -372,6 +402,18 @@ int main()
     std::uniform_int_distribution<> portDist(2048, 65534);
     port = std::to_string(portDist(trueRand));
 
+    FILE* const file = std::tmpfile();
+    if(file == nullptr)
+        FAIL_LOG("Unable to create echo file")
+    echoFile.reset(new int(fileno(file)), [file] (const int* x)
+            {
+                std::fclose(file);
+                delete x;
+            });
+    echoFileOffset = 0;
+    echoCount = 0;
+
+    transceiver.resizeLoops(3, true);
     if(!transceiver.listen("127.0.0.1", port.c_str()))
         FAIL_LOG("Unable to listen")
     transceiver.start();